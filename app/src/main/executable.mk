@@ -1,5 +1,9 @@
 LOCAL_PATH := $(call my-dir)
 
+# Developer tools, built by build.gradle's build<Variant>Tools task and
+# not installed with the app; adb push them to /data/local/tmp to run
+# them (libpuzzles.so has to be pushed alongside).
+
 # Built earlier by Gradle's generated Android.mk
 include $(CLEAR_VARS)
 LOCAL_MODULE    := libpuzzles-prebuilt
@@ -8,7 +12,34 @@ include $(PREBUILT_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
 LOCAL_MODULE    := puzzlesgen$(PUZZLESGEN_SUFFIX)
-LOCAL_CFLAGS    := -DSLOW_SYSTEM -DANDROID -DSTYLUS_BASED -DNO_PRINTING -DCOMBINED -DEXECUTABLE
+LOCAL_CFLAGS    := -DSLOW_SYSTEM -DANDROID -DSTYLUS_BASED -DCOMBINED -DEXECUTABLE
 LOCAL_SRC_FILES := jni/android-gen.c
 LOCAL_SHARED_LIBRARIES := libpuzzles-prebuilt
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE    := puzzles-bench$(PUZZLESGEN_SUFFIX)
+LOCAL_CFLAGS    := -DSLOW_SYSTEM -DANDROID -DSTYLUS_BASED -DCOMBINED -DEXECUTABLE
+LOCAL_SRC_FILES := jni/android-bench.c
+LOCAL_SHARED_LIBRARIES := libpuzzles-prebuilt
+include $(BUILD_EXECUTABLE)
+
+# The games' standalone solvers, for puzzles-bench --solvers; push them
+# next to it. Like puzzlesgen they take the rest of the game code from
+# libpuzzles, but latin.c has solver-only code, so those that use it
+# get their own copy.
+define solver
+include $$(CLEAR_VARS)
+LOCAL_MODULE    := $(1)solver$$(PUZZLESGEN_SUFFIX)
+LOCAL_CFLAGS    := -DSLOW_SYSTEM -DANDROID -DSTYLUS_BASED -DSTANDALONE_SOLVER $(3)
+LOCAL_SRC_FILES := $(patsubst %,jni/%.c,$(1) $(2))
+LOCAL_SHARED_LIBRARIES := libpuzzles-prebuilt
+include $$(BUILD_EXECUTABLE)
+endef
+
+$(foreach game,filling galaxies lightup loopy magnets map pattern pearl \
+		signpost slant solo tents unruly,\
+	$(eval $(call solver,$(game))))
+$(foreach game,keen singles towers unequal,\
+	$(eval $(call solver,$(game),latin)))
+$(eval $(call solver,latin,,-DSTANDALONE_LATIN_TEST))
@@ -10,8 +10,12 @@ import android.content.ActivityNotFoundException;
 import android.content.Intent;
 import android.content.SharedPreferences;
 import android.content.res.Configuration;
+import android.graphics.Bitmap;
+import android.graphics.Color;
 import android.graphics.PorterDuff;
 import android.graphics.Rect;
+import android.graphics.drawable.BitmapDrawable;
+import android.graphics.drawable.ColorDrawable;
 import android.graphics.drawable.Drawable;
 import android.graphics.drawable.LayerDrawable;
 import android.graphics.drawable.StateListDrawable;
@@ -44,7 +48,7 @@ import java.util.List;
 import java.util.Set;
 
 @SuppressWarnings("WeakerAccess")  // used by manifest
-public class GameChooser extends ActionBarActivity
+public class GameChooser extends ActionBarActivity implements IconCache.Callback
 {
 	static final String CHOOSER_STYLE_KEY = "chooserStyle";
 	private static final Set<String> DEFAULT_STARRED = new LinkedHashSet<String>();
@@ -59,6 +63,7 @@ public class GameChooser extends ActionBarActivity
 	}
 
 	private static final int REQ_CODE_PICKER = Activity.RESULT_FIRST_USER;
+	private static final String STAR = "ic_star";
 
     private GridLayout table;
 
@@ -75,12 +80,15 @@ public class GameChooser extends ActionBarActivity
 	private ScrollView scrollView;
 	private int scrollToOnNextLayout = -1;
 	private long resumeTime = 0;
+	private IconCache icons;
+	private int iconSize;
 
 	@Override
     @SuppressLint("CommitPrefEdits")
     protected void onCreate(Bundle savedInstanceState)
 	{
 		super.onCreate(savedInstanceState);
+		GamePlay.coldStartPending = false;  // launches via the chooser aren't timed
 		prefs = PreferenceManager.getDefaultSharedPreferences(this);
         SharedPreferences state = getSharedPreferences(GamePlay.STATE_PREFS_NAME, MODE_PRIVATE);
 		prefsSaver = PrefsSaver.get(this);
@@ -109,6 +117,8 @@ public class GameChooser extends ActionBarActivity
 		table = (GridLayout) findViewById(R.id.table);
 		starredHeader = (TextView) findViewById(R.id.games_starred);
 		otherHeader = (TextView) findViewById(R.id.games_others);
+		icons = IconCache.get(this);
+		iconSize = (int) (64 * getResources().getDisplayMetrics().density);
 		buildViews();
 		rethinkActionBarCapacity();
 		if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.KITKAT) {
@@ -174,6 +184,12 @@ public class GameChooser extends ActionBarActivity
 		}
 	}
 
+	@Override
+	protected void onDestroy() {
+		icons.forget(this);
+		super.onDestroy();
+	}
+
 	@TargetApi(Build.VERSION_CODES.JELLY_BEAN)
 	private void enableTableAnimations() {
 		final LayoutTransition transition = new LayoutTransition();
@@ -187,8 +203,7 @@ public class GameChooser extends ActionBarActivity
 			final String gameId = games[i];
 			views[i] = getLayoutInflater().inflate(
 					R.layout.list_item, table, false);
-			final StateListDrawable stateListDrawable = mkStarryIcon(gameId);
-			((ImageView)views[i].findViewById(R.id.icon)).setImageDrawable(stateListDrawable);
+			showIcon(i);
 			final int nameId = getResources().getIdentifier("name_"+gameId, "string", getPackageName());
 			final int descId = getResources().getIdentifier("desc_"+gameId, "string", getPackageName());
 			SpannableStringBuilder desc = new SpannableStringBuilder(nameId > 0 ?
@@ -228,12 +243,26 @@ public class GameChooser extends ActionBarActivity
 		rethinkColumns(true);
 	}
 
-	private StateListDrawable mkStarryIcon(String gameId) {
+	/** Shows game i's icon if it's decoded yet, else a placeholder until {@link #iconLoaded}. */
+	private void showIcon(int i) {
+		final ImageView iconView = (ImageView) views[i].findViewById(R.id.icon);
+		final Bitmap icon = icons.get(games[i], iconSize, this);
+		final Bitmap star = icons.get(STAR, 0, this);
+		iconView.setImageDrawable((icon == null || star == null) ? new ColorDrawable(Color.TRANSPARENT) : mkStarryIcon(icon, star));
+	}
+
+	@Override
+	public void iconLoaded(String name) {
+		for (int i = 0; i < games.length; i++) {
+			if (name.equals(STAR) || name.equals(games[i])) showIcon(i);
+		}
+	}
+
+	private StateListDrawable mkStarryIcon(Bitmap iconBitmap, Bitmap starBitmap) {
 		final StateListDrawable stateListDrawable = new StateListDrawable();
-		final Drawable icon = getResources().getDrawable(
-				getResources().getIdentifier(gameId, "drawable", getPackageName()));
+		final Drawable icon = new BitmapDrawable(getResources(), iconBitmap);
 		final LayerDrawable starredIcon = new LayerDrawable(new Drawable[]{
-				icon, getResources().getDrawable(R.drawable.ic_star) });
+				icon, new BitmapDrawable(getResources(), starBitmap) });
 		final float density = getResources().getDisplayMetrics().density;
 		starredIcon.setLayerInset(1, (int)(42*density), (int)(42*density), 0, 0);
 		stateListDrawable.addState(new int[]{android.R.attr.state_checked}, starredIcon);
@@ -0,0 +1,411 @@
+package name.boyle.chris.sgtpuzzles;
+
+import android.content.BroadcastReceiver;
+import android.content.Context;
+import android.content.Intent;
+import android.content.IntentFilter;
+import android.content.SharedPreferences;
+import android.net.Uri;
+import android.os.BatteryManager;
+import android.os.Build;
+import android.os.PowerManager;
+import android.os.Process;
+import android.os.SystemClock;
+import android.support.annotation.Nullable;
+import android.util.Log;
+
+import name.boyle.chris.sgtpuzzles.compat.PrefsSaver;
+
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.lang.reflect.Method;
+import java.nio.charset.Charset;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.HashMap;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Locale;
+import java.util.Map;
+import java.util.TreeMap;
+
+/**
+ * A bounded on-disk queue of pre-generated games for the presets the user plays, so that
+ * "New game" on a slow preset (Solo Jigsaw, Keen Extreme...) can start instantly. It is
+ * topped up on a background thread, one game at a time at background priority, whenever a game
+ * starts; entries are keyed by backend and full params encoding, and live in a directory per
+ * app version so that an upgrade discards them.
+ *
+ * So as not to run the battery down or warm the phone up, filling happens while charging (even
+ * with the activity gone, for as long as the process lasts), or else only while the activity is
+ * visible, not itself waiting for a game, and the battery isn't low. It backs off when the
+ * device is warm and stops when it's hot, going by the platform's thermal status where there is
+ * one (API 29) and the battery temperature otherwise. A game being generated when any of that
+ * changes is cancelled at once, through the generator's cancellation check.
+ */
+class GameGenCache {
+	private static final String TAG = "GameGenCache";
+	private static final String USES_PREFS_NAME = "pregen";
+	private static final String DIR_PREFIX = "pregen-";
+	private static final Charset UTF_8 = Charset.forName("UTF-8");
+
+	/** Most games per backend, shared among its presets; the slowest generators get more. */
+	private static final int DEFAULT_CAPACITY = 2;
+	private static final Map<String, Integer> CAPACITY = new HashMap<String, Integer>();
+	static {
+		CAPACITY.put("galaxies", 4);
+		CAPACITY.put("keen", 4);
+		CAPACITY.put("solo", 4);
+		CAPACITY.put("towers", 3);
+		CAPACITY.put("unequal", 4);
+	}
+	/** The current preset plus this many of the backend's other most-used presets. */
+	private static final int OTHER_PRESETS = 1;
+
+	/** On battery, don't fill below this charge. */
+	private static final int MIN_BATTERY_PERCENT = 30;
+	/** Battery temperatures, in tenths of a degree C, at which we back off or stop. */
+	private static final int WARM_BATTERY_TEMP = 380, HOT_BATTERY_TEMP = 420;
+	/** PowerManager.THERMAL_STATUS_LIGHT and _MODERATE, from API 29. */
+	private static final int THERMAL_STATUS_LIGHT = 1, THERMAL_STATUS_MODERATE = 2;
+	private static final int COOL = 0, WARM = 1, HOT = 2;
+	/** When warm, wait this long after each game; when hot, look again this often. */
+	private static final long WARM_BACKOFF_MS = 2 * 60 * 1000, HOT_RECHECK_MS = 60 * 1000;
+
+	private final File dir;
+	private final SharedPreferences uses;
+	private final PrefsSaver prefsSaver;
+	private final Map<String, List<String>> wanted = new LinkedHashMap<String, List<String>>();
+	private boolean active = false, busy = false;
+	private boolean charging = false;
+	private int batteryPercent = 100, batteryTemp = 0;
+	private long backoffUntil = 0;
+	private long job = 0;
+	private Thread filler = null;
+	private final PowerManager powerManager;
+	private final Method getCurrentThermalStatus;
+
+	// For getStats()
+	private final long created = SystemClock.elapsedRealtime();
+	private int filled = 0, hits = 0, misses = 0;
+	private long fillMillis = 0;
+	private final Map<String, Integer> stops = new TreeMap<String, Integer>();
+
+	private static GameGenCache instance = null;
+
+	/** There's one per process, so the filler thread outlives activity restarts. */
+	static synchronized GameGenCache get(Context context) {
+		if (instance == null) instance = new GameGenCache(context.getApplicationContext());
+		return instance;
+	}
+
+	private GameGenCache(Context context) {
+		dir = new File(context.getCacheDir(), DIR_PREFIX + BuildConfig.VERSION_CODE);
+		uses = context.getSharedPreferences(USES_PREFS_NAME, Context.MODE_PRIVATE);
+		prefsSaver = PrefsSaver.get(context);
+		powerManager = (PowerManager) context.getSystemService(Context.POWER_SERVICE);
+		Method m = null;
+		if (Build.VERSION.SDK_INT >= 29) {  // Q, newer than we compile against
+			try {
+				m = PowerManager.class.getMethod("getCurrentThermalStatus");
+			} catch (NoSuchMethodException ignored) {}
+		}
+		getCurrentThermalStatus = m;
+		// Sticky, so we get the current state at once, then every change (including temperature)
+		final Intent battery = context.registerReceiver(new BroadcastReceiver() {
+			@Override
+			public void onReceive(Context context, Intent intent) {
+				batteryChanged(intent);
+			}
+		}, new IntentFilter(Intent.ACTION_BATTERY_CHANGED));
+		if (battery != null) batteryChanged(battery);
+	}
+
+	private static int capacity(String backend) {
+		final Integer c = CAPACITY.get(backend);
+		return (c == null) ? DEFAULT_CAPACITY : c;
+	}
+
+	private File keyDir(String backend, String params) {
+		return new File(new File(dir, backend), Uri.encode(params));
+	}
+
+	private static int count(File d) {
+		final String[] names = d.list();
+		return (names == null) ? 0 : names.length;
+	}
+
+	/** Take the oldest cached game for these full params, or null if there isn't one. */
+	@Nullable
+	String take(String backend, String params) {
+		final File[] files;
+		synchronized (this) {
+			files = keyDir(backend, params).listFiles();
+			if (files == null || files.length == 0) {
+				misses++;
+				return null;
+			}
+			Arrays.sort(files);
+		}
+		for (File f : files) {
+			final File taken = new File(f.getPath() + ".taken");
+			synchronized (this) {
+				if (!f.renameTo(taken)) continue;
+			}
+			try {
+				final String saved = readFile(taken);
+				Log.d(TAG, "Using pre-generated " + backend + " " + params);
+				synchronized (this) {
+					hits++;
+				}
+				return saved;
+			} catch (IOException e) {
+				Log.w(TAG, "Can't read " + taken, e);
+			} finally {
+				//noinspection ResultOfMethodCallIgnored
+				taken.delete();
+			}
+		}
+		synchronized (this) {
+			misses++;
+		}
+		return null;
+	}
+
+	/**
+	 * Note that the user has started a game with these full params: this becomes the
+	 * backend's current preset, and the cache is topped up for it.
+	 */
+	synchronized void used(String backend, String params) {
+		final String useKey = backend + ":" + params;
+		prefsSaver.save(uses.edit().putInt(useKey, uses.getInt(useKey, 0) + 1));
+		final List<String> keys = new ArrayList<String>();
+		keys.add(params);
+		final List<Map.Entry<String, ?>> others = new ArrayList<Map.Entry<String, ?>>();
+		for (Map.Entry<String, ?> e : uses.getAll().entrySet()) {
+			if (e.getKey().startsWith(backend + ":") && !e.getKey().equals(useKey)
+					&& e.getValue() instanceof Integer) others.add(e);
+		}
+		for (int i = 0; i < OTHER_PRESETS && !others.isEmpty(); i++) {
+			Map.Entry<String, ?> best = others.get(0);
+			for (Map.Entry<String, ?> e : others) {
+				if ((Integer) e.getValue() > (Integer) best.getValue()) best = e;
+			}
+			others.remove(best);
+			keys.add(best.getKey().substring(backend.length() + 1));
+		}
+		wanted.put(backend, keys);
+		evict(backend, keys);
+		notifyAll();
+	}
+
+	/** Drop presets of this backend that are no longer wanted. */
+	private void evict(String backend, List<String> keys) {
+		final File[] dirs = new File(dir, backend).listFiles();
+		if (dirs == null) return;
+		for (File d : dirs) {
+			if (keys.contains(Uri.decode(d.getName()))) continue;
+			deleteRecursively(d);
+		}
+	}
+
+	/** Whether the activity is visible; on battery, we don't generate in the background. */
+	synchronized void setActive(boolean active) {
+		this.active = active;
+		conditionsChanged();
+	}
+
+	/** Whether the user is waiting for a game that isn't cached; we keep out of its way. */
+	synchronized void setBusy(boolean busy) {
+		this.busy = busy;
+		conditionsChanged();
+	}
+
+	private synchronized void batteryChanged(Intent intent) {
+		charging = intent.getIntExtra(BatteryManager.EXTRA_PLUGGED, 0) != 0;
+		final int level = intent.getIntExtra(BatteryManager.EXTRA_LEVEL, -1);
+		final int scale = intent.getIntExtra(BatteryManager.EXTRA_SCALE, -1);
+		batteryPercent = (level >= 0 && scale > 0) ? level * 100 / scale : 100;
+		batteryTemp = intent.getIntExtra(BatteryManager.EXTRA_TEMPERATURE, 0);
+		conditionsChanged();
+	}
+
+	private int heat() {
+		int status = 0;
+		if (getCurrentThermalStatus != null) {
+			try {
+				status = (Integer) getCurrentThermalStatus.invoke(powerManager);
+			} catch (Exception ignored) {}
+		}
+		if (status >= THERMAL_STATUS_MODERATE || batteryTemp >= HOT_BATTERY_TEMP) return HOT;
+		if (status >= THERMAL_STATUS_LIGHT || batteryTemp >= WARM_BATTERY_TEMP) return WARM;
+		return COOL;
+	}
+
+	/** Why we mustn't generate now, or null if we may. Call synchronized. */
+	@Nullable
+	private String whyNot() {
+		if (busy) return "busy";
+		if (!charging && !active) return "hidden";
+		if (!charging && batteryPercent < MIN_BATTERY_PERCENT) return "battery";
+		if (heat() == HOT) return "hot";
+		return null;
+	}
+
+	/** Call synchronized whenever anything whyNot() depends on has changed. */
+	private void conditionsChanged() {
+		final String why = whyNot();
+		if (why != null && job != 0) {
+			GamePlay.genCancel(job);
+			job = 0;
+			final Integer n = stops.get(why);
+			stops.put(why, (n == null) ? 1 : n + 1);
+		}
+		if (why == null && filler == null) {
+			filler = new Thread("pregenerate") { public void run() { fill(); }};
+			filler.setDaemon(true);
+			filler.start();
+		}
+		notifyAll();
+	}
+
+	/** Fill rates and the like, for feedback emails, in the same form as GamePlay.getStats(). */
+	synchronized String getStats() {
+		final double hours = (SystemClock.elapsedRealtime() - created) / 3600000.0;
+		final StringBuilder sb = new StringBuilder("pregen filled fill_ms per_hour hits misses\n");
+		sb.append(String.format(Locale.ROOT, "pregen %d %d %.1f %d %d\n",
+				filled, fillMillis, (hours > 0) ? filled / hours : 0.0, hits, misses));
+		for (Map.Entry<String, Integer> e : stops.entrySet()) {
+			sb.append("pregen_stopped_").append(e.getKey()).append(' ').append(e.getValue()).append('\n');
+		}
+		return sb.toString();
+	}
+
+	/** Find the wanted preset with fewest entries, if its backend has room. Call synchronized. */
+	@Nullable
+	private String[] nextToGenerate() {
+		for (Map.Entry<String, List<String>> e : wanted.entrySet()) {
+			final String backend = e.getKey();
+			int total = 0, least = Integer.MAX_VALUE;
+			String leastKey = null;
+			for (String params : e.getValue()) {
+				final int n = count(keyDir(backend, params));
+				total += n;
+				if (n < least) {
+					least = n;
+					leastKey = params;
+				}
+			}
+			if (leastKey != null && total < capacity(backend)) {
+				return new String[]{backend, leastKey};
+			}
+		}
+		return null;
+	}
+
+	private void fill() {
+		Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND);
+		removeOldVersions();
+		//noinspection InfiniteLoopStatement
+		while (true) {
+			final String[] args;
+			final long ourJob, started;
+			synchronized (this) {
+				String[] next = null;
+				while (true) {
+					final String why = whyNot();
+					final long backoff = backoffUntil - SystemClock.elapsedRealtime();
+					if (why == null && backoff <= 0 && (next = nextToGenerate()) != null) break;
+					try {
+						// Thermal status changes aren't broadcast to us, so poll when hot
+						wait("hot".equals(why) ? HOT_RECHECK_MS : (why == null && backoff > 0) ? backoff : 0);
+					} catch (InterruptedException ignored) {}
+				}
+				args = next;
+				started = SystemClock.elapsedRealtime();
+				ourJob = job = GamePlay.genSubmit(args, false);
+			}
+			String saved = null;
+			try {
+				saved = GamePlay.genWait(ourJob);
+			} catch (IllegalArgumentException e) {
+				Log.w(TAG, "Can't pre-generate " + Arrays.toString(args) + ": " + e.getMessage());
+				synchronized (this) {
+					final List<String> keys = wanted.get(args[0]);
+					if (keys != null) keys.remove(args[1]);
+				}
+			} finally {
+				synchronized (this) {
+					if (job == ourJob) job = 0;
+					GamePlay.genRelease(ourJob);
+					if (heat() == WARM) backoffUntil = SystemClock.elapsedRealtime() + WARM_BACKOFF_MS;
+				}
+			}
+			if (saved == null) continue;  // cancelled
+			synchronized (this) {
+				filled++;
+				fillMillis += SystemClock.elapsedRealtime() - started;
+				final List<String> keys = wanted.get(args[0]);
+				if (keys == null || !keys.contains(args[1])) continue;  // evicted meanwhile
+				final File d = keyDir(args[0], args[1]);
+				final File tmp = new File(d, System.currentTimeMillis() + ".tmp");
+				//noinspection ResultOfMethodCallIgnored
+				d.mkdirs();
+				try {
+					writeFile(tmp, saved);
+					//noinspection ResultOfMethodCallIgnored
+					tmp.renameTo(new File(d, tmp.getName().replace(".tmp", ".sav")));
+				} catch (IOException e) {
+					Log.w(TAG, "Can't write " + tmp, e);
+					//noinspection ResultOfMethodCallIgnored
+					tmp.delete();
+					wanted.remove(args[0]);  // probably out of space; don't spin
+				}
+			}
+		}
+	}
+
+	private void removeOldVersions() {
+		final File[] dirs = dir.getParentFile().listFiles();
+		if (dirs == null) return;
+		for (File d : dirs) {
+			if (d.getName().startsWith(DIR_PREFIX) && !d.equals(dir)) deleteRecursively(d);
+		}
+	}
+
+	private static void deleteRecursively(File f) {
+		final File[] children = f.listFiles();
+		if (children != null) for (File c : children) deleteRecursively(c);
+		//noinspection ResultOfMethodCallIgnored
+		f.delete();
+	}
+
+	private static String readFile(File f) throws IOException {
+		InputStream in = null;
+		try {
+			in = new FileInputStream(f);
+			final ByteArrayOutputStream out = new ByteArrayOutputStream();
+			final byte[] buf = new byte[8192];
+			int len;
+			while ((len = in.read(buf)) > 0) out.write(buf, 0, len);
+			return new String(out.toByteArray(), UTF_8);
+		} finally {
+			Utils.closeQuietly(in);
+		}
+	}
+
+	private static void writeFile(File f, String s) throws IOException {
+		OutputStream out = null;
+		try {
+			out = new FileOutputStream(f);
+			out.write(s.getBytes(UTF_8));
+		} finally {
+			Utils.closeQuietly(out);
+		}
+	}
+}
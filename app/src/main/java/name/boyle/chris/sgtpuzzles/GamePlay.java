@@ -1,16 +1,14 @@
 package name.boyle.chris.sgtpuzzles;
 
+import java.io.BufferedReader;
 import java.io.File;
-import java.io.FileInputStream;
 import java.io.FileOutputStream;
+import java.io.FileReader;
 import java.io.IOException;
-import java.io.InputStream;
-import java.io.OutputStream;
 import java.lang.ref.WeakReference;
 import java.nio.charset.Charset;
 import java.text.MessageFormat;
 import java.util.ArrayList;
-import java.util.Arrays;
 import java.util.Collections;
 import java.util.LinkedHashMap;
 import java.util.List;
@@ -25,6 +23,7 @@ import name.boyle.chris.sgtpuzzles.compat.SysUIVisSetter;
 import android.annotation.SuppressLint;
 import android.annotation.TargetApi;
 import android.app.Activity;
+import android.app.ActivityManager;
 import android.app.AlertDialog;
 import android.app.Dialog;
 import android.app.ProgressDialog;
@@ -36,8 +35,8 @@ import android.content.Intent;
 import android.content.SharedPreferences;
 import android.content.SharedPreferences.OnSharedPreferenceChangeListener;
 import android.content.pm.ActivityInfo;
-import android.content.pm.ApplicationInfo;
 import android.content.pm.ResolveInfo;
+import android.content.res.AssetManager;
 import android.content.res.Configuration;
 import android.content.res.Resources;
 import android.database.Cursor;
@@ -57,6 +56,7 @@ import android.os.Handler;
 import android.os.Message;
 import android.os.ParcelFileDescriptor;
 import android.os.Parcelable;
+import android.os.SystemClock;
 import android.preference.PreferenceManager;
 import android.provider.OpenableColumns;
 import android.support.annotation.NonNull;
@@ -69,6 +69,7 @@ import android.support.v7.app.ActionBarActivity;
 import android.text.InputType;
 import android.util.DisplayMetrics;
 import android.util.Log;
+import android.view.Choreographer;
 import android.view.Gravity;
 import android.view.KeyEvent;
 import android.view.Menu;
@@ -109,7 +110,6 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	public static final String SAVED_COMPLETED_PREFIX = "savedCompleted_";
 	public static final String SAVED_GAME_PREFIX = "savedGame_";
 	public static final String LAST_PARAMS_PREFIX = "last_params_";
-	private static final String PUZZLESGEN_LAST_UPDATE = "puzzlesgen_last_update";
 	private static final String BLUETOOTH_PACKAGE_PREFIX = "com.android.bluetooth";
 
 	private static final int REQ_CODE_CREATE_DOC = Activity.RESULT_FIRST_USER;
@@ -124,16 +124,23 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private Map<String, String> gameTypes;
 	private int currentType = 0;
 	private boolean workerRunning = false;
-	private Process gameGenProcess = null;
+	private final Object genLock = new Object();
+	private long genJob = 0;
+	private GameGenCache genCache;
 	private boolean solveEnabled = false, customVisible = false,
 			undoEnabled = false, redoEnabled = false;
 	private SharedPreferences prefs, state;
 	private static final int CFG_SETTINGS = 0, CFG_SEED = 1, CFG_DESC = 2,
 		C_STRING = 0, C_CHOICES = 1, C_BOOLEAN = 2;
 	static final long MAX_SAVE_SIZE = 1000000; // 1MB; we only have 16MB of heap
+	/** Set until a game's first frame is drawn, unless the chooser came first; see {@link #reportColdStart()} */
+	static boolean coldStartPending = true;
 	private boolean gameWantsTimer = false;
-	static final int TIMER_INTERVAL = 20;
-	private StringBuffer savingState;
+	static final int TIMER_INTERVAL = 20;  // minimum; also the frame rate without Choreographer
+	private static final int GEN_PROGRESS_INTERVAL = 500;
+	/** On low-end devices, how long to hold out for exactly the puzzle asked for before settling */
+	private static final int GEN_BUDGET_MS = 2000;
+	private static final int GEN_RELAXED_DIFFICULTY = 1, GEN_RELAXED_SYMMETRY = 2;  // as in puzzles.h
 	private AlertDialog dialog;
 	private int dialogEvent;
 	private ArrayList<String> dialogIds;
@@ -152,7 +159,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private final Pattern DIMENSIONS = Pattern.compile("(\\d+)( ?)x\\2(\\d+)(.*)");
 	private long lastKeySent = 0;
 	enum UIVisibility {
-		UNDO(1), REDO(2), CUSTOM(4), SOLVE(8), STATUS(16);
+		UNDO(1), REDO(2), CUSTOM(4), SOLVE(8), STATUS(16), DRAG_PATH(32);
 		private final int _flag;
 		UIVisibility(final int flag) { _flag = flag; }
 		public int getValue() { return _flag; }
@@ -172,19 +179,113 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	}
 	final Handler handler = new PuzzlesHandler(this);
 
+	/** Ticks the timer on vsync, so that animation frames are exactly display frames. */
+	@TargetApi(Build.VERSION_CODES.JELLY_BEAN)
+	static class VsyncTimer implements Choreographer.FrameCallback
+	{
+		final WeakReference<GamePlay> ref;
+		public VsyncTimer(GamePlay outer) {
+			ref = new WeakReference<GamePlay>(outer);
+		}
+		void post() { Choreographer.getInstance().postFrameCallback(this); }
+		void cancel() { Choreographer.getInstance().removeFrameCallback(this); }
+		public void doFrame(long frameTimeNanos) {
+			GamePlay outer = ref.get();
+			if (outer != null) outer.timerFired(frameTimeNanos);
+		}
+	}
+	private final VsyncTimer vsyncTimer = (Build.VERSION.SDK_INT >= Build.VERSION_CODES.JELLY_BEAN)
+			? new VsyncTimer(this) : null;
+	private boolean timerScheduled = false;
+	final RenderThread renderThread = new RenderThread();
+	/** Whether the backend needs every drag sample (Pearl, Filling), not just the latest. */
+	boolean dragFollowsPath = false;
+	private CoalescedDrag pendingDrag = null;
+
+	/**
+	 * A drag on its way to the render thread. Until the render thread takes it, later drags
+	 * just move it, so however fast the touch screen samples, a busy backend only sees the
+	 * latest position.
+	 */
+	private class CoalescedDrag implements Runnable {
+		private int x, y, k;
+		private boolean taken = false;
+		CoalescedDrag(int x, int y, int k) {
+			this.x = x;
+			this.y = y;
+			this.k = k;
+		}
+		synchronized boolean update(int x, int y, int k) {
+			if (taken) return false;
+			this.x = x;
+			this.y = y;
+			this.k = k;
+			return true;
+		}
+		@Override
+		public void run() {
+			final int x, y, k;
+			synchronized (this) {
+				taken = true;
+				x = this.x;
+				y = this.y;
+				k = this.k;
+			}
+			keyEvent(x, y, k);
+		}
+	}
+
 	private void handleMessage(Message msg) {
 		switch( MsgType.values()[msg.what] ) {
 		case TIMER:
-			if( progress == null ) timerTick();
-			if( gameWantsTimer ) {
-				handler.sendMessageDelayed(
-						handler.obtainMessage(MsgType.TIMER.ordinal()),
-						TIMER_INTERVAL);
-			}
+			timerFired(System.nanoTime());
 			break;
 		}
 	}
 
+	private void timerFired(final long frameTimeNanos) {
+		timerScheduled = false;
+		if (progress != null) {
+			if (gameWantsTimer) scheduleTimer(0);
+			return;
+		}
+		timerScheduled = true;  // by the tick itself, when it finishes
+		renderThread.post(new Runnable() {
+			@Override
+			public void run() {
+				final int delay = timerTick(frameTimeNanos);
+				handler.post(new Runnable() {
+					@Override
+					public void run() {
+						timerScheduled = false;
+						if (gameWantsTimer) scheduleTimer(delay);
+					}
+				});
+			}
+		});
+	}
+
+	/**
+	 * Arrange the next timer tick: on the next frame if delay is 0 (animating), else after
+	 * delay ms (e.g. when only a clock is showing, until its seconds change).
+	 */
+	private void scheduleTimer(int delay) {
+		cancelTimer();
+		timerScheduled = true;
+		if (delay == 0 && vsyncTimer != null) {
+			vsyncTimer.post();
+		} else {
+			handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()),
+					Math.max(delay, TIMER_INTERVAL));
+		}
+	}
+
+	private void cancelTimer() {
+		timerScheduled = false;
+		handler.removeMessages(MsgType.TIMER.ordinal());
+		if (vsyncTimer != null) vsyncTimer.cancel();
+	}
+
 	private void showProgress(int msgId, final boolean returnToChooser)
 	{
 		progress = new ProgressDialog(this);
@@ -204,10 +305,28 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 			}
 		});
 		progress.show();
+		if (msgId == R.string.starting) handler.postDelayed(genProgressUpdater, GEN_PROGRESS_INTERVAL);
 	}
 
+	/** Shows how many puzzles the generator has rejected, so a slow preset visibly isn't stuck. */
+	private final Runnable genProgressUpdater = new Runnable() {
+		@Override
+		public void run() {
+			if (progress == null) return;
+			final int attempts;
+			synchronized (genLock) {
+				attempts = (genJob != 0) ? genProgress(genJob) : 0;
+			}
+			if (attempts > 0) {
+				progress.setMessage(MessageFormat.format(getString(R.string.starting_attempts), attempts));
+			}
+			handler.postDelayed(this, GEN_PROGRESS_INTERVAL);
+		}
+	};
+
 	private void dismissProgress()
 	{
+		handler.removeCallbacks(genProgressUpdater);
 		if( progress == null ) return;
 		try {
 			progress.dismiss();
@@ -215,43 +334,66 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		progress = null;
 	}
 
+	/** A save in the standard format, for files and sharing. */
 	String saveToString()
+	{
+		return saveToString(false);
+	}
+
+	/** @param compact pack the move list; only this app can read it back, so only for our own state */
+	private String saveToString(boolean compact)
 	{
 		if (currentBackend == null || progress != null) return null;
-		savingState = new StringBuffer();
-		serialise();  // serialiseWrite() callbacks will happen in here
-		String s = savingState.toString();
-		savingState = null;
-		return s;
+		renderThread.acquire();
+		try {
+			return serialise(compact);
+		} finally {
+			renderThread.release();
+		}
 	}
 
 	@SuppressLint("CommitPrefEdits")
 	private void save()
 	{
-		String s = saveToString();
+		String s = saveToString(true);
 		if (s == null || s.length() == 0) return;
 		SharedPreferences.Editor ed = state.edit();
 		ed.remove("engineName");
 		ed.putString(SAVED_BACKEND, currentBackend);
 		ed.putString(SAVED_GAME_PREFIX + currentBackend, s);
 		ed.putBoolean(SAVED_COMPLETED_PREFIX + currentBackend, everCompleted);
-		ed.putString(LAST_PARAMS_PREFIX + currentBackend, getCurrentParams());
+		renderThread.acquire();
+		try {
+			ed.putString(LAST_PARAMS_PREFIX + currentBackend, getCurrentParams());
+		} finally {
+			renderThread.release();
+		}
 		prefsSaver.save(ed);
 	}
 
 	void gameViewResized()
 	{
-		if (progress == null && gameView.w > 10 && gameView.h > 10)
-			resizeEvent(gameView.w, gameView.h);
+		if (progress == null && gameView.w > 10 && gameView.h > 10) {
+			final int w = gameView.w, h = gameView.h;
+			renderThread.post(new Runnable() {
+				@Override
+				public void run() {
+					resizeEvent(w, h);
+				}
+			});
+		}
 	}
 
 	@Override
 	protected void onCreate(Bundle savedInstanceState)
 	{
+		renderThread.start();
 		prefs = PreferenceManager.getDefaultSharedPreferences(this);
 		prefs.registerOnSharedPreferenceChangeListener(this);
 		state = getSharedPreferences(STATE_PREFS_NAME, MODE_PRIVATE);
 		prefsSaver = PrefsSaver.get(this);
+		openPuzzlePack(getApplicationContext().getAssets());  // before anything generates
+		genCache = GameGenCache.get(this);
 		games = getResources().getStringArray(R.array.games);
 		gameTypes = new LinkedHashMap<String, String>();
 
@@ -521,22 +663,42 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		case R.id.newgame:
 			startNewGame();
 			break;
-		case R.id.restart:  restartEvent(); break;
+		case R.id.restart:
+			renderThread.acquire();
+			try {
+				restartEvent();
+			} finally {
+				renderThread.release();
+			}
+			break;
 		case R.id.undo:     sendKey(0, 0, 'U'); break;
 		case R.id.redo:     sendKey(0, 0, 'R'); break;
 		case R.id.solve:
+			renderThread.acquire();
 			try {
 				solveEvent();
 			} catch (IllegalArgumentException e) {
 				messageBox(getString(R.string.Error), e.getMessage(), false);
+			} finally {
+				renderThread.release();
 			}
 			break;
 		case R.id.custom:
-			configEvent(CFG_SETTINGS);
+			renderThread.acquire();
+			try {
+				configEvent(CFG_SETTINGS);
+			} finally {
+				renderThread.release();
+			}
 			break;
 		case R.id.this_game:
 			Intent intent = new Intent(this, HelpActivity.class);
-			intent.putExtra(HelpActivity.TOPIC, htmlHelpTopic());
+			renderThread.acquire();
+			try {
+				intent.putExtra(HelpActivity.TOPIC, htmlHelpTopic());
+			} finally {
+				renderThread.release();
+			}
 			startActivity(intent);
 			break;
 		case R.id.email:
@@ -672,86 +834,62 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 				}
 				startingBackend = currentBackend;
 				if (currentBackend != null) {
-					requestKeys(currentBackend, getCurrentParams());
+					renderThread.acquire();
+					try {
+						requestKeys(currentBackend, getCurrentParams());
+					} finally {
+						renderThread.release();
+					}
 				}
 			}
 		});
 
 	}
 
-	private String generateGame(final List<String> args) throws IllegalArgumentException, IOException {
-		String game;
-		startGameGenProcess(args);
-		OutputStream stdin = gameGenProcess.getOutputStream();
-		stdin.close();
-		game = Utils.readAllOf(gameGenProcess.getInputStream());
-		if (game.length() == 0) game = null;
-		int exitStatus = Utils.waitForProcess(gameGenProcess);
-		if (exitStatus != 0) {
-			String error = game;
-			if (error != null && error.length() > 0) {  // probably bogus params
-				throw new IllegalArgumentException(error);
-			} else if (workerRunning) {
-				error = "Game generation exited with status "+exitStatus;
-				Log.e(TAG, error);
-				throw new IOException(error);
+	private String generateGame(final List<String> args) throws IllegalArgumentException {
+		final long job = genSubmit(args.toArray(new String[args.size()]), true);
+		synchronized (genLock) {
+			genJob = job;
+			if (!workerRunning) genCancel(job);  // stopNative got in first
+		}
+		try {
+			final String game = genWait(job);  // throws IllegalArgumentException for bogus params
+			if (!workerRunning) return null;  // cancelled
+			final int relaxed = genRelaxed(job);
+			if (relaxed != 0) {
+				showToast(getString(((relaxed & GEN_RELAXED_DIFFICULTY) != 0)
+						? R.string.gen_relaxed_difficulty : R.string.gen_relaxed_symmetry), false);
+			}
+			return game;
+		} finally {
+			synchronized (genLock) {
+				genJob = 0;
+				genRelease(job);
 			}
-			// else cancelled
 		}
-		if( !workerRunning) return null;  // cancelled
-		return game;
 	}
 
-	@SuppressLint("CommitPrefEdits")
-	private void startGameGenProcess(final List<String> args) throws IOException {
-		final ApplicationInfo applicationInfo = getApplicationInfo();
-		final File dataDir = new File(applicationInfo.dataDir);
-		final File libDir;
-		if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.GINGERBREAD) {
-			libDir = new File(applicationInfo.nativeLibraryDir);
-		} else {
-			libDir = new File(dataDir, "lib");
-		}
-		final boolean canRunPIE = Build.VERSION.SDK_INT >= Build.VERSION_CODES.JELLY_BEAN;
-		final String suffix = canRunPIE ? "-with-pie" : "-no-pie";
-		final String baseName = "libpuzzlesgen" + suffix + ".so";
-		File installablePath = new File(libDir, baseName);
-		final File SYS_LIB = new File("/system/lib");
-		final File altPath = new File(SYS_LIB, baseName);
-		if (!installablePath.exists() && altPath.exists()) installablePath = altPath;
-		File executablePath = new File(dataDir, "puzzlesgen" + suffix);
-		if (!executablePath.exists() || (prefs.getInt(PUZZLESGEN_LAST_UPDATE, 0) < BuildConfig.VERSION_CODE)) {
-			copyFile(installablePath, executablePath);
-			prefsSaver.save(prefs.edit().putInt(PUZZLESGEN_LAST_UPDATE, BuildConfig.VERSION_CODE));
-		}
-		Utils.setExecutable(executablePath);
-		final String[] cmdLine = new String[args.size() + 1];
-		cmdLine[0] = executablePath.getAbsolutePath();
-		int i = 1;
-		for (String arg : args) cmdLine[i++] = arg;
-		Log.d(TAG, "exec: " + Arrays.toString(cmdLine));
-		File libPuzDir = libDir;
-		final String SO = "libpuzzles.so";
-		if (! new File(libPuzDir, SO).exists() && new File(SYS_LIB, SO).exists()) libPuzDir = SYS_LIB;
-		gameGenProcess = Runtime.getRuntime().exec(cmdLine,
-				new String[]{"LD_LIBRARY_PATH="+libPuzDir}, libPuzDir);
-	}
-
-	private void copyFile(File src, File dst) throws IOException {
-		InputStream in = new FileInputStream(src);
-		OutputStream out = new FileOutputStream(dst);
-		byte[] buf = new byte[8192];
-		int len;
-		while ((len = in.read(buf)) > 0) {
-			out.write(buf, 0, len);
-		}
-		in.close();
-		out.close();
+	/** Too slow to wait for the rarer difficulties; such a device gets a new game within {@link #GEN_BUDGET_MS} */
+	private boolean isLowEndDevice() {
+		if (Runtime.getRuntime().availableProcessors() < 2) return true;
+		return Build.VERSION.SDK_INT >= Build.VERSION_CODES.KITKAT && isLowRamDevice();
+	}
+
+	@TargetApi(Build.VERSION_CODES.KITKAT)
+	private boolean isLowRamDevice() {
+		return ((ActivityManager) getSystemService(ACTIVITY_SERVICE)).isLowRamDevice();
 	}
 
 	private void startNewGame()
 	{
-		startGame(GameLaunch.toGenerate(currentBackend, orientGameType(getCurrentParams())));
+		final String currentParams;
+		renderThread.acquire();
+		try {
+			currentParams = getCurrentParams();
+		} finally {
+			renderThread.release();
+		}
+		startGame(GameLaunch.toGenerate(currentBackend, orientGameType(currentParams)));
 	}
 
 	private void startGame(final GameLaunch launch)
@@ -809,15 +947,33 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 							Log.d(TAG, "Using specified params: " + params);
 						}
 						args.add(params);
+						if (isLowEndDevice()) {
+							args.add("--within");
+							args.add(String.valueOf(GEN_BUDGET_MS));
+						}
 					}
 					final String finalParams = params;
 					runOnUiThread(new Runnable() {
 						@Override
 						public void run() {
-							requestKeys(startingBackend, finalParams);
+							renderThread.acquire();
+							try {
+								requestKeys(startingBackend, finalParams);
+							} finally {
+								renderThread.release();
+							}
 						}
 					});
-					String generated = generateGame(args);
+					final String full = (launch.getSeed() == null) ? fullParams(whichBackend, params) : null;
+					String generated = (full != null) ? genCache.take(whichBackend, full) : null;
+					if (generated == null) {
+						genCache.setBusy(true);
+						try {
+							generated = generateGame(args);
+						} finally {
+							genCache.setBusy(false);
+						}
+					}
 					if (generated != null) {
 						launch.finishedGenerating(generated);
 					} else if (workerRunning) {
@@ -842,56 +998,71 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 					changingGame = ! currentBackend.equals(startingBackend);
 				}
 
-				if (toPlay != null) {
-					startPlaying(gameView, toPlay);
-				} else {
-					startPlayingGameID(gameView, startingBackend, gameID);
+				renderThread.acquire();
+				try {
+					if (toPlay != null) {
+						startPlaying(gameView, toPlay);
+					} else {
+						startPlayingGameID(gameView, startingBackend, gameID);
+					}
+				} finally {
+					renderThread.release();
 				}
 				if (! workerRunning) return;  // stopNative or abort was called
 				runOnUiThread(new Runnable() {
 					@Override
 					public void run() {
-						currentBackend = startingBackend;
-						refreshColours();
-						gameView.resetZoomForClear();
-						gameView.clear();
-						applyUndoRedoKbd();
-						gameView.keysHandled = 0;
-						everCompleted = false;
-
-						final String currentParams = orientGameType(getCurrentParams());
-						refreshPresets(currentParams);
-						gameView.setDragModeFor(currentBackend);
-						final String title = getGameTitle();
-						setTitle(title);
-						getSupportActionBar().setTitle(title);
-						final int flags = getUIVisibility();
-						changedState((flags & UIVisibility.UNDO.getValue()) > 0, (flags & UIVisibility.REDO.getValue()) > 0);
-						customVisible = (flags & UIVisibility.CUSTOM.getValue()) > 0;
-						solveEnabled = (flags & UIVisibility.SOLVE.getValue()) > 0;
-						setStatusBarVisibility((flags & UIVisibility.STATUS.getValue()) > 0);
-
-						if (!generating) {  // we didn't know params until we loaded the game
-							requestKeys(currentBackend, currentParams);
-						}
-						if (launch.isKnownCompleted()) {
-							completed();
-						}
-						final boolean hasArrows = computeArrowMode(currentBackend).hasArrows();
-						setCursorVisibility(hasArrows);
-						if (changingGame) {
-							if (prefs.getBoolean(CONTROLS_REMINDERS_KEY, true) && ! hasArrows) {
-								final int reminderId = getResources().getIdentifier(
-										"toast_no_arrows_" + currentBackend, "string", getPackageName());
-								if (reminderId > 0) {
-									Toast.makeText(GamePlay.this, reminderId, Toast.LENGTH_LONG).show();
+						renderThread.acquire();
+						try {
+							currentBackend = startingBackend;
+							refreshColours();
+							gameView.resetZoomForClear();
+							gameView.clear();
+							applyUndoRedoKbd();
+							gameView.keysHandled = 0;
+							everCompleted = false;
+
+							final String currentParams = orientGameType(getCurrentParams());
+							refreshPresets(currentParams);
+							final String full = (generating && launch.getSeed() == null)
+									? fullParams(currentBackend, currentParams) : null;
+							if (full != null) genCache.used(currentBackend, full);
+							gameView.setDragModeFor(currentBackend);
+							final String title = getGameTitle();
+							setTitle(title);
+							getSupportActionBar().setTitle(title);
+							final int flags = getUIVisibility();
+							changedState((flags & UIVisibility.UNDO.getValue()) > 0, (flags & UIVisibility.REDO.getValue()) > 0);
+							customVisible = (flags & UIVisibility.CUSTOM.getValue()) > 0;
+							solveEnabled = (flags & UIVisibility.SOLVE.getValue()) > 0;
+							setStatusBarVisibility((flags & UIVisibility.STATUS.getValue()) > 0);
+							dragFollowsPath = (flags & UIVisibility.DRAG_PATH.getValue()) > 0;
+
+							if (!generating) {  // we didn't know params until we loaded the game
+								requestKeys(currentBackend, currentParams);
+							}
+							if (launch.isKnownCompleted()) {
+								completed();
+							}
+							final boolean hasArrows = computeArrowMode(currentBackend).hasArrows();
+							setCursorVisibility(hasArrows);
+							if (changingGame) {
+								if (prefs.getBoolean(CONTROLS_REMINDERS_KEY, true) && ! hasArrows) {
+									final int reminderId = getResources().getIdentifier(
+											"toast_no_arrows_" + currentBackend, "string", getPackageName());
+									if (reminderId > 0) {
+										Toast.makeText(GamePlay.this, reminderId, Toast.LENGTH_LONG).show();
+									}
 								}
 							}
+							gameView.clearTextCache();  // new game, so possibly a new tile size
+							resizeEvent(gameView.w, gameView.h);
+							dismissProgress();
+							if( menu != null ) onPrepareOptionsMenu(menu);
+							save();
+						} finally {
+							renderThread.release();
 						}
-						resizeEvent(gameView.w, gameView.h);
-						dismissProgress();
-						if( menu != null ) onPrepareOptionsMenu(menu);
-						save();
 					}
 				});
 			} catch (IllegalArgumentException e) {
@@ -958,13 +1129,12 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	private void stopNative()
 	{
 		workerRunning = false;
-		if (gameGenProcess != null) {
-			gameGenProcess.destroy();
-			gameGenProcess = null;
+		synchronized (genLock) {
+			if (genJob != 0) genCancel(genJob);
 		}
 		if (worker != null) {
 			while(true) { try {
-				worker.join();  // we may ANR if native code is spinning - safer than leaving a runaway native thread
+				worker.join();  // generation was cancelled above, so this is quick
 				break;
 			} catch (InterruptedException ignored) {} }
 		}
@@ -973,7 +1143,8 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	@Override
 	protected void onPause()
 	{
-		handler.removeMessages(MsgType.TIMER.ordinal());
+		cancelTimer();
+		genCache.setActive(false);
 		save();
 		super.onPause();
 	}
@@ -984,6 +1155,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	protected void onResume()
 	{
 		super.onResume();
+		genCache.setActive(true);
 		if (restartOnResume) {
 			startActivity(new Intent(this, RestartActivity.class));
 			finish();
@@ -994,16 +1166,15 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	protected void onDestroy()
 	{
 		stopNative();
+		renderThread.quit();
 		super.onDestroy();
 	}
 
 	@Override
 	public void onWindowFocusChanged( boolean f )
 	{
-		if( f && gameWantsTimer && currentBackend != null
-				&& ! handler.hasMessages(MsgType.TIMER.ordinal()) )
-			handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()),
-					TIMER_INTERVAL);
+		if( f && gameWantsTimer && currentBackend != null && ! timerScheduled )
+			scheduleTimer(0);
 	}
 
 	void sendKey(PointF p, int k)
@@ -1011,7 +1182,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		sendKey(Math.round(p.x), Math.round(p.y), k);
 	}
 
-	void sendKey(int x, int y, int k)
+	void sendKey(final int x, final int y, final int k)
 	{
 		if (progress != null || currentBackend == null) return;
 		if (k == '\f') {
@@ -1019,7 +1190,21 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 			openOptionsMenu();
 			return;
 		}
-		keyEvent(x, y, k);
+		final boolean isDrag = k >= GameView.LEFT_DRAG && k <= GameView.LEFT_DRAG + 2;
+		if (isDrag && ! dragFollowsPath) {
+			if (pendingDrag == null || ! pendingDrag.update(x, y, k)) {
+				pendingDrag = new CoalescedDrag(x, y, k);
+				renderThread.post(pendingDrag);
+			}
+		} else {
+			pendingDrag = null;  // so that no later drag overtakes this event
+			renderThread.post(new Runnable() {
+				@Override
+				public void run() {
+					keyEvent(x, y, k);
+				}
+			});
+		}
 		gameView.requestFocus();
 		if (startedFullscreen) {
 			lightsOut(true);
@@ -1073,6 +1258,28 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		mainLayout.requestLayout();
 	}
 
+	/** Logs how long after the process began we drew the first frame; puzzles-bench --cold-start reads this. */
+	static void reportColdStart() {
+		coldStartPending = false;
+		try {
+			final BufferedReader r = new BufferedReader(new FileReader("/proc/self/stat"));
+			final String stat;
+			try {
+				stat = r.readLine();
+			} finally {
+				r.close();
+			}
+			// Field 2 is the command name, which may contain spaces; field 22 is the start time
+			final String[] fields = stat.substring(stat.lastIndexOf(')') + 2).split(" ");
+			final long startMillis = Long.parseLong(fields[19]) * 10;  // USER_HZ is 100 on Android
+			Log.i(TAG, "cold start: " + (SystemClock.elapsedRealtime() - startMillis) + " ms to first frame");
+		} catch (IOException e) {
+			Log.w(TAG, "cold start: can't read process start time", e);
+		} catch (RuntimeException e) {
+			Log.w(TAG, "cold start: can't parse process start time", e);
+		}
+	}
+
 	static String getArrowKeysPrefName(final String whichBackend, final Configuration c) {
 		return whichBackend + GamePlay.ARROW_KEYS_KEY_SUFFIX
 				+ (hasDpadOrTrackball(c) ? "WithDpad" : "");
@@ -1192,6 +1399,16 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 
 	@UsedByJNI
 	void completed()
+	{
+		runOnUiThread(new Runnable() {  // usually called from the render thread
+			@Override
+			public void run() {
+				showCompleted();
+			}
+		});
+	}
+
+	private void showCompleted()
 	{
 		everCompleted = true;
 		if (! prefs.getBoolean(COMPLETED_PROMPT_KEY, true)) {
@@ -1257,12 +1474,17 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	}
 
 	@UsedByJNI
-	void requestTimer(boolean on)
+	void requestTimer(final boolean on)
 	{
-		if( gameWantsTimer && on ) return;
-		gameWantsTimer = on;
-		if( on ) handler.sendMessageDelayed(handler.obtainMessage(MsgType.TIMER.ordinal()), TIMER_INTERVAL);
-		else handler.removeMessages(MsgType.TIMER.ordinal());
+		runOnUiThread(new Runnable() {  // usually called from the render thread
+			@Override
+			public void run() {
+				// on while already on means "stop waiting for the clock, something's animating"
+				gameWantsTimer = on;
+				if( on ) scheduleTimer(0);
+				else cancelTimer();
+			}
+		});
 	}
 
 	@UsedByJNI
@@ -1275,7 +1497,12 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 				.setView(sv)
 				.setOnCancelListener(new OnCancelListener() {
 					public void onCancel(DialogInterface dialog) {
-						configCancel();
+						renderThread.acquire();
+						try {
+							configCancel();
+						} finally {
+							renderThread.release();
+						}
 					}
 				})
 				.setPositiveButton(android.R.string.ok, new DialogInterface.OnClickListener() {
@@ -1288,15 +1515,25 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 			builder.setNegativeButton(R.string.Game_ID_, new DialogInterface.OnClickListener() {
 				@Override
 				public void onClick(DialogInterface dialog, int which) {
-					configCancel();
-					configEvent(CFG_DESC);
+					renderThread.acquire();
+					try {
+						configCancel();
+						configEvent(CFG_DESC);
+					} finally {
+						renderThread.release();
+					}
 				}
 			})
 			.setNeutralButton(R.string.Seed_, new DialogInterface.OnClickListener() {
 				@Override
 				public void onClick(DialogInterface dialog, int which) {
-					configCancel();
-					configEvent(CFG_SEED);
+					renderThread.acquire();
+					try {
+						configCancel();
+						configEvent(CFG_SEED);
+					} finally {
+						renderThread.release();
+					}
 				}
 			});
 		}
@@ -1389,39 +1626,43 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		dialog.getButton(AlertDialog.BUTTON_POSITIVE).setOnClickListener(new View.OnClickListener() {
 			@Override
 			public void onClick(View button) {
-				for (String i : dialogIds) {
-					View v = dialogLayout.findViewWithTag(i);
-					if (v instanceof EditText) {
-						configSetString(i, ((EditText) v).getText().toString());
-					} else if (v instanceof CheckBox) {
-						configSetBool(i, ((CheckBox) v).isChecked() ? 1 : 0);
-					} else if (v instanceof Spinner) {
-						configSetChoice(i, ((Spinner) v).getSelectedItemPosition());
-					}
-				}
+				renderThread.acquire();
 				try {
-					final GameLaunch launch;
-					if (dialogEvent == CFG_DESC) {
-						launch = GameLaunch.ofGameID(currentBackend, getFullGameIDFromDialog());
-					} else if (dialogEvent == CFG_SEED) {
-						launch = GameLaunch.fromSeed(currentBackend, getFullSeedFromDialog());
-					} else {
-						launch = GameLaunch.toGenerate(currentBackend, configOK());
-					}
-					startGame(launch);
-					dialog.dismiss();
-				} catch (IllegalArgumentException e) {
-					dismissProgress();
-					messageBox(getString(R.string.Error), e.getMessage(), false);
+					onDialogOK();
+				} finally {
+					renderThread.release();
 				}
 			}
 		});
 	}
 
-	@UsedByJNI
-	void serialiseWrite(byte[] buffer)
+	private void onDialogOK()
 	{
-		savingState.append(new String(buffer));
+		for (String i : dialogIds) {
+			View v = dialogLayout.findViewWithTag(i);
+			if (v instanceof EditText) {
+				configSetString(i, ((EditText) v).getText().toString());
+			} else if (v instanceof CheckBox) {
+				configSetBool(i, ((CheckBox) v).isChecked() ? 1 : 0);
+			} else if (v instanceof Spinner) {
+				configSetChoice(i, ((Spinner) v).getSelectedItemPosition());
+			}
+		}
+		try {
+			final GameLaunch launch;
+			if (dialogEvent == CFG_DESC) {
+				launch = GameLaunch.ofGameID(currentBackend, getFullGameIDFromDialog());
+			} else if (dialogEvent == CFG_SEED) {
+				launch = GameLaunch.fromSeed(currentBackend, getFullSeedFromDialog());
+			} else {
+				launch = GameLaunch.toGenerate(currentBackend, configOK());
+			}
+			startGame(launch);
+			dialog.dismiss();
+		} catch (IllegalArgumentException e) {
+			dismissProgress();
+			messageBox(getString(R.string.Error), e.getMessage(), false);
+		}
 	}
 
 	private SmallKeyboard.ArrowMode lastArrowMode = SmallKeyboard.ArrowMode.NO_ARROWS;
@@ -1444,7 +1685,12 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 		final Configuration configuration = getResources().getConfiguration();
 		if (key.equals(getArrowKeysPrefName(currentBackend, configuration))) {
 			setKeyboardVisibility(startingBackend, configuration);
-			setCursorVisibility(computeArrowMode(startingBackend).hasArrows());
+			renderThread.acquire();
+			try {
+				setCursorVisibility(computeArrowMode(startingBackend).hasArrows());
+			} finally {
+				renderThread.release();
+			}
 			gameViewResized();  // cheat - we just want a redraw in case size unchanged
 		} else if (key.equals(FULLSCREEN_KEY)) {
 			applyFullscreen(true);  // = already started
@@ -1604,7 +1850,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 
 	native void startPlaying(GameView _gameView, String savedGame);
 	native void startPlayingGameID(GameView _gameView, String whichBackend, String gameID);
-	native void timerTick();
+	native int timerTick(long frameTimeNanos);
 	native String htmlHelpTopic();
 	native void keyEvent(int x, int y, int k);
 	native void restartEvent();
@@ -1618,7 +1864,7 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	native void configSetString(String item_ptr, String s);
 	native void configSetBool(String item_ptr, int selected);
 	native void configSetChoice(String item_ptr, int selected);
-	native void serialise();
+	native String serialise(boolean compact);
 	native static int identifyBackend(String savedGame);
 	native String getCurrentParams();
 	native void requestKeys(String backend, String params);
@@ -1627,8 +1873,20 @@ public class GamePlay extends ActionBarActivity implements OnSharedPreferenceCha
 	native String[] getPresets();
 	native String getGameTitle();
 	native int getUIVisibility();
+	native static String getStats();
+	native static boolean startHeapAccounting();
+	native static String fullParams(String backend, String params);
+	native static long genSubmit(String[] args, boolean urgent);
+	native static String genWait(long job);
+	native static void genCancel(long job);
+	native static int genProgress(long job);
+	native static void genRelease(long job);
+	native static int genRelaxed(long job);
+	native static void openPuzzlePack(AssetManager assets);
 
 	static {
 		System.loadLibrary("puzzles");
+		// Before any games exist, so that the figures in feedback cover everything they allocate
+		if (BuildConfig.DEBUG) startHeapAccounting();
 	}
 }
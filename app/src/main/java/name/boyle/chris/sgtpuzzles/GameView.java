@@ -26,6 +26,7 @@ import android.support.v4.widget.EdgeEffectCompat;
 import android.support.v4.widget.ScrollerCompat;
 import android.util.AttributeSet;
 import android.util.DisplayMetrics;
+import android.util.SparseIntArray;
 import android.view.GestureDetector;
 import android.view.HapticFeedbackConstants;
 import android.view.KeyEvent;
@@ -34,14 +35,107 @@ import android.view.ScaleGestureDetector;
 import android.view.View;
 import android.view.ViewConfiguration;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+
 public class GameView extends View
 {
 	private GamePlay parent;
+	/** The back buffer: only the thread running the midend (normally the render thread) draws here. */
 	private Bitmap bitmap;
 	private Canvas canvas;
+	/** The front buffer, which onDraw shows; finished frames are copied in under frontLock. */
+	private Bitmap frontBitmap;
+	private Canvas frontCanvas;
+	private final Object frontLock = new Object();
+	private final Matrix frontMatrix = new Matrix(), frontInverse = new Matrix();  // zoom it was drawn at
+	private boolean frontStale = true;  // back buffer was cleared; next publish copies all of it
+	private boolean framePublished = false;  // front buffer holds a game frame, for cold start timing
+	private final Rect publishRect = new Rect();
+	/**
+	 * When zoomed in, square tiles of what has been drawn so far at this zoom, so that panning
+	 * back over a big board shows it sharp rather than checkerboard while the render thread
+	 * redraws. Tiles are indexed in board pixels (bitmap pixels less the zoom translation) and
+	 * kept fresh from the back buffer's dirty rectangles; guarded by frontLock.
+	 */
+	private static final int TILE_SIZE = 256;
+	private final Map<Long, Bitmap> tiles = new LinkedHashMap<Long, Bitmap>(16, 0.75f, true);
+	private float tileScale = 0.f;
+	private final Canvas tileCanvas = new Canvas();
+	private final Rect tileRect = new Rect(), tileSrc = new Rect(), tileDst = new Rect();
+	private final RectF tileVisible = new RectF();
+	private final Matrix tileDrawMatrix = new Matrix(), tileDrawInverse = new Matrix();
+	private final float[] tileMatrixValues = new float[9];  // matrixValues belongs to the render thread
 	private final Paint paint;
 	private Paint checkerboardPaint;
-	private final Bitmap[] blitters;
+	/** A blitter's pixels; may be bigger than it needs, since surfaces are pooled and reused. */
+	private static class BlitterSurface {
+		final Bitmap bitmap;
+		final Canvas canvas;
+		int w, h;  // in bitmap pixels, i.e. already zoomed
+		BlitterSurface(int w, int h) {
+			bitmap = Bitmap.createBitmap(w, h, BITMAP_CONFIG);
+			canvas = new Canvas(bitmap);
+			this.w = w;
+			this.h = h;
+		}
+	}
+	private static final int MAX_POOLED_BLITTERS = 32;
+	private int pooledBlitterPixels = 0;  // kept under half the main bitmap
+	private final List<BlitterSurface> blitters = new ArrayList<BlitterSurface>();
+	private int[] freeBlitterSlots = new int[16];
+	private int numFreeBlitterSlots = 0;
+	private final List<BlitterSurface> blitterPool = new ArrayList<BlitterSurface>();
+	private final Matrix blitterMatrix = new Matrix();
+	private final Rect blitterSrc = new Rect();
+	private final RectF blitterDst = new RectF();
+	/** Identifies a run of text as drawn; colour is the resolved ARGB, so a palette change just misses. */
+	private static final class TextKey {
+		String text;
+		int flags, size, argb;
+		TextKey set(String text, int flags, int size, int argb) {
+			this.text = text;
+			this.flags = flags;
+			this.size = size;
+			this.argb = argb;
+			return this;
+		}
+		@Override
+		public boolean equals(Object o) {
+			if (!(o instanceof TextKey)) return false;
+			final TextKey k = (TextKey) o;
+			return flags == k.flags && size == k.size && argb == k.argb && text.equals(k.text);
+		}
+		@Override
+		public int hashCode() {
+			return ((text.hashCode() * 31 + flags) * 31 + size) * 31 + argb;
+		}
+	}
+	/** Pre-rendered text, drawn with its top-left at (x, y) relative to the anchor; null bitmap = draw directly. */
+	private static final class TextRun {
+		final Bitmap bitmap;
+		final int x, y;
+		TextRun(Bitmap bitmap, int x, int y) {
+			this.bitmap = bitmap;
+			this.x = x;
+			this.y = y;
+		}
+		int pixels() { return bitmap == null ? 0 : bitmap.getWidth() * bitmap.getHeight(); }
+	}
+	private static final int MAX_CACHED_TEXT_RUNS = 512, MAX_TEXT_RUN_PIXELS = 128 * 128;
+	private final Map<TextKey, TextRun> textCache = new LinkedHashMap<TextKey, TextRun>(64, 0.75f, true);
+	private int textCachePixels = 0;  // kept under a quarter of the main bitmap
+	private final TextKey textProbe = new TextKey();
+	private final SparseIntArray textOffsets = new SparseIntArray();  // vertical centring, by size << 1 | mono
+	private final Rect textBounds = new Rect();
+	private final Paint textPaint;
+	private boolean textCacheUsable = false;
 	int[] colours = new int[0];
 	int w, h;
 	private final int longPressTimeout = ViewConfiguration.getLongPressTimeout();
@@ -72,13 +166,23 @@ public class GameView extends View
 	final Point TEXTURE_SIZE_BEFORE_ICS = new Point(2048, 2048);
 	private int overdrawX, overdrawY;
 	private Matrix zoomMatrix = new Matrix(), zoomInProgressMatrix = new Matrix(),
-			inverseZoomMatrix = new Matrix(), tempDrawMatrix = new Matrix();
+			inverseZoomMatrix = new Matrix(), tempDrawMatrix = new Matrix(), invalidMatrix = new Matrix();
+	private final RectF invalidRect = new RectF();
 	enum DragMode { UNMODIFIED, REVERT_OFF_SCREEN, REVERT_TO_START, PREVENT }
 	private DragMode dragMode = DragMode.UNMODIFIED;
 	private ScrollerCompat mScroller;
 	private EdgeEffectCompat[] edges = new EdgeEffectCompat[4];
 	// ARGB_8888 is viewable in Android Studio debugger but very memory-hungry
 	// It's also necessary to work around a 4.1 bug https://github.com/chrisboyle/sgtpuzzles/issues/63
+	// Opcodes for drawBuffer, matching android.c
+	private static final int CMD_CLIP = 1, CMD_UNCLIP = 2, CMD_TEXT = 3, CMD_RECT = 4, CMD_LINE = 5,
+			CMD_POLY = 6, CMD_CIRCLE = 7, CMD_BLITTER_SAVE = 8, CMD_BLITTER_LOAD = 9;
+	private static final Charset UTF_8 = Charset.forName("UTF-8");
+	private byte[] textBytes = new byte[64];
+	private boolean rasteriserAvailable = true;
+	private final int[] rasterClip = new int[4];
+	private final Rect clipBounds = new Rect();
+	private final float[] matrixValues = new float[9];
 	private static final Bitmap.Config BITMAP_CONFIG =
 			(Build.VERSION.SDK_INT == Build.VERSION_CODES.JELLY_BEAN)  // bug only seen on 4.1.x
 					? Bitmap.Config.ARGB_4444 : Bitmap.Config.RGB_565;
@@ -90,14 +194,18 @@ public class GameView extends View
 			this.parent = (GamePlay)context;
 		bitmap = Bitmap.createBitmap(100, 100, BITMAP_CONFIG);  // for safety
 		canvas = new Canvas(bitmap);
+		frontBitmap = Bitmap.createBitmap(100, 100, BITMAP_CONFIG);
+		frontCanvas = new Canvas(frontBitmap);
 		paint = new Paint();
 		paint.setAntiAlias(true);
 		paint.setStrokeCap(Paint.Cap.SQUARE);
 		paint.setStrokeWidth(1.f);  // will be scaled with everything else as long as it's non-zero
+		textPaint = new Paint();
+		textPaint.setAntiAlias(true);
+		textPaint.setStyle(Paint.Style.FILL);
 		checkerboardPaint = new Paint();
 		final Bitmap checkerboard = ((BitmapDrawable) getResources().getDrawable(R.drawable.checkerboard)).getBitmap();
 		checkerboardPaint.setShader(new BitmapShader(checkerboard, Shader.TileMode.REPEAT, Shader.TileMode.REPEAT));
-		blitters = new Bitmap[512];
 		maxDistSq = Math.pow(ViewConfiguration.get(context).getScaledTouchSlop(), 2);
 		backgroundColour = getDefaultBackgroundColour();
 		mScroller = ScrollerCompat.create(context);
@@ -261,7 +369,6 @@ public class GameView extends View
 		} else if (exceedsTouchSlop(h - bottomRight.y)) {
 			edges[2].onRelease();
 		}
-		canvas.setMatrix(zoomMatrix);
 		invertZoomMatrix();  // now with our changes
 	}
 
@@ -300,8 +407,13 @@ public class GameView extends View
 				final boolean wasZoomedOut = (scale == 1.f);
 				if (nextScale < 1.01f) {
 					if (! wasZoomedOut) {
-						resetZoomMatrix();
-						redrawForZoomChange();
+						lockRenderer();
+						try {
+							resetZoomMatrix();
+							redrawForZoomChange();
+						} finally {
+							unlockRenderer();
+						}
 					}
 				} else {
 					if (nextScale > MAX_ZOOM) {
@@ -320,6 +432,7 @@ public class GameView extends View
 	}
 
 	void resetZoomForClear() {
+		clearTiles();  // a new game
 		resetZoomMatrix();
 		canvas.setMatrix(zoomMatrix);
 		invertZoomMatrix();
@@ -345,17 +458,33 @@ public class GameView extends View
 			parent.zoomedIn();
 		}
 		zoomMatrixUpdated(false);  // constrains zoomInProgressMatrix
-		zoomMatrix.postConcat(zoomInProgressMatrix);
-		zoomInProgressMatrix.reset();
-		canvas.setMatrix(zoomMatrix);
-		invertZoomMatrix();
-		if (parent != null) {
-			clear();
-			parent.gameViewResized();  // not just forceRedraw() - need to reallocate blitters
+		lockRenderer();
+		try {
+			snapshotTiles();
+			zoomMatrix.postConcat(zoomInProgressMatrix);
+			zoomInProgressMatrix.reset();
+			canvas.setMatrix(zoomMatrix);
+			invertZoomMatrix();
+			if (parent != null) {
+				clear();
+				clearTextCache();
+				parent.gameViewResized();  // not just forceRedraw() - need to reallocate blitters
+			}
+		} finally {
+			unlockRenderer();
 		}
 		ViewCompat.postInvalidateOnAnimation(GameView.this);
 	}
 
+	/** Exclude the render thread while changing what it draws with (zoom, bitmap); reentrant. */
+	private void lockRenderer() {
+		if (parent != null) parent.renderThread.acquire();
+	}
+
+	private void unlockRenderer() {
+		if (parent != null) parent.renderThread.release();
+	}
+
 	private float getXScale(Matrix m) {
 		float[] values = new float[9];
 		m.getValues(values);
@@ -423,6 +552,13 @@ public class GameView extends View
 				}
 			}
 			if (touchState == TouchState.DRAGGING) {
+				if (parent.dragFollowsPath) {
+					// Android batches samples per frame; such backends want all of them
+					for (int i = 0; i < event.getHistorySize(); i++) {
+						parent.sendKey(viewToGame(new PointF(event.getHistoricalX(i), event.getHistoricalY(i))),
+								button + DRAG);
+					}
+				}
 				parent.sendKey(viewToGame(pointFromEvent(event)), button + DRAG);
 				return true;
 			}
@@ -507,19 +643,35 @@ public class GameView extends View
 	@Override
 	protected void onDraw( Canvas c )
 	{
-		if( bitmap == null ) return;
-		tempDrawMatrix.reset();
-		tempDrawMatrix.preTranslate(-overdrawX, -overdrawY);
-		tempDrawMatrix.preConcat(zoomInProgressMatrix);
-		final int restore = c.save();
-		c.concat(tempDrawMatrix);
-		float[] f = { 0, 0, bitmap.getWidth(), bitmap.getHeight() };
-		tempDrawMatrix.mapPoints(f);
-		if (f[0] > 0 || f[1] < w || f[2] < 0 || f[3] > h) {
-			c.drawPaint(checkerboardPaint);
-		}
-		c.drawBitmap(bitmap, 0, 0, null);
-		c.restoreToCount(restore);
+		if( frontBitmap == null ) return;
+		final boolean firstGameFrame;
+		synchronized (frontLock) {
+			firstGameFrame = GamePlay.coldStartPending && framePublished;
+			tempDrawMatrix.reset();
+			tempDrawMatrix.preTranslate(-overdrawX, -overdrawY);
+			tempDrawMatrix.preConcat(zoomInProgressMatrix);
+			final int restore = c.save();
+			c.concat(tempDrawMatrix);
+			// After a zoom, show the old frame at the new zoom until the render thread catches up
+			final boolean compensate = !frontMatrix.equals(zoomMatrix) && frontMatrix.invert(frontInverse);
+			if (compensate) {
+				tempDrawMatrix.preConcat(zoomMatrix);
+				tempDrawMatrix.preConcat(frontInverse);
+			}
+			float[] f = { 0, 0, frontBitmap.getWidth(), frontBitmap.getHeight() };
+			tempDrawMatrix.mapPoints(f);
+			if (f[0] > 0 || f[1] < w || f[2] < 0 || f[3] > h) {
+				c.drawPaint(checkerboardPaint);
+				drawTiles(c);
+			}
+			if (compensate) {
+				c.concat(zoomMatrix);
+				c.concat(frontInverse);
+			}
+			c.drawBitmap(frontBitmap, 0, 0, null);
+			c.restoreToCount(restore);
+		}
+		if (firstGameFrame) GamePlay.reportColdStart();
 		boolean keepAnimating = false;
 		for (int i = 0; i < 4; i++) {
 			if (!edges[i].isFinished()) {
@@ -549,6 +701,16 @@ public class GameView extends View
 	{
 		if( w <= 0 ) w = 1;
 		if( h <= 0 ) h = 1;
+		lockRenderer();
+		try {
+			sizeChanged(w, h);
+		} finally {
+			unlockRenderer();
+		}
+	}
+
+	private void sizeChanged(int w, int h)
+	{
 		if (bitmap != null) bitmap.recycle();
 		overdrawX = Math.round(ZOOM_OVERDRAW_PROPORTION * w);
 		overdrawY = Math.round(ZOOM_OVERDRAW_PROPORTION * h);
@@ -561,6 +723,13 @@ public class GameView extends View
 		overdrawX = Math.min(overdrawX, (maxTextureSize.x - w) / 2);
 		overdrawY = Math.min(overdrawY, (maxTextureSize.y - h) / 2);
 		bitmap = Bitmap.createBitmap(w + 2 * overdrawX, h + 2 * overdrawY, BITMAP_CONFIG);
+		synchronized (frontLock) {
+			clearTiles();
+			if (frontBitmap != null) frontBitmap.recycle();
+			frontBitmap = Bitmap.createBitmap(bitmap.getWidth(), bitmap.getHeight(), BITMAP_CONFIG);
+			frontBitmap.eraseColor(backgroundColour);
+			frontCanvas = new Canvas(frontBitmap);
+		}
 		clear();
 		canvas = new Canvas(bitmap);
 		this.w = w; this.h = h;
@@ -573,6 +742,7 @@ public class GameView extends View
 			int mx = (w-s)/2, my = (h-s)/2;
 			d.setBounds(new Rect(mx,my,mx+s,my+s));
 			d.draw(canvas);
+			publish(0, 0, bitmap.getWidth(), bitmap.getHeight());
 		}
 	}
 
@@ -593,6 +763,175 @@ public class GameView extends View
 	public void clear()
 	{
 		bitmap.eraseColor(backgroundColour);
+		synchronized (frontLock) {
+			frontStale = true;  // but keep showing the old frame until there's a new one
+		}
+		postInvalidate();  // the game will only invalidate what it redraws
+	}
+
+	/** Copy part of the back buffer, in bitmap pixels, to the front buffer for onDraw. */
+	private void publish(int left, int top, int right, int bottom)
+	{
+		synchronized (frontLock) {
+			// After a clear, the redraw is of the same state (or clearTiles was called)
+			final boolean redrawAfterClear = frontStale;
+			if (frontStale) {
+				left = top = 0;
+				right = bitmap.getWidth();
+				bottom = bitmap.getHeight();
+				frontStale = false;
+			}
+			publishRect.set(left, top, right, bottom);
+			if (!tiles.isEmpty()) updateTiles(publishRect, !redrawAfterClear);
+			if (publishRect.intersect(0, 0, bitmap.getWidth(), bitmap.getHeight())) {
+				frontCanvas.drawBitmap(bitmap, publishRect, publishRect, null);
+			}
+			frontMatrix.set(zoomMatrix);
+			framePublished = true;
+		}
+	}
+
+	/** End of a frame from a backend that doesn't report what it drew. */
+	@UsedByJNI
+	void postInvalidateAll()
+	{
+		publish(Integer.MIN_VALUE / 2, Integer.MIN_VALUE / 2, Integer.MAX_VALUE / 2, Integer.MAX_VALUE / 2);
+		postInvalidate();
+	}
+
+	private static long tileKey(int col, int row) {
+		return ((long) row << 32) | (col & 0xffffffffL);
+	}
+
+	private void clearTiles() {
+		synchronized (frontLock) {
+			for (Bitmap tile : tiles.values()) tile.recycle();
+			tiles.clear();
+			tileScale = 0.f;
+		}
+	}
+
+	/** Copy part of src, whose pixel (0,0) is board pixel (-ox, -oy), into a tile. */
+	private void copyToTile(Bitmap tile, int col, int row, Bitmap src, int ox, int oy, Rect part) {
+		tileSrc.set(part);
+		tileDst.set(part);
+		tileDst.offset(-ox - col * TILE_SIZE, -oy - row * TILE_SIZE);
+		tileCanvas.setBitmap(tile);
+		tileCanvas.drawBitmap(src, tileSrc, tileDst, null);
+	}
+
+	/**
+	 * Back buffer pixels in dirty (unclipped, in bitmap pixels) have changed: refresh the tiles
+	 * they cover, or drop any that were partly off the back buffer and so can't be refreshed.
+	 */
+	private void updateTiles(Rect dirty, boolean evictUnrefreshable) {
+		zoomMatrix.getValues(matrixValues);
+		if (matrixValues[Matrix.MSCALE_X] != tileScale) {
+			clearTiles();
+			return;
+		}
+		final int ox = Math.round(matrixValues[Matrix.MTRANS_X]), oy = Math.round(matrixValues[Matrix.MTRANS_Y]);
+		final Iterator<Map.Entry<Long, Bitmap>> it = tiles.entrySet().iterator();
+		while (it.hasNext()) {
+			final Map.Entry<Long, Bitmap> e = it.next();
+			final int col = (int) (long) e.getKey(), row = (int) (e.getKey() >> 32);
+			tileRect.set(col * TILE_SIZE + ox, row * TILE_SIZE + oy,
+					(col + 1) * TILE_SIZE + ox, (row + 1) * TILE_SIZE + oy);
+			if (!Rect.intersects(tileRect, dirty)) continue;
+			if (evictUnrefreshable && !(tileRect.left >= 0 && tileRect.top >= 0
+					&& tileRect.right <= bitmap.getWidth() && tileRect.bottom <= bitmap.getHeight())) {
+				e.getValue().recycle();
+				it.remove();
+				continue;
+			}
+			if (tileRect.intersect(dirty) && tileRect.intersect(0, 0, bitmap.getWidth(), bitmap.getHeight())) {
+				copyToTile(e.getValue(), col, row, bitmap, ox, oy, tileRect);
+			}
+		}
+	}
+
+	/**
+	 * Before the zoom changes (a pan or pinch ends), keep the finished front buffer as tiles:
+	 * those it wholly covers, up to as many pixels as the back buffer itself.
+	 */
+	private void snapshotTiles() {
+		synchronized (frontLock) {
+			frontMatrix.getValues(tileMatrixValues);
+			final float scale = tileMatrixValues[Matrix.MSCALE_X];
+			if (scale < 1.01f) {
+				clearTiles();
+				return;
+			}
+			if (scale != tileScale) {
+				clearTiles();
+				tileScale = scale;
+			}
+			final int ox = Math.round(tileMatrixValues[Matrix.MTRANS_X]), oy = Math.round(tileMatrixValues[Matrix.MTRANS_Y]);
+			final int maxTiles = Math.max(4, frontBitmap.getWidth() * frontBitmap.getHeight() / (TILE_SIZE * TILE_SIZE));
+			final int c0 = (int) Math.ceil(-ox / (float) TILE_SIZE), c1 = (int) Math.floor((frontBitmap.getWidth() - ox) / (float) TILE_SIZE);
+			final int r0 = (int) Math.ceil(-oy / (float) TILE_SIZE), r1 = (int) Math.floor((frontBitmap.getHeight() - oy) / (float) TILE_SIZE);
+			for (int row = r0; row < r1; row++) {
+				for (int col = c0; col < c1; col++) {
+					final Long key = tileKey(col, row);
+					Bitmap tile = tiles.get(key);
+					if (tile == null) {
+						if (tiles.size() >= maxTiles) {
+							final Iterator<Bitmap> eldest = tiles.values().iterator();
+							tile = eldest.next();  // reuse the least recently seen
+							eldest.remove();
+						} else {
+							tile = Bitmap.createBitmap(TILE_SIZE, TILE_SIZE, BITMAP_CONFIG);
+						}
+						tiles.put(key, tile);
+					}
+					tileRect.set(col * TILE_SIZE + ox, row * TILE_SIZE + oy,
+							(col + 1) * TILE_SIZE + ox, (row + 1) * TILE_SIZE + oy);
+					copyToTile(tile, col, row, frontBitmap, ox, oy, tileRect);
+				}
+			}
+		}
+	}
+
+	/** Draw whichever tiles are in view; c is in current bitmap pixels. Holding frontLock. */
+	private void drawTiles(Canvas c) {
+		if (tiles.isEmpty()) return;
+		zoomMatrix.getValues(tileMatrixValues);
+		if (tileMatrixValues[Matrix.MSCALE_X] != tileScale) return;
+		final int ox = Math.round(tileMatrixValues[Matrix.MTRANS_X]), oy = Math.round(tileMatrixValues[Matrix.MTRANS_Y]);
+		tileVisible.set(0, 0, w, h);
+		tileDrawMatrix.reset();
+		tileDrawMatrix.preTranslate(-overdrawX, -overdrawY);
+		tileDrawMatrix.preConcat(zoomInProgressMatrix);
+		if (!tileDrawMatrix.invert(tileDrawInverse)) return;
+		tileDrawInverse.mapRect(tileVisible);
+		final int c0 = (int) Math.floor((tileVisible.left - ox) / TILE_SIZE), c1 = (int) Math.ceil((tileVisible.right - ox) / TILE_SIZE);
+		final int r0 = (int) Math.floor((tileVisible.top - oy) / TILE_SIZE), r1 = (int) Math.ceil((tileVisible.bottom - oy) / TILE_SIZE);
+		for (int row = r0; row < r1; row++) {
+			for (int col = c0; col < c1; col++) {
+				final Bitmap tile = tiles.get(tileKey(col, row));
+				if (tile != null) c.drawBitmap(tile, col * TILE_SIZE + ox, row * TILE_SIZE + oy, null);
+			}
+		}
+	}
+
+	/**
+	 * End of a frame: publish this rectangle in game (canvas) coordinates, [x1, x2) x [y1, y2),
+	 * to the front buffer, and invalidate just the part of the view showing it, allowing for
+	 * zoom and the overdraw margins.
+	 */
+	@UsedByJNI
+	void postInvalidateGame(int x1, int y1, int x2, int y2)
+	{
+		// A pixel of slop for anti-aliasing, and since we draw at half-pixel offsets
+		invalidRect.set(x1 - 1, y1 - 1, x2 + 1, y2 + 1);
+		zoomMatrix.mapRect(invalidRect);
+		publish((int) Math.floor(invalidRect.left), (int) Math.floor(invalidRect.top),
+				(int) Math.ceil(invalidRect.right), (int) Math.ceil(invalidRect.bottom));
+		invalidMatrix.set(zoomInProgressMatrix);
+		invalidMatrix.postTranslate(-overdrawX, -overdrawY);
+		invalidMatrix.mapRect(invalidRect);
+		postInvalidate((int) Math.floor(invalidRect.left), (int) Math.floor(invalidRect.top),
+				(int) Math.ceil(invalidRect.right), (int) Math.ceil(invalidRect.bottom));
 	}
 
 	@Override
@@ -606,8 +945,98 @@ public class GameView extends View
 		return getResources().getColor(R.color.game_background);
 	}
 
+	/**
+	 * Replay n ints of drawing commands recorded by android.c. Where possible, runs of
+	 * non-anti-aliased fills and clips are rasterised natively, bypassing Canvas.
+	 */
 	@UsedByJNI
-	void clipRect(int x, int y, int w, int h)
+	void drawBuffer(ByteBuffer buf, int n)
+	{
+		buf.order(ByteOrder.nativeOrder());
+		zoomMatrix.getValues(matrixValues);
+		final int tx = Math.round(matrixValues[Matrix.MTRANS_X]);
+		final int ty = Math.round(matrixValues[Matrix.MTRANS_Y]);
+		// Only when Canvas would hit exactly the same pixels, i.e. not zoomed
+		final boolean pixelAligned = matrixValues[Matrix.MPERSP_0] == 0.f && matrixValues[Matrix.MPERSP_1] == 0.f
+				&& matrixValues[Matrix.MPERSP_2] == 1.f
+				&& matrixValues[Matrix.MSCALE_X] == 1.f && matrixValues[Matrix.MSCALE_Y] == 1.f
+				&& matrixValues[Matrix.MSKEW_X] == 0.f && matrixValues[Matrix.MSKEW_Y] == 0.f
+				&& matrixValues[Matrix.MTRANS_X] == tx && matrixValues[Matrix.MTRANS_Y] == ty;
+		boolean canRasterise = pixelAligned && rasteriserAvailable && BITMAP_CONFIG == Bitmap.Config.RGB_565;
+		// Cached text is pre-rendered at 1:1, so it's only a faithful substitute under the same condition
+		textCacheUsable = pixelAligned;
+		int i = 0;
+		while (i < n) {
+			final int op = buf.getInt(4 * i);
+			if (canRasterise && (op == CMD_CLIP || op == CMD_UNCLIP || op == CMD_RECT)) {
+				canvas.getClipBounds(clipBounds);
+				rasterClip[0] = clipBounds.left;
+				rasterClip[1] = clipBounds.top;
+				rasterClip[2] = clipBounds.right;
+				rasterClip[3] = clipBounds.bottom;
+				final int next = rasterise(bitmap, buf, i, n, tx, ty, w, h, colours, rasterClip);
+				if (next < 0) {
+					rasteriserAvailable = canRasterise = false;
+				} else if (next > i) {
+					canvas.clipRect(rasterClip[0] - 0.5f, rasterClip[1] - 0.5f,
+							rasterClip[2] - 0.5f, rasterClip[3] - 0.5f, Region.Op.REPLACE);
+					i = next;
+					continue;
+				}
+			}
+			i = replay(buf, i);
+		}
+	}
+
+	/** Draw the single command at index i via Canvas, returning the index of the next. */
+	private int replay(ByteBuffer buf, int i)
+	{
+		final int p = 4 * i;
+		switch (buf.getInt(p)) {
+		case CMD_CLIP:
+			clipRect(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12), buf.getInt(p + 16));
+			return i + 5;
+		case CMD_UNCLIP:
+			unClip(buf.getInt(p + 4), buf.getInt(p + 8));
+			return i + 3;
+		case CMD_TEXT: {
+			final int len = buf.getInt(p + 24);
+			if (len > textBytes.length) textBytes = new byte[len * 2];
+			buf.position(p + 28);
+			buf.get(textBytes, 0, len);
+			drawText(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12), buf.getInt(p + 16),
+					buf.getInt(p + 20), new String(textBytes, 0, len, UTF_8));
+			return i + 7 + (len + 3) / 4;
+		}
+		case CMD_RECT:
+			fillRect(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12), buf.getInt(p + 16), buf.getInt(p + 20));
+			return i + 6;
+		case CMD_LINE:
+			drawLine(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12), buf.getInt(p + 16), buf.getInt(p + 20));
+			return i + 6;
+		case CMD_POLY: {
+			final int npoints = buf.getInt(p + 12);
+			drawPoly(buf, p + 16, npoints, buf.getInt(p + 4), buf.getInt(p + 8));
+			return i + 4 + 2 * npoints;
+		}
+		case CMD_CIRCLE:
+			drawCircle(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12), buf.getInt(p + 16), buf.getInt(p + 20));
+			return i + 6;
+		case CMD_BLITTER_SAVE:
+			blitterSave(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12));
+			return i + 4;
+		case CMD_BLITTER_LOAD:
+			blitterLoad(buf.getInt(p + 4), buf.getInt(p + 8), buf.getInt(p + 12));
+			return i + 4;
+		default:
+			throw new RuntimeException("Bad draw command " + buf.getInt(p) + " at " + i);
+		}
+	}
+
+	private static native int rasterise(Bitmap bitmap, ByteBuffer buf, int start, int n,
+			int tx, int ty, int viewW, int viewH, int[] colours, int[] clip);
+
+	private void clipRect(int x, int y, int w, int h)
 	{
 		canvas.clipRect(new RectF(x - 0.5f, y - 0.5f, x + w - 0.5f, y + h - 0.5f), Region.Op.REPLACE);
 	}
@@ -618,8 +1047,7 @@ public class GameView extends View
 		canvas.clipRect(marginX - 0.5f, marginY - 0.5f, w - marginX - 1.5f, h - marginY - 1.5f, Region.Op.REPLACE);
 	}
 
-	@UsedByJNI
-	void fillRect(final int x, final int y, final int w, final int h, final int colour)
+	private void fillRect(final int x, final int y, final int w, final int h, final int colour)
 	{
 		paint.setColor(colours[colour]);
 		paint.setStyle(Paint.Style.FILL);
@@ -634,25 +1062,23 @@ public class GameView extends View
 		paint.setAntiAlias(true);
 	}
 
-	@UsedByJNI
-	void drawLine(int x1, int y1, int x2, int y2, int colour)
+	private void drawLine(int x1, int y1, int x2, int y2, int colour)
 	{
 		paint.setColor(colours[colour]);
 		canvas.drawLine(x1, y1, x2, y2, paint);
 	}
 
-	@UsedByJNI
-	void drawPoly(int[] points, int ox, int oy, int line, int fill)
+	private void drawPoly(ByteBuffer buf, int pos, int npoints, int line, int fill)
 	{
 		Path path = new Path();
-		path.moveTo(points[0] + ox, points[1] + oy);
-		for(int i=1; i < points.length/2; i++) {
-			path.lineTo(points[2 * i] + ox, points[2 * i + 1] + oy);
+		path.moveTo(buf.getInt(pos), buf.getInt(pos + 4));
+		for(int i=1; i < npoints; i++) {
+			path.lineTo(buf.getInt(pos + 8 * i), buf.getInt(pos + 8 * i + 4));
 		}
 		path.close();
 		// cheat slightly: polygons up to square look prettier without (and adjacent squares want to
 		// look continuous in lightup)
-		boolean disableAntiAlias = points.length <= 8;  // 2 per point
+		boolean disableAntiAlias = npoints <= 4;
 		if (disableAntiAlias) paint.setAntiAlias(false);
 		drawPoly(path, line, fill);
 		paint.setAntiAlias(true);
@@ -670,8 +1096,7 @@ public class GameView extends View
 		canvas.drawPath(p, paint);
 	}
 
-	@UsedByJNI
-	void drawCircle(int x, int y, int r, int lineColour, int fillColour)
+	private void drawCircle(int x, int y, int r, int lineColour, int fillColour)
 	{
 		if (fillColour != -1) {
 			paint.setColor(colours[fillColour]);
@@ -683,64 +1108,183 @@ public class GameView extends View
 		canvas.drawOval(new RectF(x-r, y-r, x+r, y+r), paint);
 	}
 
-	@UsedByJNI
-	void drawText(int x, int y, int flags, int size, int colour, String text)
+	/**
+	 * Draw text, as a blit of a cached pre-rendering where possible: puzzles redraw the same
+	 * clue numbers in the same few colours over and over. The cache is keyed on everything
+	 * that affects the pixels and is dropped whenever the view is resized (so midend_size
+	 * may have picked a new tile size).
+	 */
+	private void drawText(int x, int y, int flags, int size, int colour, String text)
 	{
-		paint.setColor(colours[colour]);
-		paint.setStyle(Paint.Style.FILL);
-		paint.setTypeface( (flags & TEXT_MONO) != 0 ? Typeface.MONOSPACE : Typeface.DEFAULT );
-		paint.setTextSize(size);
-		Paint.FontMetrics fm = paint.getFontMetrics();
-		float asc = Math.abs(fm.ascent), desc = Math.abs(fm.descent);
-		if ((flags & ALIGN_V_CENTRE) != 0) y += asc - (asc+desc)/2;
-		if ((flags & ALIGN_H_CENTRE) != 0) paint.setTextAlign( Paint.Align.CENTER );
-		else if ((flags & ALIGN_H_RIGHT) != 0) paint.setTextAlign( Paint.Align.RIGHT );
-		else paint.setTextAlign( Paint.Align.LEFT );
-		canvas.drawText(text, x, y, paint);
+		final int argb = colours[colour];
+		if (textCacheUsable) {
+			TextRun run = textCache.get(textProbe.set(text, flags, size, argb));
+			if (run == null) {
+				run = renderText(text, flags, size, argb);
+				cacheText(new TextKey().set(text, flags, size, argb), run);
+			}
+			if (run.bitmap != null) {
+				canvas.drawBitmap(run.bitmap, x + run.x, y + run.y, null);
+				return;
+			}
+		}
+		setTextStyle(flags, size);
+		textPaint.setColor(argb);
+		if ((flags & ALIGN_H_CENTRE) != 0) textPaint.setTextAlign( Paint.Align.CENTER );
+		else if ((flags & ALIGN_H_RIGHT) != 0) textPaint.setTextAlign( Paint.Align.RIGHT );
+		else textPaint.setTextAlign( Paint.Align.LEFT );
+		canvas.drawText(text, x, y + textVerticalOffset(flags, size), textPaint);
+	}
+
+	private void setTextStyle(int flags, int size)
+	{
+		final Typeface typeface = (flags & TEXT_MONO) != 0 ? Typeface.MONOSPACE : Typeface.DEFAULT;
+		if (textPaint.getTypeface() != typeface) textPaint.setTypeface(typeface);
+		if (textPaint.getTextSize() != size) textPaint.setTextSize(size);
+	}
+
+	/** Baseline offset for ALIGN_V_CENTRE; font metrics are only fetched once per size and face. */
+	private int textVerticalOffset(int flags, int size)
+	{
+		if ((flags & ALIGN_V_CENTRE) == 0) return 0;
+		final int key = size << 1 | ((flags & TEXT_MONO) != 0 ? 1 : 0);
+		int offset = textOffsets.get(key, Integer.MIN_VALUE);
+		if (offset == Integer.MIN_VALUE) {
+			setTextStyle(flags, size);
+			Paint.FontMetrics fm = textPaint.getFontMetrics();
+			float asc = Math.abs(fm.ascent), desc = Math.abs(fm.descent);
+			offset = (int) (asc - (asc+desc)/2);
+			textOffsets.put(key, offset);
+		}
+		return offset;
+	}
+
+	/** Render text into a tight bitmap, positioned as drawText would draw it directly. */
+	private TextRun renderText(String text, int flags, int size, int argb)
+	{
+		setTextStyle(flags, size);
+		textPaint.setTextAlign(Paint.Align.LEFT);
+		textPaint.getTextBounds(text, 0, text.length(), textBounds);
+		final float width = textPaint.measureText(text);
+		final float left = ((flags & ALIGN_H_CENTRE) != 0) ? -width / 2
+				: ((flags & ALIGN_H_RIGHT) != 0) ? -width : 0;
+		final int top = textVerticalOffset(flags, size);
+		// One pixel of margin for anti-aliasing, plus one across for the sub-pixel part of left
+		final int ox = (int) Math.floor(left) + textBounds.left - 1, oy = top + textBounds.top - 1;
+		final int bw = textBounds.width() + 3, bh = textBounds.height() + 2;
+		if (textBounds.isEmpty() || bw * bh > MAX_TEXT_RUN_PIXELS) return new TextRun(null, 0, 0);
+		final Bitmap b = Bitmap.createBitmap(bw, bh, Bitmap.Config.ARGB_8888);
+		textPaint.setColor(argb);
+		new Canvas(b).drawText(text, left - ox, top - oy, textPaint);
+		return new TextRun(b, ox, oy);
+	}
+
+	private void cacheText(TextKey key, TextRun run)
+	{
+		textCache.put(key, run);
+		textCachePixels += run.pixels();
+		final int limit = bitmap.getWidth() * bitmap.getHeight() / 4;
+		final Iterator<TextRun> it = textCache.values().iterator();
+		while ((textCachePixels > limit || textCache.size() > MAX_CACHED_TEXT_RUNS) && it.hasNext()) {
+			final TextRun old = it.next();
+			if (old == run) break;  // the newest; at least keep that until it's drawn
+			it.remove();
+			textCachePixels -= old.pixels();
+			if (old.bitmap != null) old.bitmap.recycle();
+		}
+	}
+
+	void clearTextCache()
+	{
+		for (TextRun run : textCache.values()) {
+			if (run.bitmap != null) run.bitmap.recycle();
+		}
+		textCache.clear();
+		textCachePixels = 0;
+		textOffsets.clear();
 	}
 
 	@UsedByJNI
 	int blitterAlloc(int w, int h)
 	{
-		for(int i=0; i<blitters.length; i++) {
-			if (blitters[i] == null) {
-				float zoom = getXScale(zoomMatrix);
-				blitters[i] = Bitmap.createBitmap(Math.round(zoom * w), Math.round(zoom * h), BITMAP_CONFIG);
-				return i;
+		final float zoom = getXScale(zoomMatrix);
+		final int pw = Math.round(zoom * w), ph = Math.round(zoom * h);
+		// Best fit from the pool, which is small enough to search
+		BlitterSurface surface = null;
+		int best = -1;
+		for (int i = 0; i < blitterPool.size(); i++) {
+			final BlitterSurface s = blitterPool.get(i);
+			if (s.bitmap.getWidth() >= pw && s.bitmap.getHeight() >= ph && (surface == null
+					|| s.bitmap.getWidth() * s.bitmap.getHeight() < surface.bitmap.getWidth() * surface.bitmap.getHeight())) {
+				surface = s;
+				best = i;
 			}
 		}
-		throw new RuntimeException("No free blitter found!");
+		if (surface != null) {
+			blitterPool.remove(best);
+			pooledBlitterPixels -= surface.bitmap.getWidth() * surface.bitmap.getHeight();
+			surface.bitmap.eraseColor(0);  // as if new
+			surface.w = pw;
+			surface.h = ph;
+		} else {
+			surface = new BlitterSurface(pw, ph);
+		}
+		if (numFreeBlitterSlots > 0) {
+			final int i = freeBlitterSlots[--numFreeBlitterSlots];
+			blitters.set(i, surface);
+			return i;
+		}
+		blitters.add(surface);
+		return blitters.size() - 1;
 	}
 
 	@UsedByJNI
 	void blitterFree(int i)
 	{
-		if( blitters[i] == null ) return;
-		blitters[i].recycle();
-		blitters[i] = null;
+		final BlitterSurface surface = blitters.get(i);
+		if (surface == null) return;
+		blitters.set(i, null);
+		if (numFreeBlitterSlots == freeBlitterSlots.length) {
+			final int[] bigger = new int[freeBlitterSlots.length * 2];
+			System.arraycopy(freeBlitterSlots, 0, bigger, 0, numFreeBlitterSlots);
+			freeBlitterSlots = bigger;
+		}
+		freeBlitterSlots[numFreeBlitterSlots++] = i;
+		final int pixels = surface.bitmap.getWidth() * surface.bitmap.getHeight();
+		final int budget = bitmap.getWidth() * bitmap.getHeight() / 2;
+		while (!blitterPool.isEmpty() && (blitterPool.size() >= MAX_POOLED_BLITTERS
+				|| pooledBlitterPixels + pixels > budget)) {
+			final BlitterSurface oldest = blitterPool.remove(0);
+			pooledBlitterPixels -= oldest.bitmap.getWidth() * oldest.bitmap.getHeight();
+			oldest.bitmap.recycle();
+		}
+		if (pixels > budget) {
+			surface.bitmap.recycle();
+			return;
+		}
+		blitterPool.add(surface);
+		pooledBlitterPixels += pixels;
 	}
 
-	@UsedByJNI
-	void blitterSave(int i, int x, int y)
+	private void blitterSave(int i, int x, int y)
 	{
-		if( blitters[i] == null ) return;
-		Canvas c = new Canvas(blitters[i]);
-		Matrix m = new Matrix(inverseZoomMatrix);
-		m.postTranslate(-x, -y);
+		final BlitterSurface surface = blitters.get(i);
+		if (surface == null) return;
+		blitterMatrix.set(inverseZoomMatrix);
+		blitterMatrix.postTranslate(-x, -y);
 		float zoom = getXScale(zoomMatrix);
-		m.postScale(zoom, zoom);
-		m.postTranslate(-overdrawX, -overdrawY);
-		c.drawBitmap(bitmap, m, null);
+		blitterMatrix.postScale(zoom, zoom);
+		blitterMatrix.postTranslate(-overdrawX, -overdrawY);
+		surface.canvas.drawBitmap(bitmap, blitterMatrix, null);
 	}
 
-	@UsedByJNI
-	void blitterLoad(int i, int x, int y)
+	private void blitterLoad(int i, int x, int y)
 	{
-		if( blitters[i] == null ) return;
-		Matrix m = new Matrix();
+		final BlitterSurface surface = blitters.get(i);
+		if (surface == null) return;
 		float zoom = getXScale(zoomMatrix);
-		m.postScale(1 / zoom, 1 / zoom);
-		m.postTranslate(x, y);
-		canvas.drawBitmap(blitters[i], m, null);
+		blitterSrc.set(0, 0, surface.w, surface.h);
+		blitterDst.set(x, y, x + surface.w / zoom, y + surface.h / zoom);
+		canvas.drawBitmap(surface.bitmap, blitterSrc, blitterDst, null);
 	}
 }
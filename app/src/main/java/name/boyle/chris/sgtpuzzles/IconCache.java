@@ -0,0 +1,131 @@
+package name.boyle.chris.sgtpuzzles;
+
+import android.content.Context;
+import android.content.res.Resources;
+import android.graphics.Bitmap;
+import android.graphics.BitmapFactory;
+import android.os.Handler;
+import android.os.Looper;
+import android.os.Process;
+import android.support.v4.util.LruCache;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.ThreadFactory;
+
+/**
+ * Chooser icons, decoded on a background thread and kept in memory at the size they're shown.
+ * One instance lives for the whole process, so recreating the chooser (rotation, coming back
+ * from a game) finds every icon already decoded and doesn't touch the disk at all.
+ *
+ * All methods must be called on the main thread, and callbacks arrive there too.
+ */
+class IconCache {
+	interface Callback {
+		void iconLoaded(String name);
+	}
+
+	private static IconCache instance;
+
+	private final Resources resources;
+	private final String packageName;
+	private final LruCache<String, Bitmap> cache;
+	private final Map<String, List<Callback>> waiting = new HashMap<String, List<Callback>>();
+	private final Set<String> missing = new HashSet<String>();
+	private final Handler handler = new Handler(Looper.getMainLooper());
+	private final ExecutorService decoder = Executors.newSingleThreadExecutor(new ThreadFactory() {
+		@Override
+		public Thread newThread(@SuppressWarnings("NullableProblems") final Runnable r) {
+			final Thread t = new Thread(new Runnable() {
+				@Override
+				public void run() {
+					Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND);
+					r.run();
+				}
+			}, "IconDecoder");
+			t.setDaemon(true);
+			return t;
+		}
+	});
+
+	static IconCache get(Context context) {
+		if (instance == null) instance = new IconCache(context.getApplicationContext());
+		return instance;
+	}
+
+	private IconCache(Context context) {
+		resources = context.getResources();
+		packageName = context.getPackageName();
+		// The whole set at xxhdpi is a few MB; allow that much but no more than 1/16 of the heap.
+		final int maxKB = (int) Math.min(8192, Runtime.getRuntime().maxMemory() / 1024 / 16);
+		cache = new LruCache<String, Bitmap>(maxKB) {
+			@Override
+			protected int sizeOf(String key, Bitmap value) {
+				return value.getRowBytes() * value.getHeight() / 1024 + 1;
+			}
+		};
+	}
+
+	/**
+	 * Returns the named drawable scaled to sizePx square (or at its natural density-scaled size
+	 * if sizePx is 0) if it's in the cache. Otherwise returns null and queues a decode, after
+	 * which callback is told and a further call will succeed (or keep returning null, without
+	 * retrying, if the resource is missing).
+	 */
+	Bitmap get(final String name, final int sizePx, final Callback callback) {
+		final String key = name + '@' + sizePx;
+		final Bitmap cached = cache.get(key);
+		if (cached != null || missing.contains(key)) return cached;
+		List<Callback> callbacks = waiting.get(key);
+		if (callbacks != null) {
+			if (!callbacks.contains(callback)) callbacks.add(callback);
+			return null;
+		}
+		callbacks = new ArrayList<Callback>();
+		callbacks.add(callback);
+		waiting.put(key, callbacks);
+		decoder.execute(new Runnable() {
+			@Override
+			public void run() {
+				final Bitmap bitmap = decode(name, sizePx);
+				handler.post(new Runnable() {
+					@Override
+					public void run() {
+						if (bitmap != null) {
+							cache.put(key, bitmap);
+						} else {
+							missing.add(key);
+						}
+						final List<Callback> callbacks = waiting.remove(key);
+						if (callbacks != null) for (Callback c : callbacks) c.iconLoaded(name);
+					}
+				});
+			}
+		});
+		return null;
+	}
+
+	/** Stop telling callback about loads, e.g. because its activity has gone. */
+	void forget(Callback callback) {
+		for (List<Callback> callbacks : waiting.values()) callbacks.remove(callback);
+	}
+
+	private Bitmap decode(String name, int sizePx) {
+		final int id = resources.getIdentifier(name, "drawable", packageName);
+		if (id == 0) return null;
+		final Bitmap bitmap = BitmapFactory.decodeResource(resources, id);
+		if (bitmap == null || sizePx == 0
+				|| (bitmap.getWidth() == sizePx && bitmap.getHeight() == sizePx)) {
+			return bitmap;
+		}
+		final Bitmap scaled = Bitmap.createScaledBitmap(bitmap, sizePx, sizePx, true);
+		if (scaled != bitmap) bitmap.recycle();
+		return scaled;
+	}
+}
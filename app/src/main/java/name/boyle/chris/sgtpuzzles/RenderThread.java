@@ -0,0 +1,69 @@
+package name.boyle.chris.sgtpuzzles;
+
+import android.os.Process;
+
+import java.util.concurrent.ConcurrentLinkedQueue;
+import java.util.concurrent.locks.LockSupport;
+import java.util.concurrent.locks.ReentrantLock;
+
+/**
+ * The thread that runs the midend for input, resizes and timer ticks, and so does their
+ * drawing, so that an expensive redraw (Loopy or Map after a zoom, say) doesn't leave touch
+ * events waiting on the UI thread. The UI thread posts work through a lock-free queue and
+ * returns at once; the results reach the screen via GameView's front buffer.
+ *
+ * Anything else that touches native state (menu actions, saving, dialogs) must do so between
+ * {@link #acquire()} and {@link #release()}. Acquiring runs any work still queued first, on
+ * the caller's thread, so that for example a save always includes the last move sent.
+ */
+class RenderThread extends Thread {
+	private final ConcurrentLinkedQueue<Runnable> queue = new ConcurrentLinkedQueue<Runnable>();
+	private final ReentrantLock lock = new ReentrantLock();
+	private volatile boolean quitting = false;
+
+	RenderThread() {
+		super("PuzzleRender");
+		setDaemon(true);
+	}
+
+	void post(Runnable r) {
+		queue.add(r);
+		LockSupport.unpark(this);
+	}
+
+	void acquire() {
+		lock.lock();
+		drain();
+	}
+
+	void release() {
+		lock.unlock();
+	}
+
+	void quit() {
+		quitting = true;
+		LockSupport.unpark(this);
+	}
+
+	private void drain() {
+		Runnable r;
+		while ((r = queue.poll()) != null) r.run();
+	}
+
+	@Override
+	public void run() {
+		Process.setThreadPriority(Process.THREAD_PRIORITY_DISPLAY);
+		while (!quitting) {
+			if (queue.isEmpty()) {
+				LockSupport.park(this);  // may return spuriously; we just check again
+				continue;
+			}
+			lock.lock();
+			try {
+				drain();
+			} finally {
+				lock.unlock();
+			}
+		}
+	}
+}
@@ -26,8 +26,15 @@ public class SendFeedbackActivity extends Activity
 		final String emailSubject = getEmailSubject(this);
 		String uri = "mailto:" + getString(R.string.author_email) + "?subject=" + Uri.encode(emailSubject);
 		final String reason = getIntent().getStringExtra(REASON);
-		if (reason != null) {
-			uri += "&body=" + Uri.encode("Reason: " + reason + "\n\n");
+		String body = (reason != null) ? "Reason: " + reason + "\n\n" : "";
+		// Where the current game has spent its time (and in debug builds, memory), in case it's a performance complaint
+		final String stats = GamePlay.getStats();
+		if (stats != null) {
+			body += "\n\nTimings:\n" + stats;
+		}
+		body += "\n\nPre-generation:\n" + GameGenCache.get(this).getStats();
+		if (body.length() > 0) {
+			uri += "&body=" + Uri.encode(body);
 		}
 		i.setData(Uri.parse(uri));
 		i.addFlags(Intent.FLAG_ACTIVITY_CLEAR_WHEN_TASK_RESET);
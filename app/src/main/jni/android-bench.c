@@ -0,0 +1,879 @@
+/*
+ * android-bench.c: the stand-alone puzzles-bench executable, which
+ * times generation and solving for every preset of every game.
+ *
+ * Each preset is run in a child process, so that one which crashes
+ * or runs past the time limit doesn't take the rest with it, and so
+ * that the child's peak resident size can stand in for the memory
+ * that preset needs. That's reported beyond an idle child's, so it
+ * includes the pages of code the game touched as well as its heap;
+ * it's what the low-memory killer sees, after all. Every run uses a
+ * fixed seed, so results are comparable between builds and devices.
+ *
+ * With --heap, malloc.c's accounting is on in the child too, and the
+ * peak heap and allocations per run for generation and for solving
+ * are reported as well. That slows every allocation a little, so it's
+ * off by default to keep timings comparable.
+ *
+ * With --grids it instead times building each of grid.c's grid types
+ * at increasing sizes, which is most of the setup cost of large Loopy
+ * games.
+ *
+ * With --solvers it instead runs the games' STANDALONE_SOLVER builds
+ * (built alongside it, as <game>solver) over a fixed corpus of game
+ * IDs, checking that each still prints exactly what it printed when
+ * the corpus was recorded (so solutions and difficulty grades are
+ * unchanged) and timing it. See solver-corpus/README.
+ *
+ * With --cold-start it instead repeatedly kills and relaunches the app
+ * (so it must run on the device, e.g. via adb shell) and collects the
+ * time from process start to the first frame of the resumed game, as
+ * logged by GamePlay. The median is checked against a budget.
+ *
+ * Gradle compiles everything in jni into libpuzzles too, so this is
+ * only built when -DEXECUTABLE is given.
+ */
+
+#ifdef EXECUTABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "puzzles.h"
+#include "grid.h"
+
+#define USAGE "Usage: puzzles-bench [--json] [--heap] [-n runs] [-s seed] [-t seconds] [game[:params]...]\n" \
+	      "       puzzles-bench --grids [--json] [-n runs] [-s seed]\n" \
+	      "       puzzles-bench --solvers [--record] [--json] [-n runs] [-t seconds] [-d dir] corpus...\n" \
+	      "       puzzles-bench --cold-start [--json] [-n runs] [-t seconds] [-b budget_ms]\n"
+
+#define DEFAULT_RUNS 10
+#define DEFAULT_COLD_START_BUDGET 1000  /* ms, median */
+#define DEFAULT_COLD_START_TIMEOUT 30   /* seconds per launch */
+#define SOLVER_MAX_ARGS 16
+#define APP_PACKAGE "name.boyle.chris.sgtpuzzles"
+
+struct bench_run {
+	double gen, solve;     /* milliseconds; solve is -1 if not solved */
+};
+
+struct bench_opts {
+	int runs, timeout, json, grids, cold_start, budget, heap;
+	const char *seed;
+	int solvers, record;
+	const char *solver_dir;
+};
+
+/* What the child sends after its runs, if opts->heap */
+struct bench_heap {
+	int ok;                /* FALSE if the accounting wasn't available */
+	struct heap_usage total, gen, solve;
+};
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * One run: new_desc, validate_desc and new_game count as generation,
+ * then solve is timed separately, starting from the new game. The
+ * solution is then played, untimed, and the states freed, so that a
+ * game whose execute_move can't cope with its own Solve move (which
+ * tends to change the whole grid at once) fails here.
+ */
+static void bench_one(const game *g, const game_params *params,
+		      const char *seed, struct bench_run *run)
+{
+	random_state *rs = random_new_seed(seed);
+	char *aux = NULL, *desc, *err, *move;
+	game_state *state, *solved;
+	double t0 = bench_now(), t1;
+	int tag = heap_tag(HEAP_GENERATE);
+
+	desc = g->new_desc(params, rs, &aux, FALSE);
+	err = g->validate_desc(params, desc);
+	if (err)
+		fatal("%s: generated \"%s\" fails validation: %s", g->name, desc, err);
+	state = g->new_game(NULL, params, desc);
+	t1 = bench_now();
+	run->gen = t1 - t0;
+
+	run->solve = -1;
+	if (g->can_solve) {
+		err = NULL;
+		heap_tag(HEAP_SOLVE);
+		move = g->solve(state, state, aux, &err);
+		if (move) {
+			run->solve = bench_now() - t1;
+			solved = g->execute_move(state, move);
+			if (!solved)
+				fatal("%s: can't execute its own solve move", g->name);
+			g->free_game(solved);
+			sfree(move);
+		}
+	}
+
+	heap_tag(tag);
+	g->free_game(state);
+	sfree(aux);
+	sfree(desc);
+	random_free(rs);
+}
+
+static int bench_write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static int bench_read_all(int fd, void *buf, size_t len)
+{
+	char *p = (char *)buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/*
+ * Run a preset in a child, filling runs[] (opts->runs of them) back
+ * in the parent. Returns NULL on success or a short description of
+ * how the child failed; *peak_rss_kb is set to its peak resident size,
+ * and *heap to its heap accounting if opts->heap.
+ */
+static const char *bench_preset(const game *g, const game_params *params,
+				const struct bench_opts *opts,
+				struct bench_run *runs, long *peak_rss_kb,
+				struct bench_heap *heap)
+{
+	int fds[2], status, ok;
+	struct rusage ru;
+	pid_t pid;
+
+	if (pipe(fds) < 0)
+		fatal("pipe: %s", strerror(errno));
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+		fatal("fork: %s", strerror(errno));
+	if (pid == 0) {
+		int i;
+		close(fds[0]);
+		if (opts->timeout > 0) alarm(opts->timeout);
+		if (opts->heap) heap_accounting_start();
+		for (i = 0; i < opts->runs; i++) {
+			char seed[80];
+			struct bench_run run;
+			sprintf(seed, "%.60s%d", opts->seed, i);
+			bench_one(g, params, seed, &run);
+			if (!bench_write_all(fds[1], &run, sizeof(run)))
+				_exit(1);
+		}
+		if (opts->heap) {
+			struct bench_heap h;
+			struct heap_usage tags[NHEAPTAGS];
+			memset(&h, 0, sizeof(h));
+			h.ok = heap_get_usage(&h.total, tags);
+			h.gen = tags[HEAP_GENERATE];
+			h.solve = tags[HEAP_SOLVE];
+			if (!bench_write_all(fds[1], &h, sizeof(h)))
+				_exit(1);
+		}
+		_exit(0);
+	}
+
+	close(fds[1]);
+	ok = bench_read_all(fds[0], runs, opts->runs * sizeof(*runs));
+	if (ok && opts->heap)
+		ok = bench_read_all(fds[0], heap, sizeof(*heap));
+	close(fds[0]);
+	while (wait4(pid, &status, 0, &ru) < 0) {
+		if (errno != EINTR)
+			fatal("wait4: %s", strerror(errno));
+	}
+	*peak_rss_kb = ru.ru_maxrss;
+	if (WIFSIGNALED(status))
+		return WTERMSIG(status) == SIGALRM ? "timeout" : "crashed";
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !ok)
+		return "failed";
+	return NULL;
+}
+
+/* The peak resident size of a child that does nothing, to subtract */
+static long bench_baseline_kb(void)
+{
+	struct bench_opts none = { 0, 0, FALSE, FALSE, FALSE, 0, FALSE, "" };
+	long kb = 0;
+	bench_preset(NULL, NULL, &none, NULL, &kb, NULL);
+	return kb;
+}
+
+static int bench_cmp(const void *av, const void *bv)
+{
+	double a = *(const double *)av, b = *(const double *)bv;
+	return a < b ? -1 : a > b ? +1 : 0;
+}
+
+struct bench_stats {
+	double min, median, p95, max;
+	int n;
+};
+
+static void bench_stats(double *v, int n, struct bench_stats *s)
+{
+	s->n = n;
+	if (n == 0) {
+		s->min = s->median = s->p95 = s->max = 0;
+		return;
+	}
+	qsort(v, n, sizeof(*v), bench_cmp);
+	s->min = v[0];
+	s->median = (n % 2) ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+	s->p95 = v[(95 * n + 99) / 100 - 1];   /* nearest rank */
+	s->max = v[n-1];
+}
+
+/* Print a string as a double-quoted CSV field or JSON string */
+static void bench_quote(const char *s, int json)
+{
+	putchar('"');
+	for (; *s; s++) {
+		if (*s == '"') {
+			fputs(json ? "\\\"" : "\"\"", stdout);
+		} else if (json && *s == '\\') {
+			fputs("\\\\", stdout);
+		} else if ((unsigned char)*s >= ' ') {
+			putchar(*s);
+		}
+	}
+	putchar('"');
+}
+
+static void bench_print_stats(const char *key, const struct bench_stats *s,
+			      int json)
+{
+	if (json) {
+		if (s->n == 0) {
+			printf(", \"%s\": null", key);
+		} else {
+			printf(", \"%s\": {\"min\": %.3f, \"median\": %.3f, "
+			       "\"p95\": %.3f, \"max\": %.3f}",
+			       key, s->min, s->median, s->p95, s->max);
+		}
+	} else if (s->n == 0) {
+		fputs(",,,,", stdout);
+	} else {
+		printf(",%.3f,%.3f,%.3f,%.3f", s->min, s->median, s->p95, s->max);
+	}
+}
+
+/*
+ * The heap figures: overall peak, then for generation and solving the
+ * peak while each was running and the allocations per run.
+ */
+static void bench_print_heap(const struct bench_heap *h, int runs, int json)
+{
+	if (json) {
+		if (!h) {
+			fputs(", \"heap\": null", stdout);
+		} else {
+			printf(", \"heap\": {\"peak_kb\": %lld, "
+			       "\"gen_peak_kb\": %lld, \"gen_allocs\": %lu, "
+			       "\"solve_peak_kb\": %lld, \"solve_allocs\": %lu}",
+			       h->total.peak / 1024, h->gen.peak / 1024,
+			       h->gen.allocs / runs, h->solve.peak / 1024,
+			       h->solve.allocs / runs);
+		}
+	} else if (!h) {
+		fputs(",,,,,", stdout);
+	} else {
+		printf(",%lld,%lld,%lu,%lld,%lu", h->total.peak / 1024,
+		       h->gen.peak / 1024, h->gen.allocs / runs,
+		       h->solve.peak / 1024, h->solve.allocs / runs);
+	}
+}
+
+static void bench_report(const game *g, const char *name,
+			 const game_params *params,
+			 const struct bench_opts *opts, long baseline_kb,
+			 int *first)
+{
+	struct bench_run *runs = snewn(opts->runs, struct bench_run);
+	double *gen = snewn(opts->runs, double);
+	double *solve = snewn(opts->runs, double);
+	struct bench_stats gs, ss;
+	struct bench_heap heap;
+	const char *failure;
+	char *encoded;
+	long peak_rss_kb;
+	int i, nsolved = 0, have_heap;
+
+	failure = bench_preset(g, params, opts, runs, &peak_rss_kb, &heap);
+	have_heap = opts->heap && !failure && heap.ok;
+	if (!failure) {
+		for (i = 0; i < opts->runs; i++) {
+			gen[i] = runs[i].gen;
+			if (runs[i].solve >= 0)
+				solve[nsolved++] = runs[i].solve;
+		}
+		bench_stats(gen, opts->runs, &gs);
+	} else {
+		bench_stats(gen, 0, &gs);
+	}
+	bench_stats(solve, nsolved, &ss);
+	peak_rss_kb = (peak_rss_kb > baseline_kb) ? peak_rss_kb - baseline_kb : 0;
+
+	encoded = g->encode_params(params, TRUE);
+	if (opts->json) {
+		printf("%s\n  {\"game\": ", *first ? "" : ",");
+		bench_quote(g->name, TRUE);
+		fputs(", \"preset\": ", stdout);
+		bench_quote(name, TRUE);
+		fputs(", \"params\": ", stdout);
+		bench_quote(encoded, TRUE);
+		printf(", \"runs\": %d, \"status\": ", opts->runs);
+		bench_quote(failure ? failure : "ok", TRUE);
+		bench_print_stats("gen_ms", &gs, TRUE);
+		bench_print_stats("solve_ms", &ss, TRUE);
+		printf(", \"solved\": %d, \"peak_rss_kb\": %ld", nsolved, peak_rss_kb);
+		bench_print_heap(have_heap ? &heap : NULL, opts->runs, TRUE);
+		putchar('}');
+	} else {
+		bench_quote(g->name, FALSE);
+		putchar(',');
+		bench_quote(name, FALSE);
+		putchar(',');
+		bench_quote(encoded, FALSE);
+		printf(",%d,%s", opts->runs, failure ? failure : "ok");
+		bench_print_stats("gen_ms", &gs, FALSE);
+		bench_print_stats("solve_ms", &ss, FALSE);
+		printf(",%d,%ld", nsolved, peak_rss_kb);
+		bench_print_heap(have_heap ? &heap : NULL, opts->runs, FALSE);
+		putchar('\n');
+	}
+	fflush(stdout);
+	*first = FALSE;
+
+	sfree(encoded);
+	sfree(solve);
+	sfree(gen);
+	sfree(runs);
+}
+
+#define GRIDNAME(upper,lower) #lower,
+static const char *const bench_grid_names[] = { GRIDGEN_LIST(GRIDNAME) };
+#undef GRIDNAME
+static const int bench_grid_sizes[] = { 10, 20, 40, 60 };
+
+/* Time grid_new_desc and grid_new for one grid type and size, uncached */
+static void bench_grid(grid_type type, int size,
+		       const struct bench_opts *opts, int *first)
+{
+	double *times = snewn(opts->runs, double);
+	struct bench_stats gs;
+	int i, faces = 0, edges = 0, dots = 0;
+
+	for (i = 0; i < opts->runs; i++) {
+		char seed[80], *desc;
+		random_state *rs;
+		grid *g;
+		double t0;
+
+		sprintf(seed, "%.60s%d", opts->seed, i);
+		rs = random_new_seed(seed);
+		grid_cache_flush();
+		t0 = bench_now();
+		desc = grid_new_desc(type, size, size, rs);
+		g = grid_new(type, size, size, desc);
+		times[i] = bench_now() - t0;
+		faces = g->num_faces;
+		edges = g->num_edges;
+		dots = g->num_dots;
+		grid_free(g);
+		sfree(desc);
+		random_free(rs);
+	}
+	bench_stats(times, opts->runs, &gs);
+
+	if (opts->json) {
+		printf("%s\n  {\"grid\": ", *first ? "" : ",");
+		bench_quote(bench_grid_names[type], TRUE);
+		printf(", \"size\": %d, \"runs\": %d", size, opts->runs);
+		bench_print_stats("build_ms", &gs, TRUE);
+		printf(", \"faces\": %d, \"edges\": %d, \"dots\": %d}",
+		       faces, edges, dots);
+	} else {
+		bench_quote(bench_grid_names[type], FALSE);
+		printf(",%d,%d", size, opts->runs);
+		bench_print_stats("build_ms", &gs, FALSE);
+		printf(",%d,%d,%d\n", faces, edges, dots);
+	}
+	fflush(stdout);
+	*first = FALSE;
+	sfree(times);
+}
+
+static void bench_grids(const struct bench_opts *opts)
+{
+	int t, i, first = TRUE;
+
+	if (opts->json)
+		fputs("[", stdout);
+	else
+		puts("grid,size,runs,build_min_ms,build_median_ms,"
+		     "build_p95_ms,build_max_ms,faces,edges,dots");
+	for (t = 0; t < GRID_TYPE_MAX; t++)
+		for (i = 0; i < lenof(bench_grid_sizes); i++)
+			bench_grid(t, bench_grid_sizes[i], opts, &first);
+	if (opts->json)
+		puts("\n]");
+}
+
+/* 64-bit FNV-1a, for fingerprinting a solver's output */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static unsigned long long bench_fnv(unsigned long long h, const char *buf,
+				    size_t len)
+{
+	while (len-- > 0) {
+		h ^= (unsigned char)*buf++;
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+
+/*
+ * Run a solver once, argv[0] being its path. Returns NULL on success
+ * or a short description of how it failed; *hash is set to the hash
+ * of everything it wrote to stdout, and *ms to how long it took from
+ * fork to exit (so including exec and dynamic linking, which is why
+ * corpus entries should take a good few milliseconds each).
+ */
+static const char *bench_solver_once(const struct bench_opts *opts,
+				     char **argv, unsigned long long *hash,
+				     double *ms)
+{
+	int fds[2], status;
+	char buf[4096];
+	double t0;
+	ssize_t n;
+	pid_t pid;
+
+	if (pipe(fds) < 0)
+		fatal("pipe: %s", strerror(errno));
+	fflush(stdout);
+	t0 = bench_now();
+	pid = fork();
+	if (pid < 0)
+		fatal("fork: %s", strerror(errno));
+	if (pid == 0) {
+		close(fds[0]);
+		if (dup2(fds[1], 1) < 0)
+			_exit(127);
+		close(fds[1]);
+		if (opts->timeout > 0) alarm(opts->timeout);  /* survives exec */
+		execv(argv[0], argv);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	*hash = FNV_OFFSET;
+	while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		*hash = bench_fnv(*hash, buf, n);
+	}
+	close(fds[0]);
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			fatal("waitpid: %s", strerror(errno));
+	}
+	*ms = bench_now() - t0;
+	if (WIFSIGNALED(status))
+		return WTERMSIG(status) == SIGALRM ? "timeout" : "crashed";
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+		return "not found";
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return "failed";
+	return NULL;
+}
+
+/*
+ * One corpus line: "solver difficulty hash args...", where hash is
+ * what the solver printed when it was recorded ("-" if never). Blank
+ * lines and #comments are skipped, or with --record copied. Returns
+ * FALSE if the solver failed or its output changed.
+ */
+static int bench_solver_entry(const struct bench_opts *opts, char *line,
+			      const char *where, int *first)
+{
+	char *fields[SOLVER_MAX_ARGS + 3], *argv[SOLVER_MAX_ARGS + 2];
+	char *path, *p, *joined, got[17];
+	double *times;
+	struct bench_stats ss;
+	unsigned long long hash, h;
+	double ms;
+	const char *failure = NULL, *status;
+	int i, nf = 0, changed = FALSE;
+
+	p = line + strspn(line, " \t");
+	if (!*p || *p == '#') {
+		if (opts->record) puts(line);
+		return TRUE;
+	}
+	while (*p && nf < lenof(fields)) {
+		fields[nf++] = p;
+		p += strcspn(p, " \t");
+		if (*p) *p++ = '\0';
+		p += strspn(p, " \t");
+	}
+	if (nf < 4 || *p)
+		fatal("%s: expected \"solver difficulty hash args...\" with at most %d args",
+		      where, SOLVER_MAX_ARGS);
+
+	path = snewn(strlen(opts->solver_dir) + strlen(fields[0]) + 2, char);
+	sprintf(path, "%s/%s", opts->solver_dir, fields[0]);
+	argv[0] = path;
+	for (i = 3; i < nf; i++)
+		argv[i-2] = fields[i];
+	argv[nf-2] = NULL;
+	joined = snewn(p - fields[3] + 1, char);
+	for (p = joined, i = 3; i < nf; i++)
+		p += sprintf(p, "%s%s", i > 3 ? " " : "", fields[i]);
+
+	if (opts->record) {
+		failure = bench_solver_once(opts, argv, &hash, &ms);
+		if (failure) {
+			fprintf(stderr, "puzzles-bench: %s: %s %s: %s\n", where,
+				fields[0], joined, failure);
+			printf("%s %s %s %s\n", fields[0], fields[1], fields[2], joined);
+		} else {
+			printf("%s %s %016llx %s\n", fields[0], fields[1], hash, joined);
+		}
+		sfree(joined);
+		sfree(path);
+		return !failure;
+	}
+
+	times = snewn(opts->runs, double);
+	hash = 0;
+	for (i = 0; i < opts->runs && !failure; i++) {
+		failure = bench_solver_once(opts, argv, &h, &times[i]);
+		if (i > 0 && h != hash)
+			changed = TRUE;    /* not even consistent with itself */
+		hash = h;
+	}
+	sprintf(got, "%016llx", hash);
+	if (!failure && strcmp(got, fields[2]))
+		changed = TRUE;
+	bench_stats(times, failure ? 0 : opts->runs, &ss);
+	status = failure ? failure : changed ? "changed" : "ok";
+
+	if (opts->json) {
+		printf("%s\n  {\"solver\": ", *first ? "" : ",");
+		bench_quote(fields[0], TRUE);
+		fputs(", \"difficulty\": ", stdout);
+		bench_quote(fields[1], TRUE);
+		fputs(", \"args\": ", stdout);
+		bench_quote(joined, TRUE);
+		printf(", \"runs\": %d, \"status\": ", opts->runs);
+		bench_quote(status, TRUE);
+		bench_print_stats("solve_ms", &ss, TRUE);
+		printf(", \"hash\": \"%s\"}", failure ? "" : got);
+	} else {
+		bench_quote(fields[0], FALSE);
+		putchar(',');
+		bench_quote(fields[1], FALSE);
+		putchar(',');
+		bench_quote(joined, FALSE);
+		printf(",%d,%s", opts->runs, status);
+		bench_print_stats("solve_ms", &ss, FALSE);
+		printf(",%s\n", failure ? "" : got);
+	}
+	fflush(stdout);
+	*first = FALSE;
+
+	sfree(times);
+	sfree(joined);
+	sfree(path);
+	return !failure && !changed;
+}
+
+/* Returns TRUE if every entry of every corpus file passed */
+static int bench_solvers(const struct bench_opts *opts, int nfiles,
+			 const char *const *files)
+{
+	int f, lineno, first = TRUE, ok = TRUE;
+
+	if (!opts->record) {
+		if (opts->json)
+			fputs("[", stdout);
+		else
+			puts("solver,difficulty,args,runs,status,solve_min_ms,"
+			     "solve_median_ms,solve_p95_ms,solve_max_ms,hash");
+	}
+
+	for (f = 0; f < nfiles; f++) {
+		FILE *fp = fopen(files[f], "r");
+		char *line = NULL, where[256];
+		int size = 0, len;
+
+		if (!fp)
+			fatal("%s: %s", files[f], strerror(errno));
+		for (lineno = 1; ; lineno++) {
+			/* Game IDs can be long, so lines have no fixed limit */
+			len = 0;
+			do {
+				if (size - len < 2) {
+					size = size * 3 / 2 + 1024;
+					line = sresize(line, size, char);
+				}
+				if (!fgets(line + len, size - len, fp))
+					break;
+				len += strlen(line + len);
+			} while (line[len-1] != '\n');
+			if (len == 0)
+				break;
+			if (line[len-1] == '\n')
+				line[--len] = '\0';
+			sprintf(where, "%.200s:%d", files[f], lineno);
+			if (!bench_solver_entry(opts, line, where, &first))
+				ok = FALSE;
+		}
+		sfree(line);
+		fclose(fp);
+	}
+
+	if (opts->json && !opts->record)
+		puts("\n]");
+	return ok;
+}
+
+/*
+ * One cold launch: returns the milliseconds GamePlay logged from
+ * process start to its first game frame, or -1 if it didn't log one
+ * in time (for instance because there was no saved game to resume).
+ */
+static double bench_cold_start_once(int timeout)
+{
+	char line[256];
+	double ms = -1, deadline;
+
+	fflush(stdout);
+	if (system("am force-stop " APP_PACKAGE) != 0 || system("logcat -c") != 0)
+		fatal("can't stop the app or clear the log; is this running on the device?");
+	if (system("am start -W -n " APP_PACKAGE "/.SGTPuzzles >/dev/null") != 0)
+		fatal("can't start the app");
+	deadline = bench_now() + timeout * 1000.0;
+	while (ms < 0 && bench_now() < deadline) {
+		FILE *fp = popen("logcat -d -s GamePlay:I", "r");
+		if (!fp)
+			fatal("can't read the log: %s", strerror(errno));
+		while (fgets(line, sizeof(line), fp)) {
+			const char *p = strstr(line, "cold start: ");
+			if (p && sscanf(p, "cold start: %lf ms", &ms) == 1)
+				break;
+		}
+		pclose(fp);
+		if (ms < 0)
+			usleep(100000);
+	}
+	return ms;
+}
+
+/* Returns TRUE if the median launch was within budget */
+static int bench_cold_start(const struct bench_opts *opts)
+{
+	double *times = snewn(opts->runs, double);
+	struct bench_stats cs;
+	int i, n = 0, within;
+	const char *status;
+
+	for (i = 0; i < opts->runs; i++) {
+		double ms = bench_cold_start_once(opts->timeout > 0 ?
+						  opts->timeout : DEFAULT_COLD_START_TIMEOUT);
+		if (ms >= 0)
+			times[n++] = ms;
+	}
+	bench_stats(times, n, &cs);
+	within = n > 0 && cs.median <= opts->budget;
+	status = n == 0 ? "no frame logged" : within ? "ok" : "over budget";
+
+	if (opts->json) {
+		printf("{\"runs\": %d, \"timeouts\": %d", opts->runs, opts->runs - n);
+		bench_print_stats("cold_start_ms", &cs, TRUE);
+		printf(", \"budget_ms\": %d, \"status\": ", opts->budget);
+		bench_quote(status, TRUE);
+		puts("}");
+	} else {
+		puts("runs,timeouts,cold_start_min_ms,cold_start_median_ms,"
+		     "cold_start_p95_ms,cold_start_max_ms,budget_ms,status");
+		printf("%d,%d", opts->runs, opts->runs - n);
+		bench_print_stats("cold_start_ms", &cs, FALSE);
+		printf(",%d,%s\n", opts->budget, status);
+	}
+	sfree(times);
+	return within;
+}
+
+/* Every preset of the game, or just the default if it has none */
+static void bench_game(const game *g, const struct bench_opts *opts,
+		       long baseline_kb, int *first)
+{
+	game_params *params;
+	char *name;
+	int i;
+
+	for (i = 0; g->fetch_preset(i, &name, &params); i++) {
+		bench_report(g, name, params, opts, baseline_kb, first);
+		sfree(name);
+		g->free_params(params);
+	}
+	if (i == 0) {
+		params = g->default_params();
+		bench_report(g, "Default", params, opts, baseline_kb, first);
+		g->free_params(params);
+	}
+}
+
+int main(int argc, const char *argv[])
+{
+	struct bench_opts opts;
+	long baseline_kb;
+	int i, first = TRUE, ngames = 0;
+
+	opts.runs = DEFAULT_RUNS;
+	opts.timeout = 0;
+	opts.json = FALSE;
+	opts.grids = FALSE;
+	opts.cold_start = FALSE;
+	opts.budget = DEFAULT_COLD_START_BUDGET;
+	opts.heap = FALSE;
+	opts.seed = "@bench";
+	opts.solvers = FALSE;
+	opts.record = FALSE;
+	opts.solver_dir = NULL;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "--json")) {
+			opts.json = TRUE;
+		} else if (!strcmp(argv[i], "--heap")) {
+			opts.heap = TRUE;
+		} else if (!strcmp(argv[i], "--grids")) {
+			opts.grids = TRUE;
+		} else if (!strcmp(argv[i], "--cold-start")) {
+			opts.cold_start = TRUE;
+		} else if (!strcmp(argv[i], "--solvers")) {
+			opts.solvers = TRUE;
+		} else if (!strcmp(argv[i], "--record")) {
+			opts.record = TRUE;
+		} else if (!strcmp(argv[i], "-d") && i+1 < argc) {
+			opts.solver_dir = argv[++i];
+		} else if (!strcmp(argv[i], "-b") && i+1 < argc) {
+			opts.budget = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+			opts.runs = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-s") && i+1 < argc) {
+			opts.seed = argv[++i];
+		} else if (!strcmp(argv[i], "-t") && i+1 < argc) {
+			opts.timeout = atoi(argv[++i]);
+		} else {
+			fputs(USAGE, stderr);
+			return 1;
+		}
+	}
+	if (opts.runs < 1 || ((opts.grids || opts.cold_start) && i < argc)
+	    || opts.grids + opts.cold_start + opts.solvers > 1
+	    || (opts.solvers && i == argc) || (opts.record && !opts.solvers)) {
+		fputs(USAGE, stderr);
+		return 1;
+	}
+	if (opts.solvers) {
+		/* By default the solvers are wherever we are */
+		if (!opts.solver_dir) {
+			const char *slash = strrchr(argv[0], '/');
+			char *dir = dupstr(slash ? argv[0] : ".");
+			if (slash) dir[slash - argv[0]] = '\0';
+			opts.solver_dir = dir;
+		}
+		return bench_solvers(&opts, argc - i, argv + i) ? 0 : 2;
+	}
+	if (opts.cold_start)
+		return bench_cold_start(&opts) ? 0 : 2;
+	if (opts.grids) {
+		bench_grids(&opts);
+		return 0;
+	}
+
+	baseline_kb = bench_baseline_kb();
+	if (opts.json)
+		fputs("[", stdout);
+	else
+		puts("game,preset,params,runs,status,"
+		     "gen_min_ms,gen_median_ms,gen_p95_ms,gen_max_ms,"
+		     "solve_min_ms,solve_median_ms,solve_p95_ms,solve_max_ms,"
+		     "solved,peak_rss_kb,heap_peak_kb,gen_heap_peak_kb,"
+		     "gen_allocs,solve_heap_peak_kb,solve_allocs");
+
+	for (; i < argc; i++) {
+		char *name = dupstr(argv[i]), *colon = strchr(name, ':'), *err;
+		const game *g;
+		game_params *params;
+
+		ngames++;
+		if (colon) *colon++ = '\0';
+		g = game_by_name(name);
+		if (!g) {
+			fprintf(stderr, "puzzles-bench: no game called \"%s\"\n", name);
+			return 1;
+		}
+		if (!colon) {
+			bench_game(g, &opts, baseline_kb, &first);
+		} else {
+			params = oriented_params_from_str(g, colon, &err);
+			if (!params) {
+				fprintf(stderr, "puzzles-bench: %s\n", err);
+				return 1;
+			}
+			bench_report(g, colon, params, &opts, baseline_kb, &first);
+			g->free_params(params);
+		}
+		sfree(name);
+	}
+	if (ngames == 0) {
+		for (i = 0; i < gamecount; i++)
+			bench_game(gamelist[i], &opts, baseline_kb, &first);
+	}
+
+	if (opts.json)
+		puts("\n]");
+	return 0;
+}
+
+#endif /* EXECUTABLE */
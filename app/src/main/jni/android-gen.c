@@ -1,69 +1,1043 @@
-#ifdef EXECUTABLE
+/*
+ * android-gen.c: game generation for the Android front end.
+ *
+ * Games are generated in-process on a small pool of worker threads
+ * (so that the UI never has to wait for, or kill, a child process),
+ * and the same code also backs the stand-alone puzzlesgen executable
+ * when built with -DEXECUTABLE.
+ */
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
 #include "puzzles.h"
 
-#define USAGE "Usage: puzzles-gen gamename [params | --seed seed | --desc desc]\n"
+#define USAGE "Usage: puzzles-gen gamename [params [--within ms] | --seed seed | --desc desc | --solve id]\n"
+#define BATCH_USAGE "       puzzles-gen gamename [params] --count n [--jobs j] [--seed seed]\n" \
+                    "                   [--print WxH [--with-solutions] [--scale n] [--colour]]\n" \
+                    "       puzzles-gen --pack out.pack [savefile...]\n"
 
-struct frontend {
-	midend *me;
+struct gen_buf {
+	char *data;
+	int len, size;
 };
 
-void serialise_write(void *ctx, void *buf, int len) {
-	write(1, buf, len);
+static void gen_buf_write(void *ctx, void *buf, int len)
+{
+	struct gen_buf *b = (struct gen_buf *)ctx;
+	if (b->len + len + 1 > b->size) {
+		b->size = (b->len + len + 1) * 5 / 4 + 256;
+		b->data = sresize(b->data, b->size, char);
+	}
+	memcpy(b->data + b->len, buf, len);
+	b->len += len;
+	b->data[b->len] = '\0';
 }
 
-
-const struct drawing_api null_drawing = {
+static const struct drawing_api null_drawing = {
 	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
 	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
 	NULL,
 };
 
-int main(int argc, const char *argv[]) {
-	if (argc < 2 || argc > 4) {
-		fprintf(stderr, USAGE);
-		exit(1);
+/* Generators recurse fairly deeply on big grids; match a main thread */
+#define GEN_STACK_SIZE (8 * 1024 * 1024)
+
+static char *gen_serialise(midend *me)
+{
+	struct gen_buf buf;
+	buf.data = NULL;
+	buf.len = buf.size = 0;
+	midend_serialise(me, gen_buf_write, &buf);
+	return buf.data;
+}
+
+#ifndef EXECUTABLE
+
+#define GEN_MAX_THREADS 4
+
+/*
+ * Racing generation: for games flagged GEN_RACES, several streams each
+ * run an ordinary midend_new_game on their own seed, on their own
+ * thread. Number each stream's attempts a = 0, 1, 2... and give
+ * attempt a of stream k the index a*nstreams + k; the winner is the
+ * success with the lowest index, just as if one thread had tried the
+ * streams' attempts in turn. A stream stops as soon as its next
+ * attempt's index is past the best success so far, so the result
+ * depends only on the base seed and nstreams, never on timing. The
+ * winning stream's seed becomes the game's seed, so that entering it
+ * later reproduces the same puzzle without any racing.
+ */
+struct gen_race;
+
+struct gen_stream {
+	struct gen_race *race;
+	int index, succeeded;
+	gen_ctx ctx;
+	midend *me;
+};
+
+struct gen_race {
+	pthread_mutex_t lock;
+	int nstreams;
+	long winning;	       /* lowest index of any success so far */
+	struct gen_stream *streams;
+	gen_ctx *parent;       /* the caller's, for cancellation and progress */
+};
+
+/* Called by random_gen_attempt() on a stream's thread */
+static void gen_stream_progress(void *arg, int attempts, int best)
+{
+	struct gen_stream *s = (struct gen_stream *)arg;
+	struct gen_race *r = s->race;
+
+	pthread_mutex_lock(&r->lock);
+	if ((long)attempts * r->nstreams + s->index > r->winning)
+		s->ctx.cancelled = TRUE;
+	if (r->parent) {
+		r->parent->attempts++;
+		if (best > r->parent->best)
+			r->parent->best = best;
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void *gen_stream_run(void *arg)
+{
+	struct gen_stream *s = (struct gen_stream *)arg;
+	struct gen_race *r = s->race;
+	int i;
+
+	midend_new_game(s->me);
+
+	pthread_mutex_lock(&r->lock);
+	if (!s->ctx.cancelled) {
+		long index = (long)s->ctx.attempts * r->nstreams + s->index;
+		s->succeeded = TRUE;
+		if (index < r->winning) {
+			r->winning = index;
+			/*
+			 * Stop streams already past us in mid-attempt. A stale
+			 * count is only ever too low, so we never stop one that
+			 * could still beat us; it finds out at its next poll.
+			 */
+			for (i = 0; i < r->nstreams; i++) {
+				struct gen_stream *t = &r->streams[i];
+				if ((long)t->ctx.attempts * r->nstreams + i > index)
+					t->ctx.cancelled = TRUE;
+			}
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+static char *gen_race(const game *g, game_params *params, gen_ctx *parent,
+		      int nstreams)
+{
+	struct gen_race r;
+	struct gen_stream *streams = snewn(nstreams, struct gen_stream);
+	pthread_t *threads = snewn(nstreams, pthread_t);
+	int *started = snewn(nstreams, int);
+	pthread_attr_t attr;
+	random_state *rs;
+	void *randseed;
+	int randseedsize, i;
+	char *ret = NULL;
+
+	get_random_seed(&randseed, &randseedsize);
+	rs = random_new(randseed, randseedsize);
+	sfree(randseed);
+
+	pthread_mutex_init(&r.lock, NULL);
+	r.nstreams = nstreams;
+	r.winning = LONG_MAX;
+	r.streams = streams;
+	r.parent = parent;
+
+	for (i = 0; i < nstreams; i++) {
+		struct gen_stream *s = &streams[i];
+		char *seed = random_new_seed_string(rs);
+
+		s->race = &r;
+		s->index = i;
+		s->succeeded = FALSE;
+		gen_ctx_init(&s->ctx);
+		s->ctx.progress = gen_stream_progress;
+		s->ctx.progress_ctx = s;
+		s->ctx.parent = parent;
+		s->me = midend_new(NULL, g, &null_drawing, NULL);
+		midend_set_params(s->me, params);
+		midend_set_seed(s->me, seed);
+		sfree(seed);
+		midend_set_gen_ctx(s->me, &s->ctx);
+	}
+	random_free(rs);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, GEN_STACK_SIZE);
+	started[0] = FALSE;
+	for (i = 1; i < nstreams; i++)
+		started[i] = !pthread_create(&threads[i], &attr, gen_stream_run, &streams[i]);
+	pthread_attr_destroy(&attr);
+
+	/* Stream 0 runs here, and so does any we couldn't start a thread for */
+	for (i = 0; i < nstreams; i++)
+		if (!started[i]) gen_stream_run(&streams[i]);
+	for (i = 1; i < nstreams; i++)
+		if (started[i]) pthread_join(threads[i], NULL);
+
+	if (!parent || !parent->cancelled) {
+		for (i = 0; i < nstreams; i++) {
+			struct gen_stream *s = &streams[i];
+			if (s->succeeded &&
+			    (long)s->ctx.attempts * nstreams + i == r.winning) {
+				ret = gen_serialise(s->me);
+				if (parent) parent->relaxed = s->ctx.relaxed;
+				break;
+			}
+		}
+	}
+
+	for (i = 0; i < nstreams; i++)
+		midend_free(streams[i].me);
+	pthread_mutex_destroy(&r.lock);
+	sfree(started);
+	sfree(threads);
+	sfree(streams);
+	return ret;
+}
+
+/*
+ * The bundled pack of pre-generated puzzles, if there is one. Games
+ * for params it covers are just looked up, with no generation at all:
+ * a random one of the pack's puzzles is set up from its desc and given
+ * back its aux info, so that Solve is as quick as for one of ours.
+ */
+static puzzle_pack *gen_pack = NULL;
+static pthread_mutex_t gen_pack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void android_gen_set_pack(puzzle_pack *pack)
+{
+	pthread_mutex_lock(&gen_pack_lock);
+	gen_pack = pack;
+	pthread_mutex_unlock(&gen_pack_lock);
+}
+
+static char *gen_from_pack(const game *g, const char *gamename, game_params *params)
+{
+	puzzle_pack *pack;
+	const char *desc, *aux;
+	char *parstr, *id, *ret = NULL;
+	int first, count;
+
+	pthread_mutex_lock(&gen_pack_lock);
+	pack = gen_pack;
+	pthread_mutex_unlock(&gen_pack_lock);
+	if (!pack) return NULL;
+
+	parstr = g->encode_params(params, TRUE);
+	count = pack_find(pack, gamename, parstr, &first);
+	if (count > 0) {
+		void *seed;
+		int seedsize;
+		random_state *rs;
+		get_random_seed(&seed, &seedsize);
+		rs = random_new(seed, seedsize);
+		sfree(seed);
+		if (pack_record(pack, first + random_upto(rs, count), &desc, &aux)) {
+			midend *me = midend_new(NULL, g, &null_drawing, NULL);
+			id = snewn(strlen(parstr) + strlen(desc) + 2, char);
+			sprintf(id, "%s:%s", parstr, desc);
+			if (!midend_game_id_int(me, id, DEF_DESC, FALSE)) {
+				midend_new_game(me);
+				midend_set_aux_info(me, aux);
+				ret = gen_serialise(me);
+			}
+			sfree(id);
+			midend_free(me);
+		}
+		random_free(rs);
 	}
+	sfree(parstr);
+	return ret;
+}
+
+/*
+ * Generate one game from an argument vector of the same form as the
+ * puzzlesgen command line, i.e. gamename [params | --seed seed |
+ * --desc desc], and return it as a serialised save (we need a save
+ * rather than just a desc, because the aux info contains the
+ * solution). On failure returns NULL and sets *error to a message
+ * which must not be freed. If ctx is non-NULL, generation can be
+ * cancelled through it, in which case we return NULL with *error NULL.
+ * With nstreams > 1, a random game of a GEN_RACES game is raced on
+ * that many threads; a given seed is always generated sequentially.
+ * Params the puzzle pack covers get one of its puzzles instead.
+ *
+ * With --within ms after the params, generation has that long to find
+ * exactly what was asked for, after which generators that can settle
+ * for less do so (see random_gen_settle), and ctx->relaxed says what
+ * was given up. A ctx is needed to find that out, but not to use it.
+ *
+ * With --solve, the game ID (params:desc) is solved instead, and the
+ * result is the solution for midend_supply_solution.
+ */
+char *android_generate(int argc, const char *const *argv, gen_ctx *ctx,
+		       int nstreams, char **error)
+{
+	const game *g;
+	game_params *params = NULL;
 	int defmode = DEF_PARAMS;
-	if (argc >= 4) {
-		if (!strcmp(argv[2], "--seed")) {
+	double budget = 0.0;
+	gen_ctx local_ctx;
+	midend *me;
+	char *ret;
+
+	*error = NULL;
+	if (argc >= 3 && !strcmp(argv[argc-2], "--within")) {
+		budget = atof(argv[argc-1]);
+		argc -= 2;
+		if (budget <= 0 || argc > 2) {
+			*error = USAGE;
+			return NULL;
+		}
+	}
+	if (argc < 1 || argc > 3) {
+		*error = USAGE;
+		return NULL;
+	}
+	if (argc >= 3) {
+		if (!strcmp(argv[1], "--seed")) {
 			defmode = DEF_SEED;
-		} else if (!strcmp(argv[2], "--desc")) {
+		} else if (!strcmp(argv[1], "--desc")) {
 			defmode = DEF_DESC;
+		} else if (!strcmp(argv[1], "--solve")) {
+			g = game_by_name(argv[0]);
+			if (!g) {
+				*error = "Game name not recognised";
+				return NULL;
+			}
+			ret = midend_solve_game_id(g, argv[2], error);
+			if (!ret && !*error) *error = "Unable to solve this game";
+			return ret;
 		} else {
-			fprintf(stderr, USAGE);
-			exit(1);
+			*error = USAGE;
+			return NULL;
 		}
 	}
 
-	const game *thegame = game_by_name(argv[1]);
-
-	if (!thegame) {
-		fprintf(stderr, "Game name not recognised\n");
-		exit(1);
+	g = game_by_name(argv[0]);
+	if (!g) {
+		*error = "Game name not recognised";
+		return NULL;
 	}
 
-	frontend *fe = snew(frontend);
-	fe->me = midend_new(fe, thegame, &null_drawing, fe);
+	if (defmode == DEF_PARAMS) {
+		params = oriented_params_from_str(g, (argc >= 2 && strlen(argv[1]) > 0) ? argv[1] : NULL, error);
+		if (!params) return NULL;
+		if (budget > 0) {
+			if (!ctx) {
+				gen_ctx_init(&local_ctx);
+				ctx = &local_ctx;
+			}
+			gen_ctx_set_budget(ctx, budget);
+		}
+		ret = gen_from_pack(g, argv[0], params);
+		if (ret) {
+			g->free_params(params);
+			return ret;
+		}
+		if (nstreams > 1 && (g->flags & GEN_RACES)) {
+			ret = gen_race(g, params, ctx, nstreams);
+			g->free_params(params);
+			return ret;
+		}
+	}
 
-	char* error = NULL;
-	game_params *params = NULL;
+	/* No frontend: the midend only passes it back to us for timers */
+	me = midend_new(NULL, g, &null_drawing, NULL);
+	midend_set_gen_ctx(me, ctx);
 	if (defmode == DEF_PARAMS) {
-		params = oriented_params_from_str(thegame, (argc >= 3 && strlen(argv[2]) > 0) ? argv[2] : NULL, &error);
+		midend_set_params(me, params);
+		g->free_params(params);
 	} else {
-		char *tmp = dupstr(argv[3]);
-		error = midend_game_id_int(fe->me, tmp, defmode, FALSE);
+		char *tmp = dupstr(argv[2]);
+		*error = midend_game_id_int(me, tmp, defmode, FALSE);
 		sfree(tmp);
+		if (*error) {
+			midend_free(me);
+			return NULL;
+		}
+	}
+	midend_new_game(me);
+	ret = (ctx && ctx->cancelled) ? NULL : gen_serialise(me);
+	midend_free(me);
+	return ret;
+}
+
+/*
+ * The worker pool. Jobs are reference-counted: one reference belongs
+ * to whoever submitted the job, and one to the queue (later the
+ * worker running it), so that a job can be abandoned by its submitter
+ * while a worker is still busy with it.
+ */
+struct gen_job {
+	int argc;
+	char **argv;
+	char *result;
+	char *error;
+	int done, cancelled, refcount;
+	int urgent, nstreams;
+	gen_ctx ctx;
+	gen_job *next;
+};
+
+#define GEN_BACKGROUND_NICE 10	/* Android's THREAD_PRIORITY_BACKGROUND */
+
+static pthread_mutex_t gen_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gen_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t gen_finished = PTHREAD_COND_INITIALIZER;
+static gen_job *gen_head = NULL, *gen_tail = NULL;
+static int gen_nthreads = 0, gen_idle = 0;
+static int gen_renice = -1;	/* may workers drop to background priority? */
+
+/* Call with gen_lock held */
+static void gen_unref(gen_job *job)
+{
+	int i;
+	if (--job->refcount > 0) return;
+	for (i = 0; i < job->argc; i++) sfree(job->argv[i]);
+	sfree(job->argv);
+	sfree(job->result);
+	sfree(job);
+}
+
+/*
+ * Once a thread has gone down to background priority, an unprivileged
+ * one needs RLIMIT_NICE to come back up (Android gives apps that), so
+ * without it we leave every worker at normal priority.
+ */
+static int gen_can_renice(void)
+{
+	struct rlimit rl;
+	if (geteuid() == 0) return TRUE;
+	return !getrlimit(RLIMIT_NICE, &rl) &&
+		(rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur >= 20);
+}
+
+static void *gen_worker(void *arg)
+{
+	pid_t tid = syscall(SYS_gettid);
+	int niced = FALSE;
+
+	pthread_mutex_lock(&gen_lock);
+	while (TRUE) {
+		gen_job *job;
+		char *result = NULL, *error = NULL;
+		int stuck = FALSE;
+
+		while (!gen_head) {
+			gen_idle++;
+			pthread_cond_wait(&gen_queued, &gen_lock);
+			gen_idle--;
+		}
+		job = gen_head;
+		gen_head = job->next;
+		if (!gen_head) gen_tail = NULL;
+
+		if (!job->cancelled) {
+			int renice = gen_renice;
+			pthread_mutex_unlock(&gen_lock);
+			/*
+			 * Pre-generation runs at background priority, so that it
+			 * neither slows the game being played nor holds the CPU
+			 * at full clock; an urgent job puts the thread back.
+			 */
+			if (!job->urgent && renice && !niced) {
+				niced = !setpriority(PRIO_PROCESS, tid, GEN_BACKGROUND_NICE);
+			} else if (job->urgent && niced) {
+				niced = stuck = setpriority(PRIO_PROCESS, tid, 0) != 0;
+			}
+			result = android_generate(job->argc, (const char *const *)job->argv, &job->ctx, job->nstreams, &error);
+			pthread_mutex_lock(&gen_lock);
+		}
+		job->result = result;
+		job->error = error;
+		job->done = TRUE;
+		pthread_cond_broadcast(&gen_finished);
+		gen_unref(job);
+		/*
+		 * If we couldn't get back to normal priority after all, stop
+		 * dropping any thread's, and retire this one so that the next
+		 * urgent job gets a fresh thread (unless it's the last one
+		 * left to see to the queue).
+		 */
+		if (stuck) {
+			gen_renice = FALSE;
+			if (gen_nthreads > 1 || !gen_head) break;
+		}
+	}
+	gen_nthreads--;
+	pthread_mutex_unlock(&gen_lock);
+	return NULL;
+}
+
+static int gen_max_streams(void)
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 1) ncpus = 1;
+	return min(ncpus, GEN_MAX_THREADS);
+}
+
+/*
+ * Call with gen_lock held. An urgent job (one the user is waiting for)
+ * may start a thread beyond the CPU count, so that it never has to
+ * wait behind background pre-generation on a single-core device.
+ */
+static void gen_ensure_worker(int urgent)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+
+	if (gen_idle > 0) return;
+	if (gen_nthreads >= (urgent ? GEN_MAX_THREADS : gen_max_streams())) return;
+	if (gen_renice < 0) gen_renice = gen_can_renice();
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, GEN_STACK_SIZE);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (!pthread_create(&thread, &attr, gen_worker, NULL))
+		gen_nthreads++;
+	pthread_attr_destroy(&attr);
+	/* If even the first thread failed, we'd wait forever */
+	if (gen_nthreads == 0) fatal("can't start game generation thread");
+}
+
+/*
+ * Queue a generation job; argv is copied. Urgent jobs go to the front
+ * of the queue, and race on as many threads as there are CPUs (up to
+ * a limit). Pool threads are started lazily and then kept, so later
+ * games don't pay for thread creation.
+ */
+gen_job *android_gen_submit(int argc, const char *const *argv, int urgent)
+{
+	gen_job *job = snew(gen_job);
+	int i;
+
+	job->argc = argc;
+	job->argv = snewn(argc, char *);
+	for (i = 0; i < argc; i++) job->argv[i] = dupstr(argv[i]);
+	job->result = job->error = NULL;
+	job->done = job->cancelled = FALSE;
+	job->urgent = urgent;
+	job->nstreams = urgent ? gen_max_streams() : 1;
+	gen_ctx_init(&job->ctx);
+	job->refcount = 2;
+	job->next = NULL;
+
+	pthread_mutex_lock(&gen_lock);
+	if (urgent) {
+		job->next = gen_head;
+		gen_head = job;
+		if (!gen_tail) gen_tail = job;
+	} else {
+		if (gen_tail) gen_tail->next = job;
+		else gen_head = job;
+		gen_tail = job;
+	}
+	gen_ensure_worker(urgent);
+	pthread_cond_signal(&gen_queued);
+	pthread_mutex_unlock(&gen_lock);
+	return job;
+}
+
+/*
+ * Block until the job has finished or been cancelled. Returns the
+ * serialised game, which the caller must free, or NULL with *error
+ * set on failure, or NULL with *error NULL if cancelled.
+ */
+char *android_gen_wait(gen_job *job, char **error)
+{
+	char *ret;
+
+	pthread_mutex_lock(&gen_lock);
+	while (!job->done && !job->cancelled)
+		pthread_cond_wait(&gen_finished, &gen_lock);
+	if (job->cancelled) {
+		ret = NULL;
+		*error = NULL;
+	} else {
+		ret = job->result;
+		job->result = NULL;
+		*error = job->error;
+	}
+	pthread_mutex_unlock(&gen_lock);
+	return ret;
+}
+
+/*
+ * Cancel a job from any thread. Anyone waiting for it returns at
+ * once; a worker that has already started on it notices at the
+ * generator's next retry, and its result is thrown away.
+ */
+void android_gen_cancel(gen_job *job)
+{
+	pthread_mutex_lock(&gen_lock);
+	job->cancelled = TRUE;
+	job->ctx.cancelled = TRUE;
+	pthread_cond_broadcast(&gen_finished);
+	pthread_mutex_unlock(&gen_lock);
+}
+
+/*
+ * How far a running job has got: the number of rejected attempts, and
+ * the highest difficulty any of them reached (-1 if none yet).
+ */
+void android_gen_progress(gen_job *job, int *attempts, int *best)
+{
+	/* Written only by the worker; a slightly stale reading is fine */
+	*attempts = job->ctx.attempts;
+	*best = job->ctx.best;
+}
+
+/* Whether android_gen_wait would return at once */
+int android_gen_done(gen_job *job)
+{
+	int done;
+	pthread_mutex_lock(&gen_lock);
+	done = job->done || job->cancelled;
+	pthread_mutex_unlock(&gen_lock);
+	return done;
+}
+
+/* What a finished job's generator settled for (GEN_RELAXED_*), if anything */
+int android_gen_relaxed(gen_job *job)
+{
+	int relaxed;
+	pthread_mutex_lock(&gen_lock);
+	relaxed = job->done ? job->ctx.relaxed : 0;
+	pthread_mutex_unlock(&gen_lock);
+	return relaxed;
+}
+
+/* Drop the submitter's reference; the job must not be used again. */
+void android_gen_release(gen_job *job)
+{
+	pthread_mutex_lock(&gen_lock);
+	job->cancelled = TRUE;
+	job->ctx.cancelled = TRUE;
+	gen_unref(job);
+	pthread_mutex_unlock(&gen_lock);
+}
+
+#else /* EXECUTABLE */
+
+/*
+ * Batch mode: --count games from one set of params, spread over --jobs
+ * threads. Each thread keeps one midend for all its games, so any
+ * per-game caches (Loopy's grids, say) stay warm, and games are written
+ * to stdout in order as they finish. Every save begins with its own
+ * SAVEFILE line, which is what separates one game from the next.
+ *
+ * Game i is generated from seed "seed-i", so a batch can be reproduced
+ * exactly whatever the number of jobs. Without --seed we pick one here:
+ * left to themselves, midends started in the same microsecond on
+ * different threads would seed themselves identically.
+ *
+ * With --print WxH the games are printed instead, W across and H down
+ * each page, as PostScript on stdout. The document streams: each page
+ * (and its solutions page, with --with-solutions) is printed and freed
+ * as soon as it's full, while the workers go on generating the next.
+ * Either way, workers stay no more than a window of games ahead of the
+ * output, so memory doesn't grow with --count.
+ */
+#define BATCH_MAX_JOBS 64
+
+struct batch {
+	const game *g;
+	char *params;	/* encoded, with difficulty */
+	char *seed;
+	int count, next, done, window;
+	char **saves;
+	pthread_mutex_t lock;
+	pthread_cond_t ready, room;
+};
+
+struct batch_print {
+	int pw, ph, with_soln, colour;
+	float scale;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct batch *b = (struct batch *)arg;
+	midend *me = midend_new(NULL, b->g, &null_drawing, NULL);
+	char *id = snewn(strlen(b->params) + strlen(b->seed) + 16, char);
+	int i;
+
+	for (;;) {
+		char *save;
+		pthread_mutex_lock(&b->lock);
+		while (b->next < b->count && b->next >= b->done + b->window)
+			pthread_cond_wait(&b->room, &b->lock);
+		i = b->next++;
+		pthread_mutex_unlock(&b->lock);
+		if (i >= b->count) break;
+		/* The params were validated up front, so this can't fail */
+		sprintf(id, "%s#%s-%d", b->params, b->seed, i);
+		midend_game_id_int(me, id, DEF_SEED, FALSE);
+		midend_new_game(me);
+		save = gen_serialise(me);
+		pthread_mutex_lock(&b->lock);
+		b->saves[i] = save;
+		pthread_cond_broadcast(&b->ready);
+		pthread_mutex_unlock(&b->lock);
 	}
-	if (error) {
+	sfree(id);
+	midend_free(me);
+	return NULL;
+}
+
+/* Read a save back from a string, as written by gen_serialise */
+struct save_input {
+	const char *data;
+	int pos, len;
+};
+
+static int save_input_read(void *ctx, void *buf, int len)
+{
+	struct save_input *in = (struct save_input *)ctx;
+	if (len > in->len - in->pos) return FALSE;
+	memcpy(buf, in->data + in->pos, len);
+	in->pos += len;
+	return TRUE;
+}
+
+static int batch_generate(const char *gamename, const char *parstr,
+			  const char *seed, int count, int jobs,
+			  const struct batch_print *print)
+{
+	struct batch b;
+	pthread_t threads[BATCH_MAX_JOBS];
+	pthread_attr_t attr;
+	game_params *params;
+	char *error = NULL;
+	int i, started = 0;
+	midend *pm = NULL;
+	psdata *ps = NULL;
+	document *doc = NULL;
+
+	b.g = game_by_name(gamename);
+	if (!b.g) {
+		fprintf(stderr, "Game name not recognised\n");
+		return 1;
+	}
+	params = oriented_params_from_str(b.g, parstr, &error);
+	if (!params) {
 		fprintf(stderr, "%s\n", error);
-		exit(1);
+		return 1;
+	}
+	if ((error = b.g->validate_params(params, TRUE)) != NULL) {
+		fprintf(stderr, "%s\n", error);
+		b.g->free_params(params);
+		return 1;
+	}
+	if (print && (!b.g->can_print || (print->colour && !b.g->can_print_in_colour)
+			|| (print->with_soln && !b.g->can_solve))) {
+		fprintf(stderr, "%s can't be printed like that\n", b.g->name);
+		b.g->free_params(params);
+		return 1;
+	}
+	b.params = b.g->encode_params(params, TRUE);
+	b.g->free_params(params);
+	if (seed) {
+		b.seed = dupstr(seed);
+	} else {
+		void *randseed;
+		int randseedsize;
+		random_state *rs;
+		get_random_seed(&randseed, &randseedsize);
+		rs = random_new(randseed, randseedsize);
+		b.seed = random_new_seed_string(rs);
+		random_free(rs);
+		sfree(randseed);
+	}
+	b.count = count;
+	b.next = b.done = 0;
+	/* Enough for the workers to be a page ahead of the printing */
+	b.window = 2 * max(jobs, print ? print->pw * print->ph : 1);
+	b.saves = snewn(count, char *);
+	for (i = 0; i < count; i++) b.saves[i] = NULL;
+	pthread_mutex_init(&b.lock, NULL);
+	pthread_cond_init(&b.ready, NULL);
+	pthread_cond_init(&b.room, NULL);
+
+	if (print) {
+		pm = midend_new(NULL, b.g, &null_drawing, NULL);
+		ps = ps_init(stdout, print->colour);
+		doc = document_new_stream(print->pw, print->ph, print->scale,
+				ps_drawing_api(ps));
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, GEN_STACK_SIZE);
+	if (jobs > count) jobs = count;
+	for (i = 0; i < jobs; i++) {
+		if (pthread_create(&threads[started], &attr, batch_worker, &b)) break;
+		started++;
 	}
-	if (defmode == DEF_PARAMS) midend_set_params(fe->me, params);
-	midend_new_game(fe->me);
+	pthread_attr_destroy(&attr);
+	if (!started) {
+		/*
+		 * No threads to be had: do the lot on this one. Nothing
+		 * drains the output until it's finished, so the window
+		 * has to take all of it.
+		 */
+		b.window = count;
+		batch_worker(&b);
+	}
+
+	for (i = 0; i < count; i++) {
+		char *save;
+		pthread_mutex_lock(&b.lock);
+		while (!b.saves[i]) pthread_cond_wait(&b.ready, &b.lock);
+		save = b.saves[i];
+		b.saves[i] = NULL;
+		b.done = i + 1;
+		pthread_cond_broadcast(&b.room);
+		pthread_mutex_unlock(&b.lock);
+		if (doc) {
+			struct save_input in;
+			in.data = save;
+			in.pos = 0;
+			in.len = strlen(save);
+			error = midend_deserialise(pm, save_input_read, &in);
+			if (!error) error = midend_print_puzzle(pm, doc, print->with_soln);
+			if (error) {
+				/* Our own save, so it can only be the solver giving up */
+				fprintf(stderr, "game %d: %s\n", i + 1, error);
+				error = NULL;
+			}
+		} else {
+			fputs(save, stdout);
+		}
+		sfree(save);
+	}
+	if (doc) {
+		document_print(doc, ps_drawing_api(ps));
+		document_free(doc);
+		ps_free(ps);
+		midend_free(pm);
+	}
+	fflush(stdout);
+
+	for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+	pthread_cond_destroy(&b.room);
+	pthread_cond_destroy(&b.ready);
+	pthread_mutex_destroy(&b.lock);
+	sfree(b.saves);
+	sfree(b.params);
+	sfree(b.seed);
+	return 0;
+}
+
+/*
+ * Pack building: read saves (as from batch mode; several may follow
+ * one another in each file, or on stdin) and write each one's params,
+ * desc and aux info to a puzzle pack, for bundling as an asset. The
+ * key is the params the game was asked for, fully encoded, as that's
+ * what android_generate will look up.
+ */
+static void pack_output_write(void *ctx, void *buf, int len)
+{
+	fwrite(buf, 1, len, (FILE *)ctx);
+}
+
+static char *read_whole_file(FILE *fp, int *len)
+{
+	int size = 65536, n;
+	char *data = snewn(size, char);
+	*len = 0;
+	while ((n = fread(data + *len, 1, size - *len, fp)) > 0) {
+		*len += n;
+		if (*len == size) {
+			size = size * 3 / 2;
+			data = sresize(data, size, char);
+		}
+	}
+	return data;
+}
+
+static int add_saves_to_pack(pack_builder *b, const char *filename, FILE *fp)
+{
+	struct save_input in;
+	char *data, *name, *error, *id, *parstr;
+	const game *g;
+	game_params *params;
+	midend *me;
+	int i, start, n = 0;
+
+	in.data = data = read_whole_file(fp, &in.len);
+	in.pos = 0;
+	for (;;) {
+		while (in.pos < in.len && (data[in.pos] == '\r' || data[in.pos] == '\n'))
+			in.pos++;
+		if (in.pos == in.len) break;
+		start = in.pos;
+		error = identify_game(&name, save_input_read, &in);
+		if (error) goto fail;
+		for (i = 0; i < gamecount && strcmp(gamelist[i]->name, name); i++);
+		sfree(name);
+		if (i == gamecount) {
+			error = "Game name not recognised";
+			goto fail;
+		}
+		g = gamelist[i];
+		me = midend_new(NULL, g, &null_drawing, NULL);
+		in.pos = start;
+		error = midend_deserialise(me, save_input_read, &in);
+		if (error) {
+			midend_free(me);
+			goto fail;
+		}
+		params = midend_get_params(me);
+		parstr = g->encode_params(params, TRUE);
+		g->free_params(params);
+		id = midend_get_game_id(me);
+		pack_builder_add(b, gamenames[i], parstr, strchr(id, ':') + 1,
+				 midend_get_aux_info(me));
+		sfree(id);
+		sfree(parstr);
+		midend_free(me);
+		n++;
+	}
+	sfree(data);
+	return n;
+
+fail:
+	fprintf(stderr, "%s: game %d: %s\n", filename, n + 1, error);
+	sfree(data);
+	return -1;
+}
+
+static int build_pack(const char *outname, int nfiles, const char *const *filenames)
+{
+	pack_builder *b = pack_builder_new();
+	FILE *fp;
+	int i, n, total = 0, nkeys;
 
-	// We need a save not just a desc: aux info contains solution
-	midend_serialise(fe->me, serialise_write, NULL);
+	for (i = 0; i < (nfiles ? nfiles : 1); i++) {
+		if (nfiles && strcmp(filenames[i], "-")) {
+			fp = fopen(filenames[i], "rb");
+			if (!fp) {
+				perror(filenames[i]);
+				pack_builder_free(b);
+				return 1;
+			}
+			n = add_saves_to_pack(b, filenames[i], fp);
+			fclose(fp);
+		} else {
+			n = add_saves_to_pack(b, "stdin", stdin);
+		}
+		if (n < 0) {
+			pack_builder_free(b);
+			return 1;
+		}
+		total += n;
+	}
+
+	fp = fopen(outname, "wb");
+	if (!fp) {
+		perror(outname);
+		pack_builder_free(b);
+		return 1;
+	}
+	nkeys = pack_builder_write(b, pack_output_write, fp);
+	pack_builder_free(b);
+	if (fclose(fp)) {
+		perror(outname);
+		return 1;
+	}
+	fprintf(stderr, "%s: %d puzzles for %d presets\n", outname, total, nkeys);
+	return 0;
+}
+
+int main(int argc, const char *argv[]) {
+	char *error = NULL;
+	char *saved;
+	const char *parstr = NULL, *seed = NULL;
+	gen_ctx ctx;
+	int i, count = 0, jobs = 1;
+	struct batch_print print;
+	int printing = FALSE;
+
+	print.with_soln = print.colour = FALSE;
+	print.scale = 1.0F;
+
+	if (argc >= 3 && !strcmp(argv[1], "--pack"))
+		exit(build_pack(argv[2], argc - 3, argv + 3));
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--count") || !strcmp(argv[i], "--jobs")) {
+			break;
+		}
+	}
+	if (i < argc) {
+		if (argc < 2 || argv[1][0] == '-') goto usage;
+		for (i = 2; i < argc; i++) {
+			if (!strcmp(argv[i], "--count") && i + 1 < argc) {
+				count = atoi(argv[++i]);
+			} else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+				jobs = atoi(argv[++i]);
+			} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+				seed = argv[++i];
+			} else if (!strcmp(argv[i], "--print") && i + 1 < argc) {
+				if (sscanf(argv[++i], "%dx%d", &print.pw, &print.ph) != 2
+						|| print.pw < 1 || print.ph < 1)
+					goto usage;
+				printing = TRUE;
+			} else if (!strcmp(argv[i], "--with-solutions")) {
+				print.with_soln = TRUE;
+			} else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+				print.scale = (float)atof(argv[++i]);
+			} else if (!strcmp(argv[i], "--colour")) {
+				print.colour = TRUE;
+			} else if (i == 2 && argv[i][0] != '-') {
+				parstr = strlen(argv[i]) > 0 ? argv[i] : NULL;
+			} else {
+				goto usage;
+			}
+		}
+		if (count < 1 || jobs < 1 || jobs > BATCH_MAX_JOBS || print.scale <= 0) goto usage;
+		exit(batch_generate(argv[1], parstr, seed, count, jobs, printing ? &print : NULL));
+	}
+
+	gen_ctx_init(&ctx);
+	saved = android_generate(argc - 1, argv + 1, &ctx, 1, &error);
+	if (!saved) {
+		if (!strcmp(error, USAGE)) goto usage;
+		fprintf(stderr, "%s\n", error);
+		exit(1);
+	}
+	if (ctx.relaxed & GEN_RELAXED_DIFFICULTY)
+		fprintf(stderr, "Out of time: settled for an easier puzzle\n");
+	if (ctx.relaxed & GEN_RELAXED_SYMMETRY)
+		fprintf(stderr, "Out of time: settled for an asymmetric puzzle\n");
+	fputs(saved, stdout);
+	sfree(saved);
 	exit(0);
+
+usage:
+	fputs(USAGE BATCH_USAGE, stderr);
+	exit(1);
 }
-#endif
+
+#endif /* EXECUTABLE */
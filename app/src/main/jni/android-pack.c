@@ -0,0 +1,260 @@
+/*
+ * android-pack.c: packs of pre-generated puzzles, bundled as an APK
+ * asset for presets too slow to generate on the device.
+ *
+ * The pack is used in place, straight from the (uncompressed, so
+ * mmapped) asset: opening it checks only the header, and finding a
+ * puzzle is a binary search of the key table and one fixed-size
+ * record, so the cost doesn't grow with the pack. All integers are
+ * 32-bit little-endian, and all offsets are from the start of the file.
+ *
+ *   header   "SGTPACK1", nkeys, nrecords, keys offset, records offset
+ *   keys     nkeys of: game name, params, first record, record count
+ *            sorted by game name (as in gamenames) then params (the
+ *            full encoding), both compared with strcmp
+ *   records  nrecords of: desc, aux info (0 if none)
+ *   strings  NUL-terminated, the last byte of the file being a NUL
+ *
+ * Names, params, descs and aux info are all string offsets. Every
+ * offset is checked as it's used, so a corrupt pack can give wrong
+ * puzzles (which midend_game_id_int will reject) but can't make us
+ * read outside it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "puzzles.h"
+
+#define PACK_MAGIC "SGTPACK1"
+#define PACK_HEADER_SIZE 24
+#define PACK_KEY_SIZE 16
+#define PACK_RECORD_SIZE 8
+
+struct puzzle_pack {
+	const unsigned char *data;
+	unsigned len, nkeys, nrecords, keys, records;
+};
+
+static unsigned pack_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+/* Is a table of n entries of size bytes at off wholly within the pack? */
+static int pack_fits(unsigned len, unsigned off, unsigned n, unsigned size)
+{
+	return off <= len && n <= (len - off) / size;
+}
+
+puzzle_pack *pack_open(const void *data, unsigned len)
+{
+	const unsigned char *d = (const unsigned char *)data;
+	puzzle_pack *pack;
+
+	if (len < PACK_HEADER_SIZE + 1 || memcmp(d, PACK_MAGIC, 8) || d[len - 1])
+		return NULL;
+	pack = snew(puzzle_pack);
+	pack->data = d;
+	pack->len = len;
+	pack->nkeys = pack_u32(d + 8);
+	pack->nrecords = pack_u32(d + 12);
+	pack->keys = pack_u32(d + 16);
+	pack->records = pack_u32(d + 20);
+	if (!pack_fits(len, pack->keys, pack->nkeys, PACK_KEY_SIZE)
+			|| !pack_fits(len, pack->records, pack->nrecords, PACK_RECORD_SIZE)) {
+		sfree(pack);
+		return NULL;
+	}
+	return pack;
+}
+
+void pack_free(puzzle_pack *pack)
+{
+	sfree(pack);
+}
+
+static const char *pack_string(const puzzle_pack *pack, unsigned off)
+{
+	return (off >= PACK_HEADER_SIZE && off < pack->len) ? (const char *)pack->data + off : NULL;
+}
+
+/*
+ * How many puzzles the pack has for this game and (fully encoded)
+ * params; *first is set to the index of the first of them.
+ */
+int pack_find(const puzzle_pack *pack, const char *gamename, const char *params, int *first)
+{
+	int lo = 0, hi = pack->nkeys;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2, c;
+		const unsigned char *key = pack->data + pack->keys + mid * PACK_KEY_SIZE;
+		const char *name = pack_string(pack, pack_u32(key));
+		const char *par = pack_string(pack, pack_u32(key + 4));
+		unsigned start, count;
+		if (!name || !par) return 0;
+		c = strcmp(gamename, name);
+		if (!c) c = strcmp(params, par);
+		if (c < 0) {
+			hi = mid;
+		} else if (c > 0) {
+			lo = mid + 1;
+		} else {
+			start = pack_u32(key + 8);
+			count = pack_u32(key + 12);
+			if (start > pack->nrecords || count > pack->nrecords - start) return 0;
+			*first = start;
+			return count;
+		}
+	}
+	return 0;
+}
+
+/* Puzzle i's desc and aux info (or NULL); FALSE if the record is bad */
+int pack_record(const puzzle_pack *pack, int i, const char **desc, const char **aux)
+{
+	const unsigned char *rec;
+	unsigned auxoff;
+
+	if (i < 0 || (unsigned)i >= pack->nrecords) return FALSE;
+	rec = pack->data + pack->records + i * PACK_RECORD_SIZE;
+	*desc = pack_string(pack, pack_u32(rec));
+	auxoff = pack_u32(rec + 4);
+	*aux = auxoff ? pack_string(pack, auxoff) : NULL;
+	return *desc && (*aux || !auxoff);
+}
+
+/*
+ * Building a pack: add puzzles in any order, then write. Puzzles with
+ * the same game and params keep the order they were added in.
+ */
+struct pack_entry {
+	char *gamename, *params, *desc, *aux;
+	int order;
+};
+
+struct pack_builder {
+	struct pack_entry *entries;
+	int n, size;
+};
+
+pack_builder *pack_builder_new(void)
+{
+	pack_builder *b = snew(pack_builder);
+	b->entries = NULL;
+	b->n = b->size = 0;
+	return b;
+}
+
+void pack_builder_add(pack_builder *b, const char *gamename, const char *params,
+		      const char *desc, const char *aux)
+{
+	struct pack_entry *e;
+	if (b->n >= b->size) {
+		b->size = b->n * 3 / 2 + 64;
+		b->entries = sresize(b->entries, b->size, struct pack_entry);
+	}
+	e = &b->entries[b->n];
+	e->gamename = dupstr(gamename);
+	e->params = dupstr(params);
+	e->desc = dupstr(desc);
+	e->aux = aux ? dupstr(aux) : NULL;
+	e->order = b->n++;
+}
+
+static int pack_entry_cmp(const void *av, const void *bv)
+{
+	const struct pack_entry *a = (const struct pack_entry *)av;
+	const struct pack_entry *b = (const struct pack_entry *)bv;
+	int c = strcmp(a->gamename, b->gamename);
+	if (!c) c = strcmp(a->params, b->params);
+	if (!c) c = a->order - b->order;
+	return c;
+}
+
+static void pack_put_u32(unsigned char *p, unsigned v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+static unsigned pack_add_string(char **strings, unsigned *len, unsigned *size,
+				unsigned base, const char *s)
+{
+	unsigned off = *len, n = strlen(s) + 1;
+	if (*len + n > *size) {
+		*size = (*len + n) * 3 / 2 + 4096;
+		*strings = sresize(*strings, *size, char);
+	}
+	memcpy(*strings + *len, s, n);
+	*len += n;
+	return base + off;
+}
+
+/* Write the pack, in one piece. Returns the number of puzzle types. */
+int pack_builder_write(pack_builder *b, void (*write)(void *ctx, void *buf, int len),
+		       void *wctx)
+{
+	unsigned char *tables, header[PACK_HEADER_SIZE];
+	char *strings = NULL;
+	unsigned slen = 0, ssize = 0, base, keys, records;
+	int i, k, nkeys = 0;
+
+	qsort(b->entries, b->n, sizeof(*b->entries), pack_entry_cmp);
+	for (i = 0; i < b->n; i++) {
+		if (!i || strcmp(b->entries[i].gamename, b->entries[i-1].gamename)
+				|| strcmp(b->entries[i].params, b->entries[i-1].params))
+			nkeys++;
+	}
+
+	keys = PACK_HEADER_SIZE;
+	records = keys + nkeys * PACK_KEY_SIZE;
+	base = records + b->n * PACK_RECORD_SIZE;
+	tables = snewn(base - PACK_HEADER_SIZE + 1, unsigned char);
+
+	for (i = k = 0; i < b->n; i++) {
+		struct pack_entry *e = &b->entries[i];
+		unsigned char *rec = tables + records - PACK_HEADER_SIZE + i * PACK_RECORD_SIZE;
+		if (!i || strcmp(e->gamename, e[-1].gamename) || strcmp(e->params, e[-1].params)) {
+			unsigned char *key = tables + k++ * PACK_KEY_SIZE;
+			pack_put_u32(key, pack_add_string(&strings, &slen, &ssize, base, e->gamename));
+			pack_put_u32(key + 4, pack_add_string(&strings, &slen, &ssize, base, e->params));
+			pack_put_u32(key + 8, i);
+			pack_put_u32(key + 12, 0);
+		}
+		pack_put_u32(tables + (k-1) * PACK_KEY_SIZE + 12,
+			     pack_u32(tables + (k-1) * PACK_KEY_SIZE + 12) + 1);
+		pack_put_u32(rec, pack_add_string(&strings, &slen, &ssize, base, e->desc));
+		pack_put_u32(rec + 4, e->aux ? pack_add_string(&strings, &slen, &ssize, base, e->aux) : 0);
+	}
+	/* So that the file always ends in a NUL, even if it's empty */
+	pack_add_string(&strings, &slen, &ssize, base, "");
+
+	memcpy(header, PACK_MAGIC, 8);
+	pack_put_u32(header + 8, nkeys);
+	pack_put_u32(header + 12, b->n);
+	pack_put_u32(header + 16, keys);
+	pack_put_u32(header + 20, records);
+	write(wctx, header, PACK_HEADER_SIZE);
+	if (base > PACK_HEADER_SIZE) write(wctx, tables, base - PACK_HEADER_SIZE);
+	write(wctx, strings, slen);
+	sfree(tables);
+	sfree(strings);
+	return nkeys;
+}
+
+void pack_builder_free(pack_builder *b)
+{
+	int i;
+	for (i = 0; i < b->n; i++) {
+		sfree(b->entries[i].gamename);
+		sfree(b->entries[i].params);
+		sfree(b->entries[i].desc);
+		sfree(b->entries[i].aux);
+	}
+	sfree(b->entries);
+	sfree(b);
+}
@@ -14,8 +14,13 @@
 #include <ctype.h>
 #include <signal.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <dlfcn.h>
 
 #include <sys/time.h>
+#include <android/bitmap.h>
+#include <android/asset_manager.h>
+#include <android/asset_manager_jni.h>
 
 #include "puzzles.h"
 
@@ -35,10 +40,13 @@ void fatal(char *fmt, ...)
 struct frontend {
 	midend *me;
 	int timer_active;
-	struct timeval last_time;
+	int timer_coarse;  /* Java is waiting for the clock, not the next frame */
+	jlong last_nanos;  /* CLOCK_MONOTONIC, i.e. System.nanoTime() */
 	config_item *cfg;
 	int cfg_which;
 	int ox, oy;
+	gen_job *solve_job;  /* finding the solution of a game from a desc */
+	char *solve_id;      /* ...whose game ID is this */
 };
 
 static frontend *fe = NULL;
@@ -61,26 +69,20 @@ static jobject ARROW_MODE_NONE = NULL,
 	ARROW_MODE_DIAGONALS = NULL;
 
 static jobject gameView = NULL;
+static jclass StringCls = NULL, IllegalArgumentExceptionCls = NULL;
 static jmethodID
 	blitterAlloc,
 	blitterFree,
-	blitterLoad,
-	blitterSave,
 	changedState,
-	clipRect,
 	dialogAdd,
 	dialogInit,
 	dialogShow,
-	drawCircle,
-	drawLine,
-	drawPoly,
-	drawText,
-	fillRect,
+	drawBuffer,
 	getBackgroundColour,
 	getText,
-	postInvalidate,
+	postInvalidateAll,
+	postInvalidateGame,
 	requestTimer,
-	serialiseWrite,
 	setStatus,
 	showToast,
 	unClip,
@@ -88,9 +90,7 @@ static jmethodID
 	setKeys;
 
 void throwIllegalArgumentException(JNIEnv *env, const char* reason) {
-	jclass exCls = (*env)->FindClass(env, "java/lang/IllegalArgumentException");
-	(*env)->ThrowNew(env, exCls, reason);
-	(*env)->DeleteLocalRef(env, exCls);
+	(*env)->ThrowNew(env, IllegalArgumentExceptionCls, reason);
 }
 
 void get_random_seed(void **randseed, int *randseedsize)
@@ -121,72 +121,300 @@ void android_status_bar(void *handle, char *text)
 
 #define CHECK_DR_HANDLE if ((frontend*)handle != fe) return;
 
+/*
+ * Drawing commands are recorded into this buffer and handed to
+ * GameView.drawBuffer() in one go at the end of each redraw, rather
+ * than making a JNI call per primitive. The opcodes must match
+ * GameView; coordinates are already offset by (ox, oy).
+ */
+enum {
+	CMD_CLIP = 1,      /* x, y, w, h */
+	CMD_UNCLIP,        /* ox, oy */
+	CMD_TEXT,          /* x, y, flags, size, colour, nbytes, UTF-8 padded to 4 */
+	CMD_RECT,          /* x, y, w, h, colour */
+	CMD_LINE,          /* x1, y1, x2, y2, colour */
+	CMD_POLY,          /* outline, fill, npoints, x0, y0, x1, y1... */
+	CMD_CIRCLE,        /* x, y, r, outline, fill */
+	CMD_BLITTER_SAVE,  /* handle, x, y */
+	CMD_BLITTER_LOAD,  /* handle, x, y */
+};
+
+static int32_t *cmds = NULL;
+static int ncmds = 0, cmdsize = 0;
+static jobject cmdBuffer = NULL;  /* global ref to a direct ByteBuffer over cmds */
+
+static int32_t *cmd_alloc(int n)
+{
+	int32_t *ret;
+	if (ncmds + n > cmdsize) {
+		cmdsize = (ncmds + n) * 2;
+		if (cmdsize < 4096) cmdsize = 4096;
+		cmds = sresize(cmds, cmdsize, int32_t);
+		if (cmdBuffer) {
+			JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+			(*env)->DeleteGlobalRef(env, cmdBuffer);
+			cmdBuffer = NULL;
+		}
+	}
+	ret = cmds + ncmds;
+	ncmds += n;
+	return ret;
+}
+
+static void cmd_flush(JNIEnv *env)
+{
+	if (!ncmds || !gameView) return;
+	if (!cmdBuffer) {
+		jobject buf = (*env)->NewDirectByteBuffer(env, cmds, cmdsize * sizeof(int32_t));
+		if (!buf) return;
+		cmdBuffer = (*env)->NewGlobalRef(env, buf);
+		(*env)->DeleteLocalRef(env, buf);
+	}
+	(*env)->CallVoidMethod(env, gameView, drawBuffer, cmdBuffer, ncmds);
+	ncmds = 0;
+}
+
+/*
+ * Native rasteriser for the command buffer. Runs of commands that
+ * Canvas would draw without anti-aliasing (rect fills and clips) are
+ * written straight into the RGB_565 bitmap, stopping at the first
+ * command that needs Canvas. Anti-aliased primitives stay with Canvas
+ * so as not to change how anything looks. libjnigraphics only exists
+ * from API 8, so look it up at run time.
+ */
+static int (*bitmap_get_info)(JNIEnv *, jobject, AndroidBitmapInfo *) = NULL;
+static int (*bitmap_lock_pixels)(JNIEnv *, jobject, void **) = NULL;
+static int (*bitmap_unlock_pixels)(JNIEnv *, jobject) = NULL;
+static int raster_state = 0;  /* 1 available, -1 not, 0 not yet known */
+static void raster_fill_choose(void);
+
+static int raster_init(void)
+{
+	if (!raster_state) {
+		void *lib = dlopen("libjnigraphics.so", RTLD_NOW);
+		if (lib) {
+			bitmap_get_info = dlsym(lib, "AndroidBitmap_getInfo");
+			bitmap_lock_pixels = dlsym(lib, "AndroidBitmap_lockPixels");
+			bitmap_unlock_pixels = dlsym(lib, "AndroidBitmap_unlockPixels");
+		}
+		raster_state = (bitmap_get_info && bitmap_lock_pixels && bitmap_unlock_pixels) ? 1 : -1;
+		raster_fill_choose();
+	}
+	return raster_state > 0;
+}
+
+/*
+ * Fill [x1,x2) x [y1,y2) in device pixels, already clipped. The x86
+ * ABIs only promise SSE2 (or less), so there we also build the same
+ * loop for AVX2, which stores 16 pixels at a time, and pick it in
+ * raster_init if the CPU has it.
+ */
+CPU_INLINE void raster_fill_body(uint8_t *pixels, uint32_t stride, int x1, int y1, int x2, int y2, uint16_t pixel)
+{
+	int x, y;
+	for (y = y1; y < y2; y++) {
+		uint16_t *row = (uint16_t *)(pixels + y * stride);
+		for (x = x1; x < x2; x++) row[x] = pixel;
+	}
+}
+
+static void raster_fill_c(uint8_t *pixels, uint32_t stride, int x1, int y1, int x2, int y2, uint16_t pixel)
+{
+	raster_fill_body(pixels, stride, x1, y1, x2, y2, pixel);
+}
+
+#if defined(CPU_DISPATCH) && !defined(__aarch64__)
+__attribute__((target("avx2")))
+static void raster_fill_avx2(uint8_t *pixels, uint32_t stride, int x1, int y1, int x2, int y2, uint16_t pixel)
+{
+	raster_fill_body(pixels, stride, x1, y1, x2, y2, pixel);
+}
+#endif
+
+static void (*raster_fill)(uint8_t *, uint32_t, int, int, int, int, uint16_t) = raster_fill_c;
+
+static void raster_fill_choose(void)
+{
+#if defined(CPU_DISPATCH) && !defined(__aarch64__)
+	if (cpu_features() & CPU_X86_AVX2) raster_fill = raster_fill_avx2;
+#endif
+}
+
+/*
+ * Rasterise commands from index i, returning the index of the first
+ * one we can't do, or -1 if we can't rasterise at all. clip is the
+ * canvas clip in canvas coordinates, [left, top, right, bottom), both
+ * in and out; (tx, ty) is the pixel-aligned canvas translation.
+ */
+jint JNICALL rasterise(JNIEnv *env, jclass c, jobject bitmap, jobject jBuf, jint i, jint n,
+		jint tx, jint ty, jint viewW, jint viewH, jintArray jColours, jintArray jClip)
+{
+	const int32_t *cmd = (*env)->GetDirectBufferAddress(env, jBuf);
+	AndroidBitmapInfo info;
+	void *pixels;
+	jint clip[4], *colours;
+	int ncolours;
+	if (!raster_init() || !cmd) return -1;
+	if (bitmap_get_info(env, bitmap, &info) < 0 || info.format != ANDROID_BITMAP_FORMAT_RGB_565)
+		return -1;
+	if (bitmap_lock_pixels(env, bitmap, &pixels) < 0) return -1;
+	(*env)->GetIntArrayRegion(env, jClip, 0, 4, clip);
+	ncolours = (*env)->GetArrayLength(env, jColours);
+	colours = (*env)->GetIntArrayElements(env, jColours, NULL);
+	while (i < n) {
+		const int32_t *a = cmd + i + 1;
+		if (cmd[i] == CMD_CLIP) {
+			clip[0] = a[0];
+			clip[1] = a[1];
+			clip[2] = a[0] + a[2];
+			clip[3] = a[1] + a[3];
+			i += 5;
+		} else if (cmd[i] == CMD_UNCLIP) {
+			/* matches GameView.unClip */
+			clip[0] = a[0];
+			clip[1] = a[1];
+			clip[2] = viewW - a[0] - 1;
+			clip[3] = viewH - a[1] - 1;
+			i += 3;
+		} else if (cmd[i] == CMD_RECT && a[2] > 0 && a[3] > 0
+				&& a[4] >= 0 && a[4] < ncolours && ((uint32_t)colours[a[4]] >> 24) == 0xff) {
+			const uint32_t argb = colours[a[4]];
+			const uint16_t pixel = ((argb >> 8) & 0xf800) | ((argb >> 5) & 0x07e0) | ((argb >> 3) & 0x001f);
+			int x1 = max(a[0], clip[0]) + tx, y1 = max(a[1], clip[1]) + ty;
+			int x2 = min(a[0] + a[2], clip[2]) + tx, y2 = min(a[1] + a[3], clip[3]) + ty;
+			x1 = max(x1, 0);
+			y1 = max(y1, 0);
+			x2 = min(x2, (int)info.width);
+			y2 = min(y2, (int)info.height);
+			if (x1 < x2 && y1 < y2) raster_fill(pixels, info.stride, x1, y1, x2, y2, pixel);
+			i += 6;
+		} else {
+			break;
+		}
+	}
+	(*env)->ReleaseIntArrayElements(env, jColours, colours, JNI_ABORT);
+	(*env)->SetIntArrayRegion(env, jClip, 0, 4, clip);
+	bitmap_unlock_pixels(env, bitmap);
+	return i;
+}
+
+/* Union of this redraw's draw_update rectangles, offset like everything else */
+static int dirty = FALSE, dirty_x1, dirty_y1, dirty_x2, dirty_y2;
+
 void android_start_draw(void *handle)
 {
 	CHECK_DR_HANDLE
 //	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 }
 
+void android_draw_update(void *handle, int x, int y, int w, int h)
+{
+	CHECK_DR_HANDLE
+	if (w <= 0 || h <= 0) return;
+	x += fe->ox;
+	y += fe->oy;
+	if (!dirty) {
+		dirty_x1 = x;
+		dirty_y1 = y;
+		dirty_x2 = x + w;
+		dirty_y2 = y + h;
+		dirty = TRUE;
+	} else {
+		dirty_x1 = min(dirty_x1, x);
+		dirty_y1 = min(dirty_y1, y);
+		dirty_x2 = max(dirty_x2, x + w);
+		dirty_y2 = max(dirty_y2, y + h);
+	}
+}
+
 void android_clip(void *handle, int x, int y, int w, int h)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, clipRect, x + fe->ox, y + fe->oy, w, h);
+	int32_t *c = cmd_alloc(5);
+	c[0] = CMD_CLIP;
+	c[1] = x + fe->ox;
+	c[2] = y + fe->oy;
+	c[3] = w;
+	c[4] = h;
 }
 
 void android_unclip(void *handle)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, unClip, fe->ox, fe->oy);
+	int32_t *c = cmd_alloc(3);
+	c[0] = CMD_UNCLIP;
+	c[1] = fe->ox;
+	c[2] = fe->oy;
 }
 
 void android_draw_text(void *handle, int x, int y, int fonttype, int fontsize,
 		int align, int colour, char *text)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jstring js = (*env)->NewStringUTF(env, text);
-	if( js == NULL ) return;
-	(*env)->CallVoidMethod(env, gameView, drawText, x + fe->ox, y + fe->oy,
-			(fonttype == FONT_FIXED ? 0x10 : 0x0) | align,
-			fontsize, colour, js);
-	(*env)->DeleteLocalRef(env, js);
+	int len = strlen(text);
+	int32_t *c = cmd_alloc(7 + (len + 3) / 4);
+	c[0] = CMD_TEXT;
+	c[1] = x + fe->ox;
+	c[2] = y + fe->oy;
+	c[3] = (fonttype == FONT_FIXED ? 0x10 : 0x0) | align;
+	c[4] = fontsize;
+	c[5] = colour;
+	c[6] = len;
+	memcpy(c + 7, text, len);
 }
 
 void android_draw_rect(void *handle, int x, int y, int w, int h, int colour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, fillRect, x + fe->ox, y + fe->oy, w, h, colour);
+	int32_t *c = cmd_alloc(6);
+	c[0] = CMD_RECT;
+	c[1] = x + fe->ox;
+	c[2] = y + fe->oy;
+	c[3] = w;
+	c[4] = h;
+	c[5] = colour;
 }
 
 void android_draw_line(void *handle, int x1, int y1, int x2, int y2, 
 		int colour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, drawLine, x1 + fe->ox, y1 + fe->oy, x2 + fe->ox, y2 + fe->oy, colour);
+	int32_t *c = cmd_alloc(6);
+	c[0] = CMD_LINE;
+	c[1] = x1 + fe->ox;
+	c[2] = y1 + fe->oy;
+	c[3] = x2 + fe->ox;
+	c[4] = y2 + fe->oy;
+	c[5] = colour;
 }
 
 void android_draw_poly(void *handle, int *coords, int npoints,
 		int fillcolour, int outlinecolour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jintArray coordsj = (*env)->NewIntArray(env, npoints*2);
-	if (coordsj == NULL) return;
-	(*env)->SetIntArrayRegion(env, coordsj, 0, npoints*2, coords);
-	(*env)->CallVoidMethod(env, gameView, drawPoly, coordsj, fe->ox, fe->oy, outlinecolour, fillcolour);
-	(*env)->DeleteLocalRef(env, coordsj);  // prevent ref table exhaustion on e.g. large Mines grids...
+	int32_t *c = cmd_alloc(4 + 2 * npoints);
+	int i;
+	c[0] = CMD_POLY;
+	c[1] = outlinecolour;
+	c[2] = fillcolour;
+	c[3] = npoints;
+	for (i = 0; i < npoints; i++) {
+		c[4 + 2*i] = coords[2*i] + fe->ox;
+		c[5 + 2*i] = coords[2*i + 1] + fe->oy;
+	}
 }
 
 void android_draw_circle(void *handle, int cx, int cy, int radius,
 		 int fillcolour, int outlinecolour)
 {
 	CHECK_DR_HANDLE
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, drawCircle, cx+fe->ox, cy+fe->oy, radius, outlinecolour, fillcolour);
+	int32_t *c = cmd_alloc(6);
+	c[0] = CMD_CIRCLE;
+	c[1] = cx + fe->ox;
+	c[2] = cy + fe->oy;
+	c[3] = radius;
+	c[4] = outlinecolour;
+	c[5] = fillcolour;
 }
 
 struct blitter {
@@ -206,6 +434,7 @@ void android_blitter_free(void *handle, blitter *bl)
 {
 	if (bl->handle != -1) {
 		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
+		cmd_flush(env);  // there may be a load from it pending
 		(*env)->CallVoidMethod(env, gameView, blitterFree, bl->handle);
 	}
 	sfree(bl);
@@ -219,7 +448,11 @@ void android_blitter_save(void *handle, blitter *bl, int x, int y)
 		bl->handle = (*env)->CallIntMethod(env, gameView, blitterAlloc, bl->w, bl->h);
 	bl->x = x;
 	bl->y = y;
-	(*env)->CallVoidMethod(env, gameView, blitterSave, bl->handle, x + fe->ox, y + fe->oy);
+	int32_t *c = cmd_alloc(4);
+	c[0] = CMD_BLITTER_SAVE;
+	c[1] = bl->handle;
+	c[2] = x + fe->ox;
+	c[3] = y + fe->oy;
 }
 
 void android_blitter_load(void *handle, blitter *bl, int x, int y)
@@ -230,14 +463,25 @@ void android_blitter_load(void *handle, blitter *bl, int x, int y)
 		x = bl->x;
 		y = bl->y;
 	}
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, blitterLoad, bl->handle, x + fe->ox, y + fe->oy);
+	int32_t *c = cmd_alloc(4);
+	c[0] = CMD_BLITTER_LOAD;
+	c[1] = bl->handle;
+	c[2] = x + fe->ox;
+	c[3] = y + fe->oy;
 }
 
 void android_end_draw(void *handle)
 {
 	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	(*env)->CallVoidMethod(env, gameView, postInvalidate);
+	int drew = ncmds > 0;
+	cmd_flush(env);
+	if (dirty) {
+		(*env)->CallVoidMethod(env, gameView, postInvalidateGame, dirty_x1, dirty_y1, dirty_x2, dirty_y2);
+		dirty = FALSE;
+	} else if (drew) {
+		/* a backend that doesn't report its updates */
+		(*env)->CallVoidMethod(env, gameView, postInvalidateAll);
+	}
 }
 
 void android_changed_state(void *handle, int can_undo, int can_redo)
@@ -262,7 +506,7 @@ const struct drawing_api android_drawing = {
 	android_draw_line,
 	android_draw_poly,
 	android_draw_circle,
-	NULL, // draw_update,
+	android_draw_update,
 	android_clip,
 	android_unclip,
 	android_start_draw,
@@ -295,42 +539,61 @@ void JNICALL resizeEvent(JNIEnv *env, jobject _obj, jint width, jint height)
 	midend_size(fe->me, &x, &y, TRUE);
 	fe->ox = (width - x) / 2;
 	fe->oy = (height - y) / 2;
-	if (gameView) (*env)->CallVoidMethod(env, gameView, unClip, fe->ox, fe->oy);
+	if (gameView) {
+		cmd_flush(env);
+		(*env)->CallVoidMethod(env, gameView, unClip, fe->ox, fe->oy);
+	}
 	midend_force_redraw(fe->me);
 }
 
-void JNICALL timerTick(JNIEnv *env, jobject _obj)
+static jlong monotonic_nanos(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (jlong)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Advance animation to frameNanos (normally a Choreographer vsync time), returning
+ * how many ms the caller may wait before the next tick: 0 means the next frame. */
+jint JNICALL timerTick(JNIEnv *env, jobject _obj, jlong frameNanos)
 {
-	if (! fe->timer_active) return;
+	float elapsed = 0;
+	float due;
+	if (! fe->timer_active) return 0;
 	pthread_setspecific(envKey, env);
-	struct timeval now;
-	float elapsed;
-	gettimeofday(&now, NULL);
-	elapsed = ((now.tv_usec - fe->last_time.tv_usec) * 0.000001F +
-			(now.tv_sec - fe->last_time.tv_sec));
-		midend_timer(fe->me, elapsed);  // may clear timer_active
-	fe->last_time = now;
+	fe->timer_coarse = FALSE;
+	if (frameNanos > fe->last_nanos) {  // a frame can start just before the timer did
+		elapsed = (frameNanos - fe->last_nanos) * 1e-9F;
+		fe->last_nanos = frameNanos;
+	}
+	midend_timer(fe->me, elapsed);  // may clear timer_active
+	if (! fe->timer_active) return 0;
+	due = midend_timer_due(fe->me);
+	fe->timer_coarse = due > 0;
+	return due > 0 ? (jint)(due * 1000) + 1 : 0;
 }
 
 void deactivate_timer(frontend *_fe)
 {
-	if (!fe) return;
+	if (!fe || _fe != fe) return;  // e.g. a generation midend on a worker thread
 	if (fe->timer_active) {
 		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 		(*env)->CallVoidMethod(env, obj, requestTimer, FALSE);
 	}
 	fe->timer_active = FALSE;
+	fe->timer_coarse = FALSE;
 }
 
 void activate_timer(frontend *_fe)
 {
-	if (!fe) return;
-	if (!fe->timer_active) {
+	if (!fe || _fe != fe) return;
+	if (!fe->timer_active || fe->timer_coarse) {  // in the latter case, e.g. a move starts animating
 		JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
 		(*env)->CallVoidMethod(env, obj, requestTimer, TRUE);
-		gettimeofday(&fe->last_time, NULL);
+		if (!fe->timer_active) fe->last_nanos = monotonic_nanos();
 	}
 	fe->timer_active = TRUE;
+	fe->timer_coarse = FALSE;
 }
 
 config_item* configItemWithName(JNIEnv *env, jstring js)
@@ -372,9 +635,53 @@ void JNICALL configSetChoice(JNIEnv *env, jobject _obj, jstring name, jint selec
 	i->ival = selected;
 }
 
+/*
+ * A game from a desc comes without its solution; for games that can
+ * keep one, find it on a generation worker, so that Solve is instant
+ * and saves carry it.
+ */
+static void solve_in_background(frontend *f)
+{
+	const game *g = midend_which_game(f->me);
+	const char *argv[3];
+	int i;
+
+	if (!midend_wants_solution(f->me)) return;
+	for (i = 0; i < gamecount && gamelist[i] != g; i++);
+	if (i == gamecount) return;
+	f->solve_id = midend_get_game_id(f->me);
+	argv[0] = gamenames[i];
+	argv[1] = "--solve";
+	argv[2] = f->solve_id;
+	f->solve_job = android_gen_submit(3, argv, FALSE);
+}
+
+/*
+ * Give the midend the background solution if it's ready. If it isn't,
+ * with give_up we stop waiting for it (midend_solve will solve itself).
+ */
+static void collect_solution(frontend *f, int give_up)
+{
+	char *soln, *error;
+
+	if (!f->solve_job) return;
+	if (android_gen_done(f->solve_job)) {
+		soln = android_gen_wait(f->solve_job, &error);
+		if (soln) midend_supply_solution(f->me, f->solve_id, soln);
+		sfree(soln);
+	} else if (!give_up) {
+		return;
+	}
+	android_gen_release(f->solve_job);
+	f->solve_job = NULL;
+	sfree(f->solve_id);
+	f->solve_id = NULL;
+}
+
 void JNICALL solveEvent(JNIEnv *env, jobject _obj)
 {
 	pthread_setspecific(envKey, env);
+	collect_solution(fe, TRUE);
 	char *msg = midend_solve(fe->me);
 	if (! msg) return;
 	jstring js = (*env)->NewStringUTF(env, msg);
@@ -491,21 +798,39 @@ void JNICALL configCancel(JNIEnv *env, jobject _obj)
 	fe->cfg = NULL;
 }
 
+struct serialise_buf {
+	char *data;
+	int len, size;
+};
+
+/* The whole save is built natively and crosses to Java once, not a record at a time */
 void android_serialise_write(void *ctx, void *buf, int len)
 {
-	JNIEnv *env = (JNIEnv*)pthread_getspecific(envKey);
-	jbyteArray bytesj = (*env)->NewByteArray(env, len);
-	if (bytesj == NULL) return;
-	(*env)->SetByteArrayRegion(env, bytesj, 0, len, buf);
-	(*env)->CallVoidMethod(env, obj, serialiseWrite, bytesj);
-	(*env)->DeleteLocalRef(env, bytesj);
+	struct serialise_buf *b = (struct serialise_buf *)ctx;
+	if (b->len + len + 1 > b->size) {
+		b->size = (b->len + len + 1) * 5 / 4 + 1024;
+		b->data = sresize(b->data, b->size, char);
+	}
+	memcpy(b->data + b->len, buf, len);
+	b->len += len;
+	b->data[b->len] = '\0';
 }
 
-void JNICALL serialise(JNIEnv *env, jobject _obj)
+jstring JNICALL serialise(JNIEnv *env, jobject _obj, jboolean compact)
 {
-	if (!fe) return;
+	struct serialise_buf b = { NULL, 0, 0 };
+	jstring ret;
+	if (!fe) return NULL;
 	pthread_setspecific(envKey, env);
-	midend_serialise(fe->me, android_serialise_write, (void*)0);
+	collect_solution(fe, FALSE);
+	if (compact) {
+		midend_serialise_compact(fe->me, android_serialise_write, &b);
+	} else {
+		midend_serialise(fe->me, android_serialise_write, &b);
+	}
+	ret = b.data ? (*env)->NewStringUTF(env, b.data) : NULL;
+	sfree(b.data);
+	return ret;
 }
 
 static const char* deserialise_readptr = NULL;
@@ -535,6 +860,7 @@ int deserialiseOrIdentify(frontend *new_fe, jstring s, jboolean identifyOnly) {
 		for (i = 0; i < gamecount; i++) {
 			if (!strcmp(gamelist[i]->name, name)) {
 				whichBackend = i;
+				break;
 			}
 		}
 		if (whichBackend < 0) error = "Internal error identifying game";
@@ -563,6 +889,83 @@ jint JNICALL identifyBackend(JNIEnv *env, jclass c, jstring savedGame)
 	return deserialiseOrIdentify(NULL, savedGame, TRUE);
 }
 
+jlong JNICALL genSubmit(JNIEnv *env, jclass c, jobjectArray jArgs, jboolean urgent)
+{
+	int argc = (*env)->GetArrayLength(env, jArgs);
+	const char **argv = snewn(argc, const char *);
+	jstring *jStrings = snewn(argc, jstring);
+	gen_job *job;
+	int i;
+	for (i = 0; i < argc; i++) {
+		jStrings[i] = (jstring)(*env)->GetObjectArrayElement(env, jArgs, i);
+		argv[i] = (*env)->GetStringUTFChars(env, jStrings[i], NULL);
+	}
+	job = android_gen_submit(argc, argv, urgent);  // copies argv
+	for (i = 0; i < argc; i++) {
+		(*env)->ReleaseStringUTFChars(env, jStrings[i], argv[i]);
+		(*env)->DeleteLocalRef(env, jStrings[i]);
+	}
+	sfree(jStrings);
+	sfree(argv);
+	return (jlong)(intptr_t)job;
+}
+
+jstring JNICALL fullParams(JNIEnv *env, jclass c, jstring jBackend, jstring jParams)
+{
+	const char *backend = (*env)->GetStringUTFChars(env, jBackend, NULL);
+	const game *my_game = game_by_name(backend);
+	game_params *params;
+	char *encoded;
+	jstring ret;
+	(*env)->ReleaseStringUTFChars(env, jBackend, backend);
+	if (!my_game) return NULL;
+	const char *paramsStr = jParams ? (*env)->GetStringUTFChars(env, jParams, NULL) : NULL;
+	params = oriented_params_from_str(my_game, paramsStr, NULL);
+	if (jParams) (*env)->ReleaseStringUTFChars(env, jParams, paramsStr);
+	if (!params) return NULL;
+	encoded = my_game->encode_params(params, TRUE);
+	my_game->free_params(params);
+	ret = (*env)->NewStringUTF(env, encoded);
+	sfree(encoded);
+	return ret;
+}
+
+jstring JNICALL genWait(JNIEnv *env, jclass c, jlong job)
+{
+	char *error;
+	char *saved = android_gen_wait((gen_job *)(intptr_t)job, &error);
+	jstring ret;
+	if (!saved) {
+		if (error) throwIllegalArgumentException(env, error);
+		return NULL;  // cancelled
+	}
+	ret = (*env)->NewStringUTF(env, saved);
+	sfree(saved);
+	return ret;
+}
+
+void JNICALL genCancel(JNIEnv *env, jclass c, jlong job)
+{
+	android_gen_cancel((gen_job *)(intptr_t)job);
+}
+
+jint JNICALL genProgress(JNIEnv *env, jclass c, jlong job)
+{
+	int attempts, best;
+	android_gen_progress((gen_job *)(intptr_t)job, &attempts, &best);
+	return attempts;
+}
+
+jint JNICALL genRelaxed(JNIEnv *env, jclass c, jlong job)
+{
+	return android_gen_relaxed((gen_job *)(intptr_t)job);
+}
+
+void JNICALL genRelease(JNIEnv *env, jclass c, jlong job)
+{
+	android_gen_release((gen_job *)(intptr_t)job);
+}
+
 jstring JNICALL getCurrentParams(JNIEnv *env, jobject _obj)
 {
 	if (! fe || ! fe->me) return NULL;
@@ -572,6 +975,22 @@ jstring JNICALL getCurrentParams(JNIEnv *env, jobject _obj)
 	return ret;
 }
 
+/* Where the current game has spent its time, for bug reports */
+jstring JNICALL getStats(JNIEnv *env, jclass cls)
+{
+	if (! fe || ! fe->me) return NULL;
+	char *stats = midend_get_stats(fe->me);
+	jstring ret = (*env)->NewStringUTF(env, stats);
+	sfree(stats);
+	return ret;
+}
+
+/* Add heap use to getStats, for debug builds; FALSE if this device can't */
+jboolean JNICALL startHeapAccounting(JNIEnv *env, jclass cls)
+{
+	return heap_accounting_start();
+}
+
 jstring JNICALL htmlHelpTopic(JNIEnv *env, jobject _obj)
 {
 	//pthread_setspecific(envKey, env);
@@ -593,11 +1012,17 @@ void android_toast(const char *msg, int fromPattern)
 	(*env)->CallVoidMethod(env, obj, showToast, js, fromPattern);
 }
 
+/* gamenames is in strcmp order (see list.c), so we can binary-search it */
 const game* game_by_name(const char* name) {
-	int i;
-	for (i = 0; i<gamecount; i++) {
-		if (!strcmp(name, gamenames[i])) {
-			return gamelist[i];
+	int lo = 0, hi = gamecount;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int c = strcmp(name, gamenames[mid]);
+		if (c == 0) return gamelist[mid];
+		if (c < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
 		}
 	}
 	return NULL;
@@ -734,8 +1159,7 @@ jobjectArray JNICALL getPresets(JNIEnv *env, jobject _obj)
 {
 	int n = midend_num_presets(fe->me);
 	int i;
-	jclass String = (*env)->FindClass(env, "java/lang/String");
-	jobjectArray ret = (*env)->NewObjectArray(env, n * 2, String, NULL);
+	jobjectArray ret = (*env)->NewObjectArray(env, n * 2, StringCls, NULL);
 	for (i = 0; i < n; i++) {
 		char *name;
 		game_params *params;
@@ -756,7 +1180,8 @@ jint JNICALL getUIVisibility(JNIEnv *env, jobject _obj) {
 			+ (midend_can_redo(fe->me) << 1)
 			+ (thegame->can_configure << 2)
 			+ (thegame->can_solve << 3)
-			+ (midend_wants_statusbar(fe->me) << 4);
+			+ (midend_wants_statusbar(fe->me) << 4)
+			+ (((thegame->flags & DRAG_FOLLOWS_PATH) != 0) << 5);
 }
 
 void startPlayingInt(JNIEnv *env, jobject _obj, jobject _gameView, jstring backend, jstring saveOrGameID, int isGameID)
@@ -777,10 +1202,12 @@ void startPlayingInt(JNIEnv *env, jobject _obj, jobject _gameView, jstring backe
 	}
 
 	if (fe) {
+		collect_solution(fe, TRUE);
 		if (fe->me) midend_free(fe->me);  // might use gameView (e.g. blitters)
 		sfree(fe);
 	}
 	fe = new_fe;
+	solve_in_background(fe);
 	if (obj) (*env)->DeleteGlobalRef(env, obj);
 	obj = (*env)->NewGlobalRef(env, _obj);
 	if (gameView) (*env)->DeleteGlobalRef(env, gameView);
@@ -801,6 +1228,51 @@ void JNICALL startPlayingGameID(JNIEnv *env, jobject _obj, jobject _gameView, js
 	startPlayingInt(env, _obj, _gameView, backend, gameID, TRUE);
 }
 
+/*
+ * Open the bundled puzzle pack, if the APK has one. It's stored
+ * uncompressed, so AAsset_getBuffer maps it rather than reading it,
+ * and it stays open (as does the asset manager) for the life of the
+ * process. The asset manager API only exists from API 9, so look it
+ * up at run time; before that there's simply no pack.
+ */
+#define PUZZLE_PACK_ASSET "puzzles.pack"
+
+void JNICALL openPuzzlePack(JNIEnv *env, jclass c, jobject jAssets)
+{
+	static jobject assets = NULL;
+	AAssetManager *(*from_java)(JNIEnv *, jobject);
+	AAsset *(*asset_open)(AAssetManager *, const char *, int);
+	const void *(*asset_get_buffer)(AAsset *);
+	off_t (*asset_get_length)(AAsset *);
+	void (*asset_close)(AAsset *);
+	AAssetManager *mgr;
+	AAsset *asset;
+	const void *data;
+	puzzle_pack *pack = NULL;
+	void *lib;
+
+	if (assets) return;  // already open
+	lib = dlopen("libandroid.so", RTLD_NOW);
+	if (!lib) return;
+	from_java = dlsym(lib, "AAssetManager_fromJava");
+	asset_open = dlsym(lib, "AAssetManager_open");
+	asset_get_buffer = dlsym(lib, "AAsset_getBuffer");
+	asset_get_length = dlsym(lib, "AAsset_getLength");
+	asset_close = dlsym(lib, "AAsset_close");
+	if (!from_java || !asset_open || !asset_get_buffer || !asset_get_length || !asset_close) return;
+	assets = (*env)->NewGlobalRef(env, jAssets);
+	mgr = from_java(env, assets);
+	asset = mgr ? asset_open(mgr, PUZZLE_PACK_ASSET, AASSET_MODE_BUFFER) : NULL;
+	if (!asset) return;
+	data = asset_get_buffer(asset);
+	if (data) pack = pack_open(data, asset_get_length(asset));
+	if (pack) {
+		android_gen_set_pack(pack);
+	} else {
+		asset_close(asset);
+	}
+}
+
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 {
 	jclass cls, vcls, arrowModeCls;
@@ -811,6 +1283,8 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 	cls = (*env)->FindClass(env, "name/boyle/chris/sgtpuzzles/GamePlay");
 	vcls = (*env)->FindClass(env, "name/boyle/chris/sgtpuzzles/GameView");
 	arrowModeCls = (*env)->FindClass(env, "name/boyle/chris/sgtpuzzles/SmallKeyboard$ArrowMode");
+	StringCls = (*env)->NewGlobalRef(env, (*env)->FindClass(env, "java/lang/String"));
+	IllegalArgumentExceptionCls = (*env)->NewGlobalRef(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"));
 	ARROW_MODE_NONE = (*env)->NewGlobalRef(env, (*env)->GetStaticObjectField(env, arrowModeCls,
 			(*env)->GetStaticFieldID(env, arrowModeCls, "NO_ARROWS", "Lname/boyle/chris/sgtpuzzles/SmallKeyboard$ArrowMode;")));
 	ARROW_MODE_ARROWS_ONLY = (*env)->NewGlobalRef(env, (*env)->GetStaticObjectField(env, arrowModeCls,
@@ -823,23 +1297,16 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 			(*env)->GetStaticFieldID(env, arrowModeCls, "ARROWS_DIAGONALS", "Lname/boyle/chris/sgtpuzzles/SmallKeyboard$ArrowMode;")));
 	blitterAlloc   = (*env)->GetMethodID(env, vcls, "blitterAlloc", "(II)I");
 	blitterFree    = (*env)->GetMethodID(env, vcls, "blitterFree", "(I)V");
-	blitterLoad    = (*env)->GetMethodID(env, vcls, "blitterLoad", "(III)V");
-	blitterSave    = (*env)->GetMethodID(env, vcls, "blitterSave", "(III)V");
 	changedState   = (*env)->GetMethodID(env, cls,  "changedState", "(ZZ)V");
-	clipRect       = (*env)->GetMethodID(env, vcls, "clipRect", "(IIII)V");
 	dialogAdd      = (*env)->GetMethodID(env, cls,  "dialogAdd", "(IILjava/lang/String;Ljava/lang/String;I)V");
 	dialogInit     = (*env)->GetMethodID(env, cls,  "dialogInit", "(ILjava/lang/String;)V");
 	dialogShow     = (*env)->GetMethodID(env, cls,  "dialogShow", "()V");
-	drawCircle     = (*env)->GetMethodID(env, vcls, "drawCircle", "(IIIII)V");
-	drawLine       = (*env)->GetMethodID(env, vcls, "drawLine", "(IIIII)V");
-	drawPoly       = (*env)->GetMethodID(env, vcls,  "drawPoly", "([IIIII)V");
-	drawText       = (*env)->GetMethodID(env, vcls, "drawText", "(IIIIILjava/lang/String;)V");
-	fillRect       = (*env)->GetMethodID(env, vcls, "fillRect", "(IIIII)V");
+	drawBuffer     = (*env)->GetMethodID(env, vcls, "drawBuffer", "(Ljava/nio/ByteBuffer;I)V");
 	getBackgroundColour = (*env)->GetMethodID(env, vcls, "getDefaultBackgroundColour", "()I");
 	getText        = (*env)->GetMethodID(env, cls,  "gettext", "(Ljava/lang/String;)Ljava/lang/String;");
-	postInvalidate = (*env)->GetMethodID(env, vcls, "postInvalidate", "()V");
+	postInvalidateAll = (*env)->GetMethodID(env, vcls, "postInvalidateAll", "()V");
+	postInvalidateGame = (*env)->GetMethodID(env, vcls, "postInvalidateGame", "(IIII)V");
 	requestTimer   = (*env)->GetMethodID(env, cls,  "requestTimer", "(Z)V");
-	serialiseWrite = (*env)->GetMethodID(env, cls,  "serialiseWrite", "([B)V");
 	setStatus      = (*env)->GetMethodID(env, cls,  "setStatus", "(Ljava/lang/String;)V");
 	showToast      = (*env)->GetMethodID(env, cls,  "showToast", "(Ljava/lang/String;Z)V");
 	unClip         = (*env)->GetMethodID(env, vcls, "unClip", "(II)V");
@@ -850,7 +1317,7 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 	JNINativeMethod methods[] = {
 		{ "keyEvent", "(III)V", keyEvent },
 		{ "resizeEvent", "(II)V", resizeEvent },
-		{ "timerTick", "()V", timerTick },
+		{ "timerTick", "(J)I", timerTick },
 		{ "configSetString", "(Ljava/lang/String;Ljava/lang/String;)V", configSetString },
 		{ "configSetBool", "(Ljava/lang/String;I)V", configSetBool },
 		{ "configSetChoice", "(Ljava/lang/String;I)V", configSetChoice },
@@ -861,20 +1328,34 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *jvm, void *reserved)
 		{ "getFullGameIDFromDialog", "()Ljava/lang/String;", getFullGameIDFromDialog },
 		{ "getFullSeedFromDialog", "()Ljava/lang/String;", getFullSeedFromDialog },
 		{ "configCancel", "()V", configCancel },
-		{ "serialise", "()V", serialise },
+		{ "serialise", "(Z)Ljava/lang/String;", serialise },
 		{ "htmlHelpTopic", "()Ljava/lang/String;", htmlHelpTopic },
 		{ "startPlaying", "(Lname/boyle/chris/sgtpuzzles/GameView;Ljava/lang/String;)V", startPlaying },
 		{ "startPlayingGameID", "(Lname/boyle/chris/sgtpuzzles/GameView;Ljava/lang/String;Ljava/lang/String;)V", startPlayingGameID },
 		{ "identifyBackend", "(Ljava/lang/String;)I", identifyBackend },
 		{ "getCurrentParams", "()Ljava/lang/String;", getCurrentParams },
+		{ "getStats", "()Ljava/lang/String;", getStats },
+		{ "startHeapAccounting", "()Z", startHeapAccounting },
 		{ "requestKeys", "(Ljava/lang/String;Ljava/lang/String;)V", requestKeys },
 		{ "setCursorVisibility", "(Z)V", setCursorVisibility },
 		{ "getColours", "()[F", getColours },
 		{ "getPresets", "()[Ljava/lang/String;", getPresets },
 		{ "getGameTitle", "()Ljava/lang/String;", getGameTitle },
 		{ "getUIVisibility", "()I", getUIVisibility },
+		{ "genSubmit", "([Ljava/lang/String;Z)J", genSubmit },
+		{ "fullParams", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;", fullParams },
+		{ "genWait", "(J)Ljava/lang/String;", genWait },
+		{ "genCancel", "(J)V", genCancel },
+		{ "genProgress", "(J)I", genProgress },
+		{ "genRelease", "(J)V", genRelease },
+		{ "genRelaxed", "(J)I", genRelaxed },
+		{ "openPuzzlePack", "(Landroid/content/res/AssetManager;)V", openPuzzlePack },
 	};
 	(*env)->RegisterNatives(env, cls, methods, sizeof(methods)/sizeof(JNINativeMethod));
+	JNINativeMethod viewMethods[] = {
+		{ "rasterise", "(Landroid/graphics/Bitmap;Ljava/nio/ByteBuffer;IIIIII[I[I)I", rasterise },
+	};
+	(*env)->RegisterNatives(env, vcls, viewMethods, sizeof(viewMethods)/sizeof(JNINativeMethod));
 
 	return JNI_VERSION_1_2;
 }
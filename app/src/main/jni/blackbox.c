@@ -39,6 +39,7 @@ enum {
 struct game_params {
     int w, h;
     int minballs, maxballs;
+    int unique;
 };
 
 static game_params *default_params(void)
@@ -47,16 +48,17 @@ static game_params *default_params(void)
 
     ret->w = ret->h = 8;
     ret->minballs = ret->maxballs = 5;
+    ret->unique = FALSE;
 
     return ret;
 }
 
 static const game_params blackbox_presets[] = {
-    { 5, 5, 3, 3 },
-    { 8, 8, 5, 5 },
-    { 8, 8, 3, 6 },
-    { 10, 10, 5, 5 },
-    { 10, 10, 4, 10 }
+    { 5, 5, 3, 3, FALSE },
+    { 8, 8, 5, 5, FALSE },
+    { 8, 8, 3, 6, FALSE },
+    { 10, 10, 5, 5, FALSE },
+    { 10, 10, 4, 10, FALSE }
 };
 
 static int game_fetch_preset(int i, char **name, game_params **params)
@@ -123,6 +125,10 @@ static void decode_params(game_params *params, char const *string)
             while (*p && isdigit((unsigned char)*p)) p++;
             break;
 
+        case 'u':
+            params->unique = TRUE;
+            break;
+
         default:
             ;
         }
@@ -133,8 +139,9 @@ static char *encode_params(const game_params *params, int full)
 {
     char str[256];
 
-    sprintf(str, "w%dh%dm%dM%d",
-            params->w, params->h, params->minballs, params->maxballs);
+    sprintf(str, "w%dh%dm%dM%d%s",
+            params->w, params->h, params->minballs, params->maxballs,
+            full && params->unique ? "u" : "");
     return dupstr(str);
 }
 
@@ -143,7 +150,7 @@ static config_item *game_configure(const game_params *params)
     config_item *ret;
     char buf[80];
 
-    ret = snewn(4, config_item);
+    ret = snewn(5, config_item);
 
     ret[0].name = _("Width");
     ret[0].type = C_STRING;
@@ -166,10 +173,15 @@ static config_item *game_configure(const game_params *params)
     ret[2].sval = dupstr(buf);
     ret[2].ival = 0;
 
-    ret[3].name = NULL;
-    ret[3].type = C_END;
+    ret[3].name = _("Ensure unique solution");
+    ret[3].type = C_BOOLEAN;
     ret[3].sval = NULL;
-    ret[3].ival = 0;
+    ret[3].ival = params->unique;
+
+    ret[4].name = NULL;
+    ret[4].type = C_END;
+    ret[4].sval = NULL;
+    ret[4].ival = 0;
 
     return ret;
 }
@@ -184,6 +196,7 @@ static game_params *custom_params(const config_item *cfg)
     /* Allow 'a-b' for a range, otherwise assume a single number. */
     if (sscanf(cfg[2].sval, "%d-%d", &ret->minballs, &ret->maxballs) < 2)
         ret->minballs = ret->maxballs = atoi(cfg[2].sval);
+    ret->unique = cfg[3].ival;
 
     return ret;
 }
@@ -210,39 +223,50 @@ static char *validate_params(const game_params *params, int full)
  * Then we obfuscate it.
  */
 
+static int layout_is_unique(const game_params *params,
+                            const unsigned char *balls, int nballs);
+
 static char *new_game_desc(const game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
-    int nballs = params->minballs, i;
+    int nballs, i;
     char *grid, *ret;
     unsigned char *bmp;
 
-    if (params->maxballs > params->minballs)
-        nballs += random_upto(rs, params->maxballs - params->minballs + 1);
+    while (1) {
+        nballs = params->minballs;
+        if (params->maxballs > params->minballs)
+            nballs += random_upto(rs, params->maxballs - params->minballs + 1);
 
-    grid = snewn(params->w*params->h, char);
-    memset(grid, 0, params->w * params->h * sizeof(char));
+        grid = snewn(params->w*params->h, char);
+        memset(grid, 0, params->w * params->h * sizeof(char));
 
-    bmp = snewn(nballs*2 + 2, unsigned char);
-    memset(bmp, 0, (nballs*2 + 2) * sizeof(unsigned char));
+        bmp = snewn(nballs*2 + 2, unsigned char);
+        memset(bmp, 0, (nballs*2 + 2) * sizeof(unsigned char));
 
-    bmp[0] = params->w;
-    bmp[1] = params->h;
+        bmp[0] = params->w;
+        bmp[1] = params->h;
 
-    for (i = 0; i < nballs; i++) {
-        int x, y;
+        for (i = 0; i < nballs; i++) {
+            int x, y;
 
-        do {
-            x = random_upto(rs, params->w);
-            y = random_upto(rs, params->h);
-        } while (grid[y*params->w + x]);
+            do {
+                x = random_upto(rs, params->w);
+                y = random_upto(rs, params->h);
+            } while (grid[y*params->w + x]);
 
-        grid[y*params->w + x] = 1;
+            grid[y*params->w + x] = 1;
 
-        bmp[(i+1)*2 + 0] = x;
-        bmp[(i+1)*2 + 1] = y;
+            bmp[(i+1)*2 + 0] = x;
+            bmp[(i+1)*2 + 1] = y;
+        }
+        sfree(grid);
+
+        if (!params->unique || layout_is_unique(params, bmp + 2, nballs) ||
+            random_gen_attempt(rs, -1))
+            break;
+        sfree(bmp);
     }
-    sfree(grid);
 
     obfuscate_bitmap(bmp, (nballs*2 + 2) * 8, FALSE);
     ret = bin2hex(bmp, nballs*2 + 2);
@@ -301,6 +325,8 @@ struct game_state {
     int w, h, minballs, maxballs, nballs, nlasers;
     unsigned int *grid; /* (w+2)x(h+2), to allow for laser firing range */
     unsigned int *exits; /* one per laser */
+    unsigned int *solnexits, *guessexits; /* cached traces; see below */
+    int *beams;         /* 4 per grid square; see guess_exit() */
     int done;           /* user has finished placing his own balls. */
     int laserno;        /* number of next laser to be fired. */
     int nguesses, reveal, justwrong, nright, nwrong, nmissed;
@@ -414,6 +440,12 @@ static game_state *new_game(midend *me, const game_params *params,
 
     state->exits = snewn(state->nlasers, unsigned int);
     memset(state->exits, LASER_EMPTY, state->nlasers * sizeof(unsigned int));
+    state->solnexits = snewn(state->nlasers, unsigned int);
+    memset(state->solnexits, LASER_EMPTY, state->nlasers * sizeof(unsigned int));
+    state->guessexits = snewn(state->nlasers, unsigned int);
+    memset(state->guessexits, LASER_EMPTY, state->nlasers * sizeof(unsigned int));
+    state->beams = snewn((state->w+2)*(state->h+2)*4, int);
+    memset(state->beams, -1, (state->w+2)*(state->h+2)*4 * sizeof(int));
 
     for (i = 0; i < state->nballs; i++) {
         GRID(state, bmp[(i+1)*2 + 0]+1, bmp[(i+1)*2 + 1]+1) = BALL_CORRECT;
@@ -441,6 +473,12 @@ static game_state *dup_game(const game_state *state)
     memcpy(ret->grid, state->grid, (ret->w+2)*(ret->h+2) * sizeof(unsigned int));
     ret->exits = snewn(ret->nlasers, unsigned int);
     memcpy(ret->exits, state->exits, ret->nlasers * sizeof(unsigned int));
+    ret->solnexits = snewn(ret->nlasers, unsigned int);
+    memcpy(ret->solnexits, state->solnexits, ret->nlasers * sizeof(unsigned int));
+    ret->guessexits = snewn(ret->nlasers, unsigned int);
+    memcpy(ret->guessexits, state->guessexits, ret->nlasers * sizeof(unsigned int));
+    ret->beams = snewn((ret->w+2)*(ret->h+2)*4, int);
+    memcpy(ret->beams, state->beams, (ret->w+2)*(ret->h+2)*4 * sizeof(int));
 
     XFER(done);
     XFER(laserno);
@@ -456,6 +494,9 @@ static game_state *dup_game(const game_state *state)
 
 static void free_game(game_state *state)
 {
+    sfree(state->beams);
+    sfree(state->guessexits);
+    sfree(state->solnexits);
     sfree(state->exits);
     sfree(state->grid);
     sfree(state);
@@ -548,10 +589,29 @@ static void game_changed_state(game_ui *ui, const game_state *oldstate,
 
 enum { LOOK_LEFT, LOOK_FORWARD, LOOK_RIGHT };
 
+/*
+ * A laser is traced against one layout of balls: the arena squares
+ * with the flag 'ball' set. The generator's uniqueness search also
+ * sets 'known' to the flag it marks decided squares with, and then the
+ * tracer gives up (returning LASER_UNDECIDED) at the first undecided
+ * square it needs to look at. If 'beams' is non-NULL, each step of the
+ * laser is recorded there as 'mark'; see guess_exit().
+ */
+#define LASER_UNDECIDED 0x20000        /* never stored in a game_state */
+
+struct tracer {
+    unsigned int ball, known;
+    int *beams, mark;
+    int undecided;                     /* grid index, if we gave up */
+};
+
 /* Given a position and a direction, check whether we can see a ball in front
- * of us, or to our front-left or front-right. */
-static int isball(game_state *state, int gx, int gy, int direction, int lookwhere)
+ * of us, or to our front-left or front-right. Returns -1 if we can't tell. */
+static int isball(const game_state *state, struct tracer *t,
+                  int gx, int gy, int direction, int lookwhere)
 {
+    unsigned int square;
+
     debug(("isball, (%d, %d), dir %s, lookwhere %s\n", gx, gy, dirstrs[direction],
            lookwhere == LOOK_LEFT ? "LEFT" :
            lookwhere == LOOK_FORWARD ? "FORWARD" : "RIGHT"));
@@ -569,31 +629,44 @@ static int isball(game_state *state, int gx, int gy, int direction, int lookwher
     if (gx < 1 || gy < 1 || gx > state->w || gy > state->h)
         return 0;
 
-    if (GRID(state, gx,gy) & BALL_CORRECT)
+    square = GRID(state, gx, gy);
+    if (t->known && !(square & t->known)) {
+        t->undecided = gy * (state->w+2) + gx;
+        return -1;
+    }
+    if (square & t->ball)
         return 1;
 
     return 0;
 }
 
-static int fire_laser_internal(game_state *state, int x, int y, int direction)
+static int fire_laser_internal(const game_state *state, struct tracer *t,
+                               int x, int y, int direction)
 {
-    int unused, lno, tmp;
+    int unused, lno, tmp, ball;
 
     tmp = grid2range(state, x, y, &lno);
     assert(tmp);
 
+    if (t->beams)
+        t->beams[(y * (state->w+2) + x) * 4 + direction] = t->mark;
+
     /* deal with strange initial reflection rules (that stop
      * you turning down the laser range) */
 
     /* I've just chosen to prioritise instant-hit over instant-reflection;
      * I can't find anywhere that gives me a definite algorithm for this. */
-    if (isball(state, x, y, direction, LOOK_FORWARD)) {
+    ball = isball(state, t, x, y, direction, LOOK_FORWARD);
+    if (ball < 0) return LASER_UNDECIDED;
+    if (ball) {
         debug(("Instant hit at (%d, %d)\n", x, y));
 	return LASER_HIT;	       /* hit */
     }
 
-    if (isball(state, x, y, direction, LOOK_LEFT) ||
-        isball(state, x, y, direction, LOOK_RIGHT)) {
+    ball = isball(state, t, x, y, direction, LOOK_LEFT);
+    if (ball == 0) ball = isball(state, t, x, y, direction, LOOK_RIGHT);
+    if (ball < 0) return LASER_UNDECIDED;
+    if (ball) {
         debug(("Instant reflection at (%d, %d)\n", x, y));
 	return LASER_REFLECT;	       /* reflection */
     }
@@ -612,21 +685,30 @@ static int fire_laser_internal(game_state *state, int x, int y, int direction)
 	    return (lno == exitno ? LASER_REFLECT : exitno);
         }
         /* paranoia. This obviously should never happen */
-        assert(!(GRID(state, x, y) & BALL_CORRECT));
+        assert(!(GRID(state, x, y) & t->ball));
+
+        if (t->beams)
+            t->beams[(y * (state->w+2) + x) * 4 + direction] = t->mark;
 
-        if (isball(state, x, y, direction, LOOK_FORWARD)) {
+        ball = isball(state, t, x, y, direction, LOOK_FORWARD);
+        if (ball < 0) return LASER_UNDECIDED;
+        if (ball) {
             /* we're facing a ball; send back a reflection. */
             debug(("Ball ahead of (%d, %d)", x, y));
             return LASER_HIT;	       /* hit */
         }
 
-        if (isball(state, x, y, direction, LOOK_LEFT)) {
+        ball = isball(state, t, x, y, direction, LOOK_LEFT);
+        if (ball < 0) return LASER_UNDECIDED;
+        if (ball) {
             /* ball to our left; rotate clockwise and look again. */
             debug(("Ball to left; turning clockwise.\n"));
             direction += 1; direction %= 4;
             continue;
         }
-        if (isball(state, x, y, direction, LOOK_RIGHT)) {
+        ball = isball(state, t, x, y, direction, LOOK_RIGHT);
+        if (ball < 0) return LASER_UNDECIDED;
+        if (ball) {
             /* ball to our right; rotate anti-clockwise and look again. */
             debug(("Ball to rightl turning anti-clockwise.\n"));
             direction += 3; direction %= 4;
@@ -638,14 +720,75 @@ static int fire_laser_internal(game_state *state, int x, int y, int direction)
     }
 }
 
-static int laser_exit(game_state *state, int entryno)
+static int laser_exit(const game_state *state, struct tracer *t, int entryno)
 {
     int tmp, x, y, direction;
 
     tmp = range2grid(state, entryno, &x, &y, &direction);
     assert(tmp);
 
-    return fire_laser_internal(state, x, y, direction);
+    return fire_laser_internal(state, t, x, y, direction);
+}
+
+/*
+ * Each laser's outcome is traced at most once against the real balls
+ * (which only ever change to an equivalent layout, in check_guesses),
+ * and against the guessed balls until a guess changes near its path.
+ *
+ * To know which those are, every step of a guess trace (a square and
+ * the direction the laser faces there) is recorded in beams[] as the
+ * laser it belongs to. Paths are reversible, so no two lasers share a
+ * step. A laser only looks at squares next to its steps, so toggling a
+ * ball can only change the lasers with a step in the 3x3 block around
+ * it, and guess_toggled() forgets just those.
+ */
+static unsigned int solution_exit(game_state *state, int entryno)
+{
+    if (state->solnexits[entryno] == LASER_EMPTY) {
+        struct tracer t;
+        t.ball = BALL_CORRECT;
+        t.known = 0;
+        t.beams = NULL;
+        state->solnexits[entryno] = laser_exit(state, &t, entryno);
+    }
+    return state->solnexits[entryno];
+}
+
+static unsigned int guess_exit(game_state *state, int entryno)
+{
+    if (state->guessexits[entryno] == LASER_EMPTY) {
+        struct tracer t;
+        t.ball = BALL_GUESS;
+        t.known = 0;
+        t.beams = state->beams;
+        t.mark = entryno;
+        state->guessexits[entryno] = laser_exit(state, &t, entryno);
+    }
+    return state->guessexits[entryno];
+}
+
+/* Call before toggling the guess at (gx,gy), while the old traces hold */
+static void guess_toggled(game_state *state, int gx, int gy)
+{
+    struct tracer t;
+    int x, y, d, e;
+
+    t.ball = BALL_GUESS;
+    t.known = 0;
+    t.beams = state->beams;
+    t.mark = -1;
+    for (y = gy-1; y <= gy+1; y++) {
+        for (x = gx-1; x <= gx+1; x++) {
+            for (d = 0; d < 4; d++) {
+                e = state->beams[(y * (state->w+2) + x) * 4 + d];
+                if (e >= 0) {
+                    /* retrace to erase its steps, then forget it */
+                    laser_exit(state, &t, e);
+                    state->guessexits[e] = LASER_EMPTY;
+                }
+            }
+        }
+    }
 }
 
 static void fire_laser(game_state *state, int entryno)
@@ -655,7 +798,7 @@ static void fire_laser(game_state *state, int entryno)
     tmp = range2grid(state, entryno, &x, &y, &direction);
     assert(tmp);
 
-    exitno = fire_laser_internal(state, x, y, direction);
+    exitno = solution_exit(state, entryno);
 
     if (exitno == LASER_HIT || exitno == LASER_REFLECT) {
 	GRID(state, x, y) = state->exits[entryno] = exitno;
@@ -670,6 +813,31 @@ static void fire_laser(game_state *state, int entryno)
     }
 }
 
+/*
+ * Seed for picking one of several errors to show: the grid as it
+ * would look with the guesses in place of the real balls, so that
+ * repeating the same marking will give the same answer.
+ */
+static random_state *guess_random(const game_state *state)
+{
+    int n = (state->w+2)*(state->h+2), x, y;
+    unsigned int *grid = snewn(n, unsigned int);
+    random_state *rs;
+
+    memcpy(grid, state->grid, n * sizeof(unsigned int));
+    for (x = 1; x <= state->w; x++) {
+        for (y = 1; y <= state->h; y++) {
+            unsigned int *sq = &grid[y*(state->w+2) + x];
+            *sq &= ~BALL_CORRECT;
+            if (*sq & BALL_GUESS)
+                *sq |= BALL_CORRECT;
+        }
+    }
+    rs = random_new((char *)grid, n * sizeof(unsigned int));
+    sfree(grid);
+    return rs;
+}
+
 /* Checks that the guessed balls in the state match up with the real balls
  * for all possible lasers (i.e. not just the ones that the player might
  * have already guessed). This is required because any layout with >4 balls
@@ -677,7 +845,6 @@ static void fire_laser(game_state *state, int entryno)
  * (i.e. consistent) layout. */
 static int check_guesses(game_state *state, int cagey)
 {
-    game_state *solution, *guesses;
     int i, x, y, n, unused, tmp;
     int ret = 0;
 
@@ -693,19 +860,10 @@ static int check_guesses(game_state *state, int cagey)
 	 * solution from their guess. If so, show them one such
 	 * laser and reveal no further information.
 	 */
-	guesses = dup_game(state);
-	/* clear out BALL_CORRECT on guess, make BALL_GUESS BALL_CORRECT. */
-	for (x = 1; x <= state->w; x++) {
-	    for (y = 1; y <= state->h; y++) {
-		GRID(guesses, x, y) &= ~BALL_CORRECT;
-		if (GRID(guesses, x, y) & BALL_GUESS)
-		    GRID(guesses, x, y) |= BALL_CORRECT;
-	    }
-	}
 	n = 0;
-	for (i = 0; i < guesses->nlasers; i++) {
-	    if (guesses->exits[i] != LASER_EMPTY &&
-		guesses->exits[i] != laser_exit(guesses, i))
+	for (i = 0; i < state->nlasers; i++) {
+	    if (state->exits[i] != LASER_EMPTY &&
+		state->exits[i] != guess_exit(state, i))
 		n++;
 	}
 	if (n) {
@@ -713,34 +871,27 @@ static int check_guesses(game_state *state, int cagey)
 	     * At least one of the player's existing lasers
 	     * contradicts their ball placement. Pick a random one,
 	     * highlight it, and return.
-	     *
-	     * A temporary random state is created from the current
-	     * grid, so that repeating the same marking will give
-	     * the same answer instead of a different one.
 	     */
-	    random_state *rs = random_new((char *)guesses->grid,
-					  (state->w+2)*(state->h+2) *
-					  sizeof(unsigned int));
+	    random_state *rs = guess_random(state);
 	    n = random_upto(rs, n);
 	    random_free(rs);
-	    for (i = 0; i < guesses->nlasers; i++) {
-		if (guesses->exits[i] != LASER_EMPTY &&
-		    guesses->exits[i] != laser_exit(guesses, i) &&
+	    for (i = 0; i < state->nlasers; i++) {
+		if (state->exits[i] != LASER_EMPTY &&
+		    state->exits[i] != guess_exit(state, i) &&
 		    n-- == 0) {
 		    state->exits[i] |= LASER_WRONG;
-		    tmp = laser_exit(state, i);
+		    tmp = solution_exit(state, i);
 		    if (RANGECHECK(state, tmp))
 			state->exits[tmp] |= LASER_WRONG;
 		    state->justwrong = TRUE;
-		    free_game(guesses);
 		    return 0;
 		}
 	    }
 	}
 	n = 0;
-	for (i = 0; i < guesses->nlasers; i++) {
-	    if (guesses->exits[i] == LASER_EMPTY &&
-		laser_exit(state, i) != laser_exit(guesses, i))
+	for (i = 0; i < state->nlasers; i++) {
+	    if (state->exits[i] == LASER_EMPTY &&
+		solution_exit(state, i) != guess_exit(state, i))
 		n++;
 	}
 	if (n) {
@@ -748,79 +899,39 @@ static int check_guesses(game_state *state, int cagey)
 	     * At least one of the player's unfired lasers would
 	     * demonstrate their ball placement to be wrong. Pick a
 	     * random one, highlight it, and return.
-	     *
-	     * A temporary random state is created from the current
-	     * grid, so that repeating the same marking will give
-	     * the same answer instead of a different one.
 	     */
-	    random_state *rs = random_new((char *)guesses->grid,
-					  (state->w+2)*(state->h+2) *
-					  sizeof(unsigned int));
+	    random_state *rs = guess_random(state);
 	    n = random_upto(rs, n);
 	    random_free(rs);
-	    for (i = 0; i < guesses->nlasers; i++) {
-		if (guesses->exits[i] == LASER_EMPTY &&
-		    laser_exit(state, i) != laser_exit(guesses, i) &&
+	    for (i = 0; i < state->nlasers; i++) {
+		if (state->exits[i] == LASER_EMPTY &&
+		    solution_exit(state, i) != guess_exit(state, i) &&
 		    n-- == 0) {
 		    fire_laser(state, i);
 		    state->exits[i] |= LASER_OMITTED;
-		    tmp = laser_exit(state, i);
+		    tmp = solution_exit(state, i);
 		    if (RANGECHECK(state, tmp))
 			state->exits[tmp] |= LASER_OMITTED;
 		    state->justwrong = TRUE;
-		    free_game(guesses);
 		    return 0;
 		}
 	    }
 	}
-	free_game(guesses);
-    }
-
-    /* duplicate the state (to solution) */
-    solution = dup_game(state);
-
-    /* clear out the lasers of solution */
-    for (i = 0; i < solution->nlasers; i++) {
-        tmp = range2grid(solution, i, &x, &y, &unused);
-        assert(tmp);
-        GRID(solution, x, y) = 0;
-        solution->exits[i] = LASER_EMPTY;
     }
 
-    /* duplicate solution to guess. */
-    guesses = dup_game(solution);
-
-    /* clear out BALL_CORRECT on guess, make BALL_GUESS BALL_CORRECT. */
-    for (x = 1; x <= state->w; x++) {
-        for (y = 1; y <= state->h; y++) {
-            GRID(guesses, x, y) &= ~BALL_CORRECT;
-            if (GRID(guesses, x, y) & BALL_GUESS)
-                GRID(guesses, x, y) |= BALL_CORRECT;
-        }
-    }
-
-    /* for each laser (on both game_states), fire it if it hasn't been fired.
-     * If one has been fired (or received a hit) and another hasn't, we know
-     * the ball layouts didn't match and can short-circuit return. */
-    for (i = 0; i < solution->nlasers; i++) {
-        if (solution->exits[i] == LASER_EMPTY)
-            fire_laser(solution, i);
-        if (guesses->exits[i] == LASER_EMPTY)
-            fire_laser(guesses, i);
-    }
-
-    /* check each game_state's laser against the other; if any differ, return 0 */
+    /* check every laser against the real balls and the guesses; if any
+     * differ, the layouts don't match. */
     ret = 1;
-    for (i = 0; i < solution->nlasers; i++) {
-        tmp = range2grid(solution, i, &x, &y, &unused);
+    for (i = 0; i < state->nlasers; i++) {
+        tmp = range2grid(state, i, &x, &y, &unused);
         assert(tmp);
 
-        if (solution->exits[i] != guesses->exits[i]) {
+        if (solution_exit(state, i) != guess_exit(state, i)) {
             /* If the original state didn't have this shot fired,
              * and it would be wrong between the guess and the solution,
              * add it. */
             if (state->exits[i] == LASER_EMPTY) {
-                state->exits[i] = solution->exits[i];
+                state->exits[i] = solution_exit(state, i);
                 if (state->exits[i] == LASER_REFLECT ||
                     state->exits[i] == LASER_HIT)
                     GRID(state, x, y) = state->exits[i];
@@ -844,7 +955,8 @@ static int check_guesses(game_state *state, int cagey)
 	state->nguesses > state->maxballs) goto done;
 
     /* fix up original state so the 'correct' balls end up matching the guesses,
-     * as we've just proved that they were equivalent. */
+     * as we've just proved that they were equivalent (so the cached
+     * solution traces still hold). */
     for (x = 1; x <= state->w; x++) {
         for (y = 1; y <= state->h; y++) {
             if (GRID(state, x, y) & BALL_GUESS)
@@ -868,12 +980,132 @@ done:
                 state->nmissed++;
         }
     }
-    free_game(solution);
-    free_game(guesses);
     state->reveal = 1;
     return ret;
 }
 
+/*
+ * Generator support: a puzzle is uniquely determinable if no other
+ * layout of between minballs and maxballs balls gives every laser
+ * the same outcome. We search for such layouts in a scratch state,
+ * using the tracer with SEARCH_BALL for a ball and SEARCH_KNOWN for a
+ * decided square: pick a laser the decided squares don't settle yet,
+ * and branch on the first undecided square it looks at. Lasers that
+ * are settled and right stay so in the whole subtree, so they're
+ * swapped out of the pending list instead of being traced again.
+ *
+ * Once every laser is settled, nothing looks at the undecided squares,
+ * so they can hold any number of the remaining balls. Searches that
+ * run too long count as ambiguous, and the generator tries again.
+ */
+#define SEARCH_BALL   BALL_GUESS
+#define SEARCH_KNOWN  BALL_LOCK
+#define SEARCH_MAX_NODES 200000L
+
+struct layout_search {
+    game_state *scratch;
+    int *target, *pending;
+    int minballs, maxballs, nballs, nundecided;
+    long nodes;
+};
+
+/* Counts the matching layouts, stopping at 2 */
+static int count_layouts(struct layout_search *ls, int npending)
+{
+    game_state *s = ls->scratch;
+    struct tracer t;
+    int i, e, r, sq = -1, lo, hi, ret;
+
+    if (++ls->nodes > SEARCH_MAX_NODES)
+        return 2;
+    if (ls->nballs > ls->maxballs ||
+        ls->nballs + ls->nundecided < ls->minballs)
+        return 0;
+
+    t.ball = SEARCH_BALL;
+    t.known = SEARCH_KNOWN;
+    t.beams = NULL;
+    for (i = 0; i < npending; ) {
+        e = ls->pending[i];
+        r = laser_exit(s, &t, e);
+        if (r == LASER_UNDECIDED) {
+            if (sq < 0)
+                sq = t.undecided;
+            i++;
+        } else if (r != ls->target[e]) {
+            return 0;
+        } else {
+            ls->pending[i] = ls->pending[--npending];
+            ls->pending[npending] = e;
+        }
+    }
+
+    if (sq < 0) {
+        lo = max(ls->minballs - ls->nballs, 0);
+        hi = min(ls->maxballs - ls->nballs, ls->nundecided);
+        if (lo > hi)
+            return 0;
+        return (lo == hi && (lo == 0 || lo == ls->nundecided)) ? 1 : 2;
+    }
+
+    s->grid[sq] |= SEARCH_KNOWN;
+    ls->nundecided--;
+    ret = count_layouts(ls, npending);
+    if (ret < 2) {
+        s->grid[sq] |= SEARCH_BALL;
+        ls->nballs++;
+        ret += count_layouts(ls, npending);
+        ls->nballs--;
+        s->grid[sq] &= ~SEARCH_BALL;
+    }
+    s->grid[sq] &= ~SEARCH_KNOWN;
+    ls->nundecided++;
+
+    return min(ret, 2);
+}
+
+/* balls[] is as in the game description, without the size header */
+static int layout_is_unique(const game_params *params,
+                            const unsigned char *balls, int nballs)
+{
+    struct layout_search ls;
+    game_state *s = snew(game_state);
+    struct tracer t;
+    int i, ret;
+
+    s->w = params->w;
+    s->h = params->h;
+    s->nlasers = 2 * (s->w + s->h);
+    s->grid = snewn((s->w+2)*(s->h+2), unsigned int);
+    memset(s->grid, 0, (s->w+2)*(s->h+2) * sizeof(unsigned int));
+    for (i = 0; i < nballs; i++)
+        GRID(s, balls[i*2] + 1, balls[i*2+1] + 1) = BALL_CORRECT;
+
+    ls.scratch = s;
+    ls.target = snewn(s->nlasers, int);
+    ls.pending = snewn(s->nlasers, int);
+    t.ball = BALL_CORRECT;
+    t.known = 0;
+    t.beams = NULL;
+    for (i = 0; i < s->nlasers; i++) {
+        ls.target[i] = laser_exit(s, &t, i);
+        ls.pending[i] = i;
+    }
+    ls.minballs = params->minballs;
+    ls.maxballs = params->maxballs;
+    ls.nballs = 0;
+    ls.nundecided = s->w * s->h;
+    ls.nodes = 0;
+
+    ret = (count_layouts(&ls, s->nlasers) == 1);
+
+    sfree(ls.target);
+    sfree(ls.pending);
+    sfree(s->grid);
+    sfree(s);
+    return ret;
+}
+
 #define TILE_SIZE (ds->tilesize)
 
 #define TODRAW(x) ((TILE_SIZE * (x)) + (TILE_SIZE / 2))
@@ -1025,6 +1257,7 @@ static game_state *execute_move(const game_state *from, const char *move)
         sscanf(move+1, "%d,%d", &gx, &gy);
         if (gx < 1 || gy < 1 || gx > ret->w || gy > ret->h)
             goto badmove;
+        guess_toggled(ret, gx, gy);
         if (GRID(ret, gx, gy) & BALL_GUESS) {
             ret->nguesses--;
             GRID(ret, gx, gy) &= ~BALL_GUESS;
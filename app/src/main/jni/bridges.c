@@ -133,8 +133,14 @@ struct game_params {
 typedef unsigned int grid_type; /* change me later if we invent > 16 bits of flags. */
 
 struct solver_state {
-    int *dsf, *comptspaces;
-    int *tmpdsf, *tmpcompspaces;
+    udsf *dsf;
+    int *comptspaces, *tmpcompspaces;
+    /* Per square, the island at the top/left end of the vertical or
+     * horizontal run of empty squares through it, or -1. */
+    int *runv, *runh;
+    /* Per island, whether island_impossible holds, and how many do. */
+    unsigned char *impossible;
+    int nimpossible;
     int refcount;
 };
 
@@ -246,9 +252,11 @@ static char *game_text_format(const game_state *state)
 
 static void debug_state(game_state *state)
 {
+#ifdef DEBUGGING
     char *textversion = game_text_format(state);
     debug(("%s", textversion));
     sfree(textversion);
+#endif
 }
 
 /*static void debug_possibles(game_state *state)
@@ -1021,6 +1029,59 @@ static void map_update_possibles(game_state *state)
     }
 }
 
+/* Refreshes the possibles along the run of empty squares after is_s in
+ * direction (dx,dy), which must end at another island. */
+static void map_update_run(game_state *state, struct island *is_s,
+                           int dx, int dy)
+{
+    int x = is_s->x + dx, y = is_s->y + dy, maxb, np, bl = 0;
+    grid_type block = dx ? (G_LINEV|G_NOLINEH) : (G_LINEH|G_NOLINEV);
+    struct island *is_f;
+
+    maxb = min(is_s->count, state->maxb);
+    while (!(is_f = INDEX(state, gridi, x, y))) {
+        maxb = min(maxb, MAXIMUM(state, dx, x, y));
+        if (GRID(state, x, y) & block) bl = 1;
+        x += dx; y += dy;
+        assert(INGRID(state, x, y));
+    }
+    np = bl ? 0 : min(maxb, is_f->count);
+
+    for (x = is_s->x + dx, y = is_s->y + dy; INDEX(state, gridi, x, y) != is_f;
+         x += dx, y += dy) {
+        if (dx)
+            INDEX(state, possh, x, y) = np;
+        else
+            INDEX(state, possv, x, y) = np;
+    }
+}
+
+/* The possibles along a run depend only on the squares in it, so after
+ * joining an island in one direction it's enough to redo that run and
+ * the ones crossing it, rather than the whole of map_update_possibles. */
+static void map_update_possibles_join(struct island *is, int direction)
+{
+    game_state *state = is->state;
+    struct solver_state *ss = state->solver;
+    int dx = is->adj.points[direction].dx, dy = is->adj.points[direction].dy;
+    int off = is->adj.points[direction].off, o, r;
+
+    if (!off) return;
+    if (dx < 0 || dy < 0)
+        map_update_run(state, INDEX(state, gridi,
+                                    ISLAND_ORTHX(is, direction),
+                                    ISLAND_ORTHY(is, direction)), -dx, -dy);
+    else
+        map_update_run(state, is, dx, dy);
+
+    for (o = 1; o < off; o++) {
+        int idx = DINDEX(is->x + o*dx, is->y + o*dy);
+        r = dx ? ss->runv[idx] : ss->runh[idx];
+        if (r >= 0)
+            map_update_run(state, &state->islands[r], !dx, !dy);
+    }
+}
+
 static void map_count(game_state *state)
 {
     int i, n, ax, ay;
@@ -1044,11 +1105,34 @@ static void map_count(game_state *state)
 
 static void map_find_orthogonal(game_state *state)
 {
-    int i;
+
+    struct solver_state *ss = state->solver;
+    struct island *is;
+    int i, j, o;
 
     for (i = 0; i < state->n_islands; i++) {
         island_find_orthogonal(&state->islands[i]);
     }
+
+    /* Now the islands are fixed, note which run each square is in. */
+    ss->impossible = sresize(ss->impossible, state->n_islands, unsigned char);
+    for (i = 0; i < state->w*state->h; i++)
+        ss->runv[i] = ss->runh[i] = -1;
+    for (i = 0; i < state->n_islands; i++) {
+        is = &state->islands[i];
+        for (j = 0; j < is->adj.npoints; j++) {
+            if (is->adj.points[j].dx < 0 || is->adj.points[j].dy < 0)
+                continue;
+            for (o = 1; o < is->adj.points[j].off; o++) {
+                int idx = DINDEX(is->x + o*is->adj.points[j].dx,
+                                 is->y + o*is->adj.points[j].dy);
+                if (is->adj.points[j].dx)
+                    ss->runh[idx] = i;
+                else
+                    ss->runv[idx] = i;
+            }
+        }
+    }
 }
 
 static int grid_degree(game_state *state, int x, int y, int *nx_r, int *ny_r)
@@ -1144,13 +1228,13 @@ static int map_hasloops(game_state *state, int mark)
 
 static void map_group(game_state *state)
 {
-    int i, wh = state->w*state->h, d1, d2;
+    int i, d1, d2;
     int x, y, x2, y2;
-    int *dsf = state->solver->dsf;
+    udsf *dsf = state->solver->dsf;
     struct island *is, *is_join;
 
     /* Initialise dsf. */
-    dsf_init(dsf, wh);
+    udsf_init(dsf);
 
     /* For each island, find connected islands right or down
      * and merge the dsf for the island squares as well as the
@@ -1171,7 +1255,7 @@ static void map_group(game_state *state)
                 if (!is_join) continue;
 
                 d2 = DINDEX(is_join->x, is_join->y);
-                if (dsf_canonify(dsf,d1) == dsf_canonify(dsf,d2)) {
+                if (udsf_canonify(dsf,d1) == udsf_canonify(dsf,d2)) {
                     ; /* we have a loop. See comment in map_hasloops. */
                     /* However, we still want to merge all squares joining
                      * this side-that-makes-a-loop. */
@@ -1180,7 +1264,7 @@ static void map_group(game_state *state)
                 for (x2 = x; x2 <= is_join->x; x2++) {
                     for (y2 = y; y2 <= is_join->y; y2++) {
                         d2 = DINDEX(x2,y2);
-                        if (d1 != d2) dsf_merge(dsf,d1,d2);
+                        if (d1 != d2) udsf_merge(dsf,d1,d2);
                     }
                 }
             }
@@ -1191,13 +1275,14 @@ static void map_group(game_state *state)
 static int map_group_check(game_state *state, int canon, int warn,
                            int *nislands_r)
 {
-    int *dsf = state->solver->dsf, nislands = 0;
+    udsf *dsf = state->solver->dsf;
+    int nislands = 0;
     int x, y, i, allfull = 1;
     struct island *is;
 
     for (i = 0; i < state->n_islands; i++) {
         is = &state->islands[i];
-        if (dsf_canonify(dsf, DINDEX(is->x,is->y)) != canon) continue;
+        if (udsf_canonify(dsf, DINDEX(is->x,is->y)) != canon) continue;
 
         GRID(state, is->x, is->y) |= G_SWEEP;
         nislands++;
@@ -1209,7 +1294,7 @@ static int map_group_check(game_state *state, int canon, int warn,
          * Mark all squares with this dsf canon as ERR. */
         for (x = 0; x < state->w; x++) {
             for (y = 0; y < state->h; y++) {
-                if (dsf_canonify(dsf, DINDEX(x,y)) == canon) {
+                if (udsf_canonify(dsf, DINDEX(x,y)) == canon) {
                     GRID(state,x,y) |= G_WARN;
                 }
             }
@@ -1222,7 +1307,8 @@ static int map_group_check(game_state *state, int canon, int warn,
 
 static int map_group_full(game_state *state, int *ngroups_r)
 {
-    int *dsf = state->solver->dsf, ngroups = 0;
+    udsf *dsf = state->solver->dsf;
+    int ngroups = 0;
     int i, anyfull = 0;
     struct island *is;
 
@@ -1233,7 +1319,7 @@ static int map_group_full(game_state *state, int *ngroups_r)
         if (GRID(state,is->x,is->y) & G_SWEEP) continue;
 
         ngroups++;
-        if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
+        if (map_group_check(state, udsf_canonify(dsf, DINDEX(is->x,is->y)),
                             1, NULL))
             anyfull = 1;
     }
@@ -1273,10 +1359,76 @@ static void map_clear(game_state *state)
     }
 }
 
+static void solve_recheck_island(struct island *is)
+{
+    struct solver_state *ss = is->state->solver;
+    int i = is - is->state->islands, imp = island_impossible(is, 0);
+
+    if (imp != ss->impossible[i]) {
+        ss->nimpossible += imp ? 1 : -1;
+        ss->impossible[i] = imp;
+    }
+}
+
+static void solve_recheck_all(game_state *state)
+{
+    int i;
+
+    state->solver->nimpossible = 0;
+    memset(state->solver->impossible, 0, state->n_islands);
+    for (i = 0; i < state->n_islands; i++)
+        solve_recheck_island(&state->islands[i]);
+}
+
+static void solve_recheck_neighbours(struct island *is)
+{
+    int i;
+
+    solve_recheck_island(is);
+    for (i = 0; i < is->adj.npoints; i++) {
+        if (!is->adj.points[i].off) continue;
+        solve_recheck_island(INDEX(is->state, gridi,
+                                   ISLAND_ORTHX(is, i), ISLAND_ORTHY(is, i)));
+    }
+}
+
+/* A join only changes the bridge counts of the two islands and the
+ * possibles of the runs map_update_possibles_join redid, so only
+ * islands next to one of those can have become (im)possible. */
+static void solve_recheck_join(struct island *is, int direction,
+                               struct island *is_orth)
+{
+    game_state *state = is->state;
+    struct solver_state *ss = state->solver;
+    int dx = is->adj.points[direction].dx, dy = is->adj.points[direction].dy;
+    int o, j, r;
+
+    solve_recheck_neighbours(is);
+    solve_recheck_neighbours(is_orth);
+
+    for (o = 1; o < is->adj.points[direction].off; o++) {
+        int idx = DINDEX(is->x + o*dx, is->y + o*dy);
+        struct island *is_s;
+
+        r = dx ? ss->runv[idx] : ss->runh[idx];
+        if (r < 0) continue;
+        is_s = &state->islands[r];
+        solve_recheck_island(is_s);
+        for (j = 0; j < is_s->adj.npoints; j++) {
+            if (is_s->adj.points[j].dx == !dx &&
+                is_s->adj.points[j].dy == !dy)
+                solve_recheck_island(INDEX(state, gridi,
+                                           ISLAND_ORTHX(is_s, j),
+                                           ISLAND_ORTHY(is_s, j)));
+        }
+    }
+}
+
 static void solve_join(struct island *is, int direction, int n, int is_max)
 {
     struct island *is_orth;
-    int d1, d2, *dsf = is->state->solver->dsf;
+    udsf *dsf = is->state->solver->dsf;
+    int d1, d2;
     game_state *state = is->state; /* for DINDEX */
 
     is_orth = INDEX(is->state, gridi,
@@ -1286,12 +1438,14 @@ static void solve_join(struct island *is, int direction, int n, int is_max)
     /*debug(("...joining (%d,%d) to (%d,%d) with %d bridge(s).\n",
            is->x, is->y, is_orth->x, is_orth->y, n));*/
     island_join(is, is_orth, n, is_max);
+    map_update_possibles_join(is, direction);
+    solve_recheck_join(is, direction, is_orth);
 
     if (n > 0 && !is_max) {
         d1 = DINDEX(is->x, is->y);
         d2 = DINDEX(is_orth->x, is_orth->y);
-        if (dsf_canonify(dsf, d1) != dsf_canonify(dsf, d2))
-            dsf_merge(dsf, d1, d2);
+        if (udsf_canonify(dsf, d1) != udsf_canonify(dsf, d2))
+            udsf_merge(dsf, d1, d2);
     }
 }
 
@@ -1380,10 +1534,7 @@ static int solve_island_stage1(struct island *is, int *didsth_r)
             if (solve_fillone(is) > 0) didsth = 1;
         }
     }
-    if (didsth) {
-        map_update_possibles(is->state);
-        *didsth_r = 1;
-    }
+    if (didsth) *didsth_r = 1;
     return 1;
 }
 
@@ -1391,7 +1542,8 @@ static int solve_island_stage1(struct island *is, int *didsth_r)
 static int solve_island_checkloop(struct island *is, int direction)
 {
     struct island *is_orth;
-    int *dsf = is->state->solver->dsf, d1, d2;
+    udsf *dsf = is->state->solver->dsf;
+    int d1, d2;
     game_state *state = is->state;
 
     if (is->state->allowloops) return 0; /* don't care anyway */
@@ -1405,7 +1557,7 @@ static int solve_island_checkloop(struct island *is, int direction)
 
     d1 = DINDEX(is->x, is->y);
     d2 = DINDEX(is_orth->x, is_orth->y);
-    if (dsf_canonify(dsf, d1) == dsf_canonify(dsf, d2)) {
+    if (udsf_canonify(dsf, d1) == udsf_canonify(dsf, d2)) {
         /* two islands are connected already; don't join them. */
         return 1;
     }
@@ -1423,7 +1575,6 @@ static int solve_island_stage2(struct island *is, int *didsth_r)
             debug(("removing possible loop at (%d,%d) direction %d.\n",
                    is->x, is->y, i));
             solve_join(is, i, -1, 0);
-            map_update_possibles(is->state);
             removed = 1;
         } else {
             navail += island_isadj(is, i);
@@ -1454,7 +1605,6 @@ static int solve_island_stage2(struct island *is, int *didsth_r)
             }
         }
     }
-    if (added) map_update_possibles(is->state);
     if (added || removed) *didsth_r = 1;
     return 1;
 }
@@ -1462,7 +1612,8 @@ static int solve_island_stage2(struct island *is, int *didsth_r)
 static int solve_island_subgroup(struct island *is, int direction)
 {
     struct island *is_join;
-    int nislands, *dsf = is->state->solver->dsf;
+    udsf *dsf = is->state->solver->dsf;
+    int nislands;
     game_state *state = is->state;
 
     debug(("..checking subgroups.\n"));
@@ -1488,7 +1639,7 @@ static int solve_island_subgroup(struct island *is, int direction)
     }
 
     /* Check group membership for is->dsf; if it's full return 1. */
-    if (map_group_check(state, dsf_canonify(dsf, DINDEX(is->x,is->y)),
+    if (map_group_check(state, udsf_canonify(dsf, DINDEX(is->x,is->y)),
                         0, &nislands)) {
         if (nislands < state->n_islands) {
             /* we have a full subgroup that isn't the whole set.
@@ -1505,17 +1656,10 @@ static int solve_island_subgroup(struct island *is, int direction)
 
 static int solve_island_impossible(game_state *state)
 {
-    struct island *is;
-    int i;
-
-    /* If any islands are impossible, return 1. */
-    for (i = 0; i < state->n_islands; i++) {
-        is = &state->islands[i];
-        if (island_impossible(is, 0)) {
-            debug(("island at (%d,%d) has become impossible, disallowing.\n",
-                   is->x, is->y));
-            return 1;
-        }
+    /* If any islands are impossible, return 1; solve_join keeps count. */
+    if (state->solver->nimpossible > 0) {
+        debug(("an island has become impossible, disallowing.\n"));
+        return 1;
     }
     return 0;
 }
@@ -1523,8 +1667,7 @@ static int solve_island_impossible(game_state *state)
 /* Bear in mind that this function is really rather inefficient. */
 static int solve_island_stage3(struct island *is, int *didsth_r)
 {
-    int i, n, x, y, missing, spc, curr, maxb, didsth = 0;
-    int wh = is->state->w * is->state->h;
+    int i, n, x, y, missing, spc, curr, maxb, checkpoint, didsth = 0;
     struct solver_state *ss = is->state->solver;
 
     assert(didsth_r);
@@ -1546,12 +1689,11 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
         /* Now we know that this island could have more bridges,
          * to bring the total from curr+1 to curr+spc. */
         maxb = -1;
-        /* We have to squirrel the dsf away and restore it afterwards;
-         * it is additive only, and can't be removed from. */
-        memcpy(ss->tmpdsf, ss->dsf, wh*sizeof(int));
+        /* The dsf is additive only, so we have to roll it back to
+         * here afterwards. */
+        checkpoint = udsf_checkpoint(ss->dsf);
         for (n = curr+1; n <= curr+spc; n++) {
             solve_join(is, i, n, 0);
-            map_update_possibles(is->state);
 
             if (solve_island_subgroup(is, i) ||
                 solve_island_impossible(is->state)) {
@@ -1564,7 +1706,7 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
             }
         }
         solve_join(is, i, curr, 0); /* put back to before. */
-        memcpy(ss->dsf, ss->tmpdsf, wh*sizeof(int));
+        udsf_rollback(ss->dsf, checkpoint);
 
         if (maxb != -1) {
             /*debug_state(is->state);*/
@@ -1577,7 +1719,6 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
             }
             didsth = 1;
         }
-        map_update_possibles(is->state);
     }
 
     for (i = 0; i < is->adj.npoints; i++) {
@@ -1633,7 +1774,7 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
                                   is->adj.points[j].dx ? G_LINEH : G_LINEV);
         if (before[i] != 0) continue;  /* this idea is pointless otherwise */
 
-        memcpy(ss->tmpdsf, ss->dsf, wh*sizeof(int));
+        checkpoint = udsf_checkpoint(ss->dsf);
 
         for (j = 0; j < is->adj.npoints; j++) {
             spc = island_adjspace(is, 1, missing, j);
@@ -1641,14 +1782,13 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
             if (j == i) continue;
             solve_join(is, j, before[j] + spc, 0);
         }
-        map_update_possibles(is->state);
 
         if (solve_island_subgroup(is, -1))
             got = 1;
 
         for (j = 0; j < is->adj.npoints; j++)
             solve_join(is, j, before[j], 0);
-        memcpy(ss->dsf, ss->tmpdsf, wh*sizeof(int));
+        udsf_rollback(ss->dsf, checkpoint);
 
         if (got) {
             debug(("island at (%d,%d) must connect in direction (%d,%d) to"
@@ -1657,8 +1797,6 @@ static int solve_island_stage3(struct island *is, int *didsth_r)
             solve_join(is, i, 1, 0);
             didsth = 1;
         }
-
-        map_update_possibles(is->state);
     }
 
     if (didsth) *didsth_r = didsth;
@@ -1676,6 +1814,8 @@ static int solve_sub(game_state *state, int difficulty, int depth)
     struct island *is;
     int i, didsth;
 
+    solve_recheck_all(state);
+
     while (1) {
         didsth = 0;
 
@@ -1768,8 +1908,11 @@ static game_state *new_state(const game_params *params)
     ret->solved = ret->completed = 0;
 
     ret->solver = snew(struct solver_state);
-    ret->solver->dsf = snew_dsf(wh);
-    ret->solver->tmpdsf = snewn(wh, int);
+    ret->solver->dsf = udsf_new(wh);
+    ret->solver->runv = snewn(wh, int);
+    ret->solver->runh = snewn(wh, int);
+    ret->solver->impossible = NULL;
+    ret->solver->nimpossible = 0;
 
     ret->solver->refcount = 1;
 
@@ -1820,8 +1963,10 @@ static game_state *dup_game(const game_state *state)
 static void free_game(game_state *state)
 {
     if (--state->solver->refcount <= 0) {
-        sfree(state->solver->dsf);
-        sfree(state->solver->tmpdsf);
+        udsf_free(state->solver->dsf);
+        sfree(state->solver->runv);
+        sfree(state->solver->runh);
+        sfree(state->solver->impossible);
         sfree(state->solver);
     }
 
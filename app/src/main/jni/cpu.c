@@ -0,0 +1,157 @@
+/*
+ * cpu.c: run-time CPU feature detection, and kernels shared between
+ * games that have tuned versions chosen by it.
+ *
+ * Each tuned kernel is the generic one's body (an always-inline
+ * function) compiled again with a target attribute, so the two can't
+ * drift apart; a function pointer starts at a chooser, which the first
+ * call replaces with the best version, as SHATransform does.
+ */
+
+#include <string.h>
+
+#include "puzzles.h"
+
+#ifdef CPU_DISPATCH
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static unsigned cpu_detect(void)
+{
+    unsigned features = 0;
+
+#ifdef CPU_DISPATCH
+#if defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+
+    if (hwcap & HWCAP_SHA1)
+        features |= CPU_ARM_SHA1;
+#else
+    unsigned a, b, c, d, max = __get_cpuid_max(0, NULL);
+
+    if (max >= 1 && __get_cpuid(1, &a, &b, &c, &d)) {
+        if (c & (1 << 23))
+            features |= CPU_X86_POPCNT;
+        if (c & (1 << 19))
+            features |= CPU_X86_SSE41;
+        /*
+         * AVX2 also needs the OS to save the upper halves of the
+         * registers on a context switch, which XGETBV tells us.
+         */
+        if (max >= 7 && (c & (1 << 27)) && (c & (1 << 28))) {
+            unsigned lo, hi;
+            __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((lo & 6) == 6 && (b & (1 << 5)))
+                features |= CPU_X86_AVX2;
+        }
+        if (max >= 7) {
+            __cpuid_count(7, 0, a, b, c, d);
+            if (b & (1 << 29))
+                features |= CPU_X86_SHA;
+        }
+    }
+#endif
+#endif
+
+    return features;
+}
+
+/*
+ * Worked out on first use. Threads racing to do it all get the same
+ * answer, so they can't disagree about it.
+ */
+unsigned cpu_features(void)
+{
+    static volatile int known = FALSE;
+    static volatile unsigned features;
+
+    if (!known) {
+        features = cpu_detect();
+        known = TRUE;
+    }
+    return features;
+}
+
+/* ----------------------------------------------------------------------
+ * Set elimination: count up through 2^n candidate sets, each needing
+ * a popcount and a pass over the rows. Without POPCNT (not in the
+ * 32-bit x86 ABI) the popcount is a libgcc call.
+ */
+CPU_INLINE int bitset_find_set_body(const unsigned long *rowmask, int n,
+                         unsigned long *setp)
+{
+    unsigned long set = *setp;
+    unsigned long all = n ? ((1UL << (n-1)) << 1) - 1 : 0;
+    int i;
+
+    for (;; set++) {
+#ifdef __GNUC__
+        int count = __builtin_popcountl(set);
+#else
+        int count = 0;
+        unsigned long m;
+        for (m = set; m; m &= m - 1)
+            count++;
+#endif
+
+        if (count > 1 && count < n-1) {
+            int rows = 0;
+            for (i = 0; i < n; i++)
+                if (!(rowmask[i] & set))
+                    rows++;
+            if (rows >= n - count) {
+                *setp = set;
+                return count;
+            }
+        }
+
+        if (set == all)
+            return 0;
+    }
+}
+
+static int bitset_find_set_c(const unsigned long *rowmask, int n,
+                             unsigned long *set)
+{
+    return bitset_find_set_body(rowmask, n, set);
+}
+
+#if defined(CPU_DISPATCH) && !defined(__aarch64__)
+__attribute__((target("popcnt")))
+static int bitset_find_set_popcnt(const unsigned long *rowmask, int n,
+                                  unsigned long *set)
+{
+    return bitset_find_set_body(rowmask, n, set);
+}
+#endif
+
+static int bitset_find_set_choose(const unsigned long *rowmask, int n,
+                                  unsigned long *set);
+static int (*bitset_find_set_fn)(const unsigned long *, int,
+                                 unsigned long *) = bitset_find_set_choose;
+
+static int bitset_find_set_choose(const unsigned long *rowmask, int n,
+                                  unsigned long *set)
+{
+    int (*chosen)(const unsigned long *, int, unsigned long *) =
+        bitset_find_set_c;
+
+#if defined(CPU_DISPATCH) && !defined(__aarch64__)
+    if (cpu_features() & CPU_X86_POPCNT)
+        chosen = bitset_find_set_popcnt;
+#endif
+
+    bitset_find_set_fn = chosen;
+    return chosen(rowmask, n, set);
+}
+
+int bitset_find_set(const unsigned long *rowmask, int n, unsigned long *set)
+{
+    return bitset_find_set_fn(rowmask, n, set);
+}
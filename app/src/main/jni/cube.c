@@ -194,11 +194,42 @@ struct game_params {
     int d1, d2;
 };
 
+struct bbox {
+    float l, r, u, d;
+};
+
+/*
+ * The result of rolling the polyhedron off a grid square in one of
+ * the four orthogonal directions. The polyhedron is always drawn in
+ * the same orientation on any square (up to the flip on a down-
+ * pointing triangle), so rolling it just permutes which face has
+ * which colour; that's all execute_move needs, and the rest is for
+ * animating the roll.
+ */
+struct roll {
+    int dest;                          /* -1 if we can't roll that way */
+    const int *perm;                   /* new colour i = old colour perm[i] */
+    int skey[2], pkey[2];              /* as sgkey and spkey in game_state */
+    float angle;
+};
+
+#define ROLL_UNKNOWN (-2)              /* roll not worked out yet */
+
 typedef struct game_grid game_grid;
 struct game_grid {
     int refcount;
     struct grid_square *squares;
     int nsquares;
+    /*
+     * Geometry worked out once per grid rather than on every move or
+     * redraw. Rolls (four per square) are filled in the first time
+     * they're needed; see get_roll().
+     */
+    struct roll *rolls;
+    int *perms;                        /* nfaces per roll */
+    int *dpkeys;                       /* two per square, as dpkey */
+    int lowest;                        /* face of the solid on the grid */
+    struct bbox bb;
 };
 
 #define SET_SQUARE(state, i, val) \
@@ -222,6 +253,8 @@ struct game_state {
     float angle;
     int completed;
     int movecount;
+    int used_solve;
+    char *solvepath;                   /* moves, if reached by a solve */
 };
 
 static game_params *default_params(void)
@@ -846,6 +879,81 @@ static struct solid *transform_poly(const struct solid *solid, int flip,
     return ret;
 }
 
+static void find_bbox_callback(void *ctx, struct grid_square *sq)
+{
+    struct bbox *bb = (struct bbox *)ctx;
+    int i;
+
+    for (i = 0; i < sq->npoints; i++) {
+        if (bb->l > sq->points[i*2]) bb->l = sq->points[i*2];
+        if (bb->r < sq->points[i*2]) bb->r = sq->points[i*2];
+        if (bb->u > sq->points[i*2+1]) bb->u = sq->points[i*2+1];
+        if (bb->d < sq->points[i*2+1]) bb->d = sq->points[i*2+1];
+    }
+}
+
+static struct bbox find_bbox(const game_params *params)
+{
+    struct bbox bb;
+
+    /*
+     * These should be hugely more than the real bounding box will
+     * be.
+     */
+    bb.l = 2.0F * (params->d1 + params->d2);
+    bb.r = -2.0F * (params->d1 + params->d2);
+    bb.u = 2.0F * (params->d1 + params->d2);
+    bb.d = -2.0F * (params->d1 + params->d2);
+    enum_grid_squares(params, find_bbox_callback, &bb);
+
+    return bb;
+}
+
+static game_grid *new_grid(const game_params *params,
+                           const struct solid *solid)
+{
+    game_grid *grid = snew(game_grid);
+    int area, i, ret;
+
+    area = grid_area(params->d1, params->d2, solid->order);
+    grid->squares = snewn(area, struct grid_square);
+    grid->nsquares = 0;
+    enum_grid_squares(params, add_grid_square_callback, grid);
+    assert(grid->nsquares == area);
+    grid->refcount = 1;
+
+    grid->rolls = snewn(area * 4, struct roll);
+    for (i = 0; i < area * 4; i++)
+        grid->rolls[i].dest = ROLL_UNKNOWN;
+    grid->perms = snewn(area * 4 * solid->nfaces, int);
+
+    grid->dpkeys = snewn(area * 2, int);
+    for (i = 0; i < area; i++) {
+        int pkey[4];
+
+        ret = align_poly(solid, &grid->squares[i], pkey);
+        assert(ret);
+        grid->dpkeys[i*2] = pkey[0];
+        grid->dpkeys[i*2+1] = pkey[1];
+    }
+
+    grid->lowest = lowest_face(solid);
+    grid->bb = find_bbox(params);
+
+    return grid;
+}
+
+static void free_grid(game_grid *grid)
+{
+    if (--grid->refcount <= 0) {
+        sfree(grid->squares);
+        sfree(grid->rolls);
+        sfree(grid->perms);
+        sfree(grid->dpkeys);
+        sfree(grid);
+    }
+}
+
 static char *validate_desc(const game_params *params, const char *desc)
 {
     int area = grid_area(params->d1, params->d2, solids[params->solid]->order);
@@ -884,20 +992,11 @@ static void android_request_keys(const game_params *params)
 static game_state *new_game(midend *me, const game_params *params,
                             const char *desc)
 {
-    game_grid *grid = snew(game_grid);
     game_state *state = snew(game_state);
-    int area;
 
     state->params = *params;           /* structure copy */
     state->solid = solids[params->solid];
-
-    area = grid_area(params->d1, params->d2, state->solid->order);
-    grid->squares = snewn(area, struct grid_square);
-    grid->nsquares = 0;
-    enum_grid_squares(params, add_grid_square_callback, grid);
-    assert(grid->nsquares == area);
-    state->grid = grid;
-    grid->refcount = 1;
+    state->grid = new_grid(params, state->solid);
 
     state->facecolours = snewn(state->solid->nfaces, int);
     memset(state->facecolours, 0, state->solid->nfaces * sizeof(int));
@@ -944,26 +1043,20 @@ static game_state *new_game(midend *me, const game_params *params,
     }
 
     /*
-     * Align the polyhedron with its grid square and determine
-     * initial key points.
+     * Initial key points, from aligning the polyhedron with its grid
+     * square.
      */
-    {
-        int pkey[4];
-        int ret;
-
-        ret = align_poly(state->solid, &state->grid->squares[state->current], pkey);
-        assert(ret);
-
-        state->dpkey[0] = state->spkey[0] = pkey[0];
-        state->dpkey[1] = state->spkey[0] = pkey[1];
-        state->dgkey[0] = state->sgkey[0] = 0;
-        state->dgkey[1] = state->sgkey[0] = 1;
-    }
+    state->dpkey[0] = state->spkey[0] = state->grid->dpkeys[state->current*2];
+    state->dpkey[1] = state->spkey[1] = state->grid->dpkeys[state->current*2+1];
+    state->dgkey[0] = state->sgkey[0] = 0;
+    state->dgkey[1] = state->sgkey[1] = 1;
 
     state->previous = state->current;
     state->angle = 0.0;
     state->completed = 0;
     state->movecount = 0;
+    state->used_solve = FALSE;
+    state->solvepath = NULL;
 
     return state;
 }
@@ -995,27 +1088,21 @@ static game_state *dup_game(const game_state *state)
     ret->angle = state->angle;
     ret->completed = state->completed;
     ret->movecount = state->movecount;
+    ret->used_solve = state->used_solve;
+    ret->solvepath = NULL;
 
     return ret;
 }
 
 static void free_game(game_state *state)
 {
-    if (--state->grid->refcount <= 0) {
-	sfree(state->grid->squares);
-	sfree(state->grid);
-    }
+    free_grid(state->grid);
+    sfree(state->solvepath);
     sfree(state->bluemask);
     sfree(state->facecolours);
     sfree(state);
 }
 
-static char *solve_game(const game_state *state, const game_state *currstate,
-                        const char *aux, char **error)
-{
-    return NULL;
-}
-
 static int game_can_format_as_text_now(const game_params *params)
 {
     return TRUE;
@@ -1048,7 +1135,8 @@ static void game_changed_state(game_ui *ui, const game_state *oldstate,
                                const game_state *newstate)
 {
 #ifdef ANDROID
-    if (newstate->completed && oldstate && ! oldstate->completed) android_completed();
+    if (newstate->completed && oldstate && ! oldstate->completed &&
+	! newstate->used_solve) android_completed();
 #endif
 }
 
@@ -1058,11 +1146,13 @@ struct game_drawstate {
 };
 
 /*
- * Code shared between interpret_move() and execute_move().
+ * Find the square we'd roll on to from a given one, and the two key
+ * points the squares share (as indices into each square's points).
  */
-static int find_move_dest(const game_state *from, int direction,
+static int find_move_dest(const game_grid *grid, int square, int direction,
 			  int *skey, int *dkey)
 {
+    const struct grid_square *sq = &grid->squares[square];
     int mask, dest, i, j;
     float points[4];
 
@@ -1070,13 +1160,13 @@ static int find_move_dest(const game_state *from, int direction,
      * Find the two points in the current grid square which
      * correspond to this move.
      */
-    mask = from->grid->squares[from->current].directions[direction];
+    mask = sq->directions[direction];
     if (mask == 0)
         return -1;
-    for (i = j = 0; i < from->grid->squares[from->current].npoints; i++)
+    for (i = j = 0; i < sq->npoints; i++)
         if (mask & (1 << i)) {
-            points[j*2] = from->grid->squares[from->current].points[i*2];
-            points[j*2+1] = from->grid->squares[from->current].points[i*2+1];
+            points[j*2] = sq->points[i*2];
+            points[j*2+1] = sq->points[i*2+1];
             skey[j] = i;
             j++;
         }
@@ -1087,18 +1177,18 @@ static int find_move_dest(const game_state *from, int direction,
      * This is our move destination.
      */
     dest = -1;
-    for (i = 0; i < from->grid->nsquares; i++)
-        if (i != from->current) {
+    for (i = 0; i < grid->nsquares; i++)
+        if (i != square) {
             int match = 0;
             float dist;
 
-            for (j = 0; j < from->grid->squares[i].npoints; j++) {
-                dist = (SQ(from->grid->squares[i].points[j*2] - points[0]) +
-                        SQ(from->grid->squares[i].points[j*2+1] - points[1]));
+            for (j = 0; j < grid->squares[i].npoints; j++) {
+                dist = (SQ(grid->squares[i].points[j*2] - points[0]) +
+                        SQ(grid->squares[i].points[j*2+1] - points[1]));
                 if (dist < 0.1)
                     dkey[match++] = j;
-                dist = (SQ(from->grid->squares[i].points[j*2] - points[2]) +
-                        SQ(from->grid->squares[i].points[j*2+1] - points[3]));
+                dist = (SQ(grid->squares[i].points[j*2] - points[2]) +
+                        SQ(grid->squares[i].points[j*2+1] - points[3]));
                 if (dist < 0.1)
                     dkey[match++] = j;
             }
@@ -1112,12 +1202,167 @@ static int find_move_dest(const game_state *from, int direction,
     return dest;
 }
 
+static void work_out_roll(const struct solid *solid, game_grid *grid,
+                          int square, int direction, struct roll *r)
+{
+    struct grid_square *from = &grid->squares[square];
+    struct solid *poly;
+    int *perm = grid->perms + (square*4 + direction) * solid->nfaces;
+    int dkey[2];
+    int i, j;
+    float angle;
+
+    r->perm = perm;
+    r->dest = find_move_dest(grid, square, direction, r->skey, dkey);
+    if (r->dest < 0)
+        return;
+
+    /*
+     * So we know what grid square we're aiming for, and we also
+     * know the two key points (as indices in both the source and
+     * destination grid squares) which are invariant between source
+     * and destination.
+     * 
+     * Next we must roll the polyhedron on to that square. So we
+     * find the indices of the key points within the polyhedron's
+     * vertex array, then use those in a call to transform_poly,
+     * and align the result on the new grid square.
+     */
+    {
+        int all_pkey[4];
+        align_poly(solid, from, all_pkey);
+        r->pkey[0] = all_pkey[r->skey[0]];
+        r->pkey[1] = all_pkey[r->skey[1]];
+        /*
+         * Now pkey[0] corresponds to skey[0] and dkey[0], and
+         * likewise [1].
+         */
+    }
+
+    /*
+     * Now find the angle through which to rotate the polyhedron.
+     * Do this by finding the two faces that share the two vertices
+     * we've found, and taking the dot product of their normals.
+     */
+    {
+        int f[2], nf = 0;
+        float dp;
+
+        for (i = 0; i < solid->nfaces; i++) {
+            int match = 0;
+            for (j = 0; j < solid->order; j++)
+                if (solid->faces[i*solid->order + j] == r->pkey[0] ||
+                    solid->faces[i*solid->order + j] == r->pkey[1])
+                    match++;
+            if (match == 2) {
+                assert(nf < 2);
+                f[nf++] = i;
+            }
+        }
+
+        assert(nf == 2);
+
+        dp = 0;
+        for (i = 0; i < 3; i++)
+            dp += (solid->normals[f[0]*3+i] *
+                   solid->normals[f[1]*3+i]);
+        angle = (float)acos(dp);
+    }
+
+    /*
+     * Now transform the polyhedron. We aren't entirely sure
+     * whether we need to rotate through angle or -angle, and the
+     * simplest way round this is to try both and see which one
+     * aligns successfully!
+     * 
+     * Unfortunately, _both_ will align successfully if this is a
+     * cube, which won't tell us anything much. So for that
+     * particular case, I resort to gross hackery: I simply negate
+     * the angle before trying the alignment, depending on the
+     * direction. Which directions work which way is determined by
+     * pure trial and error. I said it was gross :-/
+     */
+    {
+        int all_pkey[4];
+        int success;
+
+        if (solid->order == 4 && direction == UP)
+            angle = -angle;            /* HACK */
+
+        poly = transform_poly(solid, from->flip,
+                              r->pkey[0], r->pkey[1], angle);
+        flip_poly(poly, grid->squares[r->dest].flip);
+        success = align_poly(poly, &grid->squares[r->dest], all_pkey);
+
+        if (!success) {
+            sfree(poly);
+            angle = -angle;
+            poly = transform_poly(solid, from->flip,
+                                  r->pkey[0], r->pkey[1], angle);
+            flip_poly(poly, grid->squares[r->dest].flip);
+            success = align_poly(poly, &grid->squares[r->dest], all_pkey);
+        }
+
+        assert(success);
+    }
+    r->angle = angle;
+
+    /*
+     * Now we have our rotated polyhedron, which we expect to be
+     * exactly congruent to the one we started with - but with the
+     * faces permuted. So we map that congruence and thereby figure
+     * out how to permute the faces as a result of the polyhedron
+     * having rolled.
+     */
+    for (i = 0; i < solid->nfaces; i++) {
+        int nmatch = 0;
+
+        /*
+         * Now go through the transformed polyhedron's faces
+         * and figure out which one's normal is approximately
+         * equal to this one.
+         */
+        for (j = 0; j < poly->nfaces; j++) {
+            float dist;
+            int k;
+
+            dist = 0;
+
+            for (k = 0; k < 3; k++)
+                dist += SQ(poly->normals[j*3+k] - solid->normals[i*3+k]);
+
+            if (APPROXEQ(dist, 0)) {
+                nmatch++;
+                perm[i] = j;
+            }
+        }
+
+        assert(nmatch == 1);
+    }
+
+    sfree(poly);
+}
+
+/*
+ * Rolls come from a table in the (shared) grid, each worked out from
+ * the geometry the first time it's needed.
+ */
+static const struct roll *get_roll(const game_state *state, int square,
+                                   int direction)
+{
+    struct roll *r = &state->grid->rolls[square*4 + direction];
+
+    assert(direction >= LEFT && direction <= DOWN);
+    if (r->dest == ROLL_UNKNOWN)
+        work_out_roll(state->solid, state->grid, square, direction, r);
+    return r;
+}
+
 static char *interpret_move(const game_state *state, game_ui *ui,
                             const game_drawstate *ds,
                             int x, int y, int button)
 {
     int direction, mask, i;
-    int skey[2], dkey[2];
 
     button = button & (~MOD_MASK | MOD_NUM_KEYPAD);
 
@@ -1223,7 +1468,7 @@ static char *interpret_move(const game_state *state, game_ui *ui,
 	assert(direction <= DOWN);
     }
 
-    if (find_move_dest(state, direction, skey, dkey) < 0)
+    if (get_roll(state, state->current, direction)->dest < 0)
 	return NULL;
 
     if (direction == LEFT)  return dupstr("L");
@@ -1234,168 +1479,23 @@ static char *interpret_move(const game_state *state, game_ui *ui,
     return NULL;		       /* should never happen */
 }
 
-static game_state *execute_move(const game_state *from, const char *move)
+static game_state *roll_once(const game_state *from, int direction)
 {
+    const struct roll *r = get_roll(from, from->current, direction);
     game_state *ret;
-    float angle;
-    struct solid *poly;
-    int pkey[2];
-    int skey[2], dkey[2];
-    int i, j, dest;
-    int direction;
-
-    switch (*move) {
-      case 'L': direction = LEFT; break;
-      case 'R': direction = RIGHT; break;
-      case 'U': direction = UP; break;
-      case 'D': direction = DOWN; break;
-      default: return NULL;
-    }
+    int i, j;
 
-    dest = find_move_dest(from, direction, skey, dkey);
-    if (dest < 0)
+    if (r->dest < 0)
         return NULL;
 
     ret = dup_game(from);
-    ret->current = dest;
-
-    /*
-     * So we know what grid square we're aiming for, and we also
-     * know the two key points (as indices in both the source and
-     * destination grid squares) which are invariant between source
-     * and destination.
-     * 
-     * Next we must roll the polyhedron on to that square. So we
-     * find the indices of the key points within the polyhedron's
-     * vertex array, then use those in a call to transform_poly,
-     * and align the result on the new grid square.
-     */
-    {
-        int all_pkey[4];
-        align_poly(from->solid, &from->grid->squares[from->current], all_pkey);
-        pkey[0] = all_pkey[skey[0]];
-        pkey[1] = all_pkey[skey[1]];
-        /*
-         * Now pkey[0] corresponds to skey[0] and dkey[0], and
-         * likewise [1].
-         */
-    }
-
-    /*
-     * Now find the angle through which to rotate the polyhedron.
-     * Do this by finding the two faces that share the two vertices
-     * we've found, and taking the dot product of their normals.
-     */
-    {
-        int f[2], nf = 0;
-        float dp;
-
-        for (i = 0; i < from->solid->nfaces; i++) {
-            int match = 0;
-            for (j = 0; j < from->solid->order; j++)
-                if (from->solid->faces[i*from->solid->order + j] == pkey[0] ||
-                    from->solid->faces[i*from->solid->order + j] == pkey[1])
-                    match++;
-            if (match == 2) {
-                assert(nf < 2);
-                f[nf++] = i;
-            }
-        }
-
-        assert(nf == 2);
-
-        dp = 0;
-        for (i = 0; i < 3; i++)
-            dp += (from->solid->normals[f[0]*3+i] *
-                   from->solid->normals[f[1]*3+i]);
-        angle = (float)acos(dp);
-    }
-
-    /*
-     * Now transform the polyhedron. We aren't entirely sure
-     * whether we need to rotate through angle or -angle, and the
-     * simplest way round this is to try both and see which one
-     * aligns successfully!
-     * 
-     * Unfortunately, _both_ will align successfully if this is a
-     * cube, which won't tell us anything much. So for that
-     * particular case, I resort to gross hackery: I simply negate
-     * the angle before trying the alignment, depending on the
-     * direction. Which directions work which way is determined by
-     * pure trial and error. I said it was gross :-/
-     */
-    {
-        int all_pkey[4];
-        int success;
-
-        if (from->solid->order == 4 && direction == UP)
-            angle = -angle;            /* HACK */
-
-        poly = transform_poly(from->solid,
-                              from->grid->squares[from->current].flip,
-                              pkey[0], pkey[1], angle);
-        flip_poly(poly, from->grid->squares[ret->current].flip);
-        success = align_poly(poly, &from->grid->squares[ret->current], all_pkey);
-
-        if (!success) {
-            sfree(poly);
-            angle = -angle;
-            poly = transform_poly(from->solid,
-                                  from->grid->squares[from->current].flip,
-                                  pkey[0], pkey[1], angle);
-            flip_poly(poly, from->grid->squares[ret->current].flip);
-            success = align_poly(poly, &from->grid->squares[ret->current], all_pkey);
-        }
-
-        assert(success);
-    }
+    ret->current = r->dest;
 
     /*
-     * Now we have our rotated polyhedron, which we expect to be
-     * exactly congruent to the one we started with - but with the
-     * faces permuted. So we map that congruence and thereby figure
-     * out how to permute the faces as a result of the polyhedron
-     * having rolled.
+     * Permute the face colours as the polyhedron rolls.
      */
-    {
-        int *newcolours = snewn(from->solid->nfaces, int);
-
-        for (i = 0; i < from->solid->nfaces; i++)
-            newcolours[i] = -1;
-
-        for (i = 0; i < from->solid->nfaces; i++) {
-            int nmatch = 0;
-
-            /*
-             * Now go through the transformed polyhedron's faces
-             * and figure out which one's normal is approximately
-             * equal to this one.
-             */
-            for (j = 0; j < poly->nfaces; j++) {
-                float dist;
-                int k;
-
-                dist = 0;
-
-                for (k = 0; k < 3; k++)
-                    dist += SQ(poly->normals[j*3+k] -
-                               from->solid->normals[i*3+k]);
-
-                if (APPROXEQ(dist, 0)) {
-                    nmatch++;
-                    newcolours[i] = ret->facecolours[j];
-                }
-            }
-
-            assert(nmatch == 1);
-        }
-
-        for (i = 0; i < from->solid->nfaces; i++)
-            assert(newcolours[i] != -1);
-
-        sfree(ret->facecolours);
-        ret->facecolours = newcolours;
-    }
+    for (i = 0; i < from->solid->nfaces; i++)
+        ret->facecolours[i] = from->facecolours[r->perm[i]];
 
     ret->movecount++;
 
@@ -1408,7 +1508,7 @@ static game_state *execute_move(const game_state *from, const char *move)
      * grid as a feeble reward.
      */
     if (!ret->completed) {
-        i = lowest_face(from->solid);
+        i = ret->grid->lowest;
         j = ret->facecolours[i];
         ret->facecolours[i] = GET_SQUARE(ret, ret->current);
         SET_SQUARE(ret, ret->current, j);
@@ -1426,74 +1526,386 @@ static game_state *execute_move(const game_state *from, const char *move)
 
     }
 
-    sfree(poly);
-
     /*
-     * Align the normal polyhedron with its grid square, to get key
-     * points for non-animated display.
+     * Key points for non-animated display come straight from the
+     * normal polyhedron aligned with its grid square.
      */
-    {
-        int pkey[4];
-        int success;
+    ret->dpkey[0] = ret->grid->dpkeys[ret->current*2];
+    ret->dpkey[1] = ret->grid->dpkeys[ret->current*2+1];
+    ret->dgkey[0] = 0;
+    ret->dgkey[1] = 1;
+
+    ret->spkey[0] = r->pkey[0];
+    ret->spkey[1] = r->pkey[1];
+    ret->sgkey[0] = r->skey[0];
+    ret->sgkey[1] = r->skey[1];
+    ret->previous = from->current;
+    ret->angle = r->angle;
 
-        success = align_poly(ret->solid, &ret->grid->squares[ret->current], pkey);
-        assert(success);
+    return ret;
+}
 
-        ret->dpkey[0] = pkey[0];
-        ret->dpkey[1] = pkey[1];
-        ret->dgkey[0] = 0;
-        ret->dgkey[1] = 1;
+static int move_direction(char c)
+{
+    switch (c) {
+      case 'L': return LEFT;
+      case 'R': return RIGHT;
+      case 'U': return UP;
+      case 'D': return DOWN;
+      default: return -1;
     }
+}
+
+static game_state *execute_move(const game_state *from, const char *move)
+{
+    game_state *ret, *next;
+    const char *p;
+    int direction;
 
+    if (move[0] == 'S') {
+        /*
+         * A solve: a sequence of rolls, all made in one go.
+         */
+        ret = dup_game(from);
+        for (p = move+1; *p; p++) {
+            direction = move_direction(*p);
+            next = (direction < 0 ? NULL : roll_once(ret, direction));
+            free_game(ret);
+            if (!next)
+                return NULL;
+            ret = next;
+        }
+        ret->used_solve = TRUE;
+        ret->solvepath = dupstr(move+1);
+        return ret;
+    }
 
-    ret->spkey[0] = pkey[0];
-    ret->spkey[1] = pkey[1];
-    ret->sgkey[0] = skey[0];
-    ret->sgkey[1] = skey[1];
-    ret->previous = from->current;
-    ret->angle = angle;
+    direction = move_direction(move[0]);
+    if (direction < 0 || move[1])
+        return NULL;
 
-    return ret;
+    return roll_once(from, direction);
 }
 
 /* ----------------------------------------------------------------------
- * Drawing routines.
+ * Solver.
+ *
+ * Once the rolls are tabulated, the whole game is a walk over
+ * (current square, set of blue faces, set of blue squares), which
+ * for the smaller grids packs comfortably into 64 bits: the grid's
+ * blue squares in the bottom nsquares bits, then the blue faces,
+ * then the current square.
+ *
+ * We breadth-first search that space from both ends at once:
+ * forwards from the current position, and backwards (unrolling the
+ * polyhedron) from every position with all its faces blue. Solutions
+ * to the bigger puzzles can be a couple of dozen rolls long, which is
+ * well out of reach of a one-sided search.
  */
 
-struct bbox {
-    float l, r, u, d;
+#define SOLVE_MAX_STATES 2000000
+
+struct bfs {
+    unsigned long long *keys;          /* state keys in BFS order */
+    int *link;                         /* parent (forwards) or successor */
+    char *moves;                       /* roll joining a state to its link */
+    int nstates, statesize;
+    int head;                          /* next state to expand */
+    int *hash;                         /* open addressing into keys[] */
+    int hashsize;
 };
 
-static void find_bbox_callback(void *ctx, struct grid_square *sq)
+struct solver {
+    const game_state *state;
+    int nsquares, nfaces;
+    int *preds, *npreds;               /* rolls arriving at each square */
+    struct bfs sides[2];               /* forwards, backwards */
+};
+
+static unsigned solver_hashval(unsigned long long key)
 {
-    struct bbox *bb = (struct bbox *)ctx;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(key >> 32);
+}
+
+static void bfs_rehash(struct bfs *b)
+{
+    int i, h;
+
+    sfree(b->hash);
+    b->hash = snewn(b->hashsize, int);
+    for (i = 0; i < b->hashsize; i++)
+        b->hash[i] = -1;
+    for (i = 0; i < b->nstates; i++) {
+        h = solver_hashval(b->keys[i]) & (b->hashsize - 1);
+        while (b->hash[h] >= 0)
+            h = (h + 1) & (b->hashsize - 1);
+        b->hash[h] = i;
+    }
+}
+
+static void bfs_init(struct bfs *b)
+{
+    b->keys = NULL;
+    b->link = NULL;
+    b->moves = NULL;
+    b->nstates = b->statesize = b->head = 0;
+    b->hash = NULL;
+    b->hashsize = 1024;
+    bfs_rehash(b);
+}
+
+static void bfs_free(struct bfs *b)
+{
+    sfree(b->keys);
+    sfree(b->link);
+    sfree(b->moves);
+    sfree(b->hash);
+}
+
+static int bfs_find(const struct bfs *b, unsigned long long key)
+{
+    int h = solver_hashval(key) & (b->hashsize - 1);
+
+    while (b->hash[h] >= 0) {
+        if (b->keys[b->hash[h]] == key)
+            return b->hash[h];
+        h = (h + 1) & (b->hashsize - 1);
+    }
+    return -1;
+}
+
+/*
+ * Add a state if we haven't seen it before. Returns its index, or -1
+ * if it was already known.
+ */
+static int bfs_add(struct bfs *b, unsigned long long key, int link, char move)
+{
+    int h = solver_hashval(key) & (b->hashsize - 1);
+
+    while (b->hash[h] >= 0) {
+        if (b->keys[b->hash[h]] == key)
+            return -1;
+        h = (h + 1) & (b->hashsize - 1);
+    }
+
+    if (b->nstates >= b->statesize) {
+        b->statesize = b->statesize * 3 / 2 + 1024;
+        b->keys = sresize(b->keys, b->statesize, unsigned long long);
+        b->link = sresize(b->link, b->statesize, int);
+        b->moves = sresize(b->moves, b->statesize, char);
+    }
+    b->keys[b->nstates] = key;
+    b->link[b->nstates] = link;
+    b->moves[b->nstates] = move;
+    b->hash[h] = b->nstates++;
+
+    if (b->nstates * 2 > b->hashsize) {
+        b->hashsize *= 2;
+        bfs_rehash(b);
+    }
+
+    return b->nstates - 1;
+}
+
+/*
+ * Find the state reached by rolling (or, backwards, the state we
+ * must have rolled from) with a given roll.
+ */
+static unsigned long long solver_step(const struct solver *sv,
+                                      unsigned long long key,
+                                      const struct roll *r, int from,
+                                      int backwards)
+{
+    int ns = sv->nsquares, nf = sv->nfaces;
+    int lowest = sv->state->grid->lowest;
+    unsigned long long faces, low, sq;
     int i;
 
-    for (i = 0; i < sq->npoints; i++) {
-        if (bb->l > sq->points[i*2]) bb->l = sq->points[i*2];
-        if (bb->r < sq->points[i*2]) bb->r = sq->points[i*2];
-        if (bb->u > sq->points[i*2+1]) bb->u = sq->points[i*2+1];
-        if (bb->d < sq->points[i*2+1]) bb->d = sq->points[i*2+1];
+    if (!backwards) {
+        faces = 0;
+        for (i = 0; i < nf; i++)
+            if (key & (1ULL << (ns + r->perm[i])))
+                faces |= 1ULL << (ns + i);
+        key = (key & ((1ULL << ns) - 1)) | faces;
+        from = r->dest;
     }
+
+    /* Swap the bottom face with the square landed on. */
+    low = (key >> (ns + lowest)) & 1;
+    sq = (key >> r->dest) & 1;
+    key &= ~((1ULL << (ns + lowest)) | (1ULL << r->dest));
+    key |= (sq << (ns + lowest)) | (low << r->dest);
+
+    if (backwards) {
+        faces = 0;
+        for (i = 0; i < nf; i++)
+            if (key & (1ULL << (ns + i)))
+                faces |= 1ULL << (ns + r->perm[i]);
+        key = (key & ((1ULL << ns) - 1)) | faces;
+    }
+
+    return (key & ((1ULL << (ns + nf)) - 1)) |
+        ((unsigned long long)from << (ns + nf));
 }
 
-static struct bbox find_bbox(const game_params *params)
+/*
+ * Expand one level of one side of the search. Returns TRUE, with the
+ * indices of the state in each side, if the two sides have met; -1
+ * if this side has run dry; -2 if we're out of patience; otherwise
+ * FALSE.
+ */
+static int solver_level(struct solver *sv, int backwards, int meet[2])
 {
-    struct bbox bb;
+    struct bfs *b = &sv->sides[backwards], *other = &sv->sides[!backwards];
+    int ns = sv->nsquares, nf = sv->nfaces;
+    int end = b->nstates;
+
+    if (b->head == end)
+        return -1;
+
+    for (; b->head < end; b->head++) {
+        unsigned long long key = b->keys[b->head];
+        int square = (int)(key >> (ns + nf));
+        int i, n = (backwards ? sv->npreds[square] : 4);
+
+        for (i = 0; i < n; i++) {
+            const struct roll *r;
+            unsigned long long newkey;
+            int from = -1, dir = i, idx;
+
+            if (backwards) {
+                from = sv->preds[(square*4 + i) * 2];
+                dir = sv->preds[(square*4 + i) * 2 + 1];
+            }
+            r = get_roll(sv->state, backwards ? from : square, dir);
+            if (r->dest < 0)
+                continue;
+
+            newkey = solver_step(sv, key, r, from, backwards);
+            idx = bfs_add(b, newkey, b->head, "LRUD"[dir]);
+            if (idx < 0)
+                continue;
+            meet[backwards] = idx;
+            meet[!backwards] = bfs_find(other, newkey);
+            if (meet[!backwards] >= 0)
+                return TRUE;
+            if (sv->sides[0].nstates + sv->sides[1].nstates >=
+                SOLVE_MAX_STATES)
+                return -2;
+        }
+    }
+
+    return FALSE;
+}
+
+static char *solve_game(const game_state *state, const game_state *currstate,
+                        const char *aux, char **error)
+{
+    struct solver sv;
+    unsigned long long key;
+    int posbits, i, j, ret, meet[2], flen, blen;
+    char *path = NULL;
+
+    if (currstate->completed) {
+        *error = _("Game is already solved");
+        return NULL;
+    }
+
+    for (posbits = 1; (1 << posbits) < currstate->grid->nsquares; posbits++);
+    if (currstate->grid->nsquares + currstate->solid->nfaces + posbits > 64) {
+        *error = _("Puzzle is too large");
+        return NULL;
+    }
+
+    sv.state = currstate;
+    sv.nsquares = currstate->grid->nsquares;
+    sv.nfaces = currstate->solid->nfaces;
 
     /*
-     * These should be hugely more than the real bounding box will
-     * be.
+     * Tabulate the rolls arriving at each square, for the backward
+     * search.
      */
-    bb.l = 2.0F * (params->d1 + params->d2);
-    bb.r = -2.0F * (params->d1 + params->d2);
-    bb.u = 2.0F * (params->d1 + params->d2);
-    bb.d = -2.0F * (params->d1 + params->d2);
-    enum_grid_squares(params, find_bbox_callback, &bb);
+    sv.preds = snewn(sv.nsquares * 4 * 2, int);
+    sv.npreds = snewn(sv.nsquares, int);
+    for (i = 0; i < sv.nsquares; i++)
+        sv.npreds[i] = 0;
+    for (i = 0; i < sv.nsquares; i++)
+        for (j = LEFT; j <= DOWN; j++) {
+            int dest = get_roll(currstate, i, j)->dest;
+            if (dest >= 0) {
+                int k = dest*4 + sv.npreds[dest]++;
+                assert(sv.npreds[dest] <= 4);
+                sv.preds[k*2] = i;
+                sv.preds[k*2+1] = j;
+            }
+        }
 
-    return bb;
+    bfs_init(&sv.sides[0]);
+    bfs_init(&sv.sides[1]);
+
+    key = (unsigned long long)currstate->current << (sv.nsquares + sv.nfaces);
+    for (i = 0; i < sv.nsquares; i++)
+        if (GET_SQUARE(currstate, i))
+            key |= 1ULL << i;
+    for (i = 0; i < sv.nfaces; i++)
+        if (currstate->facecolours[i])
+            key |= 1ULL << (sv.nsquares + i);
+    bfs_add(&sv.sides[0], key, -1, 0);
+
+    /*
+     * Every position with all the faces blue (and hence none of the
+     * squares) is a goal.
+     */
+    for (i = 0; i < sv.nsquares; i++)
+        bfs_add(&sv.sides[1], (((unsigned long long)i << sv.nfaces) |
+                               ((1ULL << sv.nfaces) - 1)) << sv.nsquares,
+                -1, 0);
+
+    /*
+     * Grow whichever side has the smaller frontier.
+     */
+    do {
+        struct bfs *f = &sv.sides[0], *b = &sv.sides[1];
+        ret = solver_level(&sv, (b->nstates - b->head <
+                                 f->nstates - f->head), meet);
+    } while (!ret);
+
+    if (ret < 0) {
+        *error = (ret == -1 ? _("No solution exists for this position") :
+                  _("Unable to solve puzzle"));
+    } else {
+        const struct bfs *f = &sv.sides[0], *b = &sv.sides[1];
+
+        /*
+         * Follow the forward parents back to the start and the
+         * backward successors on to a goal.
+         */
+        flen = blen = 0;
+        for (i = meet[0]; f->link[i] >= 0; i = f->link[i])
+            flen++;
+        for (i = meet[1]; b->link[i] >= 0; i = b->link[i])
+            blen++;
+        path = snewn(flen + blen + 2, char);
+        path[0] = 'S';
+        for (i = meet[0], j = flen; f->link[i] >= 0; i = f->link[i])
+            path[j--] = f->moves[i];
+        for (i = meet[1], j = flen + 1; b->link[i] >= 0; i = b->link[i])
+            path[j++] = b->moves[i];
+        path[flen + blen + 1] = '\0';
+    }
+
+    bfs_free(&sv.sides[0]);
+    bfs_free(&sv.sides[1]);
+    sfree(sv.preds);
+    sfree(sv.npreds);
+    return path;
 }
 
+/* ----------------------------------------------------------------------
+ * Drawing routines.
+ */
+
 #define XSIZE(gs, bb, solid) \
     ((int)(((bb).r - (bb).l + 2*(solid)->border) * gs))
 #define YSIZE(gs, bb, solid) \
@@ -1557,13 +1969,44 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
                         float animtime, float flashtime)
 {
     int i, j;
-    struct bbox bb = find_bbox(&state->params);
+    struct bbox bb = state->grid->bb;
     struct solid *poly;
     const int *pkey, *gkey;
     float t[3];
     float angle;
     int square;
 
+    if (oldstate && (dir > 0 ? state : oldstate)->solvepath) {
+        /*
+         * Animating a solve (or its undo): replay the path from the
+         * state before it up to the roll in progress, and draw just
+         * that roll.
+         */
+        const game_state *base = (dir > 0 ? oldstate : state);
+        const char *path = (dir > 0 ? state : oldstate)->solvepath;
+        int len = strlen(path), k;
+        game_state *from, *to;
+
+        if (dir < 0)
+            animtime = len * ROLLTIME - animtime;
+        k = (int)(animtime / ROLLTIME);
+        if (k > len - 1) k = len - 1;
+        if (k < 0) k = 0;
+
+        from = dup_game(base);
+        for (i = 0; i < k; i++) {
+            to = roll_once(from, move_direction(path[i]));
+            free_game(from);
+            from = to;
+        }
+        to = roll_once(from, move_direction(path[k]));
+        game_redraw(dr, ds, from, to, +1, ui, animtime - k * ROLLTIME,
+                    flashtime);
+        free_game(from);
+        free_game(to);
+        return;
+    }
+
     draw_rect(dr, 0, 0, XSIZE(GRID_SCALE, bb, state->solid),
 	      YSIZE(GRID_SCALE, bb, state->solid), COL_BACKGROUND);
 
@@ -1718,6 +2161,10 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 static float game_anim_length(const game_state *oldstate,
                               const game_state *newstate, int dir, game_ui *ui)
 {
+    const game_state *s = (dir > 0 ? newstate : oldstate);
+
+    if (s->solvepath)
+        return strlen(s->solvepath) * ROLLTIME;
     return ROLLTIME;
 }
 
@@ -1766,7 +2213,7 @@ const struct game thegame = {
     new_game,
     dup_game,
     free_game,
-    FALSE, solve_game,
+    TRUE, solve_game,
     FALSE, game_can_format_as_text_now, game_text_format,
     new_ui,
     free_ui,
@@ -1790,5 +2237,5 @@ const struct game thegame = {
 #endif
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    SOLVE_ANIMATES,		       /* flags */
 };
@@ -168,10 +168,15 @@
  */
 
 /*
- * Possible improvements which might cut the fail rate:
+ * When the omino picked for extension can't be extended, we try
+ * the other incomplete ones in a randomised order, and if they're
+ * all stuck we break up the ominoes around one of them and carry
+ * on, only starting again from scratch if that keeps failing. That
+ * spends random numbers differently, so it's only done for the fast
+ * ('@') seeds; for older seeds a stuck omino still means a restart,
+ * so that they give the same layouts they always did.
  * 
- *  - instead of picking one omino to extend in an iteration, try
- *    them all in succession (in a randomised order)
+ * A possible improvement which might cut the fail rate further:
  * 
  *  - (for real rigour) instead of bfsing over ominoes, bfs over
  *    the space of possible _removed squares_. That way we aren't
@@ -179,10 +184,9 @@
  *    an omino and failing if that particular square doesn't
  *    happen to work.
  * 
- * However, I don't currently think it's necessary to do either of
- * these, because the failure rate is already low enough to be
- * easily tolerable, under all circumstances I've been able to
- * think of.
+ * However, I don't currently think it's necessary, because the
+ * failure rate is already low enough to be easily tolerable, under
+ * all circumstances I've been able to think of.
  */
 
 #include <assert.h>
@@ -249,6 +253,375 @@ static int addremcommon(int w, int h, int x, int y, int *own, int val)
     return (count == 2);
 }
 
+/*
+ * Work out, from scratch, whether square yx can be removed from its
+ * omino, and which ominoes it can be added to. This depends only on
+ * the ownership of the square and its eight neighbours (and on the
+ * size of its own omino, which only matters if that's 1).
+ */
+static void divvy_scan_square(int w, int h, int yx, const int *own,
+			      const int *sizes, int *addable, int *removable)
+{
+    int x = yx % w, y = yx / w;
+    int curr = own[yx];
+    int dir;
+
+    if (curr < 0) {
+	removable[yx] = FALSE;	       /* can't remove if not owned! */
+    } else if (sizes[curr] == 1) {
+	removable[yx] = TRUE;	       /* can always remove a singleton */
+    } else {
+	/*
+	 * See if this square can be removed from its omino without
+	 * disconnecting it.
+	 */
+	removable[yx] = addremcommon(w, h, x, y, (int *)own, curr);
+    }
+
+    for (dir = 0; dir < 4; dir++) {
+	int dx = (dir == 0 ? -1 : dir == 1 ? +1 : 0);
+	int dy = (dir == 2 ? -1 : dir == 3 ? +1 : 0);
+	int sx = x + dx, sy = y + dy;
+	int syx = sy*w+sx;
+
+	addable[yx*4+dir] = -1;
+
+	if (sx < 0 || sx >= w || sy < 0 || sy >= h)
+	    continue;		       /* no omino here! */
+	if (own[syx] < 0)
+	    continue;		       /* also no omino here */
+	if (own[syx] == own[yx])
+	    continue;		       /* we already got one */
+	if (!addremcommon(w, h, x, y, (int *)own, own[syx]))
+	    continue;		       /* would non-simply connect the omino */
+
+	addable[yx*4+dir] = own[syx];
+    }
+}
+
+/*
+ * The working state of divvy_internal. Besides the ownership of each
+ * square, we keep a list of the squares in each omino (so that we can
+ * find the squares an omino might expand into by looking around its
+ * edges, instead of over the whole grid), and the addable/removable
+ * tables, which we keep up to date as squares change hands rather
+ * than recomputing them for the whole grid on every iteration.
+ */
+struct divvy_ctx {
+    int w, h, k, n;
+    int *order, *rank;		       /* random order, and its inverse */
+    int *own, *sizes;
+    int *members, *mpos;	       /* k+1 slots per omino; index in them */
+    int *addable, *removable;
+    int firstfree;		       /* order[] has no free square below */
+    int *cands, *stamp, stampval;
+};
+
+static void divvy_set_owner(struct divvy_ctx *ctx, int sq, int j)
+{
+    int old = ctx->own[sq];
+
+    if (old >= 0) {
+	int last = ctx->members[old*(ctx->k+1) + --ctx->sizes[old]];
+	ctx->members[old*(ctx->k+1) + ctx->mpos[sq]] = last;
+	ctx->mpos[last] = ctx->mpos[sq];
+    }
+    ctx->own[sq] = j;
+    if (j >= 0) {
+	/*
+	 * While a chain of steals is being carried out, an omino can
+	 * briefly gain its new square before it loses the stolen one.
+	 */
+	assert(ctx->sizes[j] <= ctx->k);
+	ctx->mpos[sq] = ctx->sizes[j];
+	ctx->members[j*(ctx->k+1) + ctx->sizes[j]++] = sq;
+    }
+}
+
+/*
+ * Re-scan the squares whose addable/removable status might have been
+ * changed by a change of owner of square sq.
+ */
+static void divvy_rescan_around(struct divvy_ctx *ctx, int sq)
+{
+    int w = ctx->w, h = ctx->h;
+    int x0 = sq % w, y0 = sq / w, x, y;
+
+    for (y = max(y0-1, 0); y <= min(y0+1, h-1); y++)
+	for (x = max(x0-1, 0); x <= min(x0+1, w-1); x++)
+	    divvy_scan_square(w, h, y*w+x, ctx->own, ctx->sizes,
+			      ctx->addable, ctx->removable);
+}
+
+/*
+ * List the squares 4-adjacent to omino j but not in it, in the order
+ * a scan of the grid in order[] would come across them. Every square
+ * addable to j is among these.
+ */
+static int divvy_candidates(struct divvy_ctx *ctx, int j)
+{
+    int w = ctx->w, h = ctx->h;
+    int i, dir, nc = 0;
+
+    ctx->stampval++;
+    for (i = 0; i < ctx->sizes[j]; i++) {
+	int sq = ctx->members[j*(ctx->k+1) + i];
+	int x = sq % w, y = sq / w;
+
+	for (dir = 0; dir < 4; dir++) {
+	    int sx = x + (dir == 0 ? -1 : dir == 1 ? +1 : 0);
+	    int sy = y + (dir == 2 ? -1 : dir == 3 ? +1 : 0);
+	    int s, c;
+
+	    if (sx < 0 || sx >= w || sy < 0 || sy >= h)
+		continue;
+	    s = sy*w+sx;
+	    if (ctx->own[s] == j || ctx->stamp[s] == ctx->stampval)
+		continue;
+	    ctx->stamp[s] = ctx->stampval;
+
+	    /* Insertion sort by rank: there are at most 4k of these. */
+	    for (c = nc++; c > 0 && ctx->rank[ctx->cands[c-1]] > ctx->rank[s];
+		 c--)
+		ctx->cands[c] = ctx->cands[c-1];
+	    ctx->cands[c] = s;
+	}
+    }
+
+    return nc;
+}
+
+/*
+ * Try to expand omino start by one square. Returns FALSE if there's
+ * no way to do it.
+ */
+static int divvy_expand(struct divvy_ctx *ctx, int start, int *tmp,
+			int *queue)
+{
+    int w = ctx->w, h = ctx->h, n = ctx->n;
+    int *own = ctx->own, *sizes = ctx->sizes, *order = ctx->order;
+    int *addable = ctx->addable, *removable = ctx->removable;
+    int i, j, c, nc, qhead, qtail;
+
+    /*
+     * So we're trying to expand omino j. We breadth-first search out
+     * from j across the space of ominoes.
+     * 
+     * For bfs purposes, we use two elements of tmp per omino:
+     * tmp[2*i+0] tells us which omino we got to i from, and
+     * tmp[2*i+1] numbers the grid square that omino stole from us.
+     */
+    for (i = 0; i < n; i++)
+	tmp[2*i] = tmp[2*i+1] = -1;
+    qhead = qtail = 0;
+    queue[qtail++] = start;
+    tmp[2*start] = tmp[2*start+1] = -2;/* special value: `starting point' */
+
+    while (qhead < qtail) {
+	int tmpsq;
+
+	j = queue[qhead];
+
+	/*
+	 * We wish to expand omino j. However, we might have got here
+	 * by omino j having a square stolen from it, so first of all
+	 * we must temporarily mark that square as not belonging to j,
+	 * so that our adjacency calculations don't assume j _does_
+	 * belong to us.
+	 */
+	tmpsq = tmp[2*j+1];
+	if (tmpsq >= 0) {
+	    assert(own[tmpsq] == j);
+	    own[tmpsq] = -3;
+	}
+
+	/*
+	 * OK. Now begin by seeing if we can find any unclaimed square
+	 * into which we can expand omino j. If we find one, the entire
+	 * bfs terminates.
+	 */
+	nc = divvy_candidates(ctx, j);
+	i = -1;
+	if (sizes[j] == 1 && tmpsq >= 0) {
+	    /*
+	     * Special case: if our current omino was size 1 and then
+	     * had a square stolen from it, it's now size zero, which
+	     * means it's valid to `expand' it into _any_ unclaimed
+	     * square.
+	     */
+	    while (own[order[ctx->firstfree]] != -1) {
+		ctx->firstfree++;
+		assert(ctx->firstfree < ctx->w * ctx->h);
+	    }
+	    i = order[ctx->firstfree];
+	} else {
+	    for (c = 0; c < nc && i < 0; c++) {
+		int sq = ctx->cands[c], dir;
+
+		if (own[sq] != -1)
+		    continue;	       /* this square is claimed */
+
+		for (dir = 0; dir < 4; dir++)
+		    if (addable[sq*4+dir] == j) {
+			/*
+			 * We know this square is addable to this omino
+			 * with the grid in the state it had before we
+			 * started. However, we must now check that it's
+			 * _still_ addable to this omino when the omino
+			 * is missing a square. To do this it's only
+			 * necessary to re-check addremcommon.
+			 */
+			if (!addremcommon(w, h, sq%w, sq/w, own, j))
+			    continue;
+			i = sq;	       /* got one! */
+			break;
+		    }
+	    }
+	}
+
+	if (i >= 0) {
+	    /*
+	     * Restore the temporarily removed square _before_ we start
+	     * shifting ownerships about.
+	     */
+	    if (tmpsq >= 0)
+		own[tmpsq] = j;
+
+	    /*
+	     * We are done. We can add square i to omino j, and then
+	     * backtrack along the trail in tmp moving squares between
+	     * ominoes, ending up expanding our starting omino by one.
+	     * Only the squares around those that changed hands need
+	     * their addable/removable status recomputing.
+	     */
+#ifdef DIVVY_DIAGNOSTICS
+	    printf("(%d,%d)", i%w, i/w);
+#endif
+	    while (1) {
+		divvy_set_owner(ctx, i, j);
+		divvy_rescan_around(ctx, i);
+#ifdef DIVVY_DIAGNOSTICS
+		printf(" -> %d", j);
+#endif
+		if (tmp[2*j] == -2)
+		    break;
+		i = tmp[2*j+1];
+		j = tmp[2*j];
+#ifdef DIVVY_DIAGNOSTICS
+		printf("; (%d,%d)", i%w, i/w);
+#endif
+	    }
+#ifdef DIVVY_DIAGNOSTICS
+	    printf("\n");
+#endif
+	    return TRUE;
+	}
+
+	/*
+	 * If we get here, we haven't been able to expand omino j into
+	 * an unclaimed square. So now we begin to investigate
+	 * expanding it into squares which are claimed by ominoes the
+	 * bfs has not yet visited.
+	 */
+	for (c = 0; c < nc; c++) {
+	    int sq = ctx->cands[c], dir, nj;
+
+	    nj = own[sq];
+	    if (nj < 0 || tmp[2*nj] != -1)
+		continue;	       /* unclaimed, or owned by wrong omino */
+	    if (!removable[sq])
+		continue;	       /* its omino won't let it go */
+
+	    for (dir = 0; dir < 4; dir++)
+		if (addable[sq*4+dir] == j) {
+		    /*
+		     * As above, re-check addremcommon.
+		     */
+		    if (!addremcommon(w, h, sq%w, sq/w, own, j))
+			continue;
+
+		    /*
+		     * We have found a square we can use to expand omino
+		     * j, at the expense of the as-yet unvisited omino
+		     * nj. So add this to the bfs queue.
+		     */
+		    assert(qtail < n);
+		    queue[qtail++] = nj;
+		    tmp[2*nj] = j;
+		    tmp[2*nj+1] = sq;
+
+		    /*
+		     * Now terminate the loop over dir, to ensure we
+		     * don't accidentally add the same omino twice to
+		     * the queue.
+		     */
+		    break;
+		}
+	}
+
+	/*
+	 * Restore the temporarily removed square.
+	 */
+	if (tmpsq >= 0)
+	    own[tmpsq] = j;
+
+	/*
+	 * Advance the queue head.
+	 */
+	qhead++;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Every omino still short of its target size is stuck. Rather than
+ * start again from nothing, break up the neighbourhood of one of
+ * them: it and every omino touching it go back to a single square
+ * each, freeing the rest of their squares for a second attempt.
+ */
+static void divvy_repair(struct divvy_ctx *ctx, int j, int *list)
+{
+    int w = ctx->w, h = ctx->h, stride = ctx->k + 1;
+    int i, nl = 0, m, sq;
+
+    ctx->stampval++;
+    list[nl++] = j;
+    ctx->stamp[j] = ctx->stampval;
+    for (i = 0; i < ctx->sizes[j]; i++) {
+	int dir, x, y;
+
+	sq = ctx->members[j*stride + i];
+	x = sq % w;
+	y = sq / w;
+	for (dir = 0; dir < 4; dir++) {
+	    int sx = x + (dir == 0 ? -1 : dir == 1 ? +1 : 0);
+	    int sy = y + (dir == 2 ? -1 : dir == 3 ? +1 : 0);
+	    int o;
+
+	    if (sx < 0 || sx >= w || sy < 0 || sy >= h)
+		continue;
+	    o = ctx->own[sy*w+sx];
+	    if (o >= 0 && ctx->stamp[o] != ctx->stampval) {
+		ctx->stamp[o] = ctx->stampval;
+		list[nl++] = o;
+	    }
+	}
+    }
+
+    for (m = 0; m < nl; m++) {
+	j = list[m];
+	while (ctx->sizes[j] > 1) {
+	    sq = ctx->members[j*stride + ctx->sizes[j] - 1];
+	    divvy_set_owner(ctx, sq, -1);
+	    divvy_rescan_around(ctx, sq);
+	}
+	divvy_rescan_around(ctx, ctx->members[j*stride]);
+    }
+
+    ctx->firstfree = 0;
+}
+
 /*
  * w and h are the dimensions of the rectangle.
  * 
@@ -260,22 +633,37 @@ static int addremcommon(int w, int h, int x, int y, int *own, int val)
  * In both of the above suggested use cases, the user would
  * probably want w==h==k, but that isn't a requirement.
  */
-static int *divvy_internal(int w, int h, int k, random_state *rs)
+static int *divvy_internal(int w, int h, int k, random_state *rs,
+			   int repair)
 {
-    int *order, *queue, *tmp, *own, *sizes, *addable, *removable, *retdsf;
+    struct divvy_ctx actx, *ctx = &actx;
+    int *order, *tmp, *own, *sizes, *queue, *tried, *todo, *retdsf;
     int wh = w*h;
-    int i, j, n, x, y, qhead, qtail;
+    int i, j, n, x, y, ntodo, repairs;
 
     n = wh / k;
     assert(wh == k*n);
 
-    order = snewn(wh, int);
-    tmp = snewn(wh, int);
-    own = snewn(wh, int);
-    sizes = snewn(n, int);
+    ctx->w = w;
+    ctx->h = h;
+    ctx->k = k;
+    ctx->n = n;
+    ctx->order = order = snewn(wh, int);
+    ctx->rank = snewn(wh, int);
+    ctx->own = own = snewn(wh, int);
+    ctx->sizes = sizes = snewn(n, int);
+    ctx->members = snewn(n * (k+1), int);
+    ctx->mpos = snewn(wh, int);
+    ctx->addable = snewn(wh*4, int);
+    ctx->removable = snewn(wh, int);
+    ctx->cands = snewn(4*k, int);
+    ctx->stamp = snewn(max(wh, n), int);
+    ctx->stampval = 0;
+    ctx->firstfree = 0;
+    tmp = snewn(max(wh, 2*n), int);
     queue = snewn(n, int);
-    addable = snewn(wh*4, int);
-    removable = snewn(wh, int);
+    tried = snewn(n, int);
+    todo = snewn(n, int);
 
     /*
      * Permute the grid squares into a random order, which will be
@@ -286,6 +674,10 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
     for (i = 0; i < wh; i++)
 	order[i] = i;
     shuffle(order, wh, sizeof(*order), rs);
+    for (i = 0; i < wh; i++) {
+	ctx->rank[order[i]] = i;
+	ctx->stamp[i] = 0;
+    }
 
     /*
      * Begin by choosing a starting square at random for each
@@ -294,10 +686,25 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
     for (i = 0; i < wh; i++) {
 	own[i] = -1;
     }
-    for (i = 0; i < n; i++) {
-	own[order[i]] = i;
-	sizes[i] = 1;
-    }
+    for (i = 0; i < n; i++)
+	sizes[i] = 0;
+    for (i = 0; i < n; i++)
+	divvy_set_owner(ctx, order[i], i);
+
+    /*
+     * Go over the grid and figure out which squares can safely be
+     * added to, or removed from, each omino. We don't take account of
+     * other ominoes in this process, so we will often end up knowing
+     * that a square can be poached from one omino by another.
+     * 
+     * For each square, there may be up to four ominoes to which it
+     * can be added (those to which it is 4-adjacent).
+     * 
+     * From here on, these tables are kept up to date as squares
+     * change hands.
+     */
+    for (i = 0; i < wh; i++)
+	divvy_scan_square(w, h, i, own, sizes, ctx->addable, ctx->removable);
 
     /*
      * Now repeatedly pick a random omino which isn't already at
@@ -309,6 +716,7 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
      * causes the number of unclaimed squares to drop by one, and
      * so the process is bounded in duration.
      */
+    repairs = 0;
     while (1) {
 
 #ifdef DIVVY_DIAGNOSTICS
@@ -323,57 +731,6 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
 	}
 #endif
 
-	/*
-	 * Go over the grid and figure out which squares can
-	 * safely be added to, or removed from, each omino. We
-	 * don't take account of other ominoes in this process, so
-	 * we will often end up knowing that a square can be
-	 * poached from one omino by another.
-	 * 
-	 * For each square, there may be up to four ominoes to
-	 * which it can be added (those to which it is
-	 * 4-adjacent).
-	 */
-	for (y = 0; y < h; y++) {
-	    for (x = 0; x < w; x++) {
-		int yx = y*w+x;
-		int curr = own[yx];
-		int dir;
-
-		if (curr < 0) {
-		    removable[yx] = FALSE; /* can't remove if not owned! */
-		} else if (sizes[curr] == 1) {
-		    removable[yx] = TRUE; /* can always remove a singleton */
-		} else {
-		    /*
-		     * See if this square can be removed from its
-		     * omino without disconnecting it.
-		     */
-		    removable[yx] = addremcommon(w, h, x, y, own, curr);
-		}
-
-		for (dir = 0; dir < 4; dir++) {
-		    int dx = (dir == 0 ? -1 : dir == 1 ? +1 : 0);
-		    int dy = (dir == 2 ? -1 : dir == 3 ? +1 : 0);
-		    int sx = x + dx, sy = y + dy;
-		    int syx = sy*w+sx;
-
-		    addable[yx*4+dir] = -1;
-
-		    if (sx < 0 || sx >= w || sy < 0 || sy >= h)
-			continue;      /* no omino here! */
-		    if (own[syx] < 0)
-			continue;      /* also no omino here */
-		    if (own[syx] == own[yx])
-			continue;      /* we already got one */
-		    if (!addremcommon(w, h, x, y, own, own[syx]))
-			continue;      /* would non-simply connect the omino */
-		    
-		    addable[yx*4+dir] = own[syx];
-		}
-	    }
-	}
-
 	for (i = j = 0; i < n; i++)
 	    if (sizes[i] < k)
 		tmp[j++] = i;
@@ -384,209 +741,60 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
 	printf("Trying to extend %d\n", j);
 #endif
 
+	if (divvy_expand(ctx, j, tmp, queue))
+	    continue;
+
 	/*
-	 * So we're trying to expand omino j. We breadth-first
-	 * search out from j across the space of ominoes.
-	 * 
-	 * For bfs purposes, we use two elements of tmp per omino:
-	 * tmp[2*i+0] tells us which omino we got to i from, and
-	 * tmp[2*i+1] numbers the grid square that omino stole
-	 * from us.
-	 * 
-	 * This requires that wh (the size of tmp) is at least 2n,
-	 * i.e. k is at least 2. There would have been nothing to
-	 * stop a user calling this function with k=1, but if they
-	 * did then we wouldn't have got to _here_ in the code -
-	 * we would have noticed above that all ominoes were
-	 * already at their target sizes, and terminated :-)
+	 * Old seeds must go on giving the layouts they always have, so
+	 * for them a stuck omino still means starting again.
 	 */
-	assert(wh >= 2*n);
-	for (i = 0; i < n; i++)
-	    tmp[2*i] = tmp[2*i+1] = -1;
-	qhead = qtail = 0;
-	queue[qtail++] = j;
-	tmp[2*j] = tmp[2*j+1] = -2;    /* special value: `starting point' */
-
-	while (qhead < qtail) {
-	    int tmpsq;
-
-	    j = queue[qhead];
-
-	    /*
-	     * We wish to expand omino j. However, we might have
-	     * got here by omino j having a square stolen from it,
-	     * so first of all we must temporarily mark that
-	     * square as not belonging to j, so that our adjacency
-	     * calculations don't assume j _does_ belong to us.
-	     */
-	    tmpsq = tmp[2*j+1];
-	    if (tmpsq >= 0) {
-		assert(own[tmpsq] == j);
-		own[tmpsq] = -3;
-	    }
-
-	    /*
-	     * OK. Now begin by seeing if we can find any
-	     * unclaimed square into which we can expand omino j.
-	     * If we find one, the entire bfs terminates.
-	     */
-	    for (i = 0; i < wh; i++) {
-		int dir;
-
-		if (own[order[i]] != -1)
-		    continue;	       /* this square is claimed */
-
-		/*
-		 * Special case: if our current omino was size 1
-		 * and then had a square stolen from it, it's now
-		 * size zero, which means it's valid to `expand'
-		 * it into _any_ unclaimed square.
-		 */
-		if (sizes[j] == 1 && tmpsq >= 0)
-		    break;	       /* got one */
-
-		/*
-		 * Failing that, we must do the full test for
-		 * addability.
-		 */
-		for (dir = 0; dir < 4; dir++)
-		    if (addable[order[i]*4+dir] == j) {
-			/*
-			 * We know this square is addable to this
-			 * omino with the grid in the state it had
-			 * at the top of the loop. However, we
-			 * must now check that it's _still_
-			 * addable to this omino when the omino is
-			 * missing a square. To do this it's only
-			 * necessary to re-check addremcommon.
-			 */
-			if (!addremcommon(w, h, order[i]%w, order[i]/w,
-					  own, j))
-			    continue;
-			break;
-		    }
-		if (dir == 4)
-		    continue;	       /* we can't add this square to j */
-
-		break;		       /* got one! */
-	    }
-	    if (i < wh) {
-		i = order[i];
-
-		/*
-		 * Restore the temporarily removed square _before_
-		 * we start shifting ownerships about.
-		 */
-		if (tmpsq >= 0)
-		    own[tmpsq] = j;
-
-		/*
-		 * We are done. We can add square i to omino j,
-		 * and then backtrack along the trail in tmp
-		 * moving squares between ominoes, ending up
-		 * expanding our starting omino by one.
-		 */
-#ifdef DIVVY_DIAGNOSTICS
-		printf("(%d,%d)", i%w, i/w);
-#endif
-		while (1) {
-		    own[i] = j;
-#ifdef DIVVY_DIAGNOSTICS
-		    printf(" -> %d", j);
-#endif
-		    if (tmp[2*j] == -2)
-			break;
-		    i = tmp[2*j+1];
-		    j = tmp[2*j];
-#ifdef DIVVY_DIAGNOSTICS
-		    printf("; (%d,%d)", i%w, i/w);
-#endif
-		}
+	if (!repair) {
 #ifdef DIVVY_DIAGNOSTICS
-		printf("\n");
+	    printf("FAIL!\n");
 #endif
+	    retdsf = NULL;
+	    goto cleanup;
+	}
 
-		/*
-		 * Increment the size of the starting omino.
-		 */
-		sizes[j]++;
-
-		/*
-		 * Terminate the bfs loop.
-		 */
+	/*
+	 * We couldn't find any way to expand omino j. Before giving
+	 * up on it, see whether any of the other incomplete ominoes
+	 * can make progress, trying them in a random order.
+	 */
+	for (i = 0; i < n; i++)
+	    tried[i] = FALSE;
+	tried[j] = TRUE;
+	while (1) {
+	    for (i = ntodo = 0; i < n; i++)
+		if (sizes[i] < k && !tried[i])
+		    todo[ntodo++] = i;
+	    if (ntodo == 0)
+		break;
+	    j = todo[random_upto(rs, ntodo)];
+	    tried[j] = TRUE;
+	    if (divvy_expand(ctx, j, tmp, queue))
 		break;
-	    }
-
-	    /*
-	     * If we get here, we haven't been able to expand
-	     * omino j into an unclaimed square. So now we begin
-	     * to investigate expanding it into squares which are
-	     * claimed by ominoes the bfs has not yet visited.
-	     */
-	    for (i = 0; i < wh; i++) {
-		int dir, nj;
-
-		nj = own[order[i]];
-		if (nj < 0 || tmp[2*nj] != -1)
-		    continue;	       /* unclaimed, or owned by wrong omino */
-		if (!removable[order[i]])
-		    continue;	       /* its omino won't let it go */
-
-		for (dir = 0; dir < 4; dir++)
-		    if (addable[order[i]*4+dir] == j) {
-			/*
-			 * As above, re-check addremcommon.
-			 */
-			if (!addremcommon(w, h, order[i]%w, order[i]/w,
-					  own, j))
-			    continue;
-
-			/*
-			 * We have found a square we can use to
-			 * expand omino j, at the expense of the
-			 * as-yet unvisited omino nj. So add this
-			 * to the bfs queue.
-			 */
-			assert(qtail < n);
-			queue[qtail++] = nj;
-			tmp[2*nj] = j;
-			tmp[2*nj+1] = order[i];
-
-			/*
-			 * Now terminate the loop over dir, to
-			 * ensure we don't accidentally add the
-			 * same omino twice to the queue.
-			 */
-			break;
-		    }
-	    }
-
-	    /*
-	     * Restore the temporarily removed square.
-	     */
-	    if (tmpsq >= 0)
-		own[tmpsq] = j;
-
-	    /*
-	     * Advance the queue head.
-	     */
-	    qhead++;
 	}
+	if (ntodo > 0)
+	    continue;
 
-	if (qhead == qtail) {
-	    /*
-	     * We have finished the bfs and not found any way to
-	     * expand omino j. Panic, and return failure.
-	     * 
-	     * FIXME: or should we loop over all ominoes before we
-	     * give up?
-	     */
+	/*
+	 * Every incomplete omino is stuck. Break up the neighbourhood
+	 * of the last one we tried and carry on from there; only if
+	 * that keeps on failing do we panic, and return failure so
+	 * that our caller starts again from scratch.
+	 */
+#ifdef DIVVY_DIAGNOSTICS
+	printf("Stuck: repairing around %d\n", j);
+#endif
+	if (++repairs > n) {
 #ifdef DIVVY_DIAGNOSTICS
 	    printf("FAIL!\n");
 #endif
 	    retdsf = NULL;
 	    goto cleanup;
 	}
+	divvy_repair(ctx, j, todo);
     }
 
 #ifdef DIVVY_DIAGNOSTICS
@@ -637,13 +845,20 @@ static int *divvy_internal(int w, int h, int k, random_state *rs)
     /*
      * Free our temporary working space.
      */
-    sfree(order);
+    sfree(ctx->order);
+    sfree(ctx->rank);
+    sfree(ctx->own);
+    sfree(ctx->sizes);
+    sfree(ctx->members);
+    sfree(ctx->mpos);
+    sfree(ctx->addable);
+    sfree(ctx->removable);
+    sfree(ctx->cands);
+    sfree(ctx->stamp);
     sfree(tmp);
-    sfree(own);
-    sfree(sizes);
     sfree(queue);
-    sfree(addable);
-    sfree(removable);
+    sfree(tried);
+    sfree(todo);
 
     /*
      * And we're done.
@@ -660,7 +875,7 @@ int *divvy_rectangle(int w, int h, int k, random_state *rs)
     int *ret;
 
     do {
-	ret = divvy_internal(w, h, k, rs);
+	ret = divvy_internal(w, h, k, rs, random_is_fast(rs));
 
 #ifdef TESTMODE
 	if (!ret)
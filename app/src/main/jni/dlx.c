@@ -0,0 +1,313 @@
+/*
+ * dlx.c: exact cover by Knuth's Algorithm X, with the matrix held
+ * as dancing links so that covering and uncovering a column are
+ * both cheap and exactly reversible.
+ *
+ * Each 1 in the matrix is a node, linked left/right to the other
+ * nodes of its row and up/down to the other nodes of its column.
+ * Node 0 is the root, linked left/right to the uncovered column
+ * headers, which are nodes 1 to ncols. Covering a column unlinks
+ * its header and every row with a 1 in it from all the other
+ * columns it touches; uncovering, in the opposite order, puts the
+ * very same links back.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "dlx.h"
+
+#include "puzzles.h"		       /* for snewn/sfree */
+
+enum { UNDO_SELECT, UNDO_REMOVE, UNDO_REMOVE_HIDDEN };
+
+struct dlx {
+    int ncols, nrows, nnodes, nodesize, rowsize;
+    /* Links, and each node's column header and row. */
+    int *l, *r, *u, *d, *col, *row;
+    /* Per column: number of rows linked in, and whether covered. */
+    int *size;
+    unsigned char *covered;
+    /* Per row: its first node, plus one entry for the end. */
+    int *rowstart;
+    unsigned char *removed;
+    /* Selections and removals so far, as row*3 + UNDO_*. */
+    int *undo, nundo;
+    /* Rows chosen by dlx_solve at each level of the search. */
+    int *stack;
+};
+
+static void dlx_grow_nodes(dlx *d, int want)
+{
+    if (want <= d->nodesize)
+	return;
+    d->nodesize = max(want, d->nodesize * 2);
+    d->l = sresize(d->l, d->nodesize, int);
+    d->r = sresize(d->r, d->nodesize, int);
+    d->u = sresize(d->u, d->nodesize, int);
+    d->d = sresize(d->d, d->nodesize, int);
+    d->col = sresize(d->col, d->nodesize, int);
+    d->row = sresize(d->row, d->nodesize, int);
+}
+
+dlx *dlx_new(int ncols)
+{
+    dlx *d = snew(dlx);
+    int i;
+
+    d->ncols = ncols;
+    d->nrows = 0;
+    d->nnodes = ncols + 1;
+    d->nodesize = 0;
+    d->l = d->r = d->u = d->d = d->col = d->row = NULL;
+    dlx_grow_nodes(d, max(d->nnodes, 16 * ncols));
+
+    for (i = 0; i <= ncols; i++) {
+	d->l[i] = (i + ncols) % (ncols + 1);
+	d->r[i] = (i + 1) % (ncols + 1);
+	d->u[i] = d->d[i] = i;
+	d->col[i] = i;
+	d->row[i] = -1;
+    }
+
+    d->size = snewn(ncols + 1, int);
+    d->covered = snewn(ncols + 1, unsigned char);
+    for (i = 0; i <= ncols; i++) {
+	d->size[i] = 0;
+	d->covered[i] = FALSE;
+    }
+
+    d->rowsize = max(4 * ncols, 16);
+    d->rowstart = snewn(d->rowsize + 1, int);
+    d->rowstart[0] = d->nnodes;
+    d->removed = snewn(d->rowsize, unsigned char);
+
+    d->undo = NULL;
+    d->nundo = 0;
+    d->stack = snewn(ncols + 1, int);
+
+    return d;
+}
+
+void dlx_free(dlx *d)
+{
+    sfree(d->l);
+    sfree(d->r);
+    sfree(d->u);
+    sfree(d->d);
+    sfree(d->col);
+    sfree(d->row);
+    sfree(d->size);
+    sfree(d->covered);
+    sfree(d->rowstart);
+    sfree(d->removed);
+    sfree(d->undo);
+    sfree(d->stack);
+    sfree(d);
+}
+
+int dlx_add_row(dlx *d, const int *cols, int n)
+{
+    int i, first = d->nnodes;
+
+    assert(n > 0);
+    assert(d->nundo == 0);
+
+    if (d->nrows == d->rowsize) {
+	d->rowsize *= 2;
+	d->rowstart = sresize(d->rowstart, d->rowsize + 1, int);
+	d->removed = sresize(d->removed, d->rowsize, unsigned char);
+    }
+
+    dlx_grow_nodes(d, first + n);
+    for (i = 0; i < n; i++) {
+	int x = first + i, h = cols[i] + 1;
+
+	assert(h >= 1 && h <= d->ncols);
+	d->l[x] = first + (i + n - 1) % n;
+	d->r[x] = first + (i + 1) % n;
+	d->u[x] = d->u[h];
+	d->d[x] = h;
+	d->d[d->u[h]] = x;
+	d->u[h] = x;
+	d->col[x] = h;
+	d->row[x] = d->nrows;
+	d->size[h]++;
+    }
+
+    d->nnodes += n;
+    d->removed[d->nrows] = FALSE;
+    d->rowstart[++d->nrows] = d->nnodes;
+
+    return d->nrows - 1;
+}
+
+static void dlx_cover(dlx *d, int c)
+{
+    int i, j;
+
+    d->r[d->l[c]] = d->r[c];
+    d->l[d->r[c]] = d->l[c];
+    for (i = d->d[c]; i != c; i = d->d[i])
+	for (j = d->r[i]; j != i; j = d->r[j]) {
+	    d->u[d->d[j]] = d->u[j];
+	    d->d[d->u[j]] = d->d[j];
+	    d->size[d->col[j]]--;
+	}
+    d->covered[c] = TRUE;
+}
+
+static void dlx_uncover(dlx *d, int c)
+{
+    int i, j;
+
+    d->covered[c] = FALSE;
+    for (i = d->u[c]; i != c; i = d->u[i])
+	for (j = d->l[i]; j != i; j = d->l[j]) {
+	    d->size[d->col[j]]++;
+	    d->u[d->d[j]] = j;
+	    d->d[d->u[j]] = j;
+	}
+    d->r[d->l[c]] = c;
+    d->l[d->r[c]] = c;
+}
+
+static void dlx_push_undo(dlx *d, int entry)
+{
+    /* Every entry has its own row, so nrows bounds the stack. */
+    if (!d->undo)
+	d->undo = snewn(d->nrows, int);
+    assert(d->nundo < d->nrows);
+    d->undo[d->nundo++] = entry;
+}
+
+int dlx_select_row(dlx *d, int row)
+{
+    int x;
+
+    assert(row >= 0 && row < d->nrows);
+    if (d->removed[row])
+	return FALSE;
+    for (x = d->rowstart[row]; x < d->rowstart[row+1]; x++)
+	if (d->covered[d->col[x]])
+	    return FALSE;
+
+    for (x = d->rowstart[row]; x < d->rowstart[row+1]; x++)
+	dlx_cover(d, d->col[x]);
+    /* Mark it so that selecting it twice is caught above. */
+    d->removed[row] = TRUE;
+    dlx_push_undo(d, row*3 + UNDO_SELECT);
+    return TRUE;
+}
+
+void dlx_remove_row(dlx *d, int row)
+{
+    int x;
+
+    assert(row >= 0 && row < d->nrows);
+    if (d->removed[row])
+	return;
+    d->removed[row] = TRUE;
+
+    /*
+     * If one of its columns is covered, the row is already unlinked
+     * from all the others and will stay so until that is undone.
+     */
+    for (x = d->rowstart[row]; x < d->rowstart[row+1]; x++)
+	if (d->covered[d->col[x]]) {
+	    dlx_push_undo(d, row*3 + UNDO_REMOVE_HIDDEN);
+	    return;
+	}
+
+    for (x = d->rowstart[row]; x < d->rowstart[row+1]; x++) {
+	d->u[d->d[x]] = d->u[x];
+	d->d[d->u[x]] = d->d[x];
+	d->size[d->col[x]]--;
+    }
+    dlx_push_undo(d, row*3 + UNDO_REMOVE);
+}
+
+int dlx_checkpoint(dlx *d)
+{
+    return d->nundo;
+}
+
+void dlx_rollback(dlx *d, int checkpoint)
+{
+    int x;
+
+    assert(checkpoint >= 0 && checkpoint <= d->nundo);
+    while (d->nundo > checkpoint) {
+	int entry = d->undo[--d->nundo], row = entry / 3;
+
+	switch (entry % 3) {
+	  case UNDO_SELECT:
+	    for (x = d->rowstart[row+1]; x-- > d->rowstart[row] ;)
+		dlx_uncover(d, d->col[x]);
+	    break;
+	  case UNDO_REMOVE:
+	    for (x = d->rowstart[row+1]; x-- > d->rowstart[row] ;) {
+		d->size[d->col[x]]++;
+		d->u[d->d[x]] = x;
+		d->d[d->u[x]] = x;
+	    }
+	    break;
+	}
+	d->removed[row] = FALSE;
+    }
+}
+
+/*
+ * Returns TRUE once `limit' solutions have been found, after
+ * putting back everything it covered.
+ */
+static int dlx_search(dlx *d, int depth, int limit, int *count,
+		      int *solution)
+{
+    int c, h, x, j, done = FALSE;
+
+    if (d->r[0] == 0) {
+	if (++*count == 1 && solution) {
+	    int i, n = 0;
+	    for (i = 0; i < d->nundo; i++)
+		if (d->undo[i] % 3 == UNDO_SELECT)
+		    solution[n++] = d->undo[i] / 3;
+	    for (i = 0; i < depth; i++)
+		solution[n++] = d->stack[i];
+	    solution[n] = -1;
+	}
+	return *count >= limit;
+    }
+
+    /*
+     * Branch on the column with fewest rows left in it.
+     */
+    c = d->r[0];
+    for (h = d->r[c]; h != 0; h = d->r[h])
+	if (d->size[h] < d->size[c])
+	    c = h;
+    if (d->size[c] == 0)
+	return FALSE;
+
+    dlx_cover(d, c);
+    for (x = d->d[c]; x != c && !done; x = d->d[x]) {
+	d->stack[depth] = d->row[x];
+	for (j = d->r[x]; j != x; j = d->r[j])
+	    dlx_cover(d, d->col[j]);
+	done = dlx_search(d, depth + 1, limit, count, solution);
+	for (j = d->l[x]; j != x; j = d->l[j])
+	    dlx_uncover(d, d->col[j]);
+    }
+    dlx_uncover(d, c);
+
+    return done;
+}
+
+int dlx_solve(dlx *d, int limit, int *solution)
+{
+    int count = 0;
+
+    assert(limit > 0);
+    dlx_search(d, 0, limit, &count, solution);
+    return count;
+}
@@ -0,0 +1,65 @@
+/*
+ * dlx.h: header for dlx.c, a reusable exact cover solver using
+ * Knuth's dancing links.
+ *
+ * An exact cover problem is a matrix of 0s and 1s, described here
+ * as a list of rows each giving the columns in which it has a 1. A
+ * solution is a set of rows with exactly one 1 in every column.
+ * Generators which only want to know whether a puzzle still has a
+ * unique solution can describe it this way once, and then ask
+ * again and again as clues come and go without rebuilding
+ * anything.
+ */
+
+#ifndef DLX_DLX_H
+#define DLX_DLX_H
+
+typedef struct dlx dlx;
+
+/*
+ * Create a matrix with `ncols' columns and no rows yet.
+ */
+dlx *dlx_new(int ncols);
+void dlx_free(dlx *d);
+
+/*
+ * Add a row with a 1 in each of the `n' columns listed in `cols',
+ * and return its index. Rows are numbered from 0 in the order they
+ * were added. All rows must be added before any of the functions
+ * below are called.
+ */
+int dlx_add_row(dlx *d, const int *cols, int n);
+
+/*
+ * Force a row into every solution, as if it were a clue: its
+ * columns are covered and every row clashing with it is hidden.
+ * Returns FALSE, changing nothing, if the row clashes with a row
+ * already selected or has been removed.
+ */
+int dlx_select_row(dlx *d, int row);
+
+/*
+ * Forbid a row from appearing in any solution. Removing a row
+ * which is already hidden by a selected row is harmless.
+ */
+void dlx_remove_row(dlx *d, int row);
+
+/*
+ * Selections and removals are undone in reverse order, back to a
+ * point returned earlier by dlx_checkpoint.
+ */
+int dlx_checkpoint(dlx *d);
+void dlx_rollback(dlx *d, int checkpoint);
+
+/*
+ * Count the solutions consistent with the current selections and
+ * removals, stopping as soon as `limit' have been found (pass 2 to
+ * ask whether the solution is unique). If `solution' is non-NULL
+ * and at least one solution exists, the first one found is written
+ * to it as a list of row indices, selected rows first, terminated
+ * by -1; it needs room for one more entry than there are columns.
+ * The matrix is left as it was found.
+ */
+int dlx_solve(dlx *d, int limit, int *solution);
+
+#endif /* DLX_DLX_H */
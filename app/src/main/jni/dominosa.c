@@ -252,6 +252,54 @@ static int find_overlaps(int w, int h, int placement, int *set)
     return n;
 }
 
+/*
+ * Returns 0, 1 or 2 for number of solutions. 2 means `any number
+ * more than one', or more accurately `we were unable to prove
+ * there was only one'.
+ * 
+ * Outputs in a `placements' array, indexed the same way as the one
+ * within this function (see below); entries in there are <0 for a
+ * placement ruled out, 0 for an uncertain placement, and 1 for a
+ * definite one.
+ */
+/*
+ * Rule out a placement: unlink it from its domino's list, and queue
+ * up the domino and the two squares it covered, since those are the
+ * only deductions whose inputs have changed. Returns FALSE if that
+ * leaves the domino with nowhere to go.
+ */
+static int solver_rule_out(int w, const int *grid, int j, int dc,
+                           int *placements, int *prev, int *heads,
+                           int *counts, int *queue, int *qtail, int *qlen,
+                           int qsize, unsigned char *queued)
+{
+    int p1 = j / 2, p2 = (j & 1) ? p1 + 1 : p1 + w;
+    int di = DINDEX(grid[p1], grid[p2]);
+    int items[3], k;
+
+    assert(placements[j] >= -1);
+    if (prev[j] < 0)
+        heads[di] = placements[j];
+    else
+        placements[prev[j]] = placements[j];
+    if (placements[j] >= 0)
+        prev[placements[j]] = prev[j];
+    placements[j] = -2;
+
+    items[0] = di;
+    items[1] = dc + p1;
+    items[2] = dc + p2;
+    for (k = 0; k < 3; k++)
+        if (!queued[items[k]]) {
+            queued[items[k]] = TRUE;
+            queue[*qtail] = items[k];
+            *qtail = (*qtail + 1) % qsize;
+            (*qlen)++;
+        }
+
+    return --counts[di] > 0;
+}
+
 /*
  * Returns 0, 1 or 2 for number of solutions. 2 means `any number
  * more than one', or more accurately `we were unable to prove
@@ -265,7 +313,9 @@ static int find_overlaps(int w, int h, int placement, int *set)
 static int solver(int w, int h, int n, int *grid, int *output)
 {
     int wh = w*h, dc = DCOUNT(n);
-    int *placements, *heads;
+    int *placements, *prev, *heads, *counts, *queue;
+    unsigned char *queued;
+    int qsize = dc + wh, qhead, qtail, qlen;
     int i, j, x, y, ret;
 
     /*
@@ -284,19 +334,26 @@ static int solver(int w, int h, int n, int *grid, int *output)
      * 
      * Oh, and -3 for `not even valid', used for array indices
      * which don't even represent a plausible placement.
+     *
+     * `prev' links the lists the other way (-1 at the head), so
+     * that a placement can be unlinked without walking its list.
      */
     placements = snewn(2*wh, int);
+    prev = snewn(2*wh, int);
     for (i = 0; i < 2*wh; i++)
         placements[i] = -3;            /* not even valid */
 
     /*
      * This array has one entry for every domino, and it is an
      * index into `placements' denoting the head of the placement
-     * list for that domino.
+     * list for that domino. `counts' holds the length of each list.
      */
     heads = snewn(dc, int);
-    for (i = 0; i < dc; i++)
+    counts = snewn(dc, int);
+    for (i = 0; i < dc; i++) {
         heads[i] = -1;
+        counts[i] = 0;
+    }
 
     /*
      * Set up the initial possibility lists by scanning the grid.
@@ -305,13 +362,21 @@ static int solver(int w, int h, int n, int *grid, int *output)
         for (x = 0; x < w; x++) {
             int di = DINDEX(grid[y*w+x], grid[(y+1)*w+x]);
             placements[(y*w+x)*2] = heads[di];
+            prev[(y*w+x)*2] = -1;
+            if (heads[di] >= 0)
+                prev[heads[di]] = (y*w+x)*2;
             heads[di] = (y*w+x)*2;
+            counts[di]++;
         }
     for (y = 0; y < h; y++)
         for (x = 0; x < w-1; x++) {
             int di = DINDEX(grid[y*w+x], grid[y*w+(x+1)]);
             placements[(y*w+x)*2+1] = heads[di];
+            prev[(y*w+x)*2+1] = -1;
+            if (heads[di] >= 0)
+                prev[heads[di]] = (y*w+x)*2+1;
             heads[di] = (y*w+x)*2+1;
+            counts[di]++;
         }
 
 #ifdef SOLVER_DIAGNOSTICS
@@ -327,26 +392,48 @@ static int solver(int w, int h, int n, int *grid, int *output)
         }
 #endif
 
-    while (1) {
-        int done_something = FALSE;
+    /*
+     * Both kinds of deduction below only ever rule placements out,
+     * and each depends only on the placements of one domino or of
+     * those covering one square. So rather than sweeping the whole
+     * grid until nothing changes, we keep a queue of the dominoes
+     * (numbered from 0) and squares (numbered from dc) which have
+     * lost a placement since we last looked at them, which reaches
+     * the same end result.
+     */
+    queue = snewn(qsize, int);
+    queued = snewn(qsize, unsigned char);
+    for (i = 0; i < qsize; i++) {
+        queue[i] = i;
+        queued[i] = TRUE;
+    }
+    qhead = qtail = 0;
+    qlen = qsize;
 
-        /*
-         * For each domino, look at its possible placements, and
-         * for each placement consider the placements (of any
-         * domino) it overlaps. Any placement overlapped by all
-         * placements of this domino can be ruled out.
-         * 
-         * Each domino placement overlaps only six others, so we
-         * need not do serious set theory to work this out.
-         */
-        for (i = 0; i < dc; i++) {
+    for (i = 0; i < dc; i++)
+        if (heads[i] == -1) {          /* no placement for this domino */
+            ret = 0;                   /* therefore puzzle is impossible */
+            goto done;
+        }
+
+    do {
+        i = queue[qhead];
+        qhead = (qhead + 1) % qsize;
+        qlen--;
+        queued[i] = FALSE;
+
+        if (i < dc) {
+            /*
+             * For this domino, look at its possible placements,
+             * and for each placement consider the placements (of
+             * any domino) it overlaps. Any placement overlapped by
+             * all placements of this domino can be ruled out.
+             *
+             * Each domino placement overlaps only six others, so
+             * we need not do serious set theory to work this out.
+             */
             int permset[6], permlen = 0, p;
-            
 
-            if (heads[i] == -1) {      /* no placement for this domino */
-                ret = 0;               /* therefore puzzle is impossible */
-                goto done;
-            }
             for (j = heads[i]; j >= 0; j = placements[j]) {
                 assert(placements[j] != -2);
 
@@ -376,66 +463,49 @@ static int solver(int w, int h, int n, int *grid, int *output)
             for (p = 0; p < permlen; p++) {
                 j = permset[p];
                 if (placements[j] != -2) {
-                    int p1, p2, di;
-
-                    done_something = TRUE;
-
-                    /*
-                     * Rule out this placement. First find what
-                     * domino it is...
-                     */
-                    p1 = j / 2;
-                    p2 = (j & 1) ? p1 + 1 : p1 + w;
-                    di = DINDEX(grid[p1], grid[p2]);
 #ifdef SOLVER_DIAGNOSTICS
-                    printf("considering domino %d: ruling out placement %d"
-                           " for %d\n", i, j, di);
+                    printf("considering domino %d: ruling out placement %d\n",
+                           i, j);
 #endif
-
-                    /*
-                     * ... then walk that domino's placement list,
-                     * removing this placement when we find it.
-                     */
-                    if (heads[di] == j)
-                        heads[di] = placements[j];
-                    else {
-                        int k = heads[di];
-                        while (placements[k] != -1 && placements[k] != j)
-                            k = placements[k];
-                        assert(placements[k] == j);
-                        placements[k] = placements[j];
+                    if (!solver_rule_out(w, grid, j, dc, placements, prev,
+                                         heads, counts, queue, &qtail,
+                                         &qlen, qsize, queued)) {
+                        ret = 0;
+                        goto done;
                     }
-                    placements[j] = -2;
                 }
             }
-        }
-
-        /*
-         * For each square, look at the available placements
-         * involving that square. If all of them are for the same
-         * domino, then rule out any placements for that domino
-         * _not_ involving this square.
-         */
-        for (i = 0; i < wh; i++) {
-            int list[4], k, n, adi;
+        } else {
+            /*
+             * For this square, look at the available placements
+             * involving it. If all of them are for the same
+             * domino, then rule out any placements for that domino
+             * _not_ involving this square.
+             */
+            int list[4], k, n, adi, sq = i - dc;
 
-            x = i % w;
-            y = i / w;
+            x = sq % w;
+            y = sq / w;
 
             j = 0;
             if (x > 0)
-                list[j++] = 2*(i-1)+1;
+                list[j++] = 2*(sq-1)+1;
             if (x+1 < w)
-                list[j++] = 2*i+1;
+                list[j++] = 2*sq+1;
             if (y > 0)
-                list[j++] = 2*(i-w);
+                list[j++] = 2*(sq-w);
             if (y+1 < h)
-                list[j++] = 2*i;
+                list[j++] = 2*sq;
 
             for (n = k = 0; k < j; k++)
                 if (placements[list[k]] >= -1)
                     list[n++] = list[k];
 
+            if (n == 0) {              /* nothing can cover this square */
+                ret = 0;
+                goto done;
+            }
+
             adi = -1;
 
             for (j = 0; j < n; j++) {
@@ -452,49 +522,29 @@ static int solver(int w, int h, int n, int *grid, int *output)
                     break;
             }
 
-            if (j == n) {
-                int nn;
-
-                assert(adi >= 0);
+            if (j == n && counts[adi] > n) {
                 /*
                  * We've found something. All viable placements
-                 * involving this square are for domino `adi'. If
-                 * the current placement list for that domino is
-                 * longer than n, reduce it to precisely this
-                 * placement list and we've done something.
+                 * involving this square are for domino `adi', but
+                 * it has others too, which must all be wrong.
                  */
-                nn = 0;
-                for (k = heads[adi]; k >= 0; k = placements[k])
-                    nn++;
-                if (nn > n) {
-                    done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
-                    printf("considering square %d,%d: reducing placements "
-                           "of domino %d\n", x, y, adi);
+                printf("considering square %d,%d: reducing placements "
+                       "of domino %d\n", x, y, adi);
 #endif
-                    /*
-                     * Set all other placements on the list to
-                     * impossible.
-                     */
-                    k = heads[adi];
-                    while (k >= 0) {
-                        int tmp = placements[k];
-                        placements[k] = -2;
-                        k = tmp;
-                    }
-                    /*
-                     * Set up the new list.
-                     */
-                    heads[adi] = list[0];
-                    for (k = 0; k < n; k++)
-                        placements[list[k]] = (k+1 == n ? -1 : list[k+1]);
+                k = heads[adi];
+                while (k >= 0) {
+                    int next = placements[k];
+                    int p1 = k / 2, p2 = (k & 1) ? p1 + 1 : p1 + w;
+                    if (p1 != sq && p2 != sq)
+                        solver_rule_out(w, grid, k, dc, placements, prev,
+                                        heads, counts, queue, &qtail,
+                                        &qlen, qsize, queued);
+                    k = next;
                 }
             }
         }
-
-        if (!done_something)
-            break;
-    }
+    } while (qlen > 0);
 
 #ifdef SOLVER_DIAGNOSTICS
     printf("after solver:\n");
@@ -537,7 +587,11 @@ static int solver(int w, int h, int n, int *grid, int *output)
      * Free working data.
      */
     sfree(placements);
+    sfree(prev);
     sfree(heads);
+    sfree(counts);
+    sfree(queue);
+    sfree(queued);
 
     return ret;
 }
@@ -48,6 +48,7 @@ struct drawing {
      * this may set it to NULL. */
     midend *me;
     char *laststatus;
+    int calls;                         /* to the API, since start_draw */
 };
 
 drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
@@ -60,6 +61,7 @@ drawing *drawing_new(const drawing_api *api, midend *me, void *handle)
     dr->scale = 1.0F;
     dr->me = me;
     dr->laststatus = NULL;
+    dr->calls = 0;
     return dr;
 }
 
@@ -73,23 +75,27 @@ void drawing_free(drawing *dr)
 void draw_text(drawing *dr, int x, int y, int fonttype, int fontsize,
                int align, int colour, char *text)
 {
+    dr->calls++;
     dr->api->draw_text(dr->handle, x, y, fonttype, fontsize, align,
 		       colour, text);
 }
 
 void draw_rect(drawing *dr, int x, int y, int w, int h, int colour)
 {
+    dr->calls++;
     dr->api->draw_rect(dr->handle, x, y, w, h, colour);
 }
 
 void draw_line(drawing *dr, int x1, int y1, int x2, int y2, int colour)
 {
+    dr->calls++;
     dr->api->draw_line(dr->handle, x1, y1, x2, y2, colour);
 }
 
 void draw_thick_line(drawing *dr, float thickness,
 		     float x1, float y1, float x2, float y2, int colour)
 {
+    dr->calls++;
     if (dr->api->draw_thick_line) {
 	dr->api->draw_thick_line(dr->handle, thickness,
 				 x1, y1, x2, y2, colour);
@@ -118,6 +124,7 @@ void draw_thick_line(drawing *dr, float thickness,
 void draw_polygon(drawing *dr, int *coords, int npoints,
                   int fillcolour, int outlinecolour)
 {
+    dr->calls++;
     dr->api->draw_polygon(dr->handle, coords, npoints, fillcolour,
 			  outlinecolour);
 }
@@ -125,28 +132,33 @@ void draw_polygon(drawing *dr, int *coords, int npoints,
 void draw_circle(drawing *dr, int cx, int cy, int radius,
                  int fillcolour, int outlinecolour)
 {
+    dr->calls++;
     dr->api->draw_circle(dr->handle, cx, cy, radius, fillcolour,
 			 outlinecolour);
 }
 
 void draw_update(drawing *dr, int x, int y, int w, int h)
 {
+    dr->calls++;
     if (dr->api->draw_update)
 	dr->api->draw_update(dr->handle, x, y, w, h);
 }
 
 void clip(drawing *dr, int x, int y, int w, int h)
 {
+    dr->calls++;
     dr->api->clip(dr->handle, x, y, w, h);
 }
 
 void unclip(drawing *dr)
 {
+    dr->calls++;
     dr->api->unclip(dr->handle);
 }
 
 void start_draw(drawing *dr)
 {
+    dr->calls = 0;
     dr->api->start_draw(dr->handle);
 }
 
@@ -155,6 +167,12 @@ void end_draw(drawing *dr)
     dr->api->end_draw(dr->handle);
 }
 
+/* How many drawing calls the current or last frame has made */
+int drawing_call_count(drawing *dr)
+{
+    return dr->calls;
+}
+
 char *text_fallback(drawing *dr, const char *const *strings, int nstrings)
 {
     int i;
@@ -219,11 +237,13 @@ void blitter_free(drawing *dr, blitter *bl)
 
 void blitter_save(drawing *dr, blitter *bl, int x, int y)
 {
+    dr->calls++;
     dr->api->blitter_save(dr->handle, bl, x, y);
 }
 
 void blitter_load(drawing *dr, blitter *bl, int x, int y)
 {
+    dr->calls++;
     dr->api->blitter_load(dr->handle, bl, x, y);
 }
 
@@ -190,3 +190,131 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse)
 
 /*    fprintf(stderr, "dsf[%2d] = %2d\n", v2, dsf[v2]); */
 }
+
+/*
+ * The undoable dsf. Each element has a parent (itself, for a root)
+ * and a flag saying whether it's opposite to that parent; roots also
+ * hold the size of their class. A merge only ever hangs one root off
+ * another, so the trail of merges need only record which root that
+ * was, and there can never be more than size-1 of them.
+ */
+struct udsf {
+    int size;
+    int *parent, *classsize, *trail;
+    unsigned char *inverse;
+    int ntrail;
+};
+
+udsf *udsf_new(int size)
+{
+    udsf *u = snew(udsf);
+
+    u->size = size;
+    u->parent = snewn(size * 3, int);
+    u->classsize = u->parent + size;
+    u->trail = u->classsize + size;
+    u->inverse = snewn(size, unsigned char);
+    udsf_init(u);
+    return u;
+}
+
+void udsf_free(udsf *u)
+{
+    if (!u)
+        return;
+    sfree(u->parent);
+    sfree(u->inverse);
+    sfree(u);
+}
+
+void udsf_init(udsf *u)
+{
+    int i;
+
+    for (i = 0; i < u->size; i++) {
+        u->parent[i] = i;
+        u->classsize[i] = 1;
+    }
+    memset(u->inverse, 0, u->size);
+    u->ntrail = 0;
+}
+
+int udsf_edsf_canonify(udsf *u, int index, int *inverse_return)
+{
+    int inverse = 0;
+
+    assert(index >= 0 && index < u->size);
+
+    while (u->parent[index] != index) {
+        inverse ^= u->inverse[index];
+        index = u->parent[index];
+    }
+
+    if (inverse_return)
+        *inverse_return = inverse;
+    return index;
+}
+
+int udsf_canonify(udsf *u, int index)
+{
+    return udsf_edsf_canonify(u, index, NULL);
+}
+
+int udsf_size(udsf *u, int index)
+{
+    return u->classsize[udsf_canonify(u, index)];
+}
+
+void udsf_edsf_merge(udsf *u, int v1, int v2, int inverse)
+{
+    int i1, i2;
+
+    v1 = udsf_edsf_canonify(u, v1, &i1);
+    inverse ^= i1;
+    v2 = udsf_edsf_canonify(u, v2, &i2);
+    inverse ^= i2;
+
+    if (v1 == v2) {
+        assert(!inverse);
+        return;
+    }
+    assert(inverse == 0 || inverse == 1);
+
+    /* Hang the smaller class off the larger, so that paths stay short
+     * without compressing them. */
+    if (u->classsize[v1] < u->classsize[v2]) {
+        int v3 = v1;
+        v1 = v2;
+        v2 = v3;
+    }
+    u->parent[v2] = v1;
+    u->inverse[v2] = inverse;
+    u->classsize[v1] += u->classsize[v2];
+
+    assert(u->ntrail < u->size);
+    u->trail[u->ntrail++] = v2;
+}
+
+void udsf_merge(udsf *u, int v1, int v2)
+{
+    udsf_edsf_merge(u, v1, v2, FALSE);
+}
+
+int udsf_checkpoint(udsf *u)
+{
+    return u->ntrail;
+}
+
+void udsf_rollback(udsf *u, int checkpoint)
+{
+    assert(checkpoint >= 0 && checkpoint <= u->ntrail);
+
+    while (u->ntrail > checkpoint) {
+        int v2 = u->trail[--u->ntrail];
+        int v1 = u->parent[v2];
+
+        u->classsize[v1] -= u->classsize[v2];
+        u->parent[v2] = v2;
+        u->inverse[v2] = 0;
+    }
+}
@@ -19,6 +19,7 @@
 #define FROMCOORD(x)  ( ((x) - BORDER + TILE_SIZE) / TILE_SIZE - 1 )
 
 #define ANIM_TIME 0.13F
+#define SOLVE_ANIM_TIME 0.06F	       /* per move of an animated solve */
 #define FLASH_FRAME 0.13F
 
 #define X(state, i) ( (i) % (state)->w )
@@ -44,6 +45,7 @@ struct game_state {
     int completed;
     int used_solve;		       /* used to suppress completion flash */
     int movecount;
+    char *solvepath;		       /* gap moves, if reached by a solve */
 };
 
 static game_params *default_params(void)
@@ -359,6 +361,7 @@ static game_state *new_game(midend *me, const game_params *params,
 
     state->completed = state->movecount = 0;
     state->used_solve = FALSE;
+    state->solvepath = NULL;
 
     return state;
 }
@@ -376,6 +379,7 @@ static game_state *dup_game(const game_state *state)
     ret->completed = state->completed;
     ret->movecount = state->movecount;
     ret->used_solve = state->used_solve;
+    ret->solvepath = NULL;
 
     return ret;
 }
@@ -383,13 +387,370 @@ static game_state *dup_game(const game_state *state)
 static void free_game(game_state *state)
 {
     sfree(state->tiles);
+    sfree(state->solvepath);
     sfree(state);
 }
 
+/* ----------------------------------------------------------------------
+ * Solver.
+ *
+ * We look for an optimal solution by IDA*, guided by an additive
+ * pattern database: the tiles are split into groups, and for each
+ * group a table gives the fewest moves of that group's tiles needed
+ * to bring them home, ignoring all the other tiles. No move shifts
+ * tiles from two groups at once, so the sum over the groups is a
+ * lower bound on the real distance. On a square board we can also
+ * look the tables up for the board reflected in its main diagonal,
+ * which is just as far from solved, and take the larger answer.
+ *
+ * The tables take a while to build, so we keep the last set around
+ * for the next Solve. We only try this on boards of up to 16
+ * squares; beyond that the search would rarely finish in reasonable
+ * time anyway, and we fall back to snapping the grid into its solved
+ * state, as we also do if the search goes on too long.
+ */
+
+#define SOLVER_MAX_AREA 16
+#define SOLVER_MAX_ENTRIES (1L << 20)
+#define SOLVER_MAX_NODES 20000000L
+
+struct pattern_db {
+    int w, h, n;
+    int ngroups;
+    int *group;			       /* group of each tile, -1 for the gap */
+    long *weight;		       /* each tile's weight in its group's index */
+    int *mirror;		       /* reflection of each tile and square */
+    int *gstart;		       /* group g is tiles 1+gstart[g]..gstart[g+1] */
+    unsigned char **table;
+};
+
+static struct pattern_db *cached_pdb = NULL;
+
+/*
+ * Fill in the table for the k tiles from first onwards. A placement
+ * of them is indexed by treating their squares as the digits of a
+ * base-n number, which wastes some entries on impossible placements
+ * but lets a move update the index with one addition.
+ *
+ * We search breadth-first over placements of just those tiles,
+ * letting one step onto any adjacent square the others leave free,
+ * as if the gap could always be got there at no cost. That makes the
+ * bound a little weaker, but means one visit per table entry.
+ */
+static unsigned char *pdb_build_table(int w, int h, int first, int k)
+{
+    int n = w * h;
+    long entries, head, tail, idx;
+    unsigned char *table;
+    int *queue;
+    int i;
+
+    entries = 1;
+    for (i = 0; i < k; i++)
+	entries *= n;
+
+    table = snewn(entries, unsigned char);
+    memset(table, 255, entries);
+    entries = 1;
+    for (i = 0; i < k; i++)
+	entries *= n - i;
+    queue = snewn(entries, int);
+
+    idx = 0;
+    for (i = k; i-- > 0 ;)
+	idx = idx * n + (first + i - 1);
+    head = tail = 0;
+    queue[tail++] = idx;
+    table[idx] = 0;
+
+    while (head < tail) {
+	int pos[SOLVER_MAX_AREA], used = 0, dir;
+	long weight, rest;
+
+	idx = queue[head++];
+	for (i = 0, rest = idx; i < k; i++, rest /= n) {
+	    pos[i] = rest % n;
+	    used |= 1 << pos[i];
+	}
+
+	for (i = 0, weight = 1; i < k; i++, weight *= n) {
+	    int p = pos[i];
+
+	    for (dir = 0; dir < 4; dir++) {
+		int c;
+		long nidx;
+
+		if (dir == 0 && p >= w) c = p - w;
+		else if (dir == 1 && p < n - w) c = p + w;
+		else if (dir == 2 && p % w > 0) c = p - 1;
+		else if (dir == 3 && p % w < w - 1) c = p + 1;
+		else continue;
+		if (used & (1 << c))
+		    continue;
+
+		nidx = idx + (c - p) * weight;
+		if (table[nidx] == 255) {
+		    table[nidx] = table[idx] + 1;
+		    queue[tail++] = nidx;
+		}
+	    }
+	}
+    }
+
+    sfree(queue);
+    return table;
+}
+
+static void pdb_free(struct pattern_db *pdb)
+{
+    int g;
+
+    for (g = 0; g < pdb->ngroups; g++)
+	sfree(pdb->table[g]);
+    sfree(pdb->table);
+    sfree(pdb->group);
+    sfree(pdb->weight);
+    sfree(pdb->mirror);
+    sfree(pdb->gstart);
+    sfree(pdb);
+}
+
+static struct pattern_db *pdb_get(int w, int h)
+{
+    struct pattern_db *pdb;
+    int n = w * h, k, g, t;
+    long entries;
+
+    if (cached_pdb && cached_pdb->w == w && cached_pdb->h == h)
+	return cached_pdb;
+    if (cached_pdb)
+	pdb_free(cached_pdb);
+
+    /* Use groups as large as will keep each table a sensible size. */
+    entries = n;
+    for (k = 1; k < n-1 && entries * n <= SOLVER_MAX_ENTRIES; k++)
+	entries *= n;
+
+    pdb = snew(struct pattern_db);
+    pdb->w = w;
+    pdb->h = h;
+    pdb->n = n;
+    pdb->ngroups = (n - 1 + k - 1) / k;
+    pdb->group = snewn(n, int);
+    pdb->weight = snewn(n, long);
+    pdb->mirror = NULL;
+    pdb->gstart = snewn(pdb->ngroups + 1, int);
+    pdb->table = snewn(pdb->ngroups, unsigned char *);
+
+    pdb->group[0] = -1;
+    pdb->weight[0] = 0;
+    for (t = 1; t < n; t++) {
+	pdb->group[t] = (t - 1) / k;
+	pdb->weight[t] = ((t - 1) % k == 0 ? 1 : pdb->weight[t-1] * n);
+    }
+    for (g = 0; g <= pdb->ngroups; g++)
+	pdb->gstart[g] = min(g * k, n - 1);
+    for (g = 0; g < pdb->ngroups; g++)
+	pdb->table[g] = pdb_build_table(w, h, 1 + pdb->gstart[g],
+					pdb->gstart[g+1] - pdb->gstart[g]);
+
+    /*
+     * Reflecting a square board leaves the gap's home where it is,
+     * and takes square i to the home of tile mirror[i]+1.
+     */
+    if (w == h) {
+	pdb->mirror = snewn(n, int);
+	for (t = 0; t < n; t++)
+	    pdb->mirror[t] = (t % w) * w + t / w;
+    }
+
+    cached_pdb = pdb;
+    return pdb;
+}
+
+struct solver_ctx {
+    const struct pattern_db *pdb;
+    int w, n;
+    int *tiles, gap;
+    long *gidx;			       /* current table index per group */
+    long *ridx;			       /* the same for the reflected board */
+    char *path;
+    long nodes;
+    int bound, nextbound;
+};
+
+/*
+ * Returns +1 if a solution was found within the bound, 0 if not, and
+ * -1 if we ran out of patience.
+ */
+static int solver_dfs(struct solver_ctx *ctx, int depth, int h1, int h2,
+		      int last)
+{
+    static const char dirs[] = "UDLR";
+    const struct pattern_db *pdb = ctx->pdb;
+    int dir, hval = max(h1, h2);
+
+    if (hval == 0) {
+	ctx->path[depth] = '\0';
+	return +1;
+    }
+    if (depth + hval > ctx->bound) {
+	if (ctx->nextbound < 0 || depth + hval < ctx->nextbound)
+	    ctx->nextbound = depth + hval;
+	return 0;
+    }
+    if (++ctx->nodes > SOLVER_MAX_NODES)
+	return -1;
+
+    for (dir = 0; dir < 4; dir++) {
+	int gap = ctx->gap, c, t, g, rt, rg = 0, nh1, nh2, ret;
+	long oldidx, oldridx = 0;
+
+	if ((dir ^ 1) == last)
+	    continue;		       /* don't just undo the last move */
+	if (dir == 0 && gap >= ctx->w) c = gap - ctx->w;
+	else if (dir == 1 && gap < ctx->n - ctx->w) c = gap + ctx->w;
+	else if (dir == 2 && gap % ctx->w > 0) c = gap - 1;
+	else if (dir == 3 && gap % ctx->w < ctx->w - 1) c = gap + 1;
+	else continue;
+
+	t = ctx->tiles[c];
+	g = pdb->group[t];
+	ctx->tiles[gap] = t;
+	ctx->tiles[c] = 0;
+	ctx->gap = c;
+	oldidx = ctx->gidx[g];
+	ctx->gidx[g] += (gap - c) * pdb->weight[t];
+	nh1 = h1 - pdb->table[g][oldidx] + pdb->table[g][ctx->gidx[g]];
+	nh2 = h2;
+	if (pdb->mirror) {
+	    rt = pdb->mirror[t-1] + 1;
+	    rg = pdb->group[rt];
+	    oldridx = ctx->ridx[rg];
+	    ctx->ridx[rg] += (pdb->mirror[gap] - pdb->mirror[c]) *
+		pdb->weight[rt];
+	    nh2 += pdb->table[rg][ctx->ridx[rg]] - pdb->table[rg][oldridx];
+	}
+
+	ctx->path[depth] = dirs[dir];
+	ret = solver_dfs(ctx, depth + 1, nh1, nh2, dir);
+
+	if (pdb->mirror)
+	    ctx->ridx[rg] = oldridx;
+	ctx->gidx[g] = oldidx;
+	ctx->gap = gap;
+	ctx->tiles[c] = t;
+	ctx->tiles[gap] = 0;
+
+	if (ret != 0)
+	    return ret;
+    }
+    return 0;
+}
+
+/*
+ * Returns a dynamically allocated string of gap moves, or NULL if
+ * the board is too big or the search took too long.
+ */
+static char *solve_optimally(const game_state *state)
+{
+    struct solver_ctx ctx[1];
+    const struct pattern_db *pdb;
+    int i, g, h1, h2, ret;
+
+    if (state->n > SOLVER_MAX_AREA)
+	return NULL;
+
+    ctx->pdb = pdb = pdb_get(state->w, state->h);
+    ctx->w = state->w;
+    ctx->n = state->n;
+    ctx->tiles = snewn(ctx->n, int);
+    ctx->gidx = snewn(pdb->ngroups, long);
+    ctx->ridx = snewn(pdb->ngroups, long);
+    for (g = 0; g < pdb->ngroups; g++)
+	ctx->gidx[g] = ctx->ridx[g] = 0;
+    for (i = 0; i < ctx->n; i++) {
+	int t = state->tiles[i];
+	ctx->tiles[i] = t;
+	if (t) {
+	    ctx->gidx[pdb->group[t]] += i * pdb->weight[t];
+	    if (pdb->mirror) {
+		int rt = pdb->mirror[t-1] + 1;
+		ctx->ridx[pdb->group[rt]] += pdb->mirror[i] * pdb->weight[rt];
+	    }
+	}
+    }
+    ctx->gap = state->gap_pos;
+    h1 = h2 = 0;
+    for (g = 0; g < pdb->ngroups; g++) {
+	h1 += pdb->table[g][ctx->gidx[g]];
+	if (pdb->mirror)
+	    h2 += pdb->table[g][ctx->ridx[g]];
+    }
+    ctx->nodes = 0;
+    ctx->path = NULL;
+
+    ctx->bound = max(h1, h2);
+    while (1) {
+	ctx->path = sresize(ctx->path, ctx->bound + 1, char);
+	ctx->nextbound = -1;
+	ret = solver_dfs(ctx, 0, h1, h2, -1);
+	if (ret != 0 || ctx->nextbound < 0)
+	    break;
+	ctx->bound = ctx->nextbound;
+    }
+
+    sfree(ctx->tiles);
+    sfree(ctx->gidx);
+    sfree(ctx->ridx);
+    if (ret <= 0) {
+	sfree(ctx->path);
+	return NULL;
+    }
+    return ctx->path;
+}
+
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *aux, char **error)
 {
-    return dupstr("S");
+    char *path = solve_optimally(currstate), *ret;
+
+    if (!path || !*path) {
+	sfree(path);
+	return dupstr("S");
+    }
+    ret = snewn(strlen(path) + 2, char);
+    ret[0] = 'P';
+    strcpy(ret + 1, path);
+    sfree(path);
+    return ret;
+}
+
+/*
+ * Apply the first nsteps gap moves of a solve path to the tiles of
+ * base, writing the result into tiles. Returns the new gap position,
+ * or -1 if the path runs off the board.
+ */
+static int replay_path(const game_state *base, const char *path, int nsteps,
+		       int *tiles)
+{
+    int gap = base->gap_pos, i;
+
+    memcpy(tiles, base->tiles, base->n * sizeof(int));
+    for (i = 0; i < nsteps; i++) {
+	int c;
+
+	if (path[i] == 'U' && gap >= base->w) c = gap - base->w;
+	else if (path[i] == 'D' && gap < base->n - base->w) c = gap + base->w;
+	else if (path[i] == 'L' && gap % base->w > 0) c = gap - 1;
+	else if (path[i] == 'R' && gap % base->w < base->w - 1) c = gap + 1;
+	else return -1;
+
+	tiles[gap] = tiles[c];
+	tiles[c] = 0;
+	gap = c;
+    }
+    return gap;
 }
 
 static int game_can_format_as_text_now(const game_params *params)
@@ -536,6 +897,22 @@ static game_state *execute_move(const game_state *from, const char *move)
 	return ret;
     }
 
+    if (move[0] == 'P') {
+	int len = strlen(move+1);
+
+	ret = dup_game(from);
+	ret->gap_pos = replay_path(from, move+1, len, ret->tiles);
+	if (ret->gap_pos < 0) {
+	    free_game(ret);
+	    return NULL;
+	}
+	ret->solvepath = dupstr(move+1);
+	ret->used_solve = TRUE;
+	ret->movecount += len;
+	ret->completed = ret->movecount;
+	return ret;
+    }
+
     gx = X(from, from->gap_pos);
     gy = Y(from, from->gap_pos);
 
@@ -677,6 +1054,38 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
                         float animtime, float flashtime)
 {
     int i, pass, bgcolour;
+    const game_state *realold = oldstate, *realnew = state;
+    game_state afrom, ato;
+
+    afrom.tiles = ato.tiles = NULL;
+    if (oldstate && (dir > 0 ? state : oldstate)->solvepath) {
+	/*
+	 * Animating a solve (or its undo): pick out the single move
+	 * of the path that is in progress, and animate just that.
+	 */
+	const game_state *base = (dir > 0 ? oldstate : state);
+	const char *path = (dir > 0 ? state : oldstate)->solvepath;
+	int len = strlen(path), k;
+
+	k = (int)(animtime / SOLVE_ANIM_TIME);
+	if (k > len - 1) k = len - 1;
+	if (k < 0) k = 0;
+	animtime = (animtime - k * SOLVE_ANIM_TIME) *
+	    (ANIM_TIME / SOLVE_ANIM_TIME);
+
+	afrom = ato = *base;
+	afrom.tiles = snewn(base->n, int);
+	ato.tiles = snewn(base->n, int);
+	if (dir > 0) {
+	    afrom.gap_pos = replay_path(base, path, k, afrom.tiles);
+	    ato.gap_pos = replay_path(base, path, k+1, ato.tiles);
+	} else {
+	    afrom.gap_pos = replay_path(base, path, len-k, afrom.tiles);
+	    ato.gap_pos = replay_path(base, path, len-k-1, ato.tiles);
+	}
+	oldstate = &afrom;
+	state = &ato;
+    }
 
     if (flashtime > 0) {
         int frame = (int)(flashtime / FLASH_FRAME);
@@ -802,6 +1211,10 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
         }
     }
     ds->bgcolour = bgcolour;
+    sfree(afrom.tiles);
+    sfree(ato.tiles);
+    oldstate = realold;
+    state = realnew;
 
     /*
      * Update the status bar.
@@ -835,6 +1248,10 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 static float game_anim_length(const game_state *oldstate,
                               const game_state *newstate, int dir, game_ui *ui)
 {
+    const game_state *s = (dir > 0 ? newstate : oldstate);
+
+    if (s->solvepath)
+	return strlen(s->solvepath) * SOLVE_ANIM_TIME;
     return ANIM_TIME;
 }
 
@@ -911,5 +1328,5 @@ const struct game thegame = {
 #endif
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    SOLVE_ANIMATES,		       /* flags */
 };
@@ -301,6 +301,7 @@ struct solver_state
     int *dsf;
     int *board;
     int *connected;
+    int *flooded; /* scratch for check_capacity */
     int nempty;
 };
 
@@ -454,22 +455,27 @@ static void expand(struct solver_state *s, int w, int h, int t, int f) {
     --s->nempty;
 }
 
-static void clear_count(int *board, int sz) {
-    int i;
-    for (i = 0; i < sz; ++i) {
-        if (board[i] >= 0) continue;
-        else if (board[i] == -SENTINEL) board[i] = EMPTY;
+/* Undo the marks left by flood_count, which are only ever on the
+ * squares it lists in flooded (at most n of them), rather than
+ * sweeping the whole board. */
+static void clear_count(int *board, int sz, const int *flooded, int nflooded) {
+    int k;
+    for (k = 0; k < nflooded; ++k) {
+        const int i = flooded[k];
+        if (board[i] == -SENTINEL) board[i] = EMPTY;
         else board[i] = -board[i];
     }
 }
 
-static void flood_count(int *board, int w, int h, int i, int n, int *c) {
+static void flood_count(int *board, int w, int h, int i, int n, int *c,
+                        int *flooded, int *nflooded) {
     const int sz = w * h;
     int k;
 
     if (board[i] == EMPTY) board[i] = -SENTINEL;
     else if (board[i] == n) board[i] = -board[i];
     else return;
+    flooded[(*nflooded)++] = i;
 
     if (--*c == 0) return;
 
@@ -478,15 +484,21 @@ static void flood_count(int *board, int w, int h, int i, int n, int *c) {
         const int y = (i / w) + dy[k];
         const int idx = w*y + x;
         if (x < 0 || x >= w || y < 0 || y >= h) continue;
-        flood_count(board, w, h, idx, n, c);
+        flood_count(board, w, h, idx, n, c, flooded, nflooded);
 	if (*c == 0) return;
     }
 }
 
-static int check_capacity(int *board, int w, int h, int i) {
-    int n = board[i];
-    flood_count(board, w, h, i, board[i], &n);
-    clear_count(board, w * h);
+/* Can the region at i still reach its full size if the empty square
+ * `blocked' is kept out of it? */
+static int check_capacity(int *board, int w, int h, int i, int blocked,
+                          int *flooded) {
+    const int sz = w * h;
+    int n = board[i], nflooded = 0;
+    board[blocked] = -SENTINEL;
+    flood_count(board, w, h, i, board[i], &n, flooded, &nflooded);
+    board[blocked] = EMPTY;
+    clear_count(board, sz, flooded, nflooded);
     return n == 0;
 }
 
@@ -582,6 +594,7 @@ static void init_solver_state(struct solver_state *s, int w, int h) {
     assert(s);
 
     s->nempty = 0;
+    dsf_init(s->dsf, sz);
     for (i = 0; i < sz; ++i) s->connected[i] = i;
     for (i = 0; i < sz; ++i)
         if (s->board[i] == EMPTY) ++s->nempty;
@@ -616,8 +629,7 @@ static int learn_expand_or_one(struct solver_state *s, int w, int h) {
 					      i, s->board[idx]))))
 		one = FALSE;
 	    assert(s->board[i] == EMPTY);
-	    s->board[i] = -SENTINEL;
-	    if (check_capacity(s->board, w, h, idx)) continue;
+	    if (check_capacity(s->board, w, h, idx, i, s->flooded)) continue;
 	    assert(s->board[i] == EMPTY);
 	    printv("learn: expanding in one\n");
 	    expand(s, w, h, i, idx);
@@ -745,8 +757,7 @@ static int learn_critical_square(struct solver_state *s, int w, int h) {
 	/* for each empty square */
 	for (j = 0; j < sz; ++j) {
 	    if (s->board[j] != EMPTY) continue;
-	    s->board[j] = -SENTINEL;
-	    if (check_capacity(s->board, w, h, i)) continue;
+	    if (check_capacity(s->board, w, h, i, j, s->flooded)) continue;
 	    /* if not expanding s->board[i] to s->board[j] implies
 	     * that s->board[i] can't reach its full size, ... */
 	    assert(s->nempty);
@@ -762,45 +773,67 @@ static int learn_critical_square(struct solver_state *s, int w, int h) {
     return learn;
 }
 
-static int solver(const int *orig, int w, int h, char **solution) {
+static void new_solver_state(struct solver_state *s, int w, int h) {
     const int sz = w * h;
-
-    struct solver_state ss;
-    ss.board = memdup(orig, sz, sizeof (int));
-    ss.dsf = snew_dsf(sz); /* eqv classes: connected components */
-    ss.connected = snewn(sz, int); /* connected[n] := n.next; */
+    s->board = snewn(sz, int);
+    s->dsf = snew_dsf(sz); /* eqv classes: connected components */
+    s->connected = snewn(sz, int); /* connected[n] := n.next; */
     /* cyclic disjoint singly linked lists, same partitioning as dsf.
      * The lists lets you iterate over a partition given any member */
+    s->flooded = snewn(sz, int);
+}
+
+static void free_solver_state(struct solver_state *s) {
+    sfree(s->dsf);
+    sfree(s->board);
+    sfree(s->connected);
+    sfree(s->flooded);
+}
+
+/* ss is allocated by the caller, so that one can be reused for many
+ * boards of the same size. */
+static int solve_board(struct solver_state *ss, const int *orig, int w, int h,
+                       char **solution) {
+    const int sz = w * h;
+
+    memcpy(ss->board, orig, sz * sizeof (int));
 
     printv("trying to solve this:\n");
-    print_board(ss.board, w, h);
+    print_board(ss->board, w, h);
 
-    init_solver_state(&ss, w, h);
+    init_solver_state(ss, w, h);
     do {
-	if (learn_blocked_expansion(&ss, w, h)) continue;
-	if (learn_expand_or_one(&ss, w, h)) continue;
-	if (learn_critical_square(&ss, w, h)) continue;
+	if (learn_blocked_expansion(ss, w, h)) continue;
+	if (learn_expand_or_one(ss, w, h)) continue;
+	if (learn_critical_square(ss, w, h)) continue;
 	break;
-    } while (ss.nempty);
+    } while (ss->nempty);
 
     printv("best guess:\n");
-    print_board(ss.board, w, h);
+    print_board(ss->board, w, h);
 
     if (solution) {
         int i;
         *solution = snewn(sz + 2, char);
         **solution = 's';
-        for (i = 0; i < sz; ++i) (*solution)[i + 1] = ss.board[i] + '0';
+        for (i = 0; i < sz; ++i) (*solution)[i + 1] = ss->board[i] + '0';
         (*solution)[sz + 1] = '\0';
         /* We don't need the \0 for execute_move (the only user)
          * I'm just being printf-friendly in case I wanna print */
     }
 
-    sfree(ss.dsf);
-    sfree(ss.board);
-    sfree(ss.connected);
+    return !ss->nempty;
+}
+
+static int solver(const int *orig, int w, int h, char **solution) {
+    struct solver_state ss;
+    int ret;
+
+    new_solver_state(&ss, w, h);
+    ret = solve_board(&ss, orig, w, h, solution);
+    free_solver_state(&ss);
 
-    return !ss.nempty;
+    return ret;
 }
 
 static int *make_dsf(int *dsf, int *board, const int w, const int h) {
@@ -837,17 +870,24 @@ static int filled(int *board, int *randomize, int k, int n) {
 }
 */
 
-static int *g_board;
+/* Sort key for the clue order; carries its own value rather than
+ * looking it up in a global board, so generation is reentrant. */
+struct clue_key {
+    int value;
+    int index;
+};
 static int compare(const void *pa, const void *pb) {
-    if (!g_board) return 0;
-    return g_board[*(const int *)pb] - g_board[*(const int *)pa];
+    return ((const struct clue_key *)pb)->value -
+        ((const struct clue_key *)pa)->value;
 }
 
 static void minimize_clue_set(int *board, int w, int h, int *randomize) {
     const int sz = w * h;
     int i;
     int *board_cp = snewn(sz, int);
+    struct solver_state ss;
     memcpy(board_cp, board, sz * sizeof (int));
+    new_solver_state(&ss, w, h);
 
     /* since more clues only helps and never hurts, one pass will do
      * just fine: if we can remove clue n with k clues of index > n,
@@ -858,13 +898,14 @@ static void minimize_clue_set(int *board, int w, int h, int *randomize) {
         board[randomize[i]] = EMPTY;
 	/* (rot.) symmetry tends to include _way_ too many hints */
 	/* board[sz - randomize[i] - 1] = EMPTY; */
-        if (!solver(board, w, h, NULL)) {
+        if (!solve_board(&ss, board, w, h, NULL)) {
             board[randomize[i]] = board_cp[randomize[i]];
 	    /* board[sz - randomize[i] - 1] =
 	       board_cp[sz - randomize[i] - 1]; */
 	}
     }
 
+    free_solver_state(&ss);
     sfree(board_cp);
 }
 
@@ -877,6 +918,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     int *board = snewn(sz, int);
     int *randomize = snewn(sz, int);
     char *game_description = snewn(sz + 1, char);
+    struct clue_key *keys;
     int i;
 
     for (i = 0; i < sz; ++i) {
@@ -885,8 +927,14 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     }
 
     make_board(board, w, h, rs);
-    g_board = board;
-    qsort(randomize, sz, sizeof (int), compare);
+    keys = snewn(sz, struct clue_key);
+    for (i = 0; i < sz; ++i) {
+        keys[i].value = board[randomize[i]];
+        keys[i].index = randomize[i];
+    }
+    qsort(keys, sz, sizeof (struct clue_key), compare);
+    for (i = 0; i < sz; ++i) randomize[i] = keys[i].index;
+    sfree(keys);
     minimize_clue_set(board, w, h, randomize);
 
     for (i = 0; i < sz; ++i) {
@@ -1772,7 +1820,7 @@ const struct game thegame = {
 #endif
     FALSE,				   /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_NUMPAD,		       /* flags */
+    REQUIRE_NUMPAD | DRAG_FOLLOWS_PATH,    /* flags */
 };
 
 #ifdef STANDALONE_SOLVER /* solver? hah! */
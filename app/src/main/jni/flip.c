@@ -47,6 +47,35 @@ struct game_params {
     int matrix_type;
 };
 
+/*
+ * The solver packs rows of the matrix into words, one bit per
+ * square.
+ */
+typedef unsigned long long gf2word;
+#define GF2_BITS ((int)(sizeof(gf2word) * 8))
+#define GF2_WORDS(n) (((n) + GF2_BITS - 1) / GF2_BITS)
+#define GF2_GET(row, i) (((row)[(i) / GF2_BITS] >> ((i) % GF2_BITS)) & 1)
+#define GF2_FLIP(row, i) ((row)[(i) / GF2_BITS] ^= (gf2word)1 << ((i) % GF2_BITS))
+
+/*
+ * The result of Gaussian elimination on the matrix. It doesn't
+ * depend on the grid, so it is worked out the first time a solution
+ * is wanted and kept for the rest of the game.
+ */
+struct elimination {
+    int nwords;			       /* words per packed row */
+    int rank;
+    gf2word *rows;		       /* rank echelon rows of coefficients */
+    int *pivot;			       /* leading column of each of those */
+    /*
+     * For each of the wh rows, the set of original equations XORed
+     * together to make it. The rows after the first `rank' have no
+     * coefficients left, so their values must come out as zero.
+     */
+    gf2word *ops;
+    int *und, nund;		       /* columns with no pivot */
+};
+
 /*
  * This structure is shared between all the game_states describing
  * a particular game, so it's reference-counted.
@@ -54,6 +83,7 @@ struct game_params {
 struct matrix {
     int refcount;
     unsigned char *matrix;             /* array of (w*h) by (w*h) */
+    struct elimination *elim;	       /* NULL until first needed */
 };
 
 struct game_state {
@@ -637,6 +667,7 @@ static game_state *new_game(midend *me, const game_params *params,
     state->matrix = snew(struct matrix);
     state->matrix->refcount = 1;
     state->matrix->matrix = snewn(wh*wh, unsigned char);
+    state->matrix->elim = NULL;
     decode_bitmap(state->matrix->matrix, wh*wh, desc);
     state->grid = snewn(wh, unsigned char);
     decode_bitmap(state->grid, wh, desc + mlen + 1);
@@ -666,47 +697,101 @@ static void free_game(game_state *state)
 {
     sfree(state->grid);
     if (--state->matrix->refcount <= 0) {
+        struct elimination *elim = state->matrix->elim;
+        if (elim) {
+            sfree(elim->rows);
+            sfree(elim->pivot);
+            sfree(elim->ops);
+            sfree(elim->und);
+            sfree(elim);
+        }
         sfree(state->matrix->matrix);
         sfree(state->matrix);
     }
     sfree(state);
 }
 
-static void rowxor(unsigned char *row1, unsigned char *row2, int len)
+static void rowxor(gf2word *row1, const gf2word *row2, int len)
 {
     int i;
     for (i = 0; i < len; i++)
 	row1[i] ^= row2[i];
 }
 
-static char *solve_game(const game_state *state, const game_state *currstate,
-                        const char *aux, char **error)
+/*
+ * Parity of the number of bits set in the AND of two packed rows.
+ * With hw set, we may use the compiler's bit counting builtins, which
+ * are only quick where the CPU has a popcount instruction (see
+ * search_solutions).
+ */
+CPU_INLINE int rowdot(const gf2word *row1, const gf2word *row2, int len,
+                      int hw)
 {
-    int w = state->w, h = state->h, wh = w * h;
-    unsigned char *equations, *solution, *shortest;
-    int *und, nund;
-    int rowsdone, colsdone;
-    int i, j, k, len, bestlen;
-    char *ret;
+    gf2word v = 0;
+    int i;
+
+    for (i = 0; i < len; i++)
+	v ^= row1[i] & row2[i];
+#ifdef CPU_DISPATCH
+    if (hw)
+	return __builtin_parityll(v);
+#endif
+    for (i = GF2_BITS / 2; i > 0; i /= 2)
+	v ^= v >> i;
+    return (int)(v & 1);
+}
+
+CPU_INLINE int rowcount(const gf2word *row, int len, int hw)
+{
+    int i, n = 0;
+
+    for (i = 0; i < len; i++) {
+	gf2word v = row[i];
+#ifdef CPU_DISPATCH
+	if (hw) {
+	    n += __builtin_popcountll(v);
+	    continue;
+	}
+#endif
+	while (v) {
+	    v &= v - 1;
+	    n++;
+	}
+    }
+    return n;
+}
+
+static struct elimination *eliminate(const struct matrix *m, int wh)
+{
+    struct elimination *e = snew(struct elimination);
+    int nw = GF2_WORDS(wh), stride = 2 * nw;
+    gf2word *eq;
+    int rowsdone, colsdone, i, j;
 
     /*
-     * Set up a list of simultaneous equations. Each one is of
-     * length (wh+1) and has wh coefficients followed by a value.
+     * Set up a list of simultaneous equations, one per square, each
+     * saying that the flips covering that square add up to its
+     * value. Alongside each we keep track of which of the original
+     * equations it is made of, so that the same elimination can be
+     * replayed later on any grid.
      */
-    equations = snewn((wh + 1) * wh, unsigned char);
+    eq = snewn(stride * wh, gf2word);
+    memset(eq, 0, stride * wh * sizeof(gf2word));
     for (i = 0; i < wh; i++) {
 	for (j = 0; j < wh; j++)
-	    equations[i * (wh+1) + j] = currstate->matrix->matrix[j*wh+i];
-	equations[i * (wh+1) + wh] = currstate->grid[i] & 1;
+	    if (m->matrix[j*wh+i])
+		GF2_FLIP(eq + i*stride, j);
+	GF2_FLIP(eq + i*stride + nw, i);
     }
 
     /*
      * Perform Gaussian elimination over GF(2).
      */
     rowsdone = colsdone = 0;
-    nund = 0;
-    und = snewn(wh, int);
-    do {
+    e->nund = 0;
+    e->und = snewn(wh, int);
+    e->pivot = snewn(wh, int);
+    while (rowsdone < wh) {
 	/*
 	 * Find the leftmost column which has a 1 in it somewhere
 	 * outside the first `rowsdone' rows.
@@ -714,7 +799,7 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	j = -1;
 	for (i = colsdone; i < wh; i++) {
 	    for (j = rowsdone; j < wh; j++)
-		if (equations[j * (wh+1) + i])
+		if (GF2_GET(eq + j*stride, i))
 		    break;
 	    if (j < wh)
 		break;		       /* found one */
@@ -722,105 +807,93 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	     * This is a column which will not have an equation
 	     * controlling it. Mark it as undetermined.
 	     */
-	    und[nund++] = i;
+	    e->und[e->nund++] = i;
 	}
 
 	/*
 	 * If there wasn't one, then we've finished: all remaining
-	 * equations are of the form 0 = constant. Check to see if
-	 * any of them wants 0 to be equal to 1; this is the
-	 * condition which indicates an insoluble problem
-	 * (therefore _hopefully_ one typed in by a user!).
+	 * equations are of the form 0 = something.
 	 */
-	if (i == wh) {
-	    for (j = rowsdone; j < wh; j++)
-		if (equations[j * (wh+1) + wh]) {
-		    *error = _("No solution exists for this position");
-		    sfree(equations);
-		    sfree(und);
-		    return NULL;
-		}
+	if (i == wh)
 	    break;
-	}
 
 	/*
 	 * We've found a 1. It's in column i, and the topmost 1 in
 	 * that column is in row j. Do a row-XOR to move it up to
-	 * the topmost row if it isn't already there.
+	 * the topmost row if it isn't already there, then more to
+	 * eliminate it from all rows below that.
 	 */
 	assert(j != -1);
 	if (j > rowsdone)
-	    rowxor(equations + rowsdone*(wh+1), equations + j*(wh+1), wh+1);
-
-	/*
-	 * Do row-XORs to eliminate that 1 from all rows below the
-	 * topmost row.
-	 */
+	    rowxor(eq + rowsdone*stride, eq + j*stride, stride);
 	for (j = rowsdone + 1; j < wh; j++)
-	    if (equations[j*(wh+1) + i])
-		rowxor(equations + j*(wh+1),
-		       equations + rowsdone*(wh+1), wh+1);
+	    if (GF2_GET(eq + j*stride, i))
+		rowxor(eq + j*stride, eq + rowsdone*stride, stride);
 
-	/*
-	 * Mark this row and column as done.
-	 */
-	rowsdone++;
+	e->pivot[rowsdone++] = i;
 	colsdone = i+1;
+    }
 
-	/*
-	 * If we've done all the rows, terminate.
-	 */
-    } while (rowsdone < wh);
+    e->nwords = nw;
+    e->rank = rowsdone;
+    e->rows = snewn(nw * (rowsdone ? rowsdone : 1), gf2word);
+    e->ops = snewn(nw * wh, gf2word);
+    for (j = 0; j < wh; j++) {
+	if (j < rowsdone)
+	    memcpy(e->rows + j*nw, eq + j*stride, nw * sizeof(gf2word));
+	memcpy(e->ops + j*nw, eq + j*stride + nw, nw * sizeof(gf2word));
+    }
+
+    sfree(eq);
+    return e;
+}
+
+/*
+ * Find the solution with fewest flips, given the elimination and the
+ * value of each of its rows for the grid being solved. This is the
+ * expensive part of solving: it's exponential in the number of
+ * undetermined variables, and is mostly counting bits.
+ */
+CPU_INLINE void search_solutions_body(const struct elimination *e, int wh,
+                                      const gf2word *values,
+                                      gf2word *shortest, int hw)
+{
+    int nw = e->nwords, i, j, len, bestlen;
+    gf2word *solution;
 
     /*
-     * If we reach here, we have the ability to produce a solution.
-     * So we go through _all_ possible solutions (each
+     * We go through _all_ possible solutions (each
      * corresponding to a set of arbitrary choices of those
      * components not directly determined by an equation), and pick
      * one requiring the smallest number of flips.
      */
-    solution = snewn(wh, unsigned char);
-    shortest = snewn(wh, unsigned char);
-    memset(solution, 0, wh);
+    solution = snewn(nw, gf2word);
+    memset(solution, 0, nw * sizeof(gf2word));
     bestlen = wh + 1;
     while (1) {
 	/*
 	 * Find a solution based on the current values of the
-	 * undetermined variables.
+	 * undetermined variables. Each row's leading variable is
+	 * clear in the solution by the time we get to it, so the
+	 * rest of the row can be dotted with the whole thing.
 	 */
-	for (j = rowsdone; j-- ;) {
-	    int v;
-
-	    /*
-	     * Find the leftmost set bit in this equation.
-	     */
-	    for (i = 0; i < wh; i++)
-		if (equations[j * (wh+1) + i])
-		    break;
-	    assert(i < wh);		       /* there must have been one! */
+	for (j = e->rank; j-- ;) {
+	    int p = e->pivot[j];
 
-	    /*
-	     * Compute this variable using the rest.
-	     */
-	    v = equations[j * (wh+1) + wh];
-	    for (k = i+1; k < wh; k++)
-		if (equations[j * (wh+1) + k])
-		    v ^= solution[k];
-
-	    solution[i] = v;
+	    if (GF2_GET(solution, p))
+		GF2_FLIP(solution, p);
+	    if (GF2_GET(values, j) ^ rowdot(e->rows + j*nw, solution, nw, hw))
+		GF2_FLIP(solution, p);
 	}
 
 	/*
 	 * Compare this solution to the current best one, and
 	 * replace the best one if this one is shorter.
 	 */
-	len = 0;
-	for (i = 0; i < wh; i++)
-	    if (solution[i])
-		len++;
+	len = rowcount(solution, nw, hw);
 	if (len < bestlen) {
 	    bestlen = len;
-	    memcpy(shortest, solution, wh);
+	    memcpy(shortest, solution, nw * sizeof(gf2word));
 	}
 
 	/*
@@ -828,9 +901,9 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	 * undetermined variables: turn all 1s into 0s until we see
 	 * a 0, at which point we turn it into a 1.
 	 */
-	for (i = 0; i < nund; i++) {
-	    solution[und[i]] = !solution[und[i]];
-	    if (solution[und[i]])
+	for (i = 0; i < e->nund; i++) {
+	    GF2_FLIP(solution, e->und[i]);
+	    if (GF2_GET(solution, e->und[i]))
 		break;
 	}
 
@@ -839,10 +912,91 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	 * round and are back at the start, i.e. we have enumerated
 	 * all solutions.
 	 */
-	if (i == nund)
+	if (i == e->nund)
 	    break;
     }
 
+    sfree(solution);
+}
+
+static void search_solutions_c(const struct elimination *e, int wh,
+                               const gf2word *values, gf2word *shortest)
+{
+    search_solutions_body(e, wh, values, shortest, FALSE);
+}
+
+#ifdef CPU_DISPATCH
+#ifndef __aarch64__
+__attribute__((target("popcnt")))
+#endif
+static void search_solutions_hw(const struct elimination *e, int wh,
+                                const gf2word *values, gf2word *shortest)
+{
+    search_solutions_body(e, wh, values, shortest, TRUE);
+}
+#endif
+
+static void search_solutions(const struct elimination *e, int wh,
+                             const gf2word *values, gf2word *shortest)
+{
+#ifdef CPU_DISPATCH
+#ifdef __aarch64__
+    int hw = TRUE;		       /* CNT is in the base instruction set */
+#else
+    int hw = cpu_features() & CPU_X86_POPCNT;
+#endif
+    if (hw) {
+	search_solutions_hw(e, wh, values, shortest);
+	return;
+    }
+#endif
+    search_solutions_c(e, wh, values, shortest);
+}
+
+static char *solve_game(const game_state *state, const game_state *currstate,
+                        const char *aux, char **error)
+{
+    int w = state->w, h = state->h, wh = w * h;
+    struct elimination *e;
+    gf2word *grid, *values, *shortest;
+    int nw, i, j;
+    char *ret;
+
+    if (!currstate->matrix->elim)
+	currstate->matrix->elim = eliminate(currstate->matrix, wh);
+    e = currstate->matrix->elim;
+    nw = e->nwords;
+
+    /*
+     * Replay the elimination on the current grid to get the value
+     * of each row. Any row with no coefficients left which wants 0
+     * to be equal to 1 indicates an insoluble problem (therefore
+     * _hopefully_ one typed in by a user!).
+     */
+    grid = snewn(nw, gf2word);
+    values = snewn(nw, gf2word);
+    memset(grid, 0, nw * sizeof(gf2word));
+    memset(values, 0, nw * sizeof(gf2word));
+    for (i = 0; i < wh; i++)
+	if (currstate->grid[i] & 1)
+	    GF2_FLIP(grid, i);
+    for (j = 0; j < wh; j++)
+	if (rowdot(e->ops + j*nw, grid, nw, FALSE)) {
+	    if (j >= e->rank) {
+		*error = _("No solution exists for this position");
+		sfree(grid);
+		sfree(values);
+		return NULL;
+	    }
+	    GF2_FLIP(values, j);
+	}
+
+    /*
+     * If we reach here, we have the ability to produce a solution.
+     */
+    shortest = snewn(nw, gf2word);
+    search_solutions(e, wh, values, shortest);
+
     /*
      * We have a solution. Produce a move string encoding the
      * solution.
@@ -850,13 +1004,12 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     ret = snewn(wh + 2, char);
     ret[0] = 'S';
     for (i = 0; i < wh; i++)
-	ret[i+1] = shortest[i] ? '1' : '0';
+	ret[i+1] = GF2_GET(shortest, i) ? '1' : '0';
     ret[wh+1] = '\0';
 
     sfree(shortest);
-    sfree(solution);
-    sfree(equations);
-    sfree(und);
+    sfree(values);
+    sfree(grid);
 
     return ret;
 }
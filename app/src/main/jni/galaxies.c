@@ -1284,8 +1284,10 @@ generate:
          * _not_ permit a too-hard one (one which the solver
          * couldn't handle at all).
          */
-        if (diff > params->diff ||
-            ntries < MAXTRIES) goto generate;
+        if ((diff > params->diff ||
+             (ntries < MAXTRIES &&
+              !random_gen_settle(rs, GEN_RELAXED_DIFFICULTY))) &&
+            !random_gen_attempt(rs, diff)) goto generate;
     }
 
 #ifdef STANDALONE_PICTURE_GENERATOR
@@ -1566,7 +1568,7 @@ typedef struct solver_ctx {
     game_state *state;
     int sz;             /* state->sx * state->sy */
     space **scratch;    /* size sz */
-
+    int depth;          /* of guesses in solver_recurse */
 } solver_ctx;
 
 static solver_ctx *new_solver(game_state *state)
@@ -1575,6 +1577,7 @@ static solver_ctx *new_solver(game_state *state)
     sctx->state = state;
     sctx->sz = state->sx*state->sy;
     sctx->scratch = snewn(sctx->sz, space *);
+    sctx->depth = 0;
     return sctx;
 }
 
@@ -2059,17 +2062,24 @@ static int solver_recurse_cb(game_state *state, space *tile, void *ctx)
     return 0;
 }
 
-static int solver_state(game_state *state, int maxdiff);
+static int solver_state_ctx(solver_ctx *sctx, int maxdiff);
 
 #define MAXRECURSE 5
 
-static int solver_recurse(game_state *state, int maxdiff)
+static int solver_recurse(solver_ctx *sctx, int maxdiff)
 {
+    game_state *state = sctx->state;
     int diff = DIFF_IMPOSSIBLE, ret, n, gsz = state->sx * state->sy;
     space *ingrid, *outgrid = NULL, *bestopp;
     struct recurse_ctx rctx;
 
-    if (solver_recurse_depth >= MAXRECURSE) {
+    /*
+     * The depth is counted in the solver context rather than in
+     * solver_recurse_depth, which is only there to indent the
+     * standalone solver's output: without a limit here the search
+     * can, now and then, run on for minutes.
+     */
+    if (sctx->depth >= MAXRECURSE) {
         solvep(("Limiting recursion to %d, returning.", MAXRECURSE));
         return DIFF_UNFINISHED;
     }
@@ -2091,6 +2101,7 @@ static int solver_recurse(game_state *state, int maxdiff)
 #ifdef STANDALONE_SOLVER
     solver_recurse_depth++;
 #endif
+    sctx->depth++;
 
     ingrid = snewn(gsz, struct space);
     memcpy(ingrid, state->grid, gsz * sizeof(struct space));
@@ -2105,7 +2116,7 @@ static int solver_recurse(game_state *state, int maxdiff)
                          state->dots[n]->x, state->dots[n]->y,
                          "Attempting for recursion");
 
-        ret = solver_state(state, maxdiff);
+        ret = solver_state_ctx(sctx, maxdiff);
 
         if (diff == DIFF_IMPOSSIBLE && ret != DIFF_IMPOSSIBLE) {
             /* we found our first solved grid; copy it away. */
@@ -2140,6 +2151,7 @@ static int solver_recurse(game_state *state, int maxdiff)
 #ifdef STANDALONE_SOLVER
     solver_recurse_depth--;
 #endif
+    sctx->depth--;
 
     if (outgrid) {
         /* we found (at least one) soln; copy it back to state */
@@ -2150,9 +2162,14 @@ static int solver_recurse(game_state *state, int maxdiff)
     return diff;
 }
 
-static int solver_state(game_state *state, int maxdiff)
+/*
+ * Each level of recursion shares the one solver context, scratch
+ * space and all, since a level has finished with the scratch space
+ * before it recurses.
+ */
+static int solver_state_ctx(solver_ctx *sctx, int maxdiff)
 {
-    solver_ctx *sctx = new_solver(state);
+    game_state *state = sctx->state;
     int ret, diff = DIFF_NORMAL;
 
 #ifdef STANDALONE_PICTURE_GENERATOR
@@ -2198,10 +2215,9 @@ cont:
     if (check_complete(state, NULL, NULL)) goto got_result;
 
     diff = (maxdiff >= DIFF_UNREASONABLE) ?
-        solver_recurse(state, maxdiff) : DIFF_UNFINISHED;
+        solver_recurse(sctx, maxdiff) : DIFF_UNFINISHED;
 
 got_result:
-    free_solver(sctx);
 #ifndef STANDALONE_SOLVER
     debug(("solver_state ends, diff %s:\n", galaxies_diffnames[diff]));
     dbg_state(state);
@@ -2214,6 +2230,15 @@ got_result:
     return diff;
 }
 
+static int solver_state(game_state *state, int maxdiff)
+{
+    solver_ctx *sctx = new_solver(state);
+    int diff = solver_state_ctx(sctx, maxdiff);
+
+    free_solver(sctx);
+    return diff;
+}
+
 #ifndef EDITOR
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *aux, char **error)
@@ -3604,7 +3629,7 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
 #endif
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON,		       /* flags */
+    REQUIRE_RBUTTON | GEN_RACES,	       /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -13,9 +13,9 @@
 #include <ctype.h>
 #include <math.h>
 #include <float.h>
+#include <pthread.h>
 
 #include "puzzles.h"
-#include "tree234.h"
 #include "grid.h"
 #include "penrose.h"
 
@@ -28,26 +28,51 @@
 /* ----------------------------------------------------------------------
  * Deallocate or dereference a grid
  */
+
+/* Grids are shared between threads (see the cache in grid_new), so this
+ * covers every refcount, as well as the cache itself. */
+static pthread_mutex_t grid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void grid_index_free(struct grid_index *idx);
+
+static void grid_destroy(grid *g)
+{
+    int i;
+    grid_index_free(g->index);
+    for (i = 0; i < g->num_faces; i++) {
+        sfree(g->faces[i].dots);
+        sfree(g->faces[i].edges);
+    }
+    for (i = 0; i < g->num_dots; i++) {
+        sfree(g->dots[i].faces);
+        sfree(g->dots[i].edges);
+    }
+    sfree(g->faces);
+    sfree(g->edges);
+    sfree(g->dots);
+    sfree(g);
+}
+
 void grid_free(grid *g)
 {
+    int last;
+
+    pthread_mutex_lock(&grid_lock);
     assert(g->refcount);
+    last = (--g->refcount == 0);
+    pthread_mutex_unlock(&grid_lock);
 
-    g->refcount--;
-    if (g->refcount == 0) {
-        int i;
-        for (i = 0; i < g->num_faces; i++) {
-            sfree(g->faces[i].dots);
-            sfree(g->faces[i].edges);
-        }
-        for (i = 0; i < g->num_dots; i++) {
-            sfree(g->dots[i].faces);
-            sfree(g->dots[i].edges);
-        }
-        sfree(g->faces);
-        sfree(g->edges);
-        sfree(g->dots);
-        sfree(g);
-    }
+    if (last)
+        grid_destroy(g);
+}
+
+grid *grid_ref(grid *g)
+{
+    pthread_mutex_lock(&grid_lock);
+    assert(g->refcount);
+    g->refcount++;
+    pthread_mutex_unlock(&grid_lock);
+    return g;
 }
 
 /* Used by the other grid generators.  Create a brand new grid with nothing
@@ -61,9 +86,210 @@ static grid *grid_empty(void)
     g->num_faces = g->num_edges = g->num_dots = 0;
     g->refcount = 1;
     g->lowest_x = g->lowest_y = g->highest_x = g->highest_y = 0;
+    g->index = NULL;
     return g;
 }
 
+/* ----------------------------------------------------------------------
+ * Spatial index. The grid's bounding box is cut into square buckets
+ * about a tile across, and each face, edge and dot is listed in every
+ * bucket its own bounding box touches. Big Penrose or Floret grids have
+ * thousands of edges, and this lets a redraw or a tap look at only the
+ * few near it.
+ */
+
+#define GRID_INDEX_KINDS 3
+
+struct grid_index_kind {
+    int n;
+    int *bbox;                         /* xmin, ymin, xmax, ymax each */
+    int *start;                        /* nbuckets+1 offsets into list */
+    int *list;
+};
+
+struct grid_index {
+    int x0, y0, size, nx, ny;
+    int maxhalf;                       /* half the longest edge, rounded up */
+    struct grid_index_kind kinds[GRID_INDEX_KINDS];
+};
+
+static void grid_index_free(struct grid_index *idx)
+{
+    int k;
+    if (!idx)
+        return;
+    for (k = 0; k < GRID_INDEX_KINDS; k++) {
+        sfree(idx->kinds[k].bbox);
+        sfree(idx->kinds[k].start);
+        sfree(idx->kinds[k].list);
+    }
+    sfree(idx);
+}
+
+static int grid_index_bucket(const struct grid_index *idx, int v, int v0,
+                             int n)
+{
+    int b = (v - v0) / idx->size;
+    return v < v0 ? 0 : b >= n ? n-1 : b;
+}
+
+static struct grid_index *grid_index_new(grid *g)
+{
+    struct grid_index *idx = snew(struct grid_index);
+    int k, i, j, bx, by;
+
+    idx->x0 = g->lowest_x;
+    idx->y0 = g->lowest_y;
+    idx->size = max(g->tilesize, 1);
+    idx->nx = (g->highest_x - g->lowest_x) / idx->size + 1;
+    idx->ny = (g->highest_y - g->lowest_y) / idx->size + 1;
+    idx->maxhalf = 0;
+
+    for (k = 0; k < GRID_INDEX_KINDS; k++) {
+        struct grid_index_kind *ik = &idx->kinds[k];
+        int nb = idx->nx * idx->ny, total;
+
+        ik->n = (k == GRID_INDEX_FACES ? g->num_faces :
+                 k == GRID_INDEX_EDGES ? g->num_edges : g->num_dots);
+        ik->bbox = snewn(4 * ik->n, int);
+        for (i = 0; i < ik->n; i++) {
+            int *bb = ik->bbox + 4*i;
+            if (k == GRID_INDEX_FACES) {
+                grid_face *f = g->faces + i;
+                bb[0] = bb[2] = f->dots[0]->x;
+                bb[1] = bb[3] = f->dots[0]->y;
+                for (j = 1; j < f->order; j++) {
+                    bb[0] = min(bb[0], f->dots[j]->x);
+                    bb[1] = min(bb[1], f->dots[j]->y);
+                    bb[2] = max(bb[2], f->dots[j]->x);
+                    bb[3] = max(bb[3], f->dots[j]->y);
+                }
+            } else if (k == GRID_INDEX_EDGES) {
+                grid_edge *e = g->edges + i;
+                int half;
+                bb[0] = min(e->dot1->x, e->dot2->x);
+                bb[1] = min(e->dot1->y, e->dot2->y);
+                bb[2] = max(e->dot1->x, e->dot2->x);
+                bb[3] = max(e->dot1->y, e->dot2->y);
+                half = (int)ceil(sqrt(SQ((double)(bb[2] - bb[0])) +
+                                      SQ((double)(bb[3] - bb[1]))) / 2);
+                idx->maxhalf = max(idx->maxhalf, half);
+            } else {
+                bb[0] = bb[2] = g->dots[i].x;
+                bb[1] = bb[3] = g->dots[i].y;
+            }
+        }
+
+        /* Count each bucket's entries, then fill them in */
+        ik->start = snewn(nb + 1, int);
+        for (i = 0; i <= nb; i++)
+            ik->start[i] = 0;
+        for (i = 0; i < ik->n; i++) {
+            int *bb = ik->bbox + 4*i;
+            int bx0 = grid_index_bucket(idx, bb[0], idx->x0, idx->nx);
+            int by0 = grid_index_bucket(idx, bb[1], idx->y0, idx->ny);
+            int bx1 = grid_index_bucket(idx, bb[2], idx->x0, idx->nx);
+            int by1 = grid_index_bucket(idx, bb[3], idx->y0, idx->ny);
+            for (by = by0; by <= by1; by++)
+                for (bx = bx0; bx <= bx1; bx++)
+                    ik->start[by * idx->nx + bx + 1]++;
+        }
+        for (i = 0; i < nb; i++)
+            ik->start[i+1] += ik->start[i];
+        total = ik->start[nb];
+        ik->list = snewn(max(total, 1), int);
+        for (i = 0; i < ik->n; i++) {
+            int *bb = ik->bbox + 4*i;
+            int bx0 = grid_index_bucket(idx, bb[0], idx->x0, idx->nx);
+            int by0 = grid_index_bucket(idx, bb[1], idx->y0, idx->ny);
+            int bx1 = grid_index_bucket(idx, bb[2], idx->x0, idx->nx);
+            int by1 = grid_index_bucket(idx, bb[3], idx->y0, idx->ny);
+            for (by = by0; by <= by1; by++)
+                for (bx = bx0; bx <= bx1; bx++)
+                    ik->list[ik->start[by * idx->nx + bx]++] = i;
+        }
+        /* Filling moved each start along to the next; put them back */
+        for (i = nb; i > 0; i--)
+            ik->start[i] = ik->start[i-1];
+        ik->start[0] = 0;
+    }
+
+    return idx;
+}
+
+static struct grid_index *grid_get_index(grid *g)
+{
+    struct grid_index *idx;
+
+    pthread_mutex_lock(&grid_lock);
+    if (!g->index)
+        g->index = grid_index_new(g);
+    idx = g->index;
+    pthread_mutex_unlock(&grid_lock);
+    return idx;
+}
+
+static int grid_index_cmp(const void *av, const void *bv)
+{
+    int a = *(const int *)av, b = *(const int *)bv;
+    return a < b ? -1 : a > b ? +1 : 0;
+}
+
+/*
+ * Visit each element of a kind whose bbox meets the box exactly once:
+ * an element spanning several buckets is taken only from the first
+ * (lowest x and y) of them that the box covers.
+ */
+static int grid_index_find(struct grid_index *idx, int kind,
+                           int x0, int y0, int x1, int y1, int *out)
+{
+    struct grid_index_kind *ik = &idx->kinds[kind];
+    int bx0, by0, bx1, by1, bx, by, i, n = 0;
+
+    if (x1 < x0 || y1 < y0)
+        return 0;
+    bx0 = grid_index_bucket(idx, x0, idx->x0, idx->nx);
+    by0 = grid_index_bucket(idx, y0, idx->y0, idx->ny);
+    bx1 = grid_index_bucket(idx, x1, idx->x0, idx->nx);
+    by1 = grid_index_bucket(idx, y1, idx->y0, idx->ny);
+
+    if (bx0 == 0 && by0 == 0 && bx1 == idx->nx-1 && by1 == idx->ny-1) {
+        /* The lot: quicker to look at each element once, in order */
+        for (i = 0; i < ik->n; i++) {
+            int *bb = ik->bbox + 4*i;
+            if (bb[0] <= x1 && x0 <= bb[2] && bb[1] <= y1 && y0 <= bb[3])
+                out[n++] = i;
+        }
+        return n;
+    }
+
+    for (by = by0; by <= by1; by++)
+        for (bx = bx0; bx <= bx1; bx++) {
+            int b = by * idx->nx + bx, j;
+            for (j = ik->start[b]; j < ik->start[b+1]; j++) {
+                int *bb;
+                i = ik->list[j];
+                bb = ik->bbox + 4*i;
+                if (bb[0] <= x1 && x0 <= bb[2] &&
+                    bb[1] <= y1 && y0 <= bb[3] &&
+                    bx == max(bx0, grid_index_bucket(idx, bb[0], idx->x0,
+                                                     idx->nx)) &&
+                    by == max(by0, grid_index_bucket(idx, bb[1], idx->y0,
+                                                     idx->ny)))
+                    out[n++] = i;
+            }
+        }
+    if (bx1 > bx0 || by1 > by0)
+        qsort(out, n, sizeof(int), grid_index_cmp);
+    return n;
+}
+
+int grid_index_query(grid *g, int kind, int x0, int y0, int x1, int y1,
+                     int *out)
+{
+    return grid_index_find(grid_get_index(g), kind, x0, y0, x1, y1, out);
+}
+
 /* Helper function to calculate perpendicular distance from
  * a point P to a line AB.  A and B mustn't be equal here.
  *
@@ -111,12 +337,24 @@ grid_edge *grid_nearest_edge(grid *g, int x, int y)
 {
     grid_edge *best_edge;
     double best_distance = 0;
-    int i;
+    struct grid_index *idx = grid_get_index(g);
+    int *near, nnear, i;
 
     best_edge = NULL;
 
-    for (i = 0; i < g->num_edges; i++) {
-        grid_edge *e = &g->edges[i];
+    /*
+     * An eligible edge (see below) has (x,y) within the circle on it
+     * as diameter, so no further than half its length from its
+     * bounding box. The candidates come in index order, so ties still
+     * go to the lowest-numbered edge.
+     */
+    near = snewn(max(g->num_edges, 1), int);
+    nnear = grid_index_find(idx, GRID_INDEX_EDGES,
+                            x - idx->maxhalf, y - idx->maxhalf,
+                            x + idx->maxhalf, y + idx->maxhalf, near);
+
+    for (i = 0; i < nnear; i++) {
+        grid_edge *e = &g->edges[near[i]];
         long e2; /* squared length of edge */
         long a2, b2; /* squared lengths of other sides */
         double dist;
@@ -153,6 +391,7 @@ grid_edge *grid_nearest_edge(grid *g, int x, int y)
             best_distance = dist;
         }
     }
+    sfree(near);
     return best_edge;
 }
 
@@ -316,33 +555,6 @@ static void grid_debug_derived(grid *g)
 #endif
 }
 
-/* Helper function for building incomplete-edges list in
- * grid_make_consistent() */
-static int grid_edge_bydots_cmpfn(void *v1, void *v2)
-{
-    grid_edge *a = v1;
-    grid_edge *b = v2;
-    grid_dot *da, *db;
-
-    /* Pointer subtraction is valid here, because all dots point into the
-     * same dot-list (g->dots).
-     * Edges are not "normalised" - the 2 dots could be stored in any order,
-     * so we need to take this into account when comparing edges. */
-
-    /* Compare first dots */
-    da = (a->dot1 < a->dot2) ? a->dot1 : a->dot2;
-    db = (b->dot1 < b->dot2) ? b->dot1 : b->dot2;
-    if (da != db)
-        return db - da;
-    /* Compare last dots */
-    da = (a->dot1 < a->dot2) ? a->dot2 : a->dot1;
-    db = (b->dot1 < b->dot2) ? b->dot2 : b->dot1;
-    if (da != db)
-        return db - da;
-
-    return 0;
-}
-
 /*
  * 'Vigorously trim' a grid, by which I mean deleting any isolated or
  * uninteresting faces. By which, in turn, I mean: ensure that the
@@ -492,6 +704,99 @@ static void grid_trim_vigorously(grid *g)
     sfree(faces);
 }
 
+/* ----------------------------------------------------------------------
+ * A hash table keyed on pairs of ints, used while building grids to find
+ * dots by their coordinates and edges by their dots. Open addressing with
+ * linear probing; it doubles whenever it gets half full. Nothing is ever
+ * removed.
+ */
+
+typedef struct grid_hash_slot {
+    int k1, k2;
+    void *p;                           /* NULL if the slot is empty */
+} grid_hash_slot;
+
+typedef struct grid_hash {
+    grid_hash_slot *slots;
+    int nslots, nused;                 /* nslots is a power of two */
+} grid_hash;
+
+static grid_hash *grid_hash_new(int expected)
+{
+    grid_hash *h = snew(grid_hash);
+    int i;
+
+    h->nslots = 16;
+    while (h->nslots < 2 * (expected + 1))
+        h->nslots *= 2;
+    h->nused = 0;
+    h->slots = snewn(h->nslots, grid_hash_slot);
+    for (i = 0; i < h->nslots; i++)
+        h->slots[i].p = NULL;
+    return h;
+}
+
+static void grid_hash_free(grid_hash *h)
+{
+    sfree(h->slots);
+    sfree(h);
+}
+
+static unsigned grid_hash_index(const grid_hash *h, int k1, int k2)
+{
+    unsigned v = (unsigned)k1 * 0x9E3779B1U + (unsigned)k2 * 0x85EBCA77U;
+    v ^= v >> 15;
+    v *= 0x2C1B3C6DU;
+    v ^= v >> 13;
+    return v & (h->nslots - 1);
+}
+
+static void *grid_hash_find(const grid_hash *h, int k1, int k2)
+{
+    unsigned i = grid_hash_index(h, k1, k2);
+
+    while (h->slots[i].p) {
+        if (h->slots[i].k1 == k1 && h->slots[i].k2 == k2)
+            return h->slots[i].p;
+        i = (i + 1) & (h->nslots - 1);
+    }
+    return NULL;
+}
+
+/* Assumes (k1,k2) isn't already present */
+static void grid_hash_add(grid_hash *h, int k1, int k2, void *p)
+{
+    unsigned i;
+
+    assert(p);
+    if (2 * (h->nused + 1) > h->nslots) {
+        grid_hash_slot *old = h->slots;
+        int j, nold = h->nslots;
+
+        h->nslots *= 2;
+        h->slots = snewn(h->nslots, grid_hash_slot);
+        for (j = 0; j < h->nslots; j++)
+            h->slots[j].p = NULL;
+        for (j = 0; j < nold; j++) {
+            if (!old[j].p)
+                continue;
+            i = grid_hash_index(h, old[j].k1, old[j].k2);
+            while (h->slots[i].p)
+                i = (i + 1) & (h->nslots - 1);
+            h->slots[i] = old[j];
+        }
+        sfree(old);
+    }
+
+    i = grid_hash_index(h, k1, k2);
+    while (h->slots[i].p)
+        i = (i + 1) & (h->nslots - 1);
+    h->slots[i].k1 = k1;
+    h->slots[i].k2 = k2;
+    h->slots[i].p = p;
+    h->nused++;
+}
+
 /* Input: grid has its dots and faces initialised:
  * - dots have (optionally) x and y coordinates, but no edges or faces
  * (pointers are NULL).
@@ -504,7 +809,7 @@ static void grid_trim_vigorously(grid *g)
 static void grid_make_consistent(grid *g)
 {
     int i;
-    tree234 *incomplete_edges;
+    grid_hash *incomplete_edges;
     grid_edge *next_new_edge; /* Where new edge will go into g->edges */
 
     grid_debug_basic(g);
@@ -526,39 +831,46 @@ static void grid_make_consistent(grid *g)
      * dots, but only one of the edge's faces.  Later on in the iteration, we
      * will find the same edge again (unless it's on the border), but we will
      * know the other face.
-     * For efficiency, maintain a list of the incomplete edges, sorted by
-     * their dots. */
-    incomplete_edges = newtree234(grid_edge_bydots_cmpfn);
+     * For efficiency, keep the edges found so far in a hash, keyed by the
+     * indices of their dots, lower first.  An edge only ever has two faces,
+     * so once it's been found the second time it will never be looked up
+     * again, and there's no need to remove it. */
+    incomplete_edges = grid_hash_new(g->num_edges);
     for (i = 0; i < g->num_faces; i++) {
         grid_face *f = g->faces + i;
         int j;
         for (j = 0; j < f->order; j++) {
-            grid_edge e; /* fake edge for searching */
+            grid_dot *dot1, *dot2;
             grid_edge *edge_found;
-            int j2 = j + 1;
+            int j2 = j + 1, k1, k2;
             if (j2 == f->order)
                 j2 = 0;
-            e.dot1 = f->dots[j];
-            e.dot2 = f->dots[j2];
-            /* Use del234 instead of find234, because we always want to
-             * remove the edge if found */
-            edge_found = del234(incomplete_edges, &e);
+            dot1 = f->dots[j];
+            dot2 = f->dots[j2];
+            k1 = dot1 - g->dots;
+            k2 = dot2 - g->dots;
+            if (k1 > k2) {
+                int k3 = k1;
+                k1 = k2;
+                k2 = k3;
+            }
+            edge_found = grid_hash_find(incomplete_edges, k1, k2);
             if (edge_found) {
-                /* This edge already added, so fill out missing face.
-                 * Edge is already removed from incomplete_edges. */
+                /* This edge already added, so fill out missing face. */
+                assert(!edge_found->face2);
                 edge_found->face2 = f;
             } else {
                 assert(next_new_edge - g->edges < g->num_edges);
-                next_new_edge->dot1 = e.dot1;
-                next_new_edge->dot2 = e.dot2;
+                next_new_edge->dot1 = dot1;
+                next_new_edge->dot2 = dot2;
                 next_new_edge->face1 = f;
                 next_new_edge->face2 = NULL; /* potentially infinite face */
-                add234(incomplete_edges, next_new_edge);
+                grid_hash_add(incomplete_edges, k1, k2, next_new_edge);
                 ++next_new_edge;
             }
         }
     }
-    freetree234(incomplete_edges);
+    grid_hash_free(incomplete_edges);
     
     /* ====== Stage 2 ======
      * For each face, build its edge list.
@@ -792,16 +1104,6 @@ static void grid_make_consistent(grid *g)
 /* Helpers for making grid-generation easier.  These functions are only
  * intended for use during grid generation. */
 
-/* Comparison function for the (tree234) sorted dot list */
-static int grid_point_cmp_fn(void *v1, void *v2)
-{
-    grid_dot *p1 = v1;
-    grid_dot *p2 = v2;
-    if (p1->y != p2->y)
-        return p2->y - p1->y;
-    else
-        return p2->x - p1->x;
-}
 /* Add a new face to the grid, with its dot list allocated.
  * Assumes there's enough space allocated for the new face in grid->faces */
 static void grid_face_add_new(grid *g, int face_size)
@@ -832,21 +1134,16 @@ static grid_dot *grid_dot_add_new(grid *g, int x, int y)
  * in the dot_list, or add a new dot to the grid (and the dot_list) and
  * return that.
  * Assumes g->dots has enough capacity allocated */
-static grid_dot *grid_get_dot(grid *g, tree234 *dot_list, int x, int y)
+static grid_dot *grid_get_dot(grid *g, grid_hash *dot_list, int x, int y)
 {
-    grid_dot test, *ret;
+    grid_dot *ret;
 
-    test.order = 0;
-    test.edges = NULL;
-    test.faces = NULL;
-    test.x = x;
-    test.y = y;
-    ret = find234(dot_list, &test, NULL);
+    ret = grid_hash_find(dot_list, x, y);
     if (ret)
         return ret;
 
     ret = grid_dot_add_new(g, x, y);
-    add234(dot_list, ret);
+    grid_hash_add(dot_list, x, y, ret);
     return ret;
 }
 
@@ -914,8 +1211,17 @@ void grid_find_incentre(grid_face *f)
     grid_dot *edgedot1[3], *edgedot2[3];
     grid_dot *dots[3];
     int nedges, ndots;
+    int has_incentre;
 
-    if (f->has_incentre)
+    /*
+     * The face may belong to a grid shared with another thread, which
+     * may be finding the same incentre; the lock makes sure neither of
+     * us sees the flag set before the coordinates it vouches for.
+     */
+    pthread_mutex_lock(&grid_lock);
+    has_incentre = f->has_incentre;
+    pthread_mutex_unlock(&grid_lock);
+    if (has_incentre)
         return;
 
     /*
@@ -1364,9 +1670,11 @@ void grid_find_incentre(grid_face *f)
 
     assert(bestdist > 0);
 
-    f->has_incentre = TRUE;
+    pthread_mutex_lock(&grid_lock);
     f->ix = xbest + 0.5;               /* round to nearest */
     f->iy = ybest + 0.5;
+    f->has_incentre = TRUE;
+    pthread_mutex_unlock(&grid_lock);
 }
 
 /* ------ Generate various types of grid ------ */
@@ -1376,9 +1684,9 @@ void grid_find_incentre(grid_face *f)
  * a new face reuses an existing dot.  For example, two squares touching at an
  * edge would generate six unique dots: four dots from the first face, then
  * two additional dots for the second face, because we detect the other two
- * dots have already been taken up.  This list is stored in a tree234
- * called "points".  No extra memory-allocation needed here - we store the
- * actual grid_dot* pointers, which all point into the g->dots list.
+ * dots have already been taken up.  This list is stored in a grid_hash
+ * called "points", keyed by coordinates.  We store the actual grid_dot*
+ * pointers, which all point into the g->dots list.
  * For this reason, we have to calculate coordinates in such a way as to
  * eliminate any rounding errors, so we can detect when a dot on one
  * face precisely lands on a dot of a different face.  No floating-point
@@ -1407,14 +1715,14 @@ static grid *grid_new_square(int width, int height, const char *desc)
     int max_faces = width * height;
     int max_dots = (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = a;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     /* generate square faces */
     for (y = 0; y < height; y++) {
@@ -1436,7 +1744,7 @@ static grid *grid_new_square(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -1470,14 +1778,14 @@ static grid *grid_new_honeycomb(int width, int height, const char *desc)
     int max_faces = width * height;
     int max_dots = 2 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = HONEY_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     /* generate hexagonal faces */
     for (y = 0; y < height; y++) {
@@ -1505,7 +1813,7 @@ static grid *grid_new_honeycomb(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -1648,10 +1956,10 @@ static grid *grid_new_triangular(int width, int height, const char *desc)
          *   5x5t1:0_21120b11a1a01a1a00c1a0b211021c1h1a2a1a0a
          *   5x6t1:0_a1212c22c2a02a2f22a0c12a110d0e1c0c0a101121a1
          */
-        tree234 *points = newtree234(grid_point_cmp_fn);
         /* Upper bounds - don't have to be exact */
         int max_faces = height * (2*width+1);
         int max_dots = (height+1) * (width+1) * 4;
+        grid_hash *points = grid_hash_new(0);
 
         g->faces = snewn(max_faces, grid_face);
         g->dots = snewn(max_dots, grid_dot);
@@ -1701,7 +2009,7 @@ static grid *grid_new_triangular(int width, int height, const char *desc)
             }
         }
 
-        freetree234(points);
+        grid_hash_free(points);
         assert(g->num_faces <= max_faces);
         assert(g->num_dots <= max_dots);
     }
@@ -1736,14 +2044,14 @@ static grid *grid_new_snubsquare(int width, int height, const char *desc)
     int max_faces = 3 * width * height;
     int max_dots = 2 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = SNUBSQUARE_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1816,7 +2124,7 @@ static grid *grid_new_snubsquare(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -1849,14 +2157,14 @@ static grid *grid_new_cairo(int width, int height, const char *desc)
     int max_faces = 2 * width * height;
     int max_dots = 3 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = CAIRO_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -1922,7 +2230,7 @@ static grid *grid_new_cairo(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -1956,14 +2264,14 @@ static grid *grid_new_greathexagonal(int width, int height, const char *desc)
     int max_faces = 6 * (width + 1) * (height + 1);
     int max_dots = 6 * width * height;
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = GREATHEX_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -2052,7 +2360,7 @@ static grid *grid_new_greathexagonal(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2086,14 +2394,14 @@ static grid *grid_new_octagonal(int width, int height, const char *desc)
     int max_faces = 2 * width * height;
     int max_dots = 4 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = OCTAGONAL_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -2135,7 +2443,7 @@ static grid *grid_new_octagonal(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2169,14 +2477,14 @@ static grid *grid_new_kites(int width, int height, const char *desc)
     int max_faces = 6 * width * height;
     int max_dots = 6 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = KITE_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -2255,7 +2563,7 @@ static grid *grid_new_kites(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2298,14 +2606,14 @@ static grid *grid_new_floret(int width, int height, const char *desc)
     int max_faces = 6 * width * height;
     int max_dots = 9 * (width + 1) * (height + 1);
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = FLORET_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     /* generate pentagonal faces */
     for (y = 0; y < height; y++) {
@@ -2363,7 +2671,7 @@ static grid *grid_new_floret(int width, int height, const char *desc)
         }
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2398,14 +2706,14 @@ static grid *grid_new_dodecagonal(int width, int height, const char *desc)
     int max_faces = 3 * width * height;
     int max_dots = 14 * width * height;
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = DODEC_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -2449,7 +2757,7 @@ static grid *grid_new_dodecagonal(int width, int height, const char *desc)
 	}
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2479,14 +2787,14 @@ static grid *grid_new_greatdodecagonal(int width, int height, const char *desc)
     int max_faces = 30 * width * height;
     int max_dots = 200 * width * height;
 
-    tree234 *points;
+    grid_hash *points;
 
     grid *g = grid_empty();
     g->tilesize = DODEC_TILESIZE;
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     for (y = 0; y < height; y++) {
         for (x = 0; x < width; x++) {
@@ -2563,7 +2871,7 @@ static grid *grid_new_greatdodecagonal(int width, int height, const char *desc)
 	}
     }
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2576,7 +2884,7 @@ typedef struct setface_ctx
     int xmin, xmax, ymin, ymax;
 
     grid *g;
-    tree234 *points;
+    grid_hash *points;
 } setface_ctx;
 
 static double round_int_nearest_away(double r)
@@ -2631,7 +2939,8 @@ static void grid_size_penrose(int width, int height,
     *yextent = l * height;
 }
 
-static grid *grid_new_penrose(int width, int height, int which, const char *desc); /* forward reference */
+static grid *grid_cache_build(grid_type type, int width, int height,
+                              const char *desc); /* forward reference */
 
 static char *grid_new_desc_penrose(grid_type type, int width, int height, random_state *rs)
 {
@@ -2672,9 +2981,10 @@ static char *grid_new_desc_penrose(grid_type type, int width, int height, random
 
         /*
          * Now test-generate our grid, to make sure it actually
-         * produces something.
+         * produces something. It goes in the cache, so the game
+         * about to be built on it needn't generate it again.
          */
-        g = grid_new_penrose(width, height, which, gd);
+        g = grid_cache_build(type, width, height, gd);
         if (g) {
             grid_free(g);
             break;
@@ -2711,9 +3021,10 @@ static char *grid_validate_desc_penrose(grid_type type, int width, int height,
 
     /*
      * Test-generate to ensure these parameters don't end us up with
-     * no grid at all.
+     * no grid at all. (Via the cache, since we're usually about to
+     * build a game on it.)
      */
-    g = grid_new_penrose(width, height, which, desc);
+    g = grid_cache_build(type, width, height, desc);
     if (!g)
         return "Patch coordinates do not identify a usable grid fragment";
     grid_free(g);
@@ -2733,7 +3044,7 @@ static grid *grid_new_penrose(int width, int height, int which, const char *desc
     int xsz, ysz, xoff, yoff, aoff;
     double rradius;
 
-    tree234 *points;
+    grid_hash *points;
     grid *g;
 
     penrose_state ps;
@@ -2756,7 +3067,7 @@ static grid *grid_new_penrose(int width, int height, int which, const char *desc
     g->faces = snewn(max_faces, grid_face);
     g->dots = snewn(max_dots, grid_dot);
 
-    points = newtree234(grid_point_cmp_fn);
+    points = grid_hash_new(0);
 
     memset(&sf_ctx, 0, sizeof(sf_ctx));
     sf_ctx.g = g;
@@ -2777,6 +3088,12 @@ static grid *grid_new_penrose(int width, int height, int which, const char *desc
     sf_ctx.ymin = yoff - ysz/2;
     sf_ctx.ymax = yoff + ysz/2;
 
+    ps.clip = 1;
+    ps.xmin = sf_ctx.xmin;
+    ps.xmax = sf_ctx.xmax;
+    ps.ymin = sf_ctx.ymin;
+    ps.ymax = sf_ctx.ymax;
+
     debug(("penrose: centre (%f, %f) xsz %f ysz %f",
            0.0, 0.0, xsz, ysz));
     debug(("penrose: x range (%f --> %f), y range (%f --> %f)",
@@ -2784,7 +3101,7 @@ static grid *grid_new_penrose(int width, int height, int which, const char *desc
 
     penrose(&ps, which, aoff);
 
-    freetree234(points);
+    grid_hash_free(points);
     assert(g->num_faces <= max_faces);
     assert(g->num_dots <= max_dots);
 
@@ -2877,12 +3194,131 @@ char *grid_validate_desc(grid_type type, int width, int height,
     }
 }
 
+/*
+ * The last few grids built are kept, newest first, so that restarting,
+ * reloading or validating a game on a grid seen recently (or generating
+ * one, on a grid type with no random description) doesn't build it all
+ * again, nor find again the incentres its faces have had found. The cache
+ * holds a reference to each.
+ */
+#define GRID_CACHE_SIZE 4
+
+struct grid_cache_entry {
+    grid_type type;
+    int width, height;
+    char *desc;                        /* NULL if the grid type has none */
+    grid *g;
+};
+
+static struct grid_cache_entry grid_cache[GRID_CACHE_SIZE];
+static int grid_cache_n = 0;
+
+static int grid_cache_match(const struct grid_cache_entry *e, grid_type type,
+                            int width, int height, const char *desc)
+{
+    if (e->type != type || e->width != width || e->height != height)
+        return FALSE;
+    if (!desc || !e->desc)
+        return !desc && !e->desc;
+    return !strcmp(desc, e->desc);
+}
+
+/* Drop the cache's references, e.g. so that a benchmark can time builds */
+void grid_cache_flush(void)
+{
+    grid *evicted[GRID_CACHE_SIZE];
+    int i, n = 0;
+
+    pthread_mutex_lock(&grid_lock);
+    for (i = 0; i < grid_cache_n; i++) {
+        sfree(grid_cache[i].desc);
+        if (--grid_cache[i].g->refcount == 0)
+            evicted[n++] = grid_cache[i].g;
+    }
+    grid_cache_n = 0;
+    pthread_mutex_unlock(&grid_lock);
+
+    for (i = 0; i < n; i++)
+        grid_destroy(evicted[i]);
+}
+
+static grid *grid_cache_lookup(grid_type type, int width, int height,
+                               const char *desc)
+{
+    struct grid_cache_entry e;
+    int i;
+
+    pthread_mutex_lock(&grid_lock);
+    for (i = 0; i < grid_cache_n; i++) {
+        if (grid_cache_match(&grid_cache[i], type, width, height, desc)) {
+            e = grid_cache[i];
+            memmove(grid_cache + 1, grid_cache, i * sizeof(*grid_cache));
+            grid_cache[0] = e;
+            e.g->refcount++;
+            pthread_mutex_unlock(&grid_lock);
+            return e.g;
+        }
+    }
+    pthread_mutex_unlock(&grid_lock);
+
+    return NULL;
+}
+
+/*
+ * Find or build a grid, without validating the description first.
+ * Returns NULL, and caches nothing, if the generator comes up empty.
+ */
+static grid *grid_cache_build(grid_type type, int width, int height,
+                              const char *desc)
+{
+    struct grid_cache_entry e;
+    grid *g, *evicted = NULL;
+
+    g = grid_cache_lookup(type, width, height, desc);
+    if (g)
+        return g;
+
+    g = grid_news[type](width, height, desc);
+    if (!g)
+        return NULL;
+
+    pthread_mutex_lock(&grid_lock);
+    if (grid_cache_n == GRID_CACHE_SIZE) {
+        e = grid_cache[--grid_cache_n];
+        sfree(e.desc);
+        if (--e.g->refcount == 0)
+            evicted = e.g;
+    }
+    memmove(grid_cache + 1, grid_cache, grid_cache_n * sizeof(*grid_cache));
+    grid_cache[0].type = type;
+    grid_cache[0].width = width;
+    grid_cache[0].height = height;
+    grid_cache[0].desc = desc ? dupstr(desc) : NULL;
+    grid_cache[0].g = g;
+    grid_cache_n++;
+    g->refcount++;
+    pthread_mutex_unlock(&grid_lock);
+
+    if (evicted)
+        grid_destroy(evicted);
+    return g;
+}
+
 grid *grid_new(grid_type type, int width, int height, const char *desc)
 {
-    char *err = grid_validate_desc(type, width, height, desc);
+    grid *g;
+    char *err;
+
+    g = grid_cache_lookup(type, width, height, desc);
+    if (g)
+        return g;
+
+    err = grid_validate_desc(type, width, height, desc);
     if (err) assert(!"Invalid grid description.");
 
-    return grid_news[type](width, height, desc);
+    g = grid_cache_build(type, width, height, desc);
+    assert(g);
+    return g;
 }
 
 void grid_compute_size(grid_type type, int width, int height,
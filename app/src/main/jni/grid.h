@@ -89,6 +89,9 @@ typedef struct grid {
    * A grid is immutable once generated.
    */
   int refcount;
+
+  /* Spatial index, built on first use; see grid_index_query. */
+  struct grid_index *index;
 } grid;
 
 /* Grids are specified by type: GRID_SQUARE, GRID_KITE, etc. */
@@ -118,12 +121,26 @@ char *grid_new_desc(grid_type type, int width, int height, random_state *rs);
 char *grid_validate_desc(grid_type type, int width, int height,
                          const char *desc);
 
+/* The grid returned may be shared with other callers asking for the same
+ * one; it's immutable (bar incentres), so that doesn't matter, but take
+ * further references with grid_ref rather than by touching refcount. */
 grid *grid_new(grid_type type, int width, int height, const char *desc);
 
+grid *grid_ref(grid *g);
 void grid_free(grid *g);
+void grid_cache_flush(void);
 
 grid_edge *grid_nearest_edge(grid *g, int x, int y);
 
+/* Find the faces, edges or dots whose bounding boxes meet the box
+ * [x0,x1] x [y0,y1] (in grid coordinates, inclusive). Their indices go
+ * into out, which must have room for all of that kind, in increasing
+ * order; returns how many. Uses a bucketed spatial index, so the cost
+ * goes with the size of the box rather than of the grid. */
+enum { GRID_INDEX_FACES, GRID_INDEX_EDGES, GRID_INDEX_DOTS };
+int grid_index_query(grid *g, int kind, int x0, int y0, int x1, int y1,
+                     int *out);
+
 void grid_compute_size(grid_type type, int width, int height,
                        int *tilesize, int *xextent, int *yextent);
 
@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "puzzles.h"
 
@@ -313,7 +316,7 @@ static char *validate_desc(const game_params *params, const char *desc)
 #ifdef ANDROID
 static void android_request_keys(const game_params *params)
 {
-    android_keys2("L\b", "", ANDROID_ARROWS_LEFT_RIGHT);
+    android_keys2("L\b?", "", ANDROID_ARROWS_LEFT_RIGHT);
 }
 #endif
 
@@ -626,6 +629,356 @@ static int mark_pegs(pegrow guess, pegrow solution, int ncols)
     return nc_place;
 }
 
+/* ----------------------------------------------------------------------
+ * Hints.
+ *
+ * The hint is a code, out of those still consistent with every marked
+ * guess, whose worst-case marking leaves the fewest of them consistent
+ * (Knuth's minimax rule, restricted to codes that could still win).
+ * That means marking every candidate against every other, so each
+ * code is packed into two words and mark_pegs' sums are done a whole
+ * row at a time:
+ *
+ *  - pos has a 4-bit field per peg holding its colour. Two codes'
+ *    pegs in the right place are the zero fields of pos XOR pos.
+ *  - count has a 6-bit lane per colour 1..10 holding how many pegs
+ *    are that colour. Knuth's sum of minimum colour counts is a
+ *    lane-wise min of two count words, added up with one multiply.
+ *
+ * Finding the candidates and scoring them both stop at a deadline,
+ * keeping the best found so far, and the scoring is shared between a
+ * few threads. If there are too many candidates to score each against
+ * every other (early on with lots of colours and pegs), we score a
+ * random sample of them instead.
+ */
+#define HINT_MAX_PEGS 16
+#define HINT_MAX_CANDIDATES 16384
+#define HINT_SAMPLE 2048
+#define HINT_BUDGET_MS 400.0
+#define HINT_MAX_THREADS 4
+#define HINT_MIN_PER_THREAD 256        /* fewer candidates aren't worth it */
+#define HINT_NSCORES ((HINT_MAX_PEGS+1) * (HINT_MAX_PEGS+1))
+
+typedef unsigned long long hintword;
+
+#define HINT_FIELD_ONES 0x1111111111111111ULL
+#define HINT_LANE_ONES  0x0041041041041041ULL
+#define HINT_LANE_HIGH  (HINT_LANE_ONES << 5)
+
+struct hint_code {
+    hintword pos, count;
+};
+
+static double hint_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int hint_count_bits(hintword x)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    int n = 0;
+    for (; x; x &= x - 1)
+        n++;
+    return n;
+#endif
+}
+
+static void hint_pack(struct hint_code *hc, const int *pegs, int npegs)
+{
+    int i;
+
+    hc->pos = hc->count = 0;
+    for (i = 0; i < npegs; i++) {
+        hc->pos |= (hintword)pegs[i] << (4*i);
+        if (pegs[i] > 0)
+            hc->count += (hintword)1 << (6*(pegs[i]-1));
+    }
+}
+
+/* Equivalent to mark_pegs, as (right colour total, right place) */
+static int hint_score(const struct hint_code *a, const struct hint_code *b,
+                      int npegs)
+{
+    hintword x, m;
+    int place, total;
+
+    /* Fold each field onto its low bit, which is then set iff the
+     * pegs differ. Unused fields are zero in both. */
+    x = a->pos ^ b->pos;
+    x |= x >> 1;
+    x |= x >> 2;
+    place = npegs - hint_count_bits(x & HINT_FIELD_ONES);
+
+    /* Lane counts are at most 16, so adding 32 to each of a's stops
+     * any borrow between lanes, and bit 5 is left set iff a >= b. */
+    m = ((((a->count + HINT_LANE_HIGH) - b->count) & HINT_LANE_HIGH) >> 5) * 63;
+    x = (b->count & m) | (a->count & ~m);
+    total = (int)((x * HINT_LANE_ONES) >> 54) & 63;
+
+    return total * (HINT_MAX_PEGS+1) + place;
+}
+
+struct hint_ctx {
+    int npegs, ncolours, allow_multiple;
+    int nmarked;                       /* guesses already marked */
+    int *guesses;                      /* nmarked * npegs */
+    int *gcount;                       /* nmarked * (ncolours+1) */
+    int *place, *total;                /* each guess's marking */
+    int *curplace, *curtotal;          /* same, against the code so far */
+    int *code, *used;                  /* code so far; its colour counts */
+    random_state *rs;                  /* to shuffle colours, or NULL */
+    struct hint_code *cands;
+    int ncands, limit;
+    long nodes;
+    double deadline;
+    int timed_out;
+};
+
+/*
+ * Extend the code so far by peg i in every way that could still give
+ * each marked guess its marking. Each further peg can add at most one
+ * to either count. Returns TRUE if we should stop: there are enough
+ * candidates, or we're out of time.
+ */
+static int hint_search(struct hint_ctx *hc, int i)
+{
+    int order[10];
+    int left = hc->npegs - i - 1, nc1 = hc->ncolours + 1;
+    int k, c, g, stop;
+
+    if (i == hc->npegs) {
+        hint_pack(&hc->cands[hc->ncands++], hc->code, hc->npegs);
+        return hc->ncands >= hc->limit;
+    }
+    if ((++hc->nodes & 1023) == 0 && hint_now() > hc->deadline) {
+        hc->timed_out = TRUE;
+        return TRUE;
+    }
+
+    for (k = 0; k < hc->ncolours; k++)
+        order[k] = k+1;
+    if (hc->rs)
+        shuffle(order, hc->ncolours, sizeof(*order), hc->rs);
+
+    for (k = 0; k < hc->ncolours; k++) {
+        c = order[k];
+        if (!hc->allow_multiple && hc->used[c])
+            continue;
+        for (g = 0; g < hc->nmarked; g++) {
+            int p = hc->curplace[g] + (hc->guesses[g*hc->npegs+i] == c);
+            int t = hc->curtotal[g] + (hc->used[c] < hc->gcount[g*nc1+c]);
+            if (p > hc->place[g] || p + left < hc->place[g] ||
+                t > hc->total[g] || t + left < hc->total[g])
+                break;
+        }
+        if (g < hc->nmarked)
+            continue;
+
+        for (g = 0; g < hc->nmarked; g++) {
+            hc->curplace[g] += (hc->guesses[g*hc->npegs+i] == c);
+            hc->curtotal[g] += (hc->used[c] < hc->gcount[g*nc1+c]);
+        }
+        hc->used[c]++;
+        hc->code[i] = c;
+
+        stop = hint_search(hc, i+1);
+
+        hc->used[c]--;
+        for (g = 0; g < hc->nmarked; g++) {
+            hc->curplace[g] -= (hc->guesses[g*hc->npegs+i] == c);
+            hc->curtotal[g] -= (hc->used[c] < hc->gcount[g*nc1+c]);
+        }
+        if (stop)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Scores candidates first, first+step, ... against all the others */
+struct hint_worker {
+    const struct hint_code *cands;
+    int ncands, npegs, first, step;
+    double deadline;
+    int best, bestworst;
+};
+
+static void *hint_worker_run(void *arg)
+{
+    struct hint_worker *w = (struct hint_worker *)arg;
+    int counts[HINT_NSCORES];
+    int i, j, s, worst;
+
+    w->best = -1;
+    w->bestworst = w->ncands + 1;
+    for (i = w->first; i < w->ncands; i += w->step) {
+        if (w->best >= 0 && hint_now() > w->deadline)
+            break;
+        memset(counts, 0, sizeof(counts));
+        worst = 0;
+        for (j = 0; j < w->ncands; j++) {
+            s = hint_score(&w->cands[i], &w->cands[j], w->npegs);
+            if (++counts[s] > worst) {
+                worst = counts[s];
+                if (worst >= w->bestworst)
+                    break;             /* no better than one we have */
+            }
+        }
+        if (worst < w->bestworst) {
+            w->bestworst = worst;
+            w->best = i;
+        }
+    }
+    return NULL;
+}
+
+/* The index of the best candidate, ties going to the lowest */
+static int hint_score_all(const struct hint_code *cands, int ncands,
+                          int npegs, double deadline)
+{
+    struct hint_worker *workers;
+    pthread_t *threads;
+    int *started;
+    int nthreads, i, best = -1, bestworst = 0;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    nthreads = ncands / HINT_MIN_PER_THREAD;
+    if (nthreads > HINT_MAX_THREADS) nthreads = HINT_MAX_THREADS;
+    if (nthreads > ncpus) nthreads = (int)ncpus;
+    if (nthreads < 1) nthreads = 1;
+
+    workers = snewn(nthreads, struct hint_worker);
+    threads = snewn(nthreads, pthread_t);
+    started = snewn(nthreads, int);
+    for (i = 0; i < nthreads; i++) {
+        workers[i].cands = cands;
+        workers[i].ncands = ncands;
+        workers[i].npegs = npegs;
+        workers[i].first = i;
+        workers[i].step = nthreads;
+        workers[i].deadline = deadline;
+    }
+
+    /* Worker 0 runs here, and so does any we couldn't start a thread for */
+    started[0] = FALSE;
+    for (i = 1; i < nthreads; i++)
+        started[i] = !pthread_create(&threads[i], NULL, hint_worker_run,
+                                     &workers[i]);
+    for (i = 0; i < nthreads; i++)
+        if (!started[i]) hint_worker_run(&workers[i]);
+    for (i = 1; i < nthreads; i++)
+        if (started[i]) pthread_join(threads[i], NULL);
+
+    for (i = 0; i < nthreads; i++) {
+        struct hint_worker *w = &workers[i];
+        if (w->best >= 0 && (best < 0 || w->bestworst < bestworst ||
+                             (w->bestworst == bestworst && w->best < best))) {
+            best = w->best;
+            bestworst = w->bestworst;
+        }
+    }
+
+    sfree(workers);
+    sfree(threads);
+    sfree(started);
+    return best;
+}
+
+/*
+ * Fill in pegs with a hint for the next guess. Returns FALSE if we
+ * couldn't find one in time (or at all, for more pegs than fit).
+ */
+static int hint_guess(const game_state *state, int *pegs)
+{
+    const game_params *params = &state->params;
+    int npegs = params->npegs, nc1 = params->ncolours + 1;
+    struct hint_ctx hc;
+    int g, i, s, best, ret = FALSE;
+
+    if (npegs > HINT_MAX_PEGS)
+        return FALSE;
+
+    hc.npegs = npegs;
+    hc.ncolours = params->ncolours;
+    hc.allow_multiple = params->allow_multiple;
+    hc.nmarked = state->next_go;
+    hc.guesses = snewn(hc.nmarked * npegs + 1, int);
+    hc.guesses[hc.nmarked * npegs] = 0;
+    hc.gcount = snewn(hc.nmarked * nc1 + 1, int);
+    hc.place = snewn(hc.nmarked + 1, int);
+    hc.total = snewn(hc.nmarked + 1, int);
+    hc.curplace = snewn(hc.nmarked + 1, int);
+    hc.curtotal = snewn(hc.nmarked + 1, int);
+    hc.code = snewn(npegs, int);
+    hc.used = snewn(nc1, int);
+    hc.cands = snewn(HINT_MAX_CANDIDATES + 1, struct hint_code);
+    memset(hc.gcount, 0, (hc.nmarked * nc1 + 1) * sizeof(int));
+    memset(hc.used, 0, nc1 * sizeof(int));
+    for (g = 0; g < hc.nmarked; g++) {
+        pegrow row = state->guesses[g];
+        hc.place[g] = hc.total[g] = 0;
+        hc.curplace[g] = hc.curtotal[g] = 0;
+        for (i = 0; i < npegs; i++) {
+            hc.guesses[g*npegs+i] = row->pegs[i];
+            hc.gcount[g*nc1+row->pegs[i]]++;
+            if (row->feedback[i] == FEEDBACK_CORRECTPLACE)
+                hc.place[g]++;
+            if (row->feedback[i] != 0)
+                hc.total[g]++;
+        }
+        hc.gcount[g*nc1] = 0;          /* blanks never match */
+    }
+    hc.rs = NULL;
+    hc.ncands = 0;
+    hc.limit = HINT_MAX_CANDIDATES + 1;
+    hc.nodes = 0;
+    hc.deadline = hint_now() + HINT_BUDGET_MS;
+    hc.timed_out = FALSE;
+
+    hint_search(&hc, 0);
+
+    if (hc.ncands > HINT_MAX_CANDIDATES) {
+        /*
+         * Sample instead, one randomly ordered descent at a time. The
+         * seed is the marked guesses, so a hint is repeatable. If we
+         * run out of time before finding any, cands[0] still holds
+         * the first code found above.
+         */
+        hc.rs = random_new((char *)hc.guesses,
+                           (hc.nmarked * npegs + 1) * sizeof(int));
+        hc.ncands = 0;
+        for (s = 0; s < HINT_SAMPLE && !hc.timed_out; s++) {
+            hc.limit = hc.ncands + 1;
+            hint_search(&hc, 0);
+        }
+        random_free(hc.rs);
+        if (hc.ncands == 0)
+            hc.ncands = 1;
+    }
+
+    if (hc.ncands > 0) {
+        best = hint_score_all(hc.cands, hc.ncands, npegs, hc.deadline);
+        for (i = 0; i < npegs; i++)
+            pegs[i] = (int)(hc.cands[best].pos >> (4*i)) & 15;
+        ret = TRUE;
+    }
+
+    sfree(hc.guesses);
+    sfree(hc.gcount);
+    sfree(hc.place);
+    sfree(hc.total);
+    sfree(hc.curplace);
+    sfree(hc.curtotal);
+    sfree(hc.code);
+    sfree(hc.used);
+    sfree(hc.cands);
+    return ret;
+}
+
 static char *encode_move(const game_state *from, game_ui *ui)
 {
     char *buf, *p, *sep;
@@ -795,6 +1148,11 @@ static char *interpret_move(const game_state *from, game_ui *ui,
         ui->display_cur = 1;
         ui->holds[ui->peg_cur] = 1 - ui->holds[ui->peg_cur];
         ret = "";
+    } else if (button == '?') {
+        if (hint_guess(from, ui->curr_pegs->pegs)) {
+            ui->markable = is_markable(&from->params, ui->curr_pegs);
+            ret = "";
+        }
     }
     return ret;
 }
@@ -746,9 +746,11 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     int *nodes, *nodeindex, *edges, *backedges, *edgei, *backedgei, *circuit;
     int nedges;
     int *dist, *dist2, *list;
+    int *cdist, *cdist2;
+    unsigned char *oncircuit;
     int *unvisited;
-    int circuitlen, circuitsize;
-    int head, tail, pass, i, j, n, x, y, d, dd;
+    int circuitlen, circuitsize, ncircuit;
+    int head, tail, pass, i, j, n, n1, n2, x, y, d, dd;
     char *err, *soln, *p;
 
     /*
@@ -914,6 +916,25 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     dist2 = snewn(n, int);
     list = snewn(n, int);
 
+    /*
+     * cdist[] and cdist2[] hold the distance of each node from and
+     * to the nearest vertex on the tour. The tour only ever grows
+     * in the main loop, so these can only shrink, and we keep them
+     * up to date by bfsing out from just the vertices we add.
+     * oncircuit[] flags the vertices on the tour, of which there
+     * are ncircuit distinct ones.
+     */
+    cdist = snewn(n, int);
+    cdist2 = snewn(n, int);
+    oncircuit = snewn(n, unsigned char);
+    for (i = 0; i < n; i++) {
+	cdist[i] = cdist2[i] = -1;
+	oncircuit[i] = FALSE;
+    }
+    oncircuit[circuit[0]] = TRUE;
+    ncircuit = 1;
+    n1 = n2 = 0;
+
     err = NULL;
     soln = NULL;
 
@@ -922,7 +943,7 @@ static char *solve_game(const game_state *state, const game_state *currstate,
      * extend the tour to take in an as yet uncollected gem.
      */
     while (1) {
-	int target, n1, n2, bestdist, extralen, targetpos;
+	int target, bestdist, extralen, targetpos;
 
 #ifdef TSP_DIAGNOSTICS
 	printf("circuit is");
@@ -964,13 +985,11 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	for (pass = 0; pass < 2; pass++) {
 	    int *ep = (pass == 0 ? edges : backedges);
 	    int *ei = (pass == 0 ? edgei : backedgei);
-	    int *dp = (pass == 0 ? dist : dist2);
+	    int *dp = (pass == 0 ? cdist : cdist2);
 	    head = tail = 0;
-	    for (i = 0; i < n; i++)
-		dp[i] = -1;
-	    for (i = 0; i < circuitlen; i++) {
+	    for (i = n1; i <= n2; i++) {
 		int ni = circuit[i];
-		if (dp[ni] < 0) {
+		if (dp[ni] != 0) {
 		    dp[ni] = 0;
 		    list[tail++] = ni;
 		}
@@ -979,7 +998,7 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 		int ni = list[head++];
 		for (i = ei[ni]; i < ei[ni+1]; i++) {
 		    int ti = ep[i];
-		    if (ti >= 0 && dp[ti] < 0) {
+		    if (ti >= 0 && (dp[ti] < 0 || dp[ti] > dp[ni] + 1)) {
 			dp[ti] = dp[ni] + 1;
 			list[tail++] = ti;
 		    }
@@ -991,8 +1010,8 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	target = -1;
 	for (i = 0; i < n; i++) {
 	    if (unvisited[nodes[i] / DP1] &&
-		dist[i] >= 0 && dist2[i] >= 0) {
-		int thisdist = dist[i] + dist2[i];
+		cdist[i] >= 0 && cdist2[i] >= 0) {
+		int thisdist = cdist[i] + cdist2[i];
 		if (bestdist < 0 || bestdist > thisdist) {
 		    bestdist = thisdist;
 		    target = i;
@@ -1023,10 +1042,17 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	       nodes[target]/DP1/w, nodes[target]%DP1);
 #endif
 
+	/*
+	 * Only the distances of tour vertices are wanted, so each
+	 * search can stop once it has reached all of them: by then
+	 * every vertex nearer the target has its distance too, which
+	 * is all that tracing the paths back below needs.
+	 */
 	for (pass = 0; pass < 2; pass++) {
 	    int *ep = (pass == 0 ? edges : backedges);
 	    int *ei = (pass == 0 ? edgei : backedgei);
 	    int *dp = (pass == 0 ? dist : dist2);
+	    int togo = ncircuit;
 
 	    for (i = 0; i < n; i++)
 		dp[i] = -1;
@@ -1035,7 +1061,7 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	    dp[target] = 0;
 	    list[tail++] = target;
 
-	    while (head < tail) {
+	    while (head < tail && togo > 0) {
 		int ni = list[head++];
 		for (i = ei[ni]; i < ei[ni+1]; i++) {
 		    int ti = ep[i];
@@ -1043,6 +1069,8 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 			dp[ti] = dp[ni] + 1;
 /*printf("pass %d: set dist of vertex %d to %d (via %d)\n", pass, ti, dp[ti], ni);*/
 			list[tail++] = ti;
+			if (oncircuit[ti] && --togo == 0)
+			    break;
 		    }
 		}
 	    }
@@ -1186,6 +1214,10 @@ static char *solve_game(const game_state *state, const game_state *currstate,
 	    int pos = nodes[circuit[i]] / DP1;
 	    assert(pos >= 0 && pos < wh);
 	    unvisited[pos] = FALSE;
+	    if (!oncircuit[circuit[i]]) {
+		oncircuit[circuit[i]] = TRUE;
+		ncircuit++;
+	    }
 	}
     }
 
@@ -1438,6 +1470,9 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     sfree(list);
     sfree(dist);
     sfree(dist2);
+    sfree(cdist);
+    sfree(cdist2);
+    sfree(oncircuit);
     sfree(unvisited);
     sfree(circuit);
     sfree(backedgei);
@@ -220,9 +220,18 @@ struct solver_ctx {
     digit *soln;
     digit *dscratch;
     int *iscratch;
+    /*
+     * Every layout of digits satisfying each box's clue, ignoring
+     * the rest of the grid: ntuples[box] of them, each of the box's
+     * size, built the first time the box is looked at.
+     */
+    digit **tuples;
+    int *ntuples;
+    int *allowed;
 };
 
-static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box)
+static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box,
+                                  const digit *cand)
 {
     int w = ctx->w;
     int n = ctx->boxes[box+1] - ctx->boxes[box];
@@ -233,8 +242,8 @@ static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box)
      * routine when we discover a candidate layout for a given clue
      * box consistent with everything we currently know about the
      * digit constraints in that box. We expect to find the digits
-     * of the candidate layout in ctx->dscratch, and we update
-     * ctx->iscratch as appropriate.
+     * of the candidate layout in cand, and we update ctx->iscratch
+     * as appropriate.
      */
     if (diff == DIFF_EASY) {
 	unsigned mask = 0;
@@ -245,7 +254,7 @@ static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box)
 	 * everywhere.
 	 */
 	for (j = 0; j < n; j++)
-	    mask |= 1 << ctx->dscratch[j];
+	    mask |= 1 << cand[j];
 	for (j = 0; j < n; j++)
 	    ctx->iscratch[j] |= mask;
     } else if (diff == DIFF_NORMAL) {
@@ -254,7 +263,7 @@ static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box)
 	 * dscratch in the obvious way.
 	 */
 	for (j = 0; j < n; j++)
-	    ctx->iscratch[j] |= 1 << ctx->dscratch[j];
+	    ctx->iscratch[j] |= 1 << cand[j];
     } else if (diff == DIFF_HARD) {
 	/*
 	 * Hard-mode deductions: instead of ruling things out
@@ -269,20 +278,146 @@ static void solver_clue_candidate(struct solver_ctx *ctx, int diff, int box)
 	    ctx->iscratch[2*w+j] = 0;
 	for (j = 0; j < n; j++) {
 	    int x = sq[j] / w, y = sq[j] % w;
-	    ctx->iscratch[2*w+x] |= 1 << ctx->dscratch[j];
-	    ctx->iscratch[3*w+y] |= 1 << ctx->dscratch[j];
+	    ctx->iscratch[2*w+x] |= 1 << cand[j];
+	    ctx->iscratch[3*w+y] |= 1 << cand[j];
 	}
 	for (j = 0; j < 2*w; j++)
 	    ctx->iscratch[j] &= ctx->iscratch[2*w+j];
     }
 }
 
+static void solver_add_tuple(struct solver_ctx *ctx, int box, int *size)
+{
+    int n = ctx->boxes[box+1] - ctx->boxes[box];
+
+    if (ctx->ntuples[box] == *size) {
+	*size = *size * 2 + 16;
+	ctx->tuples[box] = sresize(ctx->tuples[box], *size * n, digit);
+    }
+    memcpy(ctx->tuples[box] + ctx->ntuples[box]++ * n, ctx->dscratch,
+	   n * sizeof(digit));
+}
+
+/*
+ * Fill in ctx->tuples[box] with every layout of digits for the box
+ * which satisfies its clue and doesn't repeat a digit in a row or
+ * column. That depends only on the clue and the shape of the box, so
+ * each pass of the solver can just filter this list by what it
+ * currently knows.
+ */
+static void solver_clue_tuples(struct solver_ctx *ctx, int box)
+{
+    int w = ctx->w;
+    int *sq = ctx->boxlist + ctx->boxes[box];
+    int n = ctx->boxes[box+1] - ctx->boxes[box];
+    long value = ctx->clues[box] & ~CMASK;
+    long op = ctx->clues[box] & CMASK;
+    int i, j, k, total, size = 0;
+
+    ctx->ntuples[box] = 0;
+    ctx->tuples[box] = snewn(1, digit);    /* so it's non-NULL if empty */
+
+    switch (op) {
+      case C_SUB:
+      case C_DIV:
+	/*
+	 * These two clue types must always apply to a box of area
+	 * 2. Also, the two digits in these boxes can never be the
+	 * same (because any domino must have its two squares in
+	 * either the same row or the same column). So we simply
+	 * list all possibilities for the two squares, both ways
+	 * round.
+	 */
+	assert(n == 2);
+
+	for (i = 1; i <= w; i++) {
+	    j = (op == C_SUB ? i + value : i * value);
+	    if (j > w) break;
+
+	    ctx->dscratch[0] = i;
+	    ctx->dscratch[1] = j;
+	    solver_add_tuple(ctx, box, &size);
+	    ctx->dscratch[0] = j;
+	    ctx->dscratch[1] = i;
+	    solver_add_tuple(ctx, box, &size);
+	}
+
+	break;
+
+      case C_ADD:
+      case C_MUL:
+	/*
+	 * For these clue types, I have no alternative but to go
+	 * through all possible number combinations.
+	 *
+	 * Instead of a tedious physical recursion, I iterate in the
+	 * scratch array through all possibilities. At any given
+	 * moment, i indexes the element of the box that will next
+	 * be incremented.
+	 */
+	i = 0;
+	ctx->dscratch[i] = 0;
+	total = value;		       /* start with the identity */
+	while (1) {
+	    if (i < n) {
+		/*
+		 * Find the next valid value for cell i.
+		 */
+		for (j = ctx->dscratch[i] + 1; j <= w; j++) {
+		    if (op == C_ADD ? (total < j) : (total % j != 0))
+			continue;      /* this one won't fit */
+		    for (k = 0; k < i; k++)
+			if (ctx->dscratch[k] == j &&
+			    (sq[k] % w == sq[i] % w ||
+			     sq[k] / w == sq[i] / w))
+			    break;     /* clashes with another row/col */
+		    if (k < i)
+			continue;
+
+		    /* Found one. */
+		    break;
+		}
+
+		if (j > w) {
+		    /* No valid values left; drop back. */
+		    i--;
+		    if (i < 0)
+			break;	       /* overall iteration is finished */
+		    if (op == C_ADD)
+			total += ctx->dscratch[i];
+		    else
+			total *= ctx->dscratch[i];
+		} else {
+		    /* Got a valid value; store it and move on. */
+		    ctx->dscratch[i++] = j;
+		    if (op == C_ADD)
+			total -= j;
+		    else
+			total /= j;
+		    ctx->dscratch[i] = 0;
+		}
+	    } else {
+		if (total == (op == C_ADD ? 0 : 1))
+		    solver_add_tuple(ctx, box, &size);
+		i--;
+		if (op == C_ADD)
+		    total += ctx->dscratch[i];
+		else
+		    total *= ctx->dscratch[i];
+	    }
+	}
+
+	break;
+    }
+}
+
 static int solver_common(struct latin_solver *solver, void *vctx, int diff)
 {
     struct solver_ctx *ctx = (struct solver_ctx *)vctx;
     int w = ctx->w;
     int box, i, j, k;
-    int ret = 0, total;
+    int ret = 0;
+    int *allowed = ctx->allowed;
 
     /*
      * Iterate over each clue box and deduce what we can.
@@ -290,8 +425,6 @@ static int solver_common(struct latin_solver *solver, void *vctx, int diff)
     for (box = 0; box < ctx->nboxes; box++) {
 	int *sq = ctx->boxlist + ctx->boxes[box];
 	int n = ctx->boxes[box+1] - ctx->boxes[box];
-	long value = ctx->clues[box] & ~CMASK;
-	long op = ctx->clues[box] & CMASK;
 
 	if (diff == DIFF_HARD) {
 	    for (i = 0; i < n; i++)
@@ -301,111 +434,26 @@ static int solver_common(struct latin_solver *solver, void *vctx, int diff)
 		ctx->iscratch[i] = 0;
 	}
 
-	switch (op) {
-	  case C_SUB:
-	  case C_DIV:
-	    /*
-	     * These two clue types must always apply to a box of
-	     * area 2. Also, the two digits in these boxes can never
-	     * be the same (because any domino must have its two
-	     * squares in either the same row or the same column).
-	     * So we simply iterate over all possibilities for the
-	     * two squares (both ways round), rule out any which are
-	     * inconsistent with the digit constraints we already
-	     * have, and update the digit constraints with any new
-	     * information thus garnered.
-	     */
-	    assert(n == 2);
-
-	    for (i = 1; i <= w; i++) {
-		j = (op == C_SUB ? i + value : i * value);
-		if (j > w) break;
+	if (!ctx->tuples[box])
+	    solver_clue_tuples(ctx, box);
 
-		/* (i,j) is a valid digit pair. Try it both ways round. */
-
-		if (solver->cube[sq[0]*w+i-1] &&
-		    solver->cube[sq[1]*w+j-1]) {
-		    ctx->dscratch[0] = i;
-		    ctx->dscratch[1] = j;
-		    solver_clue_candidate(ctx, diff, box);
-		}
-
-		if (solver->cube[sq[0]*w+j-1] &&
-		    solver->cube[sq[1]*w+i-1]) {
-		    ctx->dscratch[0] = j;
-		    ctx->dscratch[1] = i;
-		    solver_clue_candidate(ctx, diff, box);
-		}
-	    }
-
-	    break;
-
-	  case C_ADD:
-	  case C_MUL:
-	    /*
-	     * For these clue types, I have no alternative but to go
-	     * through all possible number combinations.
-	     *
-	     * Instead of a tedious physical recursion, I iterate in
-	     * the scratch array through all possibilities. At any
-	     * given moment, i indexes the element of the box that
-	     * will next be incremented.
-	     */
-	    i = 0;
-	    ctx->dscratch[i] = 0;
-	    total = value;	       /* start with the identity */
-	    while (1) {
-		if (i < n) {
-		    /*
-		     * Find the next valid value for cell i.
-		     */
-		    for (j = ctx->dscratch[i] + 1; j <= w; j++) {
-			if (op == C_ADD ? (total < j) : (total % j != 0))
-			    continue;  /* this one won't fit */
-			if (!solver->cube[sq[i]*w+j-1])
-			    continue;  /* this one is ruled out already */
-			for (k = 0; k < i; k++)
-			    if (ctx->dscratch[k] == j &&
-				(sq[k] % w == sq[i] % w ||
-				 sq[k] / w == sq[i] / w))
-				break; /* clashes with another row/col */
-			if (k < i)
-			    continue;
-
-			/* Found one. */
-			break;
-		    }
-
-		    if (j > w) {
-			/* No valid values left; drop back. */
-			i--;
-			if (i < 0)
-			    break;     /* overall iteration is finished */
-			if (op == C_ADD)
-			    total += ctx->dscratch[i];
-			else
-			    total *= ctx->dscratch[i];
-		    } else {
-			/* Got a valid value; store it and move on. */
-			ctx->dscratch[i++] = j;
-			if (op == C_ADD)
-			    total -= j;
-			else
-			    total /= j;
-			ctx->dscratch[i] = 0;
-		    }
-		} else {
-		    if (total == (op == C_ADD ? 0 : 1))
-			solver_clue_candidate(ctx, diff, box);
-		    i--;
-		    if (op == C_ADD)
-			total += ctx->dscratch[i];
-		    else
-			total *= ctx->dscratch[i];
-		}
-	    }
-
-	    break;
+	/*
+	 * Try each layout against the digits still possible in each
+	 * square of the box.
+	 */
+	for (i = 0; i < n; i++) {
+	    allowed[i] = 0;
+	    for (j = 1; j <= w; j++)
+		if (solver->cube[sq[i]*w+j-1])
+		    allowed[i] |= 1 << j;
+	}
+	for (k = 0; k < ctx->ntuples[box]; k++) {
+	    const digit *cand = ctx->tuples[box] + k*n;
+	    for (i = 0; i < n; i++)
+		if (!(allowed[i] & (1 << cand[i])))
+		    break;
+	    if (i == n)
+		solver_clue_candidate(ctx, diff, box, cand);
 	}
 
 	if (diff < DIFF_HARD) {
@@ -578,12 +626,22 @@ static int solver(int w, int *dsf, long *clues, digit *soln, int maxdiff)
 
     ctx.dscratch = snewn(a+1, digit);
     ctx.iscratch = snewn(max(a+1, 4*w), int);
+    ctx.allowed = snewn(a, int);
+    ctx.tuples = snewn(ctx.nboxes, digit *);
+    ctx.ntuples = snewn(ctx.nboxes, int);
+    for (i = 0; i < ctx.nboxes; i++)
+	ctx.tuples[i] = NULL;
 
     ret = latin_solver(soln, w, maxdiff,
 		       DIFF_EASY, DIFF_HARD, DIFF_EXTREME,
 		       DIFF_EXTREME, DIFF_UNREASONABLE,
 		       keen_solvers, &ctx, NULL, NULL);
 
+    for (i = 0; i < ctx.nboxes; i++)
+	sfree(ctx.tuples[i]);
+    sfree(ctx.tuples);
+    sfree(ctx.ntuples);
+    sfree(ctx.allowed);
     sfree(ctx.dscratch);
     sfree(ctx.iscratch);
     sfree(ctx.whichbox);
@@ -1073,12 +1131,14 @@ done
 	if (diff > 0) {
 	    memset(soln, 0, a);
 	    ret = solver(w, dsf, clues, soln, diff-1);
-	    if (ret <= diff-1)
+	    if (ret <= diff-1 && !random_gen_settle(rs, GEN_RELAXED_DIFFICULTY) &&
+		!random_gen_attempt(rs, ret))
 		continue;
 	}
 	memset(soln, 0, a);
 	ret = solver(w, dsf, clues, soln, diff);
-	if (ret != diff)
+	if (ret != diff && !(ret < diff && random_gen_settle(rs, GEN_RELAXED_DIFFICULTY)) &&
+	    !random_gen_attempt(rs, ret))
 	    continue;		       /* go round again */
 
 	/*
@@ -1123,7 +1183,7 @@ done
     /*
      * Encode the solution.
      */
-    assert(memcmp(soln, grid, a) == 0);
+    assert(memcmp(soln, grid, a) == 0 || random_gen_cancelled(rs));
     *aux = snewn(a+2, char);
     (*aux)[0] = 'S';
     for (i = 0; i < a; i++)
@@ -2376,7 +2436,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    REQUIRE_RBUTTON | REQUIRE_NUMPAD | GEN_RACES | SOLUTION_CACHEABLE,  /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdarg.h>
+#include <limits.h>
 
 #include "puzzles.h"
 #include "tree234.h"
@@ -138,8 +139,50 @@ int latin_solver_elim(struct latin_solver *solver, int start, int step
     return 0;
 }
 
+/*
+ * The cube stays one byte per candidate, since that's what every
+ * puzzle's usersolvers read and write. But set elimination and forcing
+ * chains ask the same questions of it over and over ("does this row
+ * avoid all these columns?", "how many candidates has this square?"),
+ * so they first take a bitmask copy of the part they're working on.
+ * The order of a latin square is at most 32 in any puzzle, and an
+ * unsigned long has at least 32 bits.
+ */
+typedef unsigned long latin_mask;
+#define LATIN_MASK_BITS ((int)(sizeof(latin_mask) * CHAR_BIT))
+
+static int latin_mask_count(latin_mask m)
+{
+#ifdef __GNUC__
+    return __builtin_popcountl(m);
+#else
+    int n = 0;
+    for (; m; m &= m - 1)
+        n++;
+    return n;
+#endif
+}
+
+/* The index of the lowest set bit of a nonzero mask */
+static int latin_mask_first(latin_mask m)
+{
+#ifdef __GNUC__
+    return __builtin_ctzl(m);
+#else
+    int n = 0;
+    for (; !(m & 1); m >>= 1)
+        n++;
+    return n;
+#endif
+}
+
+/* For a mask with exactly two bits set, the sum of the two digits */
+#define latin_mask_pair_sum(m) \
+    (latin_mask_first(m) + latin_mask_first((m) & ((m) - 1)) + 2)
+
 struct latin_solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    latin_mask *rowmask, *cellmask;
     int *neighbours, *bfsqueue;
 #ifdef STANDALONE_SOLVER
     int *bfsprev;
@@ -158,11 +201,12 @@ int latin_solver_set(struct latin_solver *solver,
 #ifdef STANDALONE_SOLVER
     char **names = solver->names;
 #endif
-    int i, j, n, count;
+    int i, j, n;
     unsigned char *grid = scratch->grid;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
+    latin_mask *rowmask = scratch->rowmask;
+    latin_mask set, all;
 
     /*
      * We are passed a o-by-o matrix of booleans. Our first job
@@ -197,11 +241,19 @@ int latin_solver_set(struct latin_solver *solver,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, and a mask of each of its rows
+     * (column j being bit n-1-j, so that counting upwards through the
+     * candidate sets below tries them in the same order as it always
+     * has).
      */
-    for (i = 0; i < n; i++)
-        for (j = 0; j < n; j++)
+    for (i = 0; i < n; i++) {
+        rowmask[i] = 0;
+        for (j = 0; j < n; j++) {
             grid[i*o+j] = solver->cube[start+rowidx[i]*step1+colidx[j]*step2];
+            if (grid[i*o+j])
+                rowmask[i] |= (latin_mask)1 << (n-1-j);
+        }
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -211,30 +263,24 @@ int latin_solver_set(struct latin_solver *solver,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
+    assert(n <= LATIN_MASK_BITS);
+    all = n ? (((latin_mask)1 << (n-1)) << 1) - 1 : 0;
+    for (set = 0;; set++) {
         /*
-         * We have a candidate set. If its size is <=1 or >=n-1
-         * then we move on immediately.
+         * Skip straight to the next candidate set whose size is
+         * between 2 and n-2 and which at least n-count rows avoid
+         * (the kernel counting them is chosen for the CPU; see
+         * cpu.c). Then we count those rows again here.
          */
-        if (count > 1 && count < n-1) {
-            /*
-             * The number of rows we need is n-count. See if we can
-             * find that many rows which each have a zero in all
-             * the positions listed in `set'.
-             */
+        int count = bitset_find_set(rowmask, n, &set);
+
+        if (!count)
+            break;
+        {
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*o+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!(rowmask[i] & set))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -275,15 +321,10 @@ int latin_solver_set(struct latin_solver *solver,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*o+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    if (rowmask[i] & set) {
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*o+j]) {
+                            if (!(set & ((latin_mask)1 << (n-1-j))) &&
+                                grid[i*o+j]) {
                                 int fpos = (start+rowidx[i]*step1+
                                             colidx[j]*step2);
 #ifdef STANDALONE_SOLVER
@@ -322,16 +363,7 @@ int latin_solver_set(struct latin_solver *solver,
             }
         }
 
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (set == all)
             break;                     /* done */
     }
 
@@ -387,26 +419,37 @@ int latin_solver_forcing(struct latin_solver *solver,
 #endif
     unsigned char *number = scratch->grid;
     int *neighbours = scratch->neighbours;
-    int x, y;
+    latin_mask *cellmask = scratch->cellmask;
+    int x, y, n;
 
+    /*
+     * Nothing changes the cube until we return, so take the
+     * candidates of every square as a mask first.
+     */
     for (y = 0; y < o; y++)
         for (x = 0; x < o; x++) {
-            int count, t, n;
+            latin_mask m = 0;
+            for (n = 1; n <= o; n++)
+                if (cube(x, y, n))
+                    m |= (latin_mask)1 << (n-1);
+            cellmask[y*o+x] = m;
+        }
+
+    for (y = 0; y < o; y++)
+        for (x = 0; x < o; x++) {
+            int t;
 
             /*
              * If this square doesn't have exactly two candidate
              * numbers, don't try it.
              *
-             * In this loop we also sum the candidate numbers,
-             * which is a nasty hack to allow us to quickly find
-             * `the other one' (since we will shortly know there
-             * are exactly two).
+             * We also sum the candidate numbers, which is a nasty
+             * hack to allow us to quickly find `the other one'
+             * (since we now know there are exactly two).
              */
-            for (count = t = 0, n = 1; n <= o; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            if (latin_mask_count(cellmask[y*o+x]) != 2)
                 continue;
+            t = latin_mask_pair_sum(cellmask[y*o+x]);
 
             /*
              * Now attempt a bfs for each candidate.
@@ -450,7 +493,7 @@ int latin_solver_forcing(struct latin_solver *solver,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            latin_mask mt;
 
                             xt = neighbours[i] % o;
                             yt = neighbours[i] / o;
@@ -462,7 +505,8 @@ int latin_solver_forcing(struct latin_solver *solver,
                              */
                             if (number[yt*o+xt] <= o)
                                 continue;
-                            if (!cube(xt, yt, currn))
+                            mt = cellmask[yt*o+xt];
+                            if (!(mt & ((latin_mask)1 << (currn-1))))
                                 continue;
 
                             /*
@@ -477,15 +521,13 @@ int latin_solver_forcing(struct latin_solver *solver,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= o; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            if (latin_mask_count(mt) == 2) {
                                 bfsqueue[tail++] = yt*o+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*o+xt] = yy*o+xx;
 #endif
-                                number[yt*o+xt] = tt - currn;
+                                number[yt*o+xt] = latin_mask_pair_sum(mt)
+                                                  - currn;
                             }
 
                             /*
@@ -540,7 +582,8 @@ struct latin_solver_scratch *latin_solver_new_scratch(struct latin_solver *solve
     scratch->grid = snewn(o*o, unsigned char);
     scratch->rowidx = snewn(o, unsigned char);
     scratch->colidx = snewn(o, unsigned char);
-    scratch->set = snewn(o, unsigned char);
+    scratch->rowmask = snewn(o, latin_mask);
+    scratch->cellmask = snewn(o*o, latin_mask);
     scratch->neighbours = snewn(3*o, int);
     scratch->bfsqueue = snewn(o*o, int);
 #ifdef STANDALONE_SOLVER
@@ -556,7 +599,8 @@ void latin_solver_free_scratch(struct latin_solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->cellmask);
+    sfree(scratch->rowmask);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
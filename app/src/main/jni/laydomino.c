@@ -42,7 +42,8 @@ int *domino_layout(int w, int h, random_state *rs)
 void domino_layout_prealloc(int w, int h, random_state *rs,
                             int *grid, int *grid2, int *list)
 {
-    int i, j, k, m, wh = w*h, todo, done;
+    int i, j, k, m, wh = w*h, todo, done, nsingles, last, ntouched;
+    int *touched = list + wh;
 
     /*
      * To begin with, set grid[i] = i for all i to indicate
@@ -100,6 +101,21 @@ void domino_layout_prealloc(int w, int h, random_state *rs,
     printf("generated initial layout\n");
 #endif
 
+    /*
+     * Count the singletons left over, and set grid2 to -1
+     * everywhere. It will hold our distance-from-start values, and
+     * also our backtracking data, during each b.f.s. below; rather
+     * than clearing all of it again before every search, each
+     * search puts back -1 in just the entries it wrote to.
+     */
+    nsingles = 0;
+    for (j = 0; j < wh; j++) {
+        if (grid[j] == j)
+            nsingles++;
+        grid2[j] = -1;
+    }
+    last = wh - 1;
+
     /*
      * Now we've placed as many dominoes as we can immediately
      * manage. There will be squares remaining, but they'll be
@@ -146,29 +162,26 @@ void domino_layout_prealloc(int w, int h, random_state *rs,
          * automatically taken care of by the fact that we
          * always make an even number of orthogonal moves.)
          */
-        k = 0;
-        for (j = 0; j < wh; j++) {
-            if (grid[j] == j) {
-                k++;
-                i = j;          /* start BFS here. */
-            }
-        }
-        if (k == (wh % 2))
+        if (nsingles == (wh % 2))
             break;              /* if area is even, we have no more singletons;
                                    if area is odd, we have one singleton.
                                    either way, we're done. */
 
+        /*
+         * Start the b.f.s. at the last singleton in the grid. Each
+         * repair only ever removes singletons, so the last one can
+         * be found by carrying on downwards from where the previous
+         * one was.
+         */
+        while (grid[last] != last)
+            last--;
+        i = last;
+
 #ifdef GENERATION_DIAGNOSTICS
         printf("starting b.f.s. at singleton %d\n", i);
 #endif
-        /*
-         * Set grid2 to -1 everywhere. It will hold our
-         * distance-from-start values, and also our
-         * backtracking data, during the b.f.s.
-         */
-        for (j = 0; j < wh; j++)
-            grid2[j] = -1;
         grid2[i] = 0;              /* starting square has distance zero */
+        ntouched = 0;
 
         /*
          * Start our to-do list of squares. It'll live in
@@ -216,6 +229,7 @@ void domino_layout_prealloc(int w, int h, random_state *rs,
                     printf("found neighbouring singleton %d\n", k);
 #endif
                     grid2[k] = i;
+                    touched[ntouched++] = k;
                     break;         /* found a target singleton! */
                 }
 
@@ -237,6 +251,7 @@ void domino_layout_prealloc(int w, int h, random_state *rs,
 #endif
                     grid2[m] = grid2[i]+1;
                     grid2[k] = i;
+                    touched[ntouched++] = k;
                     /*
                      * And since we've now visited a new
                      * domino, add m to the to-do list.
@@ -281,6 +296,17 @@ void domino_layout_prealloc(int w, int h, random_state *rs,
                 break;             /* we've reached the other singleton */
             i = k;
         }
+        nsingles -= 2;
+
+        /*
+         * Clear up after ourselves in grid2: the b.f.s. wrote only
+         * to the squares on its to-do list and to the near ends of
+         * the dominoes it crossed to reach them.
+         */
+        for (j = 0; j < todo; j++)
+            grid2[list[j]] = -1;
+        for (j = 0; j < ntouched; j++)
+            grid2[touched[j]] = -1;
 #ifdef GENERATION_DIAGNOSTICS
         printf("fixup path completed\n");
 #endif
@@ -110,6 +110,7 @@ struct game_params {
 #define F_LIGHT         16
 
 #define F_MARK          32
+#define F_SETMEMBER     64      /* solver scratch: in the set being tested */
 
 struct game_state {
     int w, h, nlights;
@@ -118,6 +119,7 @@ struct game_state {
                            the number of times it's lit. size h*w*/
     unsigned int *flags;        /* size h*w */
     int completed, used_solve;
+    struct sightlines *sight;   /* shared; NULL until the blacks are final */
 };
 
 #define GRID(gs,grid,x,y) (gs->grid[(y)*((gs)->w) + (x)])
@@ -132,6 +134,15 @@ typedef struct {
     int include_origin;
 } ll_data;
 
+/* Every square's ll_data depends only on where the black squares are,
+ * so once those are fixed it is worked out once and shared between all
+ * the states of that grid, rather than walked out again on every call
+ * to list_lights. */
+struct sightlines {
+    int refcount;
+    ll_data *lld;               /* size h*w */
+};
+
 /* Macro that executes 'block' once per light in lld, including
  * the origin if include_origin is specified. 'block' can use
  * lx and ly as the coords. */
@@ -378,9 +389,18 @@ static game_state *new_state(const game_params *params)
     ret->flags = snewn(ret->w * ret->h, unsigned int);
     memset(ret->flags, 0, ret->w * ret->h * sizeof(unsigned int));
     ret->completed = ret->used_solve = 0;
+    ret->sight = NULL;
     return ret;
 }
 
+static void free_sightlines(struct sightlines *sight)
+{
+    if (sight && --sight->refcount <= 0) {
+        sfree(sight->lld);
+        sfree(sight);
+    }
+}
+
 static game_state *dup_game(const game_state *state)
 {
     game_state *ret = snew(game_state);
@@ -398,11 +418,15 @@ static game_state *dup_game(const game_state *state)
     ret->completed = state->completed;
     ret->used_solve = state->used_solve;
 
+    ret->sight = state->sight;
+    if (ret->sight) ret->sight->refcount++;
+
     return ret;
 }
 
 static void free_game(game_state *state)
 {
+    free_sightlines(state->sight);
     sfree(state->lights);
     sfree(state->flags);
     sfree(state);
@@ -657,6 +681,12 @@ static void list_lights(game_state *state, int ox, int oy, int origin,
 {
     int x,y;
 
+    if (state->sight) {
+        *lld = state->sight->lld[oy*state->w + ox];
+        lld->include_origin = origin;
+        return;
+    }
+
     lld->ox = lld->minx = lld->maxx = ox;
     lld->oy = lld->miny = lld->maxy = oy;
     lld->include_origin = origin;
@@ -682,6 +712,25 @@ static void list_lights(game_state *state, int ox, int oy, int origin,
     }
 }
 
+/* Works out the sightlines of a grid whose black squares are now fixed,
+ * dropping any left over from a previous layout. */
+static void set_sightlines(game_state *state)
+{
+    struct sightlines *sight;
+    int x, y;
+
+    free_sightlines(state->sight);
+    state->sight = NULL;
+
+    sight = snew(struct sightlines);
+    sight->refcount = 1;
+    sight->lld = snewn(state->w * state->h, ll_data);
+    for (y = 0; y < state->h; y++)
+        for (x = 0; x < state->w; x++)
+            list_lights(state, x, y, 0, &sight->lld[y*state->w + x]);
+    state->sight = sight;
+}
+
 /* Makes sure a light is the given state, editing the lights table to suit the
  * new state if necessary. */
 static void set_light(game_state *state, int ox, int oy, int on)
@@ -975,20 +1024,21 @@ static void try_rule_out(game_state *state, int x, int y,
                          struct setscratch *scratch, int n,
                          trl_cb cb, void *ctx);
 
+/* The squares of the set being tested are flagged F_SETMEMBER, so that
+ * this needn't search the set for each square ruled out; the flag is
+ * cleared as each one is found, and the callers count them. */
 static void trl_callback_search(game_state *state, int dx, int dy,
-                       struct setscratch *scratch, int n, void *ignored)
+                       struct setscratch *scratch, int n, void *ctx)
 {
-    int i;
+    int *nfound = (int *)ctx;
 
 #ifdef SOLVER_DIAGNOSTICS
     if (verbose) debug(("discount cb: light at (%d,%d)\n", dx, dy));
 #endif
 
-    for (i = 0; i < n; i++) {
-        if (dx == scratch[i].x && dy == scratch[i].y) {
-            scratch[i].n = 1;
-            return;
-        }
+    if (GRID(state,flags,dx,dy) & F_SETMEMBER) {
+        GRID(state,flags,dx,dy) &= ~F_SETMEMBER;
+        (*nfound)++;
     }
 }
 
@@ -996,7 +1046,7 @@ static void trl_callback_discount(game_state *state, int dx, int dy,
                        struct setscratch *scratch, int n, void *ctx)
 {
     int *didsth = (int *)ctx;
-    int i;
+    int i, nfound = 0;
 
     if (GRID(state,flags,dx,dy) & F_IMPOSSIBLE) {
 #ifdef SOLVER_DIAGNOSTICS
@@ -1016,10 +1066,12 @@ static void trl_callback_discount(game_state *state, int dx, int dy,
 #endif
 
     for (i = 0; i < n; i++)
-        scratch[i].n = 0;
-    try_rule_out(state, dx, dy, scratch, n, trl_callback_search, NULL);
-    for (i = 0; i < n; i++) {
-        if (scratch[i].n == 0) return;
+        GRID(state,flags,scratch[i].x,scratch[i].y) |= F_SETMEMBER;
+    try_rule_out(state, dx, dy, scratch, n, trl_callback_search, &nfound);
+    if (nfound < n) {
+        for (i = 0; i < n; i++)
+            GRID(state,flags,scratch[i].x,scratch[i].y) &= ~F_SETMEMBER;
+        return;
     }
     /* The light ruled out everything in scratch. Yay. */
     GRID(state,flags,dx,dy) |= F_IMPOSSIBLE;
@@ -1536,6 +1588,7 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
     while (1) {
         for (i = 0; i < MAX_GRIDGEN_TRIES; i++) {
             set_blacks(news, params, rs); /* also cleans board. */
+            set_sightlines(news);
 
             /* set up lights and then the numbers, and remove the lights */
             place_lights(news, rs);
@@ -1694,6 +1747,7 @@ static game_state *new_game(midend *me, const game_params *params,
     }
     if (*desc) assert(!"Over-long desc.");
 
+    set_sightlines(ret);
     return ret;
 }
 
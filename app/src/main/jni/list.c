@@ -50,5 +50,6 @@
 GAMELIST(DECL)
 const game *gamelist[] = { GAMELIST(REF) };
 const int gamecount = lenof(gamelist);
+/* Sorted, because Recipe includes the *.R files in sorted order; game_by_name relies on it */
 #define NAME(x) #x,
 const char* gamenames[] = { GAMELIST(NAME) };
\ No newline at end of file
@@ -26,6 +26,10 @@ struct face_score {
     int white_score;
     int black_score;
     unsigned long random;
+    /* What the bias function last said colouring this face white or
+     * black would gain, while bias_known says that is still up to date. */
+    int bias_gain[2];
+    unsigned char bias_known[2];
     /* No need to store a grid_face* here.  The 'face_scores' array will
      * be a list of 'face_score' objects, one for each face of the grid, so
      * the position (index) within the 'face_scores' array will determine
@@ -239,6 +243,51 @@ static int face_score(grid *g, char *board, grid_face *face,
     return -face_num_neighbours(g, board, face, colour);
 }
 
+/*
+ * The bias function's gain for colouring a face can only have changed
+ * if some face near it has been coloured since it was last asked (see
+ * loopgen.h), so when cur_face is coloured we forget the gains of every
+ * face with a corner within LOOPGEN_BIAS_RADIUS edges of one of its
+ * corners. 'dotmark' and 'dotqueue' are scratch space of g->num_dots
+ * ints, with dotmark all -1 between calls.
+ */
+static void forget_bias_gains(grid *g, struct face_score *face_scores,
+                              grid_face *cur_face, int *dotmark,
+                              int *dotqueue)
+{
+    int head, tail, i, j;
+
+    head = tail = 0;
+    for (i = 0; i < cur_face->order; i++) {
+        int di = cur_face->dots[i] - g->dots;
+        if (dotmark[di] < 0) {
+            dotmark[di] = 0;
+            dotqueue[tail++] = di;
+        }
+    }
+    while (head < tail) {
+        grid_dot *d = g->dots + dotqueue[head++];
+        int dist = dotmark[d - g->dots];
+
+        for (j = 0; j < d->order; j++) {
+            if (d->faces[j]) {
+                struct face_score *fs = face_scores + (d->faces[j] - g->faces);
+                fs->bias_known[0] = fs->bias_known[1] = FALSE;
+            }
+            if (dist < LOOPGEN_BIAS_RADIUS) {
+                grid_edge *e = d->edges[j];
+                int d2 = (e->dot1 == d ? e->dot2 : e->dot1) - g->dots;
+                if (dotmark[d2] < 0) {
+                    dotmark[d2] = dist + 1;
+                    dotqueue[tail++] = d2;
+                }
+            }
+        }
+    }
+    for (i = 0; i < tail; i++)
+        dotmark[dotqueue[i]] = -1;
+}
+
 /*
  * Generate a new complete random closed loop for the given grid.
  *
@@ -306,6 +355,7 @@ void generate_loop(grid *g, char *board, random_state *rs,
     tree234 *lightable_faces_sorted;
     tree234 *darkable_faces_sorted;
     int *face_list;
+    int *dotmark = NULL, *dotqueue = NULL;
     int do_random_pass;
 
     /* Make a board */
@@ -316,6 +366,13 @@ void generate_loop(grid *g, char *board, random_state *rs,
     for (i = 0; i < num_faces; i++) {
         face_scores[i].random = random_bits(rs, 31);
         face_scores[i].black_score = face_scores[i].white_score = 0;
+        face_scores[i].bias_known[0] = face_scores[i].bias_known[1] = FALSE;
+    }
+    if (bias) {
+        dotmark = snewn(g->num_dots, int);
+        dotqueue = snewn(g->num_dots, int);
+        for (i = 0; i < g->num_dots; i++)
+            dotmark[i] = -1;
     }
     
     /* Colour a random, finite face white.  The infinite face is implicitly
@@ -386,9 +443,12 @@ void generate_loop(grid *g, char *board, random_state *rs,
              * Go through all the candidate faces and pick the one the
              * bias function likes best, breaking ties using the
              * ordering in our tree234 (which is why we replace only
-             * if score > bestscore, not >=).
+             * if score > bestscore, not >=). Only the faces near the
+             * last one coloured need asking again; since every
+             * candidate starts from the same board, comparing gains
+             * is the same as comparing scores.
              */
-            int j, k;
+            int j, k, ci = (colour == FACE_WHITE ? 0 : 1);
             struct face_score *best = NULL;
             int score, bestscore = 0;
 
@@ -397,12 +457,17 @@ void generate_loop(grid *g, char *board, random_state *rs,
                  j++) {
 
                 assert(fs);
-                k = fs - face_scores;
-                assert(board[k] == FACE_GREY);
-                board[k] = colour;
-                score = bias(biasctx, board, k);
-                board[k] = FACE_GREY;
-                bias(biasctx, board, k); /* let bias know we put it back */
+                if (!fs->bias_known[ci]) {
+                    k = fs - face_scores;
+                    assert(board[k] == FACE_GREY);
+                    board[k] = colour;
+                    score = bias(biasctx, board, k);
+                    board[k] = FACE_GREY;
+                    /* let bias know we put it back */
+                    fs->bias_gain[ci] = score - bias(biasctx, board, k);
+                    fs->bias_known[ci] = TRUE;
+                }
+                score = fs->bias_gain[ci];
 
                 if (!best || score > bestscore) {
                     bestscore = score;
@@ -417,8 +482,11 @@ void generate_loop(grid *g, char *board, random_state *rs,
         i = fs - face_scores;
         assert(board[i] == FACE_GREY);
         board[i] = colour;
-        if (bias)
+        if (bias) {
             bias(biasctx, board, i); /* notify bias function of the change */
+            forget_bias_gains(g, face_scores, g->faces + i,
+                              dotmark, dotqueue);
+        }
 
         /* Remove this newly-coloured face from the lists.  These lists should
          * only contain grey faces. */
@@ -478,6 +546,8 @@ void generate_loop(grid *g, char *board, random_state *rs,
     freetree234(lightable_faces_sorted);
     freetree234(darkable_faces_sorted);
     sfree(face_scores);
+    sfree(dotmark);
+    sfree(dotqueue);
 
     /* The next step requires a shuffled list of all faces */
     face_list = snewn(num_faces, int);
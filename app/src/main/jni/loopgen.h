@@ -28,7 +28,14 @@ typedef int (*loopgen_bias_fn_t)(void *ctx, char *board, int face);
  * parameter to the bias function indicates which face of the grid has
  * been modified since the last call; it is guaranteed that only one
  * will have been (so that bias functions can work incrementally
- * rather than re-scanning the whole grid on every call). */
+ * rather than re-scanning the whole grid on every call).
+ *
+ * The bias must also be local: the change in its value from colouring
+ * one face may depend only on the colours of faces with a corner
+ * within LOOPGEN_BIAS_RADIUS edges of one of that face's corners. The
+ * generator relies on this to avoid asking again about faces which
+ * nothing near has changed. */
+#define LOOPGEN_BIAS_RADIUS 2
 extern void generate_loop(grid *g, char *board, random_state *rs,
                           loopgen_bias_fn_t bias, void *biasctx);
 
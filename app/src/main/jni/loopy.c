@@ -111,7 +111,8 @@ enum {
 struct game_state {
     grid *game_grid; /* ref-counted (internally) */
 
-    /* Put -1 in a face that doesn't get a clue */
+    /* Put -1 in a face that doesn't get a clue. Shared between states
+     * (see shared_new), so unshare it before changing it. */
     signed char *clues;
 
     /* Array of line states, to store whether each line is
@@ -126,8 +127,20 @@ struct game_state {
     /* Used in game_text_format(), so that it knows what type of
      * grid it's trying to render as ASCII text. */
     int grid_type;
+
+    /* So that game_redraw can tell a state that's one move on from (or
+     * back from) the one it last drew, and look at only the edges that
+     * move changed rather than the whole grid. Every state gets its own
+     * id; prev_id is the state execute_move made this one from (or 0),
+     * and changed lists the edges whose lines or line_errors differ from
+     * it, nchanged being -1 if there were too many to be worth listing. */
+    unsigned id, prev_id;
+    int nchanged;
+    int *changed;
 };
 
+#define MAX_CHANGED 64
+
 enum solver_status {
     SOLVER_SOLVED,    /* This is the only solution the solver could find */
     SOLVER_MISTAKE,   /* This is definitely not a solution */
@@ -155,6 +168,11 @@ typedef struct solver_state {
     char *dot_solved, *face_solved;
     int *dotdsf;
 
+    /* Faces and dots with a line or dline changed near them since
+     * each solver function last looked at them, as TODO_* bits. Only
+     * these can give that function anything new. */
+    char *face_todo, *dot_todo;
+
     /* Information for Normal level deductions:
      * For each dline, store a bitmask for whether we know:
      * (bit 0) at least one is YES
@@ -165,6 +183,8 @@ typedef struct solver_state {
     int *linedsf;
 } solver_state;
 
+enum { TODO_TRIVIAL = 1, TODO_DLINE = 2, TODO_ALL = 3 };
+
 /*
  * Difficulty levels. I do some macro ickery here to ensure that my
  * enum and the various forms of my name list always match up.
@@ -241,6 +261,14 @@ struct game_drawstate {
     blitter *cur_bl;
 #endif
     grid_edge *cur_edge;
+
+    /* The state last drawn, as far as game_redraw needs to know it */
+    unsigned drawn_id, drawn_prev_id;
+    int drawn_nchanged;
+    int drawn_changed[MAX_CHANGED];
+
+    /* Scratch space for game_redraw_in_rect's grid_index_query calls */
+    int *near_faces, *near_edges, *near_dots;
 };
 
 static char *validate_desc(const game_params *params, const char *desc);
@@ -317,18 +345,38 @@ static grid *loopy_generate_grid(const game_params *params,
  * General struct manipulation and other straightforward code
  */
 
+static unsigned new_state_id(void)
+{
+    static unsigned last_id;
+    unsigned id;
+    do {
+#ifdef __GNUC__
+        id = __sync_add_and_fetch(&last_id, 1);
+#else
+        id = ++last_id;
+#endif
+    } while (!id);
+    return id;
+}
+
+static void init_state_history(game_state *state)
+{
+    state->id = new_state_id();
+    state->prev_id = 0;
+    state->nchanged = -1;
+    state->changed = NULL;
+}
+
 static game_state *dup_game(const game_state *state)
 {
     game_state *ret = snew(game_state);
 
-    ret->game_grid = state->game_grid;
-    ret->game_grid->refcount++;
+    ret->game_grid = grid_ref(state->game_grid);
 
     ret->solved = state->solved;
     ret->cheated = state->cheated;
 
-    ret->clues = snewn(state->game_grid->num_faces, signed char);
-    memcpy(ret->clues, state->clues, state->game_grid->num_faces);
+    ret->clues = shared_ref(state->clues);
 
     ret->lines = snewn(state->game_grid->num_edges, char);
     memcpy(ret->lines, state->lines, state->game_grid->num_edges);
@@ -337,6 +385,7 @@ static game_state *dup_game(const game_state *state)
     memcpy(ret->line_errors, state->line_errors, state->game_grid->num_edges);
 
     ret->grid_type = state->grid_type;
+    init_state_history(ret);
     return ret;
 }
 
@@ -344,7 +393,8 @@ static void free_game(game_state *state)
 {
     if (state) {
         grid_free(state->game_grid);
-        sfree(state->clues);
+        sfree(state->changed);
+        shared_free(state->clues);
         sfree(state->lines);
         sfree(state->line_errors);
         sfree(state);
@@ -375,6 +425,11 @@ static solver_state *new_solver_state(const game_state *state, int diff) {
     memset(ret->dot_solved, FALSE, num_dots);
     memset(ret->face_solved, FALSE, num_faces);
 
+    ret->dot_todo = snewn(num_dots, char);
+    ret->face_todo = snewn(num_faces, char);
+    memset(ret->dot_todo, TODO_ALL, num_dots);
+    memset(ret->face_todo, TODO_ALL, num_faces);
+
     ret->dot_yes_count = snewn(num_dots, char);
     memset(ret->dot_yes_count, 0, num_dots);
     ret->dot_no_count = snewn(num_dots, char);
@@ -407,6 +462,8 @@ static void free_solver_state(solver_state *sstate) {
         sfree(sstate->looplen);
         sfree(sstate->dot_solved);
         sfree(sstate->face_solved);
+        sfree(sstate->dot_todo);
+        sfree(sstate->face_todo);
         sfree(sstate->dot_yes_count);
         sfree(sstate->dot_no_count);
         sfree(sstate->face_yes_count);
@@ -444,6 +501,11 @@ static solver_state *dup_solver_state(const solver_state *sstate) {
     memcpy(ret->dot_solved, sstate->dot_solved, num_dots);
     memcpy(ret->face_solved, sstate->face_solved, num_faces);
 
+    ret->dot_todo = snewn(num_dots, char);
+    ret->face_todo = snewn(num_faces, char);
+    memcpy(ret->dot_todo, sstate->dot_todo, num_dots);
+    memcpy(ret->face_todo, sstate->face_todo, num_faces);
+
     ret->dot_yes_count = snewn(num_dots, char);
     memcpy(ret->dot_yes_count, sstate->dot_yes_count, num_dots);
     ret->dot_no_count = snewn(num_dots, char);
@@ -973,6 +1035,12 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
 #endif
     ds->cur_edge = NULL;
 
+    ds->drawn_id = ds->drawn_prev_id = 0;
+    ds->drawn_nchanged = -1;
+    ds->near_faces = snewn(num_faces, int);
+    ds->near_edges = snewn(num_edges, int);
+    ds->near_dots = snewn(state->game_grid->num_dots, int);
+
     return ds;
 }
 
@@ -987,6 +1055,9 @@ static void game_free_drawstate(drawing *dr, game_drawstate *ds)
     sfree(ds->clue_error);
     sfree(ds->clue_satisfied);
     sfree(ds->lines);
+    sfree(ds->near_faces);
+    sfree(ds->near_edges);
+    sfree(ds->near_dots);
     sfree(ds);
 }
 
@@ -1121,6 +1192,21 @@ static void check_caches(const solver_state* sstate)
  * Solver utility functions
  */
 
+/* Something around this dot has changed, so every solver function
+ * should look at it, and at the faces around it, again.  (Faces need
+ * the whole neighbourhood, because their deductions look at the lines
+ * and the dlines at each of their corners.) */
+static void solver_dot_changed(solver_state *sstate, grid_dot *d)
+{
+    grid *g = sstate->state->game_grid;
+    int k;
+
+    sstate->dot_todo[d - g->dots] = TODO_ALL;
+    for (k = 0; k < d->order; k++)
+        if (d->faces[k])
+            sstate->face_todo[d->faces[k] - g->faces] = TODO_ALL;
+}
+
 /* Sets the line (with index i) to the new state 'line_new', and updates
  * the cached counts of any affected faces and dots.
  * Returns TRUE if this actually changed the line's state. */
@@ -1153,6 +1239,9 @@ static int solver_set_line(solver_state *sstate, int i,
     g = state->game_grid;
     e = g->edges + i;
 
+    solver_dot_changed(sstate, e->dot1);
+    solver_dot_changed(sstate, e->dot2);
+
     /* Update the cache for both dots and both faces affected by this. */
     if (line_new == LINE_YES) {
         sstate->dot_yes_count[e->dot1 - g->dots]++;
@@ -1344,7 +1433,7 @@ static int face_setall(solver_state *sstate, int face,
 
 static void add_full_clues(game_state *state, random_state *rs)
 {
-    signed char *clues = state->clues;
+    signed char *clues = state->clues = shared_unshare(state->clues);
     grid *g = state->game_grid;
     char *board = snewn(g->num_faces, char);
     int i;
@@ -1413,6 +1502,7 @@ static game_state *remove_clues(game_state *state, random_state *rs,
 
     for (n = 0; n < num_faces; ++n) {
         saved_ret = dup_game(ret);
+        ret->clues = shared_unshare(ret->clues);
         ret->clues[face_list[n]] = -1;
 
         if (game_has_unique_soln(ret, diff)) {
@@ -1440,11 +1530,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     grid_desc = grid_new_desc(grid_types[params->type], params->w, params->h, rs);
     state->game_grid = g = loopy_generate_grid(params, grid_desc);
 
-    state->clues = snewn(g->num_faces, signed char);
+    state->clues = shared_new(g->num_faces);
     state->lines = snewn(g->num_edges, char);
     state->line_errors = snewn(g->num_edges, unsigned char);
 
     state->grid_type = params->type;
+    init_state_history(state);
 
     newboard_please:
 
@@ -1511,13 +1602,14 @@ static game_state *new_game(midend *me, const game_params *params,
     num_faces = g->num_faces;
     num_edges = g->num_edges;
 
-    state->clues = snewn(num_faces, signed char);
+    state->clues = shared_new(num_faces);
     state->lines = snewn(num_edges, char);
     state->line_errors = snewn(num_edges, unsigned char);
 
     state->solved = state->cheated = FALSE;
 
     state->grid_type = params->type;
+    init_state_history(state);
 
     for (i = 0; i < num_faces; i++) {
         if (empties_to_make) {
@@ -1792,17 +1884,29 @@ static int is_atleastone(const char *dline_array, int index)
 {
     return BIT_SET(dline_array[index], 0);
 }
-static int set_atleastone(char *dline_array, int index)
+/* The dot a dline is centred on; see dline_index_from_dot. */
+static void solver_dline_changed(solver_state *sstate, int index)
 {
-    return SET_BIT(dline_array[index], 0);
+    grid_edge *e = sstate->state->game_grid->edges + index / 2;
+    solver_dot_changed(sstate, (index & 1) ? e->dot1 : e->dot2);
+}
+static int set_atleastone(solver_state *sstate, int index)
+{
+    if (!SET_BIT(sstate->dlines[index], 0))
+        return FALSE;
+    solver_dline_changed(sstate, index);
+    return TRUE;
 }
 static int is_atmostone(const char *dline_array, int index)
 {
     return BIT_SET(dline_array[index], 1);
 }
-static int set_atmostone(char *dline_array, int index)
+static int set_atmostone(solver_state *sstate, int index)
 {
-    return SET_BIT(dline_array[index], 1);
+    if (!SET_BIT(sstate->dlines[index], 1))
+        return FALSE;
+    solver_dline_changed(sstate, index);
+    return TRUE;
 }
 
 static void array_setall(char *array, char from, char to, int len)
@@ -1848,7 +1952,7 @@ static int dline_set_opp_atleastone(solver_state *sstate,
             continue;
         /* Found opposite UNKNOWNS and they're next to each other */
         opp_dline_index = dline_index_from_dot(g, d, opp);
-        return set_atleastone(sstate->dlines, opp_dline_index);
+        return set_atleastone(sstate, opp_dline_index);
     }
     return FALSE;
 }
@@ -2033,6 +2137,10 @@ static int trivial_deductions(solver_state *sstate)
     for (i = 0; i < g->num_faces; i++) {
         grid_face *f = g->faces + i;
 
+        if (!(sstate->face_todo[i] & TODO_TRIVIAL))
+            continue;
+        sstate->face_todo[i] &= ~TODO_TRIVIAL;
+
         if (sstate->face_solved[i])
             continue;
 
@@ -2140,6 +2248,10 @@ static int trivial_deductions(solver_state *sstate)
         grid_dot *d = g->dots + i;
         int yes, no, unknown;
 
+        if (!(sstate->dot_todo[i] & TODO_TRIVIAL))
+            continue;
+        sstate->dot_todo[i] &= ~TODO_TRIVIAL;
+
         if (sstate->dot_solved[i])
             continue;
 
@@ -2239,6 +2351,9 @@ static int dline_deductions(solver_state *sstate)
         int j,m;
         int clue = state->clues[i];
         assert(N <= MAX_FACE_SIZE);
+        if (!(sstate->face_todo[i] & TODO_DLINE))
+            continue;
+        sstate->face_todo[i] &= ~TODO_DLINE;
         if (sstate->face_solved[i])
             continue;
         if (clue < 0) continue;
@@ -2349,13 +2464,13 @@ static int dline_deductions(solver_state *sstate)
                 /* minimum YESs in the complement of this dline */
                 if (mins[k][j] > clue - 2) {
                     /* Adding 2 YESs would break the clue */
-                    if (set_atmostone(dlines, dline_index))
+                    if (set_atmostone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
                 /* maximum YESs in the complement of this dline */
                 if (maxs[k][j] < clue) {
                     /* Adding 2 NOs would mean not enough YESs */
-                    if (set_atleastone(dlines, dline_index))
+                    if (set_atleastone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
             }
@@ -2372,6 +2487,9 @@ static int dline_deductions(solver_state *sstate)
         int N = d->order;
         int yes, no, unknown;
         int j;
+        if (!(sstate->dot_todo[i] & TODO_DLINE))
+            continue;
+        sstate->dot_todo[i] &= ~TODO_DLINE;
         if (sstate->dot_solved[i])
             continue;
         yes = sstate->dot_yes_count[i];
@@ -2393,11 +2511,11 @@ static int dline_deductions(solver_state *sstate)
 
             /* Infer dline state from line state */
             if (line1 == LINE_NO || line2 == LINE_NO) {
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
             }
             if (line1 == LINE_YES || line2 == LINE_YES) {
-                if (set_atleastone(dlines, dline_index))
+                if (set_atleastone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
             }
             /* Infer line state from dline state */
@@ -2443,10 +2561,10 @@ static int dline_deductions(solver_state *sstate)
                 }
             }
             if (yes == 1) {
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
                 if (unknown == 2) {
-                    if (set_atleastone(dlines, dline_index))
+                    if (set_atleastone(sstate, dline_index))
                         diff = min(diff, DIFF_NORMAL);
                 }
             }
@@ -2472,7 +2590,7 @@ static int dline_deductions(solver_state *sstate)
                         if (j == N-1 && opp == 0)
                             continue;
                         opp_dline_index = dline_index_from_dot(g, d, opp);
-                        if (set_atmostone(dlines, opp_dline_index))
+                        if (set_atmostone(sstate, opp_dline_index))
                             diff = min(diff, DIFF_NORMAL);
                     }
                     if (yes == 0 && is_atmostone(dlines, dline_index)) {
@@ -2585,9 +2703,9 @@ static int linedsf_deductions(solver_state *sstate)
             can2 = edsf_canonify(sstate->linedsf, line2_index, &inv2);
             if (can1 == can2 && inv1 != inv2) {
                 /* These are opposites, so set dline atmostone/atleastone */
-                if (set_atmostone(dlines, dline_index))
+                if (set_atmostone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
-                if (set_atleastone(dlines, dline_index))
+                if (set_atleastone(sstate, dline_index))
                     diff = min(diff, DIFF_NORMAL);
                 continue;
             }
@@ -2860,6 +2978,9 @@ static char *solve_game(const game_state *state, const game_state *currstate,
     char *soln = NULL;
     solver_state *sstate, *new_sstate;
 
+    if (aux)
+        return dupstr(aux);
+
     sstate = new_solver_state(state, DIFF_MAX);
     new_sstate = solve_game_rec(sstate);
 
@@ -3045,6 +3166,27 @@ static game_state *execute_move(const game_state *state, const char *move)
     if (check_completion(newstate))
         newstate->solved = TRUE;
 
+    /*
+     * Note what changed, for game_redraw. A move that closes or breaks
+     * a loop can change line_errors all over the grid, in which case
+     * we give up listing.
+     */
+    newstate->prev_id = state->id;
+    newstate->nchanged = 0;
+    newstate->changed = snewn(MAX_CHANGED, int);
+    for (i = 0; i < newstate->game_grid->num_edges; i++) {
+        if (newstate->lines[i] != state->lines[i] ||
+            newstate->line_errors[i] != state->line_errors[i]) {
+            if (newstate->nchanged == MAX_CHANGED) {
+                newstate->nchanged = -1;
+                sfree(newstate->changed);
+                newstate->changed = NULL;
+                break;
+            }
+            newstate->changed[newstate->nchanged++] = i;
+        }
+    }
+
     return newstate;
 
     fail:
@@ -3052,6 +3194,51 @@ static game_state *execute_move(const game_state *state, const char *move)
     return NULL;
 }
 
+/*
+ * Snapshot encoding for saves: the flags, then each line as in a move.
+ */
+static char *encode_state(const game_state *state)
+{
+    int i, n = state->game_grid->num_edges;
+    char *ret = snewn(n + 40, char), *p = ret;
+
+    p += sprintf(p, "%d,%d:", state->solved, state->cheated);
+    for (i = 0; i < n; i++)
+        *p++ = (state->lines[i] == LINE_YES ? 'y' :
+                state->lines[i] == LINE_NO ? 'n' : 'u');
+    *p = '\0';
+    return ret;
+}
+
+static game_state *decode_state(const game_state *initial, const char *str)
+{
+    int i, n = initial->game_grid->num_edges;
+    int solved, cheated, k;
+    game_state *ret;
+
+    if (sscanf(str, "%d,%d:%n", &solved, &cheated, &k) != 2 ||
+        strlen(str + k) != n)
+        return NULL;
+    str += k;
+
+    ret = dup_game(initial);
+    for (i = 0; i < n; i++) {
+        switch (str[i]) {
+          case 'y': ret->lines[i] = LINE_YES; break;
+          case 'n': ret->lines[i] = LINE_NO; break;
+          case 'u': ret->lines[i] = LINE_UNKNOWN; break;
+          default:
+            free_game(ret);
+            return NULL;
+        }
+    }
+
+    check_completion(ret);             /* for the line_errors */
+    ret->solved = solved;
+    ret->cheated = cheated;
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * Drawing routines.
  */
@@ -3241,8 +3428,10 @@ static void game_redraw_in_rect(drawing *dr, game_drawstate *ds,
                                 int x, int y, int w, int h)
 {
     grid *g = state->game_grid;
-    int i, phase;
+    int i, j, phase;
     int bx, by, bw, bh;
+    int gx0, gy0, gx1, gy1, margin;
+    int nfaces, nedges, ndots;
     int cur1, cur2;
     if (ds->cur_edge) {
 	cur1 = ds->cur_edge->dot1 - g->dots;
@@ -3254,7 +3443,31 @@ static void game_redraw_in_rect(drawing *dr, game_drawstate *ds,
     clip(dr, x, y, w, h);
     draw_rect(dr, x, y, w, h, COL_BACKGROUND);
 
-    for (i = 0; i < g->num_faces; i++) {
+    /*
+     * Find what might meet the rectangle from the grid's spatial index,
+     * then check each properly as before. Everything we draw lies
+     * within a quarter tile (the clue text) plus a few pixels of its
+     * face, edge or dot, so widen the rectangle by that much (and a
+     * grid unit for rounding) on its way into grid coordinates.
+     */
+    margin = ds->tilesize/4 + 8;
+    gx0 = (x - margin - BORDER(ds->tilesize)) * g->tilesize / ds->tilesize
+        + g->lowest_x - 1;
+    gy0 = (y - margin - BORDER(ds->tilesize)) * g->tilesize / ds->tilesize
+        + g->lowest_y - 1;
+    gx1 = (x + w + margin - BORDER(ds->tilesize)) * g->tilesize / ds->tilesize
+        + g->lowest_x + 1;
+    gy1 = (y + h + margin - BORDER(ds->tilesize)) * g->tilesize / ds->tilesize
+        + g->lowest_y + 1;
+    nfaces = grid_index_query(g, GRID_INDEX_FACES, gx0, gy0, gx1, gy1,
+                              ds->near_faces);
+    nedges = grid_index_query(g, GRID_INDEX_EDGES, gx0, gy0, gx1, gy1,
+                              ds->near_edges);
+    ndots = grid_index_query(g, GRID_INDEX_DOTS, gx0, gy0, gx1, gy1,
+                             ds->near_dots);
+
+    for (j = 0; j < nfaces; j++) {
+        i = ds->near_faces[j];
         if (state->clues[i] >= 0) {
             face_text_bbox(ds, g, &g->faces[i], &bx, &by, &bw, &bh);
             if (boxes_intersect(x, y, w, h, bx, by, bw, bh))
@@ -3262,13 +3475,15 @@ static void game_redraw_in_rect(drawing *dr, game_drawstate *ds,
         }
     }
     for (phase = 0; phase < NPHASES; phase++) {
-        for (i = 0; i < g->num_edges; i++) {
+        for (j = 0; j < nedges; j++) {
+            i = ds->near_edges[j];
             edge_bbox(ds, g, &g->edges[i], &bx, &by, &bw, &bh);
             if (boxes_intersect(x, y, w, h, bx, by, bw, bh))
                 game_redraw_line(dr, ds, state, i, phase);
         }
     }
-    for (i = 0; i < g->num_dots; i++) {
+    for (j = 0; j < ndots; j++) {
+        i = ds->near_dots[j];
         dot_bbox(ds, g, &g->dots[i], &bx, &by, &bw, &bh);
         if (boxes_intersect(x, y, w, h, bx, by, bw, bh))
             game_redraw_dot(dr, ds, state, i, i == cur1 || i == cur2);
@@ -3287,8 +3502,10 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 
     grid *g = state->game_grid;
     int border = BORDER(ds->tilesize);
-    int i;
+    int i, j, nlook;
     int flash_changed;
+    const int *changed;
+    int nchanged;
     int redraw_everything = FALSE;
     grid_edge *cur_edge;
     /*int cur1, cur2;*/
@@ -3343,13 +3560,58 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
          */
     }
 
+    /* Work out what the flash state needs to be. */
+    if (flashtime > 0 &&
+        (flashtime <= FLASH_TIME/3 ||
+         flashtime >= FLASH_TIME*2/3)) {
+        flash_changed = !ds->flashing;
+        ds->flashing = TRUE;
+    } else {
+        flash_changed = ds->flashing;
+        ds->flashing = FALSE;
+    }
+
+    /*
+     * On a big grid, even looking at every face and edge takes a while.
+     * If this state is a move on from the one we last drew, or the one
+     * it was made from (an undo), or the same one again, only the edges
+     * in between can have changed, along with the clues either side of
+     * them; otherwise (nchanged < 0) we must look at everything.
+     */
+    changed = NULL;
+    nchanged = -1;
+    if (ds->started && !flash_changed) {
+        if (state->id == ds->drawn_id) {
+            nchanged = 0;
+        } else if (state->prev_id && state->prev_id == ds->drawn_id) {
+            changed = state->changed;
+            nchanged = state->nchanged;
+        } else if (ds->drawn_prev_id == state->id) {
+            changed = ds->drawn_changed;
+            nchanged = ds->drawn_nchanged;
+        }
+    }
+
     /* First, trundle through the faces. */
-    for (i = 0; i < g->num_faces; i++) {
-        grid_face *f = g->faces + i;
-        int sides = f->order;
+    nlook = nchanged < 0 ? g->num_faces : 2 * nchanged;
+    for (j = 0; j < nlook; j++) {
+        grid_face *f;
+        int sides;
         int clue_mistake;
         int clue_satisfied;
-        int n = state->clues[i];
+        int n;
+        if (nchanged < 0) {
+            i = j;
+        } else {
+            grid_edge *e = g->edges + changed[j/2];
+            f = (j & 1) ? e->face2 : e->face1;
+            if (!f)
+                continue;
+            i = f - g->faces;
+        }
+        f = g->faces + i;
+        sides = f->order;
+        n = state->clues[i];
         if (n < 0)
             continue;
 
@@ -3369,20 +3631,12 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
         }
     }
 
-    /* Work out what the flash state needs to be. */
-    if (flashtime > 0 &&
-        (flashtime <= FLASH_TIME/3 ||
-         flashtime >= FLASH_TIME*2/3)) {
-        flash_changed = !ds->flashing;
-        ds->flashing = TRUE;
-    } else {
-        flash_changed = ds->flashing;
-        ds->flashing = FALSE;
-    }
-
     /* Now, trundle through the edges. */
-    for (i = 0; i < g->num_edges; i++) {
-        char new_ds =
+    nlook = nchanged < 0 ? g->num_edges : nchanged;
+    for (j = 0; j < nlook; j++) {
+        char new_ds;
+        i = nchanged < 0 ? j : changed[j];
+        new_ds =
             state->line_errors[i] ? DS_LINE_ERROR : state->lines[i];
         if (new_ds != ds->lines[i] ||
             (flash_changed && state->lines[i] == LINE_YES)) {
@@ -3394,6 +3648,13 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
         }
     }
 
+    ds->drawn_id = state->id;
+    ds->drawn_prev_id = state->prev_id;
+    ds->drawn_nchanged = state->nchanged;
+    if (state->nchanged > 0)
+        memcpy(ds->drawn_changed, state->changed,
+               state->nchanged * sizeof(int));
+
     /* Pass one is now done.  Now we do the actual drawing. */
     /*if (cur_edge) {
 	cur1 = cur_edge->dot1 - g->dots;
@@ -3612,7 +3873,9 @@ const struct game thegame = {
 #endif
     FALSE /* wants_statusbar */,
     FALSE, game_timing_state,
-    0,                                       /* mouse_priorities */
+    SOLUTION_CACHEABLE,                      /* flags */
+    16,                                      /* undo_keyframe_interval */
+    encode_state, decode_state,
 };
 
 #ifdef STANDALONE_SOLVER
@@ -269,6 +269,12 @@ struct game_common {
 
 #define POSSIBLE(f,w) (!(state->flags[(f)] & NOTFLAG(w)))
 
+/* Kept by the solver alongside the state it is working on. */
+struct solver_scratch {
+    tdq *force, *neither;       /* cells whose flags have changed */
+    int *rowset, *colset;       /* size h*3, w*3: cells set, by colour */
+};
+
 struct game_state {
     int w, h, wh;
     int *grid;                  /* size w*h, for cell state (pos/neg) */
@@ -276,6 +282,7 @@ struct game_state {
     int solved, completed, numbered;
 
     struct game_common *common; /* domino layout never changes. */
+    struct solver_scratch *scratch; /* NULL until solved; never copied. */
 };
 
 static void clear_state(game_state *ret)
@@ -339,6 +346,8 @@ static game_state *dup_game(const game_state *src)
     dest->flags = snewn(dest->wh, unsigned int);
     memcpy(dest->flags, src->flags, dest->wh*sizeof(unsigned int));
 
+    dest->scratch = NULL;
+
     return dest;
 }
 
@@ -351,6 +360,13 @@ static void free_game(game_state *state)
         sfree(state->common->colcount);
         sfree(state->common);
     }
+    if (state->scratch) {
+        tdq_free(state->scratch->force);
+        tdq_free(state->scratch->neither);
+        sfree(state->scratch->rowset);
+        sfree(state->scratch->colset);
+        sfree(state->scratch);
+    }
     sfree(state->flags);
     sfree(state->grid);
     sfree(state);
@@ -668,12 +684,17 @@ static char *game_text_format(const game_state *state)
     return ret;
 }
 
+#ifdef DEBUGGING
 static void game_debug(game_state *state, const char *desc)
 {
     char *fmt = game_text_format(state);
     debug(("%s:\n%s\n", desc, fmt));
     sfree(fmt);
 }
+#else
+/* Don't format the grid every generation attempt just to drop it. */
+#define game_debug(state, desc) ((void)0)
+#endif
 
 enum { ROW, COLUMN };
 
@@ -798,6 +819,45 @@ static void solve_clearflags(game_state *state)
     }
 }
 
+/* Called once the flags are reset, before any of the deductions
+ * below: every cell needs looking at, and the per-line counts of
+ * set cells (kept up to date by solve_set from here on) are taken
+ * afresh. */
+static void solve_begin(game_state *state)
+{
+    struct solver_scratch *sc = state->scratch;
+    int i, x, y;
+
+    if (!sc) {
+        sc = state->scratch = snew(struct solver_scratch);
+        sc->force = tdq_new(state->wh);
+        sc->neither = tdq_new(state->wh);
+        sc->rowset = snewn(state->h*3, int);
+        sc->colset = snewn(state->w*3, int);
+    }
+    tdq_fill(sc->force);
+    tdq_fill(sc->neither);
+
+    memset(sc->rowset, 0, state->h*3*sizeof(int));
+    memset(sc->colset, 0, state->w*3*sizeof(int));
+    for (y = 0; y < state->h; y++) {
+        for (x = 0; x < state->w; x++) {
+            i = y*state->w+x;
+            if (!(state->flags[i] & GS_SET)) continue;
+            assert(state->grid[i] < 3);
+            sc->rowset[y*3+state->grid[i]]++;
+            sc->colset[x*3+state->grid[i]]++;
+        }
+    }
+}
+
+/* Only cells whose flags have changed can have become forced. */
+static void solve_changed(game_state *state, int i)
+{
+    tdq_add(state->scratch->force, i);
+    tdq_add(state->scratch->neither, i);
+}
+
 /* Knowing a given cell cannot be a certain colour also tells us
  * something about the other cell in that domino. */
 static int solve_unflag(game_state *state, int i, int which,
@@ -827,12 +887,14 @@ static int solve_unflag(game_state *state, int i, int which,
     }
     if (POSSIBLE(i, which)) {
         state->flags[i] |= NOTFLAG(which);
+        solve_changed(state, i);
         ret++;
         debug(("solve_unflag: (%d,%d) CANNOT be %s (%s)",
                i%w, i/w, NAME(which), why));
     }
     if (POSSIBLE(ii, OPPOSITE(which))) {
         state->flags[ii] |= NOTFLAG(OPPOSITE(which));
+        solve_changed(state, ii);
         ret++;
         debug(("solve_unflag: (%d,%d) CANNOT be %s (%s, other half)",
                ii%w, ii/w, NAME(OPPOSITE(which)), why));
@@ -870,10 +932,7 @@ static int solve_unflag_surrounds(game_state *state, int i, int which)
 static int solve_set(game_state *state, int i, int which,
                      const char *why, rowcol *rc)
 {
-    int ii;
-#if defined DEBUGGING || defined STANDALONE_SOLVER
-    int w = state->w;
-#endif
+    int ii, w = state->w;
 
     ii = state->common->dominoes[i];
 
@@ -927,6 +986,11 @@ static int solve_set(game_state *state, int i, int which,
     state->flags[i] |= GS_SET;
     state->flags[ii] |= GS_SET;
 
+    state->scratch->rowset[(i/w)*3+which]++;
+    state->scratch->colset[(i%w)*3+which]++;
+    state->scratch->rowset[(ii/w)*3+OPPOSITE(which)]++;
+    state->scratch->colset[(ii%w)*3+OPPOSITE(which)]++;
+
     debug(("solve_set: (%d,%d) set to %s (%s)", i%w, i/w, NAME(which), why));
 
     return 1;
@@ -1031,9 +1095,10 @@ static int solve_rowcols(game_state *state, rowcolfn fn)
     rowcol rc;
     int counts[4];
 
+    counts[3] = 0;
     for (x = 0; x < state->w; x++) {
         rc = mkrowcol(state, x, COLUMN);
-        solve_counts(state, rc, counts, NULL);
+        memcpy(counts, state->scratch->colset + x*3, 3*sizeof(int));
 
         ret = fn(state, rc, counts);
         if (ret < 0) return ret;
@@ -1041,7 +1106,7 @@ static int solve_rowcols(game_state *state, rowcolfn fn)
     }
     for (y = 0; y < state->h; y++) {
         rc = mkrowcol(state, y, ROW);
-        solve_counts(state, rc, counts, NULL);
+        memcpy(counts, state->scratch->rowset + y*3, 3*sizeof(int));
 
         ret = fn(state, rc, counts);
         if (ret < 0) return ret;
@@ -1055,7 +1120,7 @@ static int solve_force(game_state *state)
     int i, which, didsth = 0;
     unsigned long f;
 
-    for (i = 0; i < state->wh; i++) {
+    while ((i = tdq_remove(state->scratch->force)) >= 0) {
         if (state->flags[i] & GS_SET) continue;
         if (state->common->dominoes[i] == i) continue;
 
@@ -1080,7 +1145,9 @@ static int solve_neither(game_state *state)
 {
     int i, j, didsth = 0;
 
-    for (i = 0; i < state->wh; i++) {
+    /* Both halves of a domino are checked together, so either
+     * changing is enough to look again. */
+    while ((i = tdq_remove(state->scratch->neither)) >= 0) {
         if (state->flags[i] & GS_SET) continue;
         j = state->common->dominoes[i];
         if (i == j) continue;
@@ -1369,6 +1436,7 @@ static int solve_state(game_state *state, int diff)
     debug(("solve_state, difficulty %s", magnets_diffnames[diff]));
 
     solve_clearflags(state);
+    solve_begin(state);
     if (solve_startflags(state) < 0) return -1;
 
     while (1) {
@@ -1506,6 +1574,7 @@ static int lay_dominoes(game_state *state, random_state *rs, int *scratch)
         state->grid[i] = EMPTY;
         state->flags[i] = (state->common->dominoes[i] == i) ? GS_SET : 0;
     }
+    solve_begin(state);
     shuffle(scratch, state->wh, sizeof(int), rs);
 
     n_initial_neutral = (state->wh > 100) ? 5 : (state->wh / 10);
@@ -1691,7 +1760,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     do {
         gen_game(new, rs);
         generate_aux(new, aux);
-    } while (check_difficulty(params, new, rs) < 0);
+    } while (check_difficulty(params, new, rs) < 0 &&
+             !random_gen_attempt(rs, -1));
 
     /* now we're complete, generate the description string
      * and an aux_info for the completed game. */
@@ -2400,7 +2470,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON,		       /* flags */
+    REQUIRE_RBUTTON | GEN_RACES,	       /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -2,10 +2,123 @@
  * malloc.c: safe wrappers around malloc, realloc, free, strdup
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <dlfcn.h>
+#include <pthread.h>
 #include "puzzles.h"
 
+/*
+ * Heap accounting, off unless heap_accounting_start() has been
+ * called; until then the only cost is a test of heap_on. Block sizes
+ * come from malloc_usable_size(), so we keep no headers of our own
+ * and count what the heap really handed out. It's looked up at run
+ * time as bionic has it only from API 17; without it there's no
+ * accounting.
+ *
+ * Each thread has a current tag (HEAP_GENERATE and so on, set by
+ * heap_tag()), and everything it allocates or frees is charged to
+ * that tag as well as to the totals. A block is charged to whichever
+ * tag frees it, so a tag's net figure is what its phase left behind
+ * (a new game's history, say), not what is still live from it.
+ */
+static int heap_on;
+static size_t (*heap_usable_size)(const void *);
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t heap_tag_key;
+static struct heap_usage heap_total, heap_tags[NHEAPTAGS];
+
+static const char *const heap_tag_names[NHEAPTAGS] = {
+    "other", "generate", "solve", "history", "drawing",
+};
+
+int heap_accounting_start(void)
+{
+    if (heap_on)
+	return TRUE;
+    heap_usable_size = (size_t (*)(const void *))
+	dlsym(RTLD_DEFAULT, "malloc_usable_size");
+    if (!heap_usable_size || pthread_key_create(&heap_tag_key, NULL))
+	return FALSE;
+    heap_on = TRUE;
+    return TRUE;
+}
+
+/* Set this thread's tag, returning the old one to put back later */
+int heap_tag(int tag)
+{
+    int old;
+
+    if (!heap_on)
+	return HEAP_OTHER;
+    old = (int)(long)pthread_getspecific(heap_tag_key);
+    pthread_setspecific(heap_tag_key, (void *)(long)tag);
+    return old;
+}
+
+/* size is negative for a free */
+static void heap_count(long long size)
+{
+    struct heap_usage *t =
+	&heap_tags[(int)(long)pthread_getspecific(heap_tag_key)];
+
+    pthread_mutex_lock(&heap_lock);
+    if (size > 0) {
+	heap_total.allocs++;
+	heap_total.allocated += size;
+	t->allocs++;
+	t->allocated += size;
+    }
+    heap_total.live += size;
+    t->live += size;
+    if (heap_total.live > heap_total.peak)
+	heap_total.peak = heap_total.live;
+    if (heap_total.live > t->peak)
+	t->peak = heap_total.live;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+/*
+ * The totals and each tag's figures (tags may be NULL); FALSE, with
+ * nothing filled in, if we aren't accounting.
+ */
+int heap_get_usage(struct heap_usage *total, struct heap_usage *tags)
+{
+    if (!heap_on)
+	return FALSE;
+    pthread_mutex_lock(&heap_lock);
+    *total = heap_total;
+    if (tags)
+	memcpy(tags, heap_tags, sizeof(heap_tags));
+    pthread_mutex_unlock(&heap_lock);
+    return TRUE;
+}
+
+/*
+ * A plain-text summary for midend_get_stats(): "heap live peak
+ * allocs allocated", then per tag "heap_<tag> allocs allocated net
+ * peak", all in bytes. NULL if we aren't accounting. The caller frees
+ * it.
+ */
+char *heap_get_stats(void)
+{
+    struct heap_usage total, tags[NHEAPTAGS];
+    char *ret, *p;
+    int i;
+
+    if (!heap_get_usage(&total, tags))
+	return NULL;
+    ret = p = snewn((NHEAPTAGS + 1) * 100, char);
+    p += sprintf(p, "heap %lld %lld %lu %lld\n", total.live, total.peak,
+		 total.allocs, total.allocated);
+    for (i = 0; i < NHEAPTAGS; i++)
+	p += sprintf(p, "heap_%s %lu %lld %lld %lld\n", heap_tag_names[i],
+		     tags[i].allocs, tags[i].allocated, tags[i].live,
+		     tags[i].peak);
+    return ret;
+}
+
 /*
  * smalloc should guarantee to return a useful pointer - Halibut
  * can do nothing except die when it's out of memory anyway.
@@ -15,6 +128,8 @@ void *smalloc(size_t size) {
     p = malloc(size);
     if (!p)
 	fatal("out of memory");
+    if (heap_on)
+	heap_count(heap_usable_size(p));
     return p;
 }
 
@@ -23,6 +138,8 @@ void *smalloc(size_t size) {
  */
 void sfree(void *p) {
     if (p) {
+	if (heap_on)
+	    heap_count(-(long long)heap_usable_size(p));
 	free(p);
     }
 }
@@ -33,12 +150,16 @@ void sfree(void *p) {
 void *srealloc(void *p, size_t size) {
     void *q;
     if (p) {
+	if (heap_on)
+	    heap_count(-(long long)heap_usable_size(p));
 	q = realloc(p, size);
     } else {
 	q = malloc(size);
     }
     if (!q)
 	fatal("out of memory");
+    if (heap_on)
+	heap_count(heap_usable_size(q));
     return q;
 }
 
@@ -51,3 +172,90 @@ char *dupstr(const char *s) {
     strcpy(r,s);
     return r;
 }
+
+/*
+ * Arenas: a list of chunks, newest first, each carved up from the
+ * front. Chunks double in size as the arena grows, and arena_reset
+ * keeps only the newest (hence biggest) one, so an arena reused for
+ * attempt after attempt soon stops calling malloc at all.
+ */
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_CHUNK (1024 * 1024)
+
+/* Everything arena_alloc returns is aligned for any of these */
+union arena_align {
+    long l;
+    double d;
+    void *p;
+};
+#define ARENA_ALIGN(n) \
+    (((n) + sizeof(union arena_align) - 1) & ~(sizeof(union arena_align) - 1))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size, used;
+};
+#define ARENA_HEADER ARENA_ALIGN(sizeof(struct arena_chunk))
+
+struct arena {
+    struct arena_chunk *chunks;
+    size_t chunksize;		       /* for the next new chunk */
+};
+
+arena *arena_new(void)
+{
+    arena *a = snew(arena);
+    a->chunks = NULL;
+    a->chunksize = ARENA_MIN_CHUNK;
+    return a;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+    struct arena_chunk *c = a->chunks;
+    void *ret;
+
+    size = ARENA_ALIGN(size);
+    if (!c || c->size - c->used < size) {
+	size_t csize = a->chunksize;
+	while (csize < size)
+	    csize *= 2;
+	c = smalloc(ARENA_HEADER + csize);
+	c->size = csize;
+	c->used = 0;
+	c->next = a->chunks;
+	a->chunks = c;
+	if (a->chunksize < ARENA_MAX_CHUNK)
+	    a->chunksize *= 2;
+    }
+    ret = (char *)c + ARENA_HEADER + c->used;
+    c->used += size;
+    return ret;
+}
+
+/* Forget everything allocated so far, keeping the newest chunk */
+void arena_reset(arena *a)
+{
+    struct arena_chunk *c = a->chunks, *next;
+
+    if (!c)
+	return;
+    for (next = c->next; next; next = c->next) {
+	c->next = next->next;
+	sfree(next);
+    }
+    c->used = 0;
+}
+
+void arena_free(arena *a)
+{
+    struct arena_chunk *c, *next;
+
+    if (!a)
+	return;
+    for (c = a->chunks; c; c = next) {
+	next = c->next;
+	sfree(c);
+    }
+    sfree(a);
+}
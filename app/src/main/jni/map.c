@@ -14,6 +14,7 @@
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <math.h>
 
 #include "puzzles.h"
@@ -660,24 +661,61 @@ static int graph_edge_index(int *graph, int n, int ngraph, int i, int j)
     return -1;
 }
 
-#define graph_adjacent(graph, n, ngraph, i, j) \
-    (graph_edge_index((graph), (n), (ngraph), (i), (j)) >= 0)
+/*
+ * The edge list is compact, but both finding a vertex's neighbours
+ * and testing two vertices for adjacency in it take a binary
+ * search, and the colourer and the solver do both in their inner
+ * loops. So they work from this instead, built once per map: the
+ * neighbours of vertex i are adj[start[i]] up to adj[start[i+1]-1]
+ * in the same order as the edge list, and bit j of row i of the
+ * matrix is set if i and j are adjacent.
+ */
+struct adjacency {
+    int n;
+    int *start, *adj;
+    unsigned long *matrix;
+    int rowwords;
+};
 
-static int graph_vertex_start(int *graph, int n, int ngraph, int i)
-{
-    int v = i*n;
-    int top, bot, mid;
+#define ADJ_WORD_BITS ((int)(sizeof(unsigned long) * CHAR_BIT))
 
-    bot = -1;
-    top = ngraph;
-    while (top - bot > 1) {
-	mid = (top + bot) / 2;
-	if (graph[mid] < v)
-	    bot = mid;
-	else
-	    top = mid;
+#define adjacent(a, i, j) \
+    (((a)->matrix[(i)*(a)->rowwords + (j)/ADJ_WORD_BITS] >> \
+      ((j) % ADJ_WORD_BITS)) & 1)
+
+static struct adjacency *new_adjacency(int *graph, int n, int ngraph)
+{
+    struct adjacency *a = snew(struct adjacency);
+    int i, j;
+
+    a->n = n;
+    a->start = snewn(n+1, int);
+    a->adj = snewn(max(ngraph, 1), int);
+    a->rowwords = (n + ADJ_WORD_BITS - 1) / ADJ_WORD_BITS;
+    a->matrix = snewn(max(n * a->rowwords, 1), unsigned long);
+    memset(a->matrix, 0, n * a->rowwords * sizeof(unsigned long));
+
+    for (i = j = 0; i < n; i++) {
+	a->start[i] = j;
+	for (; j < ngraph && graph[j] < n*(i+1); j++) {
+	    int k = graph[j] - i*n;
+	    a->adj[j] = k;
+	    a->matrix[i*a->rowwords + k/ADJ_WORD_BITS] |=
+		1UL << (k % ADJ_WORD_BITS);
+	}
     }
-    return top;
+    a->start[n] = j;
+    assert(j == ngraph);
+
+    return a;
+}
+
+static void free_adjacency(struct adjacency *a)
+{
+    sfree(a->start);
+    sfree(a->adj);
+    sfree(a->matrix);
+    sfree(a);
 }
 
 /* ----------------------------------------------------------------------
@@ -688,12 +726,16 @@ static int graph_vertex_start(int *graph, int n, int ngraph, int i)
  * the sake of the Palm port and its limited stack.
  */
 
-static int fourcolour_recurse(int *graph, int n, int ngraph,
-			      int *colouring, int *scratch, random_state *rs)
+static int fourcolour_recurse(const struct adjacency *a, int *colouring,
+                              int *scratch, int *budget, random_state *rs)
 {
-    int nfree, nvert, start, i, j, k, c, ci;
+    int n = a->n;
+    int nfree, nvert, i, j, k, c, ci;
     int cs[FOUR];
 
+    if ((*budget)-- <= 0)
+	return FALSE;		       /* give up; see fourcolour() */
+
     /*
      * Find the smallest number of free colours in any uncoloured
      * vertex, and count the number of such vertices.
@@ -725,7 +767,6 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	    if (j-- == 0)
 		break;
     assert(i < n);
-    start = graph_vertex_start(graph, n, ngraph, i);
 
     /*
      * Loop over the possible colours for i, and recurse for each
@@ -749,8 +790,8 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	 * Update the scratch space to reflect a new neighbour
 	 * of this colour for each neighbour of vertex i.
 	 */
-	for (j = start; j < ngraph && graph[j] < n*(i+1); j++) {
-	    k = graph[j] - i*n;
+	for (j = a->start[i]; j < a->start[i+1]; j++) {
+	    k = a->adj[j];
 	    if (scratch[k*FIVE+c] == 0)
 		scratch[k*FIVE+FOUR]--;
 	    scratch[k*FIVE+c]++;
@@ -759,15 +800,15 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
 	/*
 	 * Recurse.
 	 */
-	if (fourcolour_recurse(graph, n, ngraph, colouring, scratch, rs))
+	if (fourcolour_recurse(a, colouring, scratch, budget, rs))
 	    return TRUE;	       /* got one! */
 
 	/*
 	 * If that didn't work, clean up and try again with a
 	 * different colour.
 	 */
-	for (j = start; j < ngraph && graph[j] < n*(i+1); j++) {
-	    k = graph[j] - i*n;
+	for (j = a->start[i]; j < a->start[i+1]; j++) {
+	    k = a->adj[j];
 	    scratch[k*FIVE+c]--;
 	    if (scratch[k*FIVE+c] == 0)
 		scratch[k*FIVE+FOUR]++;
@@ -786,11 +827,12 @@ static int fourcolour_recurse(int *graph, int n, int ngraph,
     return FALSE;
 }
 
-static void fourcolour(int *graph, int n, int ngraph, int *colouring,
-		       random_state *rs)
+static void fourcolour(const struct adjacency *a, int *colouring,
+                       random_state *rs)
 {
+    int n = a->n;
     int *scratch;
-    int i;
+    int i, limit, budget;
 
     /*
      * For each vertex and each colour, we store the number of
@@ -807,8 +849,24 @@ static void fourcolour(int *graph, int n, int ngraph, int *colouring,
     for (i = 0; i < n; i++)
 	colouring[i] = -1;
 
-    i = fourcolour_recurse(graph, n, ngraph, colouring, scratch, rs);
-    assert(i);			       /* by the Four Colour Theorem :-) */
+    /*
+     * Almost every map colours with next to no backtracking, but
+     * now and then an early choice leads into a dead end which
+     * takes an astronomical time to back out of. So we give each
+     * attempt a budget of recursive calls, and if it runs out we
+     * start again (with the random state moved on, so we choose
+     * differently), doubling the budget each time so that we must
+     * eventually finish anyway. On failure fourcolour_recurse has
+     * put colouring and scratch back as it found them.
+     */
+    limit = 20 * n + 100;
+    while (1) {
+	budget = limit;
+	if (fourcolour_recurse(a, colouring, scratch, &budget, rs))
+	    break;
+	assert(budget < 0);	       /* by the Four Colour Theorem :-) */
+	limit *= 2;
+    }
 
     sfree(scratch);
 }
@@ -820,12 +878,14 @@ static void fourcolour(int *graph, int n, int ngraph, int *colouring,
 struct solver_scratch {
     unsigned char *possible;	       /* bitmap of colours for each region */
 
-    int *graph;
+    /* Shared by every level of recursion; the top level owns it. */
+    struct adjacency *adj;
     int n;
-    int ngraph;
 
     int *bfsqueue;
     int *bfscolour;
+    /* bfscolour[j] is only meaningful if bfsvisit[j] == bfsgen. */
+    int *bfsvisit, bfsgen;
 #ifdef SOLVER_DIAGNOSTICS
     int *bfsprev;
 #endif
@@ -833,18 +893,22 @@ struct solver_scratch {
     int depth;
 };
 
-static struct solver_scratch *new_scratch(int *graph, int n, int ngraph)
+static struct solver_scratch *alloc_scratch(struct adjacency *adj, int depth)
 {
     struct solver_scratch *sc;
+    int n = adj->n, i;
 
     sc = snew(struct solver_scratch);
-    sc->graph = graph;
+    sc->adj = adj;
     sc->n = n;
-    sc->ngraph = ngraph;
     sc->possible = snewn(n, unsigned char);
-    sc->depth = 0;
+    sc->depth = depth;
     sc->bfsqueue = snewn(n, int);
     sc->bfscolour = snewn(n, int);
+    sc->bfsvisit = snewn(n, int);
+    for (i = 0; i < n; i++)
+        sc->bfsvisit[i] = 0;
+    sc->bfsgen = 0;
 #ifdef SOLVER_DIAGNOSTICS
     sc->bfsprev = snewn(n, int);
 #endif
@@ -852,11 +916,19 @@ static struct solver_scratch *new_scratch(int *graph, int n, int ngraph)
     return sc;
 }
 
+static struct solver_scratch *new_scratch(int *graph, int n, int ngraph)
+{
+    return alloc_scratch(new_adjacency(graph, n, ngraph), 0);
+}
+
 static void free_scratch(struct solver_scratch *sc)
 {
+    if (sc->depth == 0)
+        free_adjacency(sc->adj);
     sfree(sc->possible);
     sfree(sc->bfsqueue);
     sfree(sc->bfscolour);
+    sfree(sc->bfsvisit);
 #ifdef SOLVER_DIAGNOSTICS
     sfree(sc->bfsprev);
 #endif
@@ -885,7 +957,7 @@ static int place_colour(struct solver_scratch *sc,
 #endif
                         )
 {
-    int *graph = sc->graph, n = sc->n, ngraph = sc->ngraph;
+    const struct adjacency *a = sc->adj;
     int j, k;
 
     if (!(sc->possible[index] & (1 << colour))) {
@@ -909,9 +981,8 @@ static int place_colour(struct solver_scratch *sc,
     /*
      * Rule out this colour from all the region's neighbours.
      */
-    for (j = graph_vertex_start(graph, n, ngraph, index);
-	 j < ngraph && graph[j] < n*(index+1); j++) {
-	k = graph[j] - index*n;
+    for (j = a->start[index]; j < a->start[index+1]; j++) {
+	k = a->adj[j];
 #ifdef SOLVER_DIAGNOSTICS
         if (verbose && (sc->possible[k] & (1 << colour)))
             printf("%*s  ruling out %c in region %d\n", 2*sc->depth, "",
@@ -949,6 +1020,7 @@ static int map_solver(struct solver_scratch *sc,
 		      int *graph, int n, int ngraph, int *colouring,
                       int difficulty)
 {
+    const struct adjacency *a = sc->adj;
     int i;
 
     if (sc->depth == 0) {
@@ -1080,10 +1152,9 @@ static int map_solver(struct solver_scratch *sc,
              * Go through the neighbours of j1 and see if any are
              * shared with j2.
              */
-            for (j = graph_vertex_start(graph, n, ngraph, j1);
-                 j < ngraph && graph[j] < n*(j1+1); j++) {
-                k = graph[j] - j1*n;
-                if (graph_adjacent(graph, n, ngraph, k, j2) &&
+            for (j = a->start[j1]; j < a->start[j1+1]; j++) {
+                k = a->adj[j];
+                if (adjacent(a, k, j2) &&
                     (sc->possible[k] & v)) {
 #ifdef SOLVER_DIAGNOSTICS
                     if (verbose) {
@@ -1168,15 +1239,23 @@ static int map_solver(struct solver_scratch *sc,
 
                     origc = 1 << c;
 
-                    for (j = 0; j < n; j++) {
-                        sc->bfscolour[j] = -1;
-#ifdef SOLVER_DIAGNOSTICS
-                        sc->bfsprev[j] = -1;
-#endif
+                    /*
+                     * Rather than clearing bfscolour for every
+                     * region each time, bump the generation
+                     * number so that last time's marks lapse.
+                     */
+                    if (++sc->bfsgen == INT_MAX) {
+                        for (j = 0; j < n; j++)
+                            sc->bfsvisit[j] = 0;
+                        sc->bfsgen = 1;
                     }
                     head = tail = 0;
                     sc->bfsqueue[tail++] = i;
+                    sc->bfsvisit[i] = sc->bfsgen;
                     sc->bfscolour[i] = sc->possible[i] &~ origc;
+#ifdef SOLVER_DIAGNOSTICS
+                    sc->bfsprev[i] = -1;
+#endif
 
                     while (head < tail) {
                         j = sc->bfsqueue[head++];
@@ -1185,9 +1264,8 @@ static int map_solver(struct solver_scratch *sc,
                         /*
                          * Try neighbours of j.
                          */
-                        for (gi = graph_vertex_start(graph, n, ngraph, j);
-                             gi < ngraph && graph[gi] < n*(j+1); gi++) {
-                            k = graph[gi] - j*n;
+                        for (gi = a->start[j]; gi < a->start[j+1]; gi++) {
+                            k = a->adj[gi];
 
                             /*
                              * To continue with the bfs in vertex
@@ -1197,11 +1275,12 @@ static int map_solver(struct solver_scratch *sc,
                              *  (c) those colours include currc.
                              */
 
-                            if (sc->bfscolour[k] < 0 &&
+                            if (sc->bfsvisit[k] != sc->bfsgen &&
                                 colouring[k] < 0 &&
                                 bitcount(sc->possible[k]) == 2 &&
                                 (sc->possible[k] & currc)) {
                                 sc->bfsqueue[tail++] = k;
+                                sc->bfsvisit[k] = sc->bfsgen;
                                 sc->bfscolour[k] =
                                     sc->possible[k] &~ currc;
 #ifdef SOLVER_DIAGNOSTICS
@@ -1218,7 +1297,7 @@ static int map_solver(struct solver_scratch *sc,
                              * the original colour we ruled out.
                              */
                             if (currc == origc &&
-                                graph_adjacent(graph, n, ngraph, k, i) &&
+                                adjacent(a, k, i) &&
                                 (sc->possible[k] & currc)) {
 #ifdef SOLVER_DIAGNOSTICS
                                 if (verbose) {
@@ -1279,10 +1358,12 @@ static int map_solver(struct solver_scratch *sc,
 
     /*
      * Now we've got to do something recursive. So first hunt for a
-     * currently-most-constrained region.
+     * currently-most-constrained region, breaking ties in favour of
+     * the region with most neighbours, since each guess there rules
+     * out the most elsewhere.
      */
     {
-        int best, bestc;
+        int best, bestc, bestdeg;
         struct solver_scratch *rsc;
         int *subcolouring, *origcolouring;
         int ret, subret;
@@ -1290,6 +1371,7 @@ static int map_solver(struct solver_scratch *sc,
 
         best = -1;
         bestc = FIVE;
+        bestdeg = -1;
 
         for (i = 0; i < n; i++) if (colouring[i] < 0) {
             int p = sc->possible[i];
@@ -1301,9 +1383,11 @@ static int map_solver(struct solver_scratch *sc,
             c = (c & 3) + ((c >> 2) & 3);
             assert(c > 1);             /* or colouring[i] would be >= 0 */
 
-            if (c < bestc) {
+            if (c < bestc ||
+                (c == bestc && a->start[i+1] - a->start[i] > bestdeg)) {
                 best = i;
                 bestc = c;
+                bestdeg = a->start[i+1] - a->start[i];
             }
         }
 
@@ -1317,8 +1401,7 @@ static int map_solver(struct solver_scratch *sc,
         /*
          * Now iterate over the possible colours for this region.
          */
-        rsc = new_scratch(graph, n, ngraph);
-        rsc->depth = sc->depth + 1;
+        rsc = alloc_scratch(sc->adj, sc->depth + 1);
         origcolouring = snewn(n, int);
         memcpy(origcolouring, colouring, n * sizeof(int));
         subcolouring = snewn(n, int);
@@ -1464,6 +1547,9 @@ static char *new_game_desc(const game_params *params, random_state *rs,
          */
         ngraph = gengraph(w, h, n, map, graph);
 
+        if (sc) free_scratch(sc);
+        sc = new_scratch(graph, n, ngraph);
+
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < ngraph; i++)
             printf("%d-%d\n", graph[i]/n, graph[i]%n);
@@ -1472,7 +1558,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
         /*
          * Colour the map.
          */
-        fourcolour(graph, n, ngraph, colouring, rs);
+        fourcolour(sc->adj, colouring, rs);
 
 #ifdef GENERATION_DIAGNOSTICS
         for (i = 0; i < n; i++)
@@ -1533,9 +1619,6 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 
         shuffle(regions, n, sizeof(*regions), rs);
 
-        if (sc) free_scratch(sc);
-        sc = new_scratch(graph, n, ngraph);
-
         for (i = 0; i < n; i++) {
             j = regions[i];
 
@@ -3294,7 +3377,7 @@ const struct game thegame = {
 
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    SOLUTION_CACHEABLE,		       /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
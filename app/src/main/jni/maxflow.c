@@ -18,21 +18,17 @@
 
 #include "puzzles.h"		       /* for snewn/sfree */
 
-int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
-			 int ne, const int *edges, const int *backedges,
-			 const int *capacity, int *flow, int *cut)
+/*
+ * Scan the edges array to find the index of the first edge from each
+ * node, and the backedges array to find the index of the first edge
+ * _to_ each node.
+ */
+static void maxflow_index(int nv, int ne, const int *edges,
+			  const int *backedges, int *firstedge,
+			  int *firstbackedge)
 {
-    int *todo = (int *)scratch;
-    int *prev = todo + nv;
-    int *firstedge = todo + 2*nv;
-    int *firstbackedge = todo + 3*nv;
-    int i, j, head, tail, from, to;
-    int totalflow;
+    int i, j;
 
-    /*
-     * Scan the edges array to find the index of the first edge
-     * from each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*i])
@@ -41,10 +37,6 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 	firstedge[j++] = ne;
     assert(j == nv);
 
-    /*
-     * Scan the backedges array to find the index of the first edge
-     * _to_ each node.
-     */
     j = 0;
     for (i = 0; i < ne; i++)
 	while (j <= edges[2*backedges[i]+1])
@@ -52,17 +44,24 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     while (j < nv)
 	firstbackedge[j++] = ne;
     assert(j == nv);
+}
 
-    /*
-     * Start the flow off at zero on every edge.
-     */
-    for (i = 0; i < ne; i++)
-	flow[i] = 0;
-    totalflow = 0;
+/*
+ * Repeatedly look for an augmenting path, and follow it, starting
+ * from whatever valid flow is currently in `flow'. Returns the
+ * total flow once there are no more augmenting paths.
+ */
+static int maxflow_augment(void *scratch, int nv, int source, int sink,
+			   int ne, const int *edges, const int *backedges,
+			   const int *capacity, int *flow, int *cut,
+			   int totalflow)
+{
+    int *todo = (int *)scratch;
+    int *prev = todo + nv;
+    int *firstedge = todo + 2*nv;
+    int *firstbackedge = todo + 3*nv;
+    int i, j, head, tail, from, to;
 
-    /*
-     * Repeatedly look for an augmenting path, and follow it.
-     */
     while (1) {
 
 	/*
@@ -120,7 +119,6 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
 		todo[tail++] = to;
 	    }
 	}
-
 	/*
 	 * If prev[sink] is non-null, we have found an augmenting
 	 * path.
@@ -218,11 +216,347 @@ int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
     }
 }
 
+int maxflow_with_scratch(void *scratch, int nv, int source, int sink,
+			 int ne, const int *edges, const int *backedges,
+			 const int *capacity, int *flow, int *cut)
+{
+    int *todo = (int *)scratch;
+    int i;
+
+    maxflow_index(nv, ne, edges, backedges, todo + 2*nv, todo + 3*nv);
+
+    /*
+     * Start the flow off at zero on every edge.
+     */
+    for (i = 0; i < ne; i++)
+	flow[i] = 0;
+
+    return maxflow_augment(scratch, nv, source, sink, ne, edges, backedges,
+			   capacity, flow, cut, 0);
+}
+
+/*
+ * Find a path from `start' to `end' made entirely of edges carrying
+ * flow (followed forwards if `forwards' is set, otherwise from the
+ * head of each edge back to its tail), and take away as much as
+ * possible of `amount' from the flow along it. Returns the amount
+ * removed, or 0 if there's no such path.
+ */
+static int maxflow_cancel_path(void *scratch, int nv, int start, int end,
+			       int forwards, int ne, const int *edges,
+			       const int *backedges, int *flow, int amount)
+{
+    int *todo = (int *)scratch;
+    int *prev = todo + nv;
+    int *firstedge = todo + 2*nv;
+    int *firstbackedge = todo + 3*nv;
+    int i, j, head, tail, from, to;
+
+    if (start == end)
+	return amount;
+
+    for (i = 0; i < nv; i++)
+	prev[i] = -1;
+    head = tail = 0;
+    todo[tail++] = start;
+
+    while (head < tail && prev[end] < 0) {
+	from = todo[head++];
+	if (forwards) {
+	    for (i = firstedge[from]; i < ne && edges[2*i] == from; i++) {
+		to = edges[2*i+1];
+		if (to != start && prev[to] < 0 && flow[i] > 0) {
+		    prev[to] = i;
+		    todo[tail++] = to;
+		}
+	    }
+	} else {
+	    for (i = firstbackedge[from];
+		 j = backedges[i], i < ne && edges[2*j+1]==from; i++) {
+		to = edges[2*j];
+		if (to != start && prev[to] < 0 && flow[j] > 0) {
+		    prev[to] = j;
+		    todo[tail++] = to;
+		}
+	    }
+	}
+    }
+
+    if (prev[end] < 0)
+	return 0;
+
+    for (to = end; to != start; to = edges[2*prev[to] + (forwards ? 0 : 1)])
+	if (flow[prev[to]] < amount)
+	    amount = flow[prev[to]];
+    for (to = end; to != start; to = edges[2*prev[to] + (forwards ? 0 : 1)])
+	flow[prev[to]] -= amount;
+
+    return amount;
+}
+
+int maxflow_reoptimise(void *scratch, int nv, int source, int sink,
+		       int ne, const int *edges, const int *backedges,
+		       const int *capacity, int *flow, int *cut)
+{
+    int *todo = (int *)scratch;
+    int i, totalflow;
+
+    maxflow_index(nv, ne, edges, backedges, todo + 2*nv, todo + 3*nv);
+
+    totalflow = 0;
+    for (i = 0; i < ne; i++) {
+	if (edges[2*i] == source)
+	    totalflow += flow[i];
+	if (edges[2*i+1] == source)
+	    totalflow -= flow[i];
+    }
+
+    /*
+     * Bring every edge whose capacity has dropped below its flow back
+     * within its capacity. The flow we take off an edge u->v was
+     * either going round a cycle, in which case we can take it off
+     * the rest of the cycle from v back to u and lose nothing, or
+     * else it came from the source to u and went on from v to the
+     * sink, in which case we must take it off both those stretches
+     * and the total flow drops.
+     */
+    for (i = 0; i < ne; i++) {
+	int u = edges[2*i], v = edges[2*i+1];
+	int excess, left, got;
+
+	if (capacity[i] < 0 || flow[i] <= capacity[i])
+	    continue;
+
+	excess = flow[i] - capacity[i];
+	flow[i] = capacity[i];
+
+	while (excess > 0 &&
+	       (got = maxflow_cancel_path(scratch, nv, v, u, TRUE, ne, edges,
+					  backedges, flow, excess)) > 0)
+	    excess -= got;
+
+	for (left = excess; left > 0; left -= got) {
+	    got = maxflow_cancel_path(scratch, nv, u, source, FALSE, ne,
+				      edges, backedges, flow, left);
+	    assert(got > 0);
+	}
+	for (left = excess; left > 0; left -= got) {
+	    got = maxflow_cancel_path(scratch, nv, v, sink, TRUE, ne,
+				      edges, backedges, flow, left);
+	    assert(got > 0);
+	}
+	totalflow -= excess;
+    }
+
+    return maxflow_augment(scratch, nv, source, sink, ne, edges, backedges,
+			   capacity, flow, cut, totalflow);
+}
+
 int maxflow_scratch_size(int nv)
 {
     return (nv * 4) * sizeof(int);
 }
 
+/*
+ * Push-relabel (FIFO variant, starting from exact distance labels).
+ * Rather than finding whole paths from source to sink, this floods
+ * as much as possible out of the source at once and then pushes each
+ * node's excess on towards nodes nearer the sink, raising a node's
+ * height whenever it can't get rid of any more. That saves a BFS
+ * over the whole graph per unit of flow, which on dense graphs is
+ * most of the cost of the method above.
+ */
+int maxflow_pr_scratch_size(int nv)
+{
+    return (nv * 8) * sizeof(int);
+}
+
+int maxflow_pr_with_scratch(void *scratch, int nv, int source, int sink,
+			    int ne, const int *edges, const int *backedges,
+			    const int *capacity, int *flow, int *cut)
+{
+    int *firstedge = (int *)scratch;
+    int *firstbackedge = firstedge + nv;
+    int *nout = firstedge + 2*nv;      /* edges out of each node */
+    int *nin = firstedge + 3*nv;       /* edges into each node */
+    int *excess = firstedge + 4*nv;
+    int *height = firstedge + 5*nv;
+    int *cur = firstedge + 6*nv;       /* next arc to try pushing along */
+    int *queue = firstedge + 7*nv;     /* FIFO of active nodes */
+    int i, j, v, w, head, tail, nqueued, unlimited;
+
+    maxflow_index(nv, ne, edges, backedges, firstedge, firstbackedge);
+    for (v = 0; v < nv; v++) {
+	for (i = firstedge[v]; i < ne && edges[2*i] == v; i++);
+	nout[v] = i - firstedge[v];
+	for (i = firstbackedge[v]; i < ne && edges[2*backedges[i]+1] == v;
+	     i++);
+	nin[v] = i - firstbackedge[v];
+    }
+
+    /*
+     * Unlimited edges can't be pushed along infinitely. But there's
+     * no unlimited path from source to sink, so the flow can't exceed
+     * the total of all the limited capacities, and giving unlimited
+     * edges one more than that changes nothing.
+     */
+    unlimited = 1;
+    for (i = 0; i < ne; i++)
+	if (capacity[i] >= 0)
+	    unlimited += capacity[i];
+#define CAP(i) (capacity[i] >= 0 ? capacity[i] : unlimited)
+
+    /*
+     * Label every node with its distance from the sink (or nv if it
+     * has none), by a BFS backwards from the sink. At this point
+     * there's no flow, so only forward edges count.
+     */
+    for (v = 0; v < nv; v++) {
+	height[v] = nv;
+	excess[v] = 0;
+	cur[v] = 0;
+    }
+    for (i = 0; i < ne; i++)
+	flow[i] = 0;
+    height[sink] = 0;
+    head = tail = 0;
+    queue[tail++] = sink;
+    while (head < tail) {
+	v = queue[head++];
+	for (i = 0; i < nin[v]; i++) {
+	    j = backedges[firstbackedge[v] + i];
+	    w = edges[2*j];
+	    if (height[w] == nv && w != sink && CAP(j) > 0) {
+		height[w] = height[v] + 1;
+		queue[tail++] = w;
+	    }
+	}
+    }
+    height[source] = nv;
+
+    /*
+     * Saturate every edge out of the source, and queue up the nodes
+     * that leaves with excess.
+     */
+    head = tail = nqueued = 0;
+    for (i = firstedge[source]; i < ne && edges[2*i] == source; i++) {
+	w = edges[2*i+1];
+	if (w == source)
+	    continue;
+	flow[i] = CAP(i);
+	excess[w] += flow[i];
+	excess[source] -= flow[i];
+	if (flow[i] > 0 && w != sink && excess[w] == flow[i]) {
+	    queue[tail] = w;
+	    tail = (tail + 1) % nv;
+	    nqueued++;
+	}
+    }
+
+    /*
+     * Discharge active nodes until there are none left. Heights may
+     * rise above nv, which is how excess that can't reach the sink
+     * finds its way back to the source.
+     */
+    while (nqueued > 0) {
+	v = queue[head];
+	head = (head + 1) % nv;
+	nqueued--;
+
+	while (excess[v] > 0) {
+	    int arc, resid, amount;
+
+	    if (cur[v] == nout[v] + nin[v]) {
+		/*
+		 * Relabel: nothing more can go anywhere downhill, so
+		 * raise v to one above its lowest residual neighbour.
+		 */
+		int newheight = -1;
+		for (arc = 0; arc < nout[v] + nin[v]; arc++) {
+		    if (arc < nout[v]) {
+			i = firstedge[v] + arc;
+			w = edges[2*i+1];
+			resid = CAP(i) - flow[i];
+		    } else {
+			i = backedges[firstbackedge[v] + arc - nout[v]];
+			w = edges[2*i];
+			resid = flow[i];
+		    }
+		    if (resid > 0 && (newheight < 0 || height[w] < newheight))
+			newheight = height[w];
+		}
+		assert(newheight >= 0);
+		height[v] = newheight + 1;
+		cur[v] = 0;
+		continue;
+	    }
+
+	    arc = cur[v];
+	    if (arc < nout[v]) {
+		i = firstedge[v] + arc;
+		w = edges[2*i+1];
+		resid = CAP(i) - flow[i];
+	    } else {
+		i = backedges[firstbackedge[v] + arc - nout[v]];
+		w = edges[2*i];
+		resid = flow[i];
+	    }
+	    if (resid <= 0 || height[v] != height[w] + 1) {
+		cur[v]++;
+		continue;
+	    }
+
+	    amount = (excess[v] < resid ? excess[v] : resid);
+	    if (arc < nout[v])
+		flow[i] += amount;
+	    else
+		flow[i] -= amount;
+	    excess[v] -= amount;
+	    if (excess[w] == 0 && w != source && w != sink) {
+		queue[tail] = w;
+		tail = (tail + 1) % nv;
+		nqueued++;
+	    }
+	    excess[w] += amount;
+	}
+    }
+
+#undef CAP
+
+    /*
+     * Output the cut, if required: the nodes still reachable from the
+     * source in the residual graph are on the source side.
+     */
+    if (cut) {
+	for (v = 0; v < nv; v++)
+	    cut[v] = 1;
+	cut[source] = 0;
+	head = tail = 0;
+	queue[tail++] = source;
+	while (head < tail) {
+	    v = queue[head++];
+	    for (i = firstedge[v]; i < ne && edges[2*i] == v; i++) {
+		w = edges[2*i+1];
+		if (cut[w] && (capacity[i] < 0 || flow[i] < capacity[i])) {
+		    cut[w] = 0;
+		    queue[tail++] = w;
+		}
+	    }
+	    for (j = firstbackedge[v];
+		 j < ne && edges[2*backedges[j]+1] == v; j++) {
+		i = backedges[j];
+		w = edges[2*i];
+		if (cut[w] && flow[i] > 0) {
+		    cut[w] = 0;
+		    queue[tail++] = w;
+		}
+	    }
+	}
+    }
+
+    return excess[sink];
+}
+
 void maxflow_setup_backedges(int ne, const int *edges, int *backedges)
 {
     int i, n;
@@ -385,6 +719,8 @@ int maxflow(int nv, int source, int sink,
 
 #ifdef TESTMODE
 
+#include <string.h>
+
 #define MAXEDGES 256
 #define MAXVERTICES 128
 #define ADDEDGE(i,j) do{edges[ne*2] = (i); edges[ne*2+1] = (j); ne++;}while(0)
@@ -455,6 +791,66 @@ int main(void)
 	if (cut[i] == 0)
 	    printf("difficult set includes %d\n", i);
 
+    /*
+     * Now cross-check the three algorithms against each other on
+     * some random networks, changing the capacities each time to
+     * exercise maxflow_reoptimise.
+     */
+    {
+	int backedges[MAXEDGES], flow2[MAXEDGES], flow3[MAXEDGES];
+	int cut2[MAXVERTICES], cut3[MAXVERTICES];
+	void *scratch, *prscratch;
+	int iter, round, ret2, ret3, nfail = 0;
+
+	scratch = malloc(maxflow_scratch_size(MAXVERTICES));
+	prscratch = malloc(maxflow_pr_scratch_size(MAXVERTICES));
+	srand(1);
+
+	for (iter = 0; iter < 2000; iter++) {
+	    nv = 2 + rand() % 30;
+	    source = 0;
+	    sink = nv - 1;
+	    ne = 0;
+	    for (i = 0; i < nv; i++)
+		for (j = 0; j < nv; j++)
+		    if (i != j && j != source && i != sink &&
+			ne < MAXEDGES && rand() % 4 == 0)
+			ADDEDGE(i, j);
+	    qsort(edges, ne, 2*sizeof(int), compare_edge);
+	    maxflow_setup_backedges(ne, edges, backedges);
+
+	    for (round = 0; round < 5; round++) {
+		for (i = 0; i < ne; i++)
+		    if (round == 0 || rand() % 3 == 0)
+			capacity[i] = rand() % 10;
+
+		ret = maxflow_with_scratch(scratch, nv, source, sink, ne,
+					   edges, backedges, capacity,
+					   flow, cut);
+		ret2 = maxflow_pr_with_scratch(prscratch, nv, source, sink,
+					       ne, edges, backedges, capacity,
+					       flow2, cut2);
+		if (round == 0)
+		    memcpy(flow3, flow, ne * sizeof(int));
+		ret3 = maxflow_reoptimise(scratch, nv, source, sink, ne,
+					  edges, backedges, capacity,
+					  flow3, cut3);
+
+		if (ret != ret2 || ret != ret3 ||
+		    memcmp(cut, cut2, nv * sizeof(int)) ||
+		    memcmp(cut, cut3, nv * sizeof(int))) {
+		    printf("mismatch at iteration %d round %d: %d %d %d\n",
+			   iter, round, ret, ret2, ret3);
+		    nfail++;
+		}
+	    }
+	}
+
+	printf("%d random mismatches\n", nfail);
+	free(scratch);
+	free(prscratch);
+    }
+
     return 0;
 }
 
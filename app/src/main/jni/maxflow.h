@@ -92,4 +92,36 @@ int maxflow(int nv, int source, int sink,
 	    int ne, const int *edges, const int *capacity,
 	    int *flow, int *cut);
 
+/*
+ * Re-solve a network whose capacities have changed since `flow' was
+ * last computed by one of these functions. All parameters are as for
+ * maxflow_with_scratch, except that on input `flow' must hold a
+ * valid maximum flow for the same edges under the _old_ capacities.
+ * Flow on any edge now over its capacity is cancelled back along
+ * paths through the existing flow, and then augmenting paths are
+ * searched for starting from what is left. When only a few edges
+ * have changed this is much cheaper than starting from nothing.
+ *
+ * `scratch' is the same size as for maxflow_with_scratch.
+ */
+int maxflow_reoptimise(void *scratch, int nv, int source, int sink,
+		       int ne, const int *edges, const int *backedges,
+		       const int *capacity, int *flow, int *cut);
+
+/*
+ * Push-relabel algorithm, as an alternative to Edmonds-Karp. All
+ * parameters and outputs are exactly as for maxflow_with_scratch,
+ * except that the scratch space must be at least
+ * maxflow_pr_scratch_size(nv) bytes. The total flow and the cut
+ * will match those from maxflow_with_scratch, but the flow on
+ * individual edges may be distributed differently.
+ *
+ * This is faster on large dense networks, where Edmonds-Karp spends
+ * most of its time repeating breadth-first searches.
+ */
+int maxflow_pr_scratch_size(int nv);
+int maxflow_pr_with_scratch(void *scratch, int nv, int source, int sink,
+			    int ne, const int *edges, const int *backedges,
+			    const int *capacity, int *flow, int *cut);
+
 #endif /* MAXFLOW_MAXFLOW_H */
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
 
 #include "puzzles.h"
 
@@ -22,10 +23,34 @@ enum { NEWGAME, MOVE, SOLVE, RESTART };/* for midend_state_entry.movetype */
 
 #define special(type) ( (type) != MOVE )
 
+/* Compact saves carry a snapshot every this many states; see
+ * midend_serialise_compact() */
+#define SNAPSHOT_INTERVAL 256
+
+/* Calls into the back end (and our own I/O) that midend_get_stats()
+ * times; the names are the ones it reports them under */
+enum {
+    PHASE_NEW_DESC, PHASE_VALIDATE_DESC, PHASE_NEW_GAME,
+    PHASE_INTERPRET_MOVE, PHASE_EXECUTE_MOVE, PHASE_REDRAW, PHASE_STATUS,
+    PHASE_SERIALISE, PHASE_DESERIALISE, NPHASES
+};
+static const char *const phase_names[NPHASES] = {
+    "new_desc", "validate_desc", "new_game",
+    "interpret_move", "execute_move", "redraw", "status",
+    "serialise", "deserialise",
+};
+
+struct midend_phase_stats {
+    unsigned long count;
+    double total, max;                 /* milliseconds */
+};
+
 struct midend_state_entry {
     game_state *state;
     char *movestr;
     int movetype;
+    unsigned char *encmove;            /* a MOVE in the back end's binary */
+    int enclen;                        /* form, if any; movestr is NULL */
 };
 
 struct midend {
@@ -62,9 +87,11 @@ struct midend {
     char *desc, *privdesc, *seedstr;
     char *aux_info;
     enum { GOT_SEED, GOT_DESC, GOT_NOTHING } genmode;
+    gen_ctx *genctx;                   /* for new_desc; not ours to free */
 
     int nstates, statesize, statepos;
     struct midend_state_entry *states;
+    int undo_floor;                    /* statepos may not go below this */
 
     game_params *params, *curparams;
     game_drawstate *drawstate;
@@ -87,6 +114,10 @@ struct midend {
 
     void (*game_id_change_notify_function)(void *);
     void *game_id_change_notify_ctx;
+
+    struct midend_phase_stats phases[NPHASES];
+    unsigned long frames, drawcalls;   /* drawing API calls by redraws */
+    int lastframecalls, maxframecalls;
 };
 
 #define ensure(me) do { \
@@ -95,8 +126,31 @@ struct midend {
 	(me)->states = sresize((me)->states, (me)->statesize, \
                                struct midend_state_entry); \
     } \
+    (me)->states[(me)->nstates].encmove = NULL; \
+    (me)->states[(me)->nstates].enclen = 0; \
 } while (0)
 
+/*
+ * Phase timing, which is cheap enough to leave on all the time: a
+ * clock read either side of each back end call.
+ */
+static double midend_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void midend_phase_done(midend *me, int phase, double start)
+{
+    struct midend_phase_stats *p = &me->phases[phase];
+    double t = midend_now() - start;
+    p->count++;
+    p->total += t;
+    if (t > p->max)
+        p->max = t;
+}
+
 void midend_reset_tilesize(midend *me)
 {
     me->preferred_tilesize = me->ourgame->preferred_tilesize;
@@ -133,7 +187,9 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->ourgame = ourgame;
     me->random = random_new(randseed, randseedsize);
     me->nstates = me->statesize = me->statepos = 0;
+    me->undo_floor = 1;
     me->states = NULL;
+    me->genctx = NULL;
     me->params = ourgame->default_params();
     me->game_id_change_notify_function = NULL;
     me->game_id_change_notify_ctx = NULL;
@@ -174,6 +230,7 @@ midend *midend_new(frontend *fe, const game *ourgame,
     me->timing = FALSE;
     me->elapsed = 0.0F;
     me->tilesize = me->winwidth = me->winheight = 0;
+    midend_reset_stats(me);
     if (drapi)
 	me->drawing = drawing_new(drapi, me, drhandle);
     else
@@ -191,12 +248,160 @@ const game *midend_which_game(midend *me)
     return me->ourgame;
 }
 
+/*
+ * If the game sets undo_keyframe_interval, we only keep a full
+ * game_state for every K'th entry in the undo chain (and for any
+ * special move, and the few around statepos); the rest have their
+ * state pointer NULL and are rebuilt on demand by replaying move
+ * strings forward from the previous state we do have.
+ */
+static int midend_is_keyframe(midend *me, int i)
+{
+    int k = me->ourgame->undo_keyframe_interval;
+    return k <= 0 || i % k == 0 || me->states[i].movetype != MOVE;
+}
+
+/*
+ * Every move the midend makes goes through here, so that a backend's
+ * update_status sees them all.
+ */
+static game_state *midend_execute_move(midend *me, const game_state *from,
+                                       const char *move)
+{
+    int tag = heap_tag(HEAP_HISTORY);
+    game_state *s = me->ourgame->execute_move(from, move);
+    if (s && s != from && me->ourgame->update_status)
+        me->ourgame->update_status(from, s, move);
+    heap_tag(tag);
+    return s;
+}
+
+/*
+ * Back ends with encode_move keep the MOVEs in the undo chain in
+ * binary, which is smaller and quicker to replay than text.
+ */
+static void midend_encode_move(midend *me, struct midend_state_entry *e)
+{
+    if (e->movetype != MOVE || !e->movestr || !me->ourgame->encode_move)
+        return;
+    e->encmove = me->ourgame->encode_move(e->movestr, &e->enclen);
+    if (e->encmove) {
+        sfree(e->movestr);
+        e->movestr = NULL;
+    }
+}
+
+/*
+ * The text of an entry's move, e.g. for saving; must be freed. A move
+ * that won't decode (which encode_move should never have made) comes
+ * out empty rather than taking the save down with it.
+ */
+static char *midend_move_text(midend *me, const struct midend_state_entry *e)
+{
+    char *text;
+
+    if (!e->encmove)
+        return dupstr(e->movestr);
+    text = me->ourgame->decode_move(e->encmove, e->enclen);
+    return text ? text : dupstr("");
+}
+
+static game_state *midend_replay_move(midend *me, const game_state *from,
+                                      const struct midend_state_entry *e)
+{
+    game_state *s;
+    char *text;
+
+    if (!e->encmove)
+        return midend_execute_move(me, from, e->movestr);
+    s = me->ourgame->execute_encoded_move(from, e->encmove, e->enclen);
+    if (s && s != from && me->ourgame->update_status) {
+        text = midend_move_text(me, e);
+        me->ourgame->update_status(from, s, text);
+        sfree(text);
+    }
+    return s;
+}
+
+/*
+ * Make sure states[i] is present, replaying forward from the last
+ * state we have. The moves skipped over by a resumed snapshot were
+ * never checked, so this can fail; if it does, the history before
+ * the next state we do have is unreachable, and undo stops there.
+ */
+static int midend_rebuild(midend *me, int i)
+{
+    int j, k, from;
+
+    assert(i >= 0 && i < me->nstates);
+    if (me->states[i].state)
+        return TRUE;
+    for (from = i; !me->states[from].state; from--)
+        assert(from > 0);              /* states[0] is always kept */
+    for (j = from + 1; j <= i; j++) {
+        double t = midend_now();
+        /* Only a resumed snapshot leaves special moves to rebuild */
+        if (me->states[j].movetype == RESTART) {
+            me->states[j].state =
+                me->ourgame->new_game(me, me->params, me->states[j].movestr);
+            midend_phase_done(me, PHASE_NEW_GAME, t);
+        } else {
+            me->states[j].state =
+                midend_replay_move(me, me->states[j-1].state, &me->states[j]);
+            midend_phase_done(me, PHASE_EXECUTE_MOVE, t);
+        }
+        if (!me->states[j].state) {
+            for (k = from + 1; k < j; k++) {
+                me->ourgame->free_game(me->states[k].state);
+                me->states[k].state = NULL;
+            }
+            for (k = j; !me->states[k].state; k++)
+                assert(k + 1 < me->nstates);
+            if (me->undo_floor < k + 1)
+                me->undo_floor = k + 1;
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static game_state *midend_state(midend *me, int i)
+{
+    int ok = midend_rebuild(me, i);
+    assert(ok);
+    return me->states[i].state;
+}
+
+/*
+ * Call whenever statepos changes: drops states we can rebuild, and
+ * makes sure the current one (which is used directly everywhere) and
+ * its neighbours are present.
+ */
+static void midend_settle_states(midend *me)
+{
+    int i;
+
+    if (me->statepos < 1)
+        return;
+    for (i = 1; i < me->nstates && me->ourgame->undo_keyframe_interval > 0;
+         i++) {
+        if (me->states[i].state && !midend_is_keyframe(me, i) &&
+            (i < me->statepos - 2 || i > me->statepos)) {
+            me->ourgame->free_game(me->states[i].state);
+            me->states[i].state = NULL;
+        }
+    }
+    midend_state(me, me->statepos - 1);
+}
+
 static void midend_purge_states(midend *me)
 {
     while (me->nstates > me->statepos) {
-        me->ourgame->free_game(me->states[--me->nstates].state);
+        if (me->states[--me->nstates].state)
+            me->ourgame->free_game(me->states[me->nstates].state);
         if (me->states[me->nstates].movestr)
             sfree(me->states[me->nstates].movestr);
+        sfree(me->states[me->nstates].encmove);
     }
 }
 
@@ -204,8 +409,10 @@ static void midend_free_game(midend *me)
 {
     while (me->nstates > 0) {
         me->nstates--;
-	me->ourgame->free_game(me->states[me->nstates].state);
+        if (me->states[me->nstates].state)
+            me->ourgame->free_game(me->states[me->nstates].state);
 	sfree(me->states[me->nstates].movestr);
+	sfree(me->states[me->nstates].encmove);
     }
 
     if (me->drawstate) {
@@ -247,6 +454,16 @@ void midend_free(midend *me)
     sfree(me);
 }
 
+/* Drawstates, and what set_size allocates in them, count as drawing */
+static game_drawstate *midend_new_drawstate(midend *me,
+                                            const game_state *state)
+{
+    int tag = heap_tag(HEAP_DRAWING);
+    game_drawstate *ds = me->ourgame->new_drawstate(me->drawing, state);
+    heap_tag(tag);
+    return ds;
+}
+
 static void midend_size_new_drawstate(midend *me)
 {
     /*
@@ -254,10 +471,12 @@ static void midend_size_new_drawstate(midend *me)
      * anyway yet.
      */
     if (me->tilesize > 0) {
+        int tag = heap_tag(HEAP_DRAWING);
 	me->ourgame->compute_size(me->params, me->tilesize,
 				  &me->winwidth, &me->winheight);
 	me->ourgame->set_size(me->drawing, me->drawstate,
 			      me->params, me->tilesize);
+        heap_tag(tag);
     }
 }
 
@@ -273,8 +492,7 @@ void midend_size(midend *me, int *x, int *y, int user_size)
      */
     if (me->drawstate && me->tilesize > 0) {
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
-        me->drawstate = me->ourgame->new_drawstate(me->drawing,
-                                                   me->states[0].state);
+        me->drawstate = midend_new_drawstate(me, me->states[0].state);
     }
 
     /*
@@ -332,6 +550,20 @@ void midend_set_params(midend *me, game_params *params)
     me->params = me->ourgame->dup_params(params);
 }
 
+/*
+ * Make the next midend_new_game generate from this seed with the
+ * current params, exactly as if it had picked the seed itself.
+ */
+void midend_set_seed(midend *me, const char *seed)
+{
+    sfree(me->seedstr);
+    me->seedstr = dupstr(seed);
+    if (me->curparams)
+        me->ourgame->free_params(me->curparams);
+    me->curparams = me->ourgame->dup_params(me->params);
+    me->genmode = GOT_SEED;
+}
+
 game_params *midend_get_params(midend *me)
 {
     return me->ourgame->dup_params(me->params);
@@ -352,14 +584,16 @@ void midend_force_redraw(midend *me)
 {
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
-    me->drawstate = me->ourgame->new_drawstate(me->drawing,
-					       me->states[0].state);
+    me->drawstate = midend_new_drawstate(me, me->states[0].state);
     midend_size_new_drawstate(me);
     midend_redraw(me);
 }
 
 void midend_new_game(midend *me)
 {
+    int cancelled = FALSE, tag;
+    double t;
+
     midend_free_game(me);
 
     assert(me->nstates == 0);
@@ -372,22 +606,9 @@ void midend_new_game(midend *me)
         if (me->genmode == GOT_SEED) {
             me->genmode = GOT_NOTHING;
         } else {
-            /*
-             * Generate a new random seed. 15 digits comes to about
-             * 48 bits, which should be more than enough.
-             * 
-             * I'll avoid putting a leading zero on the number,
-             * just in case it confuses anybody who thinks it's
-             * processed as an integer rather than a string.
-             */
-            char newseed[16];
-            int i;
-            newseed[15] = '\0';
-            newseed[0] = '1' + (char)random_upto(me->random, 9);
-            for (i = 1; i < 15; i++)
-                newseed[i] = '0' + (char)random_upto(me->random, 10);
+            /* Generate a new random seed */
             sfree(me->seedstr);
-            me->seedstr = dupstr(newseed);
+            me->seedstr = random_new_seed_string(me->random);
 
 	    if (me->curparams)
 		me->ourgame->free_params(me->curparams);
@@ -399,17 +620,35 @@ void midend_new_game(midend *me)
         sfree(me->aux_info);
 	me->aux_info = NULL;
 
-        rs = random_new(me->seedstr, strlen(me->seedstr));
+        rs = random_new_seed(me->seedstr);
+        random_set_gen_ctx(rs, me->genctx);
+        if (me->genctx)
+            me->genctx->relaxed = 0;
 	/*
 	 * If this midend has been instantiated without providing a
 	 * drawing API, it is non-interactive. This means that it's
 	 * being used for bulk game generation, and hence we should
 	 * pass the non-interactive flag to new_desc.
 	 */
+        t = midend_now();
+        tag = heap_tag(HEAP_GENERATE);
         me->desc = me->ourgame->new_desc(me->curparams, rs,
 					 &me->aux_info, (me->drawing != NULL));
+        heap_tag(tag);
+        midend_phase_done(me, PHASE_NEW_DESC, t);
 	me->privdesc = NULL;
+        cancelled = random_gen_cancelled(rs);
         random_free(rs);
+
+        /*
+         * A game that was settled for when time ran out depends on
+         * the timing as well as the seed, so the seed can't be
+         * offered as a way to get it again; the game ID still can.
+         */
+        if (me->genctx && me->genctx->relaxed) {
+            sfree(me->seedstr);
+            me->seedstr = NULL;
+        }
     }
 
     ensure(me);
@@ -428,23 +667,31 @@ void midend_new_game(midend *me)
      * case where a game has failed to encode a play-time parameter
      * in the non-full version of encode_params().
      */
+    t = midend_now();
+    tag = heap_tag(HEAP_HISTORY);
     me->states[me->nstates].state =
 	me->ourgame->new_game(me, me->params, me->desc);
+    heap_tag(tag);
+    midend_phase_done(me, PHASE_NEW_GAME, t);
 
     /*
      * As part of our commitment to self-testing, test the aux
-     * string to make sure nothing ghastly went wrong.
+     * string to make sure nothing ghastly went wrong. (Unless the
+     * generator was cancelled, in which case it may have given up
+     * on an unfinished puzzle, and nobody will use this game.)
      */
-    if (me->ourgame->can_solve && me->aux_info) {
+    if (me->ourgame->can_solve && me->aux_info && !cancelled) {
 	game_state *s;
 	char *msg, *movestr;
 
 	msg = NULL;
+        tag = heap_tag(HEAP_SOLVE);
 	movestr = me->ourgame->solve(me->states[0].state,
 				     me->states[0].state,
 				     me->aux_info, &msg);
+        heap_tag(tag);
 	assert(movestr && !msg);
-	s = me->ourgame->execute_move(me->states[0].state, movestr);
+	s = midend_execute_move(me, me->states[0].state, movestr);
 	assert(s);
 	me->ourgame->free_game(s);
 	sfree(movestr);
@@ -454,8 +701,8 @@ void midend_new_game(midend *me)
     me->states[me->nstates].movetype = NEWGAME;
     me->nstates++;
     me->statepos = 1;
-    me->drawstate = me->ourgame->new_drawstate(me->drawing,
-					       me->states[0].state);
+    me->undo_floor = 1;
+    me->drawstate = midend_new_drawstate(me, me->states[0].state);
     midend_size_new_drawstate(me);
     me->elapsed = 0.0F;
     if (me->ui)
@@ -471,7 +718,7 @@ void midend_new_game(midend *me)
 
 int midend_can_undo(midend *me)
 {
-    return (me->statepos > 1);
+    return (me->statepos > me->undo_floor);
 }
 
 int midend_can_redo(midend *me)
@@ -481,14 +728,21 @@ int midend_can_redo(midend *me)
 
 static int midend_undo(midend *me)
 {
-    if (me->statepos > 1) {
+    if (me->statepos > me->undo_floor &&
+        !midend_rebuild(me, me->statepos-2)) {
+        changed_state(me->drawing, midend_can_undo(me),
+                      midend_can_redo(me));
+        return 0;
+    }
+    if (me->statepos > me->undo_floor) {
         if (me->ui)
             me->ourgame->changed_state(me->ui,
                                        me->states[me->statepos-1].state,
-                                       me->states[me->statepos-2].state);
+                                       midend_state(me, me->statepos-2));
 	me->statepos--;
+        midend_settle_states(me);
         me->dir = -1;
-        changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+        changed_state(me->drawing, midend_can_undo(me), midend_can_redo(me));
         return 1;
     } else
         return 0;
@@ -500,10 +754,11 @@ static int midend_redo(midend *me)
         if (me->ui)
             me->ourgame->changed_state(me->ui,
                                        me->states[me->statepos-1].state,
-                                       me->states[me->statepos].state);
+                                       midend_state(me, me->statepos));
 	me->statepos++;
+        midend_settle_states(me);
         me->dir = +1;
-        changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+        changed_state(me->drawing, midend_can_undo(me), midend_can_redo(me));
         return 1;
     } else
         return 0;
@@ -523,7 +778,7 @@ static void midend_finish_move(midend *me)
          (me->dir < 0 && me->statepos < me->nstates &&
           !special(me->states[me->statepos].movetype)))) {
 	flashtime = me->ourgame->flash_length(me->oldstate ? me->oldstate :
-					      me->states[me->statepos-2].state,
+					      midend_state(me, me->statepos-2),
 					      me->states[me->statepos-1].state,
 					      me->oldstate ? me->dir : +1,
 					      me->ui);
@@ -553,6 +808,7 @@ void midend_stop_anim(midend *me)
 void midend_restart_game(midend *me)
 {
     game_state *s;
+    double t;
 
     midend_stop_anim(me);
 
@@ -567,7 +823,9 @@ void midend_restart_game(midend *me)
      * goes to _after_ the first click so you don't have to
      * remember where you clicked).
      */
+    t = midend_now();
     s = me->ourgame->new_game(me, me->params, me->desc);
+    midend_phase_done(me, PHASE_NEW_GAME, t);
 
     /*
      * Now enter the restarted state as the next move.
@@ -579,12 +837,13 @@ void midend_restart_game(midend *me)
     me->states[me->nstates].movestr = dupstr(me->desc);
     me->states[me->nstates].movetype = RESTART;
     me->statepos = ++me->nstates;
+    midend_settle_states(me);
     if (me->ui) {
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
+                                   midend_state(me, me->statepos-2),
                                    me->states[me->statepos-1].state);
     }
-    changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+    changed_state(me->drawing, midend_can_undo(me), midend_can_redo(me));
     me->anim_time = 0.0;
     midend_finish_move(me);
     midend_redraw(me);
@@ -597,6 +856,7 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
         me->ourgame->dup_game(me->states[me->statepos - 1].state);
     int type = MOVE, gottype = FALSE, ret = 1;
     float anim_time;
+    double t;
     game_state *s;
     char *movestr = NULL;
 
@@ -607,9 +867,11 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 	       button == '\x12' || button == '\x19') {
 	button = 'r';
     } else {
+        t = midend_now();
 	movestr =
 	    me->ourgame->interpret_move(me->states[me->statepos-1].state,
 					me->ui, me->drawstate, x, y, button);
+        midend_phase_done(me, PHASE_INTERPRET_MOVE, t);
     }
 
     if (!movestr) {
@@ -640,8 +902,10 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
 	if (!*movestr)
 	    s = me->states[me->statepos-1].state;
 	else {
-	    s = me->ourgame->execute_move(me->states[me->statepos-1].state,
-					  movestr);
+            t = midend_now();
+	    s = midend_execute_move(me, me->states[me->statepos-1].state,
+				    movestr);
+            midend_phase_done(me, PHASE_EXECUTE_MOVE, t);
 	    assert(s != NULL);
 	}
 
@@ -662,14 +926,16 @@ static int midend_really_process_key(midend *me, int x, int y, int button)
             me->states[me->nstates].state = s;
             me->states[me->nstates].movestr = movestr;
             me->states[me->nstates].movetype = MOVE;
+            midend_encode_move(me, &me->states[me->nstates]);
             me->statepos = ++me->nstates;
+            midend_settle_states(me);
             me->dir = +1;
 	    if (me->ui) {
 		me->ourgame->changed_state(me->ui,
-					   me->states[me->statepos-2].state,
+					   midend_state(me, me->statepos-2),
 					   me->states[me->statepos-1].state);
             }
-            changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+            changed_state(me->drawing, midend_can_undo(me), midend_can_redo(me));
         } else {
             goto done;
         }
@@ -852,6 +1118,8 @@ void midend_redraw(midend *me)
     assert(me->drawing);
 
     if (me->statepos > 0 && me->drawstate) {
+        double t = midend_now();
+        int calls, tag = heap_tag(HEAP_DRAWING);
         start_draw(me->drawing);
         if (me->oldstate && me->anim_time > 0 &&
             me->anim_pos < me->anim_time) {
@@ -865,6 +1133,14 @@ void midend_redraw(midend *me)
 				me->ui, 0.0, me->flash_pos);
         }
         end_draw(me->drawing);
+        heap_tag(tag);
+        midend_phase_done(me, PHASE_REDRAW, t);
+        calls = drawing_call_count(me->drawing);
+        me->frames++;
+        me->drawcalls += calls;
+        me->lastframecalls = calls;
+        if (calls > me->maxframecalls)
+            me->maxframecalls = calls;
     }
 }
 
@@ -908,6 +1184,19 @@ void midend_timer(midend *me, float tplus)
     midend_set_timer(me);
 }
 
+/*
+ * How long a front end can leave the timer before the next
+ * midend_timer() call would change anything on screen: zero (i.e.
+ * every frame) while animating or flashing, otherwise the time until
+ * the clock's displayed second ticks over.
+ */
+float midend_timer_due(midend *me)
+{
+    if (me->anim_time > 0 || me->flash_time > 0 || !me->timing)
+        return 0.0F;
+    return 1.0F - (me->elapsed - (int)me->elapsed);
+}
+
 float *midend_colours(midend *me, int *ncolours)
 {
     float *ret;
@@ -1234,7 +1523,9 @@ char *midend_game_id_int(midend *me, char *id, int defmode, int validate_only)
     }
 
     if (desc) {
+        double t = midend_now();
         error = me->ourgame->validate_desc(newparams, desc);
+        midend_phase_done(me, PHASE_VALIDATE_DESC, t);
         if (error) {
             if (free_params) {
                 if (newcurparams)
@@ -1317,6 +1608,51 @@ char *midend_get_current_params(midend *me, int full)
     return ret;
 }
 
+/*
+ * Attach a generation context to every game midend_new_game generates
+ * from now on (or NULL for none); see random_gen_attempt().
+ */
+void midend_set_gen_ctx(midend *me, gen_ctx *ctx)
+{
+    me->genctx = ctx;
+}
+
+void midend_reset_stats(midend *me)
+{
+    memset(me->phases, 0, sizeof(me->phases));
+    me->frames = me->drawcalls = 0;
+    me->lastframecalls = me->maxframecalls = 0;
+}
+
+/*
+ * A plain-text summary of where this midend has spent its time since
+ * it was created or midend_reset_stats() was last called: one line
+ * per phase of "name calls total_ms max_ms", then one of "frames
+ * count drawing_calls max_per_frame last_frame". If heap accounting
+ * is on, its summary (for the whole process, not just this midend)
+ * follows. The caller frees it.
+ */
+char *midend_get_stats(midend *me)
+{
+    char *heap = heap_get_stats();
+    char *ret = snewn(NPHASES * 80 + 160 + (heap ? strlen(heap) : 0), char);
+    char *p = ret;
+    int i;
+
+    p += sprintf(p, "phase calls total_ms max_ms\n");
+    for (i = 0; i < NPHASES; i++)
+        p += sprintf(p, "%s %lu %.3f %.3f\n", phase_names[i],
+                     me->phases[i].count, me->phases[i].total,
+                     me->phases[i].max);
+    p += sprintf(p, "frames %lu %lu %d %d\n", me->frames, me->drawcalls,
+                 me->maxframecalls, me->lastframecalls);
+    if (heap) {
+        strcpy(p, heap);
+        sfree(heap);
+    }
+    return ret;
+}
+
 char *midend_get_random_seed(midend *me)
 {
     char *parstr, *ret;
@@ -1393,10 +1729,96 @@ char *midend_text_format(midend *me)
 	return NULL;
 }
 
+/*
+ * A game that came from a description rather than our own generator
+ * has no aux info, so Solve would run the whole solver every time.
+ * For games whose solution can serve as aux info, this says whether
+ * it's still to be found; the front end can then find it in the
+ * background with midend_solve_game_id and hand it over with
+ * midend_supply_solution, and failing that midend_solve finds it
+ * (once). Either way it's then saved along with the game.
+ */
+int midend_wants_solution(midend *me)
+{
+    return me->ourgame->can_solve &&
+        (me->ourgame->flags & SOLUTION_CACHEABLE) &&
+        !me->aux_info && me->desc && me->nstates > 0;
+}
+
+/*
+ * Solve the game with the given ID (as from midend_get_game_id),
+ * using no midend, so that it can run on any thread. Returns NULL,
+ * setting *error if there's a reason to give, if it can't.
+ */
+char *midend_solve_game_id(const game *g, const char *id, char **error)
+{
+    game_params *params;
+    game_state *s;
+    char *parstr, *desc, *ret;
+    int tag;
+
+    *error = NULL;
+    if (!g->can_solve || !(g->flags & SOLUTION_CACHEABLE))
+        return NULL;
+    desc = strchr(id, ':');
+    if (!desc)
+        return NULL;
+    parstr = snewn(desc - id + 1, char);
+    memcpy(parstr, id, desc - id);
+    parstr[desc - id] = '\0';
+    desc++;
+
+    params = g->default_params();
+    g->decode_params(params, parstr);
+    sfree(parstr);
+    if (g->validate_params(params, TRUE) || g->validate_desc(params, desc)) {
+        g->free_params(params);
+        return NULL;
+    }
+    s = g->new_game(NULL, params, desc);
+    tag = heap_tag(HEAP_SOLVE);
+    ret = g->solve(s, s, NULL, error);
+    heap_tag(tag);
+    g->free_game(s);
+    g->free_params(params);
+    return ret;
+}
+
+/* Keep a solution from midend_solve_game_id, if it's still wanted */
+void midend_supply_solution(midend *me, const char *id, const char *soln)
+{
+    char *current;
+
+    if (!midend_wants_solution(me))
+        return;
+    current = midend_get_game_id(me);
+    if (!strcmp(current, id))
+        me->aux_info = dupstr(soln);
+    sfree(current);
+}
+
+/*
+ * The current game's aux info, e.g. to keep alongside its desc in a
+ * puzzle pack, and the way to give it back when the game is set up
+ * from that desc again.
+ */
+const char *midend_get_aux_info(midend *me)
+{
+    return me->aux_info;
+}
+
+void midend_set_aux_info(midend *me, const char *aux)
+{
+    sfree(me->aux_info);
+    me->aux_info = aux ? dupstr(aux) : NULL;
+}
+
 char *midend_solve(midend *me)
 {
     game_state *s;
     char *msg, *movestr;
+    double t;
+    int tag;
 
     if (!me->ourgame->can_solve)
 	return _("This game does not support the Solve operation");
@@ -1405,15 +1827,27 @@ char *midend_solve(midend *me)
 	return _("No game set up to solve");   /* _shouldn't_ happen! */
 
     msg = NULL;
+    tag = heap_tag(HEAP_SOLVE);
+    if (midend_wants_solution(me)) {
+        me->aux_info = me->ourgame->solve(me->states[0].state,
+                                          me->states[0].state, NULL, &msg);
+        if (!me->aux_info) {
+            heap_tag(tag);
+            return msg ? msg : _("Solve operation failed");
+        }
+    }
     movestr = me->ourgame->solve(me->states[0].state,
 				 me->states[me->statepos-1].state,
 				 me->aux_info, &msg);
+    heap_tag(tag);
     if (!movestr) {
 	if (!msg)
 	    msg = _("Solve operation failed");   /* _shouldn't_ happen, but can */
 	return msg;
     }
-    s = me->ourgame->execute_move(me->states[me->statepos-1].state, movestr);
+    t = midend_now();
+    s = midend_execute_move(me, me->states[me->statepos-1].state, movestr);
+    midend_phase_done(me, PHASE_EXECUTE_MOVE, t);
     assert(s);
 
     /*
@@ -1426,17 +1860,18 @@ char *midend_solve(midend *me)
     me->states[me->nstates].movestr = movestr;
     me->states[me->nstates].movetype = SOLVE;
     me->statepos = ++me->nstates;
+    midend_settle_states(me);
     if (me->ui) {
         me->ourgame->changed_state(me->ui,
-                                   me->states[me->statepos-2].state,
+                                   midend_state(me, me->statepos-2),
                                    me->states[me->statepos-1].state);
     }
-    changed_state(me->drawing, me->statepos > 1, me->statepos < me->nstates);
+    changed_state(me->drawing, midend_can_undo(me), midend_can_redo(me));
     me->dir = +1;
     if (me->ourgame->flags & SOLVE_ANIMATES) {
-	me->oldstate = me->ourgame->dup_game(me->states[me->statepos-2].state);
+	me->oldstate = me->ourgame->dup_game(midend_state(me, me->statepos-2));
         me->anim_time =
-	    me->ourgame->anim_length(me->states[me->statepos-2].state,
+	    me->ourgame->anim_length(midend_state(me, me->statepos-2),
 				     me->states[me->statepos-1].state,
 				     +1, me->ui);
         me->anim_pos = 0.0;
@@ -1461,10 +1896,16 @@ int midend_status(midend *me)
      * practically, a user whose midend has been left in that state
      * probably _does_ want the 'new game' option to be prominent.
      */
+    double t;
+    int ret;
+
     if (me->statepos == 0)
         return +1;
 
-    return me->ourgame->status(me->states[me->statepos-1].state);
+    t = midend_now();
+    ret = me->ourgame->status(me->states[me->statepos-1].state);
+    midend_phase_done(me, PHASE_STATUS, t);
+    return ret;
 }
 
 char *midend_rewrite_statusbar(midend *me, char *text)
@@ -1500,9 +1941,9 @@ char *midend_rewrite_statusbar(midend *me, char *text)
 #define SERIALISE_MAGIC "Simon Tatham's Portable Puzzle Collection"
 #define SERIALISE_VERSION "1"
 
-void midend_serialise(midend *me,
-                      void (*write)(void *ctx, void *buf, int len),
-                      void *wctx)
+static void midend_serialise_int(midend *me,
+                                 void (*write)(void *ctx, void *buf, int len),
+                                 void *wctx, int compact)
 {
     int i;
 
@@ -1622,6 +2063,26 @@ void midend_serialise(midend *me,
         wr("STATEPOS", buf);
     }
 
+    /*
+     * In a compact save, snapshots of the odd state along the way
+     * (each one a state we're keeping anyway, being a multiple of
+     * any keyframe interval) and of the current one, so that
+     * resuming a long game needn't replay it all from the start.
+     */
+    if (compact && me->ourgame->encode_state) {
+        for (i = SNAPSHOT_INTERVAL; i < me->statepos; i++) {
+            if ((i % SNAPSHOT_INTERVAL == 0 || i == me->statepos - 1) &&
+                i >= me->undo_floor - 1 && midend_rebuild(me, i)) {
+                char *enc = me->ourgame->encode_state(me->states[i].state);
+                char *s = snewn(strlen(enc) + 40, char);
+                sprintf(s, "%d:%s", i, enc);
+                wr("SNAPSHOT", s);
+                sfree(s);
+                sfree(enc);
+            }
+        }
+    }
+
     /*
      * For each state after the initial one (which we know is
      * constructed from either privdesc or desc), enough
@@ -1632,7 +2093,37 @@ void midend_serialise(midend *me,
         assert(me->states[i].movetype != NEWGAME);   /* only state 0 */
         switch (me->states[i].movetype) {
           case MOVE:
-            wr("MOVE", me->states[i].movestr);
+            if (compact && i+1 < me->nstates &&
+                me->states[i+1].movetype == MOVE) {
+                /*
+                 * A run of ordinary moves goes in a single MOVES
+                 * record, each move prefixed with its length and a
+                 * colon, which saves a header line per move.
+                 */
+                char *s, *p, **texts;
+                int j, n, len = 0;
+
+                for (n = 0; i+n < me->nstates &&
+                         me->states[i+n].movetype == MOVE; n++);
+                texts = snewn(n, char *);
+                for (j = 0; j < n; j++) {
+                    texts[j] = midend_move_text(me, &me->states[i+j]);
+                    len += strlen(texts[j]) + 12;
+                }
+                s = p = snewn(len + 1, char);
+                for (j = 0; j < n; j++) {
+                    p += sprintf(p, "%d:%s", (int)strlen(texts[j]), texts[j]);
+                    sfree(texts[j]);
+                }
+                sfree(texts);
+                wr("MOVES", s);
+                sfree(s);
+                i += n - 1;
+            } else {
+                char *text = midend_move_text(me, &me->states[i]);
+                wr("MOVE", text);
+                sfree(text);
+            }
             break;
           case SOLVE:
             wr("SOLVE", me->states[i].movestr);
@@ -1646,17 +2137,43 @@ void midend_serialise(midend *me,
 #undef wr
 }
 
+void midend_serialise(midend *me,
+                      void (*write)(void *ctx, void *buf, int len),
+                      void *wctx)
+{
+    double t = midend_now();
+    midend_serialise_int(me, write, wctx, FALSE);
+    midend_phase_done(me, PHASE_SERIALISE, t);
+}
+
+/*
+ * As midend_serialise, but with runs of moves packed into MOVES
+ * records, and with SNAPSHOT records of states along the way if the
+ * game can encode them. Only midend_deserialise from this version
+ * onwards can read the result, so it's for the frontend's own saved
+ * state and not for files the user might take elsewhere.
+ */
+void midend_serialise_compact(midend *me,
+                              void (*write)(void *ctx, void *buf, int len),
+                              void *wctx)
+{
+    double t = midend_now();
+    midend_serialise_int(me, write, wctx, TRUE);
+    midend_phase_done(me, PHASE_SERIALISE, t);
+}
+
 /*
  * This function returns NULL on success, or an error message.
  * Accepts me == null, to identify the game only.
  */
-char *midend_deserialise(midend *me,
-                         int (*read)(void *ctx, void *buf, int len),
-                         void *rctx)
+static char *midend_deserialise_int(midend *me,
+                                    int (*read)(void *ctx, void *buf,
+                                                int len),
+                                    void *rctx)
 {
     int nstates = 0, statepos = -1, gotstates = 0;
     int started = FALSE;
-    int i;
+    int i, start;
 
     char *val = NULL;
     /* Initially all errors give the same report */
@@ -1674,6 +2191,8 @@ char *midend_deserialise(midend *me,
     game_params *params = NULL, *cparams = NULL;
     game_ui *ui = NULL;
     struct midend_state_entry *states = NULL;
+    char **snaps = NULL;
+    int nsnaps = 0, snapsize = 0;
 
     /*
      * Loop round and round reading one key/value pair at a time
@@ -1818,6 +2337,8 @@ char *midend_deserialise(midend *me,
                     states[i].state = NULL;
                     states[i].movestr = NULL;
                     states[i].movetype = NEWGAME;
+                    states[i].encmove = NULL;
+                    states[i].enclen = 0;
                 }
             } else if (!strcmp(key, "STATEPOS")) {
                 statepos = atoi(val);
@@ -1826,6 +2347,34 @@ char *midend_deserialise(midend *me,
                 states[gotstates].movetype = MOVE;
                 states[gotstates].movestr = val;
                 val = NULL;
+            } else if (!strcmp(key, "MOVES")) {
+                char *p = val, *end = val + len;
+                while (p < end) {
+                    int mlen = 0;
+                    while (*p >= '0' && *p <= '9')
+                        mlen = mlen * 10 + (*p++ - '0');
+                    if (*p != ':' || end - (p+1) < mlen) {
+                        ret = _("Data was incorrectly formatted for a saved game file");
+                        goto cleanup;
+                    }
+                    if (!states || gotstates >= nstates-1) {
+                        ret = _("Too many moves in save file");
+                        goto cleanup;
+                    }
+                    gotstates++;
+                    states[gotstates].movetype = MOVE;
+                    states[gotstates].movestr = snewn(mlen + 1, char);
+                    memcpy(states[gotstates].movestr, p+1, mlen);
+                    states[gotstates].movestr[mlen] = '\0';
+                    p += 1 + mlen;
+                }
+            } else if (!strcmp(key, "SNAPSHOT")) {
+                if (nsnaps >= snapsize) {
+                    snapsize = nsnaps + 16;
+                    snaps = sresize(snaps, snapsize, char *);
+                }
+                snaps[nsnaps++] = val;
+                val = NULL;
             } else if (!strcmp(key, "SOLVE")) {
                 gotstates++;
                 states[gotstates].movetype = SOLVE;
@@ -1880,13 +2429,37 @@ char *midend_deserialise(midend *me,
 
     states[0].state = me->ourgame->new_game(me, params,
                                             privdesc ? privdesc : desc);
+
+    /*
+     * If there are snapshots we can use, we start from the latest,
+     * and leave the states before it for midend_state() to rebuild
+     * only if the user undoes that far. A snapshot that doesn't
+     * decode is simply ignored.
+     */
+    start = 0;
+    for (i = 0; i < nsnaps && me->ourgame->decode_state; i++) {
+        char *p;
+        int k = strtol(snaps[i], &p, 10);
+
+        if (*p != ':' || k <= 0 || k >= nstates || k >= statepos ||
+            states[k].state)
+            continue;
+        states[k].state = me->ourgame->decode_state(states[0].state, p+1);
+        if (states[k].state && k > start)
+            start = k;
+    }
+
     for (i = 1; i < nstates; i++) {
         assert(states[i].movetype != NEWGAME);
+        if (states[i].state)
+            continue;                  /* from a snapshot */
         switch (states[i].movetype) {
           case MOVE:
           case SOLVE:
-            states[i].state = me->ourgame->execute_move(states[i-1].state,
-                                                        states[i].movestr);
+            if (i < start)
+                break;
+            states[i].state = midend_execute_move(me, states[i-1].state,
+                                                  states[i].movestr);
             if (states[i].state == NULL) {
                 ret = _("Save file contained an invalid move");
                 goto cleanup;
@@ -1897,12 +2470,17 @@ char *midend_deserialise(midend *me,
                 ret = _("Save file contained an invalid restart move");
                 goto cleanup;
             }
+            if (i < start)
+                break;
             states[i].state = me->ourgame->new_game(me, params,
                                                     states[i].movestr);
             break;
         }
     }
 
+    for (i = 1; i < nstates; i++)
+        midend_encode_move(me, &states[i]);
+
     ui = me->ourgame->new_ui(states[0].state);
     me->ourgame->decode_ui(ui, uistr);
 
@@ -1945,6 +2523,7 @@ char *midend_deserialise(midend *me,
         states = tmp;
     }
     me->statepos = statepos;
+    me->undo_floor = 1;
 
     {
         game_params *tmp;
@@ -1958,6 +2537,9 @@ char *midend_deserialise(midend *me,
         cparams = tmp;
     }
 
+    /* After the params, which rebuilding a restart move needs */
+    midend_settle_states(me);
+
     me->oldstate = NULL;
     me->anim_time = me->anim_pos = me->flash_time = me->flash_pos = 0.0F;
     me->dir = 0;
@@ -1978,8 +2560,7 @@ char *midend_deserialise(midend *me,
     if (me->drawstate)
         me->ourgame->free_drawstate(me->drawing, me->drawstate);
     me->drawstate =
-        me->ourgame->new_drawstate(me->drawing,
-				   me->states[me->statepos-1].state);
+        midend_new_drawstate(me, me->states[me->statepos-1].state);
     midend_size_new_drawstate(me);
 
     ret = NULL;                        /* success! */
@@ -2006,10 +2587,26 @@ char *midend_deserialise(midend *me,
             if (states[i].state)
                 me->ourgame->free_game(states[i].state);
             sfree(states[i].movestr);
+            sfree(states[i].encmove);
         }
         sfree(states);
     }
+    for (i = 0; i < nsnaps; i++)
+        sfree(snaps[i]);
+    sfree(snaps);
+
+    return ret;
+}
 
+/* The deserialise phase includes the moves and so on that it replays */
+char *midend_deserialise(midend *me,
+                         int (*read)(void *ctx, void *buf, int len),
+                         void *rctx)
+{
+    double t = midend_now();
+    char *ret = midend_deserialise_int(me, read, rctx);
+    if (me)
+        midend_phase_done(me, PHASE_DESERIALISE, t);
     return ret;
 }
 
@@ -2144,8 +2741,8 @@ char *midend_print_puzzle(midend *me, document *doc, int with_soln)
 				     me->aux_info, &msg);
 	if (!movestr)
 	    return msg;
-	soln = me->ourgame->execute_move(me->states[me->statepos-1].state,
-					 movestr);
+	soln = midend_execute_move(me, me->states[me->statepos-1].state,
+				   movestr);
 	assert(soln);
 
 	sfree(movestr);
@@ -53,6 +53,7 @@ struct mine_layout {
      */
     int refcount;
     char *mines;
+    int nmines;			       /* how many there are in mines */
     /*
      * If we haven't yet actually generated the mine layout, here's
      * all the data we will need to do so.
@@ -65,9 +66,15 @@ struct mine_layout {
 struct game_state {
     int w, h, n, dead, won;
     int used_solve;
+    int covered;		       /* squares not yet opened */
     struct mine_layout *layout;	       /* real mine positions */
-    signed char *grid;			       /* player knowledge */
+    signed char **grid;			       /* player knowledge */
     /*
+     * The grid is kept in pieces of GRID_CHUNK squares, shared (see
+     * shared_new) between states until a move changes them, so each
+     * step of the undo history only costs the pieces its move touched.
+     * Read squares with GRID() and write them through grid_write().
+     *
      * Each item in the `grid' array is one of the following values:
      * 
      * 	- 0 to 8 mean the square is open and has a surrounding mine
@@ -91,6 +98,17 @@ struct game_state {
      */
 };
 
+#define GRID_CHUNK 256
+#define GRID_NCHUNKS(state) (((state)->w * (state)->h + GRID_CHUNK-1) / GRID_CHUNK)
+#define GRID(state, i) ((state)->grid[(i) / GRID_CHUNK][(i) % GRID_CHUNK])
+
+static signed char *grid_write(game_state *state, int i)
+{
+    signed char **chunk = &state->grid[i / GRID_CHUNK];
+    *chunk = shared_unshare(*chunk);
+    return *chunk + i % GRID_CHUNK;
+}
+
 static game_params *default_params(void)
 {
     game_params *ret = snew(game_params);
@@ -304,6 +322,7 @@ struct set {
     short x, y, mask, mines;
     int todo;
     struct set *prev, *next;
+    struct set *cprev, *cnext;
 };
 
 static int setcmp(void *av, void *bv)
@@ -327,16 +346,41 @@ static int setcmp(void *av, void *bv)
 	return 0;
 }
 
+/*
+ * The sets themselves come from an arena belonging to the caller, so
+ * that they all go at once when it's reset; ones removed along the way
+ * are kept on a free list (linked through next) for ss_add to reuse.
+ *
+ * As well as the tree, which keeps them in order for the solver to
+ * enumerate and pick from, each set is on a chain (linked through
+ * cnext and cprev, in mask order) of the sets whose top left corner
+ * is the same square. ss_overlap only ever wants the sets with a
+ * corner in a small square around the input, so it walks those
+ * chains rather than searching the tree for every corner.
+ */
 struct setstore {
     tree234 *sets;
     struct set *todo_head, *todo_tail;
+    struct set *spare;
+    arena *arena;
+    int w, h;
+    struct set **cells;
 };
 
-static struct setstore *ss_new(void)
+static struct setstore *ss_new(int w, int h, arena *a)
 {
     struct setstore *ss = snew(struct setstore);
+    int i;
+
     ss->sets = newtree234(setcmp);
     ss->todo_head = ss->todo_tail = NULL;
+    ss->spare = NULL;
+    ss->arena = a;
+    ss->w = w;
+    ss->h = h;
+    ss->cells = anewn(a, w*h, struct set *);
+    for (i = 0; i < w*h; i++)
+	ss->cells[i] = NULL;
     return ss;
 }
 
@@ -412,7 +456,7 @@ static void ss_add_todo(struct setstore *ss, struct set *s)
 
 static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
 {
-    struct set *s;
+    struct set *s, **link, *prev;
 
     assert(mask != 0);
 
@@ -428,7 +472,12 @@ static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
     /*
      * Create a set structure and add it to the tree.
      */
-    s = snew(struct set);
+    if (ss->spare) {
+	s = ss->spare;
+	ss->spare = s->next;
+    } else {
+	s = anew(ss->arena, struct set);
+    }
     s->x = x;
     s->y = y;
     s->mask = mask;
@@ -438,10 +487,27 @@ static void ss_add(struct setstore *ss, int x, int y, int mask, int mines)
 	/*
 	 * This set already existed! Free it and return.
 	 */
-	sfree(s);
+	s->next = ss->spare;
+	ss->spare = s;
 	return;
     }
 
+    /*
+     * Link it into the chain for its corner.
+     */
+    assert(x >= 0 && x < ss->w && y >= 0 && y < ss->h);
+    link = &ss->cells[y*ss->w+x];
+    prev = NULL;
+    while (*link && (*link)->mask < mask) {
+	prev = *link;
+	link = &prev->cnext;
+    }
+    s->cprev = prev;
+    s->cnext = *link;
+    if (s->cnext)
+	s->cnext->cprev = s;
+    *link = s;
+
     /*
      * We've added a new set to the tree, so put it on the todo
      * list.
@@ -472,14 +538,21 @@ static void ss_remove(struct setstore *ss, struct set *s)
     s->todo = FALSE;
 
     /*
-     * Remove s from the tree.
+     * Remove s from the tree and from its corner's chain.
      */
     del234(ss->sets, s);
+    if (s->cprev)
+	s->cprev->cnext = s->cnext;
+    else
+	ss->cells[s->y*ss->w+s->x] = s->cnext;
+    if (s->cnext)
+	s->cnext->cprev = s->cprev;
 
     /*
-     * Destroy the actual set structure.
+     * Put the actual set structure on the free list.
      */
-    sfree(s);
+    s->next = ss->spare;
+    ss->spare = s;
 }
 
 /*
@@ -492,39 +565,28 @@ static struct set **ss_overlap(struct setstore *ss, int x, int y, int mask)
     int nret = 0, retsize = 0;
     int xx, yy;
 
-    for (xx = x-3; xx < x+3; xx++)
-	for (yy = y-3; yy < y+3; yy++) {
-	    struct set stmp, *s;
-	    int pos;
+    for (xx = max(x-3, 0); xx < x+3 && xx < ss->w; xx++)
+	for (yy = max(y-3, 0); yy < y+3 && yy < ss->h; yy++) {
+	    struct set *s;
 
 	    /*
-	     * Find the first set with these top left coordinates.
+	     * Go through the sets with these top left coordinates.
 	     */
-	    stmp.x = xx;
-	    stmp.y = yy;
-	    stmp.mask = 0;
-
-	    if (findrelpos234(ss->sets, &stmp, NULL, REL234_GE, &pos)) {
-		while ((s = index234(ss->sets, pos)) != NULL &&
-		       s->x == xx && s->y == yy) {
+	    for (s = ss->cells[yy*ss->w+xx]; s; s = s->cnext) {
+		/*
+		 * This set potentially overlaps the input one.
+		 * Compute the intersection to see if they really
+		 * overlap, and add it to the list if so.
+		 */
+		if (setmunge(x, y, mask, s->x, s->y, s->mask, FALSE)) {
 		    /*
-		     * This set potentially overlaps the input one.
-		     * Compute the intersection to see if they
-		     * really overlap, and add it to the list if
-		     * so.
+		     * There's an overlap.
 		     */
-		    if (setmunge(x, y, mask, s->x, s->y, s->mask, FALSE)) {
-			/*
-			 * There's an overlap.
-			 */
-			if (nret >= retsize) {
-			    retsize = nret + 32;
-			    ret = sresize(ret, retsize, struct set *);
-			}
-			ret[nret++] = s;
+		    if (nret >= retsize) {
+			retsize = nret + 32;
+			ret = sresize(ret, retsize, struct set *);
 		    }
-
-		    pos++;
+		    ret[nret++] = s;
 		}
 	    }
 	}
@@ -646,9 +708,9 @@ typedef struct perturbations *(*perturb_cb) (void *, signed char *, int, int, in
 static int minesolve(int w, int h, int n, signed char *grid,
 		     open_cb open,
                      perturb_cb perturb,
-		     void *ctx, random_state *rs)
+		     void *ctx, random_state *rs, arena *scratch)
 {
-    struct setstore *ss = ss_new();
+    struct setstore *ss = ss_new(w, h, scratch);
     struct set **list;
     struct squaretodo astd, *std = &astd;
     int x, y, i, j;
@@ -1289,11 +1351,9 @@ static int minesolve(int w, int h, int n, signed char *grid,
      * Free the set list and square-todo list.
      */
     {
-	struct set *s;
-	while ((s = delpos234(ss->sets, 0)) != NULL)
-	    sfree(s);
 	freetree234(ss->sets);
 	sfree(ss);
+	arena_reset(scratch);
 	sfree(std->next);
     }
 
@@ -1365,6 +1425,44 @@ static int squarecmp(const void *av, const void *bv)
     return 0;
 }
 
+/*
+ * mineperturb usually wants only the first few squares in that order,
+ * out of the whole grid's worth, so rather than sorting the lot it
+ * keeps them as a heap with the least at the root and pops them off
+ * one at a time as it goes. Each popped square is swapped to the end
+ * of the heap, and never moves again once it's there.
+ */
+static void square_siftdown(struct square *sq, int i, int n)
+{
+    while (1) {
+	int c = 2*i+1;
+	struct square tmp;
+
+	if (c >= n)
+	    break;
+	if (c+1 < n && squarecmp(&sq[c+1], &sq[c]) < 0)
+	    c++;
+	if (squarecmp(&sq[c], &sq[i]) >= 0)
+	    break;
+	tmp = sq[i];
+	sq[i] = sq[c];
+	sq[c] = tmp;
+	i = c;
+    }
+}
+
+static struct square *square_pop(struct square *sq, int n)
+{
+    struct square tmp;
+
+    assert(n > 0);
+    tmp = sq[0];
+    sq[0] = sq[n-1];
+    sq[n-1] = tmp;
+    square_siftdown(sq, 0, n-1);
+    return &sq[n-1];
+}
+
 /*
  * Normally this function is passed an (x,y,mask) set description.
  * On occasions, though, there is no _localised_ set being used,
@@ -1407,7 +1505,7 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
      * 
      * Each of these sections needs to be shuffled independently.
      * We do this by preparing list of all squares and then sorting
-     * it with a random secondary key.
+     * it with a random secondary key (lazily: see square_pop).
      */
     sqlist = snewn(ctx->w * ctx->h, struct square);
     n = 0;
@@ -1455,15 +1553,16 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 	    }
 
 	    /*
-	     * Finally, a random number to cause qsort to
-	     * shuffle within each group.
+	     * Finally, a random number to shuffle within each
+	     * group.
 	     */
 	    sqlist[n].random = random_bits(ctx->rs, 31);
 
 	    n++;
 	}
 
-    qsort(sqlist, n, sizeof(struct square), squarecmp);
+    for (i = n/2; i-- > 0 ;)
+	square_siftdown(sqlist, i, n);
 
     /*
      * Now count up the number of full and empty squares in the set
@@ -1508,7 +1607,7 @@ static struct perturbations *mineperturb(void *vctx, signed char *grid,
 	toempty = snewn(ctx->w * ctx->h, struct square *);
     }
     for (i = 0; i < n; i++) {
-	struct square *sq = &sqlist[i];
+	struct square *sq = square_pop(sqlist, n - i);
 	if (ctx->grid[sq->y * ctx->w + sq->x])
 	    toempty[ntoempty++] = sq;
 	else
@@ -1730,6 +1829,7 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		     random_state *rs)
 {
     char *ret = snewn(w*h, char);
+    arena *scratch = unique ? arena_new() : NULL;
     int success;
     int ntries = 0;
 
@@ -1818,7 +1918,8 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 		assert(solvegrid[y*w+x] == 0); /* by deliberate arrangement */
 
 		solveret =
-		    minesolve(w, h, n, solvegrid, mineopen, mineperturb, ctx, rs);
+		    minesolve(w, h, n, solvegrid, mineopen, mineperturb, ctx, rs,
+			       scratch);
 		if (solveret < 0 || (prevret >= 0 && solveret >= prevret)) {
 		    success = FALSE;
 		    break;
@@ -1835,6 +1936,7 @@ static char *minegen(int w, int h, int n, int x, int y, int unique,
 
     } while (!success);
 
+    arena_free(scratch);
     return ret;
 }
 
@@ -2046,10 +2148,19 @@ static char *validate_desc(const game_params *params, const char *desc)
     return NULL;
 }
 
+static int count_mines(const char *mines, int wh)
+{
+    int i, n = 0;
+    for (i = 0; i < wh; i++)
+	if (mines[i])
+	    n++;
+    return n;
+}
+
 static int open_square(game_state *state, int x, int y)
 {
     int w = state->w, h = state->h;
-    int xx, yy, nmines, ncovered;
+    int *queue, qhead, qtail;
 
     if (!state->layout->mines) {
 	/*
@@ -2077,6 +2188,7 @@ static int open_square(game_state *state, int x, int y)
 	sfree(desc);
 	random_free(state->layout->rs);
 	state->layout->rs = NULL;
+	state->layout->nmines = count_mines(state->layout->mines, w*h);
     }
 
     if (state->layout->mines[y*w+x]) {
@@ -2086,81 +2198,69 @@ static int open_square(game_state *state, int x, int y)
 	 * want to Undo and carry on playing).
 	 */
 	state->dead = TRUE;
-	state->grid[y*w+x] = 65;
+	if (GRID(state, y*w+x) < 0)
+	    state->covered--;
+	*grid_write(state, y*w+x) = 65;
 	return -1;
     }
 
     /*
-     * Otherwise, the player has opened a safe square. Mark it to-do.
+     * Otherwise, the player has opened a safe square. Mark it to-do,
+     * and work through a queue of such squares, opening each and,
+     * whenever one turns out to have no neighbouring mines, adding
+     * all its unopened neighbours too. So the work done is in
+     * proportion to the area opened, not to the size of the grid.
      */
-    state->grid[y*w+x] = -10;	       /* `todo' value internal to this func */
+    queue = snewn(w*h, int);
+    qhead = qtail = 0;
+    if (GRID(state, y*w+x) < 0)
+	state->covered--;
+    *grid_write(state, y*w+x) = -10;   /* `todo' value internal to this func */
+    queue[qtail++] = y*w+x;
 
-    /*
-     * Now go through the grid finding all `todo' values and
-     * opening them. Every time one of them turns out to have no
-     * neighbouring mines, we add all its unopened neighbours to
-     * the list as well.
-     * 
-     * FIXME: We really ought to be able to do this better than
-     * using repeated N^2 scans of the grid.
-     */
-    while (1) {
-	int done_something = FALSE;
+    while (qhead < qtail) {
+	int xx = queue[qhead] % w, yy = queue[qhead] / w;
+	int dx, dy, v;
 
-	for (yy = 0; yy < h; yy++)
-	    for (xx = 0; xx < w; xx++)
-		if (state->grid[yy*w+xx] == -10) {
-		    int dx, dy, v;
+	qhead++;
+	assert(!state->layout->mines[yy*w+xx]);
 
-		    assert(!state->layout->mines[yy*w+xx]);
+	v = 0;
 
-		    v = 0;
-
-		    for (dx = -1; dx <= +1; dx++)
-			for (dy = -1; dy <= +1; dy++)
-			    if (xx+dx >= 0 && xx+dx < state->w &&
-				yy+dy >= 0 && yy+dy < state->h &&
-				state->layout->mines[(yy+dy)*w+(xx+dx)])
-				v++;
-
-		    state->grid[yy*w+xx] = v;
-
-		    if (v == 0) {
-			for (dx = -1; dx <= +1; dx++)
-			    for (dy = -1; dy <= +1; dy++)
-				if (xx+dx >= 0 && xx+dx < state->w &&
-				    yy+dy >= 0 && yy+dy < state->h &&
-				    state->grid[(yy+dy)*w+(xx+dx)] == -2)
-				    state->grid[(yy+dy)*w+(xx+dx)] = -10;
-		    }
+	for (dx = -1; dx <= +1; dx++)
+	    for (dy = -1; dy <= +1; dy++)
+		if (xx+dx >= 0 && xx+dx < state->w &&
+		    yy+dy >= 0 && yy+dy < state->h &&
+		    state->layout->mines[(yy+dy)*w+(xx+dx)])
+		    v++;
 
-		    done_something = TRUE;
-		}
+	*grid_write(state, yy*w+xx) = v;
 
-	if (!done_something)
-	    break;
+	if (v == 0) {
+	    for (dx = -1; dx <= +1; dx++)
+		for (dy = -1; dy <= +1; dy++)
+		    if (xx+dx >= 0 && xx+dx < state->w &&
+			yy+dy >= 0 && yy+dy < state->h &&
+			GRID(state, (yy+dy)*w+(xx+dx)) == -2) {
+			*grid_write(state, (yy+dy)*w+(xx+dx)) = -10;
+			state->covered--;
+			queue[qtail++] = (yy+dy)*w+(xx+dx);
+		    }
+	}
     }
+    sfree(queue);
 
     /*
-     * Finally, scan the grid and see if exactly as many squares
-     * are still covered as there are mines. If so, set the `won'
-     * flag and fill in mine markers on all covered squares.
+     * Finally, see if exactly as many squares are still covered as
+     * there are mines. If so, set the `won' flag and fill in mine
+     * markers on all covered squares.
      */
-    nmines = ncovered = 0;
-    for (yy = 0; yy < h; yy++)
-	for (xx = 0; xx < w; xx++) {
-	    if (state->grid[yy*w+xx] < 0)
-		ncovered++;
-	    if (state->layout->mines[yy*w+xx])
-		nmines++;
-	}
-    assert(ncovered >= nmines);
-    if (ncovered == nmines) {
-	for (yy = 0; yy < h; yy++)
-	    for (xx = 0; xx < w; xx++) {
-		if (state->grid[yy*w+xx] < 0)
-		    state->grid[yy*w+xx] = -1;
-	}
+    assert(state->covered >= state->layout->nmines);
+    if (state->covered == state->layout->nmines) {
+	int i;
+	for (i = 0; i < w*h; i++)
+	    if (GRID(state, i) < 0 && GRID(state, i) != -1)
+		*grid_write(state, i) = -1;
 	state->won = TRUE;
     }
 
@@ -2181,13 +2281,18 @@ static game_state *new_game(midend *me, const game_params *params,
     state->used_solve = FALSE;
 
     wh = state->w * state->h;
+    state->covered = wh;
 
     state->layout = snew(struct mine_layout);
     memset(state->layout, 0, sizeof(struct mine_layout));
     state->layout->refcount = 1;
 
-    state->grid = snewn(wh, signed char);
-    memset(state->grid, -2, wh);
+    /* Every chunk starts out the same, so share one between them */
+    state->grid = snewn(GRID_NCHUNKS(state), signed char *);
+    state->grid[0] = shared_new(GRID_CHUNK);
+    memset(state->grid[0], -2, GRID_CHUNK);
+    for (i = 1; i < GRID_NCHUNKS(state); i++)
+	state->grid[i] = shared_ref(state->grid[0]);
 
     if (*desc == 'r') {
 	desc++;
@@ -2264,6 +2369,7 @@ static game_state *new_game(midend *me, const game_params *params,
 	    if (bmp[i / 8] & (0x80 >> (i % 8)))
 		state->layout->mines[i] = 1;
 	}
+	state->layout->nmines = count_mines(state->layout->mines, wh);
 
 	if (x >= 0 && y >= 0)
 	    open_square(state, x, y);
@@ -2276,6 +2382,7 @@ static game_state *new_game(midend *me, const game_params *params,
 static game_state *dup_game(const game_state *state)
 {
     game_state *ret = snew(game_state);
+    int i;
 
     ret->w = state->w;
     ret->h = state->h;
@@ -2283,22 +2390,28 @@ static game_state *dup_game(const game_state *state)
     ret->dead = state->dead;
     ret->won = state->won;
     ret->used_solve = state->used_solve;
+    ret->covered = state->covered;
     ret->layout = state->layout;
     ret->layout->refcount++;
-    ret->grid = snewn(ret->w * ret->h, signed char);
-    memcpy(ret->grid, state->grid, ret->w * ret->h);
+    ret->grid = snewn(GRID_NCHUNKS(state), signed char *);
+    for (i = 0; i < GRID_NCHUNKS(state); i++)
+	ret->grid[i] = shared_ref(state->grid[i]);
 
     return ret;
 }
 
 static void free_game(game_state *state)
 {
+    int i;
+
     if (--state->layout->refcount <= 0) {
 	sfree(state->layout->mines);
 	if (state->layout->rs)
 	    random_free(state->layout->rs);
 	sfree(state->layout);
     }
+    for (i = 0; i < GRID_NCHUNKS(state); i++)
+	shared_free(state->grid[i]);
     sfree(state->grid);
     sfree(state);
 }
@@ -2327,7 +2440,7 @@ static char *game_text_format(const game_state *state)
     ret = snewn((state->w + 1) * state->h + 1, char);
     for (y = 0; y < state->h; y++) {
 	for (x = 0; x < state->w; x++) {
-	    int v = state->grid[y*state->w+x];
+	    int v = GRID(state, y*state->w+x);
 	    if (v == 0)
 		v = '-';
 	    else if (v >= 1 && v <= 8)
@@ -2422,6 +2535,16 @@ struct game_drawstate {
      * 	  click.
      */
     int cur_x, cur_y; /* -1, -1 for no cursor displayed. */
+    /*
+     * The grid chunks of the state last drawn (we hold a reference to
+     * each, so an unchanged pointer means unchanged contents), the
+     * number of mine markers in each, and the mouse-down highlight
+     * drawn over them. A redraw need only look at squares in or next
+     * to chunks that have changed since, and under either highlight.
+     */
+    signed char **drawn;
+    int *markers;
+    int hx, hy, hradius;
 };
 
 static char *interpret_move(const game_state *from, game_ui *ui,
@@ -2443,7 +2566,7 @@ static char *interpret_move(const game_state *from, game_ui *ui,
         return "";
     }
     if (IS_CURSOR_SELECT(button)) {
-        int v = from->grid[ui->cur_y * from->w + ui->cur_x];
+        int v = GRID(from, ui->cur_y * from->w + ui->cur_x);
 
         if (!ui->cur_visible) {
             ui->cur_visible = 1;
@@ -2481,7 +2604,7 @@ static char *interpret_move(const game_state *from, game_ui *ui,
 	 */
 	ui->hx = cx;
 	ui->hy = cy;
-	ui->hradius = (from->grid[cy*from->w+cx] >= 0 ? 1 : 0);
+	ui->hradius = (GRID(from, cy*from->w+cx) >= 0 ? 1 : 0);
 	if (button == LEFT_BUTTON)
 	    ui->validradius = ui->hradius;
 	else if (button == MIDDLE_BUTTON)
@@ -2501,8 +2624,8 @@ static char *interpret_move(const game_state *from, game_ui *ui,
 	 *
 	 * FIXME: question marks.
 	 */
-	if (from->grid[cy * from->w + cx] != -2 &&
-	    from->grid[cy * from->w + cx] != -1)
+	if (GRID(from, cy * from->w + cx) != -2 &&
+	    GRID(from, cy * from->w + cx) != -1)
 	    return NULL;
 
 	sprintf(buf, "F%d,%d", cx, cy);
@@ -2526,8 +2649,8 @@ static char *interpret_move(const game_state *from, game_ui *ui,
 	 * (Unmark it and _then_ open it.)
 	 */
 	if (button == LEFT_RELEASE &&
-	    (from->grid[cy * from->w + cx] == -2 ||
-	     from->grid[cy * from->w + cx] == -3) &&
+	    (GRID(from, cy * from->w + cx) == -2 ||
+	     GRID(from, cy * from->w + cx) == -3) &&
 	    ui->validradius == 0) {
 	    /* Check if you've killed yourself. */
 	    if (from->layout->mines && from->layout->mines[cy * from->w + cx])
@@ -2548,7 +2671,7 @@ uncover:
 	 * surrounding the tile is equal to its mine count, and if
 	 * so then we open all other surrounding squares.
 	 */
-	if (from->grid[cy * from->w + cx] > 0 && ui->validradius == 1) {
+	if (GRID(from, cy * from->w + cx) > 0 && ui->validradius == 1) {
 	    int dy, dx, n;
 
 	    /* Count mine markers. */
@@ -2557,11 +2680,11 @@ uncover:
 		for (dx = -1; dx <= +1; dx++)
 		    if (cx+dx >= 0 && cx+dx < from->w &&
 			cy+dy >= 0 && cy+dy < from->h) {
-			if (from->grid[(cy+dy)*from->w+(cx+dx)] == -1)
+			if (GRID(from, (cy+dy)*from->w+(cx+dx)) == -1)
 			    n++;
 		    }
 
-	    if (n == from->grid[cy * from->w + cx]) {
+	    if (n == GRID(from, cy * from->w + cx)) {
 
 		/*
 		 * Now see if any of the squares we're clearing
@@ -2578,7 +2701,7 @@ uncover:
 		    for (dx = -1; dx <= +1; dx++)
 			if (cx+dx >= 0 && cx+dx < from->w &&
 			    cy+dy >= 0 && cy+dy < from->h) {
-			    if (from->grid[(cy+dy)*from->w+(cx+dx)] != -1 &&
+			    if (GRID(from, (cy+dy)*from->w+(cx+dx)) != -1 &&
 				from->layout->mines &&
 				from->layout->mines[(cy+dy)*from->w+(cx+dx)]) {
 				p += sprintf(p, "%sO%d,%d", sep, cx+dx, cy+dy);
@@ -2606,7 +2729,7 @@ static game_state *execute_move(const game_state *from, const char *move)
     game_state *ret;
 
     if (!strcmp(move, "S")) {
-	int yy, xx;
+	int yy, xx, i;
 
 	ret = dup_game(from);
         if (!ret->dead) {
@@ -2619,7 +2742,7 @@ static game_state *execute_move(const game_state *from, const char *move)
                 for (xx = 0; xx < ret->w; xx++) {
 
                     if (ret->layout->mines[yy*ret->w+xx]) {
-                        ret->grid[yy*ret->w+xx] = -1;
+                        *grid_write(ret, yy*ret->w+xx) = -1;
                     } else {
                         int dx, dy, v;
 
@@ -2632,7 +2755,7 @@ static game_state *execute_move(const game_state *from, const char *move)
                                     ret->layout->mines[(yy+dy)*ret->w+(xx+dx)])
                                     v++;
 
-                        ret->grid[yy*ret->w+xx] = v;
+                        *grid_write(ret, yy*ret->w+xx) = v;
                     }
                 }
         } else {
@@ -2648,16 +2771,20 @@ static game_state *execute_move(const game_state *from, const char *move)
             for (yy = 0; yy < ret->h; yy++)
                 for (xx = 0; xx < ret->w; xx++) {
                     int pos = yy*ret->w+xx;
-                    if ((ret->grid[pos] == -2 || ret->grid[pos] == -3) &&
+                    if ((GRID(ret, pos) == -2 || GRID(ret, pos) == -3) &&
                         ret->layout->mines[pos]) {
-                        ret->grid[pos] = 64;
-                    } else if (ret->grid[pos] == -1 &&
+                        *grid_write(ret, pos) = 64;
+                    } else if (GRID(ret, pos) == -1 &&
                                !ret->layout->mines[pos]) {
-                        ret->grid[pos] = 66;
+                        *grid_write(ret, pos) = 66;
                     }
                 }
         }
         ret->used_solve = TRUE;
+        ret->covered = 0;
+        for (i = 0; i < ret->h * ret->w; i++)
+            if (GRID(ret, i) < 0)
+                ret->covered++;
 
 	return ret;
     } else {
@@ -2667,7 +2794,7 @@ static game_state *execute_move(const game_state *from, const char *move)
 	    if (move[0] == 'F' &&
 		sscanf(move+1, "%d,%d", &cx, &cy) == 2 &&
 		cx >= 0 && cx < from->w && cy >= 0 && cy < from->h) {
-		ret->grid[cy * from->w + cx] ^= (-2 ^ -1);
+		*grid_write(ret, cy * from->w + cx) ^= (-2 ^ -1);
 	    } else if (move[0] == 'O' &&
 		       sscanf(move+1, "%d,%d", &cx, &cy) == 2 &&
 		       cx >= 0 && cx < from->w && cy >= 0 && cy < from->h) {
@@ -2681,8 +2808,8 @@ static game_state *execute_move(const game_state *from, const char *move)
 		    for (dx = -1; dx <= +1; dx++)
 			if (cx+dx >= 0 && cx+dx < ret->w &&
 			    cy+dy >= 0 && cy+dy < ret->h &&
-			    (ret->grid[(cy+dy)*ret->w+(cx+dx)] == -2 ||
-			     ret->grid[(cy+dy)*ret->w+(cx+dx)] == -3))
+			    (GRID(ret, (cy+dy)*ret->w+(cx+dx)) == -2 ||
+			     GRID(ret, (cy+dy)*ret->w+(cx+dx)) == -3))
 			    open_square(ret, cx+dx, cy+dy);
 	    } else {
 		free_game(ret);
@@ -2808,6 +2935,7 @@ static float *game_colours(frontend *fe, int *ncolours)
 static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
 {
     struct game_drawstate *ds = snew(struct game_drawstate);
+    int i;
 
     ds->w = state->w;
     ds->h = state->h;
@@ -2816,6 +2944,14 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
     ds->grid = snewn(ds->w * ds->h, signed char);
     ds->bg = -1;
     ds->cur_x = ds->cur_y = -1;
+    ds->drawn = snewn(GRID_NCHUNKS(state), signed char *);
+    ds->markers = snewn(GRID_NCHUNKS(state), int);
+    for (i = 0; i < GRID_NCHUNKS(state); i++) {
+        ds->drawn[i] = NULL;
+        ds->markers[i] = 0;
+    }
+    ds->hx = ds->hy = -1;
+    ds->hradius = 0;
 
     memset(ds->grid, -99, ds->w * ds->h);
 
@@ -2824,6 +2960,12 @@ static game_drawstate *game_new_drawstate(drawing *dr, const game_state *state)
 
 static void game_free_drawstate(drawing *dr, game_drawstate *ds)
 {
+    int i;
+
+    for (i = 0; i < (ds->w * ds->h + GRID_CHUNK-1) / GRID_CHUNK; i++)
+        shared_free(ds->drawn[i]);
+    sfree(ds->drawn);
+    sfree(ds->markers);
     sfree(ds->grid);
     sfree(ds);
 }
@@ -2965,14 +3107,62 @@ static void draw_tile(drawing *dr, game_drawstate *ds,
     draw_update(dr, x, y, TILE_SIZE, TILE_SIZE);
 }
 
+static void mines_redraw_square(drawing *dr, game_drawstate *ds,
+                                const game_state *state, const game_ui *ui,
+                                int x, int y, int cx, int cy, int cmoved,
+                                int bg)
+{
+    int v, cc = 0;
+
+    if (x < 0 || x >= ds->w || y < 0 || y >= ds->h)
+        return;
+
+    v = GRID(state, y*ds->w+x);
+
+    if (v >= 0 && v <= 8) {
+        /*
+         * Count up the flags around this tile, and if
+         * there are too _many_, highlight the tile.
+         */
+        int dx, dy, flags = 0;
+
+        for (dy = -1; dy <= +1; dy++)
+            for (dx = -1; dx <= +1; dx++) {
+                int nx = x+dx, ny = y+dy;
+                if (nx >= 0 && nx < ds->w &&
+                    ny >= 0 && ny < ds->h &&
+                    GRID(state, ny*ds->w+nx) == -1)
+                    flags++;
+            }
+
+        if (flags > v)
+            v |= 32;
+    }
+
+    if ((v == -2 || v == -3) &&
+        (abs(x-ui->hx) <= ui->hradius && abs(y-ui->hy) <= ui->hradius))
+        v -= 20;
+
+    if (cmoved && /* if cursor has moved, force redraw of curr and prev pos */
+        ((x == cx && y == cy) || (x == ds->cur_x && y == ds->cur_y)))
+        cc = 1;
+
+    if (ds->grid[y*ds->w+x] != v || bg != ds->bg || cc) {
+        draw_tile(dr, ds, COORD(x), COORD(y), v,
+                  (x == cx && y == cy) ? COL_CURSOR : bg);
+        ds->grid[y*ds->w+x] = v;
+    }
+}
+
 static void game_redraw(drawing *dr, game_drawstate *ds,
                         const game_state *oldstate, const game_state *state,
                         int dir, const game_ui *ui,
                         float animtime, float flashtime)
 {
-    int x, y;
+    int x, y, c, i, nchunks, lo, hi, wh = ds->w * ds->h;
     int mines, markers, bg;
     int cx = -1, cy = -1, cmoved;
+    int restart = !ds->started;
 
     if (flashtime) {
 	int frame = (int)(flashtime / FLASH_FRAME);
@@ -3020,55 +3210,65 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
     cmoved = (cx != ds->cur_x || cy != ds->cur_y);
 
     /*
-     * Now draw the tiles. Also in this loop, count up the number
-     * of mines and mine markers.
+     * Now draw the tiles. A square's tile depends on it and its
+     * neighbours, so look at every square within a row and a column
+     * of a chunk that has changed since the last redraw (all of them,
+     * the first time and when the background changes), plus those
+     * under the old and new highlights and cursor positions. Also
+     * count up the mine markers in the changed chunks.
      */
-    mines = markers = 0;
-    for (y = 0; y < ds->h; y++)
-	for (x = 0; x < ds->w; x++) {
-	    int v = state->grid[y*ds->w+x], cc = 0;
-
-	    if (v == -1)
-		markers++;
-	    if (state->layout->mines && state->layout->mines[y*ds->w+x])
-		mines++;
-
-            if (v >= 0 && v <= 8) {
-                /*
-                 * Count up the flags around this tile, and if
-                 * there are too _many_, highlight the tile.
-                 */
-                int dx, dy, flags = 0;
-
-                for (dy = -1; dy <= +1; dy++)
-                    for (dx = -1; dx <= +1; dx++) {
-                        int nx = x+dx, ny = y+dy;
-                        if (nx >= 0 && nx < ds->w &&
-                            ny >= 0 && ny < ds->h &&
-                            state->grid[ny*ds->w+nx] == -1)
-                            flags++;
-                    }
-
-                if (flags > v)
-                    v |= 32;
-            }
-
-	    if ((v == -2 || v == -3) &&
-		(abs(x-ui->hx) <= ui->hradius && abs(y-ui->hy) <= ui->hradius))
-		v -= 20;
+    nchunks = GRID_NCHUNKS(state);
+    lo = hi = 0;
+    for (c = 0; c < nchunks; c++) {
+        int clo, chi;
+
+        if (ds->drawn[c] == state->grid[c] && bg == ds->bg && !restart)
+            continue;
+
+        ds->markers[c] = 0;
+        for (i = c * GRID_CHUNK; i < min((c+1) * GRID_CHUNK, wh); i++)
+            if (GRID(state, i) == -1)
+                ds->markers[c]++;
+
+        clo = max(c * GRID_CHUNK - ds->w - 1, 0);
+        chi = min((c+1) * GRID_CHUNK + ds->w + 1, wh);
+        if (clo > hi) {
+            for (i = lo; i < hi; i++)
+                mines_redraw_square(dr, ds, state, ui, i % ds->w, i / ds->w,
+                                    cx, cy, cmoved, bg);
+            lo = clo;
+        }
+        hi = chi;
 
-            if (cmoved && /* if cursor has moved, force redraw of curr and prev pos */
-                ((x == cx && y == cy) || (x == ds->cur_x && y == ds->cur_y)))
-              cc = 1;
+        shared_free(ds->drawn[c]);
+        ds->drawn[c] = shared_ref(state->grid[c]);
+    }
+    for (i = lo; i < hi; i++)
+        mines_redraw_square(dr, ds, state, ui, i % ds->w, i / ds->w,
+                            cx, cy, cmoved, bg);
+
+    for (y = -ds->hradius; y <= ds->hradius; y++)
+        for (x = -ds->hradius; x <= ds->hradius; x++)
+            mines_redraw_square(dr, ds, state, ui, ds->hx + x, ds->hy + y,
+                                cx, cy, cmoved, bg);
+    for (y = -ui->hradius; y <= ui->hradius; y++)
+        for (x = -ui->hradius; x <= ui->hradius; x++)
+            mines_redraw_square(dr, ds, state, ui, ui->hx + x, ui->hy + y,
+                                cx, cy, cmoved, bg);
+    if (cmoved) {
+        mines_redraw_square(dr, ds, state, ui, ds->cur_x, ds->cur_y,
+                            cx, cy, cmoved, bg);
+        mines_redraw_square(dr, ds, state, ui, cx, cy, cx, cy, cmoved, bg);
+    }
 
-	    if (ds->grid[y*ds->w+x] != v || bg != ds->bg || cc) {
-		draw_tile(dr, ds, COORD(x), COORD(y), v,
-                          (x == cx && y == cy) ? COL_CURSOR : bg);
-		ds->grid[y*ds->w+x] = v;
-	    }
-	}
     ds->bg = bg;
     ds->cur_x = cx; ds->cur_y = cy;
+    ds->hx = ui->hx; ds->hy = ui->hy; ds->hradius = ui->hradius;
+
+    markers = 0;
+    for (c = 0; c < nchunks; c++)
+        markers += ds->markers[c];
+    mines = state->layout->nmines;
 
     if (!state->layout->mines)
 	mines = state->layout->n;
@@ -3193,6 +3393,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     TRUE, game_timing_state,
     BUTTON_BEATS(LEFT_BUTTON, RIGHT_BUTTON) | REQUIRE_RBUTTON,
+    16,				       /* undo_keyframe_interval */
 };
 
 #ifdef STANDALONE_OBFUSCATOR
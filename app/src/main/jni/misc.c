@@ -361,4 +361,61 @@ void draw_text_outline(drawing *dr, int x, int y, int fonttype,
     draw_text(dr, x, y, fonttype, fontsize, align, text_colour, text);
 }
 
+/*
+ * The refcount and size sit in a header before the block, padded so
+ * that the block is as aligned as anything snewn returns.
+ */
+union shared_header {
+    struct {
+        int refcount, size;
+    } h;
+    double d;
+    void *p;
+    long l;
+};
+#define SHARED_HEADER(p) ((union shared_header *)(p) - 1)
+
+void *shared_new(int size)
+{
+    union shared_header *hdr = smalloc(sizeof(*hdr) + max(size, 1));
+    hdr->h.refcount = 1;
+    hdr->h.size = size;
+    return hdr + 1;
+}
+
+void *shared_dup(const void *data, int size)
+{
+    void *ret = shared_new(size);
+    memcpy(ret, data, size);
+    return ret;
+}
+
+void *shared_ref(void *p)
+{
+    SHARED_HEADER(p)->h.refcount++;
+    return p;
+}
+
+void shared_free(void *p)
+{
+    union shared_header *hdr;
+    if (!p)
+        return;
+    hdr = SHARED_HEADER(p);
+    assert(hdr->h.refcount > 0);
+    if (--hdr->h.refcount == 0)
+        sfree(hdr);
+}
+
+void *shared_unshare(void *p)
+{
+    union shared_header *hdr = SHARED_HEADER(p);
+    void *ret;
+    if (hdr->h.refcount == 1)
+        return p;
+    ret = shared_dup(p, hdr->h.size);
+    hdr->h.refcount--;
+    return ret;
+}
+
 /* vim: set shiftwidth=4 tabstop=8: */
@@ -100,8 +100,16 @@ struct game_state {
     int width, height, wrapping, completed;
     int last_rotate_x, last_rotate_y, last_rotate_dir;
     int used_solve;
+    /*
+     * Arms that don't meet an arm of the tile they point at, kept up
+     * to date by update_status. If the tiles have just enough arms
+     * between them for a spanning tree (as any generated game does),
+     * a complete board has none, so until then there's no need to
+     * check connectivity.
+     */
+    int dangling, spanning;
     unsigned char *tiles;
-    unsigned char *barriers;
+    unsigned char *barriers;		/* shared (see shared_new) */
 };
 
 #define OFFSETWH(x2,y2,x1,y1,dir,width,height) \
@@ -179,6 +187,7 @@ static const struct game_params net_presets[] = {
 #ifndef SMALL_SCREEN
     {13, 11, TRUE, TRUE, 0.0},
 #endif
+    {25, 25, TRUE, TRUE, 0.0},
 };
 
 static int game_fetch_preset(int i, char **name, game_params **params)
@@ -452,28 +461,69 @@ static int todo_get(struct todo *todo) {
     return ret;
 }
 
+/*
+ * When two classes of connected tiles are merged, any tile with an
+ * edge of unknown state leading into the merged class may have just
+ * lost an orientation to loop avoidance. Every such tile borders the
+ * smaller of the two old classes, so we walk that one's member list
+ * and put the far side of each unknown edge back on the to-do list.
+ * Walking the smaller class each time bounds the total work over the
+ * whole solve at O(n log n). Then we splice the two circular member
+ * lists together and do the merge itself.
+ */
+static void net_solver_merge(int w, int h, int *equivalence, int *classnext,
+			     unsigned char *edgestate, struct todo *todo,
+			     int i1, int i2)
+{
+    int c1 = dsf_canonify(equivalence, i1);
+    int c2 = dsf_canonify(equivalence, i2);
+    int i, t;
+
+    if (c1 == c2)
+	return;
+
+    if (dsf_size(equivalence, c1) > dsf_size(equivalence, c2))
+	c1 = c2;
+
+    i = c1;
+    do {
+	int d, x = i % w, y = i / w;
+	for (d = 1; d <= 8; d += d)
+	    if (edgestate[i * 5 + d] == 0) {
+		int x2, y2;
+		OFFSETWH(x2, y2, x, y, d, w, h);
+		todo_add(todo, y2*w+x2);
+	    }
+	i = classnext[i];
+    } while (i != c1);
+
+    t = classnext[i1];
+    classnext[i1] = classnext[i2];
+    classnext[i2] = t;
+    dsf_merge(equivalence, i1, i2);
+}
+
 static int net_solver(int w, int h, unsigned char *tiles,
 		      unsigned char *barriers, int wrapping)
 {
     unsigned char *tilestate;
     unsigned char *edgestate;
     int *deadends;
-    int *equivalence;
+    int *equivalence, *classnext;
     struct todo *todo;
     int i, j, x, y;
     int area;
-    int done_something;
 
     /*
      * Set up the solver's data structures.
      */
     
     /*
-     * tilestate stores the possible orientations of each tile.
-     * There are up to four of these, so we'll index the array in
-     * fours. tilestate[(y * w + x) * 4] and its three successive
-     * members give the possible orientations, clearing to 255 from
-     * the end as things are ruled out.
+     * tilestate stores the possible orientations of each tile, as
+     * a 4-bit mask: bit r is set if rotating the tile anticlockwise
+     * r times is still a candidate. A tile with rotational symmetry
+     * starts with only its distinct orientations set, so that a
+     * straight has two candidates and a blank or a cross has one.
      * 
      * In this loop we also count up the area of the grid (which is
      * not _necessarily_ equal to w*h, because there might be one
@@ -481,17 +531,11 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * grid generated _by_ this program, but it's worth keeping the
      * solver as general as possible.)
      */
-    tilestate = snewn(w * h * 4, unsigned char);
+    tilestate = snewn(w * h, unsigned char);
     area = 0;
     for (i = 0; i < w*h; i++) {
-	tilestate[i * 4] = tiles[i] & 0xF;
-	for (j = 1; j < 4; j++) {
-	    if (tilestate[i * 4 + j - 1] == 255 ||
-		A(tilestate[i * 4 + j - 1]) == tilestate[i * 4])
-		tilestate[i * 4 + j] = 255;
-	    else
-		tilestate[i * 4 + j] = A(tilestate[i * 4 + j - 1]);
-	}
+	int val = tiles[i] & 0xF;
+	tilestate[i] = A(val) == val ? 1 : F(val) == val ? 3 : 0xF;
 	if (tiles[i] != 0)
 	    area++;
     }
@@ -542,8 +586,15 @@ static int net_solver(int w, int h, unsigned char *tiles,
      * they're the same; and you create new equivalence (merge
      * classes) by finding the representative of each tile and
      * setting equivalence[one]=the_other.
+     *
+     * Alongside it, classnext threads each class into a circular
+     * list of its members, so that net_solver_merge can find the
+     * tiles a merge affects.
      */
     equivalence = snew_dsf(w * h);
+    classnext = snewn(w * h, int);
+    for (i = 0; i < w*h; i++)
+	classnext[i] = i;
 
     /*
      * On a non-wrapping grid, we instantly know that all the edges
@@ -583,19 +634,23 @@ static int net_solver(int w, int h, unsigned char *tiles,
     }
 
     /*
-     * Since most deductions made by this solver are local (the
-     * exception is loop avoidance, where joining two tiles
-     * together on one side of the grid can theoretically permit a
-     * fresh deduction on the other), we can address the scaling
-     * problem inherent in iterating repeatedly over the entire
-     * grid by instead working with a to-do list.
+     * Every deduction this solver makes depends only on a tile's
+     * own edges, the dead-end markers on them, and the classes of
+     * its neighbours. So whenever one of those changes we put the
+     * affected tile on a to-do list, and once the list runs dry
+     * there is nothing left to deduce anywhere. Loop avoidance is
+     * the one long-range effect - joining two tiles on one side of
+     * the grid can permit a fresh deduction on the other - and
+     * net_solver_merge takes care of queueing the tiles it reaches.
+     * So the whole grid only needs scanning once, at the start.
      */
     todo = todo_new(w * h);
+    for (i = 0; i < w*h; i++)
+	todo_add(todo, i);
 
     /*
      * Main deductive loop.
      */
-    done_something = TRUE;	       /* prevent instant termination! */
     while (1) {
 	int index;
 
@@ -603,39 +658,36 @@ static int net_solver(int w, int h, unsigned char *tiles,
 	 * Take a tile index off the todo list and process it.
 	 */
 	index = todo_get(todo);
-	if (index == -1) {
-	    /*
-	     * If we have run out of immediate things to do, we
-	     * have no choice but to scan the whole grid for
-	     * longer-range things we've missed. Hence, I now add
-	     * every square on the grid back on to the to-do list.
-	     * I also set `done_something' to FALSE at this point;
-	     * if we later come back here and find it still FALSE,
-	     * we will know we've scanned the entire grid without
-	     * finding anything new to do, and we can terminate.
-	     */
-	    if (!done_something)
-		break;
-	    for (i = 0; i < w*h; i++)
-		todo_add(todo, i);
-	    done_something = FALSE;
-
-	    index = todo_get(todo);
-	}
+	if (index == -1)
+	    break;
 
 	y = index / w;
 	x = index % w;
 	{
-	    int d, ourclass = dsf_canonify(equivalence, y*w+x);
-	    int deadendmax[9];
+	    int d, r, val, ourclass = dsf_canonify(equivalence, y*w+x);
+	    int deadendmax[9], nbclass[9];
+	    int oldstate = tilestate[y*w+x];
 
 	    deadendmax[1] = deadendmax[2] = deadendmax[4] = deadendmax[8] = 0;
 
-	    for (i = j = 0; i < 4 && tilestate[(y*w+x) * 4 + i] != 255; i++) {
+	    /*
+	     * Look up the class at the far end of each unknown edge
+	     * just once, rather than once per orientation.
+	     */
+	    for (d = 1; d <= 8; d += d)
+		if (edgestate[(y*w+x) * 5 + d] == 0) {
+		    int x2, y2;
+		    OFFSETWH(x2, y2, x, y, d, w, h);
+		    nbclass[d] = dsf_canonify(equivalence, y2*w+x2);
+		}
+
+	    for (r = 0, val = tiles[y*w+x] & 0xF; r < 4; r++, val = A(val)) {
 		int valid;
 		int nnondeadends, nondeadends[4], deadendtotal;
 		int nequiv, equiv[5];
-		int val = tilestate[(y*w+x) * 4 + i];
+
+		if (!(tilestate[y*w+x] & (1 << r)))
+		    continue;
 
 		valid = TRUE;
 		nnondeadends = deadendtotal = 0;
@@ -666,10 +718,8 @@ static int net_solver(int w, int h, unsigned char *tiles,
 			 * open, which create a loop.
 			 */
 			if (edgestate[(y*w+x) * 5 + d] == 0) {
-			    int c, k, x2, y2;
-			    
-			    OFFSETWH(x2, y2, x, y, d, w, h);
-			    c = dsf_canonify(equivalence, y2*w+x2);
+			    int c = nbclass[d], k;
+
 			    for (k = 0; k < nequiv; k++)
 				if (c == equiv[k])
 				    break;
@@ -681,20 +731,35 @@ static int net_solver(int w, int h, unsigned char *tiles,
 		    }
 		}
 
-		if (nnondeadends == 0) {
-		    /*
-		     * If this orientation links together dead-ends
-		     * with a total area of less than the entire
-		     * grid, it is invalid.
-		     *
-		     * (We add 1 to deadendtotal because of the
-		     * tile itself, of course; one tile linking
-		     * dead ends of size 2 and 3 forms a subnetwork
-		     * with a total area of 6, not 5.)
-		     */
-		    if (deadendtotal > 0 && deadendtotal+1 < area)
-			valid = FALSE;
-		} else if (nnondeadends == 1) {
+		/*
+		 * If this orientation links together dead-ends
+		 * with a total area of less than the entire grid,
+		 * it is invalid.
+		 *
+		 * (We add 1 to deadendtotal because of the tile
+		 * itself, of course; one tile linking dead ends of
+		 * size 2 and 3 forms a subnetwork with a total area
+		 * of 6, not 5.)
+		 */
+		if (nnondeadends == 0 && deadendtotal > 0 &&
+		    deadendtotal+1 < area)
+		    valid = FALSE;
+
+		if (!valid) {
+#ifdef SOLVER_DIAGNOSTICS
+		    printf("ruling out orientation %x at %d,%d\n", val, x, y);
+#endif
+		    tilestate[y*w+x] &= ~(1 << r);
+		    continue;
+		}
+
+		/*
+		 * Only orientations we are keeping contribute to
+		 * the dead-end markers, since the tile will not be
+		 * looked at again unless one of its surroundings
+		 * changes.
+		 */
+		if (nnondeadends == 1) {
 		    /*
 		     * If this orientation links together one or
 		     * more dead-ends with precisely one
@@ -706,7 +771,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
 		    deadendtotal++;
 		    if (deadendmax[nondeadends[0]] < deadendtotal)
 			deadendmax[nondeadends[0]] = deadendtotal;
-		} else {
+		} else if (nnondeadends > 1) {
 		    /*
 		     * If this orientation links together two or
 		     * more non-dead-ends, then we can rule out the
@@ -717,40 +782,30 @@ static int net_solver(int w, int h, unsigned char *tiles,
 		    for (k = 0; k < nnondeadends; k++)
 			deadendmax[nondeadends[k]] = area+1;
 		}
-
-		if (valid)
-		    tilestate[(y*w+x) * 4 + j++] = val;
-#ifdef SOLVER_DIAGNOSTICS
-		else
-		    printf("ruling out orientation %x at %d,%d\n", val, x, y);
-#endif
 	    }
 
-	    assert(j > 0);	       /* we can't lose _all_ possibilities! */
-
-	    if (j < i) {
-		done_something = TRUE;
-
-		/*
-		 * We have ruled out at least one tile orientation.
-		 * Make sure the rest are blanked.
-		 */
-		while (j < 4)
-		    tilestate[(y*w+x) * 4 + j++] = 255;
-	    }
+	    /* we can't lose _all_ possibilities! */
+	    assert(tilestate[y*w+x] != 0);
 
 	    /*
 	     * Now go through the tile orientations again and see
-	     * if we've deduced anything new about any edges.
+	     * if we've deduced anything new about any edges. Edges
+	     * already known can't change, so we needn't bother if
+	     * the set of orientations is the same as before.
 	     */
-	    {
+	    if (tilestate[y*w+x] != oldstate ||
+		edgestate[(y*w+x) * 5 + 1] == 0 ||
+		edgestate[(y*w+x) * 5 + 2] == 0 ||
+		edgestate[(y*w+x) * 5 + 4] == 0 ||
+		edgestate[(y*w+x) * 5 + 8] == 0) {
 		int a, o;
 		a = 0xF; o = 0;
 
-		for (i = 0; i < 4 && tilestate[(y*w+x) * 4 + i] != 255; i++) {
-		    a &= tilestate[(y*w+x) * 4 + i];
-		    o |= tilestate[(y*w+x) * 4 + i];
-		}
+		for (r = 0, val = tiles[y*w+x] & 0xF; r < 4; r++, val = A(val))
+		    if (tilestate[y*w+x] & (1 << r)) {
+			a &= val;
+			o |= val;
+		    }
 		for (d = 1; d <= 8; d += d)
 		    if (edgestate[(y*w+x) * 5 + d] == 0) {
 			int x2, y2, d2;
@@ -763,8 +818,9 @@ static int net_solver(int w, int h, unsigned char *tiles,
 #endif
 			    edgestate[(y*w+x) * 5 + d] = 1;
 			    edgestate[(y2*w+x2) * 5 + d2] = 1;
-			    dsf_merge(equivalence, y*w+x, y2*w+x2);
-			    done_something = TRUE;
+			    net_solver_merge(w, h, equivalence, classnext,
+					     edgestate, todo,
+					     y*w+x, y2*w+x2);
 			    todo_add(todo, y2*w+x2);
 			} else if (!(o & d)) {
 			    /* This edge is closed in all orientations. */
@@ -773,7 +829,6 @@ static int net_solver(int w, int h, unsigned char *tiles,
 #endif
 			    edgestate[(y*w+x) * 5 + d] = 2;
 			    edgestate[(y2*w+x2) * 5 + d2] = 2;
-			    done_something = TRUE;
 			    todo_add(todo, y2*w+x2);
 			}
 		    }
@@ -795,7 +850,6 @@ static int net_solver(int w, int h, unsigned char *tiles,
 			   x2, y2, d2, deadendmax[d]);
 #endif
 		    deadends[(y2*w+x2) * 5 + d2] = deadendmax[d];
-		    done_something = TRUE;
 		    todo_add(todo, y2*w+x2);
 		}
 	    }
@@ -808,9 +862,15 @@ static int net_solver(int w, int h, unsigned char *tiles,
      */
     j = TRUE;
     for (i = 0; i < w*h; i++) {
-	if (tilestate[i * 4 + 1] == 255) {
-	    assert(tilestate[i * 4 + 0] != 255);
-	    tiles[i] = tilestate[i * 4] | LOCKED;
+	int s = tilestate[i];
+	assert(s != 0);
+	if (!(s & (s-1))) {
+	    int val = tiles[i] & 0xF;
+	    while (!(s & 1)) {
+		val = A(val);
+		s >>= 1;
+	    }
+	    tiles[i] = val | LOCKED;
 	} else {
 	    tiles[i] &= ~LOCKED;
 	    j = FALSE;
@@ -825,6 +885,7 @@ static int net_solver(int w, int h, unsigned char *tiles,
     sfree(edgestate);
     sfree(deadends);
     sfree(equivalence);
+    sfree(classnext);
 
     return j;
 }
@@ -1581,6 +1642,44 @@ static void android_request_keys(const game_params *params)
  * Construct an initial game state, given a description and parameters.
  */
 
+/*
+ * The arms of one tile that don't meet an arm of the tile they point
+ * at, or that point into a barrier.
+ */
+static int dangling_arms(const game_state *state, int x, int y)
+{
+    int d, x2, y2, n = 0;
+
+    for (d = 1; d < 0x10; d <<= 1) {
+	if (!(tile(state, x, y) & d))
+	    continue;
+	OFFSET(x2, y2, x, y, d, state);
+	if ((barrier(state, x, y) & d) || !(tile(state, x2, y2) & F(d)))
+	    n++;
+    }
+    return n;
+}
+
+/*
+ * Set up `dangling' and `spanning' from scratch. A connected board
+ * of n non-empty tiles has at least n-1 links, using 2(n-1) arms; if
+ * that's all there are, none can be left dangling.
+ */
+static void count_dangling(game_state *state)
+{
+    int x, y, arms = 0, tiles = 0;
+
+    state->dangling = 0;
+    for (y = 0; y < state->height; y++)
+	for (x = 0; x < state->width; x++) {
+	    if (tile(state, x, y) & 0xF)
+		tiles++;
+	    arms += COUNT(tile(state, x, y));
+	    state->dangling += dangling_arms(state, x, y);
+	}
+    state->spanning = (arms == 2 * (tiles - 1));
+}
+
 static game_state *new_game(midend *me, const game_params *params,
                             const char *desc)
 {
@@ -1599,9 +1698,10 @@ static game_state *new_game(midend *me, const game_params *params,
     state->wrapping = params->wrapping;
     state->last_rotate_dir = state->last_rotate_x = state->last_rotate_y = 0;
     state->completed = state->used_solve = FALSE;
+    state->dangling = state->spanning = 0;
     state->tiles = snewn(state->width * state->height, unsigned char);
     memset(state->tiles, 0, state->width * state->height);
-    state->barriers = snewn(state->width * state->height, unsigned char);
+    state->barriers = shared_new(state->width * state->height);
     memset(state->barriers, 0, state->width * state->height);
 
     /*
@@ -1665,6 +1765,8 @@ static game_state *new_game(midend *me, const game_params *params,
                 state->wrapping = TRUE;
     }
 
+    count_dangling(state);
+
     return state;
 }
 
@@ -1678,13 +1780,14 @@ static game_state *dup_game(const game_state *state)
     ret->wrapping = state->wrapping;
     ret->completed = state->completed;
     ret->used_solve = state->used_solve;
+    ret->dangling = state->dangling;
+    ret->spanning = state->spanning;
     ret->last_rotate_dir = state->last_rotate_dir;
     ret->last_rotate_x = state->last_rotate_x;
     ret->last_rotate_y = state->last_rotate_y;
     ret->tiles = snewn(state->width * state->height, unsigned char);
     memcpy(ret->tiles, state->tiles, state->width * state->height);
-    ret->barriers = snewn(state->width * state->height, unsigned char);
-    memcpy(ret->barriers, state->barriers, state->width * state->height);
+    ret->barriers = shared_ref(state->barriers);
 
     return ret;
 }
@@ -1692,7 +1795,7 @@ static game_state *dup_game(const game_state *state)
 static void free_game(game_state *state)
 {
     sfree(state->tiles);
-    sfree(state->barriers);
+    shared_free(state->barriers);
     sfree(state);
 }
 
@@ -2267,36 +2370,78 @@ static game_state *execute_move(const game_state *from, const char *move)
 	ret->last_rotate_y = ty;
     }
 
+    /* Completion is checked by update_status, which the midend calls next */
+
+    return ret;
+}
+
+/*
+ * Check whether the game has been completed.
+ *
+ * For this purpose it doesn't matter where the source square is,
+ * because we can start from anywhere and correctly determine whether
+ * the game is completed.
+ */
+static int check_completion(const game_state *state)
+{
+    unsigned char *active = compute_active(state, 0, 0);
+    int x1, y1;
+    int complete = TRUE;
+
+    for (x1 = 0; x1 < state->width; x1++)
+	for (y1 = 0; y1 < state->height; y1++)
+	    if ((tile(state, x1, y1) & 0xF) && !index(state, active, x1, y1)) {
+		complete = FALSE;
+		goto break_label;  /* break out of two loops at once */
+	    }
+    break_label:
+
+    sfree(active);
+    return complete;
+}
+
+static void update_status(const game_state *oldstate, game_state *newstate,
+                          const char *move)
+{
+    int tx, ty, n;
+
+    if (newstate->completed)
+	return;
+
     /*
-     * Check whether the game has been completed.
-     * 
-     * For this purpose it doesn't matter where the source square
-     * is, because we can start from anywhere and correctly
-     * determine whether the game is completed.
+     * A single rotation only changes the dangling arms of that tile
+     * and its neighbours; anything else (solve, jumble) is counted
+     * again from scratch. Locking changes nothing.
      */
-    {
-	unsigned char *active = compute_active(ret, 0, 0);
-	int x1, y1;
-	int complete = TRUE;
-
-	for (x1 = 0; x1 < ret->width; x1++)
-	    for (y1 = 0; y1 < ret->height; y1++)
-		if ((tile(ret, x1, y1) & 0xF) && !index(ret, active, x1, y1)) {
-		    complete = FALSE;
-		    goto break_label;  /* break out of two loops at once */
-		}
-	break_label:
-
-	sfree(active);
+    if ((move[0] == 'A' || move[0] == 'C' || move[0] == 'F') &&
+	sscanf(move+1, "%d,%d%n", &tx, &ty, &n) >= 2 && !move[1+n]) {
+	int xs[5], ys[5], i, j, k = 0, d;
 
-	if (complete)
-	    ret->completed = TRUE;
+	xs[k] = tx;
+	ys[k++] = ty;
+	for (d = 1; d < 0x10; d <<= 1) {
+	    int x2, y2;
+	    OFFSET(x2, y2, tx, ty, d, newstate);
+	    /* on narrow wrapping boards, neighbours can coincide */
+	    for (j = 0; j < k; j++)
+		if (xs[j] == x2 && ys[j] == y2)
+		    break;
+	    if (j == k) {
+		xs[k] = x2;
+		ys[k++] = y2;
+	    }
+	}
+	for (i = 0; i < k; i++)
+	    newstate->dangling += dangling_arms(newstate, xs[i], ys[i]) -
+		dangling_arms(oldstate, xs[i], ys[i]);
+    } else if (move[0] != 'L') {
+	count_dangling(newstate);
     }
 
-    return ret;
+    if (newstate->dangling == 0 || !newstate->spanning)
+	newstate->completed = check_completion(newstate);
 }
 
-
 /* ----------------------------------------------------------------------
  * Routines for drawing the game position on the screen.
  */
@@ -3078,4 +3223,7 @@ const struct game thegame = {
     TRUE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     0,				       /* flags */
+    0,				       /* undo_keyframe_interval */
+    NULL, NULL,			       /* encode_state, decode_state */
+    update_status,
 };
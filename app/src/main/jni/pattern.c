@@ -49,7 +49,7 @@ struct game_state {
     int w, h;
     unsigned char *grid;
     int rowsize;
-    int *rowdata, *rowlen;
+    int *rowdata, *rowlen;             /* the clues; shared (see shared_new) */
     int completed, cheated;
 };
 
@@ -71,6 +71,7 @@ static const struct game_params pattern_presets[] = {
 #ifndef SLOW_SYSTEM
     {25, 25},
     {30, 30},
+    {40, 40},
 #endif
 };
 
@@ -219,16 +220,36 @@ static char *validate_params(const game_params *params, int full)
  * it's useful to anyone.)
  */
 
-static int float_compare(const void *av, const void *bv)
+/*
+ * Find the value that would be at index k if the array were sorted,
+ * scrambling the array in the process. Generation only wants the
+ * median, so this saves sorting the whole grid on every attempt.
+ */
+static float float_select(float *a, int n, int k)
 {
-    const float *a = (const float *)av;
-    const float *b = (const float *)bv;
-    if (*a < *b)
-        return -1;
-    else if (*a > *b)
-        return +1;
-    else
-        return 0;
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        float pivot = a[lo + (hi - lo) / 2], tmp;
+        int i = lo, j = hi;
+
+        while (i <= j) {
+            while (a[i] < pivot) i++;
+            while (a[j] > pivot) j--;
+            if (i <= j) {
+                tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            break;
+    }
+    return a[k];
 }
 
 static void generate(random_state *rs, int w, int h, unsigned char *retgrid)
@@ -299,8 +320,7 @@ static void generate(random_state *rs, int w, int h, unsigned char *retgrid)
 
     fgrid2 = snewn(w*h, float);
     memcpy(fgrid2, fgrid, w*h*sizeof(float));
-    qsort(fgrid2, w*h, sizeof(float), float_compare);
-    threshold = fgrid2[w*h/2];
+    threshold = float_select(fgrid2, w*h, w*h/2);
     sfree(fgrid2);
 
     for (i = 0; i < h; i++) {
@@ -406,6 +426,125 @@ static int do_recurse(unsigned char *known, unsigned char *deduced,
     }
 }
 
+/*
+ * The same deductions for lines short enough that every position in
+ * them, from 0 up to and including len, fits in a bit of a linemask.
+ * Rather than trying each layout in turn, this works out with a few
+ * shifts per block which layouts can exist at all:
+ *
+ *  - fwd[j] has a bit for each position p such that the first j
+ *    blocks, each followed by its separating dot if it isn't at the
+ *    end of the line, fit in the squares before p;
+ *
+ *  - back[j] likewise has a bit for each p such that the blocks
+ *    from j on fit in the squares from p to the end.
+ *
+ * A block j can start at s in some complete layout exactly when s is
+ * in fwd[j] and the square after the block leads into back[j+1], and
+ * a square can be a dot in a complete layout when it separates such
+ * a block from the next, or lies between a position in fwd[j] and
+ * one in back[j] for some j. That covers every layout the recursion
+ * above would find, so both give the same answer; this one just gets
+ * there much faster.
+ */
+typedef unsigned long long linemask;
+#define LINEMASK_BITS ((int)(sizeof(linemask) * 8))
+
+/*
+ * Starting from the positions in g, step forwards (upwards) into
+ * each position whose bit is set in p, as often as possible.
+ */
+static linemask linemask_fill_up(linemask g, linemask p)
+{
+    int shift;
+
+    for (shift = 1; shift < LINEMASK_BITS; shift *= 2) {
+	g |= p & (g << shift);
+	p &= p << shift;
+    }
+    return g;
+}
+
+/* The same, stepping backwards. */
+static linemask linemask_fill_down(linemask g, linemask p)
+{
+    int shift;
+
+    for (shift = 1; shift < LINEMASK_BITS; shift *= 2) {
+	g |= p & (g >> shift);
+	p &= p >> shift;
+    }
+    return g;
+}
+
+static void do_row_bits(const unsigned char *known, unsigned char *deduced,
+			int len, const int *data)
+{
+    linemask fwd[LINEMASK_BITS/2 + 1], back[LINEMASK_BITS/2 + 1];
+    linemask starts[LINEMASK_BITS/2];
+    linemask cells, end, notblock, notdot, canblock, candot;
+    int i, j, t, nblocks, total;
+
+    cells = ((linemask)1 << len) - 1;
+    end = (linemask)1 << len;
+    notblock = notdot = cells;
+    for (i = 0; i < len; i++) {
+	deduced[i] = 0;
+	if (known[i] == BLOCK)
+	    notblock &= ~((linemask)1 << i);
+	else if (known[i] == DOT)
+	    notdot &= ~((linemask)1 << i);
+    }
+
+    /*
+     * If the clue can't fit at all, neither can any layout.
+     */
+    for (nblocks = total = 0; data[nblocks]; nblocks++)
+	total += data[nblocks] + (nblocks > 0);
+    if (total > len)
+	return;
+
+    /*
+     * Work out where each block could start, looking only at the
+     * squares it covers and the one after it.
+     */
+    for (j = 0; j < nblocks; j++) {
+	linemask m = notdot;
+	for (t = 1; t < data[j]; t++)
+	    m &= notdot >> t;
+	starts[j] = m & ((notblock | end) >> data[j]);
+    }
+
+    fwd[0] = linemask_fill_up(1, notblock << 1);
+    for (j = 0; j < nblocks; j++) {
+	linemask s = fwd[j] & starts[j], last = end >> data[j];
+	linemask next = ((s & ~last) << data[j] << 1) | ((s & last) ? end : 0);
+	fwd[j+1] = linemask_fill_up(next, notblock << 1);
+    }
+    if (!(fwd[nblocks] & end))
+	return;
+
+    canblock = candot = 0;
+    back[nblocks] = linemask_fill_down(end, notblock);
+    for (j = nblocks; j-- > 0 ;) {
+	linemask s, last = end >> data[j];
+
+	s = starts[j] & ((back[j+1] >> data[j] >> 1) |
+			 ((back[j+1] & end) ? last : 0));
+	back[j] = linemask_fill_down(s, notblock);
+
+	s &= fwd[j];
+	for (t = 0; t < data[j]; t++)
+	    canblock |= s << t;
+	candot |= (s << data[j]) & cells;
+    }
+    for (j = 0; j <= nblocks; j++)
+	candot |= fwd[j] & (back[j] >> 1) & notblock;
+
+    for (i = 0; i < len; i++)
+	deduced[i] = ((canblock >> i) & 1 ? BLOCK : 0) |
+	    ((candot >> i) & 1 ? DOT : 0);
+}
 
 static int do_row(unsigned char *known, unsigned char *deduced,
                   unsigned char *row,
@@ -420,21 +559,27 @@ static int do_row(unsigned char *known, unsigned char *deduced,
 {
     int rowlen, i, freespace, done_any;
 
-    freespace = len+1;
-    for (rowlen = 0; data[rowlen]; rowlen++) {
-	minpos_done[rowlen] = minpos_ok[rowlen] = len - 1;
-	maxpos_done[rowlen] = maxpos_ok[rowlen] = 0;
-	freespace -= data[rowlen]+1;
-    }
-
-    for (i = 0; i < len; i++) {
+    for (i = 0; i < len; i++)
 	known[i] = start[i*step];
-	deduced[i] = 0;
-    }
-    for (i = len - 1; i >= 0 && known[i] == DOT; i--)
-        freespace--;
 
-    do_recurse(known, deduced, row, minpos_done, maxpos_done, minpos_ok, maxpos_ok, data, len, freespace, 0, 0);
+    if (len < LINEMASK_BITS) {
+	do_row_bits(known, deduced, len, data);
+    } else {
+	freespace = len+1;
+	for (rowlen = 0; data[rowlen]; rowlen++) {
+	    minpos_done[rowlen] = minpos_ok[rowlen] = len - 1;
+	    maxpos_done[rowlen] = maxpos_ok[rowlen] = 0;
+	    freespace -= data[rowlen]+1;
+	}
+
+	for (i = 0; i < len; i++)
+	    deduced[i] = 0;
+	for (i = len - 1; i >= 0 && known[i] == DOT; i--)
+	    freespace--;
+
+	do_recurse(known, deduced, row, minpos_done, maxpos_done,
+		   minpos_ok, maxpos_ok, data, len, freespace, 0, 0);
+    }
 
     done_any = FALSE;
     for (i=0; i<len; i++)
@@ -805,8 +950,9 @@ static game_state *new_game(midend *me, const game_params *params,
     memset(state->grid, GRID_UNKNOWN, state->w * state->h);
 
     state->rowsize = max(state->w, state->h);
-    state->rowdata = snewn(state->rowsize * (state->w + state->h), int);
-    state->rowlen = snewn(state->w + state->h, int);
+    state->rowdata = shared_new(state->rowsize * (state->w + state->h) *
+                                sizeof(int));
+    state->rowlen = shared_new((state->w + state->h) * sizeof(int));
 
     state->completed = state->cheated = FALSE;
 
@@ -838,12 +984,8 @@ static game_state *dup_game(const game_state *state)
     memcpy(ret->grid, state->grid, ret->w * ret->h);
 
     ret->rowsize = state->rowsize;
-    ret->rowdata = snewn(ret->rowsize * (ret->w + ret->h), int);
-    ret->rowlen = snewn(ret->w + ret->h, int);
-    memcpy(ret->rowdata, state->rowdata,
-           ret->rowsize * (ret->w + ret->h) * sizeof(int));
-    memcpy(ret->rowlen, state->rowlen,
-           (ret->w + ret->h) * sizeof(int));
+    ret->rowdata = shared_ref(state->rowdata);
+    ret->rowlen = shared_ref(state->rowlen);
 
     ret->completed = state->completed;
     ret->cheated = state->cheated;
@@ -853,8 +995,8 @@ static game_state *dup_game(const game_state *state)
 
 static void free_game(game_state *state)
 {
-    sfree(state->rowdata);
-    sfree(state->rowlen);
+    shared_free(state->rowdata);
+    shared_free(state->rowlen);
     sfree(state->grid);
     sfree(state);
 }
@@ -1194,6 +1336,44 @@ static game_state *execute_move(const game_state *from, const char *move)
 	return NULL;
 }
 
+/*
+ * Snapshot encoding for saves: the flags, then a digit per square.
+ */
+static char *encode_state(const game_state *state)
+{
+    int i, n = state->w * state->h;
+    char *ret = snewn(n + 40, char), *p = ret;
+
+    p += sprintf(p, "%d,%d:", state->completed, state->cheated);
+    for (i = 0; i < n; i++)
+	*p++ = '0' + state->grid[i];
+    *p = '\0';
+    return ret;
+}
+
+static game_state *decode_state(const game_state *initial, const char *str)
+{
+    int i, n = initial->w * initial->h;
+    int completed, cheated, k;
+    game_state *ret;
+
+    if (sscanf(str, "%d,%d:%n", &completed, &cheated, &k) != 2 ||
+	strlen(str + k) != n)
+	return NULL;
+    str += k;
+    for (i = 0; i < n; i++)
+	if (str[i] != '0' + GRID_UNKNOWN && str[i] != '0' + GRID_FULL &&
+	    str[i] != '0' + GRID_EMPTY)
+	    return NULL;
+
+    ret = dup_game(initial);
+    for (i = 0; i < n; i++)
+	ret->grid[i] = str[i] - '0';
+    ret->completed = completed;
+    ret->cheated = cheated;
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * Error-checking during gameplay.
  */
@@ -1752,6 +1932,8 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     REQUIRE_RBUTTON,		       /* flags */
+    16,				       /* undo_keyframe_interval */
+    encode_state, decode_state,
 };
 
 #ifdef STANDALONE_SOLVER
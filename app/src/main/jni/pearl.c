@@ -292,7 +292,7 @@ int pearl_solve(int w, int h, char *clues, char *result,
                 int difficulty, int partial)
 {
     int W = 2*w+1, H = 2*h+1;
-    short *workspace;
+    short *workspace, *seen;
     int *dsf, *dsfsize;
     int x, y, b, d;
     int ret = -1;
@@ -349,6 +349,18 @@ int pearl_solve(int w, int h, char *clues, char *result,
     dsf = snewn(w*h, int);
     dsfsize = snewn(w*h, int);
 
+    /*
+     * The first two deductions below look only at one square and
+     * the edges around it, so a square which has changed in neither
+     * since we last looked at it can be passed over. seen[5*i] holds
+     * square i's state word as the edge check last left it, and
+     * seen[5*i+1..4] its R,U,L,D edges at that time; seen[5*w*h+i]
+     * is its state word when it last forced its edges.
+     */
+    seen = snewn(6*w*h, short);
+    for (x = 0; x < 6*w*h; x++)
+	seen[x] = -1;
+
     /*
      * Now repeatedly try to find something we can do.
      */
@@ -370,6 +382,17 @@ int pearl_solve(int w, int h, char *clues, char *result,
 	 */
 	for (y = 0; y < h; y++)
 	    for (x = 0; x < w; x++) {
+		short *sq = seen + 5*(y*w+x);
+		int k;
+
+		if (sq[0] == workspace[(2*y+1)*W+(2*x+1)]) {
+		    for (k = 1, d = 1; d <= 8; k++, d += d)
+			if (sq[k] != workspace[(2*y+1+DY(d))*W+(2*x+1+DX(d))])
+			    break;
+		    if (d > 8)
+			continue;      /* nothing new to check against */
+		}
+
 		for (b = 0; b < 0xD; b++)
 		    if (workspace[(2*y+1)*W+(2*x+1)] & (1<<b)) {
 			/*
@@ -406,6 +429,10 @@ int pearl_solve(int w, int h, char *clues, char *result,
 		    ret = 0;
 		    goto cleanup;
 		}
+
+		sq[0] = workspace[(2*y+1)*W+(2*x+1)];
+		for (k = 1, d = 1; d <= 8; k++, d += d)
+		    sq[k] = workspace[(2*y+1+DY(d))*W+(2*x+1+DX(d))];
 	    }
 
 	/*
@@ -417,6 +444,10 @@ int pearl_solve(int w, int h, char *clues, char *result,
 	    for (x = 0; x < w; x++) {
 		int edgeor = 0, edgeand = 15;
 
+		if (seen[5*w*h+y*w+x] == workspace[(2*y+1)*W+(2*x+1)])
+		    continue;	       /* its edges are already forced */
+		seen[5*w*h+y*w+x] = workspace[(2*y+1)*W+(2*x+1)];
+
 		for (b = 0; b < 0xD; b++)
 		    if (workspace[(2*y+1)*W+(2*x+1)] & (1<<b)) {
 			edgeor |= b;
@@ -858,6 +889,7 @@ cleanup:
         }
     }
 
+    sfree(seen);
     sfree(dsfsize);
     sfree(dsf);
     sfree(workspace);
@@ -2570,7 +2602,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    DRAG_FOLLOWS_PATH,		       /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
@@ -2581,7 +2613,7 @@ const struct game thegame = {
 const char *quis = NULL;
 
 static void usage(FILE *out) {
-    fprintf(out, "usage: %s <params>\n", quis);
+    fprintf(out, "usage: %s <params> | <game_id>\n", quis);
 }
 
 static void pnum(int n, int ntot, const char *desc)
@@ -2637,6 +2669,50 @@ static void start_soak(game_params *p, random_state *rs, int nsecs)
     sfree(clues);
 }
 
+/*
+ * Solve a game ID at the lowest difficulty that manages it, and print
+ * that and the solution: a hex digit per square, giving the line
+ * directions through it as a bitmask (R=1, U=2, L=4, D=8).
+ */
+static void solve_id(char *id)
+{
+    char *desc = strchr(id, ':'), *err, *grid;
+    game_params *p = default_params();
+    game_state *s;
+    int diff, ret = 0, x, y;
+
+    *desc++ = '\0';
+    decode_params(p, id);
+    err = validate_desc(p, desc);
+    if (err) {
+        fprintf(stderr, "%s: %s\n", quis, err);
+        exit(1);
+    }
+    s = new_game(NULL, p, desc);
+    grid = snewn(p->w*p->h, char);
+
+    for (diff = 0; diff < DIFFCOUNT; diff++) {
+        ret = pearl_solve(p->w, p->h, s->shared->clues, grid, diff, FALSE);
+        if (ret != 2) break;           /* solved, or impossible */
+    }
+    if (ret == 0) {
+        printf("Puzzle is impossible.\n");
+    } else if (ret == 2) {
+        printf("Unable to find a unique solution.\n");
+    } else {
+        printf("Difficulty rating: %s\n", pearl_diffnames[diff]);
+        for (y = 0; y < p->h; y++) {
+            for (x = 0; x < p->w; x++)
+                putchar("0123456789ABCDEF"[(int)grid[y*p->w+x]]);
+            putchar('\n');
+        }
+    }
+
+    sfree(grid);
+    free_game(s);
+    free_params(p);
+}
+
 int main(int argc, const char *argv[])
 {
     game_params *p = NULL;
@@ -2667,7 +2743,7 @@ int main(int argc, const char *argv[])
 
     if (id) {
         if (strchr(id, ':')) {
-            fprintf(stderr, "soak takes params only.\n");
+            solve_id(id);
             goto done;
         }
 
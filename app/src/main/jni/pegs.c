@@ -10,7 +10,6 @@
 #include <math.h>
 
 #include "puzzles.h"
-#include "tree234.h"
 
 #define GRID_HOLE 0
 #define GRID_PEG  1
@@ -48,6 +47,7 @@ static char const *const pegs_lowertypes[] = { TYPELIST(LOWER) };
 #define TYPECONFIG TYPELIST(CONFIG)
 
 #define FLASH_FRAME 0.13F
+#define SOLVE_ANIM_TIME 0.15F	       /* per jump of an animated solve */
 
 struct game_params {
     int w, h;
@@ -57,7 +57,10 @@ struct game_params {
 struct game_state {
     int w, h;
     int completed;
+    int used_solve;		       /* used to suppress completion flash */
     unsigned char *grid;
+    int *solvepath;		       /* (from, to) pairs, if reached by a solve */
+    int solvelen;		       /* number of jumps in solvepath */
 };
 
 static game_params *default_params(void)
@@ -238,53 +241,54 @@ struct move {
     int cost;
 };
 
-static int movecmp(void *av, void *bv)
-{
-    struct move *a = (struct move *)av;
-    struct move *b = (struct move *)bv;
-
-    if (a->y < b->y)
-	return -1;
-    else if (a->y > b->y)
-	return +1;
-
-    if (a->x < b->x)
-	return -1;
-    else if (a->x > b->x)
-	return +1;
-
-    if (a->dy < b->dy)
-	return -1;
-    else if (a->dy > b->dy)
-	return +1;
+/*
+ * The moves we might make next are kept in a flat table with a slot
+ * for each start square and direction. Slots are numbered so that
+ * they run in order of y, then x, then dy, then dx, and for each cost
+ * a Fenwick tree counts the slots currently holding a move of that
+ * cost. So finding the nth cheapest move, in that order, takes
+ * O(log n) steps and no allocation, however big the board gets.
+ */
+static const int movedx[4] = { 0, -1, +1, 0 };
+static const int movedy[4] = { -1, 0, 0, +1 };
+#define MOVESLOT(w, x, y, dx, dy) \
+    (((y)*(w)+(x)) * 4 + ((dy) < 0 ? 0 : (dy) > 0 ? 3 : (dx) < 0 ? 1 : 2))
+
+struct movetable {
+    int nslots, top;		       /* top = highest power of 2 <= nslots */
+    signed char *cost;		       /* per slot; -1 if move not possible */
+    int *count[3];		       /* Fenwick tree of slots, per cost */
+    int total[3];
+};
 
-    if (a->dx < b->dx)
-	return -1;
-    else if (a->dx > b->dx)
-	return +1;
+static void movetable_adjust(struct movetable *mt, int cost, int slot,
+			     int delta)
+{
+    int *t = mt->count[cost], i;
 
-    return 0;
+    for (i = slot+1; i <= mt->nslots; i += i & -i)
+	t[i-1] += delta;
+    mt->total[cost] += delta;
 }
 
-static int movecmpcost(void *av, void *bv)
+/*
+ * Return the slot of the index'th move (from 0) at the given cost.
+ */
+static int movetable_find(struct movetable *mt, int cost, int index)
 {
-    struct move *a = (struct move *)av;
-    struct move *b = (struct move *)bv;
-
-    if (a->cost < b->cost)
-	return -1;
-    else if (a->cost > b->cost)
-	return +1;
+    int *t = mt->count[cost], pos = 0, step;
 
-    return movecmp(av, bv);
+    assert(index >= 0 && index < mt->total[cost]);
+    for (step = mt->top; step; step >>= 1)
+	if (pos + step <= mt->nslots && t[pos+step-1] <= index) {
+	    pos += step;
+	    index -= t[pos-1];
+	}
+    return pos;
 }
 
-struct movetrees {
-    tree234 *bymove, *bycost;
-};
-
 static void update_moves(unsigned char *grid, int w, int h, int x, int y,
-			 struct movetrees *trees)
+			 struct movetable *mt)
 {
     struct move move;
     int dir, pos;
@@ -304,7 +308,7 @@ static void update_moves(unsigned char *grid, int w, int h, int x, int y,
 	assert(abs(dx) + abs(dy) == 1);
 
 	for (pos = 0; pos < 3; pos++) {
-	    int v1, v2, v3;
+	    int v1, v2, v3, slot, oldcost;
 
 	    move.dx = dx;
 	    move.dy = dy;
@@ -317,94 +321,78 @@ static void update_moves(unsigned char *grid, int w, int h, int x, int y,
 		move.y+2*move.dy < 0 || move.y+2*move.dy >= h)
 		continue;	       /* completely invalid move */
 
+	    slot = MOVESLOT(w, move.x, move.y, move.dx, move.dy);
+	    oldcost = mt->cost[slot];
+
 	    v1 = grid[move.y * w + move.x];
 	    v2 = grid[(move.y+move.dy) * w + (move.x+move.dx)];
 	    v3 = grid[(move.y+2*move.dy)*w + (move.x+2*move.dx)];
 	    if (v1 == GRID_PEG && v2 != GRID_PEG && v3 != GRID_PEG) {
-		struct move *m;
-
 		move.cost = (v2 == GRID_OBST) + (v3 == GRID_OBST);
 
 		/*
-		 * This move is possible. See if it's already in
-		 * the tree.
+		 * This move is possible. If it's already listed at
+		 * the wrong cost, move it to the right one.
 		 */
-		m = find234(trees->bymove, &move, NULL);
-		if (m && m->cost != move.cost) {
-		    /*
-		     * It's in the tree but listed with the wrong
-		     * cost. Remove the old version.
-		     */
-#ifdef GENERATION_DIAGNOSTICS
-		    printf("correcting %d%+d,%d%+d at cost %d\n",
-			   m->x, m->dx, m->y, m->dy, m->cost);
-#endif
-		    del234(trees->bymove, m);
-		    del234(trees->bycost, m);
-		    sfree(m);
-		    m = NULL;
-		}
-		if (!m) {
-		    struct move *m, *m2;
-		    m = snew(struct move);
-		    *m = move;
-		    m2 = add234(trees->bymove, m);
-		    m2 = add234(trees->bycost, m);
-		    assert(m2 == m);
-#ifdef GENERATION_DIAGNOSTICS
-		    printf("adding %d%+d,%d%+d at cost %d\n",
-			   move.x, move.dx, move.y, move.dy, move.cost);
-#endif
-		} else {
+		if (oldcost != move.cost) {
 #ifdef GENERATION_DIAGNOSTICS
-		    printf("not adding %d%+d,%d%+d at cost %d\n",
+		    printf("%s %d%+d,%d%+d at cost %d\n",
+			   oldcost < 0 ? "adding" : "correcting",
 			   move.x, move.dx, move.y, move.dy, move.cost);
 #endif
+		    if (oldcost >= 0)
+			movetable_adjust(mt, oldcost, slot, -1);
+		    movetable_adjust(mt, move.cost, slot, +1);
+		    mt->cost[slot] = move.cost;
 		}
-	    } else {
+	    } else if (oldcost >= 0) {
 		/*
-		 * This move is impossible. If it is already in the
-		 * tree, delete it.
-		 * 
-		 * (We make use here of the fact that del234
-		 * doesn't have to be passed a pointer to the
-		 * _actual_ element it's deleting: it merely needs
-		 * one that compares equal to it, and it will
-		 * return the one it deletes.)
+		 * This move is impossible, but it's still listed.
+		 * Delete it.
 		 */
-		struct move *m = del234(trees->bymove, &move);
 #ifdef GENERATION_DIAGNOSTICS
-		printf("%sdeleting %d%+d,%d%+d\n", m ? "" : "not ",
+		printf("deleting %d%+d,%d%+d\n",
 		       move.x, move.dx, move.y, move.dy);
 #endif
-		if (m) {
-		    del234(trees->bycost, m);
-		    sfree(m);
-		}
+		movetable_adjust(mt, oldcost, slot, -1);
+		mt->cost[slot] = -1;
 	    }
 	}
     }
 }
 
-static void pegs_genmoves(unsigned char *grid, int w, int h, random_state *rs)
+/*
+ * Generate a board by reverse moves from the peg already on the grid.
+ * The moves are written to path as (from, to) pairs of grid indices,
+ * in the order they would be played forwards to solve the board, and
+ * the number of them is returned.
+ */
+static int pegs_genmoves(unsigned char *grid, int w, int h, random_state *rs,
+			 int *path)
 {
-    struct movetrees atrees, *trees = &atrees;
-    struct move *m;
+    struct movetable amt, *mt = &amt;
     int x, y, i, nmoves;
 
-    trees->bymove = newtree234(movecmp);
-    trees->bycost = newtree234(movecmpcost);
+    mt->nslots = w*h*4;
+    for (mt->top = 1; mt->top * 2 <= mt->nslots; mt->top *= 2);
+    mt->cost = snewn(mt->nslots, signed char);
+    memset(mt->cost, -1, mt->nslots);
+    for (i = 0; i < 3; i++) {
+	mt->count[i] = snewn(mt->nslots, int);
+	memset(mt->count[i], 0, mt->nslots * sizeof(int));
+	mt->total[i] = 0;
+    }
 
     for (y = 0; y < h; y++)
 	for (x = 0; x < w; x++)
 	    if (grid[y*w+x] == GRID_PEG)
-		update_moves(grid, w, h, x, y, trees);
+		update_moves(grid, w, h, x, y, mt);
 
     nmoves = 0;
 
     while (1) {
-	int limit, maxcost, index;
-	struct move mtmp, move, *m;
+	int maxcost, cost, slot;
+	struct move move;
 
 	/*
 	 * See how many moves we can make at zero cost. Make one,
@@ -415,23 +403,23 @@ static void pegs_genmoves(unsigned char *grid, int w, int h, random_state *rs)
 	 * accept cost-2 moves: if that's our only option, we give
 	 * up and finish.
 	 */
-	mtmp.y = h+1;
 	maxcost = (nmoves < w*h/2 ? 2 : 1);
-	m = NULL;		       /* placate optimiser */
-	for (mtmp.cost = 0; mtmp.cost <= maxcost; mtmp.cost++) {
-	    limit = -1;
-	    m = findrelpos234(trees->bycost, &mtmp, NULL, REL234_LT, &limit);
+	for (cost = 0; cost <= maxcost; cost++) {
 #ifdef GENERATION_DIAGNOSTICS
-	    printf("%d moves available with cost %d\n", limit+1, mtmp.cost);
+	    printf("%d moves available with cost %d\n", mt->total[cost], cost);
 #endif
-	    if (m)
+	    if (mt->total[cost])
 		break;
 	}
-	if (!m)
+	if (cost > maxcost)
 	    break;
 
-	index = random_upto(rs, limit+1);
-	move = *(struct move *)index234(trees->bycost, index);
+	slot = movetable_find(mt, cost, random_upto(rs, mt->total[cost]));
+	move.x = (slot / 4) % w;
+	move.y = (slot / 4) / w;
+	move.dx = movedx[slot % 4];
+	move.dy = movedy[slot % 4];
+	move.cost = cost;
 
 #ifdef GENERATION_DIAGNOSTICS
 	printf("selecting move %d%+d,%d%+d at cost %d\n",
@@ -445,22 +433,39 @@ static void pegs_genmoves(unsigned char *grid, int w, int h, random_state *rs)
 	for (i = 0; i <= 2; i++) {
 	    int tx = move.x + i*move.dx;
 	    int ty = move.y + i*move.dy;
-	    update_moves(grid, w, h, tx, ty, trees);
+	    update_moves(grid, w, h, tx, ty, mt);
 	}
 
+	/*
+	 * Played forwards, this is a jump back onto (x,y) from
+	 * two squares away.
+	 */
+	path[2*nmoves] = (move.y+2*move.dy)*w + (move.x+2*move.dx);
+	path[2*nmoves+1] = move.y * w + move.x;
 	nmoves++;
     }
 
-    while ((m = delpos234(trees->bymove, 0)) != NULL) {
-	del234(trees->bycost, m);
-	sfree(m);
+    sfree(mt->cost);
+    for (i = 0; i < 3; i++)
+	sfree(mt->count[i]);
+
+    /*
+     * Reverse the list so it runs forwards.
+     */
+    for (i = 0; i < nmoves/2; i++) {
+	int j = nmoves-1-i, t;
+	t = path[2*i]; path[2*i] = path[2*j]; path[2*j] = t;
+	t = path[2*i+1]; path[2*i+1] = path[2*j+1]; path[2*j+1] = t;
     }
-    freetree234(trees->bymove);
-    freetree234(trees->bycost);
+
+    return nmoves;
 }
 
-static void pegs_generate(unsigned char *grid, int w, int h, random_state *rs)
+static int pegs_generate(unsigned char *grid, int w, int h, random_state *rs,
+			 int *path)
 {
+    int npath;
+
     while (1) {
 	int x, y, extremes;
 
@@ -469,7 +474,7 @@ static void pegs_generate(unsigned char *grid, int w, int h, random_state *rs)
 #ifdef GENERATION_DIAGNOSTICS
 	printf("beginning move selection\n");
 #endif
-	pegs_genmoves(grid, w, h, rs);
+	npath = pegs_genmoves(grid, w, h, rs, path);
 #ifdef GENERATION_DIAGNOSTICS
 	printf("finished move selection\n");
 #endif
@@ -497,6 +502,364 @@ static void pegs_generate(unsigned char *grid, int w, int h, random_state *rs)
 #ifdef GENERATION_DIAGNOSTICS
     fflush(stdout);
 #endif
+    return npath;
+}
+
+/* ----------------------------------------------------------------------
+ * Solver, used to implement Solve by finding a sequence of moves from
+ * the current position down to a single peg.
+ *
+ * The playable squares are numbered off, and a position is a bitboard
+ * with one bit per playable square, set where there is a peg. Every
+ * jump on the board is listed once, up front, as the word and mask for
+ * each of its three squares, so testing and making a jump is a few
+ * word operations.
+ *
+ * The search is a plain depth-first one, but with a transposition
+ * table of positions already found to be dead ends, keyed on a
+ * Zobrist hash of the bitboard. Peg solitaire reaches the same
+ * position by many different move orders, so this prunes the search
+ * enormously. We also keep the hash of each reflection or rotation
+ * of the position that the board's shape allows, and use the
+ * smallest, so that a dead end is recognised in any orientation. The
+ * table is direct-mapped and simply overwrites on collision, so its
+ * memory use is fixed. A clash between two full
+ * 64-bit hashes could in principle make us wrongly skip a soluble
+ * position; that costs us at worst a failed Solve, because the
+ * moves we return are checked again by execute_move.
+ */
+
+typedef unsigned long long pegword;
+#define PEG_BITS ((int)(sizeof(pegword) * 8))
+
+#define SOLVER_TT_BITS 20
+#define SOLVER_MAX_NODES 5000000L
+
+struct pegjump {
+    int from, over, to;		       /* grid indices */
+    int fw, ow, tw;		       /* word of each square in the bitboard */
+    pegword fm, om, tm;		       /* mask of each square in its word */
+};
+
+struct pegs_solver {
+    int njumps;
+    struct pegjump *jumps;
+    pegword *board;
+    int area, nsyms;
+    pegword *zobrist;		       /* per symmetry, per grid index */
+    pegword hash[8];		       /* per symmetry */
+    pegword *dead;		       /* transposition table */
+    int npegs;
+    long nodes;
+    int *path;			       /* jump indices made so far */
+};
+
+/*
+ * A small xorshift generator for the Zobrist keys, so that the solver
+ * doesn't need a random_state and always behaves the same way.
+ */
+static pegword pegs_solver_rand(pegword *seed)
+{
+    pegword x = *seed;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *seed = x;
+}
+
+static pegword pegs_solver_key(const struct pegs_solver *ctx)
+{
+    pegword key = ctx->hash[0];
+    int s;
+
+    for (s = 1; s < ctx->nsyms; s++)
+	if (key > ctx->hash[s])
+	    key = ctx->hash[s];
+    return key;
+}
+
+static void pegs_solver_jump(struct pegs_solver *ctx,
+			     const struct pegjump *j)
+{
+    const pegword *z = ctx->zobrist;
+    int s;
+
+    ctx->board[j->fw] ^= j->fm;
+    ctx->board[j->ow] ^= j->om;
+    ctx->board[j->tw] ^= j->tm;
+    for (s = 0; s < ctx->nsyms; s++, z += ctx->area)
+	ctx->hash[s] ^= z[j->from] ^ z[j->over] ^ z[j->to];
+}
+
+/*
+ * Returns +1 if the position can be reduced to a single peg (leaving
+ * the jumps to do so in ctx->path), 0 if it can't, or -1 if we ran
+ * out of nodes before finding out.
+ */
+static int pegs_solver_dfs(struct pegs_solver *ctx, int depth)
+{
+    const pegword *b = ctx->board;
+    pegword key;
+    int i, ret;
+
+    if (ctx->npegs == 1)
+	return +1;
+    if (++ctx->nodes > SOLVER_MAX_NODES)
+	return -1;
+    key = pegs_solver_key(ctx);
+    if (ctx->dead[key & ((1 << SOLVER_TT_BITS) - 1)] == key)
+	return 0;
+
+    for (i = 0; i < ctx->njumps; i++) {
+	const struct pegjump *j = &ctx->jumps[i];
+
+	if (!(b[j->fw] & j->fm) || !(b[j->ow] & j->om) || (b[j->tw] & j->tm))
+	    continue;
+
+	pegs_solver_jump(ctx, j);
+	ctx->npegs--;
+	ctx->path[depth] = i;
+
+	ret = pegs_solver_dfs(ctx, depth + 1);
+
+	pegs_solver_jump(ctx, j);      /* jumps are their own inverse */
+	ctx->npegs++;
+
+	if (ret != 0)
+	    return ret;
+    }
+
+    ctx->dead[key & ((1 << SOLVER_TT_BITS) - 1)] = key;
+    return 0;
+}
+
+/*
+ * Solve a grid. On success, returns the number of jumps and fills in
+ * *path with pairs of grid indices (from, to) for each. Otherwise
+ * returns 0 if there is no solution, or -1 if we gave up looking.
+ *
+ * If we know a solution to some nearby position (say, the one the
+ * player started from), passing its jumps in prefer makes the search
+ * try those jumps first, which usually leads it straight back on to
+ * that solution.
+ */
+static int pegs_solve(const unsigned char *grid, int w, int h,
+		      const int *prefer, int nprefer, int **path)
+{
+    struct pegs_solver actx, *ctx = &actx;
+    int *sqnum, nsq, nwords, x, y, i, k, nfront, ret, sym;
+    pegword seed = 0x9E3779B97F4A7C15ULL;
+
+    /*
+     * Number the playable squares.
+     */
+    sqnum = snewn(w*h, int);
+    for (i = nsq = 0; i < w*h; i++)
+	sqnum[i] = (grid[i] == GRID_OBST ? -1 : nsq++);
+    nwords = (nsq + PEG_BITS - 1) / PEG_BITS;
+    if (!nwords)
+	nwords = 1;
+
+    /*
+     * Find the symmetries of the board's shape, and make a set of
+     * Zobrist keys for each, permuting the first set so that the
+     * hash under symmetry sym is the plain hash of the position
+     * transformed by sym.
+     */
+    ctx->area = w*h;
+    ctx->zobrist = snewn(8*w*h, pegword);
+    for (i = 0; i < w*h; i++)
+	ctx->zobrist[i] = pegs_solver_rand(&seed);
+    ctx->nsyms = 1;
+    for (sym = 1; sym < 8; sym++) {
+	pegword *z = ctx->zobrist + ctx->nsyms * w*h;
+
+	if ((sym & 4) && w != h)
+	    continue;
+	for (i = 0; i < w*h; i++) {
+	    int x2 = i % w, y2 = i / w, t;
+	    if (sym & 4)
+		t = x2, x2 = y2, y2 = t;
+	    if (sym & 1)
+		x2 = w-1 - x2;
+	    if (sym & 2)
+		y2 = h-1 - y2;
+	    if ((grid[i] == GRID_OBST) != (grid[y2*w+x2] == GRID_OBST))
+		break;
+	    z[i] = ctx->zobrist[y2*w+x2];
+	}
+	if (i == w*h)
+	    ctx->nsyms++;
+    }
+
+    /*
+     * List the jumps, and set up the bitboard and its hashes.
+     */
+    ctx->jumps = snewn(w*h*4, struct pegjump);
+    ctx->njumps = 0;
+    ctx->board = snewn(nwords, pegword);
+    memset(ctx->board, 0, nwords * sizeof(pegword));
+    memset(ctx->hash, 0, sizeof(ctx->hash));
+    ctx->npegs = 0;
+    for (y = 0; y < h; y++)
+	for (x = 0; x < w; x++) {
+	    int d, s = sqnum[y*w+x];
+
+	    if (s < 0)
+		continue;
+
+	    if (grid[y*w+x] == GRID_PEG) {
+		ctx->board[s / PEG_BITS] |= (pegword)1 << (s % PEG_BITS);
+		for (sym = 0; sym < ctx->nsyms; sym++)
+		    ctx->hash[sym] ^= ctx->zobrist[sym*w*h + y*w+x];
+		ctx->npegs++;
+	    }
+
+	    for (d = 0; d < 4; d++) {
+		int dx = movedx[d], dy = movedy[d];
+		int x2 = x + 2*dx, y2 = y + 2*dy;
+		struct pegjump *j;
+
+		if (x2 < 0 || x2 >= w || y2 < 0 || y2 >= h ||
+		    sqnum[(y+dy)*w+(x+dx)] < 0 || sqnum[y2*w+x2] < 0)
+		    continue;
+
+		j = &ctx->jumps[ctx->njumps++];
+		j->from = y*w+x;
+		j->over = (y+dy)*w+(x+dx);
+		j->to = y2*w+x2;
+		j->fw = sqnum[j->from] / PEG_BITS;
+		j->fm = (pegword)1 << (sqnum[j->from] % PEG_BITS);
+		j->ow = sqnum[j->over] / PEG_BITS;
+		j->om = (pegword)1 << (sqnum[j->over] % PEG_BITS);
+		j->tw = sqnum[j->to] / PEG_BITS;
+		j->tm = (pegword)1 << (sqnum[j->to] % PEG_BITS);
+	    }
+	}
+
+    /*
+     * Move any preferred jumps to the front of the list, in order.
+     */
+    for (i = nfront = 0; i < nprefer; i++)
+	for (k = nfront; k < ctx->njumps; k++)
+	    if (ctx->jumps[k].from == prefer[2*i] &&
+		ctx->jumps[k].to == prefer[2*i+1]) {
+		struct pegjump t = ctx->jumps[k];
+		ctx->jumps[k] = ctx->jumps[nfront];
+		ctx->jumps[nfront++] = t;
+		break;
+	    }
+
+    ctx->dead = snewn(1 << SOLVER_TT_BITS, pegword);
+    memset(ctx->dead, 0, (1 << SOLVER_TT_BITS) * sizeof(pegword));
+    ctx->nodes = 0;
+    ctx->path = snewn(ctx->npegs + 1, int);
+
+    /*
+     * Before searching, try the argument used in new_game_desc to
+     * show some Octagon starts are insoluble. Stripe the board
+     * diagonally in three colours, both ways: every jump flips the
+     * parity of the peg count on all three colours of each striping.
+     * So we can work out the parities we'd end up with after reducing
+     * to one peg, and unless there's a square on the board which a
+     * lone peg could occupy to give them, there's no need to search.
+     */
+    {
+	int par[2][3], final = FALSE;
+
+	memset(par, 0, sizeof(par));
+	for (i = 0; i < w*h; i++)
+	    if (grid[i] == GRID_PEG) {
+		par[0][(i%w + i/w) % 3] ^= 1;
+		par[1][(i%w - i/w + 3*h) % 3] ^= 1;
+	    }
+	if ((ctx->npegs - 1) & 1)
+	    for (i = 0; i < 3; i++)
+		par[0][i] ^= 1, par[1][i] ^= 1;
+	for (i = 0; i < w*h; i++)
+	    if (grid[i] != GRID_OBST) {
+		int c0 = (i%w + i/w) % 3, c1 = (i%w - i/w + 3*h) % 3;
+		if (par[0][c0] && !par[0][(c0+1)%3] && !par[0][(c0+2)%3] &&
+		    par[1][c1] && !par[1][(c1+1)%3] && !par[1][(c1+2)%3])
+		    final = TRUE;
+	    }
+
+	ret = (ctx->npegs > 0 && final) ? pegs_solver_dfs(ctx, 0) : 0;
+    }
+
+    if (ret > 0) {
+	int n = ctx->npegs - 1;
+
+	*path = snewn(2 * n + 1, int);
+	for (i = 0; i < n; i++) {
+	    (*path)[2*i] = ctx->jumps[ctx->path[i]].from;
+	    (*path)[2*i+1] = ctx->jumps[ctx->path[i]].to;
+	}
+	ret = n;
+    }
+
+    sfree(sqnum);
+    sfree(ctx->jumps);
+    sfree(ctx->board);
+    sfree(ctx->zobrist);
+    sfree(ctx->dead);
+    sfree(ctx->path);
+
+    return ret;
+}
+
+/*
+ * Solutions are passed around (as aux strings and as Solve moves) as an
+ * S followed by a list of jumps, each a semicolon and then source and
+ * destination coordinate pairs in the same format as an ordinary move.
+ */
+static char *encode_solve_path(int w, const int *path, int n)
+{
+    char *ret, *p;
+    int i;
+
+    ret = p = snewn(n * 40 + 2, char);
+    *p++ = 'S';
+    for (i = 0; i < n; i++)
+	p += sprintf(p, ";%d,%d-%d,%d", path[2*i] % w, path[2*i] / w,
+		     path[2*i+1] % w, path[2*i+1] / w);
+    return ret;
+}
+
+/*
+ * Parse the jumps of a solve string into (from, to) pairs of grid
+ * indices. Returns the number of jumps, or -1 if the string is
+ * malformed or refers to squares off the grid. The jumps themselves
+ * aren't checked for legality.
+ */
+static int decode_solve_path(const char *p, int w, int h, int **path)
+{
+    int n, i, len, sx, sy, tx, ty;
+    const char *q;
+
+    if (*p++ != 'S')
+	return -1;
+    for (n = 0, q = p; *q; q++)
+	if (*q == ';')
+	    n++;
+
+    *path = snewn(2 * n + 1, int);
+    for (i = 0; i < n; i++) {
+	if (*p != ';' ||
+	    sscanf(p+1, "%d,%d-%d,%d%n", &sx, &sy, &tx, &ty, &len) != 4 ||
+	    sx < 0 || sx >= w || sy < 0 || sy >= h ||
+	    tx < 0 || tx >= w || ty < 0 || ty >= h)
+	    break;
+	p += len+1;
+	(*path)[2*i] = sy*w+sx;
+	(*path)[2*i+1] = ty*w+tx;
+    }
+    if (i < n || *p) {
+	sfree(*path);
+	*path = NULL;
+	return -1;
+    }
+    return n;
 }
 
 /* ----------------------------------------------------------------------
@@ -504,6 +867,75 @@ static void pegs_generate(unsigned char *grid, int w, int h, random_state *rs)
  * it as part of the puzzle.
  */
 
+/*
+ * Solutions to the Octagon board from one starting hole in each of
+ * the three classes described in new_game_desc below. pegs_solve
+ * finds these, but takes too long on this board to do it for every
+ * game. Each jump is four digits, giving the source x,y and then the
+ * destination x,y; every other starting hole is a reflection or
+ * rotation of one of these.
+ */
+static const struct {
+    int hx, hy;
+    const char *jumps;
+} octagon_solutions[3] = {
+    {4, 0, "2040222041212022232111310222323040205232321203232422432323"
+     "2120221232634304243414555326241434345464444525434515353634"
+     "464434545452624232525153"},
+    {3, 1, "1131412113111131321230320222321252323331040202222321202254"
+     "5251533454143454526242434140422624464434546444363434545553"
+     "634343414121212323251535"},
+    {4, 3, "4143214140422040232111310222323040205232321203232422432323"
+     "2120221232634304243414555326241434345464444525434515353634"
+     "464434545452624232525153"},
+};
+
+/*
+ * Apply one of the eight symmetries of the 7x7 board to a square.
+ */
+static void octagon_map(int sym, int *x, int *y)
+{
+    int t;
+
+    if (sym & 4)
+	t = *x, *x = *y, *y = t;
+    if (sym & 1)
+	*x = 6 - *x;
+    if (sym & 2)
+	*y = 6 - *y;
+}
+
+static char *octagon_aux(const unsigned char *grid)
+{
+    int hole, c, sym, i;
+
+    for (hole = 0; hole < 49; hole++)
+	if (grid[hole] == GRID_HOLE)
+	    break;
+
+    for (c = 0; c < lenof(octagon_solutions); c++)
+	for (sym = 0; sym < 8; sym++) {
+	    int x = octagon_solutions[c].hx, y = octagon_solutions[c].hy;
+	    const char *p = octagon_solutions[c].jumps;
+	    int path[2*35];
+
+	    octagon_map(sym, &x, &y);
+	    if (y*7+x != hole)
+		continue;
+
+	    assert(strlen(p) == 4*35);
+	    for (i = 0; i < 2*35; i++, p += 2) {
+		x = p[0] - '0';
+		y = p[1] - '0';
+		octagon_map(sym, &x, &y);
+		path[i] = y*7+x;
+	    }
+	    return encode_solve_path(7, path, 35);
+	}
+
+    return NULL;
+}
+
 static char *new_game_desc(const game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
@@ -514,7 +946,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 
     grid = snewn(w*h, unsigned char);
     if (params->type == TYPE_RANDOM) {
-	pegs_generate(grid, w, h, rs);
+	int *path = snewn(2*w*h, int);
+	int n = pegs_generate(grid, w, h, rs, path);
+
+	if (n > 0)
+	    *aux = encode_solve_path(w, path, n);
+	sfree(path);
     } else {
 	int x, y, cx, cy, v;
 
@@ -643,6 +1080,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 		}
 		break;
 	    }
+
+	    *aux = octagon_aux(grid);
 	}
     }
 
@@ -690,6 +1129,9 @@ static game_state *new_game(midend *me, const game_params *params,
     state->w = w;
     state->h = h;
     state->completed = 0;
+    state->used_solve = FALSE;
+    state->solvepath = NULL;
+    state->solvelen = 0;
     state->grid = snewn(w*h, unsigned char);
     for (i = 0; i < w*h; i++)
 	state->grid[i] = (desc[i] == 'P' ? GRID_PEG :
@@ -706,8 +1148,11 @@ static game_state *dup_game(const game_state *state)
     ret->w = state->w;
     ret->h = state->h;
     ret->completed = state->completed;
+    ret->used_solve = state->used_solve;
     ret->grid = snewn(w*h, unsigned char);
     memcpy(ret->grid, state->grid, w*h);
+    ret->solvepath = NULL;
+    ret->solvelen = 0;
 
     return ret;
 }
@@ -715,13 +1160,105 @@ static game_state *dup_game(const game_state *state)
 static void free_game(game_state *state)
 {
     sfree(state->grid);
+    sfree(state->solvepath);
     sfree(state);
 }
 
+/*
+ * Make one jump on a grid, if it is legal. Returns FALSE (leaving the
+ * grid alone) if it isn't.
+ */
+static int make_jump(unsigned char *grid, int w, int h,
+		     int sx, int sy, int tx, int ty)
+{
+    int mx, my, dx, dy;
+
+    if (sx < 0 || sx >= w || sy < 0 || sy >= h)
+	return FALSE;		       /* source out of range */
+    if (tx < 0 || tx >= w || ty < 0 || ty >= h)
+	return FALSE;		       /* target out of range */
+
+    dx = tx - sx;
+    dy = ty - sy;
+    if (max(abs(dx),abs(dy)) != 2 || min(abs(dx),abs(dy)) != 0)
+	return FALSE;		       /* move length was wrong */
+    mx = sx + dx/2;
+    my = sy + dy/2;
+
+    if (grid[sy*w+sx] != GRID_PEG ||
+	grid[my*w+mx] != GRID_PEG ||
+	grid[ty*w+tx] != GRID_HOLE)
+	return FALSE;		       /* grid contents were invalid */
+
+    grid[sy*w+sx] = GRID_HOLE;
+    grid[my*w+mx] = GRID_HOLE;
+    grid[ty*w+tx] = GRID_PEG;
+    return TRUE;
+}
+
 static char *solve_game(const game_state *state, const game_state *currstate,
                         const char *aux, char **error)
 {
-    return NULL;
+    int w = state->w, h = state->h, *path, *known = NULL, nknown = 0, n;
+    char *ret;
+
+    if (aux)
+	nknown = decode_solve_path(aux, w, h, &known);
+    if (nknown > 0) {
+	/*
+	 * If the player is still on the path of the solution we
+	 * generated the board with, finish off that.
+	 */
+	unsigned char *grid = snewn(w*h, unsigned char);
+	int i;
+
+	memcpy(grid, state->grid, w*h);
+	for (i = 0; i < nknown; i++) {
+	    if (!memcmp(grid, currstate->grid, w*h)) {
+		ret = encode_solve_path(w, known + 2*i, nknown - i);
+		sfree(grid);
+		sfree(known);
+		return ret;
+	    }
+	    if (!make_jump(grid, w, h, known[2*i] % w, known[2*i] / w,
+			   known[2*i+1] % w, known[2*i+1] / w))
+		break;
+	}
+	sfree(grid);
+    } else
+	nknown = 0;
+
+    n = pegs_solve(currstate->grid, w, h, known, nknown, &path);
+    sfree(known);
+    if (n <= 0) {
+	*error = (n < 0 ? _("Unable to solve puzzle") :
+		  _("No solution exists for this position"));
+	return NULL;
+    }
+
+    ret = encode_solve_path(w, path, n);
+    sfree(path);
+    return ret;
+}
+
+/*
+ * Apply the first nsteps jumps of a solve path to a copy of base's
+ * grid.
+ */
+static void replay_path(const game_state *base, const int *path, int nsteps,
+			unsigned char *grid)
+{
+    int w = base->w, i;
+
+    memcpy(grid, base->grid, base->w * base->h);
+    for (i = 0; i < nsteps; i++) {
+	int from = path[2*i], to = path[2*i+1];
+	int fx = from % w, fy = from / w, tx = to % w, ty = to / w;
+
+	grid[from] = GRID_HOLE;
+	grid[((fy+ty)/2)*w + (fx+tx)/2] = GRID_HOLE;
+	grid[to] = GRID_PEG;
+    }
 }
 
 static int game_can_format_as_text_now(const game_params *params)
@@ -803,12 +1340,13 @@ static void game_changed_state(game_ui *ui, const game_state *oldstate,
                                const game_state *newstate)
 {
     /*
-     * Cancel a drag, in case the source square has become
-     * unoccupied.
+     * Cancel a drag, or a keyboard jump, in case the source square
+     * has become unoccupied (Solve's replay can empty any square).
      */
     ui->dragging = FALSE;
+    ui->cur_jumping = FALSE;
 #ifdef ANDROID
-    if (newstate->completed && oldstate && ! oldstate->completed) android_completed();
+    if (newstate->completed && ! newstate->used_solve && oldstate && ! oldstate->completed) android_completed();
 #endif
 }
 
@@ -966,30 +1504,44 @@ static game_state *execute_move(const game_state *state, const char *move)
     int sx, sy, tx, ty;
     game_state *ret;
 
-    if (sscanf(move, "%d,%d-%d,%d", &sx, &sy, &tx, &ty) == 4) {
-	int mx, my, dx, dy;
-
-	if (sx < 0 || sx >= w || sy < 0 || sy >= h)
-	    return NULL;	       /* source out of range */
-	if (tx < 0 || tx >= w || ty < 0 || ty >= h)
-	    return NULL;	       /* target out of range */
+    if (move[0] == 'S') {
+	/*
+	 * A solve: a list of jumps. Remember them so that the solve
+	 * can be animated.
+	 */
+	int *path, n, i, count;
 
-	dx = tx - sx;
-	dy = ty - sy;
-	if (max(abs(dx),abs(dy)) != 2 || min(abs(dx),abs(dy)) != 0)
-	    return NULL;	       /* move length was wrong */
-	mx = sx + dx/2;
-	my = sy + dy/2;
+	n = decode_solve_path(move, w, h, &path);
+	if (n <= 0) {
+	    sfree(path);
+	    return NULL;
+	}
 
-	if (state->grid[sy*w+sx] != GRID_PEG ||
-	    state->grid[my*w+mx] != GRID_PEG ||
-	    state->grid[ty*w+tx] != GRID_HOLE)
-	    return NULL;	       /* grid contents were invalid */
+	ret = dup_game(state);
+	for (i = 0; i < n; i++)
+	    if (!make_jump(ret->grid, w, h, path[2*i] % w, path[2*i] / w,
+			   path[2*i+1] % w, path[2*i+1] / w)) {
+		sfree(path);
+		free_game(ret);
+		return NULL;
+	    }
+	ret->solvepath = path;
+	ret->solvelen = n;
+	ret->used_solve = TRUE;
+	for (i = count = 0; i < w*h; i++)
+	    if (ret->grid[i] == GRID_PEG)
+		count++;
+	if (count == 1)
+	    ret->completed = 1;
+	return ret;
+    }
 
+    if (sscanf(move, "%d,%d-%d,%d", &sx, &sy, &tx, &ty) == 4) {
 	ret = dup_game(state);
-	ret->grid[sy*w+sx] = GRID_HOLE;
-	ret->grid[my*w+mx] = GRID_HOLE;
-	ret->grid[ty*w+tx] = GRID_PEG;
+	if (!make_jump(ret->grid, w, h, sx, sy, tx, ty)) {
+	    free_game(ret);
+	    return NULL;
+	}
 
         /*
          * Opinion varies on whether getting to a single peg counts as
@@ -1126,6 +1678,25 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
     int w = state->w, h = state->h;
     int x, y;
     int bgcolour;
+    const unsigned char *grid = state->grid;
+    unsigned char *animgrid = NULL;
+
+    if (oldstate && (dir > 0 ? state : oldstate)->solvepath) {
+	/*
+	 * Animating a solve (or its undo): show the grid as it is
+	 * part way along the path of jumps.
+	 */
+	const game_state *base = (dir > 0 ? oldstate : state);
+	const game_state *solved = (dir > 0 ? state : oldstate);
+	int k = (int)(animtime / SOLVE_ANIM_TIME) + 1;
+
+	if (k > solved->solvelen)
+	    k = solved->solvelen;
+	animgrid = snewn(w*h, unsigned char);
+	replay_path(base, solved->solvepath,
+		    dir > 0 ? k : solved->solvelen - k, animgrid);
+	grid = animgrid;
+    }
 
     if (flashtime > 0) {
         int frame = (int)(flashtime / FLASH_FRAME);
@@ -1241,7 +1812,7 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 	for (x = 0; x < w; x++) {
 	    int v;
 
-	    v = state->grid[y*w+x];
+	    v = grid[y*w+x];
 	    /*
 	     * Blank the source of a drag so it looks as if the
 	     * user picked the peg up physically.
@@ -1272,18 +1843,24 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
     }
 
     ds->bgcolour = bgcolour;
+    sfree(animgrid);
 }
 
 static float game_anim_length(const game_state *oldstate,
                               const game_state *newstate, int dir, game_ui *ui)
 {
+    const game_state *s = (dir > 0 ? newstate : oldstate);
+
+    if (s->solvepath)
+	return s->solvelen * SOLVE_ANIM_TIME;
     return 0.0F;
 }
 
 static float game_flash_length(const game_state *oldstate,
                                const game_state *newstate, int dir, game_ui *ui)
 {
-    if (!oldstate->completed && newstate->completed)
+    if (!oldstate->completed && newstate->completed &&
+	!oldstate->used_solve && !newstate->used_solve)
         return 2 * FLASH_FRAME;
     else
         return 0.0F;
@@ -1332,7 +1909,7 @@ const struct game thegame = {
     new_game,
     dup_game,
     free_game,
-    FALSE, solve_game,
+    TRUE, solve_game,
     TRUE, game_can_format_as_text_now, game_text_format,
     new_ui,
     free_ui,
@@ -1356,7 +1933,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    0,				       /* flags */
+    SOLVE_ANIMATES,		       /* flags */
 };
 
 /* vim: set shiftwidth=4 tabstop=8: */
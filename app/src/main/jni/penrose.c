@@ -235,177 +235,185 @@ static vector xform_coord(vector vo, int shrink, vector vtrans, int ang)
 
 #define XFORM(n,o,s,a) vs[(n)] = xform_coord(v_edge, (s), vs[(o)], (a))
 
-static int penrose_p2_small(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge);
-
-static int penrose_p2_large(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge)
-{
-    vector vv_orig, vv_edge;
-
-#ifdef DEBUG_PENROSE
-    {
-        vector vs[3];
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, 0);
-        XFORM(2, 0, 0, -36*flip);
-
-        state->new_tile(state, vs, 3, depth);
-    }
-#endif
-
-    if (flip > 0) {
-        vector vs[4];
-
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, -36);
-        XFORM(2, 0, 0, 0);
-        XFORM(3, 0, 0, 36);
-
-        state->new_tile(state, vs, 4, depth);
-    }
-    if (depth >= state->max_depth) return 0;
-
-    vv_orig = v_trans(v_orig, v_rotate(v_edge, -36*flip));
-    vv_edge = v_rotate(v_edge, 108*flip);
+/*
+ * The deflation is done with an explicit stack of half-tiles rather
+ * than by recursion, so that we can throw away whole subtrees which
+ * can't reach the clipping rectangle before generating any of them.
+ * Each half-tile deflates into at most three, which it stacks in
+ * reverse order so that tiles come out in the same order as a
+ * depth-first recursion would produce them.
+ */
 
-    penrose_p2_small(state, depth+1, flip,
-                     v_orig, v_shrinkphi(v_edge));
+enum { P2_LARGE, P2_SMALL, P3_LARGE, P3_SMALL };
 
-    penrose_p2_large(state, depth+1, flip,
-                     vv_orig, v_shrinkphi(vv_edge));
-    penrose_p2_large(state, depth+1, -flip,
-                     vv_orig, v_shrinkphi(vv_edge));
+typedef struct halftile {
+    int type, depth, flip;
+    vector v_orig, v_edge;
+} halftile;
 
-    return 0;
-}
+#define PUSH(t,f,o,e) do { \
+    stack[sp].type = (t); stack[sp].depth = depth+1; \
+    stack[sp].flip = (f); stack[sp].v_orig = (o); stack[sp].v_edge = (e); \
+    sp++; \
+} while (0)
 
-static int penrose_p2_small(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge)
+/*
+ * Work out whether any leaf tile descended from this half-tile can
+ * land inside the clipping rectangle. The half-tile's children
+ * exactly cover its triangle, but each leaf tile is made of two
+ * halves, one of which may poke out of its ancestors' triangle; so
+ * we allow a margin of a leaf tile's longest edge.
+ */
+static int halftile_clipped(penrose_state *state, const halftile *t)
 {
-    vector vv_orig;
+    vector v_orig = t->v_orig, v_edge = t->v_edge;
+    vector vs[3];
+    double margin, x, y, xmin, xmax, ymin, ymax;
+    int i;
 
-#ifdef DEBUG_PENROSE
-    {
-        vector vs[3];
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, 0);
-        XFORM(2, 0, -1, -36*flip);
+    if (!state->clip)
+        return 0;
 
-        state->new_tile(state, vs, 3, depth);
+    vs[0] = v_orig;
+    switch (t->type) {
+      case P2_LARGE:
+        XFORM(1, 0, 0, 0);
+        XFORM(2, 0, 0, -36*t->flip);
+        break;
+      case P2_SMALL:
+        XFORM(1, 0, 0, 0);
+        XFORM(2, 0, -1, -36*t->flip);
+        break;
+      case P3_LARGE:
+        XFORM(1, 0, 1, 0);
+        XFORM(2, 0, 0, -36*t->flip);
+        break;
+      default:
+        XFORM(1, 0, 0, 0);
+        XFORM(2, 0, 0, -36*t->flip);
+        break;
     }
-#endif
 
-    if (flip > 0) {
-        vector vs[4];
-
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, -72);
-        XFORM(2, 0, -1, -36);
-        XFORM(3, 0, 0, 0);
-
-        state->new_tile(state, vs, 4, depth);
+    xmin = xmax = v_x(vs, 0);
+    ymin = ymax = v_y(vs, 0);
+    for (i = 1; i < 3; i++) {
+        x = v_x(vs, i);
+        y = v_y(vs, i);
+        if (x < xmin) xmin = x;
+        if (x > xmax) xmax = x;
+        if (y < ymin) ymin = y;
+        if (y > ymax) ymax = y;
     }
 
-    if (depth >= state->max_depth) return 0;
-
-    vv_orig = v_trans(v_orig, v_edge);
-
-    penrose_p2_large(state, depth+1, -flip,
-                     v_orig, v_shrinkphi(v_rotate(v_edge, -36*flip)));
-
-    penrose_p2_small(state, depth+1, flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, -144*flip)));
-
-    return 0;
+    margin = penrose_side_length(state->start_size, state->max_depth) *
+        PHI + 1;
+    return (xmax + margin < state->xmin || xmin - margin > state->xmax ||
+            ymax + margin < state->ymin || ymin - margin > state->ymax);
 }
 
-static int penrose_p3_small(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge);
-
-static int penrose_p3_large(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge)
+static void penrose_deflate(penrose_state *state, halftile first)
 {
-    vector vv_orig;
+    halftile *stack = snewn(3 * (state->max_depth + 1) + 1, halftile);
+    int sp = 0;
 
-#ifdef DEBUG_PENROSE
-    {
-        vector vs[3];
-        vs[0] = v_orig;
-        XFORM(1, 0, 1, 0);
-        XFORM(2, 0, 0, -36*flip);
-
-        state->new_tile(state, vs, 3, depth);
-    }
-#endif
-
-    if (flip > 0) {
-        vector vs[4];
-
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, -36);
-        XFORM(2, 0, 1, 0);
-        XFORM(3, 0, 0, 36);
-
-        state->new_tile(state, vs, 4, depth);
-    }
-    if (depth >= state->max_depth) return 0;
+    stack[sp++] = first;
 
-    vv_orig = v_trans(v_orig, v_edge);
+    while (sp > 0) {
+        halftile t = stack[--sp];
+        vector v_orig = t.v_orig, v_edge = t.v_edge, vv_orig, vv_edge;
+        int depth = t.depth, flip = t.flip;
 
-    penrose_p3_large(state, depth+1, -flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, 180)));
+        if (halftile_clipped(state, &t))
+            continue;
 
-    penrose_p3_small(state, depth+1, flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, -108*flip)));
-
-    vv_orig = v_trans(v_orig, v_growphi(v_edge));
-
-    penrose_p3_large(state, depth+1, flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, -144*flip)));
+#ifdef DEBUG_PENROSE
+        {
+            vector vs[3];
+            vs[0] = v_orig;
+            switch (t.type) {
+              case P2_LARGE:
+                XFORM(1, 0, 0, 0); XFORM(2, 0, 0, -36*flip); break;
+              case P2_SMALL:
+                XFORM(1, 0, 0, 0); XFORM(2, 0, -1, -36*flip); break;
+              case P3_LARGE:
+                XFORM(1, 0, 1, 0); XFORM(2, 0, 0, -36*flip); break;
+              default:
+                XFORM(1, 0, 0, 0); XFORM(2, 0, 0, -36*flip); break;
+            }
+            state->new_tile(state, vs, 3, depth);
+        }
+#endif
 
+        if (flip > 0) {
+            vector vs[4];
+
+            vs[0] = v_orig;
+            switch (t.type) {
+              case P2_LARGE:
+                XFORM(1, 0, 0, -36);
+                XFORM(2, 0, 0, 0);
+                XFORM(3, 0, 0, 36);
+                break;
+              case P2_SMALL:
+                XFORM(1, 0, 0, -72);
+                XFORM(2, 0, -1, -36);
+                XFORM(3, 0, 0, 0);
+                break;
+              case P3_LARGE:
+                XFORM(1, 0, 0, -36);
+                XFORM(2, 0, 1, 0);
+                XFORM(3, 0, 0, 36);
+                break;
+              default:
+                XFORM(1, 0, 0, -36);
+                XFORM(3, 0, 0, 0);
+                XFORM(2, 3, 0, -36);
+                break;
+            }
+
+            state->new_tile(state, vs, 4, depth);
+        }
+        if (depth >= state->max_depth) continue;
 
-    return 0;
-}
+        switch (t.type) {
+          case P2_LARGE:
+            vv_orig = v_trans(v_orig, v_rotate(v_edge, -36*flip));
+            vv_edge = v_rotate(v_edge, 108*flip);
 
-static int penrose_p3_small(penrose_state *state, int depth, int flip,
-                            vector v_orig, vector v_edge)
-{
-    vector vv_orig;
+            PUSH(P2_LARGE, -flip, vv_orig, v_shrinkphi(vv_edge));
+            PUSH(P2_LARGE, flip, vv_orig, v_shrinkphi(vv_edge));
+            PUSH(P2_SMALL, flip, v_orig, v_shrinkphi(v_edge));
+            break;
 
-#ifdef DEBUG_PENROSE
-    {
-        vector vs[3];
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, 0);
-        XFORM(2, 0, 0, -36*flip);
+          case P2_SMALL:
+            vv_orig = v_trans(v_orig, v_edge);
 
-        state->new_tile(state, vs, 3, depth);
-    }
-#endif
+            PUSH(P2_SMALL, flip,
+                 vv_orig, v_shrinkphi(v_rotate(v_edge, -144*flip)));
+            PUSH(P2_LARGE, -flip,
+                 v_orig, v_shrinkphi(v_rotate(v_edge, -36*flip)));
+            break;
 
-    if (flip > 0) {
-        vector vs[4];
+          case P3_LARGE:
+          case P3_SMALL:
+            /* A large P3 tile deflates to one more tile than a small
+             * one; the other two are the same as a small one's. */
+            if (t.type == P3_LARGE)
+                PUSH(P3_LARGE, flip, v_trans(v_orig, v_growphi(v_edge)),
+                     v_shrinkphi(v_rotate(v_edge, -144*flip)));
 
-        vs[0] = v_orig;
-        XFORM(1, 0, 0, -36);
-        XFORM(3, 0, 0, 0);
-        XFORM(2, 3, 0, -36);
+            vv_orig = v_trans(v_orig, v_edge);
 
-        state->new_tile(state, vs, 4, depth);
+            PUSH(P3_SMALL, flip,
+                 vv_orig, v_shrinkphi(v_rotate(v_edge, -108*flip)));
+            PUSH(P3_LARGE, -flip,
+                 vv_orig, v_shrinkphi(v_rotate(v_edge, 180)));
+            break;
+        }
+        assert(sp <= 3 * (state->max_depth + 1) + 1);
     }
-    if (depth >= state->max_depth) return 0;
 
-    /* NB these two are identical to the first two of p3_large. */
-    vv_orig = v_trans(v_orig, v_edge);
-
-    penrose_p3_large(state, depth+1, -flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, 180)));
-
-    penrose_p3_small(state, depth+1, flip,
-                     vv_orig, v_shrinkphi(v_rotate(v_edge, -108*flip)));
-
-    return 0;
+    sfree(stack);
 }
 
 /* -------------------------------------------------------
@@ -438,6 +446,7 @@ int penrose(penrose_state *state, int which, int angle)
 {
     vector vo = v_origin();
     vector vb = v_origin();
+    halftile first;
 
     vo.b = vo.c = -state->start_size;
     vo = v_shrinkphi(v_shrinkphi(vo));
@@ -447,10 +456,14 @@ int penrose(penrose_state *state, int which, int angle)
     vo = v_rotate(vo, angle);
     vb = v_rotate(vb, angle);
 
-    if (which == PENROSE_P2)
-        return penrose_p2_large(state, 0, 1, vo, vb);
-    else
-        return penrose_p3_small(state, 0, 1, vo, vb);
+    first.type = (which == PENROSE_P2 ? P2_LARGE : P3_SMALL);
+    first.depth = 0;
+    first.flip = 1;
+    first.v_orig = vo;
+    first.v_edge = vb;
+    penrose_deflate(state, first);
+
+    return 0;
 }
 
 /*
@@ -576,6 +589,7 @@ int main(int argc, char *argv[])
     ps.start_size = atoi(argv[1]);
     ps.max_depth = atoi(argv[2]);
     ps.new_tile = test_cb;
+    ps.clip = 0;
 
     ntiles = nfinal = 0;
 
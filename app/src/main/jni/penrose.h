@@ -7,7 +7,8 @@
  * four sets of two pairs kite/dart, or thin/thick rhombus).
  *
  * You supply a callback function and a context pointer, which is
- * called with each tile in turn: you choose how many times to recurse.
+ * called with each tile in turn: you choose how many times to recurse,
+ * and optionally a rectangle outside which you aren't interested.
  */
 
 #ifndef _PENROSE_H
@@ -38,6 +39,12 @@ struct penrose_state {
 
     tile_callback new_tile;
     void *ctx;          /* for callback */
+
+    /* If clip is set, tiles which can't have any descendant lying
+     * inside this rectangle are neither deflated nor passed to the
+     * callback. */
+    int clip;
+    double xmin, xmax, ymin, ymax;
 };
 
 enum { PENROSE_P2, PENROSE_P3 };
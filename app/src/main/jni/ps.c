@@ -18,6 +18,7 @@ struct psdata {
     int clipped;
     float hatchthick, hatchspace;
     int gamewidth, gameheight;
+    int pages, pages_atend;
     drawing *drawing;
 };
 
@@ -293,7 +294,13 @@ static void ps_begin_doc(void *handle, int pages)
     fputs("%%Creator: Simon Tatham's Portable Puzzle Collection\n", ps->fp);
     fputs("%%DocumentData: Clean7Bit\n", ps->fp);
     fputs("%%LanguageLevel: 1\n", ps->fp);
-    fprintf(ps->fp, "%%%%Pages: %d\n", pages);
+    /* A streaming document doesn't know yet; see ps_end_doc */
+    ps->pages_atend = pages < 0;
+    ps->pages = 0;
+    if (ps->pages_atend)
+	fputs("%%Pages: (atend)\n", ps->fp);
+    else
+	fprintf(ps->fp, "%%%%Pages: %d\n", pages);
     fputs("%%DocumentNeededResources:\n", ps->fp);
     fputs("%%+ font Helvetica\n", ps->fp);
     fputs("%%+ font Courier\n", ps->fp);
@@ -371,12 +378,15 @@ static void ps_end_page(void *handle, int number)
     psdata *ps = (psdata *)handle;
 
     fputs("restore grestore showpage\n", ps->fp);
+    ps->pages++;
 }
 
 static void ps_end_doc(void *handle)
 {
     psdata *ps = (psdata *)handle;
 
+    if (ps->pages_atend)
+	fprintf(ps->fp, "%%%%Trailer\n%%%%Pages: %d\n", ps->pages);
     fputs("%%EOF\n", ps->fp);
 }
 
@@ -417,6 +427,7 @@ psdata *ps_init(FILE *outfile, int colour)
     ps->ytop = 0;
     ps->clipped = FALSE;
     ps->hatchthick = ps->hatchspace = ps->gamewidth = ps->gameheight = 0;
+    ps->pages = ps->pages_atend = 0;
     ps->drawing = drawing_new(&ps_drawing, NULL, ps);
 
     return ps;
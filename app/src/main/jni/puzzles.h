@@ -76,6 +76,16 @@ enum {
 #define REQUIRE_RBUTTON ( 1 << 10 )
 /* Pocket PC: Game requires numeric input */
 #define REQUIRE_NUMPAD ( 1 << 11 )
+/* Flag indicating that new_desc calls random_gen_attempt() as it
+ * retries, so attempts on several seeds can usefully race */
+#define GEN_RACES ( 1 << 12 )
+/* Flag indicating that interpret_move follows the path of a drag, so
+ * a front end must deliver every drag event rather than only the latest */
+#define DRAG_FOLLOWS_PATH ( 1 << 13 )
+/* Flag indicating that solve(orig, orig, NULL) gives a string that can
+ * be kept as aux info: given it, solve() returns it unchanged whatever
+ * the current state, so the midend may remember it for the game */
+#define SOLUTION_CACHEABLE ( 1 << 14 )
 /* end of `flags' word definitions */
 
 #ifdef _WIN32_WCE
@@ -92,6 +102,7 @@ typedef struct frontend frontend;
 typedef struct config_item config_item;
 typedef struct midend midend;
 typedef struct random_state random_state;
+typedef struct gen_ctx gen_ctx;
 typedef struct game_params game_params;
 typedef struct game_state game_state;
 typedef struct game_ui game_ui;
@@ -201,6 +212,7 @@ void unclip(drawing *dr);
 void start_draw(drawing *dr);
 void draw_update(drawing *dr, int x, int y, int w, int h);
 void end_draw(drawing *dr);
+int drawing_call_count(drawing *dr);
 char *text_fallback(drawing *dr, const char *const *strings, int nstrings);
 void status_bar(drawing *dr, char *text);
 blitter *blitter_new(drawing *dr, int w, int h);
@@ -213,7 +225,7 @@ void blitter_save(drawing *dr, blitter *bl, int x, int y);
 #define BLITTER_FROMSAVED (-1)
 void blitter_load(drawing *dr, blitter *bl, int x, int y);
 #ifndef NO_PRINTING
-void print_begin_doc(drawing *dr, int pages);
+void print_begin_doc(drawing *dr, int pages); /* pages < 0: not known yet */
 void print_begin_page(drawing *dr, int number);
 void print_begin_puzzle(drawing *dr, float xm, float xc,
 			float ym, float yc, int pw, int ph, float wmm,
@@ -243,6 +255,7 @@ midend *midend_new(frontend *fe, const game *ourgame,
 void midend_free(midend *me);
 const game *midend_which_game(midend *me);
 void midend_set_params(midend *me, game_params *params);
+void midend_set_seed(midend *me, const char *seed);
 game_params *midend_get_params(midend *me);
 void midend_size(midend *me, int *x, int *y, int user_size);
 void midend_reset_tilesize(midend *me);
@@ -255,6 +268,7 @@ void midend_redraw(midend *me);
 float *midend_colours(midend *me, int *ncolours);
 void midend_freeze_timer(midend *me, float tprop);
 void midend_timer(midend *me, float tplus);
+float midend_timer_due(midend *me);
 int midend_num_presets(midend *me);
 void midend_fetch_preset(midend *me, int n,
                          char **name, game_params **params, char **encoded);
@@ -269,9 +283,17 @@ char *midend_get_game_id(midend *me);
 char *midend_get_current_params(midend *me, int full);
 char *midend_config_to_encoded_params(midend *me, config_item *cfg, char **encoded);
 char *midend_get_random_seed(midend *me);
+void midend_set_gen_ctx(midend *me, gen_ctx *ctx);
+char *midend_get_stats(midend *me);
+void midend_reset_stats(midend *me);
 int midend_can_format_as_text_now(midend *me);
 char *midend_text_format(midend *me);
 char *midend_solve(midend *me);
+int midend_wants_solution(midend *me);
+char *midend_solve_game_id(const game *g, const char *id, char **error);
+void midend_supply_solution(midend *me, const char *id, const char *soln);
+const char *midend_get_aux_info(midend *me);
+void midend_set_aux_info(midend *me, const char *aux);
 int midend_status(midend *me);
 int midend_can_undo(midend *me);
 int midend_can_redo(midend *me);
@@ -280,6 +302,9 @@ char *midend_rewrite_statusbar(midend *me, char *text);
 void midend_serialise(midend *me,
                       void (*write)(void *ctx, void *buf, int len),
                       void *wctx);
+void midend_serialise_compact(midend *me,
+                              void (*write)(void *ctx, void *buf, int len),
+                              void *wctx);
 char *midend_deserialise(midend *me,
                          int (*read)(void *ctx, void *buf, int len),
                          void *rctx);
@@ -305,6 +330,37 @@ char *dupstr(const char *s);
 #define sresize(array, number, type) \
     ( (type *) srealloc ((array), (number) * sizeof (type)) )
 
+/*
+ * Optional accounting of the above, in bytes, overall and by what
+ * each thread said it was doing at the time.
+ */
+enum { HEAP_OTHER, HEAP_GENERATE, HEAP_SOLVE, HEAP_HISTORY, HEAP_DRAWING,
+       NHEAPTAGS };
+struct heap_usage {
+    unsigned long allocs;
+    long long allocated, live, peak;
+};
+int heap_accounting_start(void);
+int heap_tag(int tag);
+int heap_get_usage(struct heap_usage *total, struct heap_usage *tags);
+char *heap_get_stats(void);
+
+/*
+ * An arena hands out memory that can't be freed piece by piece, only
+ * all at once by arena_reset() or arena_free(): much cheaper than
+ * smalloc for the swarms of small blocks a single generation or
+ * solving attempt makes and then throws away.
+ */
+typedef struct arena arena;
+arena *arena_new(void);
+void *arena_alloc(arena *a, size_t size);
+void arena_reset(arena *a);
+void arena_free(arena *a);
+#define anew(a, type) \
+    ( (type *) arena_alloc ((a), sizeof (type)) )
+#define anewn(a, number, type) \
+    ( (type *) arena_alloc ((a), (number) * sizeof (type)) )
+
 /*
  * misc.c
  */
@@ -347,6 +403,19 @@ void pos2c(int w, int h, int pos, int *cx, int *cy);
 void draw_text_outline(drawing *dr, int x, int y, int fonttype,
                        int fontsize, int align,
                        int text_colour, int outline_colour, char *text);
+
+/* Refcounted blocks for data that's fixed once new_game has set it up
+ * (clues, fixed cells, barriers), so that dup_game can share it rather
+ * than copy it on every move. shared_new returns an uninitialised block
+ * with one reference; shared_ref adds one and returns the block;
+ * shared_free drops one (NULL is fine). Anything that must write to a
+ * block after it might have been shared calls shared_unshare first,
+ * which returns a private copy if there are other references. */
+void *shared_new(int size);
+void *shared_dup(const void *data, int size);
+void *shared_ref(void *p);
+void shared_free(void *p);
+void *shared_unshare(void *p);
 /*
  * dsf.c
  */
@@ -370,6 +439,24 @@ void edsf_merge(int *dsf, int v1, int v2, int inverse);
 void dsf_merge(int *dsf, int v1, int v2);
 void dsf_init(int *dsf, int len);
 
+/* An undoable dsf, for solvers that make speculative merges and then
+ * back out of them. It uses union by size and never compresses paths,
+ * so that every merge changes one element and can be undone: roll back
+ * to the value udsf_checkpoint returned to forget all the merges since.
+ * Unlike the int-array dsf, the canonical element of a class need not
+ * be its smallest. */
+typedef struct udsf udsf;
+udsf *udsf_new(int size);
+void udsf_free(udsf *u);
+void udsf_init(udsf *u);	       /* forget all merges and checkpoints */
+int udsf_canonify(udsf *u, int val);
+int udsf_edsf_canonify(udsf *u, int val, int *inverse);
+int udsf_size(udsf *u, int val);
+void udsf_merge(udsf *u, int v1, int v2);
+void udsf_edsf_merge(udsf *u, int v1, int v2, int inverse);
+int udsf_checkpoint(udsf *u);
+void udsf_rollback(udsf *u, int checkpoint);
+
 /*
  * tdq.c
  */
@@ -407,6 +494,48 @@ void tdq_add(tdq *tdq, int k);
 int tdq_remove(tdq *tdq);        /* returns -1 if nothing available */
 void tdq_fill(tdq *tdq);         /* add everything to the tdq at once */
 
+/*
+ * A prioritised to-do queue, for solvers with several kinds of
+ * deduction to keep track of. It holds `nprio' (at most 8) independent
+ * sets of integers from 0 to n-1, one per priority level; an integer
+ * can be pending at several levels at once, but at most once at each,
+ * just as in a tdq. Level 0 is the most urgent, so that's where the
+ * cheapest deductions' work should go.
+ *
+ * Members of a level come out in increasing order rather than the
+ * order they went in. ptdq_next(q, prio, k) removes and returns the
+ * smallest member of level prio that is at least k, or -1 if none, so
+ *
+ *     for (i = 0; (i = ptdq_next(q, prio, i)) >= 0; i++)
+ *
+ * visits things in exactly the order that a sweep over an array of
+ * to-do flags would, and a solver written that way can move on to a
+ * ptdq without changing what it deduces. The search steps over a
+ * word's worth of clean entries at a time, so a sweep costs little
+ * more than the work it finds. (But every operation is a function
+ * call, so a solver that marks and sweeps a few hundred flags
+ * millions of times may still be better off with its own array.)
+ *
+ * ptdq_remove takes the smallest member of the most urgent nonempty
+ * level, returning that level in *prio if prio is non-NULL, or -1 if
+ * every level is empty.
+ *
+ * Any of the functions which add things can be passed PTDQ_ALL as the
+ * level, to add to every level at once. ptdq_add_range adds the whole
+ * range [lo,hi). The queue starts off empty, and ptdq_copy duplicates
+ * one, for solvers that recurse.
+ */
+typedef struct ptdq ptdq;
+#define PTDQ_ALL (-1)
+ptdq *ptdq_new(int n, int nprio);
+ptdq *ptdq_copy(const ptdq *q);
+void ptdq_free(ptdq *q);
+void ptdq_add(ptdq *q, int prio, int k);
+void ptdq_add_range(ptdq *q, int prio, int lo, int hi);
+void ptdq_fill(ptdq *q, int prio);
+int ptdq_next(ptdq *q, int prio, int k);
+int ptdq_remove(ptdq *q, int *prio);
+
 /*
  * laydomino.c
  */
@@ -421,13 +550,59 @@ extern char ver[];
 /*
  * random.c
  */
+/* Game seeds starting with this use a faster generator; see random.c */
+#define RANDOM_FAST_PREFIX '@'
 random_state *random_new(const char *seed, int len);
+random_state *random_new_seed(const char *seed);
+char *random_new_seed_string(random_state *rs);
 random_state *random_copy(random_state *tocopy);
+int random_is_fast(const random_state *state);
 unsigned long random_bits(random_state *state, int bits);
 unsigned long random_upto(random_state *state, unsigned long limit);
 void random_free(random_state *state);
 char *random_state_encode(random_state *state);
 random_state *random_state_decode(const char *input);
+/*
+ * A generation context rides along on the random_state a game is
+ * generated from, so that new_desc can notice cancellation and report
+ * progress without any change to its interface. Retry loops call
+ * random_gen_attempt() each time an attempt is rejected, with the
+ * difficulty it reached; if that returns TRUE, the generator should
+ * give up and return whatever puzzle it has, which will be discarded.
+ * A single attempt that can take a long time may also stop early if
+ * random_gen_cancelled() says so. Cancelling a context also cancels
+ * any whose parent it is.
+ *
+ * A context (or any parent) may also have a time budget, after which
+ * the generator should settle for the best puzzle it can offer now
+ * rather than hold out for exactly what was asked. random_gen_used()
+ * says how much of the budget has gone; a generator whose attempt is
+ * a valid puzzle, only easier than asked, calls random_gen_settle(),
+ * and keeps that puzzle if it returns TRUE. Generators can also relax
+ * other constraints partway through the budget, and say so with
+ * random_gen_relax(). Either way the context's relaxed mask records
+ * it, and since the result then depends on timing, the midend doesn't
+ * offer the game's seed as a way to reproduce it.
+ */
+#define GEN_RELAXED_DIFFICULTY 1
+#define GEN_RELAXED_SYMMETRY   2
+struct gen_ctx {
+    volatile int cancelled;            /* may be set from any thread */
+    int attempts, best;                /* best is -1 until an attempt */
+    void (*progress)(void *ctx, int attempts, int best);
+    void *progress_ctx;
+    gen_ctx *parent;
+    double start, budget;              /* ms, CLOCK_MONOTONIC; budget 0 for none */
+    int relaxed;                       /* GEN_RELAXED_* */
+};
+void gen_ctx_init(gen_ctx *ctx);
+void gen_ctx_set_budget(gen_ctx *ctx, double budget_ms);
+void random_set_gen_ctx(random_state *state, gen_ctx *ctx);
+int random_gen_attempt(random_state *state, int difficulty);
+int random_gen_cancelled(random_state *state);
+double random_gen_used(random_state *state);
+int random_gen_settle(random_state *state, int relaxed);
+void random_gen_relax(random_state *state, int relaxed);
 /* random.c also exports SHA, which occasionally comes in useful. */
 #if __STDC_VERSION__ >= 199901L
 #include <stdint.h>
@@ -452,6 +627,7 @@ void SHA_Simple(const void *p, int len, unsigned char *output);
  * printing.c
  */
 document *document_new(int pw, int ph, float userscale);
+document *document_new_stream(int pw, int ph, float userscale, drawing *dr);
 void document_free(document *doc);
 void document_add_puzzle(document *doc, const game *game, game_params *par,
 			 game_state *st, game_state *st2);
@@ -484,6 +660,38 @@ void free_combi(combi_ctx *combi);
 /* divides w*h rectangle into pieces of size k. Returns w*h dsf. */
 int *divvy_rectangle(int w, int h, int k, random_state *rs);
 
+/*
+ * cpu.c: what the CPU offers beyond its ABI's baseline, so that hot
+ * kernels can pick a tuned version once at run time (on Android we
+ * build one library per ABI, for the oldest CPUs it covers). The
+ * tuned versions exist where CPU_DISPATCH is defined, i.e. where the
+ * compiler can target per function; define NO_CPU_DISPATCH to leave
+ * them all out.
+ */
+#if !defined(NO_CPU_DISPATCH) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__aarch64__) || defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH
+#define CPU_INLINE static inline __attribute__((always_inline))
+#else
+#define CPU_INLINE static
+#endif
+#define CPU_ARM_SHA1   0x0001	       /* ARMv8 crypto extensions */
+#define CPU_X86_POPCNT 0x0100
+#define CPU_X86_SSE41  0x0200
+#define CPU_X86_AVX2   0x0400	       /* and the OS saves the registers */
+#define CPU_X86_SHA    0x0800
+unsigned cpu_features(void);
+/*
+ * Set elimination in latin.c and solo.c: from *set upwards, the next
+ * set of between 2 and n-2 of the n columns which at least n minus
+ * that many rows avoid (row i's columns being the bits of
+ * rowmask[i]). Returns the set's size with *set updated, or 0 if
+ * there's none.
+ */
+int bitset_find_set(const unsigned long *rowmask, int n, unsigned long *set);
+
 /*
  * Data structure containing the function calls and data specific
  * to a particular game. This is enclosed in a data structure so
@@ -553,6 +761,31 @@ struct game {
     int is_timed;
     int (*timing_state)(const game_state *state, game_ui *ui);
     int flags;
+    /* Keep a full state only every this many moves in the undo chain
+     * (0 means every move); see midend_state() */
+    int undo_keyframe_interval;
+    /* Optional: a state as a string and back, so that a save can carry
+     * snapshots and resuming needn't replay every move. decode_state
+     * takes whatever never changes from the initial state, and returns
+     * NULL if the string is bad; see midend_serialise_compact() */
+    char *(*encode_state)(const game_state *state);
+    game_state *(*decode_state)(const game_state *initial, const char *str);
+    /* Optional: brings newstate's completion (and error) data up to
+     * date from oldstate's, given the move between them, so it needn't
+     * be rescanned from scratch every move. The midend calls it after
+     * every execute_move it makes, and then uses status() as usual;
+     * without it, execute_move must do the job itself */
+    void (*update_status)(const game_state *oldstate, game_state *newstate,
+                          const char *move);
+    /* Optional: a compact binary form for moves, which the midend then
+     * uses in the undo chain, turning them back into text only to save.
+     * encode_move returns NULL to keep a move as text, and decode_move
+     * NULL if enc is malformed; the text form is still what game IDs,
+     * saves and interpret_move deal in */
+    unsigned char *(*encode_move)(const char *move, int *len);
+    char *(*decode_move)(const unsigned char *enc, int len);
+    game_state *(*execute_encoded_move)(const game_state *state,
+                                        const unsigned char *enc, int len);
 };
 
 /*
@@ -617,6 +850,28 @@ extern void android_completed();
 extern void android_keys(const char *keys, int arrowMode);
 extern void android_keys2(const char *keys, const char *extraKeysIfArrows, int arrowMode);
 extern void android_toast(const char *msg, int fromPattern);
+/* android-gen.c */
+typedef struct gen_job gen_job;
+extern char *android_generate(int argc, const char *const *argv, gen_ctx *ctx, int nstreams, char **error);
+extern gen_job *android_gen_submit(int argc, const char *const *argv, int urgent);
+extern char *android_gen_wait(gen_job *job, char **error);
+extern void android_gen_cancel(gen_job *job);
+extern void android_gen_progress(gen_job *job, int *attempts, int *best);
+extern int android_gen_done(gen_job *job);
+extern int android_gen_relaxed(gen_job *job);
+extern void android_gen_release(gen_job *job);
+typedef struct puzzle_pack puzzle_pack;
+extern void android_gen_set_pack(puzzle_pack *pack);
+/* android-pack.c */
+extern puzzle_pack *pack_open(const void *data, unsigned len);
+extern void pack_free(puzzle_pack *pack);
+extern int pack_find(const puzzle_pack *pack, const char *gamename, const char *params, int *first);
+extern int pack_record(const puzzle_pack *pack, int i, const char **desc, const char **aux);
+typedef struct pack_builder pack_builder;
+extern pack_builder *pack_builder_new(void);
+extern void pack_builder_add(pack_builder *b, const char *gamename, const char *params, const char *desc, const char *aux);
+extern int pack_builder_write(pack_builder *b, void (*write)(void *ctx, void *buf, int len), void *wctx);
+extern void pack_builder_free(pack_builder *b);
 #define ANDROID_NO_ARROWS         0
 #define ANDROID_ARROWS_ONLY       1
 #define ANDROID_ARROWS_LEFT       2
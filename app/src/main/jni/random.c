@@ -8,14 +8,39 @@
  * The generator is based on SHA-1. This is almost certainly
  * overkill, but I had the SHA-1 code kicking around and it was
  * easier to reuse it than to do anything else!
+ *
+ * It's also slow enough to show up when generating, so seed strings
+ * starting with RANDOM_FAST_PREFIX select a second generator,
+ * xoshiro128**, keyed by a SHA-1 of the seed. Seeds without the
+ * prefix, which is every seed any other version has handed out, keep
+ * the SHA-1 generator and so still produce the same games.
  */
 
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "puzzles.h"
 
+/*
+ * Where the compiler can target them, we also have SHA-1 cores using
+ * the ARMv8 crypto extensions and x86 SHA-NI, chosen at run time if
+ * the CPU has them (and if they agree with the C version; see
+ * SHATransform_choose). Define NO_HW_SHA1 to leave them out.
+ */
+#if !defined(NO_HW_SHA1) && defined(__GNUC__) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#if defined(__aarch64__)
+#define HW_SHA1_ARM
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define HW_SHA1_X86
+#include <immintrin.h>
+#endif
+#endif
+
 /* ----------------------------------------------------------------------
  * Core SHA algorithm: processes 16-word blocks into a message digest.
  */
@@ -31,7 +56,7 @@ static void SHA_Core_Init(uint32 h[5])
     h[4] = 0xc3d2e1f0;
 }
 
-static void SHATransform(uint32 * digest, uint32 * block)
+static void SHATransform_c(uint32 * digest, uint32 * block)
 {
     uint32 w[80];
     uint32 a, b, c, d, e;
@@ -94,6 +119,140 @@ static void SHATransform(uint32 * digest, uint32 * block)
     digest[4] += e;
 }
 
+#ifdef HW_SHA1_ARM
+/*
+ * Each step does four rounds, with the message schedule for four more
+ * words alongside: w[i] holds words 4i to 4i+3, in a ring of four.
+ */
+#ifdef __clang__
+__attribute__((target("crypto")))
+#else
+__attribute__((target("+crypto")))
+#endif
+static void SHATransform_arm(uint32 * digest, uint32 * block)
+{
+    static const uint32 k[4] = {
+        0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6
+    };
+    uint32x4_t abcd, abcd0, w[4], wk;
+    uint32 e, e1;
+    int i;
+
+    abcd0 = abcd = vld1q_u32(digest);
+    e = digest[4];
+    for (i = 0; i < 4; i++)
+        w[i] = vld1q_u32(block + 4*i);
+
+    for (i = 0; i < 20; i++) {
+        if (i >= 4)
+            w[i&3] = vsha1su1q_u32(vsha1su0q_u32(w[i&3], w[(i+1)&3],
+                                                 w[(i+2)&3]),
+                                   w[(i+3)&3]);
+        wk = vaddq_u32(w[i&3], vdupq_n_u32(k[i/5]));
+        e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+        if (i < 5)
+            abcd = vsha1cq_u32(abcd, e, wk);
+        else if (i >= 10 && i < 15)
+            abcd = vsha1mq_u32(abcd, e, wk);
+        else
+            abcd = vsha1pq_u32(abcd, e, wk);
+        e = e1;
+    }
+
+    vst1q_u32(digest, vaddq_u32(abcd, abcd0));
+    digest[4] += e;
+}
+#endif
+
+#ifdef HW_SHA1_X86
+/*
+ * As above, but SHA-NI keeps words in descending order within each
+ * register, and its round function takes the next e already added
+ * into the message words.
+ */
+#define SHA1_NI_STEP(i, f) do {                                         \
+    if ((i) >= 4)                                                       \
+        w[(i)&3] = _mm_sha1msg2_epu32(                                  \
+            _mm_xor_si128(_mm_sha1msg1_epu32(w[(i)&3], w[((i)+1)&3]),  \
+                          w[((i)+2)&3]), w[((i)+3)&3]);                 \
+    e = (i) ? _mm_sha1nexte_epu32(prev, w[(i)&3])                       \
+            : _mm_add_epi32(e0, w[0]);                                  \
+    prev = abcd;                                                        \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, f);                             \
+} while (0)
+
+__attribute__((target("sha,sse4.1")))
+static void SHATransform_x86(uint32 * digest, uint32 * block)
+{
+    __m128i abcd, abcd0, e, e0, prev, w[4];
+    int i;
+
+    abcd0 = abcd =
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)digest), 0x1B);
+    e0 = _mm_set_epi32(digest[4], 0, 0, 0);
+    for (i = 0; i < 4; i++)
+        w[i] = _mm_shuffle_epi32(
+            _mm_loadu_si128((const __m128i *)(block + 4*i)), 0x1B);
+
+    /* The round function is an immediate operand, so no loop here */
+    SHA1_NI_STEP(0, 0);  SHA1_NI_STEP(1, 0);  SHA1_NI_STEP(2, 0);
+    SHA1_NI_STEP(3, 0);  SHA1_NI_STEP(4, 0);  SHA1_NI_STEP(5, 1);
+    SHA1_NI_STEP(6, 1);  SHA1_NI_STEP(7, 1);  SHA1_NI_STEP(8, 1);
+    SHA1_NI_STEP(9, 1);  SHA1_NI_STEP(10, 2); SHA1_NI_STEP(11, 2);
+    SHA1_NI_STEP(12, 2); SHA1_NI_STEP(13, 2); SHA1_NI_STEP(14, 2);
+    SHA1_NI_STEP(15, 3); SHA1_NI_STEP(16, 3); SHA1_NI_STEP(17, 3);
+    SHA1_NI_STEP(18, 3); SHA1_NI_STEP(19, 3);
+
+    e = _mm_sha1nexte_epu32(prev, e0);
+    abcd = _mm_add_epi32(abcd, abcd0);
+    _mm_storeu_si128((__m128i *)digest, _mm_shuffle_epi32(abcd, 0x1B));
+    digest[4] = _mm_extract_epi32(e, 3);
+}
+
+#undef SHA1_NI_STEP
+#endif
+
+static void SHATransform_choose(uint32 * digest, uint32 * block);
+static void (*SHATransform)(uint32 * digest, uint32 * block) =
+    SHATransform_choose;
+
+/*
+ * The first call picks the core for all later ones. A hardware one
+ * has to reproduce the C one's result on a test block first, because
+ * game seeds depend on the output being exactly the same everywhere.
+ * Threads racing through here all pick the same answer.
+ */
+static void SHATransform_choose(uint32 * digest, uint32 * block)
+{
+    void (*hw)(uint32 *, uint32 *) = NULL;
+    void (*chosen)(uint32 *, uint32 *) = SHATransform_c;
+
+#ifdef HW_SHA1_ARM
+    if (cpu_features() & CPU_ARM_SHA1)
+        hw = SHATransform_arm;
+#endif
+#ifdef HW_SHA1_X86
+    if ((cpu_features() & (CPU_X86_SHA | CPU_X86_SSE41)) ==
+        (CPU_X86_SHA | CPU_X86_SSE41))
+        hw = SHATransform_x86;
+#endif
+    if (hw) {
+        uint32 d1[5], d2[5], blk[16];
+        int i;
+        for (i = 0; i < 5; i++)
+            d1[i] = d2[i] = 0x01234567 * (i + 1);
+        for (i = 0; i < 16; i++)
+            blk[i] = 0x9e3779b9 * (i + 1);
+        SHATransform_c(d1, blk);
+        hw(d2, blk);
+        if (!memcmp(d1, d2, sizeof(d1)))
+            chosen = hw;
+    }
+
+    SHATransform = chosen;
+    chosen(digest, block);
+}
+
 /* ----------------------------------------------------------------------
  * Outer SHA algorithm: take an arbitrary length byte string,
  * convert it into 16-word blocks with the prescribed padding at
@@ -205,6 +364,9 @@ struct random_state {
     unsigned char seedbuf[40];
     unsigned char databuf[20];
     int pos;
+    int fast;                          /* use xs[] rather than the above */
+    uint32 xs[4];
+    gen_ctx *ctx;                      /* not part of the encoded state */
 };
 
 random_state *random_new(const char *seed, int len)
@@ -217,10 +379,80 @@ random_state *random_new(const char *seed, int len)
     SHA_Simple(state->seedbuf, 20, state->seedbuf + 20);
     SHA_Simple(state->seedbuf, 40, state->databuf);
     state->pos = 0;
+    state->fast = FALSE;
+    memset(state->xs, 0, sizeof(state->xs));
+    state->ctx = NULL;
 
     return state;
 }
 
+/* xoshiro128** has one bad state, all zeroes; steer clear of it */
+static void random_fast_fixup(random_state *state)
+{
+    if (!(state->xs[0] | state->xs[1] | state->xs[2] | state->xs[3]))
+        state->xs[0] = 1;
+}
+
+/*
+ * Start a generator from a game seed string, as opposed to arbitrary
+ * bytes: the fast generator if the seed asks for it, else exactly
+ * random_new(seed, strlen(seed)).
+ */
+random_state *random_new_seed(const char *seed)
+{
+    random_state *state;
+    unsigned char digest[20];
+    int i;
+
+    if (seed[0] != RANDOM_FAST_PREFIX)
+        return random_new(seed, strlen(seed));
+
+    state = snew(random_state);
+    memset(state->seedbuf, 0, sizeof(state->seedbuf));
+    memset(state->databuf, 0, sizeof(state->databuf));
+    state->pos = 0;
+    state->fast = TRUE;
+    SHA_Simple(seed + 1, strlen(seed + 1), digest);
+    for (i = 0; i < 4; i++)
+        state->xs[i] = ((uint32)digest[i*4] << 24) |
+            ((uint32)digest[i*4+1] << 16) |
+            ((uint32)digest[i*4+2] << 8) | (uint32)digest[i*4+3];
+    random_fast_fixup(state);
+    state->ctx = NULL;
+
+    return state;
+}
+
+/*
+ * Whether this generator came from a fast ('@') seed. Generators can
+ * use this to change how they spend random numbers only for new
+ * seeds, so that old seeds still give the same puzzles.
+ */
+int random_is_fast(const random_state *state)
+{
+    return state->fast;
+}
+
+/*
+ * A fresh seed string for a new game, which uses the fast generator.
+ * 15 digits comes to about 48 bits, which should be more than
+ * enough. I'll avoid putting a leading zero on the number, just in
+ * case it confuses anybody who thinks it's processed as an integer
+ * rather than a string.
+ */
+char *random_new_seed_string(random_state *rs)
+{
+    char newseed[17];
+    int i;
+
+    newseed[0] = RANDOM_FAST_PREFIX;
+    newseed[1] = '1' + (char)random_upto(rs, 9);
+    for (i = 2; i < 16; i++)
+        newseed[i] = '0' + (char)random_upto(rs, 10);
+    newseed[16] = '\0';
+    return dupstr(newseed);
+}
+
 random_state *random_copy(random_state *tocopy)
 {
     random_state *result;
@@ -228,14 +460,37 @@ random_state *random_copy(random_state *tocopy)
     memcpy(result->seedbuf, tocopy->seedbuf, sizeof(result->seedbuf));
     memcpy(result->databuf, tocopy->databuf, sizeof(result->databuf));
     result->pos = tocopy->pos;
+    result->fast = tocopy->fast;
+    memcpy(result->xs, tocopy->xs, sizeof(result->xs));
+    result->ctx = tocopy->ctx;
     return result;
 }
 
+static uint32 random_fast_next(uint32 *s)
+{
+    uint32 r = s[1] * 5, t = s[1] << 9;
+
+    r = rol(r, 7) * 9;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rol(s[3], 11);
+    return r;
+}
+
 unsigned long random_bits(random_state *state, int bits)
 {
     unsigned long ret = 0;
     int n;
 
+    if (state->fast) {
+        for (n = 0; n < bits; n += 32)
+            ret = (ret << 16 << 16) | random_fast_next(state->xs);
+        return ret & ((1 << (bits-1)) * 2 - 1);   /* see below */
+    }
+
     for (n = 0; n < bits; n += 8) {
 	if (state->pos >= 20) {
 	    int i;
@@ -295,6 +550,13 @@ char *random_state_encode(random_state *state)
     char retbuf[256];
     int len = 0, i;
 
+    if (state->fast) {
+        retbuf[len++] = RANDOM_FAST_PREFIX;
+        for (i = 0; i < 4; i++)
+            len += sprintf(retbuf+len, "%08x", (unsigned)state->xs[i]);
+        return dupstr(retbuf);
+    }
+
     for (i = 0; i < lenof(state->seedbuf); i++)
 	len += sprintf(retbuf+len, "%02x", state->seedbuf[i]);
     for (i = 0; i < lenof(state->databuf); i++)
@@ -307,13 +569,20 @@ char *random_state_encode(random_state *state)
 random_state *random_state_decode(const char *input)
 {
     random_state *state;
-    int pos, byte, digits;
+    int pos, digits;
+    uint32 byte;                       /* or a whole word, if fast */
 
     state = snew(random_state);
 
     memset(state->seedbuf, 0, sizeof(state->seedbuf));
     memset(state->databuf, 0, sizeof(state->databuf));
     state->pos = 0;
+    memset(state->xs, 0, sizeof(state->xs));
+    state->ctx = NULL;
+
+    state->fast = (*input == RANDOM_FAST_PREFIX);
+    if (state->fast)
+        input++;
 
     byte = digits = 0;
     pos = 0;
@@ -332,7 +601,13 @@ random_state *random_state_decode(const char *input)
 	byte = (byte << 4) | v;
 	digits++;
 
-	if (digits == 2) {
+	if (state->fast) {
+	    if (digits == 8) {
+		if (pos < lenof(state->xs))
+		    state->xs[pos++] = byte;
+		byte = digits = 0;
+	    }
+	} else if (digits == 2) {
 	    /*
 	     * We have a byte. Put it somewhere.
 	     */
@@ -346,6 +621,91 @@ random_state *random_state_decode(const char *input)
 	    byte = digits = 0;
 	}
     }
+    if (state->fast)
+        random_fast_fixup(state);
 
     return state;
 }
+
+void gen_ctx_init(gen_ctx *ctx)
+{
+    ctx->cancelled = FALSE;
+    ctx->attempts = 0;
+    ctx->best = -1;
+    ctx->progress = NULL;
+    ctx->progress_ctx = NULL;
+    ctx->parent = NULL;
+    ctx->start = ctx->budget = 0.0;
+    ctx->relaxed = 0;
+}
+
+static double gen_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Start the clock on a budget of budget_ms from now */
+void gen_ctx_set_budget(gen_ctx *ctx, double budget_ms)
+{
+    ctx->start = gen_now();
+    ctx->budget = budget_ms;
+}
+
+void random_set_gen_ctx(random_state *state, gen_ctx *ctx)
+{
+    state->ctx = ctx;
+}
+
+int random_gen_attempt(random_state *state, int difficulty)
+{
+    gen_ctx *ctx = state->ctx;
+
+    if (!ctx)
+        return FALSE;
+    ctx->attempts++;
+    if (difficulty > ctx->best)
+        ctx->best = difficulty;
+    if (ctx->progress)
+        ctx->progress(ctx->progress_ctx, ctx->attempts, ctx->best);
+    return random_gen_cancelled(state);
+}
+
+/*
+ * The fraction of the nearest budget that has gone (so 1 or more once
+ * it's up), or 0 if there's no budget at all.
+ */
+double random_gen_used(random_state *state)
+{
+    gen_ctx *ctx;
+
+    for (ctx = state->ctx; ctx; ctx = ctx->parent)
+        if (ctx->budget > 0)
+            return (gen_now() - ctx->start) / ctx->budget;
+    return 0.0;
+}
+
+void random_gen_relax(random_state *state, int relaxed)
+{
+    if (state->ctx)
+        state->ctx->relaxed |= relaxed;
+}
+
+int random_gen_settle(random_state *state, int relaxed)
+{
+    if (random_gen_used(state) < 1.0)
+        return FALSE;
+    random_gen_relax(state, relaxed);
+    return TRUE;
+}
+
+int random_gen_cancelled(random_state *state)
+{
+    gen_ctx *ctx;
+
+    for (ctx = state->ctx; ctx; ctx = ctx->parent)
+        if (ctx->cancelled)
+            return TRUE;
+    return FALSE;
+}
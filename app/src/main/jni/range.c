@@ -275,9 +275,27 @@ typedef struct move {
 } move;
 enum {M_BLACK = 0, M_WHITE = 1};
 
+/*
+ * Working storage for one do_solve, allocated once rather than by
+ * each pass of each reasoning.
+ *
+ * A square never becomes empty again during do_solve, so a row or
+ * column whose count of filled squares hasn't moved hasn't changed at
+ * all. solver_reasoning_not_too_big uses that to skip a clue whose
+ * row and column are just as they were when it last looked at it.
+ */
+typedef struct solver_scratch {
+    int *filled;          /* filled squares in each row, then column */
+    int *clue_filled;     /* filled[] of each clue's row and column at
+                           * its last visit, or -1 */
+    square *dfs_parent;
+    int *dfs_depth;
+} solver_scratch;
+
 typedef move *(reasoning)(game_state *state,
                           int nclues,
                           const square *clues,
+                          solver_scratch *scratch,
                           move *buf);
 
 static reasoning solver_reasoning_not_too_big;
@@ -351,18 +369,30 @@ static move *do_solve(game_state *state,
                       move *move_buffer,
                       int difficulty)
 {
+    int const w = state->params.w, h = state->params.h, n = w * h;
     struct move *buf = move_buffer, *oldbuf;
+    solver_scratch scratch;
     int i;
 
+    scratch.filled = snewn(w + h + 2 * nclues, int);
+    scratch.clue_filled = scratch.filled + w + h;
+    for (i = 0; i < 2 * nclues; ++i) scratch.clue_filled[i] = -1;
+    scratch.dfs_parent = snewn(n, square);
+    scratch.dfs_depth = snewn(n, int);
+
     do {
         oldbuf = buf;
         for (i = 0; i < lenof(reasonings) && i <= difficulty; ++i) {
             /* only recurse if all else fails */
             if (i == DIFF_RECURSION && buf > oldbuf) continue;
-            buf = (*reasonings[i])(state, nclues, clues, buf);
-            if (buf == NULL) return NULL;
+            buf = (*reasonings[i])(state, nclues, clues, &scratch, buf);
+            if (buf == NULL) break;
         }
-    } while (buf > oldbuf);
+    } while (buf != NULL && buf > oldbuf);
+
+    sfree(scratch.filled);
+    sfree(scratch.dfs_parent);
+    sfree(scratch.dfs_depth);
 
     return buf;
 }
@@ -405,6 +435,7 @@ static void solver_makemove(puzzle_size r, puzzle_size c, int colour,
 static move *solver_reasoning_adjacency(game_state *state,
                                         int nclues,
                                         const square *clues,
+                                        solver_scratch *scratch,
                                         move *buf)
 {
     int r, c, i;
@@ -428,12 +459,13 @@ static int dfs_biconnect_visit(puzzle_size r, puzzle_size c,
 static move *solver_reasoning_connectedness(game_state *state,
                                             int nclues,
                                             const square *clues,
+                                            solver_scratch *scratch,
                                             move *buf)
 {
     int const w = state->params.w, h = state->params.h, n = w * h;
 
-    square *const dfs_parent = snewn(n, square);
-    int *const dfs_depth = snewn(n, int);
+    square *const dfs_parent = scratch->dfs_parent;
+    int *const dfs_depth = scratch->dfs_depth;
 
     int i;
     for (i = 0; i < n; ++i) {
@@ -449,9 +481,6 @@ static move *solver_reasoning_connectedness(game_state *state,
 
     dfs_biconnect_visit(i / w, i % w, state, dfs_parent, dfs_depth, &buf);
 
-    sfree(dfs_parent);
-    sfree(dfs_depth);
-
     return buf;
 }
 
@@ -499,9 +528,10 @@ static int dfs_biconnect_visit(puzzle_size r, puzzle_size c,
 static move *solver_reasoning_not_too_big(game_state *state,
                                           int nclues,
                                           const square *clues,
+                                          solver_scratch *scratch,
                                           move *buf)
 {
-    int const w = state->params.w, runmasks[4] = {
+    int const w = state->params.w, h = state->params.h, runmasks[4] = {
         ~(MASK(BLACK) | MASK(EMPTY)),
         MASK(EMPTY),
         ~(MASK(BLACK) | MASK(EMPTY)),
@@ -509,14 +539,33 @@ static move *solver_reasoning_not_too_big(game_state *state,
     };
     enum {RUN_WHITE, RUN_EMPTY, RUN_BEYOND, RUN_SPACE};
 
+    int *const filled = scratch->filled;
     int i, runlengths[4][4];
 
+    /*
+     * Counted before any of this pass's moves: if one of those lands
+     * in a clue's row or column after the clue has been looked at,
+     * the next pass still sees a difference and looks again.
+     */
+    for (i = 0; i < w + h; ++i) filled[i] = 0;
+    for (i = 0; i < w * h; ++i)
+        if (state->grid[i] != EMPTY) {
+            ++filled[i / w];
+            ++filled[h + i % w];
+        }
+
     for (i = 0; i < nclues; ++i) {
         int j, k, whites, space;
 
         const puzzle_size row = clues[i].r, col = clues[i].c;
         int const clue = state->grid[idx(row, col, w)];
 
+        if (scratch->clue_filled[2*i] == filled[row] &&
+            scratch->clue_filled[2*i+1] == filled[h + col])
+            continue;
+        scratch->clue_filled[2*i] = filled[row];
+        scratch->clue_filled[2*i+1] = filled[h + col];
+
         for (j = 0; j < 4; ++j) {
             puzzle_size r = row + dr[j], c = col + dc[j];
             runlengths[RUN_SPACE][j] = 0;
@@ -584,6 +633,7 @@ static move *solver_reasoning_not_too_big(game_state *state,
 static move *solver_reasoning_recursion(game_state *state,
                                         int nclues,
                                         const square *clues,
+                                        solver_scratch *scratch,
                                         move *buf)
 {
     int const w = state->params.w, n = w * state->params.h;
@@ -1371,7 +1421,6 @@ static int find_errors(const game_state *state, int *report)
     int r, c, i;
 
     int nblack = 0, any_white_cell = -1;
-    game_state *dup = dup_game(state);
 
     for (i = r = 0; r < h; ++r)
         for (c = 0; c < w; ++c, ++i) {
@@ -1463,11 +1512,9 @@ static int find_errors(const game_state *state, int *report)
     }
     sfree(dsf);
 
-    free_game(dup);
     return FALSE; /* if report != NULL, this is ignored */
 
 found_error:
-    free_game(dup);
     return TRUE;
 }
 
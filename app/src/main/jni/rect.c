@@ -264,7 +264,7 @@ struct numberdata {
 
 static void remove_rect_placement(int w, int h,
                                   struct rectlist *rectpositions,
-                                  int *overlaps,
+                                  int *overlaps, int *ncover,
                                   int rectnum, int placement)
 {
     int x, y, xx, yy;
@@ -288,8 +288,9 @@ static void remove_rect_placement(int w, int h,
 
             assert(overlaps[(rectnum * h + y) * w + x] != 0);
 
-            if (overlaps[(rectnum * h + y) * w + x] > 0)
-                overlaps[(rectnum * h + y) * w + x]--;
+            if (overlaps[(rectnum * h + y) * w + x] > 0 &&
+                --overlaps[(rectnum * h + y) * w + x] == 0)
+                ncover[y * w + x]--;
         }
     }
 
@@ -340,7 +341,8 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
 		       random_state *rs)
 {
     struct rectlist *rectpositions;
-    int *overlaps, *rectbyplace, *workspace;
+    int *overlaps, *ncover, *rectbyplace, *workspace, *touched;
+    ptdq *dirty;
     int i, ret;
 
     /*
@@ -464,6 +466,21 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
         }
     }
 
+    /*
+     * For each square, keep count of the rectangles with a
+     * positive overlaps entry there, so that the square-focused
+     * deduction below needn't look through every rectangle.
+     */
+    ncover = snewn(w * h, int);
+    for (i = 0; i < w*h; i++) {
+        int j;
+
+        ncover[i] = 0;
+        for (j = 0; j < nrects; j++)
+            if (overlaps[j * w * h + i] > 0)
+                ncover[i]++;
+    }
+
     /*
      * Also we want an array covering the grid once, to make it
      * easy to figure out which squares are candidate number
@@ -493,7 +510,24 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
         }
     }
 
+    /*
+     * workspace[] is cleared after each placement by going back
+     * over the entries listed in touched[], rather than all nrects.
+     */
     workspace = snewn(nrects, int);
+    for (i = 0; i < nrects; i++)
+        workspace[i] = 0;
+    touched = snewn(w * h, int);
+
+    /*
+     * A rectangle's placements can only become deletable by the
+     * rectangle-focused deduction when a square they cover becomes
+     * known, or when the number placements they cover change; dirty
+     * holds the rectangles for which one of those has happened since
+     * we last looked.
+     */
+    dirty = ptdq_new(nrects, 1);
+    ptdq_fill(dirty, 0);
 
     /*
      * Now run the actual deduction loop.
@@ -549,8 +583,11 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                            " (sole remaining number position)\n", x, y, i);
 #endif
 
-                    for (j = 0; j < nrects; j++)
+                    for (j = 0; j < nrects; j++) {
+                        if (overlaps[(j * h + y) * w + x] > 0)
+                            ptdq_add(dirty, 0, j);
                         overlaps[(j * h + y) * w + x] = -1;
+                    }
                     
                     overlaps[(i * h + y) * w + x] = -2;
                 }
@@ -595,8 +632,11 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                                xx, yy, i);
 #endif
 
-                        for (j = 0; j < nrects; j++)
+                        for (j = 0; j < nrects; j++) {
+                            if (overlaps[(j * h + yy) * w + xx] > 0)
+                                ptdq_add(dirty, 0, j);
                             overlaps[(j * h + yy) * w + xx] = -1;
+                        }
                     
                         overlaps[(i * h + yy) * w + xx] = -2;
                     }
@@ -607,16 +647,13 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
          * turn and try to rule out some of its candidate
          * placements.
          */
-        for (i = 0; i < nrects; i++) {
+        for (i = 0; (i = ptdq_next(dirty, 0, i)) >= 0; i++) {
             int j;
 
             for (j = 0; j < rectpositions[i].n; j++) {
-                int xx, yy, k;
+                int xx, yy, k, m, ntouched = 0;
                 int del = FALSE;
 
-                for (k = 0; k < nrects; k++)
-                    workspace[k] = 0;
-
                 for (yy = 0; yy < rectpositions[i].rects[j].h; yy++) {
                     int y = yy + rectpositions[i].rects[j].y;
                     for (xx = 0; xx < rectpositions[i].rects[j].w; xx++) {
@@ -647,7 +684,8 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                              * candidate number placements for some
                              * rectangle. Count it.
                              */
-                            workspace[rectbyplace[y * w + x]]++;
+                            if (!workspace[rectbyplace[y * w + x]]++)
+                                touched[ntouched++] = rectbyplace[y * w + x];
                         }
                     }
                 }
@@ -659,7 +697,8 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                      * candidate number placements for any
                      * rectangle. If so, we can rule it out.
                      */
-                    for (k = 0; k < nrects; k++)
+                    for (m = 0; m < ntouched; m++) {
+                        k = touched[m];
                         if (k != i && workspace[k] == numbers[k].npoints) {
 #ifdef SOLVER_DIAGNOSTICS
                             printf("rect %d placement at %d,%d w=%d h=%d "
@@ -674,6 +713,7 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                             del = TRUE;
                             break;
                         }
+                    }
 
                     /*
                      * Failing that, see if it overlaps at least
@@ -696,8 +736,12 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                     }
                 }
 
+                for (m = 0; m < ntouched; m++)
+                    workspace[touched[m]] = 0;
+
                 if (del) {
-                    remove_rect_placement(w, h, rectpositions, overlaps, i, j);
+                    remove_rect_placement(w, h, rectpositions, overlaps,
+                                          ncover, i, j);
 
                     j--;               /* don't skip over next placement */
 
@@ -719,15 +763,14 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                 if (overlaps[y * w + x] < 0)
                     continue;          /* known already */
 
-                n = 0;
-                index = -1;
-                for (i = 0; i < nrects; i++)
-                    if (overlaps[(i * h + y) * w + x] > 0)
-                        n++, index = i;
-
+                n = ncover[y * w + x];
                 if (n == 1) {
                     int j;
 
+                    for (index = 0; index < nrects; index++)
+                        if (overlaps[(index * h + y) * w + x] > 0)
+                            break;
+
                     /*
                      * Now we can rule out all placements for
                      * rectangle `index' which _don't_ contain
@@ -743,7 +786,7 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                             y >= r->y && y < r->y + r->h)
                             continue;  /* this one is OK */
                         remove_rect_placement(w, h, rectpositions, overlaps,
-                                              index, j);
+                                              ncover, index, j);
                         j--;           /* don't skip over next placement */
                         done_something = TRUE;
                     }
@@ -856,6 +899,21 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
                         done_something = TRUE;
                     }
                 }
+
+                /*
+                 * Now any rectangle placement covering one of the
+                 * number placements left might contain them all.
+                 */
+                ptdq_add(dirty, 0, k);
+                for (m = 0; m < numbers[k].npoints; m++) {
+                    int x = numbers[k].points[m].x;
+                    int y = numbers[k].points[m].y;
+
+                    for (j = 0; j < nrects; j++)
+                        if (overlaps[(j * h + y) * w + x] > 0 ||
+                            overlaps[(j * h + y) * w + x] == -2)
+                            ptdq_add(dirty, 0, j);
+                }
             }
         }
 
@@ -904,6 +962,9 @@ static int rect_solver(int w, int h, int nrects, struct numberdata *numbers,
      * Free up all allocated storage.
      */
     sfree(workspace);
+    sfree(touched);
+    ptdq_free(dirty);
+    sfree(ncover);
     sfree(rectbyplace);
     sfree(overlaps);
     for (i = 0; i < nrects; i++)
@@ -149,11 +149,7 @@ static game_params *default_params(void)
 static const struct game_params samegame_presets[] = {
     { 5, 5, 3, 2, TRUE },
     { 10, 5, 3, 2, TRUE },
-#ifdef SLOW_SYSTEM
-    { 10, 10, 3, 2, TRUE },
-#else
     { 15, 10, 3, 2, TRUE },
-#endif
     { 15, 10, 4, 2, TRUE },
     { 20, 15, 4, 2, TRUE }
 };
@@ -322,8 +318,9 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
 {
     int wh = w*h, tc = nc+1;
     int i, j, k, c, x, y, pos, n;
-    int *list, *grid2;
+    int *list, *grid2, *tops;
     int ok, failures = 0;
+    int dlo, dhi;
 
     /*
      * We'll use `list' to track the possible places to put our
@@ -338,6 +335,16 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
      */
     list = snewn(wh + w, int);
     grid2 = snewn(wh, int);
+    tops = snewn(w, int);
+
+    /*
+     * Each attempted insertion is made in grid2 and checked there.
+     * Rather than copying the whole of grid into grid2 before every
+     * attempt, we keep grid2 identical to grid apart from columns
+     * dlo to dhi, which are the only ones the last attempt touched.
+     * tops[] holds the number of empty squares at the top of each
+     * column of grid.
+     */
 
     do {
         /*
@@ -356,6 +363,12 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
 	    for (i = 0; i < j; i++)
 		grid[(h-1-i)*w] = c;
 	}
+        memcpy(grid2, grid, wh * sizeof(int));
+        dlo = w;
+        dhi = -1;
+        for (i = 0; i < w; i++)
+            for (tops[i] = 0; tops[i] < h && grid[tops[i]*w+i] == 0;
+                 tops[i]++);
 
         /*
          * Now repeatedly insert a two-square blob in the grid, of
@@ -433,7 +446,11 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
                 x = pos % w;
                 y = pos / w;
 
-                memcpy(grid2, grid, wh * sizeof(int));
+                for (i = dlo; i <= dhi; i++)
+                    for (j = 0; j < h; j++)
+                        grid2[j*w+i] = grid[j*w+i];
+                dlo = x;
+                dhi = (y == h ? w-1 : x);
 
                 if (y == h) {
                     /*
@@ -592,6 +609,8 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
                     continue;
 
                 dir = dirs[random_upto(rs, ndirs)];
+                dlo = min(dlo, x+dir);
+                dhi = max(dhi, x+dir);
 
 #ifdef GENERATION_DIAGNOSTICS
                 printf("picked dir %d\n", dir);
@@ -622,13 +641,15 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
                     int nerrs = 0, nfix = 0;
                     k = 0;             /* current subarea size */
                     for (i = 0; i < w; i++) {
-                        if (grid2[(h-1)*w+i] == 0) {
+                        if (i < dlo || i > dhi)
+                            j = tops[i];
+                        else
+                            for (j = 0; j < h && grid2[j*w+i] == 0; j++);
+                        if (j == h) {
                             if (h % 2)
                                 nfix++;
                             continue;
                         }
-                        for (j = 0; j < h && grid2[j*w+i] == 0; j++);
-                        assert(j < h);
                         if (j == 0) {
                             /*
                              * End of previous subarea.
@@ -696,7 +717,11 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
                     }
 #endif
 
-                    for (x1 = x2 = 0; x2 < w; x2++) {
+                    /*
+                     * Columns outside dlo to dhi are untouched, and
+                     * everything to their left lines up with grid.
+                     */
+                    for (x1 = x2 = dlo; x2 <= dhi; x2++) {
                         int usedcol = FALSE;
 
                         for (y1 = y2 = h-1; y2 >= 0; y2--) {
@@ -811,7 +836,14 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
                     assert(j == ntc);
                 }
 
-                memcpy(grid, grid2, wh * sizeof(int));
+                for (i = dlo; i <= dhi; i++) {
+                    for (j = 0; j < h; j++)
+                        grid[j*w+i] = grid2[j*w+i];
+                    for (tops[i] = 0; tops[i] < h && grid[tops[i]*w+i] == 0;
+                         tops[i]++);
+                }
+                dlo = w;
+                dhi = -1;
 
                 break;		       /* done it! */
             }
@@ -877,6 +909,7 @@ static void gen_grid(int w, int h, int nc, int *grid, random_state *rs)
     }
 #endif
 
+    sfree(tops);
     sfree(grid2);
     sfree(list);
 }
@@ -103,12 +103,9 @@ static int ispointing(const game_state *state, int fromx, int fromy,
     /* the final number points to nothing. */
     if (state->nums[fromy*w + fromx] == state->n) return 0;
 
-    while (1) {
-        if (!INGRID(state, fromx, fromy)) return 0;
-        if (fromx == tox && fromy == toy) return 1;
-        fromx += dxs[dir]; fromy += dys[dir];
-    }
-    return 0; /* not reached */
+    /* an arrow points at everything in its line, however far off. */
+    if (!INGRID(state, fromx, fromy) || !INGRID(state, tox, toy)) return 0;
+    return whichdir(fromx, fromy, tox, toy) == dir;
 }
 
 static int ispointingi(game_state *state, int fromi, int toi)
@@ -580,49 +577,200 @@ static char *generate_desc(game_state *state, int issolve)
 
 /* --- Game generation --- */
 
-/* Fills in preallocated arrays ai (indices) and ad (directions)
- * showing all non-numbered cells adjacent to index i, returns length */
-/* This function has been somewhat optimised... */
-static int cell_adj(game_state *state, int i, int *ai, int *ad)
+/* The generator keeps asking which cells are still empty in each
+ * direction from a cell. Every line of the grid in each of the four
+ * orientations is laid out as a contiguous run of bits, so that the
+ * cells beyond a cell in any one direction are a range of bits in a
+ * bitset of empty cells, and can be counted a word at a time. */
+#define RAY_BITS 32
+
+struct fill_rays {
+    int n, nwords;
+    int *pos;                   /* 4*n: where each cell is in a layout */
+    int *cell;                  /* 4*n: which cell is at each position */
+    int *lstart, *lend;         /* 4*n: range of each cell's line */
+    unsigned int *empty;        /* 4*nwords: empty cells, by position */
+};
+
+/* Directions E, SE, S and SW run forwards through layouts 0-3; the
+ * others run backwards through the layout of their opposite. */
+#define RAY_LAYOUT(d) (((d)+2)%4)
+#define RAY_FORWARD(d) ((d) >= DIR_E && (d) <= DIR_SW)
+
+static struct fill_rays *new_fill_rays(int w, int h)
+{
+    struct fill_rays *rays = snew(struct fill_rays);
+    int n = w*h, l, i, j, p, x, y, dx, dy, start;
+
+    rays->n = n;
+    rays->nwords = (n + RAY_BITS - 1) / RAY_BITS;
+    rays->pos = snewn(4*n, int);
+    rays->cell = snewn(4*n, int);
+    rays->lstart = snewn(4*n, int);
+    rays->lend = snewn(4*n, int);
+    rays->empty = snewn(4*rays->nwords, unsigned int);
+
+    for (l = 0; l < 4; l++) {
+        dx = dxs[l+DIR_E]; dy = dys[l+DIR_E];
+        p = 0;
+        for (i = 0; i < n; i++) {
+            x = i%w - dx; y = i/w - dy;
+            if (x >= 0 && x < w && y >= 0 && y < h)
+                continue;       /* not the start of a line */
+            start = p;
+            for (x = i%w, y = i/w; x >= 0 && x < w && y >= 0 && y < h;
+                 x += dx, y += dy) {
+                rays->pos[l*n + y*w+x] = p;
+                rays->cell[l*n + p] = y*w+x;
+                p++;
+            }
+            for (j = start; j < p; j++) {
+                rays->lstart[l*n + rays->cell[l*n + j]] = start;
+                rays->lend[l*n + rays->cell[l*n + j]] = p;
+            }
+        }
+        assert(p == n);
+    }
+    return rays;
+}
+
+static int count_bits32(unsigned int word)
 {
-    int n = 0, a, x, y, sx, sy, dx, dy, newi;
-    int w = state->w, h = state->h;
+    word = word - ((word >> 1) & 0x55555555U);
+    word = (word & 0x33333333U) + ((word >> 2) & 0x33333333U);
+    word = (word + (word >> 4)) & 0x0F0F0F0FU;
+    return ((word * 0x01010101U) & 0xFFFFFFFFU) >> 24;
+}
 
-    sx = i % w; sy = i / w;
+static void free_fill_rays(struct fill_rays *rays)
+{
+    sfree(rays->pos);
+    sfree(rays->cell);
+    sfree(rays->lstart);
+    sfree(rays->lend);
+    sfree(rays->empty);
+    sfree(rays);
+}
 
-    for (a = 0; a < DIR_MAX; a++) {
-        x = sx; y = sy;
-        dx = dxs[a]; dy = dys[a];
-        while (1) {
-            x += dx; y += dy;
-            if (x < 0 || y < 0 || x >= w || y >= h) break;
+static void fill_rays_reset(struct fill_rays *rays)
+{
+    memset(rays->empty, 0xFF, 4*rays->nwords*sizeof(unsigned int));
+}
 
-            newi = y*w + x;
-            if (state->nums[newi] == 0) {
-                ai[n] = newi;
-                ad[n] = a;
-                n++;
-            }
-        }
+static void fill_rays_set(struct fill_rays *rays, int i)
+{
+    int l, p;
+
+    for (l = 0; l < 4; l++) {
+        p = rays->pos[l*rays->n + i];
+        rays->empty[l*rays->nwords + p/RAY_BITS] &= ~(1U << (p%RAY_BITS));
+    }
+}
+
+/* Empty positions in [lo,hi) of a layout. */
+static int fill_rays_count(const struct fill_rays *rays, int l, int lo, int hi)
+{
+    const unsigned int *e = rays->empty + l*rays->nwords;
+    unsigned int word;
+    int n = 0, nb;
+
+    while (lo < hi) {
+        nb = min(hi - lo, RAY_BITS - lo%RAY_BITS);
+        word = (e[lo/RAY_BITS] & 0xFFFFFFFFU) >> (lo%RAY_BITS);
+        if (nb < RAY_BITS) word &= (1U << nb) - 1;
+        n += count_bits32(word);
+        lo += nb;
     }
     return n;
 }
 
-static int new_game_fill(game_state *state, random_state *rs,
-                         int headi, int taili)
+/* Counts all non-numbered cells in each direction from index i into
+ * counts (size DIR_MAX), and returns the total; or, if that reaches
+ * limit, returns early with some counts left unset. */
+static int cell_adj(const struct fill_rays *rays, int i, int *counts,
+                    int limit)
 {
-    int nfilled, an, ret = 0, j;
-    int *aidx, *adir;
+    int a, l, p, n = 0;
 
-    aidx = snewn(state->n, int);
-    adir = snewn(state->n, int);
+    for (a = 0; a < DIR_MAX && n < limit; a++) {
+        l = RAY_LAYOUT(a);
+        p = rays->pos[l*rays->n + i];
+        if (RAY_FORWARD(a))
+            counts[a] = fill_rays_count(rays, l, p+1, rays->lend[l*rays->n + i]);
+        else
+            counts[a] = fill_rays_count(rays, l, rays->lstart[l*rays->n + i], p);
+        n += counts[a];
+    }
+    return n;
+}
+
+/* The k'th empty position in [lo,hi) of a layout, counting up from lo
+ * or (if !forward) down from hi-1; there must be one. */
+static int fill_rays_nth(const struct fill_rays *rays, int l, int lo, int hi,
+                         int k, int forward)
+{
+    const unsigned int *e = rays->empty + l*rays->nwords;
+    unsigned int word;
+    int nb, start, c;
+
+    while (lo < hi) {
+        if (forward)
+            nb = min(hi - lo, RAY_BITS - lo%RAY_BITS);
+        else
+            nb = min(hi - lo, (hi-1)%RAY_BITS + 1);
+        start = forward ? lo : hi - nb;
+        word = (e[start/RAY_BITS] & 0xFFFFFFFFU) >> (start%RAY_BITS);
+        if (nb < RAY_BITS) word &= (1U << nb) - 1;
+        c = count_bits32(word);
+        if (k < c) {
+            if (!forward) k = c-1 - k;
+            while (k--) word &= word - 1;
+            for (; !(word & 1); word >>= 1) start++;
+            return start;
+        }
+        k -= c;
+        if (forward) lo += nb; else hi -= nb;
+    }
+    assert(!"fill_rays_nth ran off the end of its range");
+    return -1;
+}
+
+/* Returns the j'th non-numbered cell counted by cell_adj, going
+ * through the directions in order and outwards along each, and puts
+ * its direction in *ad. */
+static int cell_adj_nth(const struct fill_rays *rays, int i,
+                        const int *counts, int j, int *ad)
+{
+    int a, l, p;
+
+    for (a = 0; j >= counts[a]; a++)
+        j -= counts[a];
+    *ad = a;
+
+    l = RAY_LAYOUT(a);
+    p = rays->pos[l*rays->n + i];
+    if (RAY_FORWARD(a))
+        p = fill_rays_nth(rays, l, p+1, rays->lend[l*rays->n + i], j, 1);
+    else
+        p = fill_rays_nth(rays, l, rays->lstart[l*rays->n + i], p, j, 0);
+    return rays->cell[l*rays->n + p];
+}
+
+static int new_game_fill(game_state *state, random_state *rs,
+                         struct fill_rays *rays, int headi, int taili)
+{
+    int nfilled, an, ret = 0, j, a, newi;
+    int counts[DIR_MAX];
 
     debug(("new_game_fill: headi=%d, taili=%d.", headi, taili));
 
     memset(state->nums, 0, state->n*sizeof(int));
+    fill_rays_reset(rays);
 
     state->nums[headi] = 1;
     state->nums[taili] = state->n;
+    fill_rays_set(rays, headi);
+    fill_rays_set(rays, taili);
 
     state->dirs[taili] = 0;
     nfilled = 2;
@@ -630,28 +778,33 @@ static int new_game_fill(game_state *state, random_state *rs,
     while (nfilled < state->n) {
         /* Try and expand _from_ headi; keep going if there's only one
          * place to go to. */
-        an = cell_adj(state, headi, aidx, adir);
+        an = cell_adj(rays, headi, counts, state->n);
         do {
             if (an == 0) goto done;
             j = random_upto(rs, an);
-            state->dirs[headi] = adir[j];
-            state->nums[aidx[j]] = state->nums[headi] + 1;
+            newi = cell_adj_nth(rays, headi, counts, j, &a);
+            state->dirs[headi] = a;
+            state->nums[newi] = state->nums[headi] + 1;
+            fill_rays_set(rays, newi);
             nfilled++;
-            headi = aidx[j];
-            an = cell_adj(state, headi, aidx, adir);
+            headi = newi;
+            /* all we need now is whether there's a single way on */
+            an = cell_adj(rays, headi, counts, 2);
         } while (an == 1);
 
         /* Try and expand _to_ taili; keep going if there's only one
          * place to go to. */
-        an = cell_adj(state, taili, aidx, adir);
+        an = cell_adj(rays, taili, counts, state->n);
         do {
             if (an == 0) goto done;
             j = random_upto(rs, an);
-            state->dirs[aidx[j]] = DIR_OPPOSITE(adir[j]);
-            state->nums[aidx[j]] = state->nums[taili] - 1;
+            newi = cell_adj_nth(rays, taili, counts, j, &a);
+            state->dirs[newi] = DIR_OPPOSITE(a);
+            state->nums[newi] = state->nums[taili] - 1;
+            fill_rays_set(rays, newi);
             nfilled++;
-            taili = aidx[j];
-            an = cell_adj(state, taili, aidx, adir);
+            taili = newi;
+            an = cell_adj(rays, taili, counts, 2);
         } while (an == 1);
     }
     /* If we get here we have headi and taili set but unconnected
@@ -664,8 +817,6 @@ static int new_game_fill(game_state *state, random_state *rs,
     if (state->dirs[headi] != -1) ret = 1;
 
 done:
-    sfree(aidx);
-    sfree(adir);
     return ret;
 }
 
@@ -805,6 +956,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 			   char **aux, int interactive)
 {
     game_state *state = blank_game(params->w, params->h);
+    struct fill_rays *rays = new_fill_rays(params->w, params->h);
     char *ret;
     int headi, taili;
 
@@ -822,7 +974,7 @@ generate:
                 taili = random_upto(rs, state->n);
             } while (headi == taili);
         }
-    } while (!new_game_fill(state, rs, headi, taili));
+    } while (!new_game_fill(state, rs, rays, headi, taili));
 
     debug_state("Filled game:", state);
 
@@ -845,6 +997,7 @@ generate:
     }
     ret = generate_desc(state, 0);
     free_game(state);
+    free_fill_rays(rays);
     return ret;
 }
 
@@ -1148,7 +1301,8 @@ static void update_numbers(game_state *state)
 
 static int check_completion(game_state *state, int mark_errors)
 {
-    int n, j, k, error = 0, complete;
+    int n, j, error = 0, complete;
+    int *seen;
 
     /* NB This only marks errors that are possible to perpetrate with
      * the current UI in interpret_move. Things like forming loops in
@@ -1161,19 +1315,21 @@ static int check_completion(game_state *state, int mark_errors)
     }
 
     /* Search for repeated numbers. */
+    seen = snewn(state->n+1, int);
+    memset(seen, 0, (state->n+1)*sizeof(int));
     for (j = 0; j < state->n; j++) {
-        if (state->nums[j] > 0 && state->nums[j] <= state->n) {
-            for (k = j+1; k < state->n; k++) {
-                if (state->nums[k] == state->nums[j]) {
-                    if (mark_errors) {
-                        state->flags[j] |= FLAG_ERROR;
-                        state->flags[k] |= FLAG_ERROR;
-                    }
-                    error = 1;
-                }
-            }
+        if (state->nums[j] > 0 && state->nums[j] <= state->n)
+            seen[state->nums[j]]++;
+    }
+    for (j = 0; j < state->n; j++) {
+        if (state->nums[j] > 0 && state->nums[j] <= state->n &&
+            seen[state->nums[j]] > 1) {
+            if (mark_errors)
+                state->flags[j] |= FLAG_ERROR;
+            error = 1;
         }
     }
+    sfree(seen);
 
     /* Search and mark numbers n not pointing to n+1; if any numbers
      * are missing we know we've not completed. */
@@ -614,6 +614,8 @@ struct solver_state {
     struct solver_op *ops;
     int n_ops, n_alloc;
     int *scratch;
+    /* For solve_findcuts. */
+    int *depth, *low, *dir, *cut, nwhite;
 };
 
 static struct solver_state *solver_state_new(game_state *state)
@@ -623,6 +625,10 @@ static struct solver_state *solver_state_new(game_state *state)
     ss->ops = NULL;
     ss->n_ops = ss->n_alloc = 0;
     ss->scratch = snewn(state->n, int);
+    ss->depth = snewn(state->n, int);
+    ss->low = snewn(state->n, int);
+    ss->dir = snewn(state->n, int);
+    ss->cut = snewn(state->n, int);
 
     return ss;
 }
@@ -630,6 +636,10 @@ static struct solver_state *solver_state_new(game_state *state)
 static void solver_state_free(struct solver_state *ss)
 {
     sfree(ss->scratch);
+    sfree(ss->depth);
+    sfree(ss->low);
+    sfree(ss->dir);
+    sfree(ss->cut);
     if (ss->ops) sfree(ss->ops);
     sfree(ss);
 }
@@ -1042,29 +1052,79 @@ static int solve_hassinglewhiteregion(game_state *state, struct solver_state *ss
     return (szwhite == nwhite) ? 1 : 0;
 }
 
+/* Sets ss->cut[i] for each white square whose blackening would split
+ * the white region containing root: its articulation points, found by
+ * one depth-first search rather than a flood fill per square. The
+ * search is iterative, using ss->scratch as its stack. */
+static void solve_findcuts(game_state *state, struct solver_state *ss,
+                           int root)
+{
+    int *depth = ss->depth, *low = ss->low, *dir = ss->dir, *cut = ss->cut;
+    int *stack = ss->scratch, sp, i, j, p, d, x, y, nchildren = 0;
+
+    for (i = 0; i < state->n; i++) {
+        depth[i] = -1;
+        cut[i] = 0;
+    }
+    depth[root] = low[root] = 0;
+    dir[root] = 0;
+    stack[0] = root;
+    sp = 1;
+    ss->nwhite = 1;
+
+    while (sp > 0) {
+        i = stack[sp-1];
+        if (dir[i] < 4) {
+            d = dir[i]++;
+            x = (i % state->w) + dxs[d];
+            y = (i / state->w) + dys[d];
+            j = y*state->w + x;
+            if (!INGRID(state, x, y)) continue;
+            if (state->flags[j] & F_BLACK) continue;
+            if (depth[j] < 0) {
+                depth[j] = low[j] = depth[i] + 1;
+                dir[j] = 0;
+                stack[sp++] = j;
+                ss->nwhite++;
+            } else if (depth[j] < low[i])
+                low[i] = depth[j];
+        } else {
+            sp--;
+            if (sp == 0) break;
+            p = stack[sp-1];
+            if (low[i] < low[p]) low[p] = low[i];
+            if (p == root)
+                nchildren++;
+            else if (low[i] >= depth[p])
+                cut[p] = 1;
+        }
+    }
+    if (nchildren >= 2) cut[root] = 1;
+}
+
 static void solve_removesplits_check(game_state *state, struct solver_state *ss,
                                      int x, int y)
 {
-    int i = y*state->w + x, issingle;
+    int i = y*state->w + x;
 
     if (!INGRID(state, x, y)) return;
     if ((state->flags[i] & F_CIRCLE) || (state->flags[i] & F_BLACK))
         return;
 
     /* If putting a black square at (x,y) would make the white region
-     * non-contiguous, it must be circled. */
-    state->flags[i] |= F_BLACK;
-    issingle = solve_hassinglewhiteregion(state, ss);
-    state->flags[i] &= ~F_BLACK;
+     * non-contiguous, it must be circled. With no other white square
+     * left at all, the position was impossible anyway. */
+    if (ss->nwhite == 1)
+        state->impossible = 1;
+    else if (!ss->cut[i])
+        return;
 
-    if (!issingle)
-        solver_op_add(ss, x, y, CIRCLE, "MC: black square here would split white region");
+    solver_op_add(ss, x, y, CIRCLE, "MC: black square here would split white region");
 }
 
 /* For all black squares, search in squares diagonally adjacent to see if
  * we can rule out putting a black square there (because it would make the
  * white region non-contiguous). */
-/* This function is likely to be somewhat slow. */
 static int solve_removesplits(game_state *state, struct solver_state *ss)
 {
     int i, x, y, n_ops = ss->n_ops;
@@ -1075,6 +1135,9 @@ static int solve_removesplits(game_state *state, struct solver_state *ss)
         return 0;
     }
 
+    for (i = 0; i < state->n && (state->flags[i] & F_BLACK); i++);
+    solve_findcuts(state, ss, i);
+
     for (i = 0; i < state->n; i++) {
         if (!(state->flags[i] & F_BLACK)) continue;
 
@@ -1394,7 +1457,8 @@ randomise:
 
     /* DIFF_ANY just returns whatever we first generated, for testing purposes. */
     if (params->diff != DIFF_ANY &&
-        !new_game_is_good(params, state, tosolve)) {
+        !new_game_is_good(params, state, tosolve) &&
+        !random_gen_attempt(rs, -1)) {
         ntries++;
         if (ntries > MAXTRIES) {
             debug(("Ran out of randomisation attempts, re-generating.\n"));
@@ -1862,7 +1926,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON,		       /* flags */
+    REQUIRE_RBUTTON | GEN_RACES,	       /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
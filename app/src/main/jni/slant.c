@@ -266,6 +266,12 @@ struct solver_scratch {
      */
     int *equiv;
 
+    /*
+     * Links the squares of each equivalence class into a circular
+     * list, so that we can find them all when merging it.
+     */
+    int *equivnext;
+
     /*
      * Stores slash values which we know for an equivalence class.
      * When we fill in a square, we set slashval[canonify(x)] to
@@ -299,6 +305,16 @@ struct solver_scratch {
      */
     unsigned char *vbitmap;
 
+    /*
+     * Marks the clue points which need looking at again in the
+     * solver's first pass. Processing a clue point depends only on
+     * its four squares and their equivalence classes, so a point
+     * which achieved nothing last time needs no second look until
+     * one of its squares is filled in or two of them become
+     * equivalent.
+     */
+    unsigned char *todo;
+
     /*
      * Useful to have this information automatically passed to
      * solver subroutines. (This pointer is not dynamically
@@ -315,15 +331,19 @@ static struct solver_scratch *new_scratch(int w, int h)
     ret->exits = snewn(W*H, int);
     ret->border = snewn(W*H, unsigned char);
     ret->equiv = snewn(w*h, int);
+    ret->equivnext = snewn(w*h, int);
     ret->slashval = snewn(w*h, signed char);
     ret->vbitmap = snewn(w*h, unsigned char);
+    ret->todo = snewn(W*H, unsigned char);
     return ret;
 }
 
 static void free_scratch(struct solver_scratch *sc)
 {
+    sfree(sc->todo);
     sfree(sc->vbitmap);
     sfree(sc->slashval);
+    sfree(sc->equivnext);
     sfree(sc->equiv);
     sfree(sc->border);
     sfree(sc->exits);
@@ -378,6 +398,38 @@ static void decr_exits(struct solver_scratch *sc, int i)
     }
 }
 
+/*
+ * Wrapper on dsf_merge() for the equivalence classes of squares.
+ * A clue point's view of the classes only changes if it has squares
+ * in both, so it's enough to mark the points around the smaller.
+ */
+static void merge_squares(int w, int h, struct solver_scratch *sc,
+                          int i, int j)
+{
+    int W = w+1;
+    int k, s, t;
+
+    i = dsf_canonify(sc->equiv, i);
+    j = dsf_canonify(sc->equiv, j);
+    if (i == j)
+        return;
+
+    s = (dsf_size(sc->equiv, i) <= dsf_size(sc->equiv, j) ? i : j);
+    k = s;
+    do {
+        int x = k % w, y = k / w;
+        sc->todo[y*W+x] = sc->todo[y*W+(x+1)] = TRUE;
+        sc->todo[(y+1)*W+x] = sc->todo[(y+1)*W+(x+1)] = TRUE;
+        k = sc->equivnext[k];
+    } while (k != s);
+
+    t = sc->equivnext[i];
+    sc->equivnext[i] = sc->equivnext[j];
+    sc->equivnext[j] = t;
+
+    dsf_merge(sc->equiv, i, j);
+}
+
 static void fill_square(int w, int h, int x, int y, int v,
 			signed char *soln,
 			int *connected, struct solver_scratch *sc)
@@ -400,6 +452,9 @@ static void fill_square(int w, int h, int x, int y, int v,
     if (sc) {
 	int c = dsf_canonify(sc->equiv, y*w+x);
 	sc->slashval[c] = v;
+
+	sc->todo[y*W+x] = sc->todo[y*W+(x+1)] = TRUE;
+	sc->todo[(y+1)*W+x] = sc->todo[(y+1)*W+(x+1)] = TRUE;
     }
 
     if (v < 0) {
@@ -477,6 +532,8 @@ static int slant_solve(int w, int h, const signed char *clues,
      * are known to slant in the same direction.
      */
     dsf_init(sc->equiv, w*h);
+    for (i = 0; i < w*h; i++)
+        sc->equivnext[i] = i;
 
     /*
      * Clear the slashval array.
@@ -488,6 +545,8 @@ static int slant_solve(int w, int h, const signed char *clues,
      */
     memset(sc->vbitmap, 0xF, w*h);
 
+    memset(sc->todo, TRUE, W*H);
+
     /*
      * Initialise the `exits' and `border' arrays. These are used
      * to do second-order loop avoidance: the dual of the no loops
@@ -534,8 +593,9 @@ static int slant_solve(int w, int h, const signed char *clues,
 		int nneighbours;
 		int nu, nl, c, s, eq, eq2, last, meq, mj1, mj2;
 
-		if ((c = clues[y*W+x]) < 0)
+		if ((c = clues[y*W+x]) < 0 || !sc->todo[y*W+x])
 		    continue;
+		sc->todo[y*W+x] = FALSE;
 
 		/*
 		 * We have a clue point. Start by listing its
@@ -713,7 +773,7 @@ static int slant_solve(int w, int h, const signed char *clues,
 			    return 0;
 			}
 			sv1 = sv1 ? sv1 : sv2;
-			dsf_merge(sc->equiv, mj1, mj2);
+			merge_squares(w, h, sc, mj1, mj2);
 			mj1 = dsf_canonify(sc->equiv, mj1);
 			sc->slashval[mj1] = sv1;
 		    }
@@ -881,7 +941,7 @@ static int slant_solve(int w, int h, const signed char *clues,
                     int n1 = y*w+x, n2 = y*w+(x+1);
                     if (dsf_canonify(sc->equiv, n1) !=
                         dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                        merge_squares(w, h, sc, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
@@ -895,7 +955,7 @@ static int slant_solve(int w, int h, const signed char *clues,
                     int n1 = y*w+x, n2 = (y+1)*w+x;
                     if (dsf_canonify(sc->equiv, n1) !=
                         dsf_canonify(sc->equiv, n2)) {
-                        dsf_merge(sc->equiv, n1, n2);
+                        merge_squares(w, h, sc, n1, n2);
                         done_something = TRUE;
 #ifdef SOLVER_DIAGNOSTICS
                         if (verbose)
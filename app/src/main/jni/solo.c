@@ -95,6 +95,7 @@ int solver_show_working, solver_recurse_depth;
 #endif
 
 #include "puzzles.h"
+#include "dlx.h"
 
 /*
  * To save space, I store digits internally as unsigned char. This
@@ -264,9 +265,9 @@ struct game_state {
     struct block_structure *blocks;
     struct block_structure *kblocks;   /* Blocks for killer puzzles.  */
     int xtype, killer;
-    digit *grid, *kgrid;
+    digit *grid, *kgrid;	       /* kgrid is shared (see shared_new) */
     unsigned char *pencil;             /* c*r*c*r elements */
-    unsigned char *immutable;	       /* marks which digits are clues */
+    unsigned char *immutable;	       /* marks which digits are clues; shared */
     int completed, cheated;
 };
 
@@ -979,8 +980,46 @@ static int solver_intersect(struct solver_usage *usage,
     return ret;
 }
 
+/*
+ * Set elimination and forcing chains ask the same questions of the
+ * cube over and over, so they take a bitmask copy of the part they're
+ * working on: bit n-1 for digit n, or for column n-1 of the matrix in
+ * solver_set. We never have more than 31 digits (see validate_params).
+ */
+typedef unsigned long solver_mask;
+
+static int solver_mask_count(solver_mask m)
+{
+#ifdef __GNUC__
+    return __builtin_popcountl(m);
+#else
+    int n = 0;
+    for (; m; m &= m - 1)
+	n++;
+    return n;
+#endif
+}
+
+/* The index of the lowest set bit of a nonzero mask */
+static int solver_mask_first(solver_mask m)
+{
+#ifdef __GNUC__
+    return __builtin_ctzl(m);
+#else
+    int n = 0;
+    for (; !(m & 1); m >>= 1)
+	n++;
+    return n;
+#endif
+}
+
+/* For a mask with exactly two bits set, the sum of the two digits */
+#define solver_mask_pair_sum(m) \
+    (solver_mask_first(m) + solver_mask_first((m) & ((m) - 1)) + 2)
+
 struct solver_scratch {
-    unsigned char *grid, *rowidx, *colidx, *set;
+    unsigned char *grid, *rowidx, *colidx;
+    solver_mask *rowmask, *cellmask;
     int *neighbours, *bfsqueue;
     int *indexlist, *indexlist2;
 #ifdef STANDALONE_SOLVER
@@ -997,11 +1036,12 @@ static int solver_set(struct solver_usage *usage,
                       )
 {
     int cr = usage->cr;
-    int i, j, n, count;
+    int i, j, n;
     unsigned char *grid = scratch->grid;
     unsigned char *rowidx = scratch->rowidx;
     unsigned char *colidx = scratch->colidx;
-    unsigned char *set = scratch->set;
+    solver_mask *rowmask = scratch->rowmask;
+    solver_mask set, all;
 
     /*
      * We are passed a cr-by-cr matrix of booleans. Our first job
@@ -1043,11 +1083,19 @@ static int solver_set(struct solver_usage *usage,
     assert(n == j);
 
     /*
-     * And create the smaller matrix.
+     * And create the smaller matrix, and a mask of each of its rows
+     * (column j being bit n-1-j, so that counting upwards through the
+     * candidate sets below tries them in the same order as it always
+     * has).
      */
-    for (i = 0; i < n; i++)
-        for (j = 0; j < n; j++)
+    for (i = 0; i < n; i++) {
+        rowmask[i] = 0;
+        for (j = 0; j < n; j++) {
             grid[i*cr+j] = usage->cube[indices[rowidx[i]*cr+colidx[j]]];
+            if (grid[i*cr+j])
+                rowmask[i] |= (solver_mask)1 << (n-1-j);
+        }
+    }
 
     /*
      * Having done that, we now have a matrix in which every row
@@ -1057,30 +1105,23 @@ static int solver_set(struct solver_usage *usage,
      * columns) whose width and height add up to n.
      */
 
-    memset(set, 0, n);
-    count = 0;
-    while (1) {
+    all = n ? (((solver_mask)1 << (n-1)) << 1) - 1 : 0;
+    for (set = 0;; set++) {
         /*
-         * We have a candidate set. If its size is <=1 or >=n-1
-         * then we move on immediately.
+         * Skip straight to the next candidate set whose size is
+         * between 2 and n-2 and which at least n-count rows avoid
+         * (the kernel counting them is chosen for the CPU; see
+         * cpu.c). Then we count those rows again here.
          */
-        if (count > 1 && count < n-1) {
-            /*
-             * The number of rows we need is n-count. See if we can
-             * find that many rows which each have a zero in all
-             * the positions listed in `set'.
-             */
+        int count = bitset_find_set(rowmask, n, &set);
+
+        if (!count)
+            break;
+        {
             int rows = 0;
-            for (i = 0; i < n; i++) {
-                int ok = TRUE;
-                for (j = 0; j < n; j++)
-                    if (set[j] && grid[i*cr+j]) {
-                        ok = FALSE;
-                        break;
-                    }
-                if (ok)
+            for (i = 0; i < n; i++)
+                if (!(rowmask[i] & set))
                     rows++;
-            }
 
             /*
              * We expect never to be able to get _more_ than
@@ -1121,15 +1162,10 @@ static int solver_set(struct solver_usage *usage,
                  * positions in the cube to meddle with.
                  */
                 for (i = 0; i < n; i++) {
-                    int ok = TRUE;
-                    for (j = 0; j < n; j++)
-                        if (set[j] && grid[i*cr+j]) {
-                            ok = FALSE;
-                            break;
-                        }
-                    if (!ok) {
+                    if (rowmask[i] & set) {
                         for (j = 0; j < n; j++)
-                            if (!set[j] && grid[i*cr+j]) {
+                            if (!(set & ((solver_mask)1 << (n-1-j))) &&
+                                grid[i*cr+j]) {
                                 int fpos = indices[rowidx[i]*cr+colidx[j]];
 #ifdef STANDALONE_SOLVER
                                 if (solver_show_working) {
@@ -1167,16 +1203,7 @@ static int solver_set(struct solver_usage *usage,
             }
         }
 
-        /*
-         * Binary increment: change the rightmost 0 to a 1, and
-         * change all 1s to the right of it to 0s.
-         */
-        i = n;
-        while (i > 0 && set[i-1])
-            set[--i] = 0, count--;
-        if (i > 0)
-            set[--i] = 1, count++;
-        else
+        if (set == all)
             break;                     /* done */
     }
 
@@ -1229,26 +1256,37 @@ static int solver_forcing(struct solver_usage *usage,
 #endif
     unsigned char *number = scratch->grid;
     int *neighbours = scratch->neighbours;
-    int x, y;
+    solver_mask *cellmask = scratch->cellmask;
+    int x, y, n;
 
+    /*
+     * Nothing changes the cube until we return, so take the
+     * candidates of every square as a mask first.
+     */
     for (y = 0; y < cr; y++)
         for (x = 0; x < cr; x++) {
-            int count, t, n;
+            solver_mask m = 0;
+            for (n = 1; n <= cr; n++)
+                if (cube(x, y, n))
+                    m |= (solver_mask)1 << (n-1);
+            cellmask[y*cr+x] = m;
+        }
+
+    for (y = 0; y < cr; y++)
+        for (x = 0; x < cr; x++) {
+            int t;
 
             /*
              * If this square doesn't have exactly two candidate
              * numbers, don't try it.
              * 
-             * In this loop we also sum the candidate numbers,
-             * which is a nasty hack to allow us to quickly find
-             * `the other one' (since we will shortly know there
-             * are exactly two).
+             * We also sum the candidate numbers, which is a nasty
+             * hack to allow us to quickly find `the other one'
+             * (since we now know there are exactly two).
              */
-            for (count = t = 0, n = 1; n <= cr; n++)
-                if (cube(x, y, n))
-                    count++, t += n;
-            if (count != 2)
+            if (solver_mask_count(cellmask[y*cr+x]) != 2)
                 continue;
+            t = solver_mask_pair_sum(cellmask[y*cr+x]);
 
             /*
              * Now attempt a bfs for each candidate.
@@ -1306,7 +1344,7 @@ static int solver_forcing(struct solver_usage *usage,
                          * Try visiting each of those neighbours.
                          */
                         for (i = 0; i < nneighbours; i++) {
-                            int cc, tt, nn;
+                            solver_mask mt;
 
                             xt = neighbours[i] % cr;
                             yt = neighbours[i] / cr;
@@ -1318,7 +1356,8 @@ static int solver_forcing(struct solver_usage *usage,
                              */
                             if (number[yt*cr+xt] <= cr)
                                 continue;
-                            if (!cube(xt, yt, currn))
+                            mt = cellmask[yt*cr+xt];
+                            if (!(mt & ((solver_mask)1 << (currn-1))))
                                 continue;
 
                             /*
@@ -1333,15 +1372,13 @@ static int solver_forcing(struct solver_usage *usage,
                              * this square to have exactly two
                              * possible numbers.
                              */
-                            for (cc = tt = 0, nn = 1; nn <= cr; nn++)
-                                if (cube(xt, yt, nn))
-                                    cc++, tt += nn;
-                            if (cc == 2) {
+                            if (solver_mask_count(mt) == 2) {
                                 bfsqueue[tail++] = yt*cr+xt;
 #ifdef STANDALONE_SOLVER
                                 bfsprev[yt*cr+xt] = yy*cr+xx;
 #endif
-                                number[yt*cr+xt] = tt - currn;
+                                number[yt*cr+xt] = solver_mask_pair_sum(mt)
+                                                   - currn;
                             }
 
                             /*
@@ -1647,7 +1684,8 @@ static struct solver_scratch *solver_new_scratch(struct solver_usage *usage)
     scratch->grid = snewn(cr*cr, unsigned char);
     scratch->rowidx = snewn(cr, unsigned char);
     scratch->colidx = snewn(cr, unsigned char);
-    scratch->set = snewn(cr, unsigned char);
+    scratch->rowmask = snewn(cr, solver_mask);
+    scratch->cellmask = snewn(cr*cr, solver_mask);
     scratch->neighbours = snewn(5*cr, int);
     scratch->bfsqueue = snewn(cr*cr, int);
 #ifdef STANDALONE_SOLVER
@@ -1665,7 +1703,8 @@ static void solver_free_scratch(struct solver_scratch *scratch)
 #endif
     sfree(scratch->bfsqueue);
     sfree(scratch->neighbours);
-    sfree(scratch->set);
+    sfree(scratch->cellmask);
+    sfree(scratch->rowmask);
     sfree(scratch->colidx);
     sfree(scratch->rowidx);
     sfree(scratch->grid);
@@ -2744,8 +2783,8 @@ static int gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
 {
     int cr = usage->cr;
     int i, j, n, sx, sy, bestm, bestr, ret;
-    int *digits;
-    unsigned int used;
+    int digits[32];
+    unsigned int used, alldigits = ((1U << cr) - 1) << 1;
 
     /*
      * Firstly, check for completion! If there are no spaces left
@@ -2776,8 +2815,6 @@ static int gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
 
 	m = usage->blocks->whichblock[y*cr+x];
 	used_xy = usage->row[y] | usage->col[x] | usage->blk[m];
-	if (usage->cge != NULL)
-	    used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
 	if (usage->cge != NULL)
 	    used_xy |= usage->cge[usage->kblocks->whichblock[y*cr+x]];
 	if (usage->diag != NULL) {
@@ -2790,12 +2827,7 @@ static int gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
 	/*
 	 * Find the number of digits that could go in this space.
 	 */
-	m = 0;
-	for (n = 1; n <= cr; n++) {
-	    unsigned int bit = 1 << n;
-	    if ((used_xy & bit) == 0)
-		m++;
-	}
+	m = cr - solver_mask_count(used_xy & alldigits);
 	if (m < bestm || (m == bestm && usage->spaces[j].r < bestr)) {
 	    bestm = m;
 	    bestr = usage->spaces[j].r;
@@ -2822,8 +2854,6 @@ static int gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
      * simply go through all possible values, shuffling them
      * randomly first if necessary.
      */
-    digits = snewn(bestm, int);
-
     j = 0;
     for (n = 1; n <= cr; n++) {
 	unsigned int bit = 1 << n;
@@ -2855,7 +2885,6 @@ static int gridgen_real(struct gridgen_usage *usage, digit *grid, int *steps)
 	usage->nspaces++;
     }
 
-    sfree(digits);
     return ret;
 }
 
@@ -2956,6 +2985,56 @@ static int gridgen(int cr, struct block_structure *blocks,
     return ret;
 }
 
+/*
+ * For the Unreasonable level, clue removal only needs to know
+ * whether the remaining clues still have a unique solution, which
+ * is an exact cover question: each row of the matrix is a digit in
+ * a square, covering that square and the digit's place in its row,
+ * column, block and (in X mode) diagonals. Building the matrix once
+ * per grid and selecting the clues each time is a lot cheaper than
+ * running the full recursive solver on every candidate.
+ */
+static dlx *exact_cover_new(int cr, struct block_structure *blocks,
+			    int xtype)
+{
+    int area = cr*cr;
+    dlx *d = dlx_new(4*area + (xtype ? 2*cr : 0));
+    int cols[6], ncols, x, y, n;
+
+    for (y = 0; y < cr; y++)
+	for (x = 0; x < cr; x++)
+	    for (n = 0; n < cr; n++) {
+		ncols = 0;
+		cols[ncols++] = y*cr+x;
+		cols[ncols++] = area + y*cr+n;
+		cols[ncols++] = 2*area + x*cr+n;
+		cols[ncols++] = 3*area + blocks->whichblock[y*cr+x]*cr+n;
+		if (xtype && ondiag0(y*cr+x))
+		    cols[ncols++] = 4*area + n;
+		if (xtype && ondiag1(y*cr+x))
+		    cols[ncols++] = 4*area + cr + n;
+		dlx_add_row(d, cols, ncols);
+	    }
+
+    return d;
+}
+
+static int exact_cover_unique(dlx *d, int cr, const digit *grid)
+{
+    int checkpoint = dlx_checkpoint(d);
+    int i, ok, ret;
+
+    for (i = 0; i < cr*cr; i++)
+	if (grid[i]) {
+	    ok = dlx_select_row(d, i*cr + grid[i]-1);
+	    assert(ok);
+	}
+    ret = (dlx_solve(d, 2, NULL) == 1);
+    dlx_rollback(d, checkpoint);
+
+    return ret;
+}
+
 /* ----------------------------------------------------------------------
  * End of grid generator code.
  */
@@ -3562,6 +3641,12 @@ static char *new_game_desc(const game_params *params, random_state *rs,
     int coords[16], ncoords;
     int x, y, i, j;
     struct difficulty dlev;
+    dlx *exact;
+    int symm = params->symm;
+    digit *bestgrid = NULL;
+    struct block_structure *bestblocks = NULL;
+    char *bestaux = NULL;
+    int bestdiff = -1;
 
     precompute_sum_bits();
 
@@ -3596,6 +3681,15 @@ static char *new_game_desc(const game_params *params, random_state *rs,
      */
     while (1) {
 
+        /*
+         * Halfway through a time budget, stop insisting on symmetry:
+         * without it more clues can go, so hard grids come sooner.
+         */
+        if (symm != SYMM_NONE && random_gen_used(rs) >= 0.5) {
+            symm = SYMM_NONE;
+            random_gen_relax(rs, GEN_RELAXED_SYMMETRY);
+        }
+
         /*
          * Generate a random solved state, starting by
          * constructing the block structure.
@@ -3702,6 +3796,11 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 			break;
 		}
 	    }
+	    if (good_cages == NULL && last_cages != NULL &&
+		random_gen_settle(rs, GEN_RELAXED_DIFFICULTY)) {
+		good_cages = last_cages;   /* soluble, if not hard enough */
+		last_cages = NULL;
+	    }
 	    if (last_cages)
 		free_block_structure(last_cages);
 	    if (good_cages != NULL) {
@@ -3711,6 +3810,8 @@ static char *new_game_desc(const game_params *params, random_state *rs,
 		memset(grid, 0, area * sizeof *grid);
 		break;
 	    }
+	    if (random_gen_attempt(rs, dlev.kdiff))
+		break;		       /* cancelled: anything will do */
 	    continue;
 	}
 
@@ -3726,7 +3827,7 @@ static char *new_game_desc(const game_params *params, random_state *rs,
                 int i = y*cr+x;
                 int j;
 
-                ncoords = symmetries(params, x, y, coords, params->symm);
+                ncoords = symmetries(params, x, y, coords, symm);
                 for (j = 0; j < ncoords; j++)
                     if (coords[2*j+1]*cr+coords[2*j] < i)
                         break;
@@ -3742,38 +3843,83 @@ static char *new_game_desc(const game_params *params, random_state *rs,
          */
         shuffle(locs, nlocs, sizeof(*locs), rs);
 
+        exact = (dlev.maxdiff == DIFF_RECURSIVE ?
+                 exact_cover_new(cr, blocks, params->xtype) : NULL);
+
         /*
          * Now loop over the shuffled list and, for each element,
          * see whether removing that element (and its reflections)
          * from the grid will still leave the grid soluble.
          */
-        for (i = 0; i < nlocs; i++) {
+        for (i = 0; i < nlocs && !random_gen_cancelled(rs); i++) {
             x = locs[i].x;
             y = locs[i].y;
 
             memcpy(grid2, grid, area);
-            ncoords = symmetries(params, x, y, coords, params->symm);
+            ncoords = symmetries(params, x, y, coords, symm);
             for (j = 0; j < ncoords; j++)
                 grid2[coords[2*j+1]*cr+coords[2*j]] = 0;
 
-            solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
-            if (dlev.diff <= dlev.maxdiff &&
-		(!params->killer || dlev.kdiff <= dlev.maxkdiff)) {
-                for (j = 0; j < ncoords; j++)
-                    grid[coords[2*j+1]*cr+coords[2*j]] = 0;
+            if (exact) {
+                if (!exact_cover_unique(exact, cr, grid2))
+                    continue;
+            } else {
+                solver(cr, blocks, kblocks, params->xtype, grid2, kgrid,
+                       &dlev);
+                if (dlev.diff > dlev.maxdiff ||
+                    (params->killer && dlev.kdiff > dlev.maxkdiff))
+                    continue;
             }
+            for (j = 0; j < ncoords; j++)
+                grid[coords[2*j+1]*cr+coords[2*j]] = 0;
         }
 
+        if (exact)
+            dlx_free(exact);
+
         memcpy(grid2, grid, area);
 
 	solver(cr, blocks, kblocks, params->xtype, grid2, kgrid, &dlev);
 	if (dlev.diff == dlev.maxdiff &&
 	    (!params->killer || dlev.kdiff == dlev.maxkdiff))
 	    break;		       /* found one! */
+
+	/*
+	 * Clues only came out while the grid stayed soluble, so this
+	 * is a valid puzzle, just an easier one. Keep the hardest so
+	 * far in case time runs out.
+	 */
+	if (dlev.diff <= dlev.maxdiff && dlev.diff > bestdiff) {
+	    bestdiff = dlev.diff;
+	    if (!bestgrid)
+		bestgrid = snewn(area, digit);
+	    memcpy(bestgrid, grid, area);
+	    if (bestblocks)
+		free_block_structure(bestblocks);
+	    bestblocks = dup_block_structure(blocks);
+	    sfree(bestaux);
+	    bestaux = dupstr(*aux);
+	}
+	if (bestgrid && random_gen_settle(rs, GEN_RELAXED_DIFFICULTY)) {
+	    memcpy(grid, bestgrid, area);
+	    free_block_structure(blocks);
+	    blocks = bestblocks;
+	    bestblocks = NULL;
+	    sfree(*aux);
+	    *aux = bestaux;
+	    bestaux = NULL;
+	    break;
+	}
+	if (random_gen_attempt(rs, dlev.diff))
+	    break;		       /* cancelled: anything will do */
     }
 
     sfree(grid2);
     sfree(locs);
+    sfree(bestgrid);
+    if (bestblocks)
+	free_block_structure(bestblocks);
+    sfree(bestaux);
 
     /*
      * Now we have the grid as it will be presented to the user.
@@ -4068,14 +4214,14 @@ static game_state *new_game(midend *me, const game_params *params,
     state->grid = snewn(area, digit);
     state->pencil = snewn(area * cr, unsigned char);
     memset(state->pencil, 0, area * cr);
-    state->immutable = snewn(area, unsigned char);
+    state->immutable = shared_new(area);
     memset(state->immutable, FALSE, area);
 
     state->blocks = alloc_block_structure (c, r, area, cr, cr);
 
     if (params->killer) {
 	state->kblocks = alloc_block_structure (c, r, area, cr, area);
-	state->kgrid = snewn(area, digit);
+	state->kgrid = shared_new(area * sizeof(digit));
     } else {
 	state->kblocks = NULL;
 	state->kgrid = NULL;
@@ -4174,17 +4320,12 @@ static game_state *dup_game(const game_state *state)
     ret->grid = snewn(area, digit);
     memcpy(ret->grid, state->grid, area);
 
-    if (state->killer) {
-	ret->kgrid = snewn(area, digit);
-	memcpy(ret->kgrid, state->kgrid, area);
-    } else
-	ret->kgrid = NULL;
+    ret->kgrid = state->kgrid ? shared_ref(state->kgrid) : NULL;
 
     ret->pencil = snewn(area * cr, unsigned char);
     memcpy(ret->pencil, state->pencil, area * cr);
 
-    ret->immutable = snewn(area, unsigned char);
-    memcpy(ret->immutable, state->immutable, area);
+    ret->immutable = shared_ref(state->immutable);
 
     ret->completed = state->completed;
     ret->cheated = state->cheated;
@@ -4198,10 +4339,10 @@ static void free_game(game_state *state)
     if (state->kblocks)
 	free_block_structure(state->kblocks);
 
-    sfree(state->immutable);
+    shared_free(state->immutable);
     sfree(state->pencil);
     sfree(state->grid);
-    if (state->kgrid) sfree(state->kgrid);
+    shared_free(state->kgrid);
     sfree(state);
 }
 
@@ -5593,7 +5734,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    REQUIRE_RBUTTON | REQUIRE_NUMPAD | GEN_RACES | SOLUTION_CACHEABLE,  /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
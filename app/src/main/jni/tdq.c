@@ -4,6 +4,8 @@
  */
 
 #include <assert.h>
+#include <limits.h>
+#include <string.h>
 
 #include "puzzles.h"
 
@@ -86,3 +88,178 @@ void tdq_fill(tdq *tdq)
     for (i = 0; i < tdq->n; i++)
         tdq_add(tdq, i);
 }
+
+/*
+ * Implementation of a ptdq: a byte per integer, with bit p set if it's
+ * pending at level p, which is what solvers tend to write by hand
+ * anyway and keeps adding things as cheap as it can be. Searching
+ * for the next pending integer at a level looks at a whole word's
+ * worth of bytes at a time, and each level keeps a lower bound on its
+ * smallest member so that repeatedly taking the lowest one doesn't
+ * rescan what it has already emptied.
+ *
+ * Everything lives in the one allocation, so that copying a ptdq
+ * (which solvers do whenever they recurse) is cheap.
+ */
+
+struct ptdq {
+    int n, nprio;
+    int *lo;
+    unsigned char *flags;
+};
+
+static size_t ptdq_size(int n, int nprio)
+{
+    return sizeof(struct ptdq) + nprio * sizeof(int) +
+        n + sizeof(unsigned long);
+}
+
+static void ptdq_setup(ptdq *q, int n, int nprio)
+{
+    q->n = n;
+    q->nprio = nprio;
+    q->lo = (int *)(q + 1);
+    q->flags = (unsigned char *)(q->lo + nprio);
+}
+
+ptdq *ptdq_new(int n, int nprio)
+{
+    size_t size = ptdq_size(n, nprio);
+    ptdq *q = (ptdq *)smalloc(size);
+    int p;
+
+    assert(nprio >= 1 && nprio <= CHAR_BIT);
+    memset(q, 0, size);
+    ptdq_setup(q, n, nprio);
+    for (p = 0; p < nprio; p++)
+        q->lo[p] = n;
+    return q;
+}
+
+ptdq *ptdq_copy(const ptdq *q)
+{
+    size_t size = ptdq_size(q->n, q->nprio);
+    ptdq *ret = (ptdq *)smalloc(size);
+
+    memcpy(ret, q, size);
+    ptdq_setup(ret, q->n, q->nprio);
+    return ret;
+}
+
+void ptdq_free(ptdq *q)
+{
+    sfree(q);
+}
+
+void ptdq_add(ptdq *q, int prio, int k)
+{
+    assert((unsigned)k < (unsigned)q->n);
+    if (prio == PTDQ_ALL) {
+        int p;
+        q->flags[k] = (1 << q->nprio) - 1;
+        for (p = 0; p < q->nprio; p++)
+            if (k < q->lo[p])
+                q->lo[p] = k;
+    } else {
+        assert((unsigned)prio < (unsigned)q->nprio);
+        q->flags[k] |= 1 << prio;
+        if (k < q->lo[prio])
+            q->lo[prio] = k;
+    }
+}
+
+void ptdq_add_range(ptdq *q, int prio, int lo, int hi)
+{
+    int p, k, mask;
+
+    assert(0 <= lo && lo <= hi && hi <= q->n);
+    if (lo == hi)
+        return;
+    if (prio == PTDQ_ALL) {
+        mask = (1 << q->nprio) - 1;
+        for (p = 0; p < q->nprio; p++)
+            if (lo < q->lo[p])
+                q->lo[p] = lo;
+    } else {
+        assert((unsigned)prio < (unsigned)q->nprio);
+        mask = 1 << prio;
+        if (lo < q->lo[prio])
+            q->lo[prio] = lo;
+    }
+
+    if (mask == (1 << q->nprio) - 1) {
+        memset(q->flags + lo, mask, hi - lo);
+    } else {
+        for (k = lo; k < hi; k++)
+            q->flags[k] |= mask;
+    }
+}
+
+void ptdq_fill(ptdq *q, int prio)
+{
+    ptdq_add_range(q, prio, 0, q->n);
+}
+
+int ptdq_next(ptdq *q, int prio, int k)
+{
+    const unsigned char *flags = q->flags;
+    unsigned char bit;
+    unsigned long wmask;
+    int n = q->n, from_lo;
+
+    assert((unsigned)prio < (unsigned)q->nprio);
+    from_lo = (k <= q->lo[prio]);
+    if (from_lo)
+        k = q->lo[prio];
+
+    bit = 1 << prio;
+    wmask = (~0UL / 0xFF) * bit;       /* that bit in every byte */
+
+    /*
+     * Step a byte at a time to a word boundary, then a word at a
+     * time until something turns up, then bytewise again to find it.
+     */
+    while (k < n && !(flags[k] & bit) &&
+           (k % sizeof(unsigned long)) != 0)
+        k++;
+    if (k < n && !(flags[k] & bit)) {
+        while (k + (int)sizeof(unsigned long) <= n) {
+            unsigned long w;
+            memcpy(&w, flags + k, sizeof(w));
+            if (w & wmask)
+                break;
+            k += sizeof(unsigned long);
+        }
+        while (k < n && !(flags[k] & bit))
+            k++;
+    }
+
+    if (k >= n) {
+        if (from_lo)
+            q->lo[prio] = n;
+        return -1;
+    }
+
+    q->flags[k] &= ~bit;
+    /*
+     * If the search started from the lower bound, we've just taken
+     * the smallest member, so the bound can move past it.
+     */
+    if (from_lo)
+        q->lo[prio] = k + 1;
+    return k;
+}
+
+int ptdq_remove(ptdq *q, int *prio)
+{
+    int p, k;
+
+    for (p = 0; p < q->nprio; p++) {
+        if ((k = ptdq_next(q, p, 0)) >= 0) {
+            if (prio)
+                *prio = p;
+            return k;
+        }
+    }
+    return -1;
+}
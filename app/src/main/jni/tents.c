@@ -426,7 +426,8 @@ enum { N, U, L, R, D, MAXDIR };	       /* link directions */
 struct solver_scratch {
     char *links;		       /* mapping between trees and tents */
     int *locs;
-    char *place, *mrows, *trows;
+    char *mrows, *fwd, *bwd;
+    int *lastfree;		       /* per row/column: see tents_solve */
 };
 
 static struct solver_scratch *new_scratch(int w, int h)
@@ -435,18 +436,20 @@ static struct solver_scratch *new_scratch(int w, int h)
 
     ret->links = snewn(w*h, char);
     ret->locs = snewn(max(w, h), int);
-    ret->place = snewn(max(w, h), char);
+    ret->lastfree = snewn(w+h, int);
     ret->mrows = snewn(3 * max(w, h), char);
-    ret->trows = snewn(3 * max(w, h), char);
+    ret->fwd = snewn((max(w, h)+1) * (max(w, h)+1), char);
+    ret->bwd = snewn((max(w, h)+1) * (max(w, h)+1), char);
 
     return ret;
 }
 
 static void free_scratch(struct solver_scratch *sc)
 {
-    sfree(sc->trows);
+    sfree(sc->bwd);
+    sfree(sc->fwd);
     sfree(sc->mrows);
-    sfree(sc->place);
+    sfree(sc->lastfree);
     sfree(sc->locs);
     sfree(sc->links);
     sfree(sc);
@@ -460,12 +463,14 @@ static int tents_solve(int w, int h, const char *grid, int *numbers,
 		       char *soln, struct solver_scratch *sc, int diff)
 {
     int x, y, d, i, j;
-    char *mrow, *trow, *trow1, *trow2;
+    char *mrow;
 
     /*
      * Set up solver data.
      */
     memset(sc->links, N, w*h);
+    for (i = 0; i < w+h; i++)
+	sc->lastfree[i] = -1;
 
     /*
      * Set up solution array.
@@ -671,7 +676,8 @@ static int tents_solve(int w, int h, const char *grid, int *numbers,
 	 * by all remaining combinations.
 	 */
 	for (i = 0; i < w+h; i++) {
-	    int start, step, len, start1, start2, n, k;
+	    int start, step, len, start1, start2, n, k, m, a, p, q;
+	    char *fwd, *bwd;
 
 	    if (i < w) {
 		/*
@@ -733,111 +739,58 @@ static int tents_solve(int w, int h, const char *grid, int *numbers,
 		continue;	       /* nothing left to do here */
 
 	    /*
-	     * Now we know we're placing k tents in n squares. Set
-	     * up the first possibility.
-	     */
-	    for (j = 0; j < n; j++)
-		sc->place[j] = (j < k ? TENT : NONTENT);
-
-	    /*
-	     * We're aiming to find squares in this row which are
-	     * invariant over all valid possibilities. Thus, we
-	     * maintain the current state of that invariance. We
-	     * start everything off at MAGIC to indicate that it
-	     * hasn't been set up yet.
+	     * Squares only ever go from BLANK to something else, so if
+	     * this line has as many free squares as it did the last
+	     * time we went through its possibilities, it is exactly as
+	     * it was then, and everything it told us has already been
+	     * written into soln.
 	     */
-	    mrow = sc->mrows;
-	    trow = sc->trows;
-	    trow1 = sc->trows + len;
-	    trow2 = sc->trows + 2*len;
-	    memset(mrow, MAGIC, 3*len);
+	    if (n == sc->lastfree[i])
+		continue;
+	    sc->lastfree[i] = n;
 
 	    /*
-	     * And iterate over all possibilities.
+	     * Now we know we're placing k tents in n squares, no two
+	     * adjacent. We're aiming to find squares in this row which
+	     * are invariant over all valid possibilities; rather than
+	     * go through every possibility in turn, we work out which
+	     * partial placements are valid from each end of the row
+	     * and see where they can meet.
+	     *
+	     * fwd[m*(k+1)+a] says whether the first m free squares can
+	     * hold a tents, with bit 1 set if that can be done leaving
+	     * square m-1 empty and bit 2 if with a tent in it. bwd
+	     * says the same for squares m to n-1 and square m. A row
+	     * wanting more tents than it has free squares (or fewer
+	     * than none) is treated as having them all full (or all
+	     * empty), which is as good as a contradiction.
 	     */
-	    while (1) {
-		int p, valid;
-
-		/*
-		 * See if this possibility is valid. The only way
-		 * it can fail to be valid is if it contains two
-		 * adjacent tents. (Other forms of invalidity, such
-		 * as containing a tent adjacent to one already
-		 * placed, will have been dealt with already by
-		 * other parts of the solver.)
-		 */
-		valid = TRUE;
-		for (j = 0; j+1 < n; j++)
-		    if (sc->place[j] == TENT &&
-			sc->place[j+1] == TENT &&
-			sc->locs[j+1] == sc->locs[j]+1) {
-			valid = FALSE;
-			break;
-		    }
-
-		if (valid) {
-		    /*
-		     * Merge this valid combination into mrow.
-		     */
-		    memset(trow, MAGIC, len);
-		    memset(trow+len, BLANK, 2*len);
-		    for (j = 0; j < n; j++) {
-			trow[sc->locs[j]] = sc->place[j];
-			if (sc->place[j] == TENT) {
-			    int jj;
-			    for (jj = sc->locs[j]-1; jj <= sc->locs[j]+1; jj++)
-				if (jj >= 0 && jj < len)
-				    trow1[jj] = trow2[jj] = NONTENT;
-			}
-		    }
-
-		    for (j = 0; j < 3*len; j++) {
-			if (trow[j] == MAGIC)
-			    continue;
-			if (mrow[j] == MAGIC || mrow[j] == trow[j]) {
-			    /*
-			     * Either this is the first valid
-			     * placement we've found at all, or
-			     * this square's contents are
-			     * consistent with every previous valid
-			     * combination.
-			     */
-			    mrow[j] = trow[j];
-			} else {
-			    /*
-			     * This square's contents fail to match
-			     * what they were in a different
-			     * combination, so we cannot deduce
-			     * anything about this square.
-			     */
-			    mrow[j] = BLANK;
-			}
-		    }
+	    k = max(0, min(k, n));
+	    fwd = sc->fwd;
+	    bwd = sc->bwd;
+	    memset(fwd, 0, (n+1)*(k+1));
+	    memset(bwd, 0, (n+1)*(k+1));
+	    fwd[0] = 1;
+	    for (m = 0; m < n; m++) {
+		int adj = (m > 0 && sc->locs[m] == sc->locs[m-1]+1);
+		for (a = 0; a <= k; a++) {
+		    int f = fwd[m*(k+1)+a];
+		    if (f)
+			fwd[(m+1)*(k+1)+a] |= 1;
+		    if (a < k && ((f & 1) || ((f & 2) && !adj)))
+			fwd[(m+1)*(k+1)+a+1] |= 2;
 		}
-
-		/*
-		 * Find the next combination of k choices from n.
-		 * We do this by finding the rightmost tent which
-		 * can be moved one place right, doing so, and
-		 * shunting all tents to the right of that as far
-		 * left as they can go.
-		 */
-		p = 0;
-		for (j = n-1; j > 0; j--) {
-		    if (sc->place[j] == TENT)
-			p++;
-		    if (sc->place[j] == NONTENT && sc->place[j-1] == TENT) {
-			sc->place[j-1] = NONTENT;
-			sc->place[j] = TENT;
-			while (p--)
-			    sc->place[++j] = TENT;
-			while (++j < n)
-			    sc->place[j] = NONTENT;
-			break;
-		    }
+	    }
+	    bwd[n*(k+1)] = 1;
+	    for (m = n; m-- > 0 ;) {
+		int adj = (m+1 < n && sc->locs[m+1] == sc->locs[m]+1);
+		for (a = 0; a <= k; a++) {
+		    int b = bwd[(m+1)*(k+1)+a];
+		    if (b)
+			bwd[m*(k+1)+a] |= 1;
+		    if (a < k && ((b & 1) || ((b & 2) && !adj)))
+			bwd[m*(k+1)+a+1] |= 2;
 		}
-		if (j <= 0)
-		    break;	       /* we've finished */
 	    }
 
 	    /*
@@ -845,9 +798,48 @@ static int tents_solve(int w, int h, const char *grid, int *numbers,
 	     * which case we have an internally inconsistent
 	     * puzzle.
 	     */
-	    if (mrow[sc->locs[0]] == MAGIC)
+	    if (!fwd[n*(k+1)+k])
 		return 0;	       /* inconsistent */
 
+	    /*
+	     * mrow holds what every valid placement agrees on: for
+	     * each free square, TENT or NONTENT or BLANK if they
+	     * disagree, and MAGIC for squares we aren't placing in.
+	     * After it come the same for the rows either side, where
+	     * a square is NONTENT if every valid placement puts a
+	     * tent beside it.
+	     */
+	    mrow = sc->mrows;
+	    memset(mrow, MAGIC, len);
+	    for (m = 0; m < n; m++) {
+		int adj = (m > 0 && sc->locs[m] == sc->locs[m-1]+1);
+		int cantent = FALSE, canempty = FALSE;
+
+		for (a = 0; a <= k; a++) {
+		    int f = fwd[m*(k+1)+a], b = bwd[m*(k+1)+k-a];
+		    if (f && (b & 1))
+			canempty = TRUE;
+		    if (((f & 1) || ((f & 2) && !adj)) && (b & 2))
+			cantent = TRUE;
+		}
+		mrow[sc->locs[m]] = (!cantent ? NONTENT :
+				     !canempty ? TENT : BLANK);
+	    }
+	    p = q = 0;
+	    for (j = 0; j < len; j++) {
+		int canempty = FALSE;
+
+		/* Free squares 0..p-1 and q..n-1 are clear of j-1..j+1. */
+		while (p < n && sc->locs[p] < j-1)
+		    p++;
+		while (q < n && sc->locs[q] <= j+1)
+		    q++;
+		for (a = 0; a <= k; a++)
+		    if (fwd[p*(k+1)+a] && bwd[q*(k+1)+k-a])
+			canempty = TRUE;
+		mrow[len+j] = mrow[2*len+j] = (canempty ? BLANK : NONTENT);
+	    }
+
 	    /*
 	     * Now go through mrow and see if there's anything
 	     * we've deduced which wasn't already mentioned in soln.
@@ -912,11 +904,13 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
     char *puzzle = snewn(w*h, char);
     int *numbers = snewn(w+h, int);
     char *soln = snewn(w*h, char);
-    int *temp = snewn(2*w*h, int);
+    int *temp = snewn(2*w*h, int), *order = temp + w*h;
     int maxedges = ntrees*4 + w*h;
     int *edges = snewn(2*maxedges, int);
     int *capacity = snewn(maxedges, int);
     int *flow = snewn(maxedges, int);
+    int *backedges = snewn(maxedges, int);
+    void *mfscratch = smalloc(maxflow_scratch_size(w*h+2));
     struct solver_scratch *sc = new_scratch(w, h);
     char *ret, *p;
     int i, j, nedges;
@@ -985,6 +979,8 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
 	for (i = 0; i < w*h; i++)
 	    temp[i] = i;
 	shuffle(temp, w*h, sizeof(*temp), rs);
+	for (i = 0; i < w*h; i++)
+	    order[temp[i]] = i;
 
 	/*
 	 * The first `ntrees' entries in temp which we can get
@@ -1013,21 +1009,29 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
 	    continue;		       /* couldn't place all the tents */
 
 	/*
-	 * Now we build up the list of graph edges.
+	 * Now we build up the list of graph edges, in the sorted
+	 * order maxflow wants them: so each tent's edges go to its
+	 * non-tent neighbours in order of their node numbers.
 	 */
 	nedges = 0;
 	for (i = 0; i < w*h; i++) {
 	    if (grid[temp[i]] == TENT) {
-		for (j = 0; j < w*h; j++) {
-		    if (grid[temp[j]] != TENT) {
-			int xi = temp[i] % w, yi = temp[i] / w;
-			int xj = temp[j] % w, yj = temp[j] / w;
-			if (abs(xi-xj) + abs(yi-yj) == 1) {
-			    edges[nedges*2] = i;
-			    edges[nedges*2+1] = j;
-			    capacity[nedges] = 1;
-			    nedges++;
+		int xi = temp[i] % w, yi = temp[i] / w;
+		int d, k, first = nedges;
+
+		for (d = 1; d < MAXDIR; d++) {
+		    int x2 = xi + dx(d), y2 = yi + dy(d);
+		    if (x2 >= 0 && x2 < w && y2 >= 0 && y2 < h &&
+			grid[y2*w+x2] != TENT) {
+			j = order[y2*w+x2];
+			for (k = nedges; k > first && edges[k*2-1] > j; k--) {
+			    edges[k*2] = i;
+			    edges[k*2+1] = edges[k*2-1];
 			}
+			edges[k*2] = i;
+			edges[k*2+1] = j;
+			capacity[nedges] = 1;
+			nedges++;
 		    }
 		}
 	    } else {
@@ -1061,7 +1065,9 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
 	 * Now we're ready to call the maxflow algorithm to place the
 	 * trees.
 	 */
-	j = maxflow(w*h+2, w*h+1, w*h, nedges, edges, capacity, flow, NULL);
+	maxflow_setup_backedges(nedges, edges, backedges);
+	j = maxflow_with_scratch(mfscratch, w*h+2, w*h+1, w*h, nedges,
+				 edges, backedges, capacity, flow, NULL);
 
 	if (j < ntrees)
 	    continue;		       /* couldn't place all the tents */
@@ -1179,6 +1185,8 @@ static char *new_game_desc(const game_params *params_in, random_state *rs,
     *aux = sresize(*aux, p - *aux, char);
 
     free_scratch(sc);
+    sfree(mfscratch);
+    sfree(backedges);
     sfree(flow);
     sfree(capacity);
     sfree(edges);
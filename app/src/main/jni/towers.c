@@ -262,6 +262,14 @@ struct solver_ctx {
     int *clues;
     long *iscratch;
     int *dscratch;
+    /*
+     * For solver_hard: the candidates in each square of a clue's
+     * row, as bitmaps, the last time analysing the clue got nowhere
+     * (or all zero if it hasn't been tried). If they haven't changed
+     * since, there's no point trying again.
+     */
+    long *allowed;
+    long *tried;
 };
 
 static int solver_easy(struct latin_solver *solver, void *vctx)
@@ -451,7 +459,7 @@ static int solver_hard(struct latin_solver *solver, void *vctx)
     struct solver_ctx *ctx = (struct solver_ctx *)vctx;
     int w = ctx->w;
     int c, i, j, n, best, clue, start, step, ret;
-    long bitmap;
+    long bitmap, *allowed = ctx->allowed;
 #ifdef STANDALONE_SOLVER
     char prefix[256];
 #endif
@@ -460,11 +468,26 @@ static int solver_hard(struct latin_solver *solver, void *vctx)
      * Go over every clue analysing all possibilities.
      */
     for (c = 0; c < 4*w; c++) {
+	long *tried = ctx->tried + c*w;
+
 	clue = ctx->clues[c];
 	if (!clue)
 	    continue;
 	CSTARTSTEP(start, step, c, w);
 
+	for (i = 0; i < w; i++) {
+	    int pos = start + step * i;
+	    allowed[i] = 0;
+	    for (j = 1; j <= w; j++)
+		if (solver->cube[pos*w+j-1])
+		    allowed[i] |= 1L << j;
+	}
+	for (i = 0; i < w; i++)
+	    if (allowed[i] != tried[i])
+		break;
+	if (i == w)
+	    continue;		       /* nothing new to learn here */
+
 	for (i = 0; i < w; i++)
 	    ctx->iscratch[i] = 0;
 
@@ -485,12 +508,20 @@ static int solver_hard(struct latin_solver *solver, void *vctx)
 		 * Find the next valid value for cell i.
 		 */
 		int limit = (n == clue ? best : w);
-		int pos = start + step * i;
 		for (j = ctx->dscratch[i] + 1; j <= limit; j++) {
 		    if (bitmap & (1L << j))
 			continue;      /* used this one already */
-		    if (!solver->cube[pos*w+j-1])
+		    if (!(allowed[i] & (1L << j)))
 			continue;      /* ruled out already */
+		    /*
+		     * Even if every square after this one showed a new
+		     * tallest tower, there'd have to be enough of them
+		     * left, and enough taller heights to use.
+		     */
+		    if (j > best ?
+			n + 1 + min(w-1 - i, w - j) < clue :
+			n + min(w-1 - i, w - best) < clue)
+			continue;
 
 		    /* Found one. */
 		    break;
@@ -521,8 +552,18 @@ static int solver_hard(struct latin_solver *solver, void *vctx)
 		}
 	    } else {
 		if (n == clue) {
-		    for (j = 0; j < w; j++)
+		    int full = TRUE;
+		    for (j = 0; j < w; j++) {
 			ctx->iscratch[j] |= 1L << ctx->dscratch[j];
+			if (ctx->iscratch[j] != allowed[j])
+			    full = FALSE;
+		    }
+		    /*
+		     * Once every candidate has been seen in some layout,
+		     * no more layouts can rule anything out.
+		     */
+		    if (full)
+			break;
 		}
 		i--;
 		bitmap &= ~(1L << ctx->dscratch[i]);
@@ -574,6 +615,9 @@ static int solver_hard(struct latin_solver *solver, void *vctx)
 	    if (ret)
 		return ret;
 	}
+
+	for (i = 0; i < w; i++)
+	    tried[i] = allowed[i];
     }
 
     return 0;
@@ -593,6 +637,9 @@ static int solver(int w, int *clues, digit *soln, int maxdiff)
     ctx.started = FALSE;
     ctx.iscratch = snewn(w, long);
     ctx.dscratch = snewn(w+1, int);
+    ctx.allowed = snewn(w, long);
+    ctx.tried = snewn(4*w*w, long);
+    memset(ctx.tried, 0, 4*w*w * sizeof(long));
 
     ret = latin_solver(soln, w, maxdiff,
 		       DIFF_EASY, DIFF_HARD, DIFF_EXTREME,
@@ -601,6 +648,8 @@ static int solver(int w, int *clues, digit *soln, int maxdiff)
 
     sfree(ctx.iscratch);
     sfree(ctx.dscratch);
+    sfree(ctx.allowed);
+    sfree(ctx.tried);
 
     return ret;
 }
@@ -688,7 +737,7 @@ done
 	     */
 	    memset(soln2, 0, a);
 	    ret = solver(w, clues, soln2, diff);
-	    if (ret > diff)
+	    if (ret > diff && !random_gen_attempt(rs, ret))
 		continue;
 	}
 
@@ -727,7 +776,8 @@ done
 	 */
 	memcpy(soln2, grid, a);
 	ret = solver(w, clues, soln2, diff);
-	if (ret != diff)
+	if (ret != diff && !(ret < diff && random_gen_settle(rs, GEN_RELAXED_DIFFICULTY)) &&
+	    !random_gen_attempt(rs, ret))
 	    continue;		       /* go round again */
 
 	/*
@@ -2011,7 +2061,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    REQUIRE_RBUTTON | REQUIRE_NUMPAD | GEN_RACES | SOLUTION_CACHEABLE,  /* flags */
 };
 
 #ifdef STANDALONE_SOLVER
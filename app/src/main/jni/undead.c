@@ -900,60 +900,181 @@ int solve_iterative(game_state *state, struct path *paths) {
     return solved;
 }
 
-int solve_bruteforce(game_state *state, struct path *paths) {
-    int solved, correct;
-    int number_solutions;
-    int p,i;
+/*
+ * Rather than enumerating every combination of the cells left
+ * ambiguous by solve_iterative, solve_bruteforce searches for
+ * solutions with the path clues propagated after every guess.
+ *
+ * Each end of a path sees a cell once, twice or not at all for each
+ * kind of monster it might hold, so a clue is a sum over the path's
+ * cells. Knowing the smallest and largest amount every cell can
+ * still add, a monster is ruled out wherever it would leave that sum
+ * unable to reach the clue; what that rules out narrows the sums of
+ * every other path through the cell, and so on until nothing
+ * changes. Only then is a cell guessed, picking one with the fewest
+ * monsters left so the search stays small.
+ */
+struct bf_solver {
+    game_state *state;
+    struct path *paths;
+    int *seen;          /* per path, 6 per monster: start then end */
+    int *soln;
+    int nsolutions;
+};
 
-    struct guess loop;
+int bf_propagate(struct bf_solver *sv, int *possible) {
+    int num_total = sv->state->common->num_total;
+    int counts[3], limits[3];
+    int p,e,i,t,m,lo,hi,min_seen,max_seen,changed;
+    int *seen;
 
-    loop.guess = snewn(state->common->num_total,int);
-    loop.possible = snewn(state->common->num_total,int);
+    limits[0] = sv->state->common->num_ghosts;
+    limits[1] = sv->state->common->num_vampires;
+    limits[2] = sv->state->common->num_zombies;
 
-    for (i=0;i<state->common->num_total;i++) {
-        loop.possible[i] = state->guess[i];
-        switch (state->guess[i]) {
-          case 1: loop.guess[i] = 1; break;
-          case 2: loop.guess[i] = 2; break;
-          case 3: loop.guess[i] = 1; break;
-          case 4: loop.guess[i] = 4; break;
-          case 5: loop.guess[i] = 1; break;
-          case 6: loop.guess[i] = 2; break;
-          case 7: loop.guess[i] = 1; break;
+    do {
+        changed = FALSE;
+
+        seen = sv->seen;
+        for (p=0;p<sv->state->common->num_paths;p++) {
+            struct path *path = &sv->paths[p];
+            for (e=0;e<2;e++) {
+                int target = e ? path->sightings_end : path->sightings_start;
+
+                lo = hi = 0;
+                for (i=0;i<path->num_monsters;i++) {
+                    m = path->mapping[i];
+                    min_seen = 2; max_seen = 0;
+                    for (t=0;t<3;t++) if (possible[m] & (1<<t)) {
+                        min_seen = min(min_seen, seen[i*6+e*3+t]);
+                        max_seen = max(max_seen, seen[i*6+e*3+t]);
+                    }
+                    lo += min_seen; hi += max_seen;
+                }
+                if (lo > target || hi < target) return FALSE;
+                if (lo == hi) continue;
+
+                for (i=0;i<path->num_monsters;i++) {
+                    m = path->mapping[i];
+                    min_seen = 2; max_seen = 0;
+                    for (t=0;t<3;t++) if (possible[m] & (1<<t)) {
+                        min_seen = min(min_seen, seen[i*6+e*3+t]);
+                        max_seen = max(max_seen, seen[i*6+e*3+t]);
+                    }
+                    for (t=0;t<3;t++) if (possible[m] & (1<<t)) {
+                        int c = seen[i*6+e*3+t];
+                        if (lo - min_seen + c > target ||
+                            hi - max_seen + c < target) {
+                            possible[m] &= ~(1<<t);
+                            changed = TRUE;
+                        }
+                    }
+                    if (possible[m] == 0) return FALSE;
+                }
+            }
+            seen += path->num_monsters * 6;
+        }
+
+        /* No more of any monster than the counts allow. */
+        counts[0] = counts[1] = counts[2] = 0;
+        for (m=0;m<num_total;m++) {
+            if (possible[m] == 1) counts[0]++;
+            else if (possible[m] == 2) counts[1]++;
+            else if (possible[m] == 4) counts[2]++;
+        }
+        for (t=0;t<3;t++) {
+            if (counts[t] > limits[t]) return FALSE;
+            if (counts[t] < limits[t]) continue;
+            for (m=0;m<num_total;m++)
+                if (possible[m] != (1<<t) && (possible[m] & (1<<t))) {
+                    possible[m] &= ~(1<<t);
+                    changed = TRUE;
+                }
+        }
+    } while (changed);
+
+    return TRUE;
+}
+
+/* Stops once a second solution turns up. */
+void bf_search(struct bf_solver *sv, int *possible) {
+    int num_total = sv->state->common->num_total;
+    int *next = possible + num_total;
+    int m,t,best,nbest,n;
+
+    if (!bf_propagate(sv, possible)) return;
+
+    best = -1; nbest = 4;
+    for (m=0;m<num_total;m++) {
+        n = (possible[m] & 1) + ((possible[m] >> 1) & 1) +
+            ((possible[m] >> 2) & 1);
+        if (n == 0) return;
+        if (n > 1 && n < nbest) {
+            best = m; nbest = n;
         }
     }
 
-    solved = FALSE;
-    number_solutions = 0;
+    if (best == -1) {
+        if (sv->nsolutions++ == 0)
+            memcpy(sv->soln, possible, num_total*sizeof(int));
+        return;
+    }
 
-    while (TRUE) {
+    for (t=0;t<3 && sv->nsolutions < 2;t++) {
+        if (!(possible[best] & (1<<t))) continue;
+        memcpy(next, possible, num_total*sizeof(int));
+        next[best] = 1<<t;
+        bf_search(sv, next);
+    }
+}
 
-        correct = TRUE;
-        if (!check_numbers(state,loop.guess)) correct = FALSE;
-        else 
-            for (p=0;p<state->common->num_paths;p++)
-                if (!check_solution(loop.guess,paths[p])) {
-                    correct = FALSE; break;
-                }
-        if (correct) {
-            number_solutions++;
-            solved = TRUE;
-            if(number_solutions > 1) {
-                solved = FALSE;
-                break; 
+int solve_bruteforce(game_state *state, struct path *paths) {
+    struct bf_solver sv;
+    int num_total = state->common->num_total;
+    int *possible;
+    int p,e,g,i,mirror,total_monsters;
+
+    total_monsters = 0;
+    for (p=0;p<state->common->num_paths;p++)
+        total_monsters += paths[p].num_monsters;
+
+    sv.state = state;
+    sv.paths = paths;
+    sv.seen = snewn(total_monsters * 6 + 1, int);
+    sv.soln = snewn(num_total + 1, int);
+    sv.nsolutions = 0;
+
+    /* How often each end of each path sees a monster in each cell. */
+    for (p=0,i=0;p<state->common->num_paths;i+=paths[p].num_monsters*6,p++) {
+        int *seen = sv.seen + i;
+        for (g=0;g<paths[p].num_monsters*6;g++) seen[g] = 0;
+        for (e=0;e<2;e++) {
+            mirror = FALSE;
+            for (g=0;g<paths[p].length;g++) {
+                int pos = e ? paths[p].length-1-g : g, k;
+                if (paths[p].p[pos] == -1) { mirror = TRUE; continue; }
+                for (k=0;paths[p].mapping[k] != paths[p].p[pos];k++);
+                if (mirror) seen[k*6+e*3+0]++;
+                else seen[k*6+e*3+1]++;
+                seen[k*6+e*3+2]++;
             }
-            for (i=0;i<state->common->num_total;i++)
-                state->guess[i] = loop.guess[i];
-        }
-        if (!next_list(&loop,state->common->num_total -1)) {
-            break;
         }
     }
 
-    sfree(loop.possible);
-    sfree(loop.guess);
+    /* One set of possibilities for each level of the search. */
+    possible = snewn((num_total+1) * num_total + 1, int);
+    for (g=0;g<num_total;g++) possible[g] = state->guess[g];
 
-    return solved;
+    bf_search(&sv, possible);
+
+    if (sv.nsolutions == 1)
+        for (g=0;g<num_total;g++) state->guess[g] = sv.soln[g];
+
+    sfree(possible);
+    sfree(sv.soln);
+    sfree(sv.seen);
+
+    return sv.nsolutions == 1;
 }
 
 int path_cmp(const void *a, const void *b) {
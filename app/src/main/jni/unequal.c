@@ -720,16 +720,30 @@ static int solver_adjacent(struct latin_solver *solver, void *vctx)
 static int solver_adjacent_set(struct latin_solver *solver, void *vctx)
 {
     struct solver_ctx *ctx = (struct solver_ctx *)vctx;
-    int x, y, i, n, nn, o = solver->o, nx, ny, gd;
-    int nchanged = 0, *scratch = snewn(o, int);
+    int x, y, i, n, o = solver->o, nx, ny;
+    int nchanged = 0;
+    unsigned long full = ((1UL << (o-1)) << 1) - 1;
+    unsigned long *poss = snewn(o*o, unsigned long);
 
     /* Update possible values based on other possible values
-     * of adjacent squares, and adjacency clues. */
+     * of adjacent squares, and adjacency clues. We keep the
+     * possibles for each square as a bitmap (bit n for the number
+     * n+1), updating it as we rule things out. */
+
+    for (x = 0; x < o; x++) {
+        for (y = 0; y < o; y++) {
+            poss[x*o+y] = 0;
+            for (n = 0; n < o; n++)
+                if (cube(x, y, n+1))
+                    poss[x*o+y] |= 1UL << n;
+        }
+    }
 
     for (x = 0; x < o; x++) {
         for (y = 0; y < o; y++) {
             for (i = 0; i < 4; i++) {
                 int isadjacent = (GRID(ctx->state, flags, x, y) & adjthan[i].f);
+                unsigned long here = poss[x*o+y], allowed, rule_out;
 
                 nx = x + adjthan[i].dx, ny = y + adjthan[i].dy;
                 if (nx < 0 || ny < 0 || nx >= o || ny >= o)
@@ -738,29 +752,23 @@ static int solver_adjacent_set(struct latin_solver *solver, void *vctx)
                 /* We know the current possibles for the square (x,y)
                  * and also the adjacency clue from (x,y) to (nx,ny).
                  * Construct a maximum set of possibles for (nx,ny)
-                 * in scratch, based on these constraints... */
-
-                memset(scratch, 0, o*sizeof(int));
+                 * based on these constraints... */
 
-                for (n = 0; n < o; n++) {
-                    if (cube(x, y, n+1) == FALSE) continue;
-
-                    for (nn = 0; nn < o; nn++) {
-                        if (n == nn) continue;
-
-                        gd = abs(nn - n);
-                        if (isadjacent && (gd != 1)) continue;
-                        if (!isadjacent && (gd == 1)) continue;
-
-                        scratch[nn] = 1;
-                    }
+                if (isadjacent) {
+                    allowed = ((here << 1) | (here >> 1)) & full;
+                } else {
+                    allowed = 0;
+                    for (n = 0; n < o && allowed != full; n++)
+                        if (here & (1UL << n))
+                            allowed |= full & ~((7UL << n) >> 1);
                 }
 
                 /* ...and remove any possibilities for (nx,ny) that are
-                 * currently set but are not indicated in scratch. */
+                 * currently set but are not indicated in it. */
+                rule_out = poss[nx*o+ny] & ~allowed;
+                if (!rule_out) continue;
                 for (n = 0; n < o; n++) {
-                    if (scratch[n] == 1) continue;
-                    if (cube(nx, ny, n+1) == FALSE) continue;
+                    if (!(rule_out & (1UL << n))) continue;
 
 #ifdef STANDALONE_SOLVER
                     if (solver_show_working) {
@@ -774,10 +782,12 @@ static int solver_adjacent_set(struct latin_solver *solver, void *vctx)
                     cube(nx, ny, n+1) = FALSE;
                     nchanged++;
                 }
+                poss[nx*o+ny] &= allowed;
             }
         }
     }
 
+    sfree(poss);
     return nchanged;
 }
 
@@ -1151,7 +1161,9 @@ generate:
             if (solver_show_working)
                 printf("game_assemble: puzzle as generated is too easy.\n");
 #endif
-            if (ntries < MAXTRIES) {
+            if (ntries < MAXTRIES &&
+                !random_gen_settle(rs, GEN_RELAXED_DIFFICULTY) &&
+                !random_gen_attempt(rs, params->diff - 1)) {
                 ntries++;
                 goto generate;
             }
@@ -2052,7 +2064,7 @@ const struct game thegame = {
 #endif
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
-    REQUIRE_RBUTTON | REQUIRE_NUMPAD,  /* flags */
+    REQUIRE_RBUTTON | REQUIRE_NUMPAD | GEN_RACES | SOLUTION_CACHEABLE,  /* flags */
 };
 
 /* ----------------------------------------------------------------------
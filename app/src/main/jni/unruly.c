@@ -463,17 +463,34 @@ static char *game_text_format(const game_state *state)
  * Solver *
  * ****** */
 
+/*
+ * Besides the per-line counts, the solver keeps every row and column
+ * as two bitmaps, of the squares known to be 1 and known to be 0, so
+ * that looking for threes or for matching rows takes a few word
+ * operations per line instead of a pass over its squares. Bit j of
+ * a line is bit j%32 of its word j/32; rows take rowwords words each
+ * and columns colwords.
+ */
+#define LINE_BITS 32
+
 struct unruly_scratch {
     int *ones_rows;
     int *ones_cols;
     int *zeros_rows;
     int *zeros_cols;
+
+    int rowwords, colwords;
+    unsigned int *ones_rowbits;
+    unsigned int *ones_colbits;
+    unsigned int *zeros_rowbits;
+    unsigned int *zeros_colbits;
 };
 
 static void unruly_solver_update_remaining(const game_state *state,
                                            struct unruly_scratch *scratch)
 {
     int w2 = state->w2, h2 = state->h2;
+    int rw = scratch->rowwords, cw = scratch->colwords;
     int x, y;
 
     /* Reset all scratch data */
@@ -481,19 +498,64 @@ static void unruly_solver_update_remaining(const game_state *state,
     memset(scratch->ones_cols, 0, w2 * sizeof(int));
     memset(scratch->zeros_rows, 0, h2 * sizeof(int));
     memset(scratch->zeros_cols, 0, w2 * sizeof(int));
+    memset(scratch->ones_rowbits, 0, h2 * rw * sizeof(unsigned int));
+    memset(scratch->ones_colbits, 0, w2 * cw * sizeof(unsigned int));
+    memset(scratch->zeros_rowbits, 0, h2 * rw * sizeof(unsigned int));
+    memset(scratch->zeros_colbits, 0, w2 * cw * sizeof(unsigned int));
 
     for (x = 0; x < w2; x++)
         for (y = 0; y < h2; y++) {
+            unsigned int xbit = 1U << (x % LINE_BITS);
+            unsigned int ybit = 1U << (y % LINE_BITS);
             if (state->grid[y * w2 + x] == N_ONE) {
                 scratch->ones_rows[y]++;
                 scratch->ones_cols[x]++;
+                scratch->ones_rowbits[y * rw + x / LINE_BITS] |= xbit;
+                scratch->ones_colbits[x * cw + y / LINE_BITS] |= ybit;
             } else if (state->grid[y * w2 + x] == N_ZERO) {
                 scratch->zeros_rows[y]++;
                 scratch->zeros_cols[x]++;
+                scratch->zeros_rowbits[y * rw + x / LINE_BITS] |= xbit;
+                scratch->zeros_colbits[x * cw + y / LINE_BITS] |= ybit;
             }
         }
 }
 
+/* Fill an empty square, keeping the counts and bitmaps up to date. */
+static void unruly_solver_place(game_state *state,
+                                struct unruly_scratch *scratch,
+                                int i, char fill)
+{
+    int w2 = state->w2, x = i % w2, y = i / w2;
+    int rw = scratch->rowwords, cw = scratch->colwords;
+
+    assert(state->grid[i] == EMPTY);
+    state->grid[i] = fill;
+    if (fill == N_ONE) {
+        scratch->ones_rows[y]++;
+        scratch->ones_cols[x]++;
+        scratch->ones_rowbits[y * rw + x / LINE_BITS] |=
+            1U << (x % LINE_BITS);
+        scratch->ones_colbits[x * cw + y / LINE_BITS] |=
+            1U << (y % LINE_BITS);
+    } else {
+        scratch->zeros_rows[y]++;
+        scratch->zeros_cols[x]++;
+        scratch->zeros_rowbits[y * rw + x / LINE_BITS] |=
+            1U << (x % LINE_BITS);
+        scratch->zeros_colbits[x * cw + y / LINE_BITS] |=
+            1U << (y % LINE_BITS);
+    }
+}
+
+static int unruly_count_bits(unsigned int word)
+{
+    word = word - ((word >> 1) & 0x55555555U);
+    word = (word & 0x33333333U) + ((word >> 2) & 0x33333333U);
+    word = (word + (word >> 4)) & 0x0F0F0F0FU;
+    return (int)((word * 0x01010101U) >> 24);
+}
+
 static struct unruly_scratch *unruly_new_scratch(const game_state *state)
 {
     int w2 = state->w2, h2 = state->h2;
@@ -505,6 +567,13 @@ static struct unruly_scratch *unruly_new_scratch(const game_state *state)
     ret->zeros_rows = snewn(h2, int);
     ret->zeros_cols = snewn(w2, int);
 
+    ret->rowwords = (w2 + LINE_BITS - 1) / LINE_BITS;
+    ret->colwords = (h2 + LINE_BITS - 1) / LINE_BITS;
+    ret->ones_rowbits = snewn(h2 * ret->rowwords, unsigned int);
+    ret->ones_colbits = snewn(w2 * ret->colwords, unsigned int);
+    ret->zeros_rowbits = snewn(h2 * ret->rowwords, unsigned int);
+    ret->zeros_colbits = snewn(w2 * ret->colwords, unsigned int);
+
     unruly_solver_update_remaining(state, ret);
 
     return ret;
@@ -516,74 +585,76 @@ static void unruly_free_scratch(struct unruly_scratch *scratch)
     sfree(scratch->ones_cols);
     sfree(scratch->zeros_rows);
     sfree(scratch->zeros_cols);
+    sfree(scratch->ones_rowbits);
+    sfree(scratch->ones_colbits);
+    sfree(scratch->zeros_rowbits);
+    sfree(scratch->zeros_colbits);
 
     sfree(scratch);
 }
 
-static int unruly_solver_check_threes(game_state *state, int *rowcount,
-                                      int *colcount, int horizontal,
+static int unruly_solver_check_threes(game_state *state,
+                                      struct unruly_scratch *scratch,
+                                      int horizontal,
                                       char check, char block)
 {
     int w2 = state->w2, h2 = state->h2;
 
-    int dx = horizontal ? 1 : 0, dy = 1 - dx;
-    int sx = dx, sy = dy;
-    int ex = w2 - dx, ey = h2 - dy;
+    int nl = (horizontal ? h2 : w2), len = (horizontal ? w2 : h2);
+    int nw = (horizontal ? scratch->rowwords : scratch->colwords);
+    unsigned int *checkbits, *blockbits;
 
-    int x, y;
+    int l, k, j;
     int ret = 0;
 
-    /* Check for any three squares which almost form three in a row */
-    for (y = sy; y < ey; y++) {
-        for (x = sx; x < ex; x++) {
-            int i1 = (y-dy) * w2 + (x-dx);
-            int i2 = y * w2 + x;
-            int i3 = (y+dy) * w2 + (x+dx);
+    if (check == N_ONE) {
+        checkbits = horizontal ? scratch->ones_rowbits : scratch->ones_colbits;
+        blockbits = horizontal ? scratch->zeros_rowbits : scratch->zeros_colbits;
+    } else {
+        checkbits = horizontal ? scratch->zeros_rowbits : scratch->zeros_colbits;
+        blockbits = horizontal ? scratch->ones_rowbits : scratch->ones_colbits;
+    }
 
-            if (state->grid[i1] == check && state->grid[i2] == check
-                && state->grid[i3] == EMPTY) {
-                ret++;
-#ifdef STANDALONE_SOLVER
-                if (solver_verbose) {
-                    printf("Solver: %i,%i and %i,%i confirm %c at %i,%i\n",
-                           i1 % w2, i1 / w2, i2 % w2, i2 / w2,
-                           (block == N_ONE ? '1' : '0'), i3 % w2,
-                           i3 / w2);
-                }
-#endif
-                state->grid[i3] = block;
-                rowcount[i3 / w2]++;
-                colcount[i3 % w2]++;
-            }
-            if (state->grid[i1] == check && state->grid[i2] == EMPTY
-                && state->grid[i3] == check) {
-                ret++;
-#ifdef STANDALONE_SOLVER
-                if (solver_verbose) {
-                    printf("Solver: %i,%i and %i,%i confirm %c at %i,%i\n",
-                           i1 % w2, i1 / w2, i3 % w2, i3 / w2,
-                           (block == N_ONE ? '1' : '0'), i2 % w2,
-                           i2 / w2);
-                }
-#endif
-                state->grid[i2] = block;
-                rowcount[i2 / w2]++;
-                colcount[i2 % w2]++;
-            }
-            if (state->grid[i1] == EMPTY && state->grid[i2] == check
-                && state->grid[i3] == check) {
+    /*
+     * Any empty square which would make three in a row with two
+     * squares of type 'check' next to it, or either side of it, must
+     * be 'block'. Filling one in can't create or remove such a pair,
+     * so every line can be done in one go.
+     */
+    for (l = 0; l < nl; l++) {
+        const unsigned int *c = checkbits + l * nw;
+        const unsigned int *b = blockbits + l * nw;
+
+        for (k = 0; k < nw; k++) {
+            unsigned int prev = (k > 0 ? c[k-1] : 0);
+            unsigned int next = (k+1 < nw ? c[k+1] : 0);
+            unsigned int l1 = (c[k] << 1) | (prev >> (LINE_BITS-1));
+            unsigned int l2 = (c[k] << 2) | (prev >> (LINE_BITS-2));
+            unsigned int r1 = (c[k] >> 1) | (next << (LINE_BITS-1));
+            unsigned int r2 = (c[k] >> 2) | (next << (LINE_BITS-2));
+            unsigned int found = ~(c[k] | b[k]) &
+                ((l1 & l2) | (l1 & r1) | (r1 & r2));
+
+            if (k == nw-1 && len % LINE_BITS)
+                found &= (1U << (len % LINE_BITS)) - 1;
+
+            for (j = 0; found; j++, found >>= 1) {
+                int p, i;
+
+                if (!(found & 1))
+                    continue;
+                p = k * LINE_BITS + j;
+                i = (horizontal ? l * w2 + p : p * w2 + l);
                 ret++;
 #ifdef STANDALONE_SOLVER
                 if (solver_verbose) {
-                    printf("Solver: %i,%i and %i,%i confirm %c at %i,%i\n",
-                           i2 % w2, i2 / w2, i3 % w2, i3 / w2,
-                           (block == N_ONE ? '1' : '0'), i1 % w2,
-                           i1 / w2);
+                    printf("Solver: %s %i has two %c beside %i,%i, "
+                           "so it is %c\n", horizontal ? "row" : "col", l,
+                           (check == N_ONE ? '1' : '0'), i % w2, i / w2,
+                           (block == N_ONE ? '1' : '0'));
                 }
 #endif
-                state->grid[i1] = block;
-                rowcount[i1 / w2]++;
-                colcount[i1 % w2]++;
+                unruly_solver_place(state, scratch, i, block);
             }
         }
     }
@@ -596,19 +667,10 @@ static int unruly_solver_check_all_threes(game_state *state,
 {
     int ret = 0;
 
-    ret +=
-        unruly_solver_check_threes(state, scratch->zeros_rows,
-                                   scratch->zeros_cols, TRUE, N_ONE, N_ZERO);
-    ret +=
-        unruly_solver_check_threes(state, scratch->ones_rows,
-                                   scratch->ones_cols, TRUE, N_ZERO, N_ONE);
-    ret +=
-        unruly_solver_check_threes(state, scratch->zeros_rows,
-                                   scratch->zeros_cols, FALSE, N_ONE,
-                                   N_ZERO);
-    ret +=
-        unruly_solver_check_threes(state, scratch->ones_rows,
-                                   scratch->ones_cols, FALSE, N_ZERO, N_ONE);
+    ret += unruly_solver_check_threes(state, scratch, TRUE, N_ONE, N_ZERO);
+    ret += unruly_solver_check_threes(state, scratch, TRUE, N_ZERO, N_ONE);
+    ret += unruly_solver_check_threes(state, scratch, FALSE, N_ONE, N_ZERO);
+    ret += unruly_solver_check_threes(state, scratch, FALSE, N_ZERO, N_ONE);
 
     return ret;
 }
@@ -624,8 +686,14 @@ static int unruly_solver_check_uniques(game_state *state, int *rowcount,
     int nr = (horizontal ? h2 : w2);
     int nc = (horizontal ? w2 : h2);
     int max = nc / 2;
-
-    int r, r2, c;
+    int nw = (horizontal ? scratch->rowwords : scratch->colwords);
+    const unsigned int *bits = (check == N_ONE ?
+                                (horizontal ? scratch->ones_rowbits :
+                                 scratch->ones_colbits) :
+                                (horizontal ? scratch->zeros_rowbits :
+                                 scratch->zeros_colbits));
+
+    int r, r2, c, k;
     int ret = 0;
 
     /*
@@ -638,18 +706,18 @@ static int unruly_solver_check_uniques(game_state *state, int *rowcount,
         if (rowcount[r] != max)
             continue;
         for (r2 = 0; r2 < nr; r2++) {
+            const unsigned int *b1 = bits + r * nw, *b2 = bits + r2 * nw;
             int nmatch = 0, nonmatch = -1;
             if (rowcount[r2] != max-1)
                 continue;
-            for (c = 0; c < nc; c++) {
-                if (state->grid[r*rmult + c*cmult] == check) {
-                    if (state->grid[r2*rmult + c*cmult] == check)
-                        nmatch++;
-                    else
-                        nonmatch = c;
-                }
-            }
+            for (k = 0; k < nw; k++)
+                nmatch += unruly_count_bits(b1[k] & b2[k]);
             if (nmatch == max-1) {
+                /* Just one of row r's squares is missing from row r2. */
+                for (k = 0; !(b1[k] & ~b2[k]); k++);
+                for (c = 0; !((b1[k] & ~b2[k]) & (1U << c)); c++);
+                nonmatch = k * LINE_BITS + c;
+
                 int i1 = r2 * rmult + nonmatch * cmult;
                 assert(nonmatch != -1);
                 if (state->grid[i1] == block)
@@ -663,14 +731,7 @@ static int unruly_solver_check_uniques(game_state *state, int *rowcount,
                            i1 / w2);
                 }
 #endif
-                state->grid[i1] = block;
-                if (block == N_ONE) {
-                    scratch->ones_rows[i1 / w2]++;
-                    scratch->ones_cols[i1 % w2]++;
-                } else {
-                    scratch->zeros_rows[i1 / w2]++;
-                    scratch->zeros_cols[i1 % w2]++;
-                }
+                unruly_solver_place(state, scratch, i1, block);
                 ret++;
             }
         }
@@ -695,8 +756,9 @@ static int unruly_solver_check_all_uniques(game_state *state,
     return ret;
 }
 
-static int unruly_solver_fill_row(game_state *state, int i, int horizontal,
-                                  int *rowcount, int *colcount, char fill)
+static int unruly_solver_fill_row(game_state *state,
+                                  struct unruly_scratch *scratch,
+                                  int i, int horizontal, char fill)
 {
     int ret = 0;
     int w2 = state->w2, h2 = state->h2;
@@ -721,9 +783,7 @@ static int unruly_solver_fill_row(game_state *state, int i, int horizontal,
             }
 #endif
             ret++;
-            state->grid[p] = fill;
-            rowcount[(horizontal ? i : j)]++;
-            colcount[(horizontal ? j : i)]++;
+            unruly_solver_place(state, scratch, p, fill);
         }
     }
 
@@ -737,6 +797,7 @@ static int unruly_solver_fill_row(game_state *state, int i, int horizontal,
 }
 
 static int unruly_solver_check_complete_nums(game_state *state,
+                                             struct unruly_scratch *scratch,
                                              int *complete, int horizontal,
                                              int *rowcount, int *colcount,
                                              char fill)
@@ -758,8 +819,8 @@ static int unruly_solver_check_complete_nums(game_state *state,
                        (fill != N_ZERO ? '0' : '1'));
             }
 #endif
-            ret += unruly_solver_fill_row(state, i, horizontal, rowcount,
-                                          colcount, fill);
+            ret += unruly_solver_fill_row(state, scratch, i, horizontal,
+                                          fill);
         }
     }
 
@@ -772,19 +833,23 @@ static int unruly_solver_check_all_complete_nums(game_state *state,
     int ret = 0;
 
     ret +=
-        unruly_solver_check_complete_nums(state, scratch->ones_rows, TRUE,
+        unruly_solver_check_complete_nums(state, scratch,
+                                          scratch->ones_rows, TRUE,
                                           scratch->zeros_rows,
                                           scratch->zeros_cols, N_ZERO);
     ret +=
-        unruly_solver_check_complete_nums(state, scratch->ones_cols, FALSE,
+        unruly_solver_check_complete_nums(state, scratch,
+                                          scratch->ones_cols, FALSE,
                                           scratch->zeros_rows,
                                           scratch->zeros_cols, N_ZERO);
     ret +=
-        unruly_solver_check_complete_nums(state, scratch->zeros_rows, TRUE,
+        unruly_solver_check_complete_nums(state, scratch,
+                                          scratch->zeros_rows, TRUE,
                                           scratch->ones_rows,
                                           scratch->ones_cols, N_ONE);
     ret +=
-        unruly_solver_check_complete_nums(state, scratch->zeros_cols, FALSE,
+        unruly_solver_check_complete_nums(state, scratch,
+                                          scratch->zeros_cols, FALSE,
                                           scratch->ones_rows,
                                           scratch->ones_cols, N_ONE);
 
@@ -792,6 +857,7 @@ static int unruly_solver_check_all_complete_nums(game_state *state,
 }
 
 static int unruly_solver_check_near_complete(game_state *state,
+                                             struct unruly_scratch *scratch,
                                              int *complete, int horizontal,
                                              int *rowcount, int *colcount,
                                              char fill)
@@ -855,8 +921,8 @@ static int unruly_solver_check_near_complete(game_state *state,
                 }
 #endif
                 ret +=
-                    unruly_solver_fill_row(state, i, horizontal, rowcount,
-                                         colcount, fill);
+                    unruly_solver_fill_row(state, scratch, i, horizontal,
+                                           fill);
 
                 state->grid[i2] = EMPTY;
                 state->grid[i3] = EMPTY;
@@ -874,8 +940,8 @@ static int unruly_solver_check_near_complete(game_state *state,
                 }
 #endif
                 ret +=
-                    unruly_solver_fill_row(state, i, horizontal, rowcount,
-                                         colcount, fill);
+                    unruly_solver_fill_row(state, scratch, i, horizontal,
+                                           fill);
 
                 state->grid[i1] = EMPTY;
                 state->grid[i3] = EMPTY;
@@ -893,8 +959,8 @@ static int unruly_solver_check_near_complete(game_state *state,
                 }
 #endif
                 ret +=
-                    unruly_solver_fill_row(state, i, horizontal, rowcount,
-                                         colcount, fill);
+                    unruly_solver_fill_row(state, scratch, i, horizontal,
+                                           fill);
 
                 state->grid[i1] = EMPTY;
                 state->grid[i2] = EMPTY;
@@ -913,8 +979,8 @@ static int unruly_solver_check_near_complete(game_state *state,
                 }
 #endif
                 ret +=
-                    unruly_solver_fill_row(state, i, horizontal, rowcount,
-                                         colcount, fill);
+                    unruly_solver_fill_row(state, scratch, i, horizontal,
+                                           fill);
 
                 state->grid[i1] = EMPTY;
                 state->grid[i2] = EMPTY;
@@ -932,19 +998,23 @@ static int unruly_solver_check_all_near_complete(game_state *state,
     int ret = 0;
 
     ret +=
-        unruly_solver_check_near_complete(state, scratch->ones_rows, TRUE,
+        unruly_solver_check_near_complete(state, scratch,
+                                        scratch->ones_rows, TRUE,
                                         scratch->zeros_rows,
                                         scratch->zeros_cols, N_ZERO);
     ret +=
-        unruly_solver_check_near_complete(state, scratch->ones_cols, FALSE,
+        unruly_solver_check_near_complete(state, scratch,
+                                        scratch->ones_cols, FALSE,
                                         scratch->zeros_rows,
                                         scratch->zeros_cols, N_ZERO);
     ret +=
-        unruly_solver_check_near_complete(state, scratch->zeros_rows, TRUE,
+        unruly_solver_check_near_complete(state, scratch,
+                                        scratch->zeros_rows, TRUE,
                                         scratch->ones_rows,
                                         scratch->ones_cols, N_ONE);
     ret +=
-        unruly_solver_check_near_complete(state, scratch->zeros_cols, FALSE,
+        unruly_solver_check_near_complete(state, scratch,
+                                        scratch->zeros_cols, FALSE,
                                         scratch->ones_rows,
                                         scratch->ones_cols, N_ONE);
 
@@ -1251,15 +1321,8 @@ static int unruly_fill_game(game_state *state, struct unruly_scratch *scratch,
         if (state->grid[i] != EMPTY)
             continue;
 
-        if (random_upto(rs, 2)) {
-            state->grid[i] = N_ONE;
-            scratch->ones_rows[i / w2]++;
-            scratch->ones_cols[i % w2]++;
-        } else {
-            state->grid[i] = N_ZERO;
-            scratch->zeros_rows[i / w2]++;
-            scratch->zeros_cols[i % w2]++;
-        }
+        unruly_solver_place(state, scratch, i,
+                            random_upto(rs, 2) ? N_ONE : N_ZERO);
 
         unruly_solve_game(state, scratch, DIFFCOUNT);
     }
@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <math.h>
+#include <limits.h>
 
 #include "puzzles.h"
 #include "tree234.h"
@@ -42,6 +43,14 @@
 #else
 #define DRAG_THRESHOLD (CIRCLE_RADIUS * 2)
 #endif
+
+/* How far beyond its centre drawing a point can reach. */
+#ifdef VERTEX_NUMBERS
+#define REDRAW_MARGIN (DRAG_THRESHOLD * 2)
+#else
+#define REDRAW_MARGIN (CIRCLE_RADIUS + 2)
+#endif
+
 #define PREFERRED_TILESIZE 64
 
 #define FLASH_TIME 0.30F
@@ -89,6 +98,14 @@ struct game_params {
 struct graph {
     int refcount;		       /* for deallocation */
     tree234 *edges;		       /* stores `edge' structures */
+    /*
+     * The same edges as an array in the tree's order, and the
+     * indices into it of the edges meeting each point: point i's
+     * are pedges[pstart[i]] up to pedges[pstart[i+1]-1].
+     */
+    int nedges;
+    edge *elist;
+    int *pstart, *pedges;
 };
 
 struct game_state {
@@ -96,8 +113,9 @@ struct game_state {
     int w, h;			       /* extent of coordinate system only */
     point *pts;
 #ifdef SHOW_CROSSINGS
-    int *crosses;		       /* mark edges which are crossed */
+    int *crosses;		       /* how many edges cross each edge */
 #endif
+    int ncrossings;		       /* pairs of edges which cross */
     struct graph *graph;
     int completed, cheated, just_solved;
 };
@@ -764,46 +782,111 @@ static char *validate_desc(const game_params *params, const char *desc)
     return NULL;
 }
 
-static void mark_crossings(game_state *state)
+static void graph_index(struct graph *g, int n)
+{
+    edge *e;
+    int i;
+
+    g->nedges = count234(g->edges);
+    g->elist = snewn(max(g->nedges, 1), edge);
+    g->pstart = snewn(n+1, int);
+    g->pedges = snewn(max(2 * g->nedges, 1), int);
+
+    for (i = 0; i <= n; i++)
+	g->pstart[i] = 0;
+    for (i = 0; (e = index234(g->edges, i)) != NULL; i++) {
+	g->elist[i] = *e;
+	g->pstart[e->a]++;
+	g->pstart[e->b]++;
+    }
+    for (i = 1; i <= n; i++)
+	g->pstart[i] += g->pstart[i-1];
+
+    /*
+     * Now pstart[i] is the end of point i's list. Fill each list in
+     * from that end, which leaves pstart[i] pointing at its start.
+     */
+    for (i = g->nedges; i-- > 0 ;) {
+	g->pedges[--g->pstart[g->elist[i].a]] = i;
+	g->pedges[--g->pstart[g->elist[i].b]] = i;
+    }
+}
+
+/*
+ * cross() can disagree with itself about degenerate cases depending
+ * on which way round it's asked, so always ask in the same order.
+ */
+static int edges_cross(const game_state *state, int i, int j)
+{
+    const edge *e = &state->graph->elist[min(i, j)];
+    const edge *e2 = &state->graph->elist[max(i, j)];
+
+    if (e2->a == e->a || e2->a == e->b ||
+	e2->b == e->a || e2->b == e->b)
+	return FALSE;
+    return cross(state->pts[e2->a], state->pts[e2->b],
+		 state->pts[e->a], state->pts[e->b]);
+}
+
+/*
+ * Count the crossings from scratch.
+ */
+static void count_crossings(game_state *state)
 {
-    int ok = TRUE;
+    const struct graph *g = state->graph;
     int i, j;
-    edge *e, *e2;
 
+    state->ncrossings = 0;
 #ifdef SHOW_CROSSINGS
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++)
-	state->crosses[i] = FALSE;
+    for (i = 0; i < g->nedges; i++)
+	state->crosses[i] = 0;
 #endif
 
-    /*
-     * Check correctness: for every pair of edges, see whether they
-     * cross.
-     */
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
-	for (j = i+1; (e2 = index234(state->graph->edges, j)) != NULL; j++) {
-	    if (e2->a == e->a || e2->a == e->b ||
-		e2->b == e->a || e2->b == e->b)
-		continue;
-	    if (cross(state->pts[e2->a], state->pts[e2->b],
-		      state->pts[e->a], state->pts[e->b])) {
-		ok = FALSE;
+    for (i = 0; i < g->nedges; i++)
+	for (j = i+1; j < g->nedges; j++)
+	    if (edges_cross(state, i, j)) {
+		state->ncrossings++;
 #ifdef SHOW_CROSSINGS
-		state->crosses[i] = state->crosses[j] = TRUE;
-#else
-		goto done;	       /* multi-level break - sorry */
+		state->crosses[i]++;
+		state->crosses[j]++;
 #endif
 	    }
-	}
-    }
+}
 
-    /*
-     * e == NULL if we've gone through all the edge pairs
-     * without finding a crossing.
-     */
-#ifndef SHOW_CROSSINGS
-    done:
+/*
+ * Add (dir = +1) or remove (dir = -1) the crossings involving the
+ * edges at point p. Two edges at p can't cross each other, so each
+ * crossing is counted exactly once.
+ */
+static void point_crossings(game_state *state, int p, int dir)
+{
+    const struct graph *g = state->graph;
+    int k, i, j;
+
+    for (k = g->pstart[p]; k < g->pstart[p+1]; k++) {
+	i = g->pedges[k];
+	for (j = 0; j < g->nedges; j++)
+	    if (edges_cross(state, i, j)) {
+		state->ncrossings += dir;
+#ifdef SHOW_CROSSINGS
+		state->crosses[i] += dir;
+		state->crosses[j] += dir;
 #endif
-    if (ok)
+	    }
+    }
+}
+
+static void move_point(game_state *state, int p, point newpos)
+{
+    point_crossings(state, p, -1);
+    state->pts[p] = newpos;
+    point_crossings(state, p, +1);
+}
+
+static void mark_crossings(game_state *state)
+{
+    count_crossings(state);
+    if (state->ncrossings == 0)
 	state->completed = TRUE;
 }
 
@@ -845,10 +928,13 @@ static game_state *new_game(midend *me, const game_params *params,
 	}
 	addedge(state->graph->edges, a, b);
     }
+    graph_index(state->graph, n);
 
 #ifdef SHOW_CROSSINGS
-    state->crosses = snewn(count234(state->graph->edges), int);
+    state->crosses = snewn(max(state->graph->nedges, 1), int);
     mark_crossings(state);	       /* sets up `crosses' and `completed' */
+#else
+    count_crossings(state);
 #endif
 
     return state;
@@ -869,10 +955,11 @@ static game_state *dup_game(const game_state *state)
     ret->completed = state->completed;
     ret->cheated = state->cheated;
     ret->just_solved = state->just_solved;
+    ret->ncrossings = state->ncrossings;
 #ifdef SHOW_CROSSINGS
-    ret->crosses = snewn(count234(ret->graph->edges), int);
+    ret->crosses = snewn(max(ret->graph->nedges, 1), int);
     memcpy(ret->crosses, state->crosses,
-	   count234(ret->graph->edges) * sizeof(int));
+	   ret->graph->nedges * sizeof(int));
 #endif
 
     return ret;
@@ -885,6 +972,9 @@ static void free_game(game_state *state)
 	while ((e = delpos234(state->graph->edges, 0)) != NULL)
 	    sfree(e);
 	freetree234(state->graph->edges);
+	sfree(state->graph->elist);
+	sfree(state->graph->pstart);
+	sfree(state->graph->pedges);
 	sfree(state->graph);
     }
     sfree(state->pts);
@@ -1186,9 +1276,12 @@ static game_state *execute_move(const game_state *state, const char *move)
 	if (*move == 'P' &&
 	    sscanf(move+1, "%d:%ld,%ld/%ld%n", &p, &x, &y, &d, &k) == 4 &&
 	    p >= 0 && p < n && d > 0) {
-	    ret->pts[p].x = x;
-	    ret->pts[p].y = y;
-	    ret->pts[p].d = d;
+	    point newpos;
+
+	    newpos.x = x;
+	    newpos.y = y;
+	    newpos.d = d;
+	    move_point(ret, p, newpos);
 
 	    move += k+1;
 	    if (*move == ';') move++;
@@ -1198,11 +1291,208 @@ static game_state *execute_move(const game_state *state, const char *move)
 	}
     }
 
-    mark_crossings(ret);
+    if (ret->ncrossings == 0)
+	ret->completed = TRUE;
+
+    return ret;
+}
+
+/*
+ * Binary moves for the undo chain: a tag byte for each part of the
+ * move, and for a point its index, coordinates and denominator as
+ * variable-length integers (signed ones zigzag-encoded), seven bits
+ * to a byte with the top bit meaning more follow.
+ */
+#define ENC_SOLVE 0
+#define ENC_POINT 1
+
+static unsigned char *put_uvarint(unsigned char *p, unsigned long v)
+{
+    while (v >= 0x80) {
+	*p++ = (unsigned char)(v | 0x80);
+	v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static unsigned char *put_svarint(unsigned char *p, long v)
+{
+    return put_uvarint(p, v < 0 ? ~((unsigned long)v << 1)
+		       : (unsigned long)v << 1);
+}
+
+static int get_uvarint(const unsigned char **pp, const unsigned char *end,
+		       unsigned long *v)
+{
+    const unsigned char *p = *pp;
+    int shift = 0;
+
+    *v = 0;
+    do {
+	if (p >= end || shift >= (int)(8 * sizeof(*v)))
+	    return FALSE;
+	*v |= (unsigned long)(*p & 0x7F) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    return TRUE;
+}
+
+static int get_svarint(const unsigned char **pp, const unsigned char *end,
+		       long *v)
+{
+    unsigned long u;
 
+    if (!get_uvarint(pp, end, &u))
+	return FALSE;
+    *v = (u & 1) ? ~(long)(u >> 1) : (long)(u >> 1);
+    return TRUE;
+}
+
+static unsigned char *encode_move(const char *move, int *len)
+{
+    /* At worst a point's 8 characters of text become 1+3*10+5 bytes */
+    unsigned char *ret = snewn(strlen(move) * 5 + 8, unsigned char), *q = ret;
+    int p, k;
+    long x, y, d;
+
+    while (*move) {
+	if (*move == 'S') {
+	    *q++ = ENC_SOLVE;
+	    move++;
+	    if (*move == ';') move++;
+	} else if (*move == 'P' &&
+		   sscanf(move+1, "%d:%ld,%ld/%ld%n", &p, &x, &y, &d, &k) == 4 &&
+		   p >= 0 && d > 0) {
+	    *q++ = ENC_POINT;
+	    q = put_uvarint(q, p);
+	    q = put_svarint(q, x);
+	    q = put_svarint(q, y);
+	    q = put_uvarint(q, d);
+	    move += k+1;
+	    if (*move == ';') move++;
+	} else {
+	    sfree(ret);
+	    return NULL;
+	}
+    }
+    *len = q - ret;
+    return sresize(ret, max(*len, 1), unsigned char);
+}
+
+static char *decode_move(const unsigned char *enc, int len)
+{
+    const unsigned char *p = enc, *end = enc + len;
+    char *ret = snewn(len * 8 + 1, char), *q = ret;
+    unsigned long pt, d;
+    long x, y;
+
+    while (p < end) {
+	if (q > ret)
+	    *q++ = ';';
+	if (*p == ENC_SOLVE) {
+	    p++;
+	    *q++ = 'S';
+	} else if (*p++ == ENC_POINT &&
+		   get_uvarint(&p, end, &pt) &&
+		   get_svarint(&p, end, &x) &&
+		   get_svarint(&p, end, &y) &&
+		   get_uvarint(&p, end, &d)) {
+	    q += sprintf(q, "P%lu:%ld,%ld/%lu", pt, x, y, d);
+	} else {
+	    sfree(ret);
+	    return NULL;
+	}
+    }
+    *q = '\0';
     return ret;
 }
 
+static game_state *execute_encoded_move(const game_state *state,
+					const unsigned char *enc, int len)
+{
+    const unsigned char *p = enc, *end = enc + len;
+    game_state *ret = dup_game(state);
+    unsigned long pt, d;
+    point newpos;
+
+    ret->just_solved = FALSE;
+
+    while (p < end) {
+	if (*p == ENC_SOLVE) {
+	    p++;
+	    ret->cheated = ret->just_solved = TRUE;
+	} else if (*p++ == ENC_POINT &&
+		   get_uvarint(&p, end, &pt) && pt < (unsigned long)state->params.n &&
+		   get_svarint(&p, end, &newpos.x) &&
+		   get_svarint(&p, end, &newpos.y) &&
+		   get_uvarint(&p, end, &d) && d > 0 && d <= LONG_MAX) {
+	    newpos.d = d;
+	    move_point(ret, pt, newpos);
+	} else {
+	    free_game(ret);
+	    return NULL;
+	}
+    }
+
+    if (ret->ncrossings == 0)
+	ret->completed = TRUE;
+
+    return ret;
+}
+
+/*
+ * Snapshot encoding for saves: the flags, then every point.
+ */
+static char *encode_state(const game_state *state)
+{
+    int n = state->params.n;
+    char *ret = snewn(n * 70 + 40, char), *p = ret;
+    int i;
+
+    p += sprintf(p, "%d,%d,%d", state->completed, state->cheated,
+		 state->just_solved);
+    for (i = 0; i < n; i++)
+	p += sprintf(p, ";%ld,%ld/%ld", state->pts[i].x, state->pts[i].y,
+		     state->pts[i].d);
+    return ret;
+}
+
+static game_state *decode_state(const game_state *initial, const char *str)
+{
+    int n = initial->params.n;
+    int i, flags[3];
+    char *p = (char *)str;
+    game_state *ret = dup_game(initial);
+
+    for (i = 0; i < 3; i++) {
+	if (i > 0 && *p++ != ',') goto fail;
+	flags[i] = strtol(p, &p, 10);
+    }
+    for (i = 0; i < n; i++) {
+	point *pt = &ret->pts[i];
+	if (*p++ != ';') goto fail;
+	pt->x = strtol(p, &p, 10);
+	if (*p++ != ',') goto fail;
+	pt->y = strtol(p, &p, 10);
+	if (*p++ != '/') goto fail;
+	pt->d = strtol(p, &p, 10);
+	if (pt->d <= 0) goto fail;
+    }
+    if (*p) goto fail;
+
+    mark_crossings(ret);
+    ret->completed = flags[0];
+    ret->cheated = flags[1];
+    ret->just_solved = flags[2];
+    return ret;
+
+    fail:
+    free_game(ret);
+    return NULL;
+}
+
 /* ----------------------------------------------------------------------
  * Drawing routines.
  */
@@ -1310,15 +1600,20 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
                         int dir, const game_ui *ui,
                         float animtime, float flashtime)
 {
+    const struct graph *g = state->graph;
     int w, h;
-    edge *e;
     int i, j;
-    int bg, points_moved;
+    int bg, points_moved, lastmoved;
+    long ox = 0, oy = 0;
+    int partial;
+    long x0, y0, x1, y1;
 
     /*
-     * There's no terribly sensible way to do partial redraws of
-     * this game, so I'm going to have to resort to redrawing the
-     * whole thing every time.
+     * Mostly we redraw the whole thing every time. But while a
+     * single point is being dragged, only the part of the picture
+     * containing it and its edges, before and after, can have
+     * changed, and we redraw just that; with a lot of points this
+     * is what keeps dragging smooth.
      */
 
     if (flashtime == 0)
@@ -1338,7 +1633,8 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
      * Also in this loop we work out the coordinates of all the
      * points for this redraw.
      */
-    points_moved = FALSE;
+    points_moved = 0;
+    lastmoved = -1;
     for (i = 0; i < state->params.n; i++) {
         point p = state->pts[i];
         long x, y;
@@ -1352,8 +1648,12 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 	x = p.x * ds->tilesize / p.d;
 	y = p.y * ds->tilesize / p.d;
 
-        if (ds->x[i] != x || ds->y[i] != y)
-            points_moved = TRUE;
+        if (ds->x[i] != x || ds->y[i] != y) {
+            points_moved++;
+            lastmoved = i;
+            ox = ds->x[i];
+            oy = ds->y[i];
+        }
 
         ds->x[i] = x;
         ds->y[i] = y;
@@ -1362,17 +1662,62 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
     if (ds->bg == bg && ds->dragpoint == ui->dragpoint && !points_moved)
         return;                        /* nothing to do */
 
+    /*
+     * Crossing colours can change anywhere at once, so with those
+     * shown we always redraw everything.
+     */
+#ifdef SHOW_CROSSINGS
+    partial = FALSE;
+#else
+    partial = (ds->bg == bg && ds->dragpoint == ui->dragpoint &&
+               points_moved == 1 && ox >= 0);
+#endif
+
     ds->dragpoint = ui->dragpoint;
     ds->bg = bg;
 
     game_compute_size(&state->params, ds->tilesize, &w, &h);
-    draw_rect(dr, 0, 0, w, h, bg);
+    if (partial) {
+        int p = lastmoved, k;
+
+        x0 = min(ox, ds->x[p]);
+        x1 = max(ox, ds->x[p]);
+        y0 = min(oy, ds->y[p]);
+        y1 = max(oy, ds->y[p]);
+        for (k = g->pstart[p]; k < g->pstart[p+1]; k++) {
+            const edge *e = &g->elist[g->pedges[k]];
+            int q = (e->a == p ? e->b : e->a);
+            x0 = min(x0, ds->x[q]);
+            x1 = max(x1, ds->x[q]);
+            y0 = min(y0, ds->y[q]);
+            y1 = max(y1, ds->y[q]);
+        }
+        x0 = max(x0 - REDRAW_MARGIN, 0);
+        y0 = max(y0 - REDRAW_MARGIN, 0);
+        x1 = min(x1 + REDRAW_MARGIN + 1, w);
+        y1 = min(y1 + REDRAW_MARGIN + 1, h);
+        clip(dr, x0, y0, x1 - x0, y1 - y0);
+    } else {
+        x0 = y0 = 0;
+        x1 = w;
+        y1 = h;
+    }
+    draw_rect(dr, x0, y0, x1 - x0, y1 - y0, bg);
 
     /*
      * Draw the edges.
      */
 
-    for (i = 0; (e = index234(state->graph->edges, i)) != NULL; i++) {
+    for (i = 0; i < g->nedges; i++) {
+        const edge *e = &g->elist[i];
+
+        if (partial &&
+            (max(ds->x[e->a], ds->x[e->b]) < x0 ||
+             min(ds->x[e->a], ds->x[e->b]) >= x1 ||
+             max(ds->y[e->a], ds->y[e->b]) < y0 ||
+             min(ds->y[e->a], ds->y[e->b]) >= y1))
+            continue;
+
 	draw_line(dr, ds->x[e->a], ds->y[e->a], ds->x[e->b], ds->y[e->b],
 #ifdef SHOW_CROSSINGS
 		  (oldstate?oldstate:state)->crosses[i] ?
@@ -1393,6 +1738,13 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 	for (i = 0; i < state->params.n; i++) {
             int c;
 
+            if (partial &&
+                (ds->x[i] + REDRAW_MARGIN < x0 ||
+                 ds->x[i] - REDRAW_MARGIN >= x1 ||
+                 ds->y[i] + REDRAW_MARGIN < y0 ||
+                 ds->y[i] - REDRAW_MARGIN >= y1))
+                continue;
+
 	    if (ui->dragpoint == i) {
 		c = COL_DRAGPOINT;
 	    } else if (ui->dragpoint >= 0 &&
@@ -1420,7 +1772,9 @@ static void game_redraw(drawing *dr, game_drawstate *ds,
 	}
     }
 
-    draw_update(dr, 0, 0, w, h);
+    if (partial)
+        unclip(dr);
+    draw_update(dr, x0, y0, x1 - x0, y1 - y0);
 }
 
 static float game_anim_length(const game_state *oldstate,
@@ -1508,4 +1862,8 @@ const struct game thegame = {
     FALSE,			       /* wants_statusbar */
     FALSE, game_timing_state,
     SOLVE_ANIMATES,		       /* flags */
+    16,				       /* undo_keyframe_interval */
+    encode_state, decode_state,
+    NULL,			       /* update_status */
+    encode_move, decode_move, execute_encoded_move,
 };